@@ -1110,6 +1110,33 @@ pinos_stream_get_time (PinosStream *stream,
   return true;
 }
 
+/**
+ * pinos_stream_send_qos:
+ * @stream: a #PinosStream
+ * @interval: the minimum time in nanoseconds between two buffers
+ *
+ * Tell the server that @stream can't handle more than one buffer every
+ * @interval nanoseconds. The server then skips the other buffers before
+ * they are sent to @stream. Use 0 to get all buffers again.
+ *
+ * Returns: %true on success.
+ */
+bool
+pinos_stream_send_qos (PinosStream *stream,
+                       int64_t      interval)
+{
+  PinosStreamImpl *impl = SPA_CONTAINER_OF (stream, PinosStreamImpl, this);
+  SpaEventNodeQoS qos = SPA_EVENT_NODE_QOS_INIT (stream->context->type.event_node.QoS,
+                                                 interval);
+
+  if (impl->node_proxy == NULL)
+    return false;
+
+  pinos_client_node_do_event (impl->node_proxy, (SpaEvent*)&qos);
+
+  return true;
+}
+
 /**
  * pinos_stream_get_empty_buffer:
  * @stream: a #PinosStream
@@ -118,6 +118,8 @@ bool             pinos_stream_finish_format     (PinosStream     *stream,
 
 bool             pinos_stream_get_time          (PinosStream     *stream,
                                                  PinosTime       *time);
+bool             pinos_stream_send_qos          (PinosStream     *stream,
+                                                 int64_t          interval);
 
 uint32_t         pinos_stream_get_empty_buffer  (PinosStream     *stream);
 bool             pinos_stream_recycle_buffer    (PinosStream     *stream,
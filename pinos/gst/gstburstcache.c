@@ -104,6 +104,8 @@
 #define DEFAULT_BUFFERS_MIN             -1
 #define DEFAULT_RECOVER                 GST_BURST_CACHE_RECOVER_NONE
 
+#define DEFAULT_RING_SIZE               16
+
 enum
 {
   PROP_0,
@@ -131,6 +133,24 @@ G_DEFINE_TYPE (GstBurstCache, gst_burst_cache, G_TYPE_OBJECT);
 
 #define VALUE_INVALID ((guint64)-1)
 
+/* Buffers are kept in a ring and addressed by an ever increasing sequence
+ * number. Positions count backwards from the most recent buffer, which is at
+ * position 0, and are only used to express burst and lag amounts. */
+#define CACHE_LEN(c)            ((gint) ((c)->head_seq - (c)->tail_seq))
+#define CACHE_ENTRY(c,seq)      (&(c)->ring[(seq) & (c)->ring_mask])
+#define POS_TO_SEQ(c,pos)       ((c)->head_seq - 1 - (gint64) (pos))
+#define SEQ_TO_POS(c,seq)       ((gint) ((gint64) (c)->head_seq - 1 - (gint64) (seq)))
+
+/* an entry in the ring. The prefix sums make it possible to find the
+ * position for an amount of bytes or time with a binary search. */
+struct _GstBurstCacheEntry
+{
+  GstBuffer *buffer;
+  guint64 bytes;                /* bytes queued before this buffer */
+  GstClockTime time;            /* highest timestamp up to this buffer */
+  GQueue readers;               /* readers that get this buffer next */
+};
+
 static void gst_burst_cache_finalize (GObject * object);
 
 G_DEFINE_POINTER_TYPE (GstBurstCacheReader, gst_burst_cache_reader);
@@ -142,7 +162,7 @@ static gboolean is_keyframe (GstBurstCache * cache, GstBuffer * buffer);
 
 static gint get_buffers_max (GstBurstCache * cache, GstFormat format,
     gint64 max);
-static gint gst_burst_cache_recover_reader (GstBurstCache * cache,
+static guint64 gst_burst_cache_recover_reader (GstBurstCache * cache,
     GstBurstCacheReader * reader);
 static gboolean find_limits (GstBurstCache * cache, gint * min_idx,
     gint bytes_min, gint buffers_min, gint64 time_min, gint * max_idx,
@@ -164,7 +184,15 @@ static void
 gst_burst_cache_init (GstBurstCache * this)
 {
   CACHE_LOCK_INIT (this);
-  this->bufqueue = g_ptr_array_new ();
+  this->ring = g_new0 (GstBurstCacheEntry, DEFAULT_RING_SIZE);
+  this->ring_mask = DEFAULT_RING_SIZE - 1;
+  this->last_time = GST_CLOCK_TIME_NONE;
+  this->timed_seq = VALUE_INVALID;
+  this->keyframes = g_array_new (FALSE, FALSE, sizeof (guint64));
+  g_queue_init (&this->waiting);
+  g_queue_init (&this->new_readers);
+  g_queue_init (&this->kf_readers);
+  this->timeouts = g_ptr_array_new ();
   this->limit_format = DEFAULT_LIMIT_FORMAT;
   this->limit_max = DEFAULT_LIMIT_MAX;
   this->limit_soft_max = DEFAULT_LIMIT_SOFT_MAX;
@@ -179,13 +207,17 @@ static void
 gst_burst_cache_finalize (GObject * object)
 {
   GstBurstCache *this;
+  guint64 seq;
 
   this = GST_BURST_CACHE (object);
 
   g_hook_list_clear (&this->readers);
+  g_ptr_array_free (this->timeouts, TRUE);
 
-  g_ptr_array_foreach (this->bufqueue, (GFunc) gst_buffer_unref, NULL);
-  g_ptr_array_free (this->bufqueue, TRUE);
+  for (seq = this->tail_seq; seq < this->head_seq; seq++)
+    gst_buffer_unref (CACHE_ENTRY (this, seq)->buffer);
+  g_free (this->ring);
+  g_array_free (this->keyframes, TRUE);
   CACHE_LOCK_CLEAR (this);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
@@ -347,8 +379,10 @@ gst_burst_cache_reader_new (GstBurstCache * cache,
 
   reader->hook.data = reader;
   reader->hook.destroy = (GDestroyNotify) gst_burst_cache_reader_destroy;
+  reader->link.data = reader;
+  reader->queue = NULL;
 
-  reader->bufpos = -1;
+  reader->seq = VALUE_INVALID;
   reader->draincount = -1;
   reader->new_reader = TRUE;
   reader->discont = FALSE;
@@ -422,6 +456,212 @@ is_keyframe (GstBurstCache * cache, GstBuffer * buffer)
   return FALSE;
 }
 
+/* The readers with a timeout are kept in a binary heap on their deadline,
+ * last_activity_time + timeout. Activity only moves the deadline later and
+ * does not touch the heap, the deadline in the heap is the earliest time
+ * the reader can time out. A reader that was active by then is moved down
+ * to its new deadline when it gets to the top. */
+#define TIMEOUT_HEAP(c,i)       ((GstBurstCacheReader *) g_ptr_array_index ((c)->timeouts, (i)))
+
+static void
+timeout_heap_set (GstBurstCache * cache, guint i, GstBurstCacheReader * reader)
+{
+  g_ptr_array_index (cache->timeouts, i) = reader;
+  reader->timeout_pos = i + 1;
+}
+
+static void
+timeout_heap_up (GstBurstCache * cache, guint i)
+{
+  GstBurstCacheReader *reader = TIMEOUT_HEAP (cache, i);
+
+  while (i > 0) {
+    guint parent = (i - 1) / 2;
+
+    if (TIMEOUT_HEAP (cache, parent)->deadline <= reader->deadline)
+      break;
+    timeout_heap_set (cache, i, TIMEOUT_HEAP (cache, parent));
+    i = parent;
+  }
+  timeout_heap_set (cache, i, reader);
+}
+
+static void
+timeout_heap_down (GstBurstCache * cache, guint i)
+{
+  GstBurstCacheReader *reader = TIMEOUT_HEAP (cache, i);
+  guint len = cache->timeouts->len;
+
+  while (2 * i + 1 < len) {
+    guint child = 2 * i + 1;
+
+    if (child + 1 < len &&
+        TIMEOUT_HEAP (cache, child + 1)->deadline < TIMEOUT_HEAP (cache, child)->deadline)
+      child++;
+    if (reader->deadline <= TIMEOUT_HEAP (cache, child)->deadline)
+      break;
+    timeout_heap_set (cache, i, TIMEOUT_HEAP (cache, child));
+    i = child;
+  }
+  timeout_heap_set (cache, i, reader);
+}
+
+static void
+timeout_heap_remove (GstBurstCache * cache, GstBurstCacheReader * reader)
+{
+  GstBurstCacheReader *last;
+  guint i;
+
+  if (reader->timeout_pos == 0)
+    return;
+
+  i = reader->timeout_pos - 1;
+  reader->timeout_pos = 0;
+  last = g_ptr_array_remove_index (cache->timeouts, cache->timeouts->len - 1);
+  if (last == reader)
+    return;
+
+  /* fill the hole with the last reader */
+  timeout_heap_set (cache, i, last);
+  timeout_heap_up (cache, i);
+  timeout_heap_down (cache, last->timeout_pos - 1);
+}
+
+/* put @reader in the heap with its current deadline, readers without a
+ * timeout are left out */
+static void
+timeout_heap_update (GstBurstCache * cache, GstBurstCacheReader * reader)
+{
+  timeout_heap_remove (cache, reader);
+  if (reader->timeout == 0)
+    return;
+
+  reader->deadline = reader->last_activity_time + reader->timeout;
+  g_ptr_array_add (cache->timeouts, reader);
+  timeout_heap_up (cache, cache->timeouts->len - 1);
+}
+
+/**
+ * gst_burst_cache_reader_set_timeout:
+ * @cache: a #GstBurstCache
+ * @reader: a #GstBurstCacheReader
+ * @timeout: timeout in microseconds, 0 disables the timeout
+ *
+ * Remove @reader from @cache when it did not get a buffer for longer than
+ * @timeout. The time is counted from the last buffer @reader got or from
+ * when it was made. This can be called before and after @reader is added.
+ */
+void
+gst_burst_cache_reader_set_timeout (GstBurstCache * cache,
+    GstBurstCacheReader * reader, guint64 timeout)
+{
+  g_return_if_fail (GST_IS_BURST_CACHE (cache));
+  g_return_if_fail (reader != NULL);
+
+  CACHE_LOCK (cache);
+  reader->timeout = timeout;
+  if (G_HOOK_IS_VALID (reader))
+    timeout_heap_update (cache, reader);
+  CACHE_UNLOCK (cache);
+}
+
+/* move @reader to the tail of @queue, removing it from the queue it was
+ * in. @queue can be %NULL to only remove the reader. */
+static void
+reader_enqueue (GstBurstCache * cache, GstBurstCacheReader * reader,
+    GQueue * queue)
+{
+  if (reader->queue)
+    g_queue_unlink (reader->queue, &reader->link);
+  reader->queue = queue;
+  if (queue)
+    g_queue_push_tail_link (queue, &reader->link);
+}
+
+/* position @reader so that the buffer with @seq is the next one it will
+ * receive. When @seq is the next buffer to be queued, the reader is waiting
+ * for data. */
+static void
+reader_set_seq (GstBurstCache * cache, GstBurstCacheReader * reader,
+    guint64 seq)
+{
+  reader->seq = seq;
+  if (seq == cache->head_seq) {
+    reader_enqueue (cache, reader, &cache->waiting);
+  } else {
+    reader_enqueue (cache, reader, &CACHE_ENTRY (cache, seq)->readers);
+    if (seq < cache->min_seq)
+      cache->min_seq = seq;
+  }
+}
+
+/* find the oldest buffer that still has a reader positioned on it. Readers
+ * only move forward except when they are positioned before min_seq, which
+ * then lowers min_seq, so this is amortized constant time.
+ * Returns: the sequence number or head_seq when all readers are waiting.
+ */
+static guint64
+find_min_seq (GstBurstCache * cache)
+{
+  guint64 seq;
+
+  seq = MAX (cache->min_seq, cache->tail_seq);
+  while (seq < cache->head_seq &&
+      CACHE_ENTRY (cache, seq)->readers.length == 0)
+    seq++;
+  cache->min_seq = seq;
+
+  return seq;
+}
+
+/* double the size of the ring when it is full */
+static void
+grow_ring (GstBurstCache * cache)
+{
+  GstBurstCacheEntry *ring;
+  guint size, mask;
+  guint64 seq;
+
+  size = (cache->ring_mask + 1) * 2;
+  mask = size - 1;
+  ring = g_new0 (GstBurstCacheEntry, size);
+
+  for (seq = cache->tail_seq; seq < cache->head_seq; seq++) {
+    GstBurstCacheEntry *entry = &ring[seq & mask];
+    GList *l;
+
+    *entry = *CACHE_ENTRY (cache, seq);
+    /* the readers point to the queue they are in */
+    for (l = entry->readers.head; l; l = l->next)
+      ((GstBurstCacheReader *) l->data)->queue = &entry->readers;
+  }
+  g_free (cache->ring);
+  cache->ring = ring;
+  cache->ring_mask = mask;
+
+  GST_DEBUG_OBJECT (cache, "ring grown to %u buffers", size);
+}
+
+/* index in the keyframe index of the first keyframe with a sequence
+ * number >= @seq */
+static guint
+keyframe_lower_bound (GstBurstCache * cache, guint64 seq)
+{
+  guint lo, hi;
+
+  lo = cache->kf_first;
+  hi = cache->keyframes->len;
+  while (lo < hi) {
+    guint mid = lo + (hi - lo) / 2;
+
+    if (g_array_index (cache->keyframes, guint64, mid) < seq)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
 /* find the keyframe in the list of buffers starting the
  * search from @idx. @direction as -1 will search backwards,
  * 1 will search forwards.
@@ -430,27 +670,77 @@ is_keyframe (GstBurstCache * cache, GstBuffer * buffer)
 static gint
 find_keyframe (GstBurstCache * cache, gint idx, gint direction)
 {
-  gint i, len, result;
+  guint64 seq;
+  guint i;
+  gint result;
+
+  if (idx < 0 || idx >= CACHE_LEN (cache))
+    return -1;
+
+  /* positions go from new to old, the keyframe index from old to new */
+  seq = POS_TO_SEQ (cache, idx);
+  if (direction > 0) {
+    /* newest keyframe at or before seq */
+    i = keyframe_lower_bound (cache, seq + 1);
+    if (i == cache->kf_first)
+      return -1;
+    i--;
+  } else {
+    /* oldest keyframe at or after seq */
+    i = keyframe_lower_bound (cache, seq);
+    if (i == cache->keyframes->len)
+      return -1;
+  }
+
+  result = SEQ_TO_POS (cache, g_array_index (cache->keyframes, guint64, i));
+  GST_LOG_OBJECT (cache, "found keyframe at %d from %d, direction %d",
+      result, idx, direction);
 
-  /* take length of queued buffers */
-  len = cache->bufqueue->len;
+  return result;
+}
 
-  /* assume we don't find a keyframe */
-  result = -1;
+/* find the first position in the queue where the buffers from the most recent
+ * one up to and including that position contain at least @amount bytes or
+ * span at least @amount time. Buffers without a timestamp take the highest
+ * timestamp seen before them.
+ * Returns: the position or -1 if there is not enough data in the queue.
+ */
+static gint
+find_position (GstBurstCache * cache, GstFormat format, guint64 amount)
+{
+  guint64 first, lo, hi;
 
-  /* then loop over all buffers to find the first keyframe */
-  for (i = idx; i >= 0 && i < len; i += direction) {
-    GstBuffer *buf;
+  if (format == GST_FORMAT_TIME) {
+    if (cache->timed_seq == VALUE_INVALID)
+      return -1;
+    first = MAX (cache->tail_seq, cache->timed_seq);
+  } else {
+    first = cache->tail_seq;
+  }
 
-    buf = g_ptr_array_index (cache->bufqueue, i);
-    if (is_keyframe (cache, buf)) {
-      GST_LOG_OBJECT (cache, "found keyframe at %d from %d, direction %d",
-          i, idx, direction);
-      result = i;
-      break;
-    }
+  /* the amount only grows for older buffers, find the newest buffer that
+   * does not have enough */
+  lo = first;
+  hi = cache->head_seq;
+  while (lo < hi) {
+    guint64 mid = lo + (hi - lo) / 2;
+    GstBurstCacheEntry *entry = CACHE_ENTRY (cache, mid);
+    guint64 value;
+
+    if (format == GST_FORMAT_TIME)
+      value = cache->last_time - entry->time;
+    else
+      value = cache->bytes_total - entry->bytes;
+
+    if (value >= amount)
+      lo = mid + 1;
+    else
+      hi = mid;
   }
-  return result;
+  if (lo == first)
+    return -1;
+
+  return SEQ_TO_POS (cache, lo - 1);
 }
 
 /* Get the number of buffers from the buffer queue needed to satisfy
@@ -464,46 +754,15 @@ get_buffers_max (GstBurstCache * cache, GstFormat format, gint64 max)
     case GST_FORMAT_BUFFERS:
       return max;
     case GST_FORMAT_TIME:
-    {
-      GstBuffer *buf;
-      int i;
-      int len;
-      gint64 diff;
-      GstClockTime first = GST_CLOCK_TIME_NONE;
-
-      len = cache->bufqueue->len;
-
-      for (i = 0; i < len; i++) {
-        buf = g_ptr_array_index (cache->bufqueue, i);
-        if (GST_BUFFER_TIMESTAMP_IS_VALID (buf)) {
-          if (first == GST_CLOCK_TIME_NONE)
-            first = GST_BUFFER_TIMESTAMP (buf);
-
-          diff = first - GST_BUFFER_TIMESTAMP (buf);
-
-          if (diff > max)
-            return i + 1;
-        }
-      }
-      return len + 1;
-    }
     case GST_FORMAT_BYTES:
     {
-      GstBuffer *buf;
-      int i;
-      int len;
-      gint acc = 0;
+      gint pos;
 
-      len = cache->bufqueue->len;
-
-      for (i = 0; i < len; i++) {
-        buf = g_ptr_array_index (cache->bufqueue, i);
-        acc += gst_buffer_get_size (buf);
-
-        if (acc > max)
-          return i + 1;
-      }
-      return len + 1;
+      /* first position that exceeds max */
+      pos = find_position (cache, format, max + 1);
+      if (pos == -1)
+        return CACHE_LEN (cache) + 1;
+      return pos + 1;
     }
     default:
       return max;
@@ -527,12 +786,10 @@ find_limits (GstBurstCache * cache,
     gint * min_idx, gint bytes_min, gint buffers_min, gint64 time_min,
     gint * max_idx, gint bytes_max, gint buffers_max, gint64 time_max)
 {
-  GstClockTime first, time;
-  gint i, len, bytes;
-  gboolean result, max_hit;
+  gint len, pos, min, max;
 
   /* take length of queue */
-  len = cache->bufqueue->len;
+  len = CACHE_LEN (cache);
 
   /* this must hold */
   g_assert (len > 0);
@@ -550,78 +807,34 @@ find_limits (GstBurstCache * cache,
     return FALSE;
   }
 
-  result = FALSE;
-  /* else count bytes and time */
-  first = -1;
-  bytes = 0;
-  /* unset limits */
-  *min_idx = -1;
-  *max_idx = -1;
-  max_hit = FALSE;
-
-  i = 0;
-  /* loop through the buffers, when a limit is ok, mark it
-   * as -1, we have at least one buffer in the queue. */
-  do {
-    GstBuffer *buf;
-
-    /* if we checked all min limits, update result */
-    if (bytes_min == -1 && time_min == -1 && *min_idx == -1) {
-      /* don't go below 0 */
-      *min_idx = MAX (i - 1, 0);
-    }
-    /* if we reached one max limit break out */
-    if (max_hit) {
-      /* i > 0 when we get here, we subtract one to get the position
-       * of the previous buffer. */
-      *max_idx = i - 1;
-      /* we have valid complete result if we found a min_idx too */
-      result = *min_idx != -1;
-      break;
-    }
-    buf = g_ptr_array_index (cache->bufqueue, i);
-
-    bytes += gst_buffer_get_size (buf);
-
-    /* take timestamp and save for the base first timestamp */
-    if ((time = GST_BUFFER_TIMESTAMP (buf)) != GST_CLOCK_TIME_NONE) {
-      GST_LOG_OBJECT (cache, "Ts %" GST_TIME_FORMAT " on buffer",
-          GST_TIME_ARGS (time));
-      if (first == GST_CLOCK_TIME_NONE)
-        first = time;
-
-      /* increase max usage if we did not fill enough. Note that
-       * buffers are sorted from new to old, so the first timestamp is
-       * bigger than the next one. */
-      if (time_min != -1 && first - time >= (guint64) time_min)
-        time_min = -1;
-      if (time_max != -1 && first - time >= (guint64) time_max)
-        max_hit = TRUE;
-    } else {
-      GST_LOG_OBJECT (cache, "No timestamp on buffer");
-    }
-    /* time is OK or unknown, check and increase if not enough bytes */
-    if (bytes_min != -1) {
-      if (bytes >= bytes_min)
-        bytes_min = -1;
-    }
-    if (bytes_max != -1) {
-      if (bytes >= bytes_max) {
-        max_hit = TRUE;
-      }
-    }
-    i++;
+  /* the min limits are satisfied where the last of them is satisfied */
+  min = 0;
+  if (bytes_min != -1) {
+    pos = find_position (cache, GST_FORMAT_BYTES, bytes_min);
+    min = pos == -1 ? -1 : MAX (min, pos);
+  }
+  if (min != -1 && time_min != -1) {
+    pos = find_position (cache, GST_FORMAT_TIME, time_min);
+    min = pos == -1 ? -1 : MAX (min, pos);
+  }
+
+  /* the max limit is reached where the first of them is hit */
+  max = -1;
+  if (bytes_max != -1)
+    max = find_position (cache, GST_FORMAT_BYTES, bytes_max);
+  if (time_max != -1) {
+    pos = find_position (cache, GST_FORMAT_TIME, time_max);
+    if (pos != -1 && (max == -1 || pos < max))
+      max = pos;
   }
-  while (i < len);
 
   /* if we did not hit the max or min limit, set to buffer size */
-  if (*max_idx == -1)
-    *max_idx = len - 1;
+  *max_idx = max == -1 ? len - 1 : max;
   /* make sure min does not exceed max */
-  if (*min_idx == -1)
-    *min_idx = *max_idx;
+  *min_idx = min == -1 || min > *max_idx ? *max_idx : min;
 
-  return result;
+  /* we have valid complete result if we found a min before the max */
+  return max != -1 && min != -1 && min <= max;
 }
 
 /* parse the unit/value pair and assign it to the result value of the
@@ -680,50 +893,36 @@ count_burst_unit (GstBurstCache * cache, gint * min_idx,
 
 /* decide where in the current buffer queue this new reader should start
  * receiving buffers from.
- * This function is called whenever a reader is added and has not yet
- * received a buffer.
+ * This function is called whenever a reader is added and, for readers that
+ * could not be positioned yet, when a new buffer is queued. Readers waiting
+ * for the next keyframe are positioned in gst_burst_cache_queue_buffer().
  */
 static void
 handle_new_reader (GstBurstCache * cache, GstBurstCacheReader * reader)
 {
-  gint position;
+  gint position, len;
+
+  len = CACHE_LEN (cache);
 
   GST_DEBUG_OBJECT (cache,
       "%s new reader, deciding where to start in queue", reader->debug);
-  GST_DEBUG_OBJECT (cache, "queue is currently %d buffers long",
-      cache->bufqueue->len);
+  GST_DEBUG_OBJECT (cache, "queue is currently %d buffers long", len);
 
   switch (reader->start_method) {
     case GST_BURST_CACHE_START_LATEST:
       /* no syncing, we are happy with whatever the reader is going to get */
-      position = reader->bufpos;
       GST_DEBUG_OBJECT (cache,
-          "%s BURST_CACHE_START_LATEST, position %d", reader->debug, position);
-      break;
+          "%s BURST_CACHE_START_LATEST, waiting for next buffer",
+          reader->debug);
+      reader->new_reader = FALSE;
+      reader_set_seq (cache, reader, cache->head_seq);
+      return;
     case GST_BURST_CACHE_START_NEXT_KEYFRAME:
-    {
-      /* if one of the new buffers (between reader->bufpos and 0) in the queue
-       * is a key frame, we can proceed, otherwise we need to keep waiting */
-      GST_LOG_OBJECT (cache,
-          "%s new reader, bufpos %d, waiting for keyframe",
-          reader->debug, reader->bufpos);
-
-      position = find_prev_keyframe (cache, reader->bufpos);
-      if (position != -1) {
-        GST_DEBUG_OBJECT (cache,
-            "%s BURST_CACHE_START_NEXT_KEYFRAME: position %d", reader->debug,
-            position);
-        break;
-      }
-
-      /* reader is not on a keyframe, need to skip these buffers and
-       * wait some more */
-      GST_LOG_OBJECT (cache,
-          "%s new reader, skipping buffer(s), no keyframe found",
+      /* the reader is positioned when the next keyframe is queued */
+      GST_LOG_OBJECT (cache, "%s new reader, waiting for keyframe",
           reader->debug);
-      reader->bufpos = -1;
+      position = -1;
       break;
-    }
     case GST_BURST_CACHE_START_LATEST_KEYFRAME:
     {
       GST_DEBUG_OBJECT (cache, "%s BURST_CACHE_START_LATEST_KEYFRAME",
@@ -745,9 +944,7 @@ handle_new_reader (GstBurstCache * cache, GstBurstCacheReader * reader)
       GST_DEBUG_OBJECT (cache,
           "%s BURST_CACHE_START_LATEST_KEYFRAME: no keyframe found, "
           "switching to BURST_CACHE_START_NEXT_KEYFRAME", reader->debug);
-      /* throw reader to the waiting state */
-      reader->bufpos = -1;
-      /* and make reader sync to next keyframe */
+      /* make reader sync to next keyframe */
       reader->start_method = GST_BURST_CACHE_START_NEXT_KEYFRAME;
       break;
     }
@@ -756,6 +953,12 @@ handle_new_reader (GstBurstCache * cache, GstBurstCacheReader * reader)
       gboolean ok;
       gint max;
 
+      /* wait for data to burst */
+      if (len == 0) {
+        position = -1;
+        break;
+      }
+
       /* move to the position where we satisfy the reader's burst
        * parameters. If we could not satisfy the parameters because there
        * is not enough data, we just send what we have (which is in position).
@@ -790,6 +993,11 @@ handle_new_reader (GstBurstCache * cache, GstBurstCacheReader * reader)
        * last keyframe before min. If there is none, the behaviour is like
        * NEXT_KEYFRAME.
        */
+      if (len == 0) {
+        position = -1;
+        break;
+      }
+
       /* gather burst limits */
       count_burst_unit (cache, &min_idx, reader->min_format,
           reader->min_value, &max_idx, reader->max_format, reader->max_value);
@@ -818,9 +1026,7 @@ handle_new_reader (GstBurstCache * cache, GstBurstCacheReader * reader)
       GST_WARNING_OBJECT (cache,
           "no prev keyframe found in BURST_KEYFRAME start mode, waiting for next");
 
-      /* throw reader to the waiting state */
-      reader->bufpos = -1;
-      /* and make reader sync to next keyframe */
+      /* make reader sync to next keyframe */
       reader->start_method = GST_BURST_CACHE_START_NEXT_KEYFRAME;
       position = -1;
       break;
@@ -836,6 +1042,11 @@ handle_new_reader (GstBurstCache * cache, GstBurstCacheReader * reader)
        * a keyframe between min/max limits. If there is none, we send it the
        * amount of data up 'till min.
        */
+      if (len == 0) {
+        position = -1;
+        break;
+      }
+
       /* gather enough data to burst */
       count_burst_unit (cache, &min_idx, reader->min_format,
           reader->min_value, &max_idx, reader->max_format, reader->max_value);
@@ -865,16 +1076,20 @@ handle_new_reader (GstBurstCache * cache, GstBurstCacheReader * reader)
     }
     default:
       g_warning ("unknown start method %d", reader->start_method);
-      position = reader->bufpos;
+      position = len > 0 ? 0 : -1;
       break;
   }
 
   if (position >= 0) {
     /* we got a valid spot in the queue */
     reader->new_reader = FALSE;
-    reader->bufpos = position;
+    reader_set_seq (cache, reader, POS_TO_SEQ (cache, position));
     /* signal that the reader is ready */
     reader->callback (cache, reader, reader->user_data);
+  } else if (reader->start_method == GST_BURST_CACHE_START_NEXT_KEYFRAME) {
+    reader_enqueue (cache, reader, &cache->kf_readers);
+  } else {
+    reader_enqueue (cache, reader, &cache->new_readers);
   }
 }
 
@@ -906,6 +1121,7 @@ gst_burst_cache_add_reader (GstBurstCache * cache, GstBurstCacheReader * reader)
   /* we can add the handle now */
   g_hook_prepend (&cache->readers, (GHook *) reader);
   cache->readers_cookie++;
+  timeout_heap_update (cache, reader);
   CACHE_UNLOCK (cache);
 
   return TRUE;
@@ -933,8 +1149,9 @@ gst_burst_cache_remove_reader_link (GstBurstCache * cache,
   GST_DEBUG_OBJECT (cache, "%s removing reader %p: (%s)",
       reader->debug, reader, reason ? reason->message : "Unknown reason");
 
-  /* set reader to invalid position while being removed */
-  reader->bufpos = -1;
+  /* take reader out of the queue while being removed */
+  reader_enqueue (cache, reader, NULL);
+  timeout_heap_remove (cache, reader);
   reader->reason = reason;
   reader->remove_time = g_get_real_time ();
 
@@ -981,12 +1198,14 @@ gst_burst_cache_remove_reader (GstBurstCache * cache,
 
   if (drain) {
     if (reader->draincount == -1) {
-      /* take the position of the reader as the number of buffers left to drain.
-       * If the reader was at position -1, we drain 0 buffers, 0 == drain 1
-       * buffer, etc... This will mark reader as draining. We can not remove the
-       * reader right away because it might have some buffers to drain in its
-       * queue. */
-      reader->draincount = reader->bufpos + 1;
+      /* take the number of buffers the reader did not receive yet as the
+       * number of buffers left to drain. This will mark reader as draining.
+       * We can not remove the reader right away because it might have some
+       * buffers to drain in its queue. */
+      if (reader->new_reader)
+        reader->draincount = 0;
+      else
+        reader->draincount = cache->head_seq - reader->seq;
     } else {
       GST_INFO_OBJECT (cache, "%s Reader already draining", reader->debug);
     }
@@ -1081,10 +1300,10 @@ gst_burst_cache_remove_readers (GstBurstCache * cache)
 }
 
 /* calculate the new position for a reader after recovery. This function
- * does not update the reader position but merely returns the required
- * position.
+ * does not update the reader position but merely returns the sequence
+ * number of the required position.
  */
-static gint
+static guint64
 gst_burst_cache_recover_reader (GstBurstCache * cache,
     GstBurstCacheReader * reader)
 {
@@ -1092,14 +1311,13 @@ gst_burst_cache_recover_reader (GstBurstCache * cache,
 
   GST_WARNING_OBJECT (cache,
       "%s reader %p is lagging at %d, recover using policy %d",
-      reader->debug, reader, reader->bufpos, cache->recover);
+      reader->debug, reader, SEQ_TO_POS (cache, reader->seq), cache->recover);
 
   switch (cache->recover) {
     case GST_BURST_CACHE_RECOVER_NONE:
       /* do nothing, reader will catch up or get kicked out when it reaches
        * the hard max */
-      newbufpos = reader->bufpos;
-      break;
+      return reader->seq;
     case GST_BURST_CACHE_RECOVER_RESYNC_LATEST:
       /* move to beginning of queue */
       newbufpos = -1;
@@ -1112,20 +1330,10 @@ gst_burst_cache_recover_reader (GstBurstCache * cache,
     case GST_BURST_CACHE_RECOVER_RESYNC_KEYFRAME:
       /* find keyframe in buffers, we search backwards to find the
        * closest keyframe relative to what this reader already received. */
-      newbufpos = MIN ((gint) (cache->bufqueue->len - 1),
+      newbufpos = MIN (CACHE_LEN (cache) - 1,
           get_buffers_max (cache, cache->limit_format,
               cache->limit_soft_max) - 1);
-
-      while (newbufpos >= 0) {
-        GstBuffer *buf;
-
-        buf = g_ptr_array_index (cache->bufqueue, newbufpos);
-        if (is_keyframe (cache, buf)) {
-          /* found a buffer that is not a delta unit */
-          break;
-        }
-        newbufpos--;
-      }
+      newbufpos = find_prev_keyframe (cache, newbufpos);
       break;
     default:
       /* unknown recovery procedure */
@@ -1133,41 +1341,31 @@ gst_burst_cache_recover_reader (GstBurstCache * cache,
           get_buffers_max (cache, cache->limit_format, cache->limit_soft_max);
       break;
   }
-  return newbufpos;
-}
+  /* never move before the oldest buffer */
+  newbufpos = MIN (newbufpos, CACHE_LEN (cache) - 1);
 
-typedef struct
-{
-  GstBurstCache *cache;
-  GstBurstCacheClass *klass;
-  GstClockTime now;
-  gint max_buffer_usage;
-  gint max_buffers;
-  gint soft_max_buffers;
-} QueueHookData;
+  return POS_TO_SEQ (cache, newbufpos);
+}
 
-static gboolean
-queue_hook (GstBurstCacheReader * reader, QueueHookData * data)
+/* check a reader that lags more than the soft or hard max. The reader is
+ * recovered, removed or put back in the queue at the same position. */
+static void
+check_lagging_reader (GstBurstCache * cache, GstBurstCacheReader * reader,
+    gint max_buffers, gint soft_max_buffers)
 {
-  GstBurstCache *cache = data->cache;
-
-  /* move reader forwards */
-  reader->bufpos++;
+  guint64 seq = reader->seq;
 
   GST_LOG_OBJECT (cache, "%s reader %p at position %d",
-      reader->debug, reader, reader->bufpos);
+      reader->debug, reader, SEQ_TO_POS (cache, seq));
 
   /* check soft max if needed, recover reader */
-  if (data->soft_max_buffers > 0 && reader->bufpos >= data->soft_max_buffers) {
-    gint newpos;
-
-    newpos = gst_burst_cache_recover_reader (cache, reader);
-    if (newpos != reader->bufpos) {
-      reader->dropped_buffers += reader->bufpos - newpos;
-      reader->bufpos = newpos;
+  if (soft_max_buffers > 0 && SEQ_TO_POS (cache, seq) >= soft_max_buffers) {
+    seq = gst_burst_cache_recover_reader (cache, reader);
+    if (seq != reader->seq) {
+      reader->dropped_buffers += seq - reader->seq;
       reader->discont = TRUE;
       GST_INFO_OBJECT (cache, "%s reader %p position reset to %d",
-          reader->debug, reader, reader->bufpos);
+          reader->debug, reader, SEQ_TO_POS (cache, seq));
     } else {
       GST_INFO_OBJECT (cache,
           "%s reader %p not recovering position", reader->debug, reader);
@@ -1175,47 +1373,74 @@ queue_hook (GstBurstCacheReader * reader, QueueHookData * data)
   }
 
   /* check hard max */
-  if (data->max_buffers > 0 && reader->bufpos >= data->max_buffers)
+  if (max_buffers > 0 && SEQ_TO_POS (cache, seq) >= max_buffers)
     goto hit_limit;
 
-  /* check timeout */
-  if (reader->timeout > 0 && data->now - reader->last_activity_time >
-      reader->timeout)
-    goto timeout;
-
-  if (reader->new_reader) {
-    handle_new_reader (cache, reader);
-  } else if (reader->bufpos == 0) {
-    /* reader changed from -1 to 0, we can send data to this reader now. */
-    reader->callback (cache, reader, reader->user_data);
-  }
-
-  /* keep track of maximum buffer usage */
-  if (reader->bufpos > data->max_buffer_usage) {
-    data->max_buffer_usage = reader->bufpos;
-  }
-
-  return TRUE;
+  reader_set_seq (cache, reader, seq);
+  return;
 
   /* ERRORS */
 hit_limit:
   {
     GST_WARNING_OBJECT (cache, "%s reader %p is too slow, removing",
         reader->debug, reader);
-    gst_burst_cache_remove_reader_link (cache, reader, FALSE,
+    gst_burst_cache_remove_reader_link (cache, reader, TRUE,
         g_error_new (GST_BURST_CACHE_ERROR, GST_BURST_CACHE_ERROR_SLOW, "Reader is too slow"));
-    /* remove reader */
-    return FALSE;
+    return;
   }
-timeout:
-  {
-    GST_WARNING_OBJECT (cache, "%s reader %p timeout, removing",
-        reader->debug, reader);
-    gst_burst_cache_remove_reader_link (cache, reader, FALSE,
-        g_error_new (GST_BURST_CACHE_ERROR, GST_BURST_CACHE_ERROR_SLOW, "Reader timed out"));
-    /* remove reader */
-    return FALSE;
+}
+
+/* remove the readers that were not active for longer than their timeout.
+ * Only the readers with a deadline before @now are visited. */
+static void
+check_timeouts (GstBurstCache * cache, guint64 now)
+{
+  while (cache->timeouts->len > 0) {
+    GstBurstCacheReader *reader = TIMEOUT_HEAP (cache, 0);
+
+    if (now <= reader->deadline)
+      break;
+
+    if (now > reader->last_activity_time + reader->timeout) {
+      GST_WARNING_OBJECT (cache, "%s reader %p timeout, removing",
+          reader->debug, reader);
+      timeout_heap_remove (cache, reader);
+      gst_burst_cache_remove_reader_link (cache, reader, TRUE,
+          g_error_new (GST_BURST_CACHE_ERROR, GST_BURST_CACHE_ERROR_SLOW, "Reader timed out"));
+    } else {
+      /* it was active, wait for its new deadline */
+      reader->deadline = reader->last_activity_time + reader->timeout;
+      timeout_heap_down (cache, 0);
+    }
+  }
+}
+
+/* remove the buffers before @keep from the queue. No reader can be
+ * positioned on them. */
+static void
+trim_queue (GstBurstCache * cache, guint64 keep)
+{
+  guint first;
+
+  while (cache->tail_seq < keep) {
+    GstBurstCacheEntry *entry = CACHE_ENTRY (cache, cache->tail_seq);
+
+    g_assert (entry->readers.length == 0);
+
+    /* unref tail buffer */
+    gst_buffer_unref (entry->buffer);
+    entry->buffer = NULL;
+    cache->tail_seq++;
   }
+
+  /* skip the keyframes of the removed buffers, compact the index when
+   * half of it is unused */
+  first = keyframe_lower_bound (cache, cache->tail_seq);
+  if (first > 0 && first >= cache->keyframes->len / 2) {
+    g_array_remove_range (cache->keyframes, 0, first);
+    first = 0;
+  }
+  cache->kf_first = first;
 }
 
 /**
@@ -1229,47 +1454,123 @@ timeout:
 void
 gst_burst_cache_queue_buffer (GstBurstCache * cache, GstBuffer * buffer)
 {
-  gint queuelen;
-  gint i;
-  QueueHookData data;
+  GstBurstCacheEntry *entry;
+  GList *link;
+  guint64 seq, i, limit;
+  gint64 now;
+  gint queuelen, n;
+  gint max_buffers, soft_max_buffers, max_buffer_usage;
+  gboolean keyframe;
 
   g_return_if_fail (GST_IS_BURST_CACHE (cache));
   g_return_if_fail (buffer != NULL);
 
-  data.now = g_get_real_time ();
-
-  data.klass = GST_BURST_CACHE_GET_CLASS (cache);
+  now = g_get_real_time ();
 
   CACHE_LOCK (cache);
   /* add buffer to queue */
-  g_ptr_array_insert (cache->bufqueue, 0, buffer);
-  queuelen = cache->bufqueue->len;
+  if (CACHE_LEN (cache) > cache->ring_mask)
+    grow_ring (cache);
+
+  seq = cache->head_seq;
+  entry = CACHE_ENTRY (cache, seq);
+  entry->buffer = buffer;
+  entry->bytes = cache->bytes_total;
+  cache->bytes_total += gst_buffer_get_size (buffer);
+
+  if (GST_BUFFER_TIMESTAMP_IS_VALID (buffer)) {
+    if (cache->timed_seq == VALUE_INVALID)
+      cache->timed_seq = seq;
+    if (cache->last_time == GST_CLOCK_TIME_NONE ||
+        GST_BUFFER_TIMESTAMP (buffer) > cache->last_time)
+      cache->last_time = GST_BUFFER_TIMESTAMP (buffer);
+  }
+  entry->time = cache->last_time;
+
+  keyframe = is_keyframe (cache, buffer);
+  if (keyframe)
+    g_array_append_val (cache->keyframes, seq);
 
-  data.cache = cache;
+  cache->head_seq++;
+  queuelen = CACHE_LEN (cache);
 
   if (cache->limit_max > 0)
-    data.max_buffers =
+    max_buffers =
         get_buffers_max (cache, cache->limit_format, cache->limit_max);
   else
-    data.max_buffers = -1;
+    max_buffers = -1;
 
   if (cache->limit_soft_max > 0)
-    data.soft_max_buffers =
+    soft_max_buffers =
         get_buffers_max (cache, cache->limit_format, cache->limit_soft_max);
   else
-    data.soft_max_buffers = -1;
+    soft_max_buffers = -1;
 
-  GST_LOG_OBJECT (cache, "Using max %d, softmax %d", data.max_buffers,
-      data.soft_max_buffers);
+  GST_LOG_OBJECT (cache, "Using max %d, softmax %d", max_buffers,
+      soft_max_buffers);
 
-  /* After adding the buffer, we update all reader positions in the queue. If
-   * a reader moves over the soft max, we start the recovery procedure for this
-   * slow reader. If it goes over the hard max, it is put into the slow list
-   * and removed.  */
-  data.max_buffer_usage = 0;
+  /* readers that were waiting for data get the new buffer next. Readers that
+   * take it from the callback go back to the tail of the waiting queue with
+   * the next sequence number. */
+  while ((link = g_queue_peek_head_link (&cache->waiting))) {
+    GstBurstCacheReader *reader = link->data;
 
-  g_hook_list_marshal_check (&cache->readers, TRUE, (GHookCheckMarshaller)
-      queue_hook, &data);
+    if (reader->seq != seq)
+      break;
+
+    reader_set_seq (cache, reader, seq);
+    reader->callback (cache, reader, reader->user_data);
+  }
+
+  /* readers waiting for a keyframe start at this one */
+  if (keyframe) {
+    while ((link = g_queue_peek_head_link (&cache->kf_readers))) {
+      GstBurstCacheReader *reader = link->data;
+
+      GST_DEBUG_OBJECT (cache,
+          "%s BURST_CACHE_START_NEXT_KEYFRAME: position 0", reader->debug);
+
+      reader->new_reader = FALSE;
+      reader_set_seq (cache, reader, seq);
+      reader->callback (cache, reader, reader->user_data);
+    }
+  }
+
+  /* position the new readers that were waiting for data */
+  for (n = cache->new_readers.length; n > 0; n--) {
+    if (!(link = g_queue_peek_head_link (&cache->new_readers)))
+      break;
+    handle_new_reader (cache, link->data);
+  }
+
+  /* Readers before limit are over the soft max, and need recovery, or over
+   * the hard max, and need to be removed. Only those readers are visited,
+   * starting from the oldest one. */
+  limit = 0;
+  if (soft_max_buffers > 0 && cache->recover != GST_BURST_CACHE_RECOVER_NONE &&
+      (guint64) soft_max_buffers < cache->head_seq)
+    limit = cache->head_seq - soft_max_buffers;
+  if (max_buffers > 0 && (guint64) max_buffers < cache->head_seq)
+    limit = MAX (limit, cache->head_seq - max_buffers);
+
+  for (i = find_min_seq (cache); i < limit; i++) {
+    GstBurstCacheEntry *e = CACHE_ENTRY (cache, i);
+
+    /* readers that stay are put back at the tail */
+    for (n = e->readers.length; n > 0; n--) {
+      if (!(link = g_queue_peek_head_link (&e->readers)))
+        break;
+      check_lagging_reader (cache, link->data, max_buffers, soft_max_buffers);
+    }
+  }
+
+  check_timeouts (cache, now);
+
+  /* keep the buffers of the oldest reader */
+  max_buffer_usage = 0;
+  i = find_min_seq (cache);
+  if (i < cache->head_seq)
+    max_buffer_usage = SEQ_TO_POS (cache, i);
 
   /* make sure we respect bytes-min, buffers-min and time-min when they are set */
   {
@@ -1277,7 +1578,7 @@ gst_burst_cache_queue_buffer (GstBurstCache * cache, GstBuffer * buffer)
 
     GST_LOG_OBJECT (cache,
         "extending queue %d to respect time_min %" GST_TIME_FORMAT
-        ", bytes_min %d, buffers_min %d", data.max_buffer_usage,
+        ", bytes_min %d, buffers_min %d", max_buffer_usage,
         GST_TIME_ARGS (cache->time_min), cache->bytes_min, cache->buffers_min);
 
     /* get index where the limits are ok, we don't really care if all limits
@@ -1286,8 +1587,8 @@ gst_burst_cache_queue_buffer (GstBurstCache * cache, GstBuffer * buffer)
     find_limits (cache, &usage, cache->bytes_min, cache->buffers_min,
         cache->time_min, &max, -1, -1, -1);
 
-    data.max_buffer_usage = MAX (data.max_buffer_usage, usage + 1);
-    GST_LOG_OBJECT (cache, "extended queue to %d", data.max_buffer_usage);
+    max_buffer_usage = MAX (max_buffer_usage, usage + 1);
+    GST_LOG_OBJECT (cache, "extended queue to %d", max_buffer_usage);
   }
 
   /* now look for start points and make sure there is at least one
@@ -1295,46 +1596,34 @@ gst_burst_cache_queue_buffer (GstBurstCache * cache, GstBuffer * buffer)
   {
     /* no point in searching beyond the queue length */
     gint limit = queuelen;
+    gint pos;
 
     /* no point in searching beyond the soft-max if any. */
-    if (data.soft_max_buffers > 0) {
-      limit = MIN (limit, data.soft_max_buffers);
+    if (soft_max_buffers > 0) {
+      limit = MIN (limit, soft_max_buffers);
     }
     GST_LOG_OBJECT (cache,
         "extending queue to include start point, now at %d, limit is %d",
-        data.max_buffer_usage, limit);
-
-    for (i = 0; i < limit; i++) {
-      GstBuffer *buf;
+        max_buffer_usage, limit);
 
-      buf = g_ptr_array_index (cache->bufqueue, i);
-      if (is_keyframe (cache, buf)) {
-        /* found a sync frame, now extend the buffer usage to
-         * include at least this frame. */
-        data.max_buffer_usage = MAX (data.max_buffer_usage, i);
-        break;
-      }
+    pos = find_next_keyframe (cache, 0);
+    if (pos != -1 && pos < limit) {
+      /* found a sync frame, now extend the buffer usage to
+       * include at least this frame. */
+      max_buffer_usage = MAX (max_buffer_usage, pos);
     }
-    GST_LOG_OBJECT (cache, "max buffer usage is now %d", data.max_buffer_usage);
+    GST_LOG_OBJECT (cache, "max buffer usage is now %d", max_buffer_usage);
   }
 
-  GST_LOG_OBJECT (cache, "len %d, usage %d", queuelen, data.max_buffer_usage);
+  GST_LOG_OBJECT (cache, "len %d, usage %d", queuelen, max_buffer_usage);
 
   /* nobody is referencing units after max_buffer_usage so we can
-   * remove them from the queue. We remove them in reverse order as
-   * this is the most optimal for GArray. */
-  for (i = queuelen - 1; i > data.max_buffer_usage; i--) {
-    GstBuffer *old;
+   * remove them from the queue. */
+  if (max_buffer_usage < queuelen - 1)
+    trim_queue (cache, POS_TO_SEQ (cache, max_buffer_usage));
 
-    /* queue exceeded max size */
-    queuelen--;
-    old = g_ptr_array_remove_index (cache->bufqueue, i);
-
-    /* unref tail buffer */
-    gst_buffer_unref (old);
-  }
   /* save for stats */
-  cache->buffers_queued = data.max_buffer_usage;
+  cache->buffers_queued = max_buffer_usage;
   CACHE_UNLOCK (cache);
 }
 
@@ -1347,11 +1636,23 @@ gst_burst_cache_queue_buffer (GstBurstCache * cache, GstBuffer * buffer)
 void
 gst_burst_cache_remove_buffers (GstBurstCache * cache)
 {
+  guint64 seq;
+
   g_return_if_fail (GST_IS_BURST_CACHE (cache));
 
   CACHE_LOCK (cache);
-  g_ptr_array_foreach (cache->bufqueue, (GFunc) gst_buffer_unref, NULL);
-  g_ptr_array_set_size (cache->bufqueue, 0);
+  /* readers in the queue will get the next buffer */
+  for (seq = find_min_seq (cache); seq < cache->head_seq; seq++) {
+    GstBurstCacheEntry *entry = CACHE_ENTRY (cache, seq);
+    GList *link;
+
+    while ((link = g_queue_peek_head_link (&entry->readers)))
+      reader_set_seq (cache, link->data, cache->head_seq);
+  }
+  trim_queue (cache, cache->head_seq);
+
+  cache->last_time = GST_CLOCK_TIME_NONE;
+  cache->timed_seq = VALUE_INVALID;
   CACHE_UNLOCK (cache);
 }
 
@@ -1382,16 +1683,17 @@ gst_burst_cache_get_buffer (GstBurstCache * cache, GstBurstCacheReader * reader,
   g_return_val_if_fail (buffer != NULL, GST_BURST_CACHE_RESULT_ERROR);
 
   CACHE_LOCK (cache);
-  if (reader->bufpos == -1)
+  if (reader->new_reader || reader->queue == NULL ||
+      reader->seq == cache->head_seq)
     goto no_data_yet;
 
   /* we drained all remaining buffers, no need to get a new one */
   if (reader->draincount == 0)
     goto drained;
 
-  /* grab buffer */
-  buf = g_ptr_array_index (cache->bufqueue, reader->bufpos);
-  reader->bufpos--;
+  /* grab buffer and move to the next one */
+  buf = CACHE_ENTRY (cache, reader->seq)->buffer;
+  reader_set_seq (cache, reader, reader->seq + 1);
 
   /* update stats */
   timestamp = GST_BUFFER_TIMESTAMP (buf);
@@ -1404,8 +1706,10 @@ gst_burst_cache_get_buffer (GstBurstCache * cache, GstBurstCacheReader * reader,
   if (reader->draincount != -1)
     reader->draincount--;
 
-  GST_LOG_OBJECT (cache, "%s reader %p at position %d",
-      reader->debug, reader, reader->bufpos);
+  reader->last_activity_time = g_get_real_time ();
+
+  GST_LOG_OBJECT (cache, "%s reader %p at seq %" G_GUINT64_FORMAT,
+      reader->debug, reader, reader->seq);
 
   *buffer = gst_buffer_ref (buf);
   CACHE_UNLOCK (cache);
@@ -40,6 +40,7 @@ G_BEGIN_DECLS
 typedef struct _GstBurstCache GstBurstCache;
 typedef struct _GstBurstCacheClass GstBurstCacheClass;
 typedef struct _GstBurstCacheReader GstBurstCacheReader;
+typedef struct _GstBurstCacheEntry GstBurstCacheEntry;
 
 /**
  * GstBurstCacheRecover:
@@ -137,7 +138,7 @@ typedef void (*GstBurstCacheReaderCallback)  (GstBurstCache *cache,
 /**
  * GstBurstCacheReader:
  * @object: parent miniobject
- * @bufpos: position of this reader in the global queue
+ * @seq: sequence number of the next buffer for this reader
  * @draincount: the remaining number of buffers to drain or -1 if the
  *              reader is not draining.
  * @new_reader: this is a new reader
@@ -149,7 +150,7 @@ typedef void (*GstBurstCacheReaderCallback)  (GstBurstCache *cache,
 struct _GstBurstCacheReader {
   GHook hook;
 
-  gint bufpos;
+  guint64 seq;
   gint draincount;
 
   GstBurstCacheReaderCallback callback;
@@ -178,17 +179,29 @@ struct _GstBurstCacheReader {
   guint64 add_time;
   guint64 remove_time;
   guint64 last_activity_time;
-  guint64 timeout;
+  guint64 timeout;              /* use gst_burst_cache_reader_set_timeout() */
 
   gchar debug[30];              /* a debug string used in debug calls to
                                    identify the reader */
+
+  /*< private >*/
+  GList link;                   /* link in the queue the reader is in */
+  GQueue *queue;
+  guint64 deadline;             /* earliest time the reader can time out */
+  guint timeout_pos;            /* position in the timeout heap plus one,
+                                   0 when the reader has no timeout */
 };
 
 /**
  * GstBurstCache:
  * @parent: parent GObject
  * @lock: lock to protect @readers
- * @bufqueue: global queue of buffers
+ * @ring: ring of buffers, indexed by sequence number
+ * @ring_mask: size of @ring minus one
+ * @head_seq: sequence number of the next buffer
+ * @tail_seq: sequence number of the oldest buffer in @ring
+ * @keyframes: sorted sequence numbers of the keyframes in @ring
+ * @timeouts: heap of the readers with a timeout, on their deadline
  * @readers: list of readers we are serving
  * @readers_cookie: Cookie to detect changes to @readers
  * @limit_format: the format of @limit_max and @@limit_soft_max
@@ -209,7 +222,26 @@ struct _GstBurstCache {
 
   /*< private >*/
   GRecMutex lock;
-  GPtrArray *bufqueue;
+  GstBurstCacheEntry *ring;
+  guint ring_mask;
+  guint64 head_seq;
+  guint64 tail_seq;
+  /* no reader is positioned before this buffer */
+  guint64 min_seq;
+  /* running totals, the entries keep the values at the time they
+   * were queued */
+  guint64 bytes_total;
+  GstClockTime last_time;
+  /* first buffer with a valid running time */
+  guint64 timed_seq;
+  GArray *keyframes;
+  guint kf_first;
+  /* readers waiting for the next buffer, new readers that could not be
+   * positioned yet and new readers waiting for the next keyframe */
+  GQueue waiting;
+  GQueue new_readers;
+  GQueue kf_readers;
+  GPtrArray *timeouts;
   /* the readers */
   GHookList readers;
   guint readers_cookie;
@@ -282,6 +314,9 @@ gboolean                gst_burst_cache_reader_set_burst (GstBurstCacheReader *r
                                                           GstBurstCacheStart start_method,
                                                           GstFormat min_format, guint64 min_value,
                                                           GstFormat max_format, guint64 max_value);
+void                    gst_burst_cache_reader_set_timeout (GstBurstCache *cache,
+                                                          GstBurstCacheReader *reader,
+                                                          guint64 timeout);
 void                    gst_burst_cache_reader_destroy   (GstBurstCacheReader *reader);
 
 gboolean                gst_burst_cache_add_reader       (GstBurstCache *cache,
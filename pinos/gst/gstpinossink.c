@@ -48,6 +48,10 @@
 #include "gstpinosformat.h"
 
 static GQuark process_mem_data_quark;
+static GQuark damage_quark;
+
+/* max number of damaged regions we send per frame */
+#define MAX_DAMAGE_REGIONS 16
 
 GST_DEBUG_CATEGORY_STATIC (pinos_sink_debug);
 #define GST_CAT_DEFAULT pinos_sink_debug
@@ -142,6 +146,10 @@ gst_pinos_sink_propose_allocation (GstBaseSink * bsink, GstQuery * query)
   GstPinosSink *pinossink = GST_PINOS_SINK (bsink);
 
   gst_query_add_allocation_pool (query, GST_BUFFER_POOL_CAST (pinossink->pool), 0, 0, 0);
+  /* the crop and damage are passed on as metadata, upstream does not need
+   * to copy */
+  gst_query_add_allocation_meta (query, GST_VIDEO_CROP_META_API_TYPE, NULL);
+  gst_query_add_allocation_meta (query, GST_VIDEO_REGION_OF_INTEREST_META_API_TYPE, NULL);
   return TRUE;
 }
 
@@ -217,6 +225,7 @@ gst_pinos_sink_class_init (GstPinosSinkClass * klass)
       "Pinos Sink");
 
   process_mem_data_quark = g_quark_from_static_string ("GstPinosSinkProcessMemQuark");
+  damage_quark = g_quark_from_static_string ("damage");
 }
 
 
@@ -243,7 +252,7 @@ pool_activated (GstPinosPool *pool, GstPinosSink *sink)
   guint size;
   guint min_buffers;
   guint max_buffers;
-  SpaAllocParam *port_params[3];
+  SpaAllocParam *port_params[5];
   SpaPODBuilder b = { NULL };
   uint8_t buffer[1024];
   SpaPODFrame f[2];
@@ -264,6 +273,18 @@ pool_activated (GstPinosPool *pool, GstPinosSink *sink)
       PROP    (&f[1], ctx->type.alloc_param_meta_enable.size, SPA_POD_TYPE_INT, sizeof (SpaMetaHeader)));
   port_params[1] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
 
+  spa_pod_builder_object (&b, &f[0], 0, ctx->type.alloc_param_meta_enable.MetaEnable,
+      PROP    (&f[1], ctx->type.alloc_param_meta_enable.type, SPA_POD_TYPE_ID, ctx->type.meta.VideoCrop),
+      PROP    (&f[1], ctx->type.alloc_param_meta_enable.size, SPA_POD_TYPE_INT, sizeof (SpaMetaVideoCrop)));
+  port_params[2] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
+
+  spa_pod_builder_object (&b, &f[0], 0, ctx->type.alloc_param_meta_enable.MetaEnable,
+      PROP    (&f[1], ctx->type.alloc_param_meta_enable.type, SPA_POD_TYPE_ID, ctx->type.meta.VideoDamage),
+      PROP    (&f[1], ctx->type.alloc_param_meta_enable.size, SPA_POD_TYPE_INT,
+                                                             SPA_META_VIDEO_DAMAGE_SIZE (MAX_DAMAGE_REGIONS)),
+      PROP    (&f[1], ctx->type.alloc_param_meta_enable.videoDamageRegions, SPA_POD_TYPE_INT, MAX_DAMAGE_REGIONS));
+  port_params[3] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
+
   spa_pod_builder_object (&b, &f[0], 0, ctx->type.alloc_param_meta_enable.MetaEnable,
       PROP    (&f[1], ctx->type.alloc_param_meta_enable.type, SPA_POD_TYPE_ID, ctx->type.meta.Ringbuffer),
       PROP    (&f[1], ctx->type.alloc_param_meta_enable.size, SPA_POD_TYPE_INT, sizeof (SpaRingbuffer)),
@@ -273,9 +294,9 @@ pool_activated (GstPinosPool *pool, GstPinosSink *sink)
       PROP    (&f[1], ctx->type.alloc_param_meta_enable.ringbufferStride, SPA_POD_TYPE_INT, 0),
       PROP    (&f[1], ctx->type.alloc_param_meta_enable.ringbufferBlocks, SPA_POD_TYPE_INT, 1),
       PROP    (&f[1], ctx->type.alloc_param_meta_enable.ringbufferAlign,  SPA_POD_TYPE_INT, 16));
-  port_params[2] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
+  port_params[4] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
 
-  pinos_stream_finish_format (sink->stream, SPA_RESULT_OK, port_params, 2);
+  pinos_stream_finish_format (sink->stream, SPA_RESULT_OK, port_params, 4);
 }
 
 static void
@@ -409,6 +430,8 @@ typedef struct {
   guint id;
   SpaBuffer *buf;
   SpaMetaHeader *header;
+  SpaMetaVideoCrop *crop;
+  SpaMetaVideoDamage *damage;
   guint flags;
   goffset offset;
 } ProcessMemData;
@@ -446,6 +469,8 @@ on_add_buffer (PinosListener *listener,
   data.id = id;
   data.buf = b;
   data.header = spa_buffer_find_meta (b, stream->context->type.meta.Header);
+  data.crop = spa_buffer_find_meta (b, stream->context->type.meta.VideoCrop);
+  data.damage = spa_buffer_find_meta (b, stream->context->type.meta.VideoDamage);
 
   for (i = 0; i < b->n_datas; i++) {
     SpaData *d = &b->datas[i];
@@ -518,6 +543,36 @@ on_new_buffer (PinosListener *listener,
   }
 }
 
+/* the regions of interest of type "damage" become the damaged regions, a
+ * buffer without them or with too many of them is sent as fully damaged */
+static void
+update_damage_meta (GstPinosSink *pinossink, GstBuffer *buffer, SpaMetaVideoDamage *damage)
+{
+  SpaMetaRegion *r = SPA_META_VIDEO_DAMAGE_REGIONS (damage);
+  GstMeta *meta;
+  gpointer state = NULL;
+  uint32_t n = 0;
+
+  while ((meta = gst_buffer_iterate_meta (buffer, &state))) {
+    GstVideoRegionOfInterestMeta *roi = (GstVideoRegionOfInterestMeta *) meta;
+
+    if (meta->info->api != GST_VIDEO_REGION_OF_INTEREST_META_API_TYPE ||
+        roi->roi_type != damage_quark)
+      continue;
+    if (n == damage->max_regions) {
+      n = 0;
+      break;
+    }
+    r[n].x = roi->x;
+    r[n].y = roi->y;
+    r[n].width = roi->w;
+    r[n].height = roi->h;
+    n++;
+  }
+  damage->n_regions = n;
+  GST_LOG_OBJECT (pinossink, "%u damaged regions", n);
+}
+
 static void
 do_send_buffer (GstPinosSink *pinossink)
 {
@@ -540,6 +595,21 @@ do_send_buffer (GstPinosSink *pinossink)
     data->header->pts = GST_BUFFER_PTS (buffer);
     data->header->dts_offset = GST_BUFFER_DTS (buffer);
   }
+  if (data->crop) {
+    GstVideoCropMeta *meta = gst_buffer_get_video_crop_meta (buffer);
+
+    if (meta) {
+      data->crop->x = meta->x;
+      data->crop->y = meta->y;
+      data->crop->width = meta->width;
+      data->crop->height = meta->height;
+    } else {
+      data->crop->x = data->crop->y = 0;
+      data->crop->width = data->crop->height = 0;
+    }
+  }
+  if (data->damage)
+    update_damage_meta (pinossink, buffer, data->damage);
   for (i = 0; i < data->buf->n_datas; i++) {
     SpaData *d = &data->buf->datas[i];
     GstMemory *mem = gst_buffer_peek_memory (buffer, i);
@@ -666,6 +736,22 @@ start_error:
   }
 }
 
+static void
+copy_damage_meta (GstBuffer *dest, GstBuffer *src)
+{
+  GstMeta *meta;
+  gpointer state = NULL;
+
+  while ((meta = gst_buffer_iterate_meta (src, &state))) {
+    GstVideoRegionOfInterestMeta *roi = (GstVideoRegionOfInterestMeta *) meta;
+
+    if (meta->info->api == GST_VIDEO_REGION_OF_INTEREST_META_API_TYPE &&
+        roi->roi_type == damage_quark)
+      gst_buffer_add_video_region_of_interest_meta_id (dest, damage_quark,
+          roi->x, roi->y, roi->w, roi->h);
+  }
+}
+
 static GstFlowReturn
 gst_pinos_sink_render (GstBaseSink * bsink, GstBuffer * buffer)
 {
@@ -684,6 +770,7 @@ gst_pinos_sink_render (GstBaseSink * bsink, GstBuffer * buffer)
   if (buffer->pool != GST_BUFFER_POOL_CAST (pinossink->pool)) {
     GstBuffer *b = NULL;
     GstMapInfo info = { 0, };
+    GstVideoCropMeta *crop;
 
     if (!gst_buffer_pool_is_active (GST_BUFFER_POOL_CAST (pinossink->pool)))
       gst_buffer_pool_set_active (GST_BUFFER_POOL_CAST (pinossink->pool), TRUE);
@@ -695,6 +782,15 @@ gst_pinos_sink_render (GstBaseSink * bsink, GstBuffer * buffer)
     gst_buffer_extract (buffer, 0, info.data, info.size);
     gst_buffer_unmap (b, &info);
     gst_buffer_resize (b, 0, gst_buffer_get_size (buffer));
+    if ((crop = gst_buffer_get_video_crop_meta (buffer))) {
+      GstVideoCropMeta *c = gst_buffer_add_video_crop_meta (b);
+
+      c->x = crop->x;
+      c->y = crop->y;
+      c->width = crop->width;
+      c->height = crop->height;
+    }
+    copy_damage_meta (b, buffer);
     buffer = b;
   } else
     gst_buffer_ref (buffer);
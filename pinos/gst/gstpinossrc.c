@@ -50,6 +50,10 @@
 #include "gstpinosclock.h"
 
 static GQuark process_mem_data_quark;
+static GQuark damage_quark;
+
+/* max number of damaged regions we accept per frame */
+#define MAX_DAMAGE_REGIONS 16
 
 GST_DEBUG_CATEGORY_STATIC (pinos_src_debug);
 #define GST_CAT_DEFAULT pinos_src_debug
@@ -272,6 +276,7 @@ gst_pinos_src_class_init (GstPinosSrcClass * klass)
       "Pinos Source");
 
   process_mem_data_quark = g_quark_from_static_string ("GstPinosSrcProcessMemQuark");
+  damage_quark = g_quark_from_static_string ("damage");
 }
 
 static void
@@ -345,6 +350,8 @@ typedef struct {
   guint id;
   SpaBuffer *buf;
   SpaMetaHeader *header;
+  SpaMetaVideoCrop *crop;
+  SpaMetaVideoDamage *damage;
   guint flags;
   goffset offset;
 } ProcessMemData;
@@ -404,6 +411,8 @@ on_add_buffer (PinosListener *listener,
   data.id = id;
   data.buf = b;
   data.header = spa_buffer_find_meta (b, ctx->type.meta.Header);
+  data.crop = spa_buffer_find_meta (b, ctx->type.meta.VideoCrop);
+  data.damage = spa_buffer_find_meta (b, ctx->type.meta.VideoDamage);
 
   for (i = 0; i < b->n_datas; i++) {
     SpaData *d = &b->datas[i];
@@ -461,6 +470,69 @@ on_remove_buffer (PinosListener *listener,
   }
 }
 
+/* the buffers are reused so the crop meta of the previous frame is updated
+ * or removed when the frame is not cropped anymore */
+static void
+update_crop_meta (GstPinosSrc *pinossrc, GstBuffer *buf, SpaMetaVideoCrop *crop)
+{
+  GstVideoCropMeta *meta;
+  gboolean cropped;
+
+  cropped = crop && crop->width > 0 && crop->height > 0 &&
+      pinossrc->width > 0 && pinossrc->height > 0 &&
+      (crop->x != 0 || crop->y != 0 ||
+       crop->width != pinossrc->width || crop->height != pinossrc->height);
+
+  meta = gst_buffer_get_video_crop_meta (buf);
+  if (!cropped) {
+    if (meta)
+      gst_buffer_remove_meta (buf, (GstMeta *) meta);
+    return;
+  }
+  if (meta == NULL)
+    meta = gst_buffer_add_video_crop_meta (buf);
+
+  meta->x = crop->x;
+  meta->y = crop->y;
+  meta->width = crop->width;
+  meta->height = crop->height;
+
+  GST_LOG_OBJECT (pinossrc, "crop %d,%d %dx%d", crop->x, crop->y, crop->width, crop->height);
+}
+
+static gboolean
+remove_damage_meta (GstBuffer *buf, GstMeta **meta, gpointer user_data)
+{
+  if ((*meta)->info->api == GST_VIDEO_REGION_OF_INTEREST_META_API_TYPE &&
+      ((GstVideoRegionOfInterestMeta *) *meta)->roi_type == damage_quark)
+    *meta = NULL;
+
+  return TRUE;
+}
+
+/* each damaged region becomes a region of interest of type "damage", a
+ * buffer without them has to be processed completely */
+static void
+update_damage_meta (GstPinosSrc *pinossrc, GstBuffer *buf, SpaMetaVideoDamage *damage)
+{
+  SpaMetaRegion *r;
+  guint i;
+
+  gst_buffer_foreach_meta (buf, remove_damage_meta, NULL);
+
+  if (damage == NULL || damage->n_regions == 0 || damage->n_regions > damage->max_regions)
+    return;
+
+  r = SPA_META_VIDEO_DAMAGE_REGIONS (damage);
+  for (i = 0; i < damage->n_regions; i++) {
+    if (r[i].x < 0 || r[i].y < 0 || r[i].width <= 0 || r[i].height <= 0)
+      continue;
+    gst_buffer_add_video_region_of_interest_meta_id (buf, damage_quark,
+        r[i].x, r[i].y, r[i].width, r[i].height);
+  }
+  GST_LOG_OBJECT (pinossrc, "%u damaged regions", damage->n_regions);
+}
+
 static void
 on_new_buffer (PinosListener *listener,
                PinosStream   *stream,
@@ -492,6 +564,8 @@ on_new_buffer (PinosListener *listener,
     }
     GST_BUFFER_OFFSET (buf) = h->seq;
   }
+  update_crop_meta (pinossrc, buf, data->crop);
+  update_damage_meta (pinossrc, buf, data->damage);
   for (i = 0; i < data->buf->n_datas; i++) {
     SpaData *d = &data->buf->datas[i];
     GstMemory *mem = gst_buffer_peek_memory (buf, i);
@@ -763,13 +837,23 @@ on_format_changed (PinosListener *listener,
 
   caps = gst_caps_from_format (format);
   GST_DEBUG_OBJECT (pinossrc, "we got format %" GST_PTR_FORMAT, caps);
+
+  pinossrc->width = pinossrc->height = 0;
+  if (gst_caps_get_size (caps) > 0) {
+    GstStructure *s = gst_caps_get_structure (caps, 0);
+
+    if (gst_structure_has_name (s, "video/x-raw")) {
+      gst_structure_get_int (s, "width", &pinossrc->width);
+      gst_structure_get_int (s, "height", &pinossrc->height);
+    }
+  }
   res = gst_base_src_set_caps (GST_BASE_SRC (pinossrc), caps);
   gst_caps_unref (caps);
 
   if (res) {
-    SpaAllocParam *params[1];
+    SpaAllocParam *params[3];
     SpaPODBuilder b = { NULL };
-    uint8_t buffer[128];
+    uint8_t buffer[512];
     SpaPODFrame f[2];
 
     spa_pod_builder_init (&b, buffer, sizeof (buffer));
@@ -778,8 +862,20 @@ on_format_changed (PinosListener *listener,
         PROP    (&f[1], ctx->type.alloc_param_meta_enable.size, SPA_POD_TYPE_INT, sizeof (SpaMetaHeader)));
     params[0] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
 
+    spa_pod_builder_object (&b, &f[0], 0, ctx->type.alloc_param_meta_enable.MetaEnable,
+        PROP    (&f[1], ctx->type.alloc_param_meta_enable.type, SPA_POD_TYPE_ID, ctx->type.meta.VideoCrop),
+        PROP    (&f[1], ctx->type.alloc_param_meta_enable.size, SPA_POD_TYPE_INT, sizeof (SpaMetaVideoCrop)));
+    params[1] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
+
+    spa_pod_builder_object (&b, &f[0], 0, ctx->type.alloc_param_meta_enable.MetaEnable,
+        PROP    (&f[1], ctx->type.alloc_param_meta_enable.type, SPA_POD_TYPE_ID, ctx->type.meta.VideoDamage),
+        PROP    (&f[1], ctx->type.alloc_param_meta_enable.size, SPA_POD_TYPE_INT,
+                                                               SPA_META_VIDEO_DAMAGE_SIZE (MAX_DAMAGE_REGIONS)),
+        PROP    (&f[1], ctx->type.alloc_param_meta_enable.videoDamageRegions, SPA_POD_TYPE_INT, MAX_DAMAGE_REGIONS));
+    params[2] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
+
     GST_DEBUG_OBJECT (pinossrc, "doing finish format");
-    pinos_stream_finish_format (pinossrc->stream, SPA_RESULT_OK, params, 1);
+    pinos_stream_finish_format (pinossrc->stream, SPA_RESULT_OK, params, 3);
   } else {
     GST_WARNING_OBJECT (pinossrc, "finish format with error");
     pinos_stream_finish_format (pinossrc->stream, SPA_RESULT_INVALID_MEDIA_TYPE, NULL, 0);
@@ -59,6 +59,10 @@ struct _GstPinosSrc {
   gboolean flushing;
   gboolean started;
 
+  /* frame size of the negotiated video format, 0 for other media */
+  gint width;
+  gint height;
+
   gboolean is_live;
   GstClockTime min_latency;
   GstClockTime max_latency;
@@ -20,14 +20,31 @@
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include <time.h>
+#include <dlfcn.h>
 
 #include "config.h"
 
+#include <spa/format-builder.h>
+#include <spa/audio/format-utils.h>
+
 #include "pinos/client/interfaces.h"
 #include "pinos/server/core.h"
 #include "pinos/server/module.h"
 #include "pinos/server/client-node.h"
 
+#define AUDIOCONVERT_LIB "build/spa/plugins/audioconvert/libspa-audioconvert.so"
+#define RESAMPLE_LIB     "build/spa/plugins/resample/libspa-resample.so"
+#define CHANNELMIX_LIB   "build/spa/plugins/channelmix/libspa-channelmix.so"
+
+/* the most nodes we insert between two ports */
+#define MAX_CONVERT      4
+
+/* how often the rate of an adaptive resampler is updated */
+#define RATE_UPDATE_SEC  1
+/* the time in which a change in the buffer fill is corrected */
+#define RATE_SETTLE_SEC  10
+
 typedef struct {
   PinosCore       *core;
   PinosProperties *properties;
@@ -36,6 +53,17 @@ typedef struct {
   PinosListener global_removed;
 
   SpaList client_list;
+
+  SpaTypeFormatAudio format_audio;
+  uint32_t prop_adaptive;
+  uint32_t prop_rate_correction;
+
+  void *convert_hnd;
+  const SpaHandleFactory *convert_factory;
+  void *resample_hnd;
+  const SpaHandleFactory *resample_factory;
+  void *channelmix_hnd;
+  const SpaHandleFactory *channelmix_factory;
 } ModuleImpl;
 
 typedef struct {
@@ -56,9 +84,53 @@ typedef struct {
   PinosListener  state_changed;
   PinosListener  port_added;
   PinosListener  port_removed;
+  SpaList        link_list;
+  SpaList        convert_list;
+} NodeInfo;
+
+/* the link of @port, a port of the node, to its target or into the convert
+ * chain to its target. When the target goes away, @port is linked again
+ * after @port_link is freed. */
+typedef struct {
+  NodeInfo      *info;
+  PinosPort     *port;
+  PinosLink     *port_link;
+  SpaList        link;
   PinosListener  port_unlinked;
   PinosListener  link_state_changed;
-} NodeInfo;
+  PinosListener  link_free;
+} LinkInfo;
+
+/* an adaptive resampler between two devices with their own clock. The
+ * resampler makes @in_clock consume exactly what @out_clock produces. */
+typedef struct {
+  SpaClock      *out_clock;
+  SpaClock      *in_clock;
+  SpaSource     *timer;
+  bool           locked;
+  double         out_start;
+  double         in_start;
+  double         out_last;
+  double         in_last;
+  int64_t        time_last;
+} RateControl;
+
+/* an audioconvert or resample node we inserted between a port of the node
+ * and its target because they had no format or rate in common or were in
+ * different clock domains.
+ * @port is the port of our node and @port_link its link into the chain.
+ * @target_link is the link of the node on the side of the target. */
+typedef struct {
+  NodeInfo      *info;
+  PinosNode     *node;
+  PinosPort     *port;
+  PinosLink     *port_link;
+  PinosLink     *target_link;
+  bool           activated;
+  SpaList        link;
+  PinosListener  link_state_changed;
+  RateControl    rate;
+} ConvertInfo;
 
 static NodeInfo *
 find_node_info (ClientInfo *cinfo, PinosNode *node)
@@ -84,15 +156,77 @@ find_client_info (ModuleImpl *impl, PinosClient *client)
   return NULL;
 }
 
+static LinkInfo *
+find_link_info (NodeInfo *info, PinosPort *port)
+{
+  LinkInfo *linfo;
+
+  spa_list_for_each (linfo, &info->link_list, link) {
+    if (linfo->port == port)
+      return linfo;
+  }
+  return NULL;
+}
+
+static void
+link_info_free (LinkInfo *linfo)
+{
+  spa_list_remove (&linfo->link);
+  pinos_signal_remove (&linfo->port_unlinked);
+  pinos_signal_remove (&linfo->link_state_changed);
+  pinos_signal_remove (&linfo->link_free);
+  free (linfo);
+}
+
+static SpaResult
+do_convert_info_free (SpaLoop        *loop,
+                      bool            async,
+                      uint32_t        seq,
+                      size_t          size,
+                      void           *data,
+                      void           *user_data)
+{
+  free (user_data);
+  return SPA_RESULT_OK;
+}
+
+static void
+convert_info_free (ConvertInfo *cinfo)
+{
+  PinosDataLoop *data_loop = cinfo->node->data_loop;
+
+  spa_list_remove (&cinfo->link);
+  pinos_signal_remove (&cinfo->link_state_changed);
+  pinos_node_destroy (cinfo->node);
+
+  if (cinfo->rate.timer) {
+    pinos_loop_destroy_source (cinfo->info->impl->core->main_loop->loop, cinfo->rate.timer);
+    /* after the rate update that might still be queued */
+    pinos_loop_invoke (data_loop->loop,
+                       do_convert_info_free,
+                       SPA_ID_INVALID,
+                       0,
+                       NULL,
+                       cinfo);
+  } else
+    free (cinfo);
+}
+
 static void
 node_info_free (NodeInfo *info)
 {
+  LinkInfo *linfo, *ltmp;
+  ConvertInfo *cinfo, *tmp;
+
+  spa_list_for_each_safe (linfo, ltmp, &info->link_list, link)
+    link_info_free (linfo);
+  spa_list_for_each_safe (cinfo, tmp, &info->convert_list, link)
+    convert_info_free (cinfo);
+
   spa_list_remove (&info->link);
   pinos_signal_remove (&info->state_changed);
   pinos_signal_remove (&info->port_added);
   pinos_signal_remove (&info->port_removed);
-  pinos_signal_remove (&info->port_unlinked);
-  pinos_signal_remove (&info->link_state_changed);
   free (info);
 }
 
@@ -113,17 +247,101 @@ client_info_free (ClientInfo *cinfo)
 
 static void try_link_port (PinosNode *node, PinosPort *port, NodeInfo  *info);
 
+/* stop following the link of our port, it is going away */
+static void
+unlisten_link (LinkInfo *linfo)
+{
+  pinos_signal_remove (&linfo->port_unlinked);
+  pinos_signal_remove (&linfo->link_state_changed);
+  spa_list_init (&linfo->port_unlinked.link);
+  spa_list_init (&linfo->link_state_changed.link);
+}
+
+/* remove the convert nodes between @port and its target, the links of the
+ * chain go away with the ports of the nodes. Returns the link of @port
+ * into the chain or %NULL when there was no chain. */
+static PinosLink *
+unlink_convert_chain (NodeInfo  *info,
+                      PinosPort *port)
+{
+  ConvertInfo *cinfo, *tmp;
+  PinosLink *port_link = NULL;
+
+  spa_list_for_each_safe (cinfo, tmp, &info->convert_list, link) {
+    if (cinfo->port != port)
+      continue;
+    port_link = cinfo->port_link;
+    convert_info_free (cinfo);
+  }
+  return port_link;
+}
+
+static void
+on_link_free (PinosListener *listener,
+              PinosLink     *link)
+{
+  LinkInfo *linfo = SPA_CONTAINER_OF (listener, LinkInfo, link_free);
+  NodeInfo *info = linfo->info;
+  PinosPort *port = linfo->port;
+
+  link_info_free (linfo);
+
+  pinos_log_debug ("module %p: link %p: freed, relink port %p", info->impl, link, port);
+  try_link_port (port->node, port, info);
+}
+
+/* the ports drop their links asynchronously and an input port with a link
+ * can't be linked again, so link the port of @linfo again when @link is
+ * freed */
+static void
+relink_when_free (LinkInfo  *linfo,
+                  PinosLink *link)
+{
+  pinos_signal_remove (&linfo->link_free);
+  pinos_signal_add (&link->free_signal, &linfo->link_free, on_link_free);
+}
+
 static void
 on_link_port_unlinked (PinosListener *listener,
                        PinosLink     *link,
                        PinosPort     *port)
 {
-  NodeInfo *info = SPA_CONTAINER_OF (listener, NodeInfo, port_unlinked);
-  ModuleImpl *impl = info->impl;
+  LinkInfo *linfo = SPA_CONTAINER_OF (listener, LinkInfo, port_unlinked);
+  NodeInfo *info = linfo->info;
+
+  pinos_log_debug ("module %p: link %p: port %p unlinked", info->impl, link, port);
+
+  unlisten_link (linfo);
+  unlink_convert_chain (info, linfo->port);
+
+  /* our own port is going away, there is nothing to link anymore */
+  if (port == linfo->port) {
+    link_info_free (linfo);
+    return;
+  }
+  relink_when_free (linfo, link);
+}
+
+static void
+notify_link_error (NodeInfo  *info,
+                   PinosLink *link)
+{
+  PinosResource *resource;
 
-  pinos_log_debug ("module %p: link %p: port %p unlinked", impl, link, port);
-  if (port->direction == PINOS_DIRECTION_OUTPUT && link->input)
-    try_link_port (link->input->node, link->input, info);
+  pinos_log_debug ("module %p: link %p: state error: %s", info->impl, link, link->error);
+
+  spa_list_for_each (resource, &link->resource_list, link) {
+    pinos_core_notify_error (resource->client->core_resource,
+                             resource->id,
+                             SPA_RESULT_ERROR,
+                             link->error);
+  }
+  if (info->info->client) {
+    pinos_core_notify_error (info->info->client->core_resource,
+                             info->resource->id,
+                             SPA_RESULT_ERROR,
+                             link->error);
+  }
 }
 
 static void
@@ -132,30 +350,14 @@ on_link_state_changed (PinosListener  *listener,
                        PinosLinkState  old,
                        PinosLinkState  state)
 {
-  NodeInfo *info = SPA_CONTAINER_OF (listener, NodeInfo, link_state_changed);
+  LinkInfo *linfo = SPA_CONTAINER_OF (listener, LinkInfo, link_state_changed);
+  NodeInfo *info = linfo->info;
   ModuleImpl *impl = info->impl;
 
   switch (state) {
     case PINOS_LINK_STATE_ERROR:
-    {
-      PinosResource *resource;
-
-      pinos_log_debug ("module %p: link %p: state error: %s", impl, link, link->error);
-
-      spa_list_for_each (resource, &link->resource_list, link) {
-        pinos_core_notify_error (resource->client->core_resource,
-                                 resource->id,
-                                 SPA_RESULT_ERROR,
-                                 link->error);
-      }
-      if (info->info->client) {
-        pinos_core_notify_error (info->info->client->core_resource,
-                                 info->resource->id,
-                                 SPA_RESULT_ERROR,
-                                 link->error);
-      }
+      notify_link_error (info, link);
       break;
-    }
 
     case PINOS_LINK_STATE_UNLINKED:
       pinos_log_debug ("module %p: link %p: unlinked", impl, link);
@@ -170,6 +372,535 @@ on_link_state_changed (PinosListener  *listener,
   }
 }
 
+static void
+on_convert_link_state_changed (PinosListener  *listener,
+                               PinosLink      *link,
+                               PinosLinkState  old,
+                               PinosLinkState  state)
+{
+  ConvertInfo *cinfo = SPA_CONTAINER_OF (listener, ConvertInfo, link_state_changed);
+  NodeInfo *info = cinfo->info;
+  PinosPort *port = cinfo->port;
+  PinosLink *port_link;
+  LinkInfo *linfo;
+
+  switch (state) {
+    case PINOS_LINK_STATE_ERROR:
+      notify_link_error (info, link);
+      break;
+
+    /* the target or a node of the chain went away, remove the complete
+     * chain and link our port again. The link of our port into the chain
+     * goes away with the ports of the convert nodes. */
+    case PINOS_LINK_STATE_UNLINKED:
+      pinos_log_debug ("module %p: link %p: convert chain of port %p unlinked", info->impl, link, port);
+      port_link = unlink_convert_chain (info, port);
+      if ((linfo = find_link_info (info, port)) == NULL)
+        break;
+      unlisten_link (linfo);
+      if (port_link)
+        relink_when_free (linfo, port_link);
+      else
+        link_info_free (linfo);
+      break;
+
+    case PINOS_LINK_STATE_INIT:
+    case PINOS_LINK_STATE_NEGOTIATING:
+    case PINOS_LINK_STATE_ALLOCATING:
+    case PINOS_LINK_STATE_PAUSED:
+    case PINOS_LINK_STATE_RUNNING:
+      break;
+  }
+}
+
+static const SpaHandleFactory *
+find_factory (const char  *lib,
+              const char  *name,
+              void       **hnd)
+{
+  SpaEnumHandleFactoryFunc enum_func;
+  uint32_t index;
+  const SpaHandleFactory *factory = NULL;
+  SpaResult res;
+
+  if ((*hnd = dlopen (lib, RTLD_NOW)) == NULL) {
+    pinos_log_error ("can't load %s: %s", lib, dlerror());
+    return NULL;
+  }
+  if ((enum_func = dlsym (*hnd, "spa_enum_handle_factory")) == NULL) {
+    pinos_log_error ("can't find enum function");
+    goto no_symbol;
+  }
+
+  for (index = 0; ; index++) {
+    if ((res = enum_func (&factory, index)) < 0) {
+      if (res != SPA_RESULT_ENUM_END)
+        pinos_log_error ("can't enumerate factories: %d", res);
+      goto enum_failed;
+    }
+    if (strcmp (factory->name, name) == 0)
+      break;
+  }
+  return factory;
+
+enum_failed:
+no_symbol:
+  dlclose (*hnd);
+  *hnd = NULL;
+  return NULL;
+}
+
+static PinosNode *
+make_convert_node (ModuleImpl             *impl,
+                   const SpaHandleFactory *factory)
+{
+  SpaHandle *handle;
+  SpaResult res;
+  void *iface;
+
+  if (factory == NULL)
+    return NULL;
+
+  handle = calloc (1, factory->size);
+  if ((res = spa_handle_factory_init (factory,
+                                      handle,
+                                      NULL,
+                                      impl->core->support,
+                                      impl->core->n_support)) < 0) {
+    pinos_log_error ("can't make factory instance: %d", res);
+    goto init_failed;
+  }
+  if ((res = spa_handle_get_interface (handle,
+                                       impl->core->type.spa_node,
+                                       &iface)) < 0) {
+    pinos_log_error ("can't get interface %d", res);
+    goto interface_failed;
+  }
+
+  return pinos_node_new (impl->core,
+                         NULL,
+                         factory->name,
+                         false,
+                         iface,
+                         NULL,
+                         NULL);
+
+interface_failed:
+  spa_handle_clear (handle);
+init_failed:
+  free (handle);
+  return NULL;
+}
+
+static uint32_t
+port_state (PinosPort *port)
+{
+  /* an idle node can still change the format */
+  if (port->state > PINOS_PORT_STATE_CONFIGURE && port->node->state == PINOS_NODE_STATE_IDLE)
+    return PINOS_PORT_STATE_CONFIGURE;
+  return port->state;
+}
+
+/* check if @output and @input can agree on a format. A port that is
+ * already configured only offers its current format. */
+static bool
+can_negotiate (ModuleImpl *impl,
+               PinosPort  *output,
+               PinosPort  *input)
+{
+  uint32_t out_state = port_state (output), in_state = port_state (input);
+  const SpaFormat *current = NULL;
+  SpaFormat *format;
+  char *error = NULL;
+
+  if (out_state == PINOS_PORT_STATE_CONFIGURE && in_state == PINOS_PORT_STATE_CONFIGURE) {
+    format = pinos_core_find_format (impl->core, output, input, NULL, 0, NULL, &error);
+    free (error);
+    return format != NULL;
+  }
+  if (out_state == PINOS_PORT_STATE_CONFIGURE) {
+    if (spa_node_port_get_format (input->node->node, SPA_DIRECTION_INPUT,
+                                  input->port_id, &current) < 0 || current == NULL)
+      return true;
+    return spa_node_port_enum_formats (output->node->node, SPA_DIRECTION_OUTPUT,
+                                       output->port_id, &format, current, 0) == SPA_RESULT_OK;
+  }
+  if (in_state == PINOS_PORT_STATE_CONFIGURE) {
+    if (spa_node_port_get_format (output->node->node, SPA_DIRECTION_OUTPUT,
+                                  output->port_id, &current) < 0 || current == NULL)
+      return true;
+    return spa_node_port_enum_formats (input->node->node, SPA_DIRECTION_INPUT,
+                                       input->port_id, &format, current, 0) == SPA_RESULT_OK;
+  }
+  return true;
+}
+
+/* check if the value of the format property @key of a configured @output
+ * or @input is accepted by the other port. Without a configured port both
+ * can still pick any value. */
+static bool
+prop_matches (ModuleImpl *impl,
+              PinosPort  *output,
+              PinosPort  *input,
+              uint32_t    key)
+{
+  uint32_t out_state = port_state (output), in_state = port_state (input);
+  PinosPort *configured, *other;
+  const SpaFormat *current = NULL;
+  SpaFormat *format;
+  SpaPODProp *prop;
+  SpaPODBuilder b = { NULL, };
+  SpaPODFrame f[2];
+  uint8_t buffer[256];
+
+  if (out_state == PINOS_PORT_STATE_CONFIGURE && in_state > PINOS_PORT_STATE_CONFIGURE) {
+    configured = input;
+    other = output;
+  } else if (in_state == PINOS_PORT_STATE_CONFIGURE && out_state > PINOS_PORT_STATE_CONFIGURE) {
+    configured = output;
+    other = input;
+  } else
+    return true;
+
+  if (spa_node_port_get_format (configured->node->node, configured->direction,
+                                configured->port_id, &current) < 0 || current == NULL)
+    return true;
+
+  if ((prop = spa_format_find_prop (current, key)) == NULL ||
+      (prop->body.flags & SPA_POD_PROP_FLAG_UNSET) ||
+      prop->body.value.type != SPA_POD_TYPE_INT)
+    return true;
+
+  /* a format with only @key, the other properties are left open */
+  spa_pod_builder_init (&b, buffer, sizeof (buffer));
+  spa_pod_builder_format (&b, &f[0], impl->core->type.spa_format,
+      SPA_FORMAT_MEDIA_TYPE (current), SPA_FORMAT_MEDIA_SUBTYPE (current),
+      SPA_POD_PROP (&f[1], key, 0, SPA_POD_TYPE_INT, 1,
+                           SPA_POD_VALUE (SpaPODInt, &prop->body.value)));
+
+  return spa_node_port_enum_formats (other->node->node, other->direction, other->port_id, &format,
+                                     SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaFormat), 0) == SPA_RESULT_OK;
+}
+
+static bool
+rates_match (ModuleImpl *impl,
+             PinosPort  *output,
+             PinosPort  *input)
+{
+  return prop_matches (impl, output, input, impl->format_audio.rate);
+}
+
+static bool
+channels_match (ModuleImpl *impl,
+                PinosPort  *output,
+                PinosPort  *input)
+{
+  return prop_matches (impl, output, input, impl->format_audio.channels);
+}
+
+static PinosNode *
+find_clock_node (ModuleImpl *impl,
+                 SpaClock   *clock)
+{
+  PinosNode *node;
+
+  spa_list_for_each (node, &impl->core->node_list, link) {
+    if (node->own_clock == clock)
+      return node;
+  }
+  return NULL;
+}
+
+/* the card of the device behind @node, its capture and playback devices
+ * are clocked by the same crystal */
+static const char *
+clock_card (PinosNode *node)
+{
+  if (node == NULL || node->properties == NULL)
+    return NULL;
+  return pinos_properties_get (node->properties, "alsa.card.id");
+}
+
+/* @output and @input run off different clocks when the node of @input has a
+ * clock of its own that is not the clock @output is driven by and the two
+ * clocks are not of the same card */
+static bool
+clocks_differ (ModuleImpl *impl,
+               PinosPort  *output,
+               PinosPort  *input)
+{
+  SpaClock *out_clock = output->node->clock, *in_clock = input->node->own_clock;
+  const char *out_card, *in_card;
+
+  if (out_clock == NULL || in_clock == NULL || out_clock == in_clock)
+    return false;
+
+  out_card = clock_card (find_clock_node (impl, out_clock));
+  in_card = clock_card (input->node);
+
+  return out_card == NULL || in_card == NULL || strcmp (out_card, in_card) != 0;
+}
+
+static void
+set_resample_props (ModuleImpl *impl,
+                    PinosNode  *node,
+                    bool        adaptive,
+                    double      rate_correction)
+{
+  SpaPODBuilder b = { NULL, };
+  SpaPODFrame f[2];
+  uint8_t buffer[256];
+  SpaResult res;
+
+  spa_pod_builder_init (&b, buffer, sizeof (buffer));
+  spa_pod_builder_props (&b, &f[0], impl->core->type.spa_props,
+      SPA_POD_PROP (&f[1], impl->prop_adaptive, 0, SPA_POD_TYPE_BOOL, 1, adaptive),
+      SPA_POD_PROP (&f[1], impl->prop_rate_correction, 0, SPA_POD_TYPE_DOUBLE, 1, rate_correction));
+
+  if ((res = spa_node_set_props (node->node, SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaProps))) < 0)
+    pinos_log_warn ("module %p: can't set resample props: %d", impl, res);
+}
+
+/* the position of @clock at @now, in ticks of the clock */
+static double
+clock_position (SpaClock *clock,
+                int64_t   now,
+                int32_t  *rate)
+{
+  int64_t ticks, monotonic_time;
+
+  if (spa_clock_get_time (clock, rate, &ticks, &monotonic_time) < 0 || *rate <= 0)
+    return 0.0;
+
+  return ticks + (double) (now - monotonic_time) * *rate / SPA_NSEC_PER_SEC;
+}
+
+/* the clocks filter the device positions, the ratio of their speeds over
+ * the last period is the rate correction. On top of that, drive the
+ * difference between what was produced and consumed since we locked back
+ * to 0 so that the buffer fill stays bounded. This runs on the data loop
+ * where the clocks are updated and the resampler runs. */
+static SpaResult
+do_rate_update (SpaLoop        *loop,
+                bool            async,
+                uint32_t        seq,
+                size_t          size,
+                void           *data,
+                void           *user_data)
+{
+  ConvertInfo *cinfo = user_data;
+  ModuleImpl *impl = cinfo->info->impl;
+  RateControl *rc = &cinfo->rate;
+  struct timespec ts;
+  int64_t now;
+  int32_t out_rate = 0, in_rate = 0;
+  double out_pos, in_pos, out_speed, in_speed, dt, error, correction;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  now = SPA_TIMESPEC_TO_TIME (&ts);
+
+  out_pos = clock_position (rc->out_clock, now, &out_rate);
+  in_pos = clock_position (rc->in_clock, now, &in_rate);
+  if (out_rate <= 0 || in_rate <= 0)
+    return SPA_RESULT_OK;
+
+  if (!rc->locked)
+    goto relock;
+
+  dt = (double) (now - rc->time_last) / SPA_NSEC_PER_SEC;
+  out_speed = (out_pos - rc->out_last) / (dt * out_rate);
+  in_speed = (in_pos - rc->in_last) / (dt * in_rate);
+
+  /* frames of @in_clock that were produced but not consumed */
+  error = (out_pos - rc->out_start) * in_rate / out_rate - (in_pos - rc->in_start);
+
+  /* a device was stopped or restarted */
+  if (out_speed <= 0.0 || in_speed <= 0.0 || error > in_rate || error < -in_rate) {
+    pinos_log_debug ("module %p: resample %p: clocks jumped, relock", impl, cinfo->node);
+    goto relock;
+  }
+
+  correction = out_speed / in_speed * (1.0 + error / ((double) in_rate * RATE_SETTLE_SEC));
+
+  pinos_log_trace ("module %p: resample %p: speed %f %f, error %f, correction %f", impl,
+      cinfo->node, out_speed, in_speed, error, correction);
+
+  set_resample_props (impl, cinfo->node, true, correction);
+
+  rc->out_last = out_pos;
+  rc->in_last = in_pos;
+  rc->time_last = now;
+  return SPA_RESULT_OK;
+
+relock:
+  rc->locked = true;
+  rc->out_start = rc->out_last = out_pos;
+  rc->in_start = rc->in_last = in_pos;
+  rc->time_last = now;
+  return SPA_RESULT_OK;
+}
+
+static void
+on_rate_timeout (SpaLoopUtils *utils,
+                 SpaSource    *source,
+                 void         *data)
+{
+  ConvertInfo *cinfo = data;
+
+  pinos_loop_invoke (cinfo->node->data_loop->loop,
+                     do_rate_update,
+                     SPA_ID_INVALID,
+                     0,
+                     NULL,
+                     cinfo);
+}
+
+static void
+start_rate_control (ConvertInfo *cinfo,
+                    SpaClock    *out_clock,
+                    SpaClock    *in_clock)
+{
+  ModuleImpl *impl = cinfo->info->impl;
+  RateControl *rc = &cinfo->rate;
+  struct timespec value;
+
+  rc->out_clock = out_clock;
+  rc->in_clock = in_clock;
+  rc->locked = false;
+  rc->timer = pinos_loop_add_timer (impl->core->main_loop->loop,
+                                    on_rate_timeout,
+                                    cinfo);
+  value.tv_sec = RATE_UPDATE_SEC;
+  value.tv_nsec = 0;
+  pinos_loop_update_timer (impl->core->main_loop->loop,
+                           rc->timer,
+                           &value,
+                           &value,
+                           false);
+}
+
+/* link @output to @input, limiting the rate to @max_rate when set */
+static PinosLink *
+link_ports (PinosPort   *output,
+            PinosPort   *input,
+            const char  *max_rate,
+            char       **error)
+{
+  PinosProperties *link_props = NULL;
+  PinosLink *link;
+
+  if (max_rate)
+    link_props = pinos_properties_new ("pinos.link.max-rate", max_rate, NULL);
+
+  link = pinos_port_link (output, input, NULL, link_props, error);
+
+  if (link_props && (link == NULL || link->properties != link_props))
+    pinos_properties_free (link_props);
+
+  return link;
+}
+
+/* put a chain of nodes made with @factories between @output and @input,
+ * in the order the data flows. The link on the side of @port, the port of
+ * our node, is returned. The other links are activated with
+ * activate_convert_links() after that one so that the formats are
+ * negotiated from both ends of the chain inwards. When @adaptive is set,
+ * the resampler follows the clock of @input. @max_rate limits the link
+ * into @input. */
+static PinosLink *
+link_with_convert (NodeInfo                *info,
+                   PinosPort               *port,
+                   PinosPort               *output,
+                   PinosPort               *input,
+                   const SpaHandleFactory **factories,
+                   uint32_t                 n_factories,
+                   bool                     adaptive,
+                   const char              *max_rate,
+                   char                   **error)
+{
+  ModuleImpl *impl = info->impl;
+  ConvertInfo *cinfo;
+  PinosNode *nodes[MAX_CONVERT];
+  PinosPort *cin[MAX_CONVERT], *cout[MAX_CONVERT];
+  PinosLink *links[MAX_CONVERT + 1];
+  uint32_t i, idx, n_nodes = 0, n_links = 0;
+  SpaClock *out_clock = output->node->clock, *in_clock = input->node->own_clock;
+
+  for (i = 0; i < n_factories; i++) {
+    if ((nodes[i] = make_convert_node (impl, factories[i])) == NULL)
+      goto not_possible;
+    n_nodes++;
+
+    /* before the formats are negotiated so that it does not pass through */
+    if (adaptive && factories[i] == impl->resample_factory)
+      set_resample_props (impl, nodes[i], true, 1.0);
+
+    if ((cin[i] = pinos_node_get_free_port (nodes[i], PINOS_DIRECTION_INPUT)) == NULL ||
+        (cout[i] = pinos_node_get_free_port (nodes[i], PINOS_DIRECTION_OUTPUT)) == NULL)
+      goto not_possible;
+  }
+
+  if (!can_negotiate (impl, output, cin[0]) ||
+      !can_negotiate (impl, cout[n_nodes - 1], input))
+    goto not_possible;
+
+  for (i = 0; i <= n_nodes; i++) {
+    if ((links[i] = link_ports (i == 0 ? output : cout[i - 1],
+                                i == n_nodes ? input : cin[i],
+                                i == n_nodes ? max_rate : NULL,
+                                error)) == NULL)
+      goto not_possible;
+    n_links++;
+  }
+
+  for (i = 0; i < n_nodes; i++) {
+    /* the node next to the target first, then from our port inwards */
+    if (port == output)
+      idx = i == 0 ? n_nodes - 1 : i - 1;
+    else
+      idx = i == 0 ? 0 : n_nodes - i;
+
+    pinos_log_debug ("module %p: inserted %s %p", impl, factories[idx]->name, nodes[idx]);
+
+    cinfo = calloc (1, sizeof (ConvertInfo));
+    cinfo->info = info;
+    cinfo->node = nodes[idx];
+    cinfo->port = port;
+    cinfo->port_link = port == output ? links[0] : links[n_nodes];
+    cinfo->target_link = port == output ? links[idx + 1] : links[idx];
+    spa_list_insert (info->convert_list.prev, &cinfo->link);
+
+    pinos_signal_add (&cinfo->target_link->state_changed,
+                      &cinfo->link_state_changed,
+                      on_convert_link_state_changed);
+
+    if (adaptive && factories[idx] == impl->resample_factory)
+      start_rate_control (cinfo, out_clock, in_clock);
+  }
+
+  return port == output ? links[0] : links[n_nodes];
+
+not_possible:
+  for (i = 0; i < n_links; i++)
+    pinos_link_destroy (links[i]);
+  for (i = 0; i < n_nodes; i++)
+    pinos_node_destroy (nodes[i]);
+  return NULL;
+}
+
+static void
+activate_convert_links (NodeInfo *info)
+{
+  ConvertInfo *cinfo;
+
+  spa_list_for_each (cinfo, &info->convert_list, link) {
+    if (!cinfo->activated) {
+      pinos_link_activate (cinfo->target_link);
+      cinfo->activated = true;
+    }
+  }
+}
+
 static void
 try_link_port (PinosNode *node,
                PinosPort *port,
@@ -181,13 +912,20 @@ try_link_port (PinosNode *node,
   uint32_t path_id;
   char *error = NULL;
   PinosLink *link;
-  PinosPort *target;
+  PinosPort *target, *output, *input;
+  LinkInfo *linfo;
+  const char *max_rate;
+  bool adaptive;
 
   props = node->properties;
   if (props == NULL) {
     pinos_log_debug ("module %p: node has no properties", impl);
     return;
   }
+  if (find_link_info (info, port)) {
+    pinos_log_debug ("module %p: port %p is already linked", impl, port);
+    return;
+  }
 
   str = pinos_properties_get (props, "pinos.target.node");
   if (str != NULL)
@@ -213,18 +951,57 @@ try_link_port (PinosNode *node,
   if (target == NULL)
     goto error;
 
-  if (port->direction == PINOS_DIRECTION_OUTPUT)
-    link = pinos_port_link (port, target, NULL, NULL, &error);
-  else
-    link = pinos_port_link (target, port, NULL, NULL, &error);
+  if (port->direction == PINOS_DIRECTION_OUTPUT) {
+    output = port;
+    input = target;
+  } else {
+    output = target;
+    input = port;
+  }
+
+  /* a consumer that only wants a few frames per second */
+  max_rate = pinos_properties_get (props, "pinos.link.max-rate");
+
+  link = NULL;
+  adaptive = clocks_differ (impl, output, input);
+  if (adaptive || !can_negotiate (impl, output, input)) {
+    const SpaHandleFactory *factories[MAX_CONVERT];
+    uint32_t n_factories = 0;
+
+    /* resample and mix the channels in F32, converting to and from the
+     * formats of the ports. Between clock domains we always resample to
+     * follow the drift. */
+    factories[n_factories++] = impl->convert_factory;
+    if (adaptive || !rates_match (impl, output, input))
+      factories[n_factories++] = impl->resample_factory;
+    if (!channels_match (impl, output, input))
+      factories[n_factories++] = impl->channelmix_factory;
+    if (n_factories > 1)
+      factories[n_factories++] = impl->convert_factory;
+    link = link_with_convert (info, port, output, input, factories, n_factories,
+                              adaptive, max_rate, &error);
+  }
+  if (link == NULL) {
+    free (error);
+    error = NULL;
+    link = link_ports (output, input, max_rate, &error);
+  }
 
   if (link == NULL)
     goto error;
 
-  pinos_signal_add (&link->port_unlinked, &info->port_unlinked, on_link_port_unlinked);
-  pinos_signal_add (&link->state_changed, &info->link_state_changed, on_link_state_changed);
+  linfo = calloc (1, sizeof (LinkInfo));
+  linfo->info = info;
+  linfo->port = port;
+  linfo->port_link = link;
+  spa_list_insert (info->link_list.prev, &linfo->link);
+
+  spa_list_init (&linfo->link_free.link);
+  pinos_signal_add (&link->port_unlinked, &linfo->port_unlinked, on_link_port_unlinked);
+  pinos_signal_add (&link->state_changed, &linfo->link_state_changed, on_link_state_changed);
 
   pinos_link_activate (link);
+  activate_convert_links (info);
 
   return;
 
@@ -298,9 +1075,9 @@ on_node_added (ModuleImpl    *impl,
   info->resource = resource;
   info->info = cinfo;
   spa_list_insert (cinfo->node_list.prev, &info->link);
+  spa_list_init (&info->link_list);
+  spa_list_init (&info->convert_list);
 
-  spa_list_init (&info->port_unlinked.link);
-  spa_list_init (&info->link_state_changed.link);
   pinos_signal_add (&node->port_added, &info->port_added, on_port_added);
   pinos_signal_add (&node->port_removed, &info->port_removed, on_port_removed);
   pinos_signal_add (&node->state_changed, &info->state_changed, on_state_changed);
@@ -410,6 +1187,14 @@ module_new (PinosCore       *core,
 
   spa_list_init (&impl->client_list);
 
+  spa_type_format_audio_map (core->type.map, &impl->format_audio);
+  impl->prop_adaptive = spa_type_map_get_id (core->type.map, SPA_TYPE_PROPS__adaptive);
+  impl->prop_rate_correction = spa_type_map_get_id (core->type.map, SPA_TYPE_PROPS__rateCorrection);
+
+  impl->convert_factory = find_factory (AUDIOCONVERT_LIB, "audioconvert", &impl->convert_hnd);
+  impl->resample_factory = find_factory (RESAMPLE_LIB, "resample", &impl->resample_hnd);
+  impl->channelmix_factory = find_factory (CHANNELMIX_LIB, "channelmix", &impl->channelmix_hnd);
+
   pinos_signal_add (&core->global_added, &impl->global_added, on_global_added);
   pinos_signal_add (&core->global_removed, &impl->global_removed, on_global_removed);
 
@@ -43,6 +43,8 @@
 #define MAX_OUTPUTS      64
 
 #define MAX_BUFFERS      64
+#define MAX_METAS        16
+#define MAX_DATAS        4
 
 #define CHECK_IN_PORT_ID(this,d,p)       ((d) == SPA_DIRECTION_INPUT && (p) < MAX_INPUTS)
 #define CHECK_OUT_PORT_ID(this,d,p)      ((d) == SPA_DIRECTION_OUTPUT && (p) < MAX_OUTPUTS)
@@ -63,8 +65,8 @@ typedef struct _PinosClientNodeImpl PinosClientNodeImpl;
 struct _ProxyBuffer {
   SpaBuffer   *outbuf;
   SpaBuffer    buffer;
-  SpaMeta      metas[4];
-  SpaData      datas[4];
+  SpaMeta      metas[MAX_METAS];
+  SpaData      datas[MAX_DATAS];
   off_t        offset;
   size_t       size;
   bool         outstanding;
@@ -655,6 +657,10 @@ spa_proxy_node_port_use_buffers (SpaNode         *node,
       spa_log_error (this->log, "missing shared metadata on buffer %d", i);
       return SPA_RESULT_ERROR;
     }
+    if (buffers[i]->n_metas > MAX_METAS || buffers[i]->n_datas > MAX_DATAS) {
+      spa_log_error (this->log, "too many metadata or data blocks on buffer %d", i);
+      return SPA_RESULT_ERROR;
+    }
 
     b->outbuf = buffers[i];
     memcpy (&b->buffer, buffers[i], sizeof (SpaBuffer));
@@ -790,7 +796,9 @@ spa_proxy_node_port_send_command (SpaNode        *node,
 
   this = SPA_CONTAINER_OF (node, SpaProxy, node);
 
-  spa_log_warn (this->log, "unhandled command %d", SPA_COMMAND_TYPE (command));
+  /* clients don't change their rate, the links skip buffers for them */
+  if (SPA_COMMAND_TYPE (command) != this->impl->core->type.command_node.QoS)
+    spa_log_warn (this->log, "unhandled command %d", SPA_COMMAND_TYPE (command));
   return SPA_RESULT_NOT_IMPLEMENTED;
 }
 
@@ -17,6 +17,7 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include <stdio.h>
 #include <string.h>
 
 #include <spa/lib/debug.h>
@@ -30,6 +31,7 @@
 #include "pinos/server/work-queue.h"
 
 #define MAX_BUFFERS     16
+#define MAX_DATAS       4
 
 typedef struct
 {
@@ -245,7 +247,7 @@ alloc_buffers (PinosLink      *this,
   /* each buffer */
   skel_size = sizeof (SpaBuffer);
 
-  metas = alloca (sizeof (SpaMeta) * n_params + 1);
+  metas = alloca (sizeof (SpaMeta) * (n_params + 1));
 
   /* add shared metadata */
   metas[n_metas].type = this->core->type.meta.Shared;
@@ -259,14 +261,38 @@ alloc_buffers (PinosLink      *this,
     SpaAllocParam *ap = params[i];
 
     if (ap->pod.type == this->core->type.alloc_param_meta_enable.MetaEnable) {
-      uint32_t type, size;
+      uint32_t type, size, j;
 
       if (spa_alloc_param_query (ap,
             this->core->type.alloc_param_meta_enable.type, SPA_POD_TYPE_ID, &type,
             this->core->type.alloc_param_meta_enable.size, SPA_POD_TYPE_INT, &size,
-            0) != 1)
+            0) != 2)
         continue;
 
+      if (type == this->core->type.meta.VideoDamage) {
+        uint32_t n_regions;
+
+        if (spa_alloc_param_query (ap,
+              this->core->type.alloc_param_meta_enable.videoDamageRegions, SPA_POD_TYPE_INT, &n_regions,
+              0) == 1)
+          size = SPA_META_VIDEO_DAMAGE_SIZE (n_regions);
+        if (size < sizeof (SpaMetaVideoDamage))
+          continue;
+      }
+
+      /* both ports can enable the same meta, use the largest size */
+      for (j = 0; j < n_metas; j++) {
+        if (metas[j].type == type)
+          break;
+      }
+      if (j < n_metas) {
+        if (size > metas[j].size) {
+          meta_size += size - metas[j].size;
+          metas[j].size = size;
+        }
+        continue;
+      }
+
       metas[n_metas].type = type;
       metas[n_metas].size = size;
       meta_size += metas[n_metas].size;
@@ -325,6 +351,12 @@ alloc_buffers (PinosLink      *this,
         SpaMetaRingbuffer *rb = p;
         spa_ringbuffer_init (&rb->ringbuffer, data_sizes[0]);
       }
+      else if (m->type == this->core->type.meta.VideoDamage) {
+        SpaMetaVideoDamage *vd = p;
+
+        vd->max_regions = (m->size - sizeof (SpaMetaVideoDamage)) / sizeof (SpaMetaRegion);
+        vd->n_regions = 0;
+      }
       p += m->size;
     }
     /* pointer to data structure */
@@ -439,24 +471,28 @@ do_allocation (PinosLink *this, uint32_t in_state, uint32_t out_state)
   if (impl->buffers == NULL) {
     SpaAllocParam *in_alloc, *out_alloc;
     SpaAllocParam *in_me, *out_me;
-    uint32_t max_buffers;
+    uint32_t max_buffers, n_datas = 1;
     size_t minsize = 1024, stride = 0;
 
     in_me = find_meta_enable (this->core, iinfo, this->core->type.meta.Ringbuffer);
     out_me = find_meta_enable (this->core, oinfo, this->core->type.meta.Ringbuffer);
     if (in_me && out_me) {
       uint32_t ms1, ms2, s1, s2;
+      size_t size;
       max_buffers = 1;
 
       if (spa_alloc_param_query (in_me,
             this->core->type.alloc_param_meta_enable.ringbufferSize,   SPA_POD_TYPE_INT, &ms1,
             this->core->type.alloc_param_meta_enable.ringbufferStride, SPA_POD_TYPE_INT, &s1, 0) == 2 &&
-          spa_alloc_param_query (in_me,
+          spa_alloc_param_query (out_me,
             this->core->type.alloc_param_meta_enable.ringbufferSize,   SPA_POD_TYPE_INT, &ms2,
             this->core->type.alloc_param_meta_enable.ringbufferStride, SPA_POD_TYPE_INT, &s2, 0) == 2) {
         minsize = SPA_MAX (ms1, ms2);
         stride = SPA_MAX (s1, s2);
       }
+      /* the ringbuffer wraps with a mask, its size is a power of 2 */
+      for (size = 1; size < minsize; size <<= 1);
+      minsize = size;
     } else {
       max_buffers = MAX_BUFFERS;
       minsize = stride = 0;
@@ -464,33 +500,39 @@ do_allocation (PinosLink *this, uint32_t in_state, uint32_t out_state)
       if (in_alloc) {
         uint32_t qmax_buffers = max_buffers,
                  qminsize = minsize,
-                 qstride = stride;
+                 qstride = stride,
+                 qn_datas = n_datas;
 
         spa_alloc_param_query (in_alloc,
             this->core->type.alloc_param_buffers.size,    SPA_POD_TYPE_INT, &qminsize,
             this->core->type.alloc_param_buffers.stride,  SPA_POD_TYPE_INT, &qstride,
             this->core->type.alloc_param_buffers.buffers, SPA_POD_TYPE_INT, &qmax_buffers,
+            this->core->type.alloc_param_buffers.datas,   SPA_POD_TYPE_INT, &qn_datas,
             0);
 
         max_buffers = qmax_buffers == 0 ? max_buffers : SPA_MIN (qmax_buffers, max_buffers);
         minsize = SPA_MAX (minsize, qminsize);
         stride = SPA_MAX (stride, qstride);
+        n_datas = SPA_CLAMP (qn_datas, n_datas, MAX_DATAS);
       }
       out_alloc = find_param (oinfo, this->core->type.alloc_param_buffers.Buffers);
       if (out_alloc) {
         uint32_t qmax_buffers = max_buffers,
                  qminsize = minsize,
-                 qstride = stride;
+                 qstride = stride,
+                 qn_datas = n_datas;
 
         spa_alloc_param_query (out_alloc,
             this->core->type.alloc_param_buffers.size,    SPA_POD_TYPE_INT, &qminsize,
             this->core->type.alloc_param_buffers.stride,  SPA_POD_TYPE_INT, &qstride,
             this->core->type.alloc_param_buffers.buffers, SPA_POD_TYPE_INT, &qmax_buffers,
+            this->core->type.alloc_param_buffers.datas,   SPA_POD_TYPE_INT, &qn_datas,
             0);
 
         max_buffers = qmax_buffers == 0 ? max_buffers : SPA_MIN (qmax_buffers, max_buffers);
         minsize = SPA_MAX (minsize, qminsize);
         stride = SPA_MAX (stride, qstride);
+        n_datas = SPA_CLAMP (qn_datas, n_datas, MAX_DATAS);
       }
     }
 
@@ -513,19 +555,31 @@ do_allocation (PinosLink *this, uint32_t in_state, uint32_t out_state)
       impl->buffer_owner = this->input;
       pinos_log_debug ("reusing %d input buffers %p", impl->n_buffers, impl->buffers);
     } else {
-      size_t data_sizes[1];
-      ssize_t data_strides[1];
+      size_t data_sizes[MAX_DATAS];
+      ssize_t data_strides[MAX_DATAS];
+      SpaAllocParam **params;
+      uint32_t i, n_params;
+
+      for (i = 0; i < n_datas; i++) {
+        data_sizes[i] = minsize;
+        data_strides[i] = stride;
+      }
 
-      data_sizes[0] = minsize;
-      data_strides[0] = stride;
+      /* metadata can be enabled on either side of the link */
+      n_params = oinfo->n_params + iinfo->n_params;
+      params = alloca (n_params * sizeof (SpaAllocParam *));
+      for (i = 0; i < oinfo->n_params; i++)
+        params[i] = oinfo->params[i];
+      for (i = 0; i < iinfo->n_params; i++)
+        params[oinfo->n_params + i] = iinfo->params[i];
 
       impl->buffer_owner = this;
       impl->n_buffers = max_buffers;
       impl->buffers = alloc_buffers (this,
                                      impl->n_buffers,
-                                     oinfo->n_params,
-                                     oinfo->params,
-                                     1,
+                                     n_params,
+                                     params,
+                                     n_datas,
                                      data_sizes,
                                      data_strides,
                                      &impl->buffer_mem);
@@ -803,6 +857,9 @@ pinos_link_free (PinosLink *link)
   if (impl->buffer_owner == link)
     pinos_memblock_free (&impl->buffer_mem);
 
+  if (link->properties)
+    pinos_properties_free (link->properties);
+
   free (impl);
 }
 
@@ -864,6 +921,62 @@ no_mem:
   return SPA_RESULT_NO_MEMORY;
 }
 
+/* the pinos.link.max-rate property is a framerate as "num/denom" or a
+ * number of buffers per second, returns the interval in nanoseconds */
+static int64_t
+parse_max_rate (PinosProperties *properties)
+{
+  const char *str;
+  int num, denom = 1;
+
+  if (properties == NULL ||
+      (str = pinos_properties_get (properties, "pinos.link.max-rate")) == NULL)
+    return 0;
+
+  if (sscanf (str, "%d/%d", &num, &denom) < 1 || num <= 0 || denom <= 0) {
+    pinos_log_warn ("invalid pinos.link.max-rate '%s'", str);
+    return 0;
+  }
+  return (int64_t) denom * SPA_NSEC_PER_SEC / num;
+}
+
+/**
+ * pinos_link_accept_rt:
+ * @link: a #PinosLink
+ * @time: the time of the buffer on the output port
+ *
+ * Check if a buffer with @time should go to the input of @link. Buffers
+ * are passed on a schedule of one every interval so that the average rate
+ * matches the max-rate of the link even when the output rate is not a
+ * multiple of it.
+ *
+ * Returns: %true when the buffer should be passed on.
+ */
+bool
+pinos_link_accept_rt (PinosLink *link,
+                      int64_t    time)
+{
+  int64_t interval = SPA_MAX (link->rt.max_rate_interval, link->rt.qos_interval);
+
+  if (interval <= 0)
+    return true;
+
+  /* first buffer, far behind the schedule or time jumped back */
+  if (link->rt.next_time < 0 ||
+      time >= link->rt.next_time + interval ||
+      time < link->rt.next_time - interval)
+    link->rt.next_time = time;
+
+  /* some slack for the jitter of live sources */
+  if (time + interval / 8 < link->rt.next_time) {
+    link->rt.skipped++;
+    return false;
+  }
+  link->rt.next_time += interval;
+
+  return true;
+}
+
 PinosLink *
 pinos_link_new (PinosCore       *core,
                 PinosPort       *output,
@@ -891,6 +1004,9 @@ pinos_link_new (PinosCore       *core,
   this->input = input;
   this->output = output;
 
+  this->rt.max_rate_interval = parse_max_rate (properties);
+  this->rt.next_time = -1;
+
   spa_list_init (&this->resource_list);
   pinos_signal_init (&this->port_unlinked);
   pinos_signal_init (&this->state_changed);
@@ -1009,9 +1125,12 @@ do_link_remove (SpaLoop        *loop,
     this->rt.input = NULL;
   }
   if (this->rt.output) {
-    pinos_port_pause_rt (this->rt.output);
+    PinosPort *output = this->rt.output;
+
+    pinos_port_pause_rt (output);
     spa_list_remove (&this->rt.output_link);
     this->rt.output = NULL;
+    pinos_port_update_rate_rt (output);
   }
 
   res = pinos_loop_invoke (this->core->main_loop->loop,
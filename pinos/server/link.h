@@ -74,6 +74,13 @@ struct _PinosLink {
     PinosPort     *output;
     SpaList        input_link;
     SpaList        output_link;
+    /* buffers within the interval after the previous one are not passed
+     * to the input, from the pinos.link.max-rate property and from QoS
+     * events of the input node */
+    int64_t        max_rate_interval;
+    int64_t        qos_interval;
+    int64_t        next_time;
+    uint32_t       skipped;
   } rt;
 };
 
@@ -88,6 +95,9 @@ void            pinos_link_destroy      (PinosLink       *link);
 bool            pinos_link_activate     (PinosLink *link);
 bool            pinos_link_deactivate   (PinosLink *link);
 
+bool            pinos_link_accept_rt    (PinosLink *link,
+                                         int64_t    time);
+
 #ifdef __cplusplus
 }
 #endif
@@ -20,6 +20,8 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <time.h>
+#include <inttypes.h>
 
 #include "pinos/client/pinos.h"
 #include "pinos/client/interfaces.h"
@@ -310,6 +312,56 @@ do_pull (PinosNode *this)
   return res;
 }
 
+static SpaResult
+do_link_qos (SpaLoop        *loop,
+             bool            async,
+             uint32_t        seq,
+             size_t          size,
+             void           *data,
+             void           *user_data)
+{
+  PinosLink *link = user_data;
+  int64_t interval = *(int64_t *) data;
+
+  if (link->rt.qos_interval == interval)
+    return SPA_RESULT_OK;
+
+  pinos_log_debug ("link %p: QoS interval %"PRIi64", skipped %u", link, interval, link->rt.skipped);
+  link->rt.qos_interval = interval;
+  link->rt.next_time = -1;
+
+  if (link->rt.output)
+    pinos_port_update_rate_rt (link->rt.output);
+
+  return SPA_RESULT_OK;
+}
+
+/* the node can't keep up, let the links to its inputs skip buffers */
+static void
+handle_qos (PinosNode *this, int64_t interval)
+{
+  PinosPort *inport;
+
+  if (interval < 0)
+    interval = 0;
+
+  spa_list_for_each (inport, &this->input_ports, link) {
+    PinosLink *link;
+
+    spa_list_for_each (link, &inport->links, input_link) {
+      if (link->output == NULL)
+        continue;
+
+      pinos_loop_invoke (link->output->node->data_loop->loop,
+                         do_link_qos,
+                         SPA_ID_INVALID,
+                         sizeof (int64_t),
+                         &interval,
+                         link);
+    }
+  }
+}
+
 static void
 on_node_event (SpaNode *node, SpaEvent *event, void *user_data)
 {
@@ -326,6 +378,12 @@ on_node_event (SpaNode *node, SpaEvent *event, void *user_data)
   else if (SPA_EVENT_TYPE (event) == this->core->type.event_node.RequestClockUpdate) {
     send_clock_update (this);
   }
+  else if (SPA_EVENT_TYPE (event) == this->core->type.event_node.QoS) {
+    SpaEventNodeQoS *qos = (SpaEventNodeQoS *) event;
+
+    pinos_log_debug ("node %p: QoS interval %"PRIi64, this, qos->body.interval.value);
+    handle_qos (this, qos->body.interval.value);
+  }
 }
 
 static void
@@ -336,6 +394,22 @@ on_node_need_input (SpaNode *node, void *user_data)
   do_pull (this);
 }
 
+/* the pts of the buffer, or now when the producer does not tell */
+static int64_t
+get_buffer_time (PinosPort *port, uint32_t buffer_id)
+{
+  SpaMetaHeader *h = NULL;
+  struct timespec now;
+
+  if (buffer_id < port->n_buffers)
+    h = spa_buffer_find_meta (port->buffers[buffer_id], port->node->core->type.meta.Header);
+  if (h)
+    return h->pts;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return SPA_TIMESPEC_TO_TIME (&now);
+}
+
 static void
 on_node_have_output (SpaNode *node, void *user_data)
 {
@@ -346,6 +420,7 @@ on_node_have_output (SpaNode *node, void *user_data)
   spa_list_for_each (outport, &this->output_ports, link) {
     PinosLink *link;
     SpaPortIO *po;
+    int64_t time = -1;
 
     po = &outport->io;
     if (po->buffer_id == SPA_ID_INVALID)
@@ -359,6 +434,17 @@ on_node_have_output (SpaNode *node, void *user_data)
       if (link->rt.input == NULL || link->rt.output == NULL)
         continue;
 
+      /* skip the buffers the input can't handle, the input node does not
+       * even wake up for them */
+      if (link->rt.max_rate_interval > 0 || link->rt.qos_interval > 0) {
+        if (time < 0)
+          time = get_buffer_time (outport, po->buffer_id);
+        if (!pinos_link_accept_rt (link, time)) {
+          pinos_log_trace ("link %p: skip buffer %d", link, po->buffer_id);
+          continue;
+        }
+      }
+
       inport = link->rt.input;
       inport->io = *po;
 
@@ -555,6 +641,7 @@ pinos_node_new (PinosCore       *core,
 
   this->node = node;
   this->clock = clock;
+  this->own_clock = clock;
   this->data_loop = core->data_loop;
 
   spa_list_init (&this->resource_list);
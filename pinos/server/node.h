@@ -68,6 +68,7 @@ struct _PinosNode {
   SpaNode *node;
   bool live;
   SpaClock *clock;
+  SpaClock *own_clock;
 
   SpaList resource_list;
 
@@ -20,6 +20,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <inttypes.h>
 
 #include "pinos/client/pinos.h"
 
@@ -89,6 +90,7 @@ do_add_link (SpaLoop        *loop,
   else {
     spa_list_insert (this->rt.links.prev, &link->rt.output_link);
     link->rt.output = this;
+    pinos_port_update_rate_rt (this);
   }
 
   return SPA_RESULT_OK;
@@ -152,7 +154,8 @@ pinos_port_link (PinosPort       *output_port,
 
   if (link == NULL)  {
     input_node->live = output_node->live;
-    if (output_node->clock)
+    /* a node with a clock of its own stays in its own clock domain */
+    if (output_node->clock && input_node->own_clock == NULL)
       input_node->clock = output_node->clock;
     pinos_log_debug ("node %p: clock %p, live %d", output_node, output_node->clock, output_node->live);
 
@@ -217,6 +220,54 @@ pinos_port_pause_rt (PinosPort *port)
   return res;
 }
 
+/**
+ * pinos_port_update_rate_rt:
+ * @port: an output port
+ *
+ * Tell the node of @port about the smallest interval at which the links
+ * of @port pass buffers. When all consumers skip buffers, the node can
+ * make fewer of them.
+ *
+ * Returns: the result of the QoS command
+ */
+SpaResult
+pinos_port_update_rate_rt (PinosPort *port)
+{
+  PinosLink *link;
+  int64_t interval = -1;
+  SpaResult res;
+
+  if (port->direction != PINOS_DIRECTION_OUTPUT)
+    return SPA_RESULT_OK;
+
+  spa_list_for_each (link, &port->rt.links, rt.output_link) {
+    int64_t li = SPA_MAX (link->rt.max_rate_interval, link->rt.qos_interval);
+    interval = interval < 0 ? li : SPA_MIN (interval, li);
+  }
+  if (interval < 0)
+    interval = 0;
+
+  if (interval == port->rt.interval)
+    return SPA_RESULT_OK;
+
+  port->rt.interval = interval;
+  pinos_log_debug ("port %p: rate interval %"PRIi64, port, interval);
+
+  {
+    SpaCommandNodeQoS qos = SPA_COMMAND_NODE_QOS_INIT (port->node->core->type.command_node.QoS,
+                                                      interval);
+    res = spa_node_port_send_command (port->node->node,
+                                      port->direction,
+                                      port->port_id,
+                                      (SpaCommand *) &qos);
+  }
+  /* not all nodes can change their rate, the links skip buffers anyway */
+  if (res == SPA_RESULT_NOT_IMPLEMENTED)
+    res = SPA_RESULT_OK;
+
+  return res;
+}
+
 static SpaResult
 do_remove_link_done (SpaLoop        *loop,
                      bool            async,
@@ -285,6 +336,7 @@ do_remove_link (SpaLoop        *loop,
     pinos_port_pause_rt (link->rt.output);
     spa_list_remove (&link->rt.output_link);
     link->rt.output = NULL;
+    pinos_port_update_rate_rt (port);
   }
 
   res = pinos_loop_invoke (this->core->main_loop->loop,
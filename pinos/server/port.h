@@ -66,6 +66,8 @@ struct _PinosPort {
 
   struct {
     SpaList         links;
+    /* the interval of the QoS command last sent to the node */
+    int64_t         interval;
   } rt;
 };
 
@@ -84,6 +86,7 @@ SpaResult           pinos_port_unlink                  (PinosPort        *port,
                                                         PinosLink        *link);
 
 SpaResult           pinos_port_pause_rt                (PinosPort        *port);
+SpaResult           pinos_port_update_rate_rt          (PinosPort        *port);
 SpaResult           pinos_port_clear_buffers           (PinosPort        *port);
 
 
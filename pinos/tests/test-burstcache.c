@@ -0,0 +1,331 @@
+/* Pinos
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <gst/gst.h>
+
+#include "gstburstcache.h"
+
+#define N_READERS       12
+#define N_OPS           3000
+#define N_TIMED         200
+
+static guint failures;
+static guint32 seed = 1;
+
+#define CHECK(expr, ...)                        \
+  G_STMT_START {                                \
+    if (!(expr)) {                              \
+      if (failures++ < 20) {                    \
+        g_print ("FAIL %s:%d: ", __FILE__, __LINE__); \
+        g_print (__VA_ARGS__);                  \
+        g_print ("\n");                         \
+      }                                         \
+    }                                           \
+  } G_STMT_END
+
+static guint
+next_random (guint n)
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 8) % n;
+}
+
+typedef struct {
+  GstBurstCacheReader *reader;
+  gboolean used;
+  gboolean alive;
+  GstBurstCacheStart start;
+  /* offset of the last buffer received, -1 for none */
+  gint64 last;
+} Slot;
+
+static void
+reader_ready (GstBurstCache * cache, GstBurstCacheReader * reader, gpointer user_data)
+{
+}
+
+static void
+reader_notify (gpointer user_data)
+{
+  ((Slot *) user_data)->alive = FALSE;
+}
+
+static GstBuffer *
+make_buffer (GPtrArray * buffers, gboolean keyframe)
+{
+  GstBuffer *buffer = gst_buffer_new_allocate (NULL, next_random (200) + 1, NULL);
+
+  GST_BUFFER_OFFSET (buffer) = buffers->len;
+  GST_BUFFER_PTS (buffer) = buffers->len * 10 * GST_MSECOND;
+  if (!keyframe)
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+
+  /* keep a ref to check that the cache releases its own */
+  g_ptr_array_add (buffers, gst_buffer_ref (buffer));
+
+  return buffer;
+}
+
+/* every buffer a reader receives is the one after the previous one and
+ * readers that start at the next keyframe get a keyframe first, unless the
+ * reader was resynced. All buffers are released in the end. */
+static void
+test_readers (void)
+{
+  static const GstFormat formats[] = { GST_FORMAT_BUFFERS, GST_FORMAT_BYTES, GST_FORMAT_TIME };
+  static const gint64 units[] = { 1, 100, 10 * GST_MSECOND };
+  Slot slots[N_READERS];
+  GPtrArray *buffers;
+  GstBurstCache *cache;
+  guint i, j, f;
+
+  memset (slots, 0, sizeof (slots));
+  buffers = g_ptr_array_new ();
+  cache = gst_burst_cache_new (sizeof (GstBurstCacheReader));
+
+  f = next_random (3);
+  gst_burst_cache_set_limits (cache, formats[f], 40 * units[f], 20 * units[f],
+      GST_BURST_CACHE_RECOVER_RESYNC_KEYFRAME);
+  gst_burst_cache_set_min_amount (cache, 1000, -1, 10);
+
+  for (i = 0; i < N_OPS; i++) {
+    guint op = next_random (10);
+
+    if (op < 5 || buffers->len == 0) {
+      gst_burst_cache_queue_buffer (cache, make_buffer (buffers, next_random (6) == 0));
+    } else if (op < 6) {
+      Slot *s = NULL;
+
+      for (j = 0; j < N_READERS; j++) {
+        if (!slots[j].used || !slots[j].alive) {
+          s = &slots[j];
+          break;
+        }
+      }
+      if (s == NULL)
+        continue;
+
+      s->used = s->alive = TRUE;
+      s->last = -1;
+      s->start = next_random (6);
+      s->reader = gst_burst_cache_reader_new (cache, reader_ready, s, reader_notify);
+      gst_burst_cache_reader_set_burst (s->reader, s->start,
+          GST_FORMAT_BUFFERS, next_random (10), GST_FORMAT_BUFFERS, next_random (30) + 10);
+      gst_burst_cache_add_reader (cache, s->reader);
+    } else {
+      Slot *s = &slots[next_random (N_READERS)];
+      guint n = next_random (5);
+
+      if (!s->used || !s->alive)
+        continue;
+
+      if (next_random (40) == 0) {
+        gst_burst_cache_remove_reader (cache, s->reader, FALSE);
+        continue;
+      }
+      while (n-- > 0) {
+        GstBuffer *buffer;
+        gint64 offset;
+
+        if (gst_burst_cache_get_buffer (cache, s->reader, &buffer) != GST_BURST_CACHE_RESULT_OK)
+          break;
+
+        offset = GST_BUFFER_OFFSET (buffer);
+        if (s->last == -1 && s->start == GST_BURST_CACHE_START_NEXT_KEYFRAME &&
+            !s->reader->discont)
+          CHECK (!GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT),
+              "reader %ld started at %ld, not a keyframe", (glong) (s - slots), (glong) offset);
+        if (s->last != -1 && !s->reader->discont)
+          CHECK (offset == s->last + 1, "reader %ld got %ld after %ld",
+              (glong) (s - slots), (glong) offset, (glong) s->last);
+        else
+          CHECK (offset > s->last, "reader %ld went back from %ld to %ld",
+              (glong) (s - slots), (glong) s->last, (glong) offset);
+
+        s->last = offset;
+        s->reader->discont = FALSE;
+        gst_buffer_unref (buffer);
+      }
+    }
+  }
+
+  gst_burst_cache_remove_readers (cache);
+  for (j = 0; j < N_READERS; j++)
+    CHECK (!slots[j].alive, "reader %u was not removed", j);
+  g_object_unref (cache);
+
+  for (i = 0; i < buffers->len; i++) {
+    GstBuffer *buffer = g_ptr_array_index (buffers, i);
+
+    CHECK (GST_MINI_OBJECT_REFCOUNT_VALUE (buffer) == 1, "buffer %u has %d refs", i,
+        GST_MINI_OBJECT_REFCOUNT_VALUE (buffer));
+    gst_buffer_unref (buffer);
+  }
+  g_ptr_array_free (buffers, TRUE);
+}
+
+/* exactly the readers that were idle for longer than their timeout are
+ * removed when a buffer is queued. Getting a buffer counts as activity and
+ * the timeout can be changed after the reader was added. The times are
+ * seconds apart so the test does not depend on how fast it runs. */
+static void
+test_timeouts (void)
+{
+  static Slot slots[N_TIMED];
+  static guint64 idle[N_TIMED];
+  static gboolean expired[N_TIMED];
+  GPtrArray *buffers;
+  GstBurstCache *cache;
+  gint64 now;
+  guint i, round;
+
+  memset (slots, 0, sizeof (slots));
+  buffers = g_ptr_array_new ();
+  cache = gst_burst_cache_new (sizeof (GstBurstCacheReader));
+  gst_burst_cache_queue_buffer (cache, make_buffer (buffers, TRUE));
+
+  now = g_get_real_time ();
+  for (i = 0; i < N_TIMED; i++) {
+    Slot *s = &slots[i];
+    guint64 timeout = next_random (4) == 0 ? 0 : next_random (20) * G_USEC_PER_SEC + G_USEC_PER_SEC / 2;
+
+    idle[i] = next_random (20) * G_USEC_PER_SEC;
+    s->used = s->alive = TRUE;
+    s->reader = gst_burst_cache_reader_new (cache, reader_ready, s, reader_notify);
+    s->reader->last_activity_time = now - idle[i];
+
+    /* half of them get their timeout before they are added */
+    if (i & 1)
+      gst_burst_cache_reader_set_timeout (cache, s->reader, timeout);
+    gst_burst_cache_add_reader (cache, s->reader);
+    if (!(i & 1))
+      gst_burst_cache_reader_set_timeout (cache, s->reader, timeout);
+
+    expired[i] = timeout > 0 && idle[i] > timeout;
+  }
+
+  for (round = 0; round < 4; round++) {
+    for (i = 0; i < N_TIMED; i++) {
+      Slot *s = &slots[i];
+      GstBuffer *buffer;
+
+      if (!s->alive)
+        continue;
+
+      switch (next_random (4)) {
+        case 0:
+          if (gst_burst_cache_get_buffer (cache, s->reader, &buffer) == GST_BURST_CACHE_RESULT_OK) {
+            gst_buffer_unref (buffer);
+            idle[i] = 0;
+          }
+          break;
+        case 1:
+          /* a timeout it can't have reached */
+          gst_burst_cache_reader_set_timeout (cache, s->reader, (guint64) 3600 * G_USEC_PER_SEC);
+          expired[i] = FALSE;
+          break;
+        case 2:
+          /* reached when it was idle for 2 seconds or more */
+          gst_burst_cache_reader_set_timeout (cache, s->reader, 3 * G_USEC_PER_SEC / 2);
+          expired[i] = idle[i] > G_USEC_PER_SEC;
+          break;
+        default:
+          break;
+      }
+    }
+
+    gst_burst_cache_queue_buffer (cache, make_buffer (buffers, TRUE));
+
+    for (i = 0; i < N_TIMED; i++) {
+      if (!slots[i].used)
+        continue;
+      CHECK (slots[i].alive == !expired[i], "round %u: reader %u is %s", round, i,
+          slots[i].alive ? "still there" : "removed");
+      slots[i].used = slots[i].alive;
+    }
+  }
+
+  gst_burst_cache_remove_readers (cache);
+  g_object_unref (cache);
+
+  for (i = 0; i < buffers->len; i++)
+    gst_buffer_unref (g_ptr_array_index (buffers, i));
+  g_ptr_array_free (buffers, TRUE);
+}
+
+/* a reader that was active after its first deadline stays until its new
+ * deadline and does not hold up the readers behind it. This one has to
+ * take real time, it sleeps for 1.2 seconds. */
+static void
+test_timeout_activity (void)
+{
+  Slot slots[2];
+  GPtrArray *buffers;
+  GstBurstCache *cache;
+  GstBuffer *buffer;
+  guint i;
+
+  memset (slots, 0, sizeof (slots));
+  buffers = g_ptr_array_new ();
+  cache = gst_burst_cache_new (sizeof (GstBurstCacheReader));
+
+  /* the second reader times out at the same time or after the first one */
+  for (i = 0; i < 2; i++) {
+    slots[i].used = slots[i].alive = TRUE;
+    slots[i].reader = gst_burst_cache_reader_new (cache, reader_ready, &slots[i], reader_notify);
+    gst_burst_cache_reader_set_timeout (cache, slots[i].reader, G_USEC_PER_SEC);
+    gst_burst_cache_add_reader (cache, slots[i].reader);
+  }
+  gst_burst_cache_queue_buffer (cache, make_buffer (buffers, TRUE));
+
+  g_usleep (G_USEC_PER_SEC / 2);
+  CHECK (gst_burst_cache_get_buffer (cache, slots[0].reader, &buffer) == GST_BURST_CACHE_RESULT_OK,
+      "no buffer for the first reader");
+  gst_buffer_unref (buffer);
+
+  g_usleep (G_USEC_PER_SEC * 7 / 10);
+  gst_burst_cache_queue_buffer (cache, make_buffer (buffers, TRUE));
+  CHECK (slots[0].alive, "the active reader was removed");
+  CHECK (!slots[1].alive, "the idle reader was not removed");
+
+  gst_burst_cache_remove_readers (cache);
+  g_object_unref (cache);
+
+  for (i = 0; i < buffers->len; i++)
+    gst_buffer_unref (g_ptr_array_index (buffers, i));
+  g_ptr_array_free (buffers, TRUE);
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+  gst_init (&argc, &argv);
+
+  test_readers ();
+  test_timeouts ();
+  test_timeout_activity ();
+
+  if (failures) {
+    g_print ("%u failures\n", failures);
+    return 1;
+  }
+  g_print ("all passed\n");
+  return 0;
+}
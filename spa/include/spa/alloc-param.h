@@ -63,6 +63,9 @@ spa_alloc_param_query (const SpaAllocParam *param, uint32_t key, ...)
 #define SPA_TYPE_ALLOC_PARAM_BUFFERS__stride    SPA_TYPE_ALLOC_PARAM_BUFFERS_BASE "stride"
 #define SPA_TYPE_ALLOC_PARAM_BUFFERS__buffers   SPA_TYPE_ALLOC_PARAM_BUFFERS_BASE "buffers"
 #define SPA_TYPE_ALLOC_PARAM_BUFFERS__align     SPA_TYPE_ALLOC_PARAM_BUFFERS_BASE "align"
+/* number of data blocks in a buffer, one per plane for multiplanar video,
+ * size and stride then apply to each block */
+#define SPA_TYPE_ALLOC_PARAM_BUFFERS__datas     SPA_TYPE_ALLOC_PARAM_BUFFERS_BASE "datas"
 
 typedef struct {
   uint32_t Buffers;
@@ -70,6 +73,7 @@ typedef struct {
   uint32_t stride;
   uint32_t buffers;
   uint32_t align;
+  uint32_t datas;
 } SpaTypeAllocParamBuffers;
 
 static inline void
@@ -81,6 +85,7 @@ spa_type_alloc_param_buffers_map (SpaTypeMap *map, SpaTypeAllocParamBuffers *typ
     type->stride   = spa_type_map_get_id (map, SPA_TYPE_ALLOC_PARAM_BUFFERS__stride);
     type->buffers  = spa_type_map_get_id (map, SPA_TYPE_ALLOC_PARAM_BUFFERS__buffers);
     type->align    = spa_type_map_get_id (map, SPA_TYPE_ALLOC_PARAM_BUFFERS__align);
+    type->datas    = spa_type_map_get_id (map, SPA_TYPE_ALLOC_PARAM_BUFFERS__datas);
   }
 }
 
@@ -94,6 +99,9 @@ spa_type_alloc_param_buffers_map (SpaTypeMap *map, SpaTypeAllocParamBuffers *typ
 #define SPA_TYPE_ALLOC_PARAM_META_ENABLE__ringbufferBlocks SPA_TYPE_ALLOC_PARAM_META_ENABLE_BASE "ringbufferBlocks"
 #define SPA_TYPE_ALLOC_PARAM_META_ENABLE__ringbufferAlign  SPA_TYPE_ALLOC_PARAM_META_ENABLE_BASE "ringbufferAlign"
 
+/* max number of damaged regions in the VideoDamage metadata */
+#define SPA_TYPE_ALLOC_PARAM_META_ENABLE__videoDamageRegions SPA_TYPE_ALLOC_PARAM_META_ENABLE_BASE "videoDamageRegions"
+
 typedef struct {
   uint32_t MetaEnable;
   uint32_t type;
@@ -102,6 +110,7 @@ typedef struct {
   uint32_t ringbufferStride;
   uint32_t ringbufferBlocks;
   uint32_t ringbufferAlign;
+  uint32_t videoDamageRegions;
 } SpaTypeAllocParamMetaEnable;
 
 static inline void
@@ -115,6 +124,7 @@ spa_type_alloc_param_meta_enable_map (SpaTypeMap *map, SpaTypeAllocParamMetaEnab
     type->ringbufferStride     = spa_type_map_get_id (map, SPA_TYPE_ALLOC_PARAM_META_ENABLE__ringbufferStride);
     type->ringbufferBlocks     = spa_type_map_get_id (map, SPA_TYPE_ALLOC_PARAM_META_ENABLE__ringbufferBlocks);
     type->ringbufferAlign      = spa_type_map_get_id (map, SPA_TYPE_ALLOC_PARAM_META_ENABLE__ringbufferAlign);
+    type->videoDamageRegions   = spa_type_map_get_id (map, SPA_TYPE_ALLOC_PARAM_META_ENABLE__videoDamageRegions);
   }
 }
 
@@ -77,6 +77,39 @@ typedef enum {
   SPA_AUDIO_FLAG_UNPOSITIONED      = (1 << 0)
 } SpaAudioFlags;
 
+/**
+ * SpaAudioChannelPosition:
+ * @SPA_AUDIO_CHANNEL_FL: front left
+ * @SPA_AUDIO_CHANNEL_FR: front right
+ * @SPA_AUDIO_CHANNEL_FC: front center
+ * @SPA_AUDIO_CHANNEL_LFE: low frequency effects
+ * @SPA_AUDIO_CHANNEL_RL: rear left
+ * @SPA_AUDIO_CHANNEL_RR: rear right
+ * @SPA_AUDIO_CHANNEL_FLC: front left of center
+ * @SPA_AUDIO_CHANNEL_FRC: front right of center
+ * @SPA_AUDIO_CHANNEL_RC: rear center
+ * @SPA_AUDIO_CHANNEL_SL: side left
+ * @SPA_AUDIO_CHANNEL_SR: side right
+ *
+ * The bits of the channel mask. The channels of a frame are stored in
+ * the order of their bits, lowest first.
+ */
+typedef enum {
+  SPA_AUDIO_CHANNEL_FL             = (1 << 0),
+  SPA_AUDIO_CHANNEL_FR             = (1 << 1),
+  SPA_AUDIO_CHANNEL_FC             = (1 << 2),
+  SPA_AUDIO_CHANNEL_LFE            = (1 << 3),
+  SPA_AUDIO_CHANNEL_RL             = (1 << 4),
+  SPA_AUDIO_CHANNEL_RR             = (1 << 5),
+  SPA_AUDIO_CHANNEL_FLC            = (1 << 6),
+  SPA_AUDIO_CHANNEL_FRC            = (1 << 7),
+  SPA_AUDIO_CHANNEL_RC             = (1 << 8),
+  SPA_AUDIO_CHANNEL_SL             = (1 << 9),
+  SPA_AUDIO_CHANNEL_SR             = (1 << 10),
+} SpaAudioChannelPosition;
+
+#define SPA_AUDIO_N_CHANNEL_POSITIONS 11
+
 /**
  * SpaAudioLayout:
  * @SPA_AUDIO_LAYOUT_INTERLEAVED: interleaved audio
@@ -96,7 +129,8 @@ typedef enum {
  * @layout: the sample layout
  * @rate: the sample rate
  * @channels: the number of channels
- * @channel_mask: the channel mask
+ * @channel_mask: the #SpaAudioChannelPosition of each channel, 0 when
+ *     unknown
  */
 struct _SpaAudioInfoRaw {
   uint32_t       format;
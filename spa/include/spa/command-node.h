@@ -36,6 +36,7 @@ extern "C" {
 #define SPA_TYPE_COMMAND_NODE__Drain          SPA_TYPE_COMMAND_NODE_BASE "Drain"
 #define SPA_TYPE_COMMAND_NODE__Marker         SPA_TYPE_COMMAND_NODE_BASE "Marker"
 #define SPA_TYPE_COMMAND_NODE__ClockUpdate    SPA_TYPE_COMMAND_NODE_BASE "ClockUpdate"
+#define SPA_TYPE_COMMAND_NODE__QoS            SPA_TYPE_COMMAND_NODE_BASE "QoS"
 
 typedef struct {
   uint32_t Pause;
@@ -44,6 +45,7 @@ typedef struct {
   uint32_t Drain;
   uint32_t Marker;
   uint32_t ClockUpdate;
+  uint32_t QoS;
 } SpaTypeCommandNode;
 
 static inline void
@@ -56,6 +58,7 @@ spa_type_command_node_map (SpaTypeMap *map, SpaTypeCommandNode *type)
     type->Drain          = spa_type_map_get_id (map, SPA_TYPE_COMMAND_NODE__Drain);
     type->Marker         = spa_type_map_get_id (map, SPA_TYPE_COMMAND_NODE__Marker);
     type->ClockUpdate    = spa_type_map_get_id (map, SPA_TYPE_COMMAND_NODE__ClockUpdate);
+    type->QoS            = spa_type_map_get_id (map, SPA_TYPE_COMMAND_NODE__QoS);
   }
 }
 
@@ -106,6 +109,29 @@ typedef struct {
                                  SPA_POD_INT_INIT (flags),                 \
                                  SPA_POD_LONG_INIT (latency))
 
+/**
+ * SpaCommandNodeQoS:
+ * @interval: all consumers of the port skip buffers that follow the
+ *            previous one within @interval nanoseconds, 0 when some
+ *            consumer wants all buffers
+ *
+ * Sent to an output port, a producer can lower its rate to avoid making
+ * buffers nobody looks at.
+ */
+typedef struct {
+  SpaPODObjectBody body;
+  SpaPODLong      interval              SPA_ALIGNED (8);
+} SpaCommandNodeQoSBody;
+
+typedef struct {
+  SpaPOD                pod;
+  SpaCommandNodeQoSBody body;
+} SpaCommandNodeQoS;
+
+#define SPA_COMMAND_NODE_QOS_INIT(type,interval)                           \
+  SPA_COMMAND_INIT_COMPLEX (sizeof (SpaCommandNodeQoSBody), type,          \
+                                 SPA_POD_LONG_INIT (interval))
+
 #ifdef __cplusplus
 }  /* extern "C" */
 #endif
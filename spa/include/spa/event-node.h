@@ -37,6 +37,7 @@ extern "C" {
 #define SPA_TYPE_EVENT_NODE__Buffering             SPA_TYPE_EVENT_NODE_BASE "Buffering"
 #define SPA_TYPE_EVENT_NODE__RequestRefresh        SPA_TYPE_EVENT_NODE_BASE "RequestRefresh"
 #define SPA_TYPE_EVENT_NODE__RequestClockUpdate    SPA_TYPE_EVENT_NODE_BASE "RequestClockUpdate"
+#define SPA_TYPE_EVENT_NODE__QoS                   SPA_TYPE_EVENT_NODE_BASE "QoS"
 
 typedef struct {
   uint32_t AsyncComplete;
@@ -44,6 +45,7 @@ typedef struct {
   uint32_t Buffering;
   uint32_t RequestRefresh;
   uint32_t RequestClockUpdate;
+  uint32_t QoS;
 } SpaTypeEventNode;
 
 static inline void
@@ -55,6 +57,7 @@ spa_type_event_node_map (SpaTypeMap *map, SpaTypeEventNode *type)
     type->Buffering            = spa_type_map_get_id (map, SPA_TYPE_EVENT_NODE__Buffering);
     type->RequestRefresh       = spa_type_map_get_id (map, SPA_TYPE_EVENT_NODE__RequestRefresh);
     type->RequestClockUpdate   = spa_type_map_get_id (map, SPA_TYPE_EVENT_NODE__RequestClockUpdate);
+    type->QoS                  = spa_type_map_get_id (map, SPA_TYPE_EVENT_NODE__QoS);
   }
 }
 
@@ -95,6 +98,25 @@ typedef struct {
       SPA_POD_LONG_INIT (timestamp),                                                    \
       SPA_POD_LONG_INIT (offset))
 
+/**
+ * SpaEventNodeQoS:
+ * @interval: the minimum time in nanoseconds between two buffers the node
+ *            can handle on its input ports, 0 when it can handle all of them
+ */
+typedef struct {
+  SpaPODObjectBody body;
+  SpaPODLong       interval     SPA_ALIGNED (8);
+} SpaEventNodeQoSBody;
+
+typedef struct {
+  SpaPOD              pod;
+  SpaEventNodeQoSBody body;
+} SpaEventNodeQoS;
+
+#define SPA_EVENT_NODE_QOS_INIT(type,interval)                          \
+  SPA_EVENT_INIT_COMPLEX (sizeof (SpaEventNodeQoSBody), type,           \
+      SPA_POD_LONG_INIT (interval))
+
 #ifdef __cplusplus
 }  /* extern "C" */
 #endif
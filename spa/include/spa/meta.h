@@ -34,6 +34,7 @@ extern "C" {
 #define SPA_TYPE_META__Header                SPA_TYPE_META_BASE "Header"
 #define SPA_TYPE_META__Pointer               SPA_TYPE_META_BASE "Pointer"
 #define SPA_TYPE_META__VideoCrop             SPA_TYPE_META_BASE "VideoCrop"
+#define SPA_TYPE_META__VideoDamage           SPA_TYPE_META_BASE "VideoDamage"
 #define SPA_TYPE_META__Ringbuffer            SPA_TYPE_META_BASE "Ringbuffer"
 #define SPA_TYPE_META__Shared                SPA_TYPE_META_BASE "Shared"
 
@@ -41,6 +42,7 @@ typedef struct {
   uint32_t Header;
   uint32_t Pointer;
   uint32_t VideoCrop;
+  uint32_t VideoDamage;
   uint32_t Ringbuffer;
   uint32_t Shared;
 } SpaTypeMeta;
@@ -52,6 +54,7 @@ spa_type_meta_map (SpaTypeMap *map, SpaTypeMeta *type)
     type->Header        = spa_type_map_get_id (map, SPA_TYPE_META__Header);
     type->Pointer       = spa_type_map_get_id (map, SPA_TYPE_META__Pointer);
     type->VideoCrop     = spa_type_map_get_id (map, SPA_TYPE_META__VideoCrop);
+    type->VideoDamage   = spa_type_map_get_id (map, SPA_TYPE_META__VideoDamage);
     type->Ringbuffer    = spa_type_map_get_id (map, SPA_TYPE_META__Ringbuffer);
     type->Shared        = spa_type_map_get_id (map, SPA_TYPE_META__Shared);
   }
@@ -85,16 +88,52 @@ typedef struct {
 
 /**
  * SpaMetaVideoCrop:
- * @x:
- * @y:
- * @width:
- * @height
+ * @x: horizontal offset of the region in pixels
+ * @y: vertical offset of the region in pixels
+ * @width: width of the region in pixels
+ * @height: height of the region in pixels
+ *
+ * The region of the video frame that contains the valid image. The format
+ * still describes the complete frame, a consumer can use the region without
+ * copying by offsetting into the planes of the buffer. A @width or @height
+ * of 0 means that the complete frame is valid.
  */
 typedef struct {
   int32_t   x, y;
   int32_t   width, height;
 } SpaMetaVideoCrop;
 
+/**
+ * SpaMetaRegion:
+ * @x: horizontal offset of the region in pixels
+ * @y: vertical offset of the region in pixels
+ * @width: width of the region in pixels
+ * @height: height of the region in pixels
+ */
+typedef struct {
+  int32_t   x, y;
+  int32_t   width, height;
+} SpaMetaRegion;
+
+/**
+ * SpaMetaVideoDamage:
+ * @max_regions: number of regions that fit in the metadata, set when the
+ *               buffer is allocated
+ * @n_regions: number of regions that changed since the previous frame
+ *
+ * The @n_regions SpaMetaRegion follow the structure in memory, use
+ * SPA_META_VIDEO_DAMAGE_REGIONS() to get them. When @n_regions is 0 the
+ * complete frame has to be considered changed, producers that have more
+ * regions than @max_regions should do the same or merge regions.
+ */
+typedef struct {
+  uint32_t  max_regions;
+  uint32_t  n_regions;
+} SpaMetaVideoDamage;
+
+#define SPA_META_VIDEO_DAMAGE_SIZE(n)     (sizeof (SpaMetaVideoDamage) + (n) * sizeof (SpaMetaRegion))
+#define SPA_META_VIDEO_DAMAGE_REGIONS(d)  SPA_MEMBER ((d), sizeof (SpaMetaVideoDamage), SpaMetaRegion)
+
 /**
  * SpaMetaRingbuffer:
  * @ringbuffer:
@@ -373,7 +373,7 @@ spa_pod_builder_addv (SpaPODBuilder *builder,
         goto primitive;
       case SPA_POD_TYPE_LONG:
         head.long_pod.pod.type = SPA_POD_TYPE_LONG;
-        head.long_pod.pod.size = body_size = sizeof (uint32_t);
+        head.long_pod.pod.size = body_size = sizeof (uint64_t);
         head.long_pod.value = va_arg (args, int64_t);
         head_size = sizeof (SpaPOD);
         body = &head.long_pod.value;
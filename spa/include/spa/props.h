@@ -38,15 +38,40 @@ typedef SpaPODObject SpaProps;
 #define SPA_TYPE_PROPS__card                 SPA_TYPE_PROPS_BASE "card"
 #define SPA_TYPE_PROPS__cardName             SPA_TYPE_PROPS_BASE "cardName"
 #define SPA_TYPE_PROPS__minLatency           SPA_TYPE_PROPS_BASE "minLatency"
+#define SPA_TYPE_PROPS__maxLatency           SPA_TYPE_PROPS_BASE "maxLatency"
+#define SPA_TYPE_PROPS__latency              SPA_TYPE_PROPS_BASE "latency"
+#define SPA_TYPE_PROPS__xruns                SPA_TYPE_PROPS_BASE "xruns"
 #define SPA_TYPE_PROPS__periods              SPA_TYPE_PROPS_BASE "periods"
 #define SPA_TYPE_PROPS__periodSize           SPA_TYPE_PROPS_BASE "periodSize"
 #define SPA_TYPE_PROPS__periodEvent          SPA_TYPE_PROPS_BASE "periodEvent"
+#define SPA_TYPE_PROPS__bytes                SPA_TYPE_PROPS_BASE "bytes"
+#define SPA_TYPE_PROPS__cycles               SPA_TYPE_PROPS_BASE "cycles"
+#define SPA_TYPE_PROPS__minCycleTime         SPA_TYPE_PROPS_BASE "minCycleTime"
+#define SPA_TYPE_PROPS__maxCycleTime         SPA_TYPE_PROPS_BASE "maxCycleTime"
+#define SPA_TYPE_PROPS__avgCycleTime         SPA_TYPE_PROPS_BASE "avgCycleTime"
 #define SPA_TYPE_PROPS__live                 SPA_TYPE_PROPS_BASE "live"
 #define SPA_TYPE_PROPS__waveType             SPA_TYPE_PROPS_BASE "waveType"
 #define SPA_TYPE_PROPS__frequency            SPA_TYPE_PROPS_BASE "frequency"
+#define SPA_TYPE_PROPS__burst                SPA_TYPE_PROPS_BASE "burst"
 #define SPA_TYPE_PROPS__volume               SPA_TYPE_PROPS_BASE "volume"
 #define SPA_TYPE_PROPS__mute                 SPA_TYPE_PROPS_BASE "mute"
+#define SPA_TYPE_PROPS__channelVolume        SPA_TYPE_PROPS_BASE "channelVolume"
+#define SPA_TYPE_PROPS__dither               SPA_TYPE_PROPS_BASE "dither"
+#define SPA_TYPE_PROPS__quality              SPA_TYPE_PROPS_BASE "quality"
+#define SPA_TYPE_PROPS__adaptive             SPA_TYPE_PROPS_BASE "adaptive"
+#define SPA_TYPE_PROPS__rateCorrection       SPA_TYPE_PROPS_BASE "rateCorrection"
+#define SPA_TYPE_PROPS__channelMatrix        SPA_TYPE_PROPS_BASE "channelMatrix"
+#define SPA_TYPE_PROPS__normalize            SPA_TYPE_PROPS_BASE "normalize"
 #define SPA_TYPE_PROPS__patternType          SPA_TYPE_PROPS_BASE "patternType"
+#define SPA_TYPE_PROPS__threads              SPA_TYPE_PROPS_BASE "threads"
+#define SPA_TYPE_PROPS__dropOldest           SPA_TYPE_PROPS_BASE "dropOldest"
+#define SPA_TYPE_PROPS__droppedFrames        SPA_TYPE_PROPS_BASE "droppedFrames"
+#define SPA_TYPE_PROPS__lowLatency           SPA_TYPE_PROPS_BASE "lowLatency"
+#define SPA_TYPE_PROPS__bitrate              SPA_TYPE_PROPS_BASE "bitrate"
+#define SPA_TYPE_PROPS__cropX                SPA_TYPE_PROPS_BASE "cropX"
+#define SPA_TYPE_PROPS__cropY                SPA_TYPE_PROPS_BASE "cropY"
+#define SPA_TYPE_PROPS__cropWidth            SPA_TYPE_PROPS_BASE "cropWidth"
+#define SPA_TYPE_PROPS__cropHeight           SPA_TYPE_PROPS_BASE "cropHeight"
 
 static inline uint32_t
 spa_pod_builder_push_props (SpaPODBuilder *builder,
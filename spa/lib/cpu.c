@@ -0,0 +1,87 @@
+/* Simple Plugin API
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <lib/cpu.h>
+
+static uint32_t
+detect_flags (void)
+{
+  uint32_t flags = 0;
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("sse2"))
+    flags |= SPA_CPU_FLAG_SSE2;
+  if (__builtin_cpu_supports ("ssse3"))
+    flags |= SPA_CPU_FLAG_SSSE3;
+  if (__builtin_cpu_supports ("sse4.1"))
+    flags |= SPA_CPU_FLAG_SSE41;
+  if (__builtin_cpu_supports ("avx2"))
+    flags |= SPA_CPU_FLAG_AVX2;
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+  flags |= SPA_CPU_FLAG_NEON;
+#endif
+
+  return flags;
+}
+
+/**
+ * spa_cpu_get_flags:
+ *
+ * Get the #SpaCPUFlags of the CPU we are running on. The flags are
+ * detected once and cached.
+ *
+ * Returns: a mask of #SpaCPUFlags
+ */
+uint32_t
+spa_cpu_get_flags (void)
+{
+  static uint32_t flags;
+  static bool detected = false;
+
+  if (!detected) {
+    flags = detect_flags ();
+    detected = true;
+  }
+  return flags;
+}
+
+/**
+ * spa_cpu_get_info_flags:
+ * @info: the plugin info or %NULL
+ *
+ * Get the CPU flags a plugin should use, taking the optional
+ * #SPA_CPU_INFO_MASK from @info into account.
+ *
+ * Returns: a mask of #SpaCPUFlags
+ */
+uint32_t
+spa_cpu_get_info_flags (const SpaDict *info)
+{
+  uint32_t flags = spa_cpu_get_flags ();
+  const char *str;
+
+  if (info && (str = spa_dict_lookup (info, SPA_CPU_INFO_MASK)))
+    flags &= strtoul (str, NULL, 0);
+
+  return flags;
+}
@@ -0,0 +1,62 @@
+/* Simple Plugin API
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_LIBCPU_H__
+#define __SPA_LIBCPU_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <spa/defs.h>
+#include <spa/dict.h>
+
+/**
+ * SpaCPUFlags:
+ * @SPA_CPU_FLAG_SSE2: x86 SSE2 instructions
+ * @SPA_CPU_FLAG_SSSE3: x86 SSSE3 instructions
+ * @SPA_CPU_FLAG_SSE41: x86 SSE4.1 instructions
+ * @SPA_CPU_FLAG_AVX2: x86 AVX2 instructions
+ * @SPA_CPU_FLAG_NEON: ARM NEON instructions
+ */
+typedef enum {
+  SPA_CPU_FLAG_SSE2     = (1 << 0),
+  SPA_CPU_FLAG_SSSE3    = (1 << 1),
+  SPA_CPU_FLAG_SSE41    = (1 << 2),
+  SPA_CPU_FLAG_AVX2     = (1 << 3),
+  SPA_CPU_FLAG_NEON     = (1 << 16),
+} SpaCPUFlags;
+
+/**
+ * SPA_CPU_INFO_MASK:
+ *
+ * Key in the info dictionary passed to a plugin that restricts the
+ * detected CPU flags to the given mask. Use "0" to force the plain C
+ * code paths, for example to compare against the SIMD ones.
+ */
+#define SPA_CPU_INFO_MASK  "cpu.mask"
+
+uint32_t   spa_cpu_get_flags      (void);
+uint32_t   spa_cpu_get_info_flags (const SpaDict *info);
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* __SPA_LIBCPU_H__ */
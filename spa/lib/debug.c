@@ -87,6 +87,16 @@ spa_debug_buffer (const SpaBuffer *buffer, const SpaTypeMap *map)
       fprintf (stderr, "      width:  %d\n", h->width);
       fprintf (stderr, "      height: %d\n", h->height);
     }
+    else if (!strcmp (type_name, SPA_TYPE_META__VideoDamage)) {
+      SpaMetaVideoDamage *h = m->data;
+      SpaMetaRegion *r = SPA_META_VIDEO_DAMAGE_REGIONS (h);
+      uint32_t j;
+      fprintf (stderr, "    SpaMetaVideoDamage:\n");
+      fprintf (stderr, "      max_regions: %u\n", h->max_regions);
+      fprintf (stderr, "      n_regions:   %u\n", h->n_regions);
+      for (j = 0; j < SPA_MIN (h->n_regions, h->max_regions); j++)
+        fprintf (stderr, "        %d,%d %dx%d\n", r[j].x, r[j].y, r[j].width, r[j].height);
+    }
     else if (!strcmp (type_name, SPA_TYPE_META__Ringbuffer)) {
       SpaMetaRingbuffer *h = m->data;
       fprintf (stderr, "    SpaMetaRingbuffer:\n");
@@ -0,0 +1,134 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <immintrin.h>
+
+#include <lib/mix-ops.h>
+
+void
+spa_audiomixer_mix_s16_avx2 (void *dst, const void *src[], uint32_t n_src, uint32_t n_samples)
+{
+  int16_t *d = dst;
+  const int16_t **s = (const int16_t **) src;
+  uint32_t i, j, unrolled = n_samples & ~15;
+
+  /* accumulate in 32 bits and saturate once with packs */
+  for (i = 0; i < unrolled; i += 16) {
+    __m256i lo = _mm256_setzero_si256 (), hi = _mm256_setzero_si256 ();
+    __m256i r;
+
+    for (j = 0; j < n_src; j++) {
+      __m128i in0 = _mm_loadu_si128 ((const __m128i *) &s[j][i]);
+      __m128i in1 = _mm_loadu_si128 ((const __m128i *) &s[j][i + 8]);
+      lo = _mm256_add_epi32 (lo, _mm256_cvtepi16_epi32 (in0));
+      hi = _mm256_add_epi32 (hi, _mm256_cvtepi16_epi32 (in1));
+    }
+    /* packs works per 128 bit lane, put the quadwords back in order */
+    r = _mm256_permute4x64_epi64 (_mm256_packs_epi32 (lo, hi), 0xd8);
+    _mm256_storeu_si256 ((__m256i *) &d[i], r);
+  }
+  spa_audiomixer_mix_s16_range (d, s, n_src, i, n_samples);
+}
+
+void
+spa_audiomixer_mix_f32_avx2 (void *dst, const void *src[], uint32_t n_src, uint32_t n_samples)
+{
+  float *d = dst;
+  const float **s = (const float **) src;
+  uint32_t i, j, unrolled = n_samples & ~15;
+
+  for (i = 0; i < unrolled; i += 16) {
+    __m256 a0 = _mm256_loadu_ps (&s[0][i]);
+    __m256 a1 = _mm256_loadu_ps (&s[0][i + 8]);
+
+    for (j = 1; j < n_src; j++) {
+      a0 = _mm256_add_ps (a0, _mm256_loadu_ps (&s[j][i]));
+      a1 = _mm256_add_ps (a1, _mm256_loadu_ps (&s[j][i + 8]));
+    }
+    _mm256_storeu_ps (&d[i], a0);
+    _mm256_storeu_ps (&d[i + 8], a1);
+  }
+  spa_audiomixer_mix_f32_range (d, s, n_src, i, n_samples);
+}
+
+void
+spa_audiomixer_mix_s16_gain_avx2 (void *dst, const void *src[], const float gain[],
+                                  const float step[], uint32_t n_channels, uint32_t n_src,
+                                  uint32_t n_samples)
+{
+  int16_t *d = dst;
+  const int16_t **s = (const int16_t **) src;
+  uint32_t i, j, unrolled = n_samples & ~15, frame = 0, channel = 0;
+  float index[16];
+  const __m256 min = _mm256_set1_ps (INT16_MIN), max = _mm256_set1_ps (INT16_MAX);
+
+  for (i = 0; i < unrolled; i += 16) {
+    __m256 idx0, idx1, a0 = _mm256_setzero_ps (), a1 = _mm256_setzero_ps ();
+    __m256i r;
+
+    spa_audiomixer_frame_index (index, 16, &frame, &channel, n_channels);
+    idx0 = _mm256_loadu_ps (&index[0]);
+    idx1 = _mm256_loadu_ps (&index[8]);
+
+    for (j = 0; j < n_src; j++) {
+      __m256 g = _mm256_set1_ps (gain[j]), st = _mm256_set1_ps (step[j]);
+      __m256 in0 = _mm256_cvtepi32_ps (_mm256_cvtepi16_epi32 (_mm_loadu_si128 ((const __m128i *) &s[j][i])));
+      __m256 in1 = _mm256_cvtepi32_ps (_mm256_cvtepi16_epi32 (_mm_loadu_si128 ((const __m128i *) &s[j][i + 8])));
+
+      a0 = _mm256_add_ps (a0, _mm256_mul_ps (in0, _mm256_add_ps (g, _mm256_mul_ps (st, idx0))));
+      a1 = _mm256_add_ps (a1, _mm256_mul_ps (in1, _mm256_add_ps (g, _mm256_mul_ps (st, idx1))));
+    }
+    a0 = _mm256_min_ps (_mm256_max_ps (a0, min), max);
+    a1 = _mm256_min_ps (_mm256_max_ps (a1, min), max);
+    r = _mm256_packs_epi32 (_mm256_cvtps_epi32 (a0), _mm256_cvtps_epi32 (a1));
+    _mm256_storeu_si256 ((__m256i *) &d[i], _mm256_permute4x64_epi64 (r, 0xd8));
+  }
+  spa_audiomixer_mix_s16_gain_range (d, s, gain, step, n_channels, n_src, i, n_samples);
+}
+
+void
+spa_audiomixer_mix_f32_gain_avx2 (void *dst, const void *src[], const float gain[],
+                                  const float step[], uint32_t n_channels, uint32_t n_src,
+                                  uint32_t n_samples)
+{
+  float *d = dst;
+  const float **s = (const float **) src;
+  uint32_t i, j, unrolled = n_samples & ~15, frame = 0, channel = 0;
+  float index[16];
+
+  for (i = 0; i < unrolled; i += 16) {
+    __m256 idx0, idx1, a0 = _mm256_setzero_ps (), a1 = _mm256_setzero_ps ();
+
+    spa_audiomixer_frame_index (index, 16, &frame, &channel, n_channels);
+    idx0 = _mm256_loadu_ps (&index[0]);
+    idx1 = _mm256_loadu_ps (&index[8]);
+
+    for (j = 0; j < n_src; j++) {
+      __m256 g = _mm256_set1_ps (gain[j]), st = _mm256_set1_ps (step[j]);
+
+      a0 = _mm256_add_ps (a0, _mm256_mul_ps (_mm256_loadu_ps (&s[j][i]),
+                                             _mm256_add_ps (g, _mm256_mul_ps (st, idx0))));
+      a1 = _mm256_add_ps (a1, _mm256_mul_ps (_mm256_loadu_ps (&s[j][i + 8]),
+                                             _mm256_add_ps (g, _mm256_mul_ps (st, idx1))));
+    }
+    _mm256_storeu_ps (&d[i], a0);
+    _mm256_storeu_ps (&d[i + 8], a1);
+  }
+  spa_audiomixer_mix_f32_gain_range (d, s, gain, step, n_channels, n_src, i, n_samples);
+}
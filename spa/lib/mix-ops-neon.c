@@ -0,0 +1,93 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <arm_neon.h>
+
+#include <lib/mix-ops.h>
+
+void
+spa_audiomixer_mix_s16_neon (void *dst, const void *src[], uint32_t n_src, uint32_t n_samples)
+{
+  int16_t *d = dst;
+  const int16_t **s = (const int16_t **) src;
+  uint32_t i, j, unrolled = n_samples & ~7;
+
+  /* accumulate in 32 bits and saturate once with a narrowing move */
+  for (i = 0; i < unrolled; i += 8) {
+    int32x4_t lo = vdupq_n_s32 (0), hi = vdupq_n_s32 (0);
+
+    for (j = 0; j < n_src; j++) {
+      int16x8_t in = vld1q_s16 (&s[j][i]);
+      lo = vaddw_s16 (lo, vget_low_s16 (in));
+      hi = vaddw_s16 (hi, vget_high_s16 (in));
+    }
+    vst1q_s16 (&d[i], vcombine_s16 (vqmovn_s32 (lo), vqmovn_s32 (hi)));
+  }
+  spa_audiomixer_mix_s16_range (d, s, n_src, i, n_samples);
+}
+
+void
+spa_audiomixer_mix_f32_neon (void *dst, const void *src[], uint32_t n_src, uint32_t n_samples)
+{
+  float *d = dst;
+  const float **s = (const float **) src;
+  uint32_t i, j, unrolled = n_samples & ~7;
+
+  for (i = 0; i < unrolled; i += 8) {
+    float32x4_t a0 = vld1q_f32 (&s[0][i]);
+    float32x4_t a1 = vld1q_f32 (&s[0][i + 4]);
+
+    for (j = 1; j < n_src; j++) {
+      a0 = vaddq_f32 (a0, vld1q_f32 (&s[j][i]));
+      a1 = vaddq_f32 (a1, vld1q_f32 (&s[j][i + 4]));
+    }
+    vst1q_f32 (&d[i], a0);
+    vst1q_f32 (&d[i + 4], a1);
+  }
+  spa_audiomixer_mix_f32_range (d, s, n_src, i, n_samples);
+}
+
+void
+spa_audiomixer_mix_f32_gain_neon (void *dst, const void *src[], const float gain[],
+                                  const float step[], uint32_t n_channels, uint32_t n_src,
+                                  uint32_t n_samples)
+{
+  float *d = dst;
+  const float **s = (const float **) src;
+  uint32_t i, j, unrolled = n_samples & ~7, frame = 0, channel = 0;
+  float index[8];
+
+  for (i = 0; i < unrolled; i += 8) {
+    float32x4_t idx0, idx1, a0 = vdupq_n_f32 (0.0f), a1 = vdupq_n_f32 (0.0f);
+
+    spa_audiomixer_frame_index (index, 8, &frame, &channel, n_channels);
+    idx0 = vld1q_f32 (&index[0]);
+    idx1 = vld1q_f32 (&index[4]);
+
+    for (j = 0; j < n_src; j++) {
+      float32x4_t g = vdupq_n_f32 (gain[j]);
+
+      a0 = vmlaq_f32 (a0, vld1q_f32 (&s[j][i]), vmlaq_n_f32 (g, idx0, step[j]));
+      a1 = vmlaq_f32 (a1, vld1q_f32 (&s[j][i + 4]), vmlaq_n_f32 (g, idx1, step[j]));
+    }
+    vst1q_f32 (&d[i], a0);
+    vst1q_f32 (&d[i + 4], a1);
+  }
+  spa_audiomixer_mix_f32_gain_range (d, s, gain, step, n_channels, n_src, i, n_samples);
+}
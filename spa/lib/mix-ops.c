@@ -0,0 +1,122 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <lib/cpu.h>
+#include <lib/mix-ops.h>
+
+void
+spa_audiomixer_mix_s16_c (void *dst, const void *src[], uint32_t n_src, uint32_t n_samples)
+{
+  spa_audiomixer_mix_s16_range (dst, (const int16_t **) src, n_src, 0, n_samples);
+}
+
+void
+spa_audiomixer_mix_s32_c (void *dst, const void *src[], uint32_t n_src, uint32_t n_samples)
+{
+  int32_t *d = dst;
+  const int32_t **s = (const int32_t **) src;
+  uint32_t i, j;
+
+  for (i = 0; i < n_samples; i++) {
+    int64_t t = s[0][i];
+    for (j = 1; j < n_src; j++)
+      t += s[j][i];
+    d[i] = SPA_CLAMP (t, INT32_MIN, INT32_MAX);
+  }
+}
+
+void
+spa_audiomixer_mix_f32_c (void *dst, const void *src[], uint32_t n_src, uint32_t n_samples)
+{
+  spa_audiomixer_mix_f32_range (dst, (const float **) src, n_src, 0, n_samples);
+}
+
+void
+spa_audiomixer_mix_s16_gain_c (void *dst, const void *src[], const float gain[],
+                               const float step[], uint32_t n_channels, uint32_t n_src,
+                               uint32_t n_samples)
+{
+  spa_audiomixer_mix_s16_gain_range (dst, (const int16_t **) src, gain, step, n_channels, n_src, 0, n_samples);
+}
+
+void
+spa_audiomixer_mix_s32_gain_c (void *dst, const void *src[], const float gain[],
+                               const float step[], uint32_t n_channels, uint32_t n_src,
+                               uint32_t n_samples)
+{
+  int32_t *d = dst;
+  const int32_t **s = (const int32_t **) src;
+  uint32_t i, j, frame = 0, channel = 0;
+
+  for (i = 0; i < n_samples; i++) {
+    double t = 0.0;
+    float f = frame;
+    for (j = 0; j < n_src; j++)
+      t += s[j][i] * (double) (gain[j] + step[j] * f);
+    d[i] = llrint (SPA_CLAMP (t, (double) INT32_MIN, (double) INT32_MAX));
+    spa_audiomixer_next_sample (&frame, &channel, n_channels);
+  }
+}
+
+void
+spa_audiomixer_mix_f32_gain_c (void *dst, const void *src[], const float gain[],
+                               const float step[], uint32_t n_channels, uint32_t n_src,
+                               uint32_t n_samples)
+{
+  spa_audiomixer_mix_f32_gain_range (dst, (const float **) src, gain, step, n_channels, n_src, 0, n_samples);
+}
+
+void
+spa_audiomixer_ops_init (SpaAudioMixerOps *ops, uint32_t cpu_flags)
+{
+  ops->cpu_flags = 0;
+  ops->mix_s16 = spa_audiomixer_mix_s16_c;
+  ops->mix_s32 = spa_audiomixer_mix_s32_c;
+  ops->mix_f32 = spa_audiomixer_mix_f32_c;
+  ops->mix_s16_gain = spa_audiomixer_mix_s16_gain_c;
+  ops->mix_s32_gain = spa_audiomixer_mix_s32_gain_c;
+  ops->mix_f32_gain = spa_audiomixer_mix_f32_gain_c;
+
+#if defined (HAVE_SSE2)
+  if (cpu_flags & SPA_CPU_FLAG_SSE2) {
+    ops->cpu_flags = SPA_CPU_FLAG_SSE2;
+    ops->mix_s16 = spa_audiomixer_mix_s16_sse2;
+    ops->mix_f32 = spa_audiomixer_mix_f32_sse2;
+    ops->mix_s16_gain = spa_audiomixer_mix_s16_gain_sse2;
+    ops->mix_f32_gain = spa_audiomixer_mix_f32_gain_sse2;
+  }
+#endif
+#if defined (HAVE_AVX2)
+  if (cpu_flags & SPA_CPU_FLAG_AVX2) {
+    ops->cpu_flags = SPA_CPU_FLAG_AVX2;
+    ops->mix_s16 = spa_audiomixer_mix_s16_avx2;
+    ops->mix_f32 = spa_audiomixer_mix_f32_avx2;
+    ops->mix_s16_gain = spa_audiomixer_mix_s16_gain_avx2;
+    ops->mix_f32_gain = spa_audiomixer_mix_f32_gain_avx2;
+  }
+#endif
+#if defined (HAVE_NEON)
+  if (cpu_flags & SPA_CPU_FLAG_NEON) {
+    ops->cpu_flags = SPA_CPU_FLAG_NEON;
+    ops->mix_s16 = spa_audiomixer_mix_s16_neon;
+    ops->mix_f32 = spa_audiomixer_mix_f32_neon;
+    ops->mix_f32_gain = spa_audiomixer_mix_f32_gain_neon;
+  }
+#endif
+}
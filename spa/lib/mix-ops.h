@@ -0,0 +1,207 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_LIBMIX_OPS_H__
+#define __SPA_LIBMIX_OPS_H__
+
+#include <math.h>
+
+#include <spa/defs.h>
+
+/**
+ * SpaAudioMixerMixFunc:
+ * @dst: destination samples
+ * @src: array of @n_src source sample pointers
+ * @n_src: number of sources, at least 1
+ * @n_samples: number of samples in @dst and each of @src
+ *
+ * Sum all @src into @dst in one pass. Integer formats are accumulated
+ * with extra headroom and clamped only once when writing @dst.
+ */
+typedef void (*SpaAudioMixerMixFunc) (void *dst, const void *src[], uint32_t n_src, uint32_t n_samples);
+
+/**
+ * SpaAudioMixerMixGainFunc:
+ * @dst: destination samples
+ * @src: array of @n_src source sample pointers
+ * @gain: array of @n_src gains for the first sample
+ * @step: array of @n_src gain increments per frame
+ * @n_channels: number of interleaved channels
+ * @n_src: number of sources, at least 1
+ * @n_samples: number of samples in @dst and each of @src, a multiple
+ *   of @n_channels
+ *
+ * Like #SpaAudioMixerMixFunc but multiply sample i of source j with
+ * gain[j] + step[j] * (i / n_channels) while summing so that all channels
+ * of a frame get the same gain. A step of 0 applies a constant gain.
+ */
+typedef void (*SpaAudioMixerMixGainFunc) (void *dst, const void *src[], const float gain[],
+                                          const float step[], uint32_t n_channels,
+                                          uint32_t n_src, uint32_t n_samples);
+
+/**
+ * SpaAudioMixerOps:
+ * @cpu_flags: the #SpaCPUFlags the functions were selected for
+ * @mix_s16: mix S16 samples
+ * @mix_s32: mix S32 samples
+ * @mix_f32: mix F32 samples
+ * @mix_s16_gain: mix S16 samples with gain
+ * @mix_s32_gain: mix S32 samples with gain
+ * @mix_f32_gain: mix F32 samples with gain
+ *
+ * The mixing kernels, selected once for the CPU we run on.
+ */
+typedef struct {
+  uint32_t             cpu_flags;
+  SpaAudioMixerMixFunc mix_s16;
+  SpaAudioMixerMixFunc mix_s32;
+  SpaAudioMixerMixFunc mix_f32;
+  SpaAudioMixerMixGainFunc mix_s16_gain;
+  SpaAudioMixerMixGainFunc mix_s32_gain;
+  SpaAudioMixerMixGainFunc mix_f32_gain;
+} SpaAudioMixerOps;
+
+void spa_audiomixer_ops_init (SpaAudioMixerOps *ops, uint32_t cpu_flags);
+
+/* step to the next interleaved sample, the frame advances after the last
+ * channel */
+static inline void
+spa_audiomixer_next_sample (uint32_t *frame, uint32_t *channel, uint32_t n_channels)
+{
+  if (++*channel == n_channels) {
+    *channel = 0;
+    (*frame)++;
+  }
+}
+
+/* the frame numbers of the @n samples from @frame and @channel on, the
+ * SIMD kernels use them as the ramp position of their lanes */
+static inline void
+spa_audiomixer_frame_index (float *idx, uint32_t n, uint32_t *frame, uint32_t *channel,
+                            uint32_t n_channels)
+{
+  uint32_t k;
+
+  for (k = 0; k < n; k++) {
+    idx[k] = *frame;
+    spa_audiomixer_next_sample (frame, channel, n_channels);
+  }
+}
+
+/* plain C versions, also used by the SIMD kernels for the remaining
+ * samples from @start to @end */
+static inline void
+spa_audiomixer_mix_s16_range (int16_t *d, const int16_t **s, uint32_t n_src,
+                              uint32_t start, uint32_t end)
+{
+  uint32_t i, j;
+
+  for (i = start; i < end; i++) {
+    int32_t t = s[0][i];
+    for (j = 1; j < n_src; j++)
+      t += s[j][i];
+    d[i] = SPA_CLAMP (t, INT16_MIN, INT16_MAX);
+  }
+}
+
+static inline void
+spa_audiomixer_mix_f32_range (float *d, const float **s, uint32_t n_src,
+                              uint32_t start, uint32_t end)
+{
+  uint32_t i, j;
+
+  for (i = start; i < end; i++) {
+    float t = s[0][i];
+    for (j = 1; j < n_src; j++)
+      t += s[j][i];
+    d[i] = t;
+  }
+}
+
+static inline void
+spa_audiomixer_mix_s16_gain_range (int16_t *d, const int16_t **s, const float *gain, const float *step,
+                                   uint32_t n_channels, uint32_t n_src, uint32_t start, uint32_t end)
+{
+  uint32_t i, j, frame = start / n_channels, channel = start % n_channels;
+
+  for (i = start; i < end; i++) {
+    float t = 0.0f, f = frame;
+    for (j = 0; j < n_src; j++)
+      t += s[j][i] * (gain[j] + step[j] * f);
+    d[i] = lrintf (SPA_CLAMP (t, (float) INT16_MIN, (float) INT16_MAX));
+    spa_audiomixer_next_sample (&frame, &channel, n_channels);
+  }
+}
+
+static inline void
+spa_audiomixer_mix_f32_gain_range (float *d, const float **s, const float *gain, const float *step,
+                                   uint32_t n_channels, uint32_t n_src, uint32_t start, uint32_t end)
+{
+  uint32_t i, j, frame = start / n_channels, channel = start % n_channels;
+
+  for (i = start; i < end; i++) {
+    float t = 0.0f, f = frame;
+    for (j = 0; j < n_src; j++)
+      t += s[j][i] * (gain[j] + step[j] * f);
+    d[i] = t;
+    spa_audiomixer_next_sample (&frame, &channel, n_channels);
+  }
+}
+
+void spa_audiomixer_mix_s16_c    (void *dst, const void *src[], uint32_t n_src, uint32_t n_samples);
+void spa_audiomixer_mix_s32_c    (void *dst, const void *src[], uint32_t n_src, uint32_t n_samples);
+void spa_audiomixer_mix_f32_c    (void *dst, const void *src[], uint32_t n_src, uint32_t n_samples);
+void spa_audiomixer_mix_s16_gain_c    (void *dst, const void *src[], const float gain[],
+                                       const float step[], uint32_t n_channels, uint32_t n_src,
+                                       uint32_t n_samples);
+void spa_audiomixer_mix_s32_gain_c    (void *dst, const void *src[], const float gain[],
+                                       const float step[], uint32_t n_channels, uint32_t n_src,
+                                       uint32_t n_samples);
+void spa_audiomixer_mix_f32_gain_c    (void *dst, const void *src[], const float gain[],
+                                       const float step[], uint32_t n_channels, uint32_t n_src,
+                                       uint32_t n_samples);
+#if defined (HAVE_SSE2)
+void spa_audiomixer_mix_s16_sse2 (void *dst, const void *src[], uint32_t n_src, uint32_t n_samples);
+void spa_audiomixer_mix_f32_sse2 (void *dst, const void *src[], uint32_t n_src, uint32_t n_samples);
+void spa_audiomixer_mix_s16_gain_sse2 (void *dst, const void *src[], const float gain[],
+                                       const float step[], uint32_t n_channels, uint32_t n_src,
+                                       uint32_t n_samples);
+void spa_audiomixer_mix_f32_gain_sse2 (void *dst, const void *src[], const float gain[],
+                                       const float step[], uint32_t n_channels, uint32_t n_src,
+                                       uint32_t n_samples);
+#endif
+#if defined (HAVE_AVX2)
+void spa_audiomixer_mix_s16_avx2 (void *dst, const void *src[], uint32_t n_src, uint32_t n_samples);
+void spa_audiomixer_mix_f32_avx2 (void *dst, const void *src[], uint32_t n_src, uint32_t n_samples);
+void spa_audiomixer_mix_s16_gain_avx2 (void *dst, const void *src[], const float gain[],
+                                       const float step[], uint32_t n_channels, uint32_t n_src,
+                                       uint32_t n_samples);
+void spa_audiomixer_mix_f32_gain_avx2 (void *dst, const void *src[], const float gain[],
+                                       const float step[], uint32_t n_channels, uint32_t n_src,
+                                       uint32_t n_samples);
+#endif
+#if defined (HAVE_NEON)
+void spa_audiomixer_mix_s16_neon (void *dst, const void *src[], uint32_t n_src, uint32_t n_samples);
+void spa_audiomixer_mix_f32_neon (void *dst, const void *src[], uint32_t n_src, uint32_t n_samples);
+void spa_audiomixer_mix_f32_gain_neon (void *dst, const void *src[], const float gain[],
+                                       const float step[], uint32_t n_channels, uint32_t n_src,
+                                       uint32_t n_samples);
+#endif
+
+#endif /* __SPA_LIBMIX_OPS_H__ */
@@ -24,21 +24,25 @@
 #include <spa/node.h>
 #include <spa/audio/format.h>
 #include <lib/props.h>
+#include <lib/cpu.h>
 
 #include "alsa-utils.h"
 
-#define CHECK_PORT(this,d,p)    ((d) == SPA_DIRECTION_INPUT && (p) == 0)
+#define CHECK_FREE_PORT(this,d,p) ((d) == SPA_DIRECTION_INPUT && (p) < MAX_PORTS && !(this)->ports[p].valid)
+#define CHECK_PORT(this,d,p)      ((d) == SPA_DIRECTION_INPUT && (p) < MAX_PORTS && (this)->ports[p].valid)
 
 typedef struct _SpaALSAState SpaALSASink;
 
 static const char default_device[] = "default";
 static const uint32_t default_min_latency = 1024;
+static const uint32_t default_max_latency = 8192;
 
 static void
 reset_alsa_sink_props (SpaALSAProps *props)
 {
   strncpy (props->device, default_device, 64);
   props->min_latency = default_min_latency;
+  props->max_latency = default_max_latency;
 }
 
 static SpaResult
@@ -60,7 +64,10 @@ spa_alsa_sink_node_get_props (SpaNode       *node,
         PROP    (&f[1], this->type.prop_device,      -SPA_POD_TYPE_STRING, this->props.device, sizeof (this->props.device)),
         PROP    (&f[1], this->type.prop_device_name, -SPA_POD_TYPE_STRING, this->props.device_name, sizeof (this->props.device_name)),
         PROP    (&f[1], this->type.prop_card_name,   -SPA_POD_TYPE_STRING, this->props.card_name, sizeof (this->props.card_name)),
-        PROP_MM (&f[1], this->type.prop_min_latency,  SPA_POD_TYPE_INT,    this->props.min_latency, 1, INT32_MAX));
+        PROP_MM (&f[1], this->type.prop_min_latency,  SPA_POD_TYPE_INT,    this->props.min_latency, 1, INT32_MAX),
+        PROP_MM (&f[1], this->type.prop_max_latency,  SPA_POD_TYPE_INT,    this->props.max_latency, 1, INT32_MAX),
+        PROP_R  (&f[1], this->type.prop_latency,      SPA_POD_TYPE_INT,    this->threshold),
+        PROP_R  (&f[1], this->type.prop_xruns,        SPA_POD_TYPE_INT,    this->xruns));
 
   *props = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaProps);
 
@@ -84,6 +91,7 @@ spa_alsa_sink_node_set_props (SpaNode         *node,
     spa_props_query (props,
         this->type.prop_device,      -SPA_POD_TYPE_STRING, this->props.device, sizeof (this->props.device),
         this->type.prop_min_latency,  SPA_POD_TYPE_INT,    &this->props.min_latency,
+        this->type.prop_max_latency,  SPA_POD_TYPE_INT,    &this->props.max_latency,
         0);
   }
   return SPA_RESULT_OK;
@@ -104,6 +112,18 @@ do_send_event (SpaLoop        *loop,
   return SPA_RESULT_OK;
 }
 
+static bool
+have_port_buffers (SpaALSASink *this)
+{
+  uint32_t i;
+
+  for (i = 0; i < MAX_PORTS; i++) {
+    if (this->ports[i].active)
+      return true;
+  }
+  return false;
+}
+
 static SpaResult
 do_command (SpaLoop        *loop,
             bool            async,
@@ -116,8 +136,14 @@ do_command (SpaLoop        *loop,
   SpaResult res;
   SpaCommand *cmd = data;
 
-  if (SPA_COMMAND_TYPE (cmd) == this->type.command_node.Start ||
-      SPA_COMMAND_TYPE (cmd) == this->type.command_node.Pause) {
+  /* the buffers are set on the data loop, check them here after the
+   * use_buffers that were invoked before the command */
+  if (SPA_COMMAND_TYPE (cmd) == this->type.command_node.Start &&
+      !have_port_buffers (this)) {
+    res = SPA_RESULT_NO_BUFFERS;
+  }
+  else if (SPA_COMMAND_TYPE (cmd) == this->type.command_node.Start ||
+           SPA_COMMAND_TYPE (cmd) == this->type.command_node.Pause) {
     res = spa_node_port_send_command (&this->node,
                                       SPA_DIRECTION_INPUT,
                                       0,
@@ -155,9 +181,6 @@ spa_alsa_sink_node_send_command (SpaNode    *node,
     if (!this->have_format)
       return SPA_RESULT_NO_FORMAT;
 
-    if (this->n_buffers == 0)
-      return SPA_RESULT_NO_BUFFERS;
-
     return spa_loop_invoke (this->data_loop,
                             do_command,
                             ++this->seq,
@@ -195,12 +218,16 @@ spa_alsa_sink_node_get_n_ports (SpaNode       *node,
                                 uint32_t      *n_output_ports,
                                 uint32_t      *max_output_ports)
 {
+  SpaALSASink *this;
+
   spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
+  this = SPA_CONTAINER_OF (node, SpaALSASink, node);
+
   if (n_input_ports)
-    *n_input_ports = 1;
+    *n_input_ports = this->n_ports;
   if (max_input_ports)
-    *max_input_ports = 1;
+    *max_input_ports = MAX_PORTS;
   if (n_output_ports)
     *n_output_ports = 0;
   if (max_output_ports)
@@ -216,29 +243,188 @@ spa_alsa_sink_node_get_port_ids (SpaNode       *node,
                                  uint32_t       n_output_ports,
                                  uint32_t      *output_ids)
 {
+  SpaALSASink *this;
+  uint32_t i, idx;
+
   spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
-  if (n_input_ports > 0 && input_ids != NULL)
-    input_ids[0] = 0;
+  this = SPA_CONTAINER_OF (node, SpaALSASink, node);
+
+  if (input_ids) {
+    for (i = 0, idx = 0; i < MAX_PORTS && idx < n_input_ports; i++) {
+      if (this->ports[i].valid)
+        input_ids[idx++] = i;
+    }
+  }
+  return SPA_RESULT_OK;
+}
+
+/* the part of the port that pull_frames walks, only called from the data
+ * loop once the node is running */
+static void
+reset_port (SpaALSAPort *port)
+{
+  port->active = false;
+  port->io = NULL;
+  port->n_buffers = 0;
+  port->ready_offset = 0;
+  spa_list_init (&port->free);
+  spa_list_init (&port->ready);
+}
+
+static SpaResult
+do_init_port (SpaLoop        *loop,
+              bool            async,
+              uint32_t        seq,
+              size_t          size,
+              void           *data,
+              void           *user_data)
+{
+  SpaALSASink *this = user_data;
+  uint32_t *port_id = data;
+
+  reset_port (&this->ports[*port_id]);
 
   return SPA_RESULT_OK;
 }
 
+typedef struct {
+  uint32_t   port_id;
+  SpaPortIO *io;
+} PortIO;
 
+static SpaResult
+do_set_io (SpaLoop        *loop,
+           bool            async,
+           uint32_t        seq,
+           size_t          size,
+           void           *data,
+           void           *user_data)
+{
+  SpaALSASink *this = user_data;
+  PortIO *pio = data;
+
+  this->ports[pio->port_id].io = pio->io;
+
+  return SPA_RESULT_OK;
+}
+
+typedef struct {
+  uint32_t   port_id;
+  uint32_t   n_buffers;
+  SpaBuffer *buffers[MAX_BUFFERS];
+} PortBuffers;
+
+static SpaResult
+do_use_buffers (SpaLoop        *loop,
+                bool            async,
+                uint32_t        seq,
+                size_t          size,
+                void           *data,
+                void           *user_data)
+{
+  SpaALSASink *this = user_data;
+  PortBuffers *pb = data;
+  SpaALSAPort *port = &this->ports[pb->port_id];
+  uint32_t i;
+
+  spa_list_init (&port->ready);
+  port->ready_offset = 0;
+
+  for (i = 0; i < pb->n_buffers; i++) {
+    SpaALSABuffer *b = &port->buffers[i];
+
+    b->outbuf = pb->buffers[i];
+    b->outstanding = true;
+    b->h = spa_buffer_find_meta (b->outbuf, this->type.meta.Header);
+    b->rb = spa_buffer_find_meta (b->outbuf, this->type.meta.Ringbuffer);
+  }
+  port->n_buffers = pb->n_buffers;
+  port->active = pb->n_buffers > 0;
+
+  return SPA_RESULT_OK;
+}
+
+static void
+init_port (SpaALSASink *this, uint32_t port_id)
+{
+  SpaALSAPort *port = &this->ports[port_id];
+
+  port->valid = true;
+  port->have_format = false;
+  this->n_ports++;
+
+  spa_loop_invoke (this->data_loop,
+                   do_init_port,
+                   SPA_ID_INVALID,
+                   sizeof (port_id),
+                   &port_id,
+                   this);
+}
+
+
+/* more input ports are mixed into the device, they all have the format
+ * of the device */
 static SpaResult
 spa_alsa_sink_node_add_port (SpaNode        *node,
                              SpaDirection    direction,
                              uint32_t        port_id)
 {
-  return SPA_RESULT_NOT_IMPLEMENTED;
+  SpaALSASink *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaALSASink, node);
+
+  spa_return_val_if_fail (CHECK_FREE_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  init_port (this, port_id);
+
+  return SPA_RESULT_OK;
 }
 
+static SpaResult spa_alsa_sink_node_port_set_format (SpaNode         *node,
+                                                     SpaDirection     direction,
+                                                     uint32_t         port_id,
+                                                     uint32_t         flags,
+                                                     const SpaFormat *format);
+
 static SpaResult
 spa_alsa_sink_node_remove_port (SpaNode        *node,
                                 SpaDirection    direction,
                                 uint32_t        port_id)
 {
-  return SPA_RESULT_NOT_IMPLEMENTED;
+  SpaALSASink *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaALSASink, node);
+
+  /* the first port is always there */
+  spa_return_val_if_fail (port_id > 0 && CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  spa_alsa_sink_node_port_set_format (node, direction, port_id, 0, NULL);
+  this->ports[port_id].valid = false;
+  this->n_ports--;
+
+  return SPA_RESULT_OK;
+}
+
+/* the format of the device */
+static SpaFormat *
+build_format (SpaALSASink *this, uint8_t *buffer, size_t size)
+{
+  SpaPODBuilder b = { NULL, };
+  SpaPODFrame f[2];
+
+  spa_pod_builder_init (&b, buffer, size);
+  spa_pod_builder_format (&b, &f[0], this->type.format,
+         this->type.media_type.audio, this->type.media_subtype.raw,
+         PROP (&f[1], this->type.format_audio.format,   SPA_POD_TYPE_ID,  this->current_format.info.raw.format),
+         PROP (&f[1], this->type.format_audio.rate,     SPA_POD_TYPE_INT, this->current_format.info.raw.rate),
+         PROP (&f[1], this->type.format_audio.channels, SPA_POD_TYPE_INT, this->current_format.info.raw.channels));
+
+  return SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaFormat);
 }
 
 static SpaResult
@@ -258,17 +444,66 @@ spa_alsa_sink_node_port_enum_formats (SpaNode         *node,
 
   spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
 
+  /* the device is configured by another port, we can only mix in that
+   * format */
+  if (this->have_format && !this->ports[port_id].have_format) {
+    SpaPODBuilder b = { NULL, };
+    uint8_t buffer[256];
+
+    if (index > 0)
+      return SPA_RESULT_ENUM_END;
+
+    spa_pod_builder_init (&b, this->format_buffer, sizeof (this->format_buffer));
+    if (spa_format_filter (build_format (this, buffer, sizeof (buffer)), filter, &b) != SPA_RESULT_OK)
+      return SPA_RESULT_ENUM_END;
+
+    *format = SPA_POD_BUILDER_DEREF (&b, 0, SpaFormat);
+    return SPA_RESULT_OK;
+  }
+
   return spa_alsa_enum_format (this, format, filter, index);
 }
 
 static SpaResult
-spa_alsa_clear_buffers (SpaALSASink *this)
+spa_alsa_clear_buffers (SpaALSASink *this, uint32_t port_id)
+{
+  PortBuffers pb = { port_id, 0 };
+
+  return spa_loop_invoke (this->data_loop,
+                          do_use_buffers,
+                          SPA_ID_INVALID,
+                          offsetof (PortBuffers, buffers),
+                          &pb,
+                          this);
+}
+
+static bool
+have_port_format (SpaALSASink *this)
 {
-  if (this->n_buffers > 0) {
-    spa_list_init (&this->ready);
-    this->n_buffers = 0;
+  uint32_t i;
+
+  for (i = 0; i < MAX_PORTS; i++) {
+    if (this->ports[i].valid && this->ports[i].have_format)
+      return true;
+  }
+  return false;
+}
+
+/* the kernel that sums the ports in the format of the device, without one
+ * only a single port can play */
+static SpaAudioMixerMixFunc
+find_mix_func (SpaALSASink *this)
+{
+  switch (this->format) {
+    case SND_PCM_FORMAT_S16:
+      return this->mix_ops.mix_s16;
+    case SND_PCM_FORMAT_S32:
+      return this->mix_ops.mix_s32;
+    case SND_PCM_FORMAT_FLOAT:
+      return this->mix_ops.mix_f32;
+    default:
+      return NULL;
   }
-  return SPA_RESULT_OK;
 }
 
 static SpaResult
@@ -279,6 +514,7 @@ spa_alsa_sink_node_port_set_format (SpaNode         *node,
                                     const SpaFormat *format)
 {
   SpaALSASink *this;
+  SpaALSAPort *port;
   SpaPODBuilder b = { NULL };
   SpaPODFrame f[2];
 
@@ -288,12 +524,42 @@ spa_alsa_sink_node_port_set_format (SpaNode         *node,
 
   spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
 
+  port = &this->ports[port_id];
+
   if (format == NULL) {
-    spa_log_info (this->log, "clear format");
-    spa_alsa_pause (this, false);
-    spa_alsa_clear_buffers (this);
-    spa_alsa_close (this);
-    this->have_format = false;
+    spa_log_info (this->log, "clear format on port %u", port_id);
+    if (port->have_format) {
+      port->have_format = false;
+      /* the device keeps playing the other ports */
+      if (!have_port_format (this)) {
+        spa_alsa_pause (this, false);
+        spa_alsa_close (this);
+        this->have_format = false;
+      }
+    }
+    spa_alsa_clear_buffers (this, port_id);
+  } else if (this->have_format && !port->have_format) {
+    SpaAudioInfo info = { SPA_FORMAT_MEDIA_TYPE (format),
+                          SPA_FORMAT_MEDIA_SUBTYPE (format), };
+    SpaAudioInfoRaw *current = &this->current_format.info.raw;
+
+    if (info.media_type != this->type.media_type.audio ||
+        info.media_subtype != this->type.media_subtype.raw)
+      return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+    if (!spa_format_audio_raw_parse (format, &info.info.raw, &this->type.format_audio))
+      return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+    if (info.info.raw.format != current->format ||
+        info.info.raw.rate != current->rate ||
+        info.info.raw.channels != current->channels)
+      return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+    if (this->mix == NULL) {
+      spa_log_error (this->log, "alsa-sink %p: can't mix in the format of the device", this);
+      return SPA_RESULT_INVALID_MEDIA_TYPE;
+    }
+    port->have_format = true;
   } else {
     SpaAudioInfo info = { SPA_FORMAT_MEDIA_TYPE (format),
                           SPA_FORMAT_MEDIA_SUBTYPE (format), };
@@ -310,6 +576,8 @@ spa_alsa_sink_node_port_set_format (SpaNode         *node,
 
     this->current_format = info;
     this->have_format = true;
+    this->mix = find_mix_func (this);
+    port->have_format = true;
   }
 
   if (this->have_format) {
@@ -355,8 +623,6 @@ spa_alsa_sink_node_port_get_format (SpaNode          *node,
                                     const SpaFormat **format)
 {
   SpaALSASink *this;
-  SpaPODBuilder b = { NULL, };
-  SpaPODFrame f[2];
 
   spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
   spa_return_val_if_fail (format != NULL, SPA_RESULT_INVALID_ARGUMENTS);
@@ -365,17 +631,10 @@ spa_alsa_sink_node_port_get_format (SpaNode          *node,
 
   spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
 
-  if (!this->have_format)
+  if (!this->ports[port_id].have_format)
     return SPA_RESULT_NO_FORMAT;
 
-  spa_pod_builder_init (&b, this->format_buffer, sizeof (this->format_buffer));
-  spa_pod_builder_format (&b, &f[0], this->type.format,
-         this->type.media_type.audio, this->type.media_subtype.raw,
-         PROP (&f[1], this->type.format_audio.format,   SPA_POD_TYPE_ID,  this->current_format.info.raw.format),
-         PROP (&f[1], this->type.format_audio.rate,     SPA_POD_TYPE_INT, this->current_format.info.raw.rate),
-         PROP (&f[1], this->type.format_audio.channels, SPA_POD_TYPE_INT, this->current_format.info.raw.channels));
-
-  *format = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaFormat);
+  *format = build_format (this, this->format_buffer, sizeof (this->format_buffer));
 
   return SPA_RESULT_OK;
 }
@@ -426,6 +685,8 @@ spa_alsa_sink_node_port_use_buffers (SpaNode         *node,
                                      uint32_t         n_buffers)
 {
   SpaALSASink *this;
+  SpaALSAPort *port;
+  PortBuffers pb;
   int i;
 
   spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
@@ -434,26 +695,27 @@ spa_alsa_sink_node_port_use_buffers (SpaNode         *node,
 
   spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
 
-  spa_log_info (this->log, "use buffers %d", n_buffers);
+  spa_log_info (this->log, "use buffers %d on port %u", n_buffers, port_id);
 
-  if (!this->have_format)
+  port = &this->ports[port_id];
+
+  if (!port->have_format)
     return SPA_RESULT_NO_FORMAT;
 
-  if (n_buffers == 0) {
-    spa_alsa_pause (this, false);
-    spa_alsa_clear_buffers (this);
-    return SPA_RESULT_OK;
-  }
+  /* the other ports keep playing */
+  if (n_buffers == 0)
+    return spa_alsa_clear_buffers (this, port_id);
+
+  if (n_buffers > MAX_BUFFERS)
+    return SPA_RESULT_INVALID_ARGUMENTS;
+
+  pb.port_id = port_id;
+  pb.n_buffers = n_buffers;
 
   for (i = 0; i < n_buffers; i++) {
-    SpaALSABuffer *b = &this->buffers[i];
     uint32_t type = buffers[i]->datas[0].type;
 
-    b->outbuf = buffers[i];
-    b->outstanding = true;
-
-    b->h = spa_buffer_find_meta (b->outbuf, this->type.meta.Header);
-    b->rb = spa_buffer_find_meta (b->outbuf, this->type.meta.Ringbuffer);
+    pb.buffers[i] = buffers[i];
 
     if ((type == this->type.data.MemFd ||
          type == this->type.data.DmaBuf ||
@@ -463,9 +725,13 @@ spa_alsa_sink_node_port_use_buffers (SpaNode         *node,
       return SPA_RESULT_ERROR;
     }
   }
-  this->n_buffers = n_buffers;
 
-  return SPA_RESULT_OK;
+  return spa_loop_invoke (this->data_loop,
+                          do_use_buffers,
+                          SPA_ID_INVALID,
+                          offsetof (PortBuffers, buffers) + n_buffers * sizeof (SpaBuffer *),
+                          &pb,
+                          this);
 }
 
 static SpaResult
@@ -499,6 +765,7 @@ spa_alsa_sink_node_port_set_io (SpaNode      *node,
                                 SpaPortIO    *io)
 {
   SpaALSASink *this;
+  PortIO pio = { port_id, io };
 
   spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
@@ -506,9 +773,12 @@ spa_alsa_sink_node_port_set_io (SpaNode      *node,
 
   spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
 
-  this->io = io;
-
-  return SPA_RESULT_OK;
+  return spa_loop_invoke (this->data_loop,
+                          do_set_io,
+                          SPA_ID_INVALID,
+                          sizeof (pio),
+                          &pio,
+                          this);
 }
 
 static SpaResult
@@ -550,27 +820,39 @@ static SpaResult
 spa_alsa_sink_node_process_input (SpaNode *node)
 {
   SpaALSASink *this;
-  SpaPortIO *input;
+  uint32_t i;
 
   spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   this = SPA_CONTAINER_OF (node, SpaALSASink, node);
-  input = this->io;
-  spa_return_val_if_fail (input != NULL, SPA_RESULT_WRONG_STATE);
 
-  if (input->status == SPA_RESULT_HAVE_BUFFER &&
-      input->buffer_id != SPA_ID_INVALID) {
-    SpaALSABuffer *b = &this->buffers[input->buffer_id];
+  for (i = 0; i < MAX_PORTS; i++) {
+    SpaALSAPort *port = &this->ports[i];
+    SpaPortIO *input = port->io;
+    SpaALSABuffer *b;
+
+    if (!port->active || input == NULL)
+      continue;
+
+    if (input->status != SPA_RESULT_HAVE_BUFFER ||
+        input->buffer_id == SPA_ID_INVALID)
+      continue;
+
+    if (input->buffer_id >= port->n_buffers) {
+      input->status = SPA_RESULT_INVALID_BUFFER_ID;
+      continue;
+    }
 
+    b = &port->buffers[input->buffer_id];
     if (!b->outstanding) {
-      spa_log_warn (this->log, "alsa-sink %p: buffer %u in use", this, input->buffer_id);
+      spa_log_warn (this->log, "alsa-sink %p: buffer %u in use on port %u", this, input->buffer_id, i);
       input->status = SPA_RESULT_INVALID_BUFFER_ID;
-      return SPA_RESULT_ERROR;
+      continue;
     }
 
-    spa_log_trace (this->log, "alsa-sink %p: queue buffer %u", this, input->buffer_id);
+    spa_log_trace (this->log, "alsa-sink %p: queue buffer %u on port %u", this, input->buffer_id, i);
 
-    spa_list_insert (this->ready.prev, &b->link);
+    spa_list_insert (port->ready.prev, &b->link);
     b->outstanding = false;
     input->buffer_id = SPA_ID_INVALID;
     input->status = SPA_RESULT_OK;
@@ -611,6 +893,44 @@ static const SpaNode alsasink_node = {
   spa_alsa_sink_node_process_output,
 };
 
+static SpaResult
+spa_alsa_sink_clock_get_props (SpaClock  *clock,
+                               SpaProps **props)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_alsa_sink_clock_set_props (SpaClock       *clock,
+                               const SpaProps *props)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_alsa_sink_clock_get_time (SpaClock         *clock,
+                              int32_t          *rate,
+                              int64_t          *ticks,
+                              int64_t          *monotonic_time)
+{
+  SpaALSASink *this;
+
+  spa_return_val_if_fail (clock != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (clock, SpaALSASink, clock);
+
+  return spa_alsa_get_time (this, rate, ticks, monotonic_time);
+}
+
+static const SpaClock alsasink_clock = {
+  sizeof (SpaClock),
+  NULL,
+  SPA_CLOCK_STATE_STOPPED,
+  spa_alsa_sink_clock_get_props,
+  spa_alsa_sink_clock_set_props,
+  spa_alsa_sink_clock_get_time,
+};
+
 static SpaResult
 spa_alsa_sink_get_interface (SpaHandle               *handle,
                              uint32_t                 interface_id,
@@ -625,6 +945,8 @@ spa_alsa_sink_get_interface (SpaHandle               *handle,
 
   if (interface_id == this->type.node)
     *interface = &this->node;
+  else if (interface_id == this->type.clock)
+    *interface = &this->clock;
   else
     return SPA_RESULT_UNKNOWN_INTERFACE;
 
@@ -680,10 +1002,14 @@ alsa_sink_init (const SpaHandleFactory  *factory,
   init_type (&this->type, this->map);
 
   this->node = alsasink_node;
+  this->clock = alsasink_clock;
   this->stream = SND_PCM_STREAM_PLAYBACK;
   reset_alsa_sink_props (&this->props);
 
-  spa_list_init (&this->ready);
+  spa_audiomixer_ops_init (&this->mix_ops, spa_cpu_get_info_flags (info));
+  this->ports[0].valid = true;
+  this->n_ports = 1;
+  reset_port (&this->ports[0]);
 
   for (i = 0; info && i < info->n_items; i++) {
     if (!strcmp (info->items[i].key, "alsa.card")) {
@@ -697,6 +1023,7 @@ alsa_sink_init (const SpaHandleFactory  *factory,
 static const SpaInterfaceInfo alsa_sink_interfaces[] =
 {
   { SPA_TYPE__Node, },
+  { SPA_TYPE__Clock, },
 };
 
 static SpaResult
@@ -707,13 +1034,11 @@ alsa_sink_enum_interface_info (const SpaHandleFactory  *factory,
   spa_return_val_if_fail (factory != NULL, SPA_RESULT_INVALID_ARGUMENTS);
   spa_return_val_if_fail (info != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
-  switch (index) {
-    case 0:
-      *info = &alsa_sink_interfaces[index];
-      break;
-    default:
-      return SPA_RESULT_ENUM_END;
-  }
+  if (index >= SPA_N_ELEMENTS (alsa_sink_interfaces))
+    return SPA_RESULT_ENUM_END;
+
+  *info = &alsa_sink_interfaces[index];
+
   return SPA_RESULT_OK;
 }
 
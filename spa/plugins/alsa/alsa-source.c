@@ -34,12 +34,14 @@ typedef struct _SpaALSAState SpaALSASource;
 
 static const char default_device[] = "hw:0";
 static const uint32_t default_min_latency = 1024;
+static const uint32_t default_max_latency = 8192;
 
 static void
 reset_alsa_props (SpaALSAProps *props)
 {
   strncpy (props->device, default_device, 64);
   props->min_latency = default_min_latency;
+  props->max_latency = default_max_latency;
 }
 
 static SpaResult
@@ -61,7 +63,10 @@ spa_alsa_source_node_get_props (SpaNode       *node,
     PROP    (&f[1], this->type.prop_device,      -SPA_POD_TYPE_STRING, this->props.device, sizeof (this->props.device)),
     PROP    (&f[1], this->type.prop_device_name, -SPA_POD_TYPE_STRING, this->props.device_name, sizeof (this->props.device_name)),
     PROP    (&f[1], this->type.prop_card_name,   -SPA_POD_TYPE_STRING, this->props.card_name, sizeof (this->props.card_name)),
-    PROP_MM (&f[1], this->type.prop_min_latency,  SPA_POD_TYPE_INT,    this->props.min_latency, 1, INT32_MAX));
+    PROP_MM (&f[1], this->type.prop_min_latency,  SPA_POD_TYPE_INT,    this->props.min_latency, 1, INT32_MAX),
+    PROP_MM (&f[1], this->type.prop_max_latency,  SPA_POD_TYPE_INT,    this->props.max_latency, 1, INT32_MAX),
+    PROP_R  (&f[1], this->type.prop_latency,      SPA_POD_TYPE_INT,    this->threshold),
+    PROP_R  (&f[1], this->type.prop_xruns,        SPA_POD_TYPE_INT,    this->xruns));
 
   *props = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaProps);
 
@@ -85,6 +90,7 @@ spa_alsa_source_node_set_props (SpaNode         *node,
     spa_props_query (props,
         this->type.prop_device,      -SPA_POD_TYPE_STRING, this->props.device, sizeof (this->props.device),
         this->type.prop_min_latency,  SPA_POD_TYPE_INT,    &this->props.min_latency,
+        this->type.prop_max_latency,  SPA_POD_TYPE_INT,    &this->props.max_latency,
         0);
   }
 
@@ -173,7 +179,7 @@ spa_alsa_source_node_send_command (SpaNode    *node,
     if (!this->have_format)
       return SPA_RESULT_NO_FORMAT;
 
-    if (this->n_buffers == 0)
+    if (this->ports[0].n_buffers == 0)
       return SPA_RESULT_NO_BUFFERS;
 
     return spa_loop_invoke (this->data_loop,
@@ -187,7 +193,7 @@ spa_alsa_source_node_send_command (SpaNode    *node,
     if (!this->have_format)
       return SPA_RESULT_NO_FORMAT;
 
-    if (this->n_buffers == 0)
+    if (this->ports[0].n_buffers == 0)
       return SPA_RESULT_NO_BUFFERS;
 
     return spa_loop_invoke (this->data_loop,
@@ -301,20 +307,20 @@ recycle_buffer (SpaALSASource *this, uint32_t buffer_id)
 
   spa_log_trace (this->log, "alsa-source %p: recycle buffer %u", this, buffer_id);
 
-  b = &this->buffers[buffer_id];
+  b = &this->ports[0].buffers[buffer_id];
   spa_return_if_fail (b->outstanding);
 
   b->outstanding = false;
-  spa_list_insert (this->free.prev, &b->link);
+  spa_list_insert (this->ports[0].free.prev, &b->link);
 }
 
 static SpaResult
 spa_alsa_clear_buffers (SpaALSASource *this)
 {
-  if (this->n_buffers > 0) {
-    spa_list_init (&this->free);
-    spa_list_init (&this->ready);
-    this->n_buffers = 0;
+  if (this->ports[0].n_buffers > 0) {
+    spa_list_init (&this->ports[0].free);
+    spa_list_init (&this->ports[0].ready);
+    this->ports[0].n_buffers = 0;
   }
   return SPA_RESULT_OK;
 }
@@ -364,7 +370,7 @@ spa_alsa_source_node_port_set_format (SpaNode         *node,
                        SPA_PORT_INFO_FLAG_LIVE;
     this->info.maxbuffering = this->buffer_frames * this->frame_size;
     this->info.latency = (this->period_frames * SPA_NSEC_PER_SEC) / this->rate;
-    this->info.n_params = 2;
+    this->info.n_params = 3;
     this->info.params = this->params;
 
     spa_pod_builder_init (&b, this->params_buffer, sizeof (this->params_buffer));
@@ -381,6 +387,15 @@ spa_alsa_source_node_port_set_format (SpaNode         *node,
         PROP    (&f[1], this->type.alloc_param_meta_enable.size, SPA_POD_TYPE_INT, sizeof (SpaMetaHeader)));
     this->params[1] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
 
+    spa_pod_builder_object (&b, &f[0], 0, this->type.alloc_param_meta_enable.MetaEnable,
+        PROP    (&f[1], this->type.alloc_param_meta_enable.type, SPA_POD_TYPE_ID, this->type.meta.Ringbuffer),
+        PROP    (&f[1], this->type.alloc_param_meta_enable.size, SPA_POD_TYPE_INT, sizeof (SpaMetaRingbuffer)),
+        PROP    (&f[1], this->type.alloc_param_meta_enable.ringbufferSize,   SPA_POD_TYPE_INT, this->period_frames * this->frame_size * 32),
+        PROP    (&f[1], this->type.alloc_param_meta_enable.ringbufferStride, SPA_POD_TYPE_INT, 0),
+        PROP    (&f[1], this->type.alloc_param_meta_enable.ringbufferBlocks, SPA_POD_TYPE_INT, 1),
+        PROP    (&f[1], this->type.alloc_param_meta_enable.ringbufferAlign,  SPA_POD_TYPE_INT, 16));
+    this->params[2] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
+
     this->info.extra = NULL;
   }
 
@@ -477,19 +492,20 @@ spa_alsa_source_node_port_use_buffers (SpaNode         *node,
   if (!this->have_format)
     return SPA_RESULT_NO_FORMAT;
 
-  if (this->n_buffers > 0) {
+  if (this->ports[0].n_buffers > 0) {
     spa_alsa_pause (this, false);
     if ((res = spa_alsa_clear_buffers (this)) < 0)
       return res;
   }
   for (i = 0; i < n_buffers; i++) {
-    SpaALSABuffer *b = &this->buffers[i];
+    SpaALSABuffer *b = &this->ports[0].buffers[i];
     SpaData *d = buffers[i]->datas;
 
     b->outbuf = buffers[i];
     b->outstanding = false;
 
     b->h = spa_buffer_find_meta (b->outbuf, this->type.meta.Header);
+    b->rb = spa_buffer_find_meta (b->outbuf, this->type.meta.Ringbuffer);
 
     if (!((d[0].type == this->type.data.MemFd ||
            d[0].type == this->type.data.DmaBuf ||
@@ -498,9 +514,9 @@ spa_alsa_source_node_port_use_buffers (SpaNode         *node,
       spa_log_error (this->log, "alsa-source: need mapped memory");
       return SPA_RESULT_ERROR;
     }
-    spa_list_insert (this->free.prev, &b->link);
+    spa_list_insert (this->ports[0].free.prev, &b->link);
   }
-  this->n_buffers = n_buffers;
+  this->ports[0].n_buffers = n_buffers;
 
   return SPA_RESULT_OK;
 }
@@ -524,7 +540,7 @@ spa_alsa_source_node_port_alloc_buffers (SpaNode         *node,
 
   spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
 
-  if (this->n_buffers == 0)
+  if (this->ports[0].n_buffers == 0)
     return SPA_RESULT_NO_FORMAT;
 
   return SPA_RESULT_NOT_IMPLEMENTED;
@@ -544,7 +560,7 @@ spa_alsa_source_node_port_set_io (SpaNode       *node,
 
   spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
 
-  this->io = io;
+  this->ports[0].io = io;
 
   return SPA_RESULT_OK;
 }
@@ -562,10 +578,10 @@ spa_alsa_source_node_port_reuse_buffer (SpaNode         *node,
 
   spa_return_val_if_fail (port_id == 0, SPA_RESULT_INVALID_PORT);
 
-  if (this->n_buffers == 0)
+  if (this->ports[0].n_buffers == 0)
     return SPA_RESULT_NO_BUFFERS;
 
-  if (buffer_id >= this->n_buffers)
+  if (buffer_id >= this->ports[0].n_buffers)
     return SPA_RESULT_INVALID_BUFFER_ID;
 
   recycle_buffer (this, buffer_id);
@@ -613,7 +629,7 @@ spa_alsa_source_node_process_output (SpaNode *node)
   spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   this = SPA_CONTAINER_OF (node, SpaALSASource, node);
-  io = this->io;
+  io = this->ports[0].io;
   spa_return_val_if_fail (io != NULL, SPA_RESULT_WRONG_STATE);
 
   if (io->status == SPA_RESULT_HAVE_BUFFER)
@@ -678,14 +694,7 @@ spa_alsa_source_clock_get_time (SpaClock         *clock,
 
   this = SPA_CONTAINER_OF (clock, SpaALSASource, clock);
 
-  if (rate)
-    *rate = SPA_USEC_PER_SEC;
-  if (ticks)
-    *ticks = this->last_ticks;
-  if (monotonic_time)
-    *monotonic_time = this->last_monotonic;
-
-  return SPA_RESULT_OK;
+  return spa_alsa_get_time (this, rate, ticks, monotonic_time);
 }
 
 static const SpaClock alsasource_clock = {
@@ -772,8 +781,10 @@ alsa_source_init (const SpaHandleFactory  *factory,
   this->stream = SND_PCM_STREAM_CAPTURE;
   reset_alsa_props (&this->props);
 
-  spa_list_init (&this->free);
-  spa_list_init (&this->ready);
+  this->ports[0].valid = true;
+  this->n_ports = 1;
+  spa_list_init (&this->ports[0].free);
+  spa_list_init (&this->ports[0].ready);
 
   for (i = 0; info && i < info->n_items; i++) {
     if (!strcmp (info->items[i].key, "alsa.card")) {
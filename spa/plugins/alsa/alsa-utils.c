@@ -325,77 +325,280 @@ set_swparams (SpaALSAState *state)
   return 0;
 }
 
-static inline snd_pcm_uframes_t
-pull_frames (SpaALSAState *state,
-             const snd_pcm_channel_area_t *my_areas,
-             snd_pcm_uframes_t offset,
-             snd_pcm_uframes_t frames,
-             bool do_pull)
+/* the loop starts wide to lock quickly and then narrows down to follow
+ * only the slow drift of the device clock */
+#define DLL_BW_MAX        1.0
+#define DLL_BW_MIN        0.05
+/* a bigger error is a jump of the clock, like after an xrun */
+#define DLL_MAX_ERROR     (SPA_NSEC_PER_SEC / 10)
+
+static void
+dll_reset (SpaALSAState *state, int64_t ticks, int64_t time)
+{
+  SpaALSADll *dll = &state->dll;
+
+  dll->valid = true;
+  dll->bw = DLL_BW_MAX;
+  dll->ticks = ticks;
+  dll->time = time;
+  dll->period = (double) SPA_NSEC_PER_SEC / state->rate;
+}
+
+/* feed a new hardware position and the time it was sampled at */
+static void
+dll_update (SpaALSAState *state, int64_t ticks, int64_t time)
+{
+  SpaALSADll *dll = &state->dll;
+  int64_t diff = ticks - dll->ticks;
+  double pred, err, w;
+
+  if (!dll->valid || diff < 0) {
+    dll_reset (state, ticks, time);
+    return;
+  }
+  /* the device did not move, nothing to learn */
+  if (diff == 0)
+    return;
+
+  pred = dll->time + diff * dll->period;
+  err = time - pred;
+  if (err > DLL_MAX_ERROR || err < -DLL_MAX_ERROR) {
+    spa_log_debug (state->log, "alsa %p: clock jumped %f ns, reset dll", state, err);
+    dll_reset (state, ticks, time);
+    return;
+  }
+
+  /* the updates are not periodic, scale the loop to the time since the
+   * last one */
+  w = 2.0 * M_PI * dll->bw * diff * dll->period / SPA_NSEC_PER_SEC;
+  w = SPA_MIN (w, 0.5);
+
+  dll->time = pred + M_SQRT2 * w * err;
+  dll->period += w * w * err / diff;
+  dll->ticks = ticks;
+  dll->bw = SPA_MAX (dll->bw * 0.99, DLL_BW_MIN);
+}
+
+/* the filtered time at which the hardware was at @ticks */
+static inline int64_t
+dll_get_time (SpaALSAState *state, int64_t ticks)
+{
+  SpaALSADll *dll = &state->dll;
+
+  if (!dll->valid)
+    return state->last_monotonic;
+  return dll->time + (ticks - dll->ticks) * dll->period;
+}
+
+/* the threshold is adapted to the wakeup jitter after a window of this
+ * many seconds */
+#define WATERMARK_WINDOW_SEC  10
+
+static void
+watermark_reset (SpaALSAState *state, int64_t now)
+{
+  state->watermark.max_late = 0;
+  state->watermark.window_start = now;
+}
+
+/* keep at least half of the buffer free for refilling it */
+static void
+set_threshold (SpaALSAState *state, int threshold, int64_t now)
 {
-  snd_pcm_uframes_t total_frames = 0, to_write = frames;
-  SpaPortIO *io = state->io;
+  int max = SPA_MIN (state->props.max_latency, state->buffer_frames / 2);
+
+  threshold = SPA_MIN (threshold, max);
+  threshold = SPA_MAX (threshold, (int) state->props.min_latency);
+
+  if (threshold != state->threshold) {
+    spa_log_info (state->log, "alsa %p: threshold %d -> %d, late %d, %u xruns", state,
+        state->threshold, threshold, state->watermark.max_late, state->xruns);
+    state->threshold = threshold;
+  }
+  watermark_reset (state, now);
+}
+
+/* a wakeup came @late frames after the threshold was crossed. Grow the
+ * threshold when that used up most of it, shrink it slowly when all the
+ * wakeups of a window left a wide margin. */
+static void
+update_watermark (SpaALSAState *state, int late, int64_t now)
+{
+  SpaALSAWatermark *w = &state->watermark;
+
+  w->max_late = SPA_MAX (w->max_late, late);
+
+  if (late > state->threshold * 3 / 4)
+    set_threshold (state, state->threshold + state->threshold / 2, now);
+  else if (now - w->window_start > WATERMARK_WINDOW_SEC * SPA_NSEC_PER_SEC) {
+    if (w->max_late * 2 < state->threshold)
+      set_threshold (state, SPA_MAX (state->threshold - state->threshold / 8, w->max_late * 2), now);
+    else
+      watermark_reset (state, now);
+  }
+}
+
+/* the device ran @lost frames past our position. It does not stop on
+ * xruns, skip what it played or captured without us so that our
+ * position is that of the device again. */
+static void
+alsa_xrun (SpaALSAState *state, snd_pcm_uframes_t lost, int64_t now)
+{
+  snd_pcm_sframes_t skipped;
+
+  state->xruns++;
+  spa_log_warn (state->log, "alsa %p: xrun %u, %lu frames lost at threshold %d", state,
+      state->xruns, lost, state->threshold);
+
+  if ((skipped = snd_pcm_forward (state->hndl, lost)) < 0) {
+    spa_log_error (state->log, "snd_pcm_forward error: %s", snd_strerror (skipped));
+  } else
+    state->sample_count += skipped;
+
+  set_threshold (state, state->threshold * 2, now);
+}
+
+/* ask for new buffers on the ports that have nothing to play */
+static void
+request_input (SpaALSAState *state, snd_pcm_uframes_t frames)
+{
+  uint32_t i;
+  bool need = false;
+
+  for (i = 0; i < MAX_PORTS; i++) {
+    SpaALSAPort *port = &state->ports[i];
+    SpaPortIO *io = port->io;
+
+    if (!port->active || io == NULL || !spa_list_is_empty (&port->ready))
+      continue;
 
-  if (spa_list_is_empty (&state->ready) && do_pull) {
     io->status = SPA_RESULT_NEED_BUFFER;
     io->range.offset = state->sample_count * state->frame_size;
     io->range.min_size = state->threshold * state->frame_size;
     io->range.max_size = frames * state->frame_size;
-    state->callbacks.need_input (&state->node, state->user_data);
+    need = true;
   }
-  while (!spa_list_is_empty (&state->ready) && to_write > 0) {
-    uint8_t *src, *dst;
-    size_t n_bytes, n_frames, size;
-    off_t offs;
-    SpaALSABuffer *b;
-    bool reuse = false;
-    SpaData *d;
+  if (need)
+    state->callbacks.need_input (&state->node, state->user_data);
+}
 
-    b = spa_list_first (&state->ready, SpaALSABuffer, link);
-    d = b->outbuf->datas;
+/* the samples of the first ready buffer of @port that can be read in one
+ * piece, at most @max_frames */
+static snd_pcm_uframes_t
+peek_frames (SpaALSAState *state,
+             SpaALSAPort *port,
+             snd_pcm_uframes_t max_frames,
+             const void **data)
+{
+  SpaALSABuffer *b = spa_list_first (&port->ready, SpaALSABuffer, link);
+  SpaData *d = b->outbuf->datas;
+  size_t avail;
+
+  if (b->rb) {
+    SpaRingbuffer *ringbuffer = &b->rb->ringbuffer;
+    uint32_t index, offs;
+    int32_t filled;
+
+    filled = spa_ringbuffer_get_read_index (ringbuffer, &index);
+    offs = index & ringbuffer->mask;
+    avail = SPA_MIN (SPA_MAX (filled, 0), ringbuffer->size - offs);
+    *data = SPA_MEMBER (d[0].data, offs, void);
+  } else {
+    size_t offs = SPA_MIN (d[0].chunk->offset, d[0].maxsize);
+    size_t size = SPA_MIN (d[0].chunk->size, d[0].maxsize - offs);
 
-    dst = SPA_MEMBER (my_areas[0].addr, offset * state->frame_size, uint8_t);
+    avail = size - SPA_MIN (port->ready_offset, size);
+    *data = SPA_MEMBER (d[0].data, offs + port->ready_offset, void);
+  }
+  return SPA_MIN (avail / state->frame_size, max_frames);
+}
 
-    if (b->rb) {
-      SpaRingbuffer *ringbuffer = &b->rb->ringbuffer;
-      uint32_t index;
-      int32_t avail;
+/* mark @n_frames of the first ready buffer of @port_id as played and
+ * give the buffer back when there is no complete frame left in it */
+static void
+consume_frames (SpaALSAState *state,
+                uint32_t port_id,
+                snd_pcm_uframes_t n_frames)
+{
+  SpaALSAPort *port = &state->ports[port_id];
+  SpaALSABuffer *b = spa_list_first (&port->ready, SpaALSABuffer, link);
+  SpaData *d = b->outbuf->datas;
+  size_t n_bytes = n_frames * state->frame_size, left;
+
+  if (b->rb) {
+    SpaRingbuffer *ringbuffer = &b->rb->ringbuffer;
+    uint32_t index;
+    int32_t filled;
+
+    filled = spa_ringbuffer_get_read_index (ringbuffer, &index);
+    spa_ringbuffer_read_update (ringbuffer, index + n_bytes);
+    left = SPA_MAX (filled, 0) - SPA_MIN (SPA_MAX (filled, 0), n_bytes);
+  } else {
+    size_t offs = SPA_MIN (d[0].chunk->offset, d[0].maxsize);
+    size_t size = SPA_MIN (d[0].chunk->size, d[0].maxsize - offs);
 
-      avail = spa_ringbuffer_get_read_index (ringbuffer, &index);
+    port->ready_offset += n_bytes;
+    left = size - SPA_MIN (port->ready_offset, size);
+  }
 
-      n_bytes = SPA_MIN (avail, to_write * state->frame_size);
-      n_frames = SPA_MIN (to_write, n_bytes / state->frame_size);
+  if (left < state->frame_size) {
+    spa_list_remove (&b->link);
+    b->outstanding = true;
+    port->io->buffer_id = b->outbuf->id;
+    spa_log_trace (state->log, "alsa-util %p: reuse buffer %u on port %u", state, b->outbuf->id, port_id);
+    state->callbacks.reuse_buffer (&state->node, port_id, b->outbuf->id, state->user_data);
+    port->ready_offset = 0;
+  }
+}
+
+/* sum the ready samples of all ports straight into the mmap area of the
+ * device. A single port is copied. */
+static inline snd_pcm_uframes_t
+pull_frames (SpaALSAState *state,
+             const snd_pcm_channel_area_t *my_areas,
+             snd_pcm_uframes_t offset,
+             snd_pcm_uframes_t frames,
+             bool do_pull)
+{
+  snd_pcm_uframes_t total_frames = 0;
 
-      spa_ringbuffer_read_data (ringbuffer,
-                                d[0].data,
-                                index & ringbuffer->mask,
-                                dst,
-                                n_bytes);
+  if (do_pull)
+    request_input (state, frames);
 
-      spa_ringbuffer_read_update (ringbuffer, index + n_bytes);
-      reuse = avail == n_bytes;
-    } else {
-      offs = SPA_MIN (d[0].chunk->offset + state->ready_offset, d[0].maxsize);
-      size = SPA_MIN (d[0].chunk->size, d[0].maxsize) - offs;
-      src = SPA_MEMBER (d[0].data, offs, uint8_t);
+  while (total_frames < frames) {
+    const void *src[MAX_PORTS];
+    uint32_t ids[MAX_PORTS], i, n_src = 0;
+    snd_pcm_uframes_t n, n_frames = frames - total_frames;
+    uint8_t *dst;
 
-      n_bytes = SPA_MIN (size, to_write * state->frame_size);
-      n_frames = SPA_MIN (to_write, n_bytes / state->frame_size);
+    for (i = 0; i < MAX_PORTS; i++) {
+      SpaALSAPort *port = &state->ports[i];
 
-      memcpy (dst, src, n_bytes);
+      if (!port->active || spa_list_is_empty (&port->ready))
+        continue;
 
-      state->ready_offset += n_bytes;
-      reuse = (state->ready_offset >= size);
-    }
-    if (reuse) {
-      spa_list_remove (&b->link);
-      b->outstanding = true;
-      state->io->buffer_id = b->outbuf->id;
-      spa_log_trace (state->log, "alsa-util %p: reuse buffer %u", state, b->outbuf->id);
-      state->callbacks.reuse_buffer (&state->node, 0, b->outbuf->id, state->user_data);
-      state->ready_offset = 0;
+      if ((n = peek_frames (state, port, n_frames, &src[n_src])) == 0) {
+        /* nothing or less than a frame left */
+        consume_frames (state, i, 0);
+        continue;
+      }
+      n_frames = SPA_MIN (n_frames, n);
+      ids[n_src++] = i;
     }
+    if (n_src == 0)
+      break;
+
+    dst = SPA_MEMBER (my_areas[0].addr, (offset + total_frames) * state->frame_size, uint8_t);
+
+    if (n_src == 1 || state->mix == NULL)
+      memcpy (dst, src[0], n_frames * state->frame_size);
+    else
+      state->mix (dst, src, n_src, n_frames * state->channels);
+
+    for (i = 0; i < n_src; i++)
+      consume_frames (state, ids[i], n_frames);
+
     total_frames += n_frames;
-    to_write -= n_frames;
   }
   if (total_frames == 0 && do_pull) {
     total_frames = SPA_MIN (frames, state->threshold);
@@ -405,51 +608,106 @@ pull_frames (SpaALSAState *state,
   return total_frames;
 }
 
+/* append complete frames to the ringbuffer of @b, the chunk tells where the
+ * new samples start in the ring, they wrap around at its end */
+static size_t
+write_ring (SpaALSAState *state, SpaALSABuffer *b, const uint8_t *src, size_t n_bytes)
+{
+  SpaRingbuffer *ringbuffer = &b->rb->ringbuffer;
+  SpaData *d = b->outbuf->datas;
+  uint8_t *dst = d[0].data;
+  uint32_t index, offs;
+  int32_t filled;
+  size_t avail;
+
+  filled = spa_ringbuffer_get_write_index (ringbuffer, &index);
+  avail = ringbuffer->size - SPA_MIN ((uint32_t) SPA_MAX (filled, 0), ringbuffer->size);
+  n_bytes = SPA_MIN (n_bytes, avail - avail % state->frame_size);
+
+  offs = index & ringbuffer->mask;
+  if (offs + n_bytes > ringbuffer->size) {
+    size_t l0 = ringbuffer->size - offs;
+    memcpy (dst + offs, src, l0);
+    memcpy (dst, src + l0, n_bytes - l0);
+  } else {
+    memcpy (dst + offs, src, n_bytes);
+  }
+  spa_ringbuffer_write_update (ringbuffer, index + n_bytes);
+
+  d[0].chunk->offset = offs;
+  d[0].chunk->size = n_bytes;
+  d[0].chunk->stride = 0;
+
+  return n_bytes;
+}
+
+/* Push @frames captured frames from the mmap area into as many free
+ * buffers as we have. Stops early when we run out of buffers or when
+ * the graph did not consume the previously pushed buffer yet, the
+ * remaining frames stay in the device for the next wakeup. */
 static snd_pcm_uframes_t
 push_frames (SpaALSAState *state,
              const snd_pcm_channel_area_t *my_areas,
              snd_pcm_uframes_t offset,
-             snd_pcm_uframes_t frames)
+             snd_pcm_uframes_t frames,
+             uint64_t position)
 {
   snd_pcm_uframes_t total_frames = 0;
-  SpaPortIO *io = state->io;
+  SpaALSAPort *port = &state->ports[0];
+  SpaPortIO *io = port->io;
 
-  if (spa_list_is_empty (&state->free)) {
-    spa_log_trace (state->log, "no more buffers");
-  }
-  else {
+  while (total_frames < frames) {
     uint8_t *src;
     size_t n_bytes;
+    snd_pcm_uframes_t n_frames;
     SpaALSABuffer *b;
     SpaData *d;
 
-    b = spa_list_first (&state->free, SpaALSABuffer, link);
-    spa_list_remove (&b->link);
-
-    if (b->h) {
-      b->h->seq = state->sample_count;
-      b->h->pts = state->last_monotonic;
-      b->h->dts_offset = 0;
+    if (io->status == SPA_RESULT_HAVE_BUFFER) {
+      spa_log_trace (state->log, "previous buffer not consumed");
+      break;
+    }
+    if (spa_list_is_empty (&port->free)) {
+      spa_log_trace (state->log, "no more buffers");
+      break;
     }
 
+    b = spa_list_first (&port->free, SpaALSABuffer, link);
     d = b->outbuf->datas;
 
-    total_frames = SPA_MIN (frames, d[0].maxsize / state->frame_size);
-    src = SPA_MEMBER (my_areas[0].addr, offset * state->frame_size, uint8_t);
-    n_bytes = total_frames * state->frame_size;
+    src = SPA_MEMBER (my_areas[0].addr, (offset + total_frames) * state->frame_size, uint8_t);
+    n_frames = frames - total_frames;
 
-    memcpy (d[0].data, src, n_bytes);
+    if (b->rb) {
+      n_bytes = write_ring (state, b, src, n_frames * state->frame_size);
+      n_frames = n_bytes / state->frame_size;
+    } else {
+      n_frames = SPA_MIN (n_frames, d[0].maxsize / state->frame_size);
+      n_bytes = n_frames * state->frame_size;
 
-    d[0].chunk->offset = 0;
-    d[0].chunk->size = n_bytes;
-    d[0].chunk->stride = 0;
+      memcpy (d[0].data, src, n_bytes);
 
-    {
-      b->outstanding = true;
-      io->buffer_id = b->outbuf->id;
-      io->status = SPA_RESULT_HAVE_BUFFER;
-      state->callbacks.have_output (&state->node, state->user_data);
+      d[0].chunk->offset = 0;
+      d[0].chunk->size = n_bytes;
+      d[0].chunk->stride = 0;
     }
+    if (n_frames == 0)
+      break;
+
+    spa_list_remove (&b->link);
+
+    if (b->h) {
+      b->h->seq = position + total_frames;
+      b->h->pts = dll_get_time (state, b->h->seq);
+      b->h->dts_offset = 0;
+    }
+
+    b->outstanding = true;
+    io->buffer_id = b->outbuf->id;
+    io->status = SPA_RESULT_HAVE_BUFFER;
+    state->callbacks.have_output (&state->node, state->user_data);
+
+    total_frames += n_frames;
   }
   return total_frames;
 }
@@ -513,14 +771,21 @@ alsa_on_playback_timeout_event (SpaSource *source)
 
   avail = snd_pcm_status_get_avail (status);
   snd_pcm_status_get_htstamp (status, &htstamp);
+  state->last_monotonic = (int64_t)htstamp.tv_sec * SPA_NSEC_PER_SEC + (int64_t)htstamp.tv_nsec;
 
-  if (avail > state->buffer_frames)
+  if (avail > state->buffer_frames) {
+    if (state->alsa_started)
+      alsa_xrun (state, avail - state->buffer_frames, state->last_monotonic);
     avail = state->buffer_frames;
+  }
 
   filled = state->buffer_frames - avail;
 
   state->last_ticks = state->sample_count - filled;
-  state->last_monotonic = (int64_t)htstamp.tv_sec * SPA_NSEC_PER_SEC + (int64_t)htstamp.tv_nsec;
+  if (state->alsa_started) {
+    dll_update (state, state->last_ticks, state->last_monotonic);
+    update_watermark (state, SPA_MAX (state->threshold - (int) filled, 0), state->last_monotonic);
+  }
 
   spa_log_trace (state->log, "timeout %ld %d %ld %ld %ld", filled, state->threshold,
                       state->sample_count, htstamp.tv_sec, htstamp.tv_nsec);
@@ -600,9 +865,16 @@ alsa_on_capture_timeout_event (SpaSource *source)
 
   avail = snd_pcm_status_get_avail (status);
   snd_pcm_status_get_htstamp (status, &htstamp);
+  state->last_monotonic = (int64_t)htstamp.tv_sec * SPA_NSEC_PER_SEC + (int64_t)htstamp.tv_nsec;
+
+  if (avail > state->buffer_frames) {
+    alsa_xrun (state, avail - state->buffer_frames, state->last_monotonic);
+    avail = state->buffer_frames;
+  }
 
   state->last_ticks = state->sample_count + avail;
-  state->last_monotonic = (int64_t)htstamp.tv_sec * SPA_NSEC_PER_SEC + (int64_t)htstamp.tv_nsec;
+  dll_update (state, state->last_ticks, state->last_monotonic);
+  update_watermark (state, SPA_MAX ((int) avail - state->threshold, 0), state->last_monotonic);
 
   spa_log_trace (state->log, "timeout %ld %d %ld %ld %ld", avail, state->threshold,
                       state->sample_count, htstamp.tv_sec, htstamp.tv_nsec);
@@ -625,7 +897,8 @@ alsa_on_capture_timeout_event (SpaSource *source)
         return;
       }
 
-      read = push_frames (state, my_areas, offset, frames);
+      read = push_frames (state, my_areas, offset, frames,
+                          state->sample_count + total_read);
       if (read < frames)
         to_read = 0;
 
@@ -676,6 +949,8 @@ spa_alsa_start (SpaALSAState *state, bool xrun_recover)
   spa_loop_add_source (state->data_loop, &state->source);
 
   state->threshold = state->props.min_latency;
+  state->dll.valid = false;
+  watermark_reset (state, 0);
 
   if (state->stream == SND_PCM_STREAM_PLAYBACK) {
     state->alsa_started = false;
@@ -712,3 +987,29 @@ spa_alsa_pause (SpaALSAState *state, bool xrun_recover)
 
   return SPA_RESULT_OK;
 }
+
+/* the filtered position of the device, @rate is the nominal rate of
+ * @ticks. The real rate follows from two positions. */
+SpaResult
+spa_alsa_get_time (SpaALSAState *state,
+                   int32_t      *rate,
+                   int64_t      *ticks,
+                   int64_t      *monotonic_time)
+{
+  SpaALSADll *dll = &state->dll;
+
+  if (rate)
+    *rate = state->rate;
+  if (dll->valid) {
+    if (ticks)
+      *ticks = dll->ticks;
+    if (monotonic_time)
+      *monotonic_time = dll->time;
+  } else {
+    if (ticks)
+      *ticks = state->last_ticks;
+    if (monotonic_time)
+      *monotonic_time = state->last_monotonic;
+  }
+  return SPA_RESULT_OK;
+}
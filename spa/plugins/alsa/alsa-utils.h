@@ -38,6 +38,8 @@ extern "C" {
 #include <spa/audio/format-utils.h>
 #include <spa/format-builder.h>
 
+#include <lib/mix-ops.h>
+
 typedef struct _SpaALSAState SpaALSAState;
 typedef struct _SpaALSABuffer SpaALSABuffer;
 
@@ -46,9 +48,45 @@ typedef struct {
   char device_name[128];
   char card_name[128];
   uint32_t min_latency;
+  uint32_t max_latency;
 } SpaALSAProps;
 
 #define MAX_BUFFERS 64
+#define MAX_PORTS   32
+
+/**
+ * SpaALSAWatermark:
+ * @max_late: the most frames a wakeup was late in the current window
+ * @window_start: monotonic start time of the window, in nanoseconds
+ *
+ * The lateness of the wakeups, measured as the distance of the fill
+ * level from the threshold. The threshold grows when we get close to an
+ * xrun and shrinks after a window in which all wakeups were well in time.
+ */
+typedef struct {
+  int      max_late;
+  int64_t  window_start;
+} SpaALSAWatermark;
+
+/**
+ * SpaALSADll:
+ * @valid: if the loop has been started
+ * @bw: the current bandwidth of the loop in Hz
+ * @ticks: hardware position of the last update, in frames
+ * @time: filtered monotonic time of @ticks, in nanoseconds
+ * @period: filtered duration of one frame, in nanoseconds
+ *
+ * A delay locked loop that filters the hardware position of the device
+ * against the monotonic clock. It removes the wakeup jitter from the
+ * timestamps and measures the real rate of the device in @period.
+ */
+typedef struct {
+  bool     valid;
+  double   bw;
+  int64_t  ticks;
+  double   time;
+  double   period;
+} SpaALSADll;
 
 struct _SpaALSABuffer {
   SpaBuffer *outbuf;
@@ -58,6 +96,36 @@ struct _SpaALSABuffer {
   SpaList link;
 };
 
+/**
+ * SpaALSAPort:
+ * @valid: if the port exists
+ * @have_format: if the port has the format of the device
+ * @active: if the port has buffers to play
+ * @io: the io area of the port
+ * @buffers: the buffers of the port
+ * @n_buffers: number of @buffers
+ * @free: buffers we can capture into
+ * @ready: buffers with samples to play
+ * @ready_offset: bytes played from the first @ready buffer
+ *
+ * A port of an ALSA node. A sink has several input ports that are mixed
+ * into the device, a source has one output port. The sink only changes
+ * @active and the fields after it from the data loop.
+ */
+typedef struct {
+  bool           valid;
+  bool           have_format;
+  bool           active;
+  SpaPortIO     *io;
+
+  SpaALSABuffer  buffers[MAX_BUFFERS];
+  uint32_t       n_buffers;
+
+  SpaList        free;
+  SpaList        ready;
+  size_t         ready_offset;
+} SpaALSAPort;
+
 typedef struct {
   uint32_t node;
   uint32_t clock;
@@ -67,6 +135,9 @@ typedef struct {
   uint32_t prop_device_name;
   uint32_t prop_card_name;
   uint32_t prop_min_latency;
+  uint32_t prop_max_latency;
+  uint32_t prop_latency;
+  uint32_t prop_xruns;
   SpaTypeMeta meta;
   SpaTypeData data;
   SpaTypeMediaType media_type;
@@ -91,6 +162,9 @@ init_type (Type *type, SpaTypeMap *map)
   type->prop_device_name = spa_type_map_get_id (map, SPA_TYPE_PROPS__deviceName);
   type->prop_card_name = spa_type_map_get_id (map, SPA_TYPE_PROPS__cardName);
   type->prop_min_latency = spa_type_map_get_id (map, SPA_TYPE_PROPS__minLatency);
+  type->prop_max_latency = spa_type_map_get_id (map, SPA_TYPE_PROPS__maxLatency);
+  type->prop_latency = spa_type_map_get_id (map, SPA_TYPE_PROPS__latency);
+  type->prop_xruns = spa_type_map_get_id (map, SPA_TYPE_PROPS__xruns);
 
   spa_type_meta_map (map, &type->meta);
   spa_type_data_map (map, &type->data);
@@ -144,28 +218,31 @@ struct _SpaALSAState {
   SpaPortInfo info;
   SpaAllocParam *params[3];
   uint8_t params_buffer[1024];
-  SpaPortIO *io;
 
-  SpaALSABuffer buffers[MAX_BUFFERS];
-  unsigned int n_buffers;
+  SpaALSAPort ports[MAX_PORTS];
+  uint32_t n_ports;
 
-  SpaList free;
-  SpaList ready;
-  size_t ready_offset;
+  SpaAudioMixerOps mix_ops;
+  SpaAudioMixerMixFunc mix;
 
   bool started;
   SpaSource source;
   int timerfd;
   bool alsa_started;
   int threshold;
+  SpaALSAWatermark watermark;
+  uint32_t xruns;
 
   int64_t sample_count;
   int64_t last_ticks;
   int64_t last_monotonic;
+  SpaALSADll dll;
 };
 
 #define PROP(f,key,type,...)                                                    \
           SPA_POD_PROP (f,key,0,type,1,__VA_ARGS__)
+#define PROP_R(f,key,type,...)                                                  \
+          SPA_POD_PROP (f,key,SPA_POD_PROP_FLAG_READONLY,type,1,__VA_ARGS__)
 #define PROP_MM(f,key,type,...)                                                 \
           SPA_POD_PROP (f,key,SPA_POD_PROP_RANGE_MIN_MAX,type,3,__VA_ARGS__)
 #define PROP_U_MM(f,key,type,...)                                               \
@@ -191,6 +268,11 @@ SpaResult spa_alsa_start (SpaALSAState *state, bool xrun_recover);
 SpaResult spa_alsa_pause (SpaALSAState *state, bool xrun_recover);
 SpaResult spa_alsa_close (SpaALSAState *state);
 
+SpaResult spa_alsa_get_time (SpaALSAState *state,
+                             int32_t      *rate,
+                             int64_t      *ticks,
+                             int64_t      *monotonic_time);
+
 #ifdef __cplusplus
 }  /* extern "C" */
 #endif
@@ -0,0 +1,1143 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stddef.h>
+
+#include <spa/log.h>
+#include <spa/type-map.h>
+#include <spa/node.h>
+#include <spa/list.h>
+#include <spa/audio/format-utils.h>
+#include <spa/format-builder.h>
+#include <lib/props.h>
+#include <lib/cpu.h>
+
+#include "convert-ops.h"
+
+#define MAX_BUFFERS     16
+#define MAX_CHANNELS    64
+
+/* samples converted in one go, the temporary buffers stay in the cache */
+#define BLOCK_SAMPLES   4096
+/* length of the precomputed dither noise table */
+#define DITHER_SIZE     4096
+
+typedef struct _SpaAudioConvert SpaAudioConvert;
+
+typedef struct {
+  bool dither;
+} SpaAudioConvertProps;
+
+typedef struct {
+  SpaBuffer     *outbuf;
+  bool           outstanding;
+  SpaMetaHeader *h;
+  SpaList        link;
+} SpaAudioConvertBuffer;
+
+typedef struct {
+  bool            have_format;
+  SpaAudioInfo    format;
+  uint32_t        sample_size;
+  uint32_t        frame_size;
+  uint32_t        bits;
+  bool            planar;
+
+  SpaPortInfo     info;
+  SpaAllocParam  *params[2];
+  uint8_t         params_buffer[1024];
+
+  SpaAudioConvertBuffer buffers[MAX_BUFFERS];
+  uint32_t        n_buffers;
+  SpaPortIO      *io;
+
+  SpaList         empty;
+} SpaAudioConvertPort;
+
+typedef struct {
+  uint32_t node;
+  uint32_t format;
+  uint32_t props;
+  uint32_t prop_dither;
+  SpaTypeMeta meta;
+  SpaTypeData data;
+  SpaTypeMediaType media_type;
+  SpaTypeMediaSubtype media_subtype;
+  SpaTypeFormatAudio format_audio;
+  SpaTypeAudioFormat audio_format;
+  SpaTypeEventNode event_node;
+  SpaTypeCommandNode command_node;
+  SpaTypeAllocParamBuffers alloc_param_buffers;
+  SpaTypeAllocParamMetaEnable alloc_param_meta_enable;
+} Type;
+
+static inline void
+init_type (Type *type, SpaTypeMap *map)
+{
+  type->node = spa_type_map_get_id (map, SPA_TYPE__Node);
+  type->format = spa_type_map_get_id (map, SPA_TYPE__Format);
+  type->props = spa_type_map_get_id (map, SPA_TYPE__Props);
+  type->prop_dither = spa_type_map_get_id (map, SPA_TYPE_PROPS__dither);
+  spa_type_meta_map (map, &type->meta);
+  spa_type_data_map (map, &type->data);
+  spa_type_media_type_map (map, &type->media_type);
+  spa_type_media_subtype_map (map, &type->media_subtype);
+  spa_type_format_audio_map (map, &type->format_audio);
+  spa_type_audio_format_map (map, &type->audio_format);
+  spa_type_event_node_map (map, &type->event_node);
+  spa_type_command_node_map (map, &type->command_node);
+  spa_type_alloc_param_buffers_map (map, &type->alloc_param_buffers);
+  spa_type_alloc_param_meta_enable_map (map, &type->alloc_param_meta_enable);
+}
+
+struct _SpaAudioConvert {
+  SpaHandle  handle;
+  SpaNode  node;
+
+  Type type;
+  SpaTypeMap *map;
+  SpaLog *log;
+
+  uint8_t props_buffer[512];
+  SpaAudioConvertProps props;
+
+  SpaNodeCallbacks callbacks;
+  void *user_data;
+
+  uint8_t format_buffer[1024];
+
+  SpaAudioConvertPort in_ports[1];
+  SpaAudioConvertPort out_ports[1];
+
+  SpaAudioConvertOps ops;
+  SpaAudioConvertToF32Func to_f32;
+  SpaAudioConvertFromF32Func from_f32;
+  bool passthrough;
+  bool dither;
+
+  float tmp[2][BLOCK_SAMPLES];
+  float dither_noise[DITHER_SIZE + BLOCK_SAMPLES];
+  uint32_t dither_seed;
+
+  bool started;
+};
+
+#define CHECK_IN_PORT(this,d,p)  ((d) == SPA_DIRECTION_INPUT && (p) == 0)
+#define CHECK_OUT_PORT(this,d,p) ((d) == SPA_DIRECTION_OUTPUT && (p) == 0)
+#define CHECK_PORT(this,d,p)     ((p) == 0)
+#define GET_PORT(this,d,p)       ((d) == SPA_DIRECTION_INPUT ? &(this)->in_ports[p] : &(this)->out_ports[p])
+#define GET_OTHER_PORT(this,d,p) ((d) == SPA_DIRECTION_INPUT ? &(this)->out_ports[p] : &(this)->in_ports[p])
+
+#define DEFAULT_DITHER false
+
+static void
+reset_audioconvert_props (SpaAudioConvertProps *props)
+{
+  props->dither = DEFAULT_DITHER;
+}
+
+#define PROP(f,key,type,...)                                                    \
+          SPA_POD_PROP (f,key,0,type,1,__VA_ARGS__)
+#define PROP_U_MM(f,key,type,...)                                               \
+          SPA_POD_PROP (f,key,SPA_POD_PROP_FLAG_UNSET |                         \
+                              SPA_POD_PROP_RANGE_MIN_MAX,type,3,__VA_ARGS__)
+#define PROP_U_EN(f,key,type,n,...)                                             \
+          SPA_POD_PROP (f,key,SPA_POD_PROP_FLAG_UNSET |                         \
+                              SPA_POD_PROP_RANGE_ENUM,type,n,__VA_ARGS__)
+
+static SpaResult
+spa_audioconvert_node_get_props (SpaNode        *node,
+                                 SpaProps     **props)
+{
+  SpaAudioConvert *this;
+  SpaPODBuilder b = { NULL,  };
+  SpaPODFrame f[2];
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (props != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaAudioConvert, node);
+
+  spa_pod_builder_init (&b, this->props_buffer, sizeof (this->props_buffer));
+  spa_pod_builder_props (&b, &f[0], this->type.props,
+      PROP (&f[1], this->type.prop_dither, SPA_POD_TYPE_BOOL, this->props.dither));
+
+  *props = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaProps);
+
+  return SPA_RESULT_OK;
+}
+
+static void update_convert (SpaAudioConvert *this);
+
+static SpaResult
+spa_audioconvert_node_set_props (SpaNode        *node,
+                                 const SpaProps *props)
+{
+  SpaAudioConvert *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaAudioConvert, node);
+
+  if (props == NULL) {
+    reset_audioconvert_props (&this->props);
+  } else {
+    spa_props_query (props,
+        this->type.prop_dither, SPA_POD_TYPE_BOOL, &this->props.dither,
+        0);
+  }
+  update_convert (this);
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_audioconvert_node_send_command (SpaNode    *node,
+                                    SpaCommand *command)
+{
+  SpaAudioConvert *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (command != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaAudioConvert, node);
+
+  if (SPA_COMMAND_TYPE (command) == this->type.command_node.Start) {
+    this->started = true;
+  }
+  else if (SPA_COMMAND_TYPE (command) == this->type.command_node.Pause) {
+    this->started = false;
+  }
+  else
+    return SPA_RESULT_NOT_IMPLEMENTED;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_audioconvert_node_set_callbacks (SpaNode                *node,
+                                     const SpaNodeCallbacks *callbacks,
+                                     size_t                  callbacks_size,
+                                     void                   *user_data)
+{
+  SpaAudioConvert *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaAudioConvert, node);
+
+  this->callbacks = *callbacks;
+  this->user_data = user_data;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_audioconvert_node_get_n_ports (SpaNode       *node,
+                                   uint32_t      *n_input_ports,
+                                   uint32_t      *max_input_ports,
+                                   uint32_t      *n_output_ports,
+                                   uint32_t      *max_output_ports)
+{
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  if (n_input_ports)
+    *n_input_ports = 1;
+  if (max_input_ports)
+    *max_input_ports = 1;
+  if (n_output_ports)
+    *n_output_ports = 1;
+  if (max_output_ports)
+    *max_output_ports = 1;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_audioconvert_node_get_port_ids (SpaNode       *node,
+                                    uint32_t       n_input_ports,
+                                    uint32_t      *input_ids,
+                                    uint32_t       n_output_ports,
+                                    uint32_t      *output_ids)
+{
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  if (n_input_ports > 0 && input_ids)
+    input_ids[0] = 0;
+  if (n_output_ports > 0 && output_ids)
+    output_ids[0] = 0;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_audioconvert_node_add_port (SpaNode        *node,
+                                SpaDirection    direction,
+                                uint32_t        port_id)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_audioconvert_node_remove_port (SpaNode        *node,
+                                   SpaDirection    direction,
+                                   uint32_t        port_id)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_audioconvert_node_port_enum_formats (SpaNode          *node,
+                                         SpaDirection      direction,
+                                         uint32_t          port_id,
+                                         SpaFormat       **format,
+                                         const SpaFormat  *filter,
+                                         uint32_t          index)
+{
+  SpaAudioConvert *this;
+  SpaAudioConvertPort *other;
+  SpaResult res;
+  SpaFormat *fmt;
+  uint8_t buffer[1024];
+  SpaPODBuilder b = { NULL, };
+  SpaPODFrame f[2];
+  uint32_t count, match;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (format != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaAudioConvert, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  other = GET_OTHER_PORT (this, direction, port_id);
+
+  count = match = filter ? 0 : index;
+
+next:
+  spa_pod_builder_init (&b, buffer, sizeof (buffer));
+
+  switch (count++) {
+    case 0:
+      /* we only convert the sample format and layout, rate and channels
+       * have to match the other port once that is configured */
+      if (other->have_format) {
+        spa_pod_builder_format (&b, &f[0], this->type.format,
+            this->type.media_type.audio, this->type.media_subtype.raw,
+            PROP_U_EN (&f[1], this->type.format_audio.format,   SPA_POD_TYPE_ID, 6,
+                                                                this->type.audio_format.S16,
+                                                                this->type.audio_format.S16,
+                                                                this->type.audio_format.S24,
+                                                                this->type.audio_format.S24_32,
+                                                                this->type.audio_format.S32,
+                                                                this->type.audio_format.F32),
+            PROP_U_EN (&f[1], this->type.format_audio.layout,   SPA_POD_TYPE_INT, 3,
+                                                                SPA_AUDIO_LAYOUT_INTERLEAVED,
+                                                                SPA_AUDIO_LAYOUT_INTERLEAVED,
+                                                                SPA_AUDIO_LAYOUT_NON_INTERLEAVED),
+            PROP      (&f[1], this->type.format_audio.rate,     SPA_POD_TYPE_INT,
+                                                                other->format.info.raw.rate),
+            PROP      (&f[1], this->type.format_audio.channels, SPA_POD_TYPE_INT,
+                                                                other->format.info.raw.channels));
+      } else {
+        spa_pod_builder_format (&b, &f[0], this->type.format,
+            this->type.media_type.audio, this->type.media_subtype.raw,
+            PROP_U_EN (&f[1], this->type.format_audio.format,   SPA_POD_TYPE_ID, 6,
+                                                                this->type.audio_format.S16,
+                                                                this->type.audio_format.S16,
+                                                                this->type.audio_format.S24,
+                                                                this->type.audio_format.S24_32,
+                                                                this->type.audio_format.S32,
+                                                                this->type.audio_format.F32),
+            PROP_U_EN (&f[1], this->type.format_audio.layout,   SPA_POD_TYPE_INT, 3,
+                                                                SPA_AUDIO_LAYOUT_INTERLEAVED,
+                                                                SPA_AUDIO_LAYOUT_INTERLEAVED,
+                                                                SPA_AUDIO_LAYOUT_NON_INTERLEAVED),
+            PROP_U_MM (&f[1], this->type.format_audio.rate,     SPA_POD_TYPE_INT, 44100, 1, INT32_MAX),
+            PROP_U_MM (&f[1], this->type.format_audio.channels, SPA_POD_TYPE_INT, 2, 1, MAX_CHANNELS));
+      }
+      break;
+    default:
+      return SPA_RESULT_ENUM_END;
+  }
+  fmt = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaFormat);
+  spa_pod_builder_init (&b, this->format_buffer, sizeof (this->format_buffer));
+
+  if ((res = spa_format_filter (fmt, filter, &b)) != SPA_RESULT_OK || match++ != index)
+    goto next;
+
+  *format = SPA_POD_BUILDER_DEREF (&b, 0, SpaFormat);
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+clear_buffers (SpaAudioConvert *this, SpaAudioConvertPort *port)
+{
+  if (port->n_buffers > 0) {
+    spa_log_info (this->log, "audioconvert %p: clear buffers", this);
+    port->n_buffers = 0;
+    spa_list_init (&port->empty);
+  }
+  return SPA_RESULT_OK;
+}
+
+/* pick the kernels for the configured input and output formats */
+static void
+update_convert (SpaAudioConvert *this)
+{
+  SpaAudioConvertPort *in = &this->in_ports[0], *out = &this->out_ports[0];
+  SpaTypeAudioFormat *af = &this->type.audio_format;
+  uint32_t in_format, out_format;
+
+  if (!in->have_format || !out->have_format)
+    return;
+
+  in_format = in->format.info.raw.format;
+  out_format = out->format.info.raw.format;
+
+  this->passthrough = in_format == out_format && in->planar == out->planar;
+
+  if (in_format == af->S16)
+    this->to_f32 = this->ops.s16_to_f32;
+  else if (in_format == af->S24)
+    this->to_f32 = this->ops.s24_to_f32;
+  else if (in_format == af->S24_32)
+    this->to_f32 = this->ops.s24_32_to_f32;
+  else if (in_format == af->S32)
+    this->to_f32 = this->ops.s32_to_f32;
+  else
+    this->to_f32 = NULL;
+
+  if (out_format == af->S16)
+    this->from_f32 = this->ops.f32_to_s16;
+  else if (out_format == af->S24)
+    this->from_f32 = this->ops.f32_to_s24;
+  else if (out_format == af->S24_32)
+    this->from_f32 = this->ops.f32_to_s24_32;
+  else if (out_format == af->S32)
+    this->from_f32 = this->ops.f32_to_s32;
+  else
+    this->from_f32 = NULL;
+
+  /* only worth it when we drop bits, S32 is beyond float precision */
+  this->dither = this->props.dither && this->from_f32 != NULL &&
+                 out->bits < in->bits && out->bits <= 24;
+
+  spa_log_info (this->log, "audioconvert %p: %s%s%s", this,
+      this->passthrough ? "passthrough" : "convert",
+      in->planar != out->planar ? ", change layout" : "",
+      this->dither ? ", dither" : "");
+}
+
+static SpaResult
+spa_audioconvert_node_port_set_format (SpaNode         *node,
+                                       SpaDirection     direction,
+                                       uint32_t         port_id,
+                                       uint32_t         flags,
+                                       const SpaFormat *format)
+{
+  SpaAudioConvert *this;
+  SpaAudioConvertPort *port, *other;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaAudioConvert, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  port = GET_PORT (this, direction, port_id);
+  other = GET_OTHER_PORT (this, direction, port_id);
+
+  if (format == NULL) {
+    port->have_format = false;
+    clear_buffers (this, port);
+  } else {
+    SpaTypeAudioFormat *af = &this->type.audio_format;
+    SpaAudioInfo info = { SPA_FORMAT_MEDIA_TYPE (format),
+                          SPA_FORMAT_MEDIA_SUBTYPE (format), };
+
+    if (info.media_type != this->type.media_type.audio ||
+        info.media_subtype != this->type.media_subtype.raw)
+      return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+    if (!spa_format_audio_raw_parse (format, &info.info.raw, &this->type.format_audio))
+      return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+    if (info.info.raw.channels == 0 || info.info.raw.channels > MAX_CHANNELS ||
+        info.info.raw.rate == 0)
+      return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+    if (other->have_format &&
+        (info.info.raw.rate != other->format.info.raw.rate ||
+         info.info.raw.channels != other->format.info.raw.channels))
+      return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+    if (info.info.raw.format == af->S16) {
+      port->sample_size = 2;
+      port->bits = 16;
+    } else if (info.info.raw.format == af->S24) {
+      port->sample_size = 3;
+      port->bits = 24;
+    } else if (info.info.raw.format == af->S24_32) {
+      port->sample_size = 4;
+      port->bits = 24;
+    } else if (info.info.raw.format == af->S32) {
+      port->sample_size = 4;
+      port->bits = 32;
+    } else if (info.info.raw.format == af->F32) {
+      port->sample_size = 4;
+      port->bits = 32;
+    } else
+      return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+    port->planar = info.info.raw.layout == SPA_AUDIO_LAYOUT_NON_INTERLEAVED;
+    port->frame_size = port->sample_size * info.info.raw.channels;
+    port->format = info;
+    port->have_format = true;
+
+    update_convert (this);
+  }
+
+  if (port->have_format) {
+    SpaPODBuilder b = { NULL };
+    SpaPODFrame f[2];
+
+    port->info.maxbuffering = -1;
+    port->info.latency = 0;
+
+    port->info.n_params = 2;
+    port->info.params = port->params;
+
+    spa_pod_builder_init (&b, port->params_buffer, sizeof (port->params_buffer));
+    spa_pod_builder_object (&b, &f[0], 0, this->type.alloc_param_buffers.Buffers,
+      PROP      (&f[1], this->type.alloc_param_buffers.size,    SPA_POD_TYPE_INT, 1024 * port->frame_size),
+      PROP      (&f[1], this->type.alloc_param_buffers.stride,  SPA_POD_TYPE_INT,
+                                                                port->planar ? port->sample_size : port->frame_size),
+      PROP_U_MM (&f[1], this->type.alloc_param_buffers.buffers, SPA_POD_TYPE_INT, MAX_BUFFERS, 2, MAX_BUFFERS),
+      PROP      (&f[1], this->type.alloc_param_buffers.align,   SPA_POD_TYPE_INT, 16));
+    port->params[0] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
+
+    spa_pod_builder_object (&b, &f[0], 0, this->type.alloc_param_meta_enable.MetaEnable,
+      PROP      (&f[1], this->type.alloc_param_meta_enable.type, SPA_POD_TYPE_ID, this->type.meta.Header),
+      PROP      (&f[1], this->type.alloc_param_meta_enable.size, SPA_POD_TYPE_INT, sizeof (SpaMetaHeader)));
+    port->params[1] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
+
+    port->info.extra = NULL;
+  }
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_audioconvert_node_port_get_format (SpaNode          *node,
+                                       SpaDirection      direction,
+                                       uint32_t          port_id,
+                                       const SpaFormat **format)
+{
+  SpaAudioConvert *this;
+  SpaAudioConvertPort *port;
+  SpaPODBuilder b = { NULL, };
+  SpaPODFrame f[2];
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (format != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaAudioConvert, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  port = GET_PORT (this, direction, port_id);
+
+  if (!port->have_format)
+    return SPA_RESULT_NO_FORMAT;
+
+  spa_pod_builder_init (&b, this->format_buffer, sizeof (this->format_buffer));
+  spa_pod_builder_format (&b, &f[0], this->type.format,
+         this->type.media_type.audio, this->type.media_subtype.raw,
+         PROP (&f[1], this->type.format_audio.format,   SPA_POD_TYPE_ID,  port->format.info.raw.format),
+         PROP (&f[1], this->type.format_audio.layout,   SPA_POD_TYPE_INT, port->format.info.raw.layout),
+         PROP (&f[1], this->type.format_audio.rate,     SPA_POD_TYPE_INT, port->format.info.raw.rate),
+         PROP (&f[1], this->type.format_audio.channels, SPA_POD_TYPE_INT, port->format.info.raw.channels));
+
+  *format = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaFormat);
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_audioconvert_node_port_get_info (SpaNode            *node,
+                                     SpaDirection        direction,
+                                     uint32_t            port_id,
+                                     const SpaPortInfo **info)
+{
+  SpaAudioConvert *this;
+  SpaAudioConvertPort *port;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (info != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaAudioConvert, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  port = GET_PORT (this, direction, port_id);
+  *info = &port->info;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_audioconvert_node_port_get_props (SpaNode       *node,
+                                      SpaDirection   direction,
+                                      uint32_t       port_id,
+                                      SpaProps     **props)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_audioconvert_node_port_set_props (SpaNode        *node,
+                                      SpaDirection    direction,
+                                      uint32_t        port_id,
+                                      const SpaProps *props)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_audioconvert_node_port_use_buffers (SpaNode         *node,
+                                        SpaDirection     direction,
+                                        uint32_t         port_id,
+                                        SpaBuffer      **buffers,
+                                        uint32_t         n_buffers)
+{
+  SpaAudioConvert *this;
+  SpaAudioConvertPort *port;
+  uint32_t i, j;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaAudioConvert, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  port = GET_PORT (this, direction, port_id);
+
+  if (!port->have_format)
+    return SPA_RESULT_NO_FORMAT;
+
+  clear_buffers (this, port);
+
+  for (i = 0; i < n_buffers; i++) {
+    SpaAudioConvertBuffer *b;
+    SpaData *d = buffers[i]->datas;
+
+    b = &port->buffers[i];
+    b->outbuf = buffers[i];
+    b->outstanding = true;
+    b->h = spa_buffer_find_meta (buffers[i], this->type.meta.Header);
+
+    for (j = 0; j < buffers[i]->n_datas; j++) {
+      if ((d[j].type != this->type.data.MemPtr &&
+           d[j].type != this->type.data.MemFd &&
+           d[j].type != this->type.data.DmaBuf) ||
+          d[j].data == NULL) {
+        spa_log_error (this->log, "audioconvert %p: invalid memory on buffer %p", this, buffers[i]);
+        return SPA_RESULT_ERROR;
+      }
+    }
+    spa_list_insert (port->empty.prev, &b->link);
+  }
+  port->n_buffers = n_buffers;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_audioconvert_node_port_alloc_buffers (SpaNode         *node,
+                                          SpaDirection     direction,
+                                          uint32_t         port_id,
+                                          SpaAllocParam  **params,
+                                          uint32_t         n_params,
+                                          SpaBuffer      **buffers,
+                                          uint32_t        *n_buffers)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_audioconvert_node_port_set_io (SpaNode      *node,
+                                   SpaDirection  direction,
+                                   uint32_t      port_id,
+                                   SpaPortIO    *io)
+{
+  SpaAudioConvert *this;
+  SpaAudioConvertPort *port;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaAudioConvert, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  port = GET_PORT (this, direction, port_id);
+  port->io = io;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_audioconvert_node_port_reuse_buffer (SpaNode         *node,
+                                         uint32_t         port_id,
+                                         uint32_t         buffer_id)
+{
+  SpaAudioConvert *this;
+  SpaAudioConvertBuffer *b;
+  SpaAudioConvertPort *port;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaAudioConvert, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, SPA_DIRECTION_OUTPUT, port_id), SPA_RESULT_INVALID_PORT);
+
+  port = &this->out_ports[port_id];
+
+  if (port->n_buffers == 0)
+    return SPA_RESULT_NO_BUFFERS;
+
+  if (buffer_id >= port->n_buffers)
+    return SPA_RESULT_INVALID_BUFFER_ID;
+
+  b = &port->buffers[buffer_id];
+  if (!b->outstanding)
+    return SPA_RESULT_OK;
+
+  b->outstanding = false;
+  spa_list_insert (port->empty.prev, &b->link);
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_audioconvert_node_port_send_command (SpaNode        *node,
+                                         SpaDirection    direction,
+                                         uint32_t        port_id,
+                                         SpaCommand     *command)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaAudioConvertBuffer *
+find_free_buffer (SpaAudioConvert *this, SpaAudioConvertPort *port)
+{
+  SpaAudioConvertBuffer *b;
+
+  if (spa_list_is_empty (&port->empty))
+    return NULL;
+
+  b = spa_list_first (&port->empty, SpaAudioConvertBuffer, link);
+  spa_list_remove (&b->link);
+  b->outstanding = true;
+
+  return b;
+}
+
+static inline void
+release_buffer (SpaAudioConvert *this, SpaBuffer *buffer)
+{
+  this->callbacks.reuse_buffer (&this->node, 0, buffer->id, this->user_data);
+}
+
+static void
+init_dither (SpaAudioConvert *this)
+{
+  uint32_t i, seed = 22222;
+
+  /* triangular noise of +-1 LSB, the sum of two uniform values */
+  for (i = 0; i < SPA_N_ELEMENTS (this->dither_noise); i++) {
+    float r1, r2;
+
+    seed = seed * 1103515245 + 12345;
+    r1 = (seed >> 8) * (1.0f / (1 << 24));
+    seed = seed * 1103515245 + 12345;
+    r2 = (seed >> 8) * (1.0f / (1 << 24));
+
+    this->dither_noise[i] = r1 - r2;
+  }
+  this->dither_seed = seed;
+}
+
+static inline const float *
+next_dither (SpaAudioConvert *this)
+{
+  /* start each block at a random place so that the table does not repeat
+   * with the block size */
+  this->dither_seed = this->dither_seed * 1103515245 + 12345;
+  return &this->dither_noise[(this->dither_seed >> 8) % DITHER_SIZE];
+}
+
+/* @src and @dst have one plane per channel when planar or a single plane
+ * with interleaved samples */
+static void
+convert (SpaAudioConvert *this, void *dst[], const void *src[], uint32_t n_frames)
+{
+  SpaAudioConvertPort *in = &this->in_ports[0], *out = &this->out_ports[0];
+  uint32_t channels = in->format.info.raw.channels;
+  uint32_t n_src = in->planar ? channels : 1;
+  uint32_t n_dst = out->planar ? channels : 1;
+  uint32_t block = BLOCK_SAMPLES / channels;
+  uint32_t i, k, n, n_in, n_out;
+  const float *f[MAX_CHANNELS];
+  float *t[MAX_CHANNELS];
+  const float *dither;
+
+  for (k = 0; k < n_frames; k += n) {
+    n = SPA_MIN (block, n_frames - k);
+    n_in = n * channels / n_src;
+    n_out = n * channels / n_dst;
+
+    /* to F32, still in the input layout */
+    for (i = 0; i < n_src; i++) {
+      const void *s = SPA_MEMBER (src[i], k * channels / n_src * in->sample_size, void);
+
+      if (this->to_f32) {
+        t[i] = &this->tmp[0][i * n_in];
+        this->to_f32 (t[i], s, n_in);
+        f[i] = t[i];
+      } else
+        f[i] = s;
+    }
+
+    /* change the layout, straight into the output for F32 */
+    if (n_src != n_dst) {
+      for (i = 0; i < n_dst; i++) {
+        if (this->from_f32)
+          t[i] = &this->tmp[1][i * n_out];
+        else
+          t[i] = SPA_MEMBER (dst[i], k * channels / n_dst * sizeof (float), float);
+      }
+      if (n_dst == 1)
+        this->ops.interleave_f32 (t[0], f, channels, n);
+      else
+        this->ops.deinterleave_f32 (t, f[0], channels, n);
+
+      if (this->from_f32 == NULL)
+        continue;
+
+      for (i = 0; i < n_dst; i++)
+        f[i] = t[i];
+    }
+
+    /* to the output format */
+    dither = this->dither ? next_dither (this) : NULL;
+    for (i = 0; i < n_dst; i++) {
+      void *d = SPA_MEMBER (dst[i], k * channels / n_dst * out->sample_size, void);
+
+      if (this->from_f32)
+        this->from_f32 (d, f[i], dither ? dither + i * n_out : NULL, n_out);
+      else
+        memcpy (d, f[i], n_out * sizeof (float));
+    }
+  }
+}
+
+/* fill @planes with the plane pointers of @buffer and return how many
+ * frames they hold. Planar data either comes as one data block per channel
+ * or as consecutive planes in one block. */
+static uint32_t
+get_in_planes (SpaAudioConvertPort *port, SpaBuffer *buffer, const void *planes[])
+{
+  uint32_t i, n_frames, channels = port->format.info.raw.channels;
+  SpaData *d = buffer->datas;
+
+  if (!port->planar || buffer->n_datas < channels) {
+    const uint8_t *p = SPA_MEMBER (d[0].data, d[0].chunk->offset, uint8_t);
+
+    n_frames = SPA_MIN (d[0].chunk->size, d[0].maxsize) / port->frame_size;
+    planes[0] = p;
+    if (port->planar) {
+      for (i = 1; i < channels; i++)
+        planes[i] = p + i * n_frames * port->sample_size;
+    }
+  } else {
+    n_frames = UINT32_MAX;
+    for (i = 0; i < channels; i++) {
+      planes[i] = SPA_MEMBER (d[i].data, d[i].chunk->offset, void);
+      n_frames = SPA_MIN (n_frames, SPA_MIN (d[i].chunk->size, d[i].maxsize) / port->sample_size);
+    }
+  }
+  return n_frames;
+}
+
+static uint32_t
+get_out_frames (SpaAudioConvertPort *port, SpaBuffer *buffer)
+{
+  uint32_t i, n_frames, channels = port->format.info.raw.channels;
+  SpaData *d = buffer->datas;
+
+  if (!port->planar || buffer->n_datas < channels)
+    return d[0].maxsize / port->frame_size;
+
+  n_frames = UINT32_MAX;
+  for (i = 0; i < channels; i++)
+    n_frames = SPA_MIN (n_frames, d[i].maxsize / port->sample_size);
+
+  return n_frames;
+}
+
+static void
+set_out_planes (SpaAudioConvertPort *port, SpaBuffer *buffer, uint32_t n_frames, void *planes[])
+{
+  uint32_t i, channels = port->format.info.raw.channels;
+  SpaData *d = buffer->datas;
+
+  if (!port->planar || buffer->n_datas < channels) {
+    planes[0] = d[0].data;
+    if (port->planar) {
+      for (i = 1; i < channels; i++)
+        planes[i] = SPA_MEMBER (d[0].data, i * n_frames * port->sample_size, void);
+    }
+    d[0].chunk->offset = 0;
+    d[0].chunk->size = n_frames * port->frame_size;
+    d[0].chunk->stride = port->planar ? port->sample_size : port->frame_size;
+  } else {
+    for (i = 0; i < channels; i++) {
+      planes[i] = d[i].data;
+      d[i].chunk->offset = 0;
+      d[i].chunk->size = n_frames * port->sample_size;
+      d[i].chunk->stride = port->sample_size;
+    }
+  }
+}
+
+static void
+do_convert (SpaAudioConvert *this, SpaBuffer *dbuf, SpaBuffer *sbuf)
+{
+  SpaAudioConvertPort *in = &this->in_ports[0], *out = &this->out_ports[0];
+  const void *src[MAX_CHANNELS];
+  void *dst[MAX_CHANNELS];
+  uint32_t i, n_frames, n_planes;
+
+  n_frames = get_in_planes (in, sbuf, src);
+  n_frames = SPA_MIN (n_frames, get_out_frames (out, dbuf));
+
+  set_out_planes (out, dbuf, n_frames, dst);
+
+  if (this->passthrough) {
+    n_planes = out->planar ? out->format.info.raw.channels : 1;
+    for (i = 0; i < n_planes; i++)
+      memcpy (dst[i], src[i], n_frames * out->frame_size / n_planes);
+  } else
+    convert (this, dst, src, n_frames);
+}
+
+static SpaResult
+spa_audioconvert_node_process_input (SpaNode *node)
+{
+  SpaAudioConvert *this;
+  SpaPortIO *input;
+  SpaPortIO *output;
+  SpaAudioConvertPort *in_port, *out_port;
+  SpaAudioConvertBuffer *sb, *db;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaAudioConvert, node);
+
+  in_port = &this->in_ports[0];
+  out_port = &this->out_ports[0];
+
+  if ((input = in_port->io) == NULL)
+    return SPA_RESULT_ERROR;
+  if ((output = out_port->io) == NULL)
+    return SPA_RESULT_ERROR;
+
+  if (!in_port->have_format || !out_port->have_format) {
+    input->status = SPA_RESULT_NO_FORMAT;
+    return SPA_RESULT_ERROR;
+  }
+  if (input->buffer_id >= in_port->n_buffers) {
+    input->status = SPA_RESULT_INVALID_BUFFER_ID;
+    return SPA_RESULT_ERROR;
+  }
+
+  if (output->buffer_id >= out_port->n_buffers) {
+    db = find_free_buffer (this, out_port);
+  } else {
+    db = &out_port->buffers[output->buffer_id];
+  }
+  if (db == NULL)
+    return SPA_RESULT_OUT_OF_BUFFERS;
+
+  sb = &in_port->buffers[input->buffer_id];
+
+  input->buffer_id = SPA_ID_INVALID;
+  input->status = SPA_RESULT_OK;
+
+  do_convert (this, db->outbuf, sb->outbuf);
+
+  if (sb->h && db->h)
+    *db->h = *sb->h;
+
+  output->buffer_id = db->outbuf->id;
+  output->status = SPA_RESULT_OK;
+
+  release_buffer (this, sb->outbuf);
+
+  return SPA_RESULT_HAVE_BUFFER;
+}
+
+static SpaResult
+spa_audioconvert_node_process_output (SpaNode *node)
+{
+  return SPA_RESULT_NEED_BUFFER;
+}
+
+static const SpaNode audioconvert_node = {
+  sizeof (SpaNode),
+  NULL,
+  spa_audioconvert_node_get_props,
+  spa_audioconvert_node_set_props,
+  spa_audioconvert_node_send_command,
+  spa_audioconvert_node_set_callbacks,
+  spa_audioconvert_node_get_n_ports,
+  spa_audioconvert_node_get_port_ids,
+  spa_audioconvert_node_add_port,
+  spa_audioconvert_node_remove_port,
+  spa_audioconvert_node_port_enum_formats,
+  spa_audioconvert_node_port_set_format,
+  spa_audioconvert_node_port_get_format,
+  spa_audioconvert_node_port_get_info,
+  spa_audioconvert_node_port_get_props,
+  spa_audioconvert_node_port_set_props,
+  spa_audioconvert_node_port_use_buffers,
+  spa_audioconvert_node_port_alloc_buffers,
+  spa_audioconvert_node_port_set_io,
+  spa_audioconvert_node_port_reuse_buffer,
+  spa_audioconvert_node_port_send_command,
+  spa_audioconvert_node_process_input,
+  spa_audioconvert_node_process_output,
+};
+
+static SpaResult
+spa_audioconvert_get_interface (SpaHandle               *handle,
+                                uint32_t                 interface_id,
+                                void                   **interface)
+{
+  SpaAudioConvert *this;
+
+  spa_return_val_if_fail (handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (interface != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = (SpaAudioConvert *) handle;
+
+  if (interface_id == this->type.node)
+    *interface = &this->node;
+  else
+    return SPA_RESULT_UNKNOWN_INTERFACE;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+audioconvert_clear (SpaHandle *handle)
+{
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+audioconvert_init (const SpaHandleFactory  *factory,
+                   SpaHandle               *handle,
+                   const SpaDict           *info,
+                   const SpaSupport        *support,
+                   uint32_t                 n_support)
+{
+  SpaAudioConvert *this;
+  uint32_t i;
+
+  spa_return_val_if_fail (factory != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  handle->get_interface = spa_audioconvert_get_interface;
+  handle->clear = audioconvert_clear;
+
+  this = (SpaAudioConvert *) handle;
+
+  for (i = 0; i < n_support; i++) {
+    if (strcmp (support[i].type, SPA_TYPE__TypeMap) == 0)
+      this->map = support[i].data;
+    else if (strcmp (support[i].type, SPA_TYPE__Log) == 0)
+      this->log = support[i].data;
+  }
+  if (this->map == NULL) {
+    spa_log_error (this->log, "a type-map is needed");
+    return SPA_RESULT_ERROR;
+  }
+  init_type (&this->type, this->map);
+
+  spa_audioconvert_ops_init (&this->ops, spa_cpu_get_info_flags (info));
+  spa_log_info (this->log, "audioconvert %p: using cpu flags 0x%08x", this, this->ops.cpu_flags);
+
+  this->node = audioconvert_node;
+  reset_audioconvert_props (&this->props);
+  init_dither (this);
+
+  this->in_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
+  spa_list_init (&this->in_ports[0].empty);
+
+  this->out_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS |
+                                  SPA_PORT_INFO_FLAG_NO_REF;
+  spa_list_init (&this->out_ports[0].empty);
+
+  return SPA_RESULT_OK;
+}
+
+static const SpaInterfaceInfo audioconvert_interfaces[] =
+{
+  { SPA_TYPE__Node, },
+};
+
+static SpaResult
+audioconvert_enum_interface_info (const SpaHandleFactory  *factory,
+                                  const SpaInterfaceInfo **info,
+                                  uint32_t                 index)
+{
+  spa_return_val_if_fail (factory != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (info != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  switch (index) {
+    case 0:
+      *info = &audioconvert_interfaces[index];
+      break;
+    default:
+      return SPA_RESULT_ENUM_END;
+  }
+  return SPA_RESULT_OK;
+}
+
+const SpaHandleFactory spa_audioconvert_factory =
+{ "audioconvert",
+  NULL,
+  sizeof (SpaAudioConvert),
+  audioconvert_init,
+  audioconvert_enum_interface_info,
+};
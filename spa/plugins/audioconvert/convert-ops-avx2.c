@@ -0,0 +1,97 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <immintrin.h>
+
+#include "convert-ops.h"
+
+void
+spa_audioconvert_s16_to_f32_avx2 (float *dst, const void *src, uint32_t n_samples)
+{
+  const int16_t *s = src;
+  const __m256 scale = _mm256_set1_ps (1.0f / SPA_AUDIOCONVERT_S16_SCALE);
+  uint32_t i, unrolled = n_samples & ~15;
+
+  for (i = 0; i < unrolled; i += 16) {
+    __m256i lo = _mm256_cvtepi16_epi32 (_mm_loadu_si128 ((const __m128i *) &s[i]));
+    __m256i hi = _mm256_cvtepi16_epi32 (_mm_loadu_si128 ((const __m128i *) &s[i + 8]));
+
+    _mm256_storeu_ps (&dst[i], _mm256_mul_ps (_mm256_cvtepi32_ps (lo), scale));
+    _mm256_storeu_ps (&dst[i + 8], _mm256_mul_ps (_mm256_cvtepi32_ps (hi), scale));
+  }
+  spa_audioconvert_s16_to_f32_range (dst, s, i, n_samples);
+}
+
+void
+spa_audioconvert_s32_to_f32_avx2 (float *dst, const void *src, uint32_t n_samples)
+{
+  const int32_t *s = src;
+  const __m256 scale = _mm256_set1_ps (1.0f / SPA_AUDIOCONVERT_S32_SCALE);
+  uint32_t i, unrolled = n_samples & ~7;
+
+  for (i = 0; i < unrolled; i += 8) {
+    __m256i in = _mm256_loadu_si256 ((const __m256i *) &s[i]);
+    _mm256_storeu_ps (&dst[i], _mm256_mul_ps (_mm256_cvtepi32_ps (in), scale));
+  }
+  spa_audioconvert_s32_to_f32_range (dst, s, i, n_samples);
+}
+
+void
+spa_audioconvert_f32_to_s16_avx2 (void *dst, const float *src, const float *dither, uint32_t n_samples)
+{
+  int16_t *d = dst;
+  const __m256 scale = _mm256_set1_ps (SPA_AUDIOCONVERT_S16_SCALE);
+  const __m256 min = _mm256_set1_ps (-32768.0f), max = _mm256_set1_ps (32767.0f);
+  uint32_t i, unrolled = n_samples & ~15;
+
+  for (i = 0; i < unrolled; i += 16) {
+    __m256 lo = _mm256_mul_ps (_mm256_loadu_ps (&src[i]), scale);
+    __m256 hi = _mm256_mul_ps (_mm256_loadu_ps (&src[i + 8]), scale);
+    __m256i r;
+
+    if (dither) {
+      lo = _mm256_add_ps (lo, _mm256_loadu_ps (&dither[i]));
+      hi = _mm256_add_ps (hi, _mm256_loadu_ps (&dither[i + 8]));
+    }
+    lo = _mm256_min_ps (_mm256_max_ps (lo, min), max);
+    hi = _mm256_min_ps (_mm256_max_ps (hi, min), max);
+
+    /* packs works per 128 bit lane, put the quadwords back in order */
+    r = _mm256_packs_epi32 (_mm256_cvtps_epi32 (lo), _mm256_cvtps_epi32 (hi));
+    _mm256_storeu_si256 ((__m256i *) &d[i], _mm256_permute4x64_epi64 (r, 0xd8));
+  }
+  spa_audioconvert_f32_to_s16_range (d, src, dither, i, n_samples);
+}
+
+void
+spa_audioconvert_f32_to_s32_avx2 (void *dst, const float *src, const float *dither, uint32_t n_samples)
+{
+  int32_t *d = dst;
+  const __m256 scale = _mm256_set1_ps (SPA_AUDIOCONVERT_S32_SCALE);
+  const __m256 min = _mm256_set1_ps (-SPA_AUDIOCONVERT_S32_SCALE);
+  const __m256 max = _mm256_set1_ps (SPA_AUDIOCONVERT_S32_MAX);
+  uint32_t i, unrolled = n_samples & ~7;
+
+  for (i = 0; i < unrolled; i += 8) {
+    __m256 v = _mm256_mul_ps (_mm256_loadu_ps (&src[i]), scale);
+    v = _mm256_min_ps (_mm256_max_ps (v, min), max);
+    _mm256_storeu_si256 ((__m256i *) &d[i], _mm256_cvtps_epi32 (v));
+  }
+  spa_audioconvert_f32_to_s32_range (d, src, i, n_samples);
+}
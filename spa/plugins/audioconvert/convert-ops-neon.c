@@ -0,0 +1,73 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <arm_neon.h>
+
+#include "convert-ops.h"
+
+static inline int32x4_t
+round_s32 (float32x4_t v)
+{
+#if defined (__aarch64__)
+  return vcvtnq_s32_f32 (v);
+#else
+  /* ARMv7 only truncates, round half away from zero instead */
+  const uint32x4_t sign = vdupq_n_u32 (0x80000000);
+  float32x4_t half = vreinterpretq_f32_u32 (vorrq_u32 (vandq_u32 (vreinterpretq_u32_f32 (v), sign),
+                                                       vreinterpretq_u32_f32 (vdupq_n_f32 (0.5f))));
+  return vcvtq_s32_f32 (vaddq_f32 (v, half));
+#endif
+}
+
+void
+spa_audioconvert_s16_to_f32_neon (float *dst, const void *src, uint32_t n_samples)
+{
+  const int16_t *s = src;
+  uint32_t i, unrolled = n_samples & ~7;
+
+  for (i = 0; i < unrolled; i += 8) {
+    int16x8_t in = vld1q_s16 (&s[i]);
+
+    vst1q_f32 (&dst[i], vmulq_n_f32 (vcvtq_f32_s32 (vmovl_s16 (vget_low_s16 (in))),
+                                     1.0f / SPA_AUDIOCONVERT_S16_SCALE));
+    vst1q_f32 (&dst[i + 4], vmulq_n_f32 (vcvtq_f32_s32 (vmovl_s16 (vget_high_s16 (in))),
+                                         1.0f / SPA_AUDIOCONVERT_S16_SCALE));
+  }
+  spa_audioconvert_s16_to_f32_range (dst, s, i, n_samples);
+}
+
+void
+spa_audioconvert_f32_to_s16_neon (void *dst, const float *src, const float *dither, uint32_t n_samples)
+{
+  int16_t *d = dst;
+  uint32_t i, unrolled = n_samples & ~7;
+
+  for (i = 0; i < unrolled; i += 8) {
+    float32x4_t lo = vmulq_n_f32 (vld1q_f32 (&src[i]), SPA_AUDIOCONVERT_S16_SCALE);
+    float32x4_t hi = vmulq_n_f32 (vld1q_f32 (&src[i + 4]), SPA_AUDIOCONVERT_S16_SCALE);
+
+    if (dither) {
+      lo = vaddq_f32 (lo, vld1q_f32 (&dither[i]));
+      hi = vaddq_f32 (hi, vld1q_f32 (&dither[i + 4]));
+    }
+    /* the narrowing move saturates */
+    vst1q_s16 (&d[i], vcombine_s16 (vqmovn_s32 (round_s32 (lo)), vqmovn_s32 (round_s32 (hi))));
+  }
+  spa_audioconvert_f32_to_s16_range (d, src, dither, i, n_samples);
+}
@@ -0,0 +1,143 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <emmintrin.h>
+
+#include "convert-ops.h"
+
+void
+spa_audioconvert_s16_to_f32_sse2 (float *dst, const void *src, uint32_t n_samples)
+{
+  const int16_t *s = src;
+  const __m128 scale = _mm_set1_ps (1.0f / SPA_AUDIOCONVERT_S16_SCALE);
+  uint32_t i, unrolled = n_samples & ~7;
+
+  for (i = 0; i < unrolled; i += 8) {
+    __m128i in = _mm_loadu_si128 ((const __m128i *) &s[i]);
+    __m128i lo = _mm_srai_epi32 (_mm_unpacklo_epi16 (in, in), 16);
+    __m128i hi = _mm_srai_epi32 (_mm_unpackhi_epi16 (in, in), 16);
+
+    _mm_storeu_ps (&dst[i], _mm_mul_ps (_mm_cvtepi32_ps (lo), scale));
+    _mm_storeu_ps (&dst[i + 4], _mm_mul_ps (_mm_cvtepi32_ps (hi), scale));
+  }
+  spa_audioconvert_s16_to_f32_range (dst, s, i, n_samples);
+}
+
+void
+spa_audioconvert_s32_to_f32_sse2 (float *dst, const void *src, uint32_t n_samples)
+{
+  const int32_t *s = src;
+  const __m128 scale = _mm_set1_ps (1.0f / SPA_AUDIOCONVERT_S32_SCALE);
+  uint32_t i, unrolled = n_samples & ~3;
+
+  for (i = 0; i < unrolled; i += 4) {
+    __m128i in = _mm_loadu_si128 ((const __m128i *) &s[i]);
+    _mm_storeu_ps (&dst[i], _mm_mul_ps (_mm_cvtepi32_ps (in), scale));
+  }
+  spa_audioconvert_s32_to_f32_range (dst, s, i, n_samples);
+}
+
+void
+spa_audioconvert_f32_to_s16_sse2 (void *dst, const float *src, const float *dither, uint32_t n_samples)
+{
+  int16_t *d = dst;
+  const __m128 scale = _mm_set1_ps (SPA_AUDIOCONVERT_S16_SCALE);
+  const __m128 min = _mm_set1_ps (-32768.0f), max = _mm_set1_ps (32767.0f);
+  uint32_t i, unrolled = n_samples & ~7;
+
+  for (i = 0; i < unrolled; i += 8) {
+    __m128 lo = _mm_mul_ps (_mm_loadu_ps (&src[i]), scale);
+    __m128 hi = _mm_mul_ps (_mm_loadu_ps (&src[i + 4]), scale);
+
+    if (dither) {
+      lo = _mm_add_ps (lo, _mm_loadu_ps (&dither[i]));
+      hi = _mm_add_ps (hi, _mm_loadu_ps (&dither[i + 4]));
+    }
+    lo = _mm_min_ps (_mm_max_ps (lo, min), max);
+    hi = _mm_min_ps (_mm_max_ps (hi, min), max);
+
+    _mm_storeu_si128 ((__m128i *) &d[i], _mm_packs_epi32 (_mm_cvtps_epi32 (lo), _mm_cvtps_epi32 (hi)));
+  }
+  spa_audioconvert_f32_to_s16_range (d, src, dither, i, n_samples);
+}
+
+void
+spa_audioconvert_f32_to_s32_sse2 (void *dst, const float *src, const float *dither, uint32_t n_samples)
+{
+  int32_t *d = dst;
+  const __m128 scale = _mm_set1_ps (SPA_AUDIOCONVERT_S32_SCALE);
+  const __m128 min = _mm_set1_ps (-SPA_AUDIOCONVERT_S32_SCALE), max = _mm_set1_ps (SPA_AUDIOCONVERT_S32_MAX);
+  uint32_t i, unrolled = n_samples & ~3;
+
+  for (i = 0; i < unrolled; i += 4) {
+    __m128 v = _mm_mul_ps (_mm_loadu_ps (&src[i]), scale);
+    v = _mm_min_ps (_mm_max_ps (v, min), max);
+    _mm_storeu_si128 ((__m128i *) &d[i], _mm_cvtps_epi32 (v));
+  }
+  spa_audioconvert_f32_to_s32_range (d, src, i, n_samples);
+}
+
+/* only stereo is worth a special case, other layouts use the C version */
+void
+spa_audioconvert_interleave_f32_sse2 (float *dst, const float *src[], uint32_t n_channels, uint32_t n_frames)
+{
+  uint32_t i, unrolled = n_frames & ~3;
+  const float *l, *r;
+
+  if (n_channels != 2) {
+    spa_audioconvert_interleave_f32_c (dst, src, n_channels, n_frames);
+    return;
+  }
+  l = src[0];
+  r = src[1];
+  for (i = 0; i < unrolled; i += 4) {
+    __m128 a = _mm_loadu_ps (&l[i]), b = _mm_loadu_ps (&r[i]);
+
+    _mm_storeu_ps (&dst[2 * i], _mm_unpacklo_ps (a, b));
+    _mm_storeu_ps (&dst[2 * i + 4], _mm_unpackhi_ps (a, b));
+  }
+  for (; i < n_frames; i++) {
+    dst[2 * i] = l[i];
+    dst[2 * i + 1] = r[i];
+  }
+}
+
+void
+spa_audioconvert_deinterleave_f32_sse2 (float *dst[], const float *src, uint32_t n_channels, uint32_t n_frames)
+{
+  uint32_t i, unrolled = n_frames & ~3;
+  float *l, *r;
+
+  if (n_channels != 2) {
+    spa_audioconvert_deinterleave_f32_c (dst, src, n_channels, n_frames);
+    return;
+  }
+  l = dst[0];
+  r = dst[1];
+  for (i = 0; i < unrolled; i += 4) {
+    __m128 a = _mm_loadu_ps (&src[2 * i]), b = _mm_loadu_ps (&src[2 * i + 4]);
+
+    _mm_storeu_ps (&l[i], _mm_shuffle_ps (a, b, _MM_SHUFFLE (2, 0, 2, 0)));
+    _mm_storeu_ps (&r[i], _mm_shuffle_ps (a, b, _MM_SHUFFLE (3, 1, 3, 1)));
+  }
+  for (; i < n_frames; i++) {
+    l[i] = src[2 * i];
+    r[i] = src[2 * i + 1];
+  }
+}
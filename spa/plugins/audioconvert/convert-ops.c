@@ -0,0 +1,178 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <endian.h>
+
+#include <lib/cpu.h>
+
+#include "convert-ops.h"
+
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+#define S24_READ(p)     ((int32_t) (((uint32_t) (p)[0] << 8) | ((uint32_t) (p)[1] << 16) | ((uint32_t) (p)[2] << 24)) >> 8)
+#define S24_WRITE(p,v)  ((p)[0] = (v), (p)[1] = (v) >> 8, (p)[2] = (v) >> 16)
+#else
+#define S24_READ(p)     ((int32_t) (((uint32_t) (p)[2] << 8) | ((uint32_t) (p)[1] << 16) | ((uint32_t) (p)[0] << 24)) >> 8)
+#define S24_WRITE(p,v)  ((p)[2] = (v), (p)[1] = (v) >> 8, (p)[0] = (v) >> 16)
+#endif
+
+static inline int32_t
+f32_to_s24 (float s, float dither)
+{
+  float v = s * SPA_AUDIOCONVERT_S24_SCALE + dither;
+  return lrintf (SPA_CLAMP (v, -8388608.0f, 8388607.0f));
+}
+
+void
+spa_audioconvert_s16_to_f32_c (float *dst, const void *src, uint32_t n_samples)
+{
+  spa_audioconvert_s16_to_f32_range (dst, src, 0, n_samples);
+}
+
+void
+spa_audioconvert_s24_to_f32_c (float *dst, const void *src, uint32_t n_samples)
+{
+  const uint8_t *s = src;
+  uint32_t i;
+
+  for (i = 0; i < n_samples; i++, s += 3)
+    dst[i] = S24_READ (s) * (1.0f / SPA_AUDIOCONVERT_S24_SCALE);
+}
+
+void
+spa_audioconvert_s24_32_to_f32_c (float *dst, const void *src, uint32_t n_samples)
+{
+  const int32_t *s = src;
+  uint32_t i;
+
+  /* sign extend from the low 24 bits, the top byte is undefined */
+  for (i = 0; i < n_samples; i++)
+    dst[i] = ((int32_t) ((uint32_t) s[i] << 8) >> 8) * (1.0f / SPA_AUDIOCONVERT_S24_SCALE);
+}
+
+void
+spa_audioconvert_s32_to_f32_c (float *dst, const void *src, uint32_t n_samples)
+{
+  spa_audioconvert_s32_to_f32_range (dst, src, 0, n_samples);
+}
+
+void
+spa_audioconvert_f32_to_s16_c (void *dst, const float *src, const float *dither, uint32_t n_samples)
+{
+  spa_audioconvert_f32_to_s16_range (dst, src, dither, 0, n_samples);
+}
+
+void
+spa_audioconvert_f32_to_s24_c (void *dst, const float *src, const float *dither, uint32_t n_samples)
+{
+  uint8_t *d = dst;
+  uint32_t i;
+
+  for (i = 0; i < n_samples; i++, d += 3) {
+    int32_t v = f32_to_s24 (src[i], dither ? dither[i] : 0.0f);
+    S24_WRITE (d, v);
+  }
+}
+
+void
+spa_audioconvert_f32_to_s24_32_c (void *dst, const float *src, const float *dither, uint32_t n_samples)
+{
+  int32_t *d = dst;
+  uint32_t i;
+
+  for (i = 0; i < n_samples; i++)
+    d[i] = f32_to_s24 (src[i], dither ? dither[i] : 0.0f);
+}
+
+void
+spa_audioconvert_f32_to_s32_c (void *dst, const float *src, const float *dither, uint32_t n_samples)
+{
+  spa_audioconvert_f32_to_s32_range (dst, src, 0, n_samples);
+}
+
+void
+spa_audioconvert_interleave_f32_c (float *dst, const float *src[], uint32_t n_channels, uint32_t n_frames)
+{
+  uint32_t i, c;
+
+  for (c = 0; c < n_channels; c++) {
+    const float *s = src[c];
+    float *d = &dst[c];
+
+    for (i = 0; i < n_frames; i++, d += n_channels)
+      *d = s[i];
+  }
+}
+
+void
+spa_audioconvert_deinterleave_f32_c (float *dst[], const float *src, uint32_t n_channels, uint32_t n_frames)
+{
+  uint32_t i, c;
+
+  for (c = 0; c < n_channels; c++) {
+    const float *s = &src[c];
+    float *d = dst[c];
+
+    for (i = 0; i < n_frames; i++, s += n_channels)
+      d[i] = *s;
+  }
+}
+
+void
+spa_audioconvert_ops_init (SpaAudioConvertOps *ops, uint32_t cpu_flags)
+{
+  ops->cpu_flags = 0;
+  ops->s16_to_f32 = spa_audioconvert_s16_to_f32_c;
+  ops->s24_to_f32 = spa_audioconvert_s24_to_f32_c;
+  ops->s24_32_to_f32 = spa_audioconvert_s24_32_to_f32_c;
+  ops->s32_to_f32 = spa_audioconvert_s32_to_f32_c;
+  ops->f32_to_s16 = spa_audioconvert_f32_to_s16_c;
+  ops->f32_to_s24 = spa_audioconvert_f32_to_s24_c;
+  ops->f32_to_s24_32 = spa_audioconvert_f32_to_s24_32_c;
+  ops->f32_to_s32 = spa_audioconvert_f32_to_s32_c;
+  ops->interleave_f32 = spa_audioconvert_interleave_f32_c;
+  ops->deinterleave_f32 = spa_audioconvert_deinterleave_f32_c;
+
+#if defined (HAVE_SSE2)
+  if (cpu_flags & SPA_CPU_FLAG_SSE2) {
+    ops->cpu_flags = SPA_CPU_FLAG_SSE2;
+    ops->s16_to_f32 = spa_audioconvert_s16_to_f32_sse2;
+    ops->s32_to_f32 = spa_audioconvert_s32_to_f32_sse2;
+    ops->f32_to_s16 = spa_audioconvert_f32_to_s16_sse2;
+    ops->f32_to_s32 = spa_audioconvert_f32_to_s32_sse2;
+    ops->interleave_f32 = spa_audioconvert_interleave_f32_sse2;
+    ops->deinterleave_f32 = spa_audioconvert_deinterleave_f32_sse2;
+  }
+#endif
+#if defined (HAVE_AVX2)
+  if (cpu_flags & SPA_CPU_FLAG_AVX2) {
+    ops->cpu_flags = SPA_CPU_FLAG_AVX2;
+    ops->s16_to_f32 = spa_audioconvert_s16_to_f32_avx2;
+    ops->s32_to_f32 = spa_audioconvert_s32_to_f32_avx2;
+    ops->f32_to_s16 = spa_audioconvert_f32_to_s16_avx2;
+    ops->f32_to_s32 = spa_audioconvert_f32_to_s32_avx2;
+  }
+#endif
+#if defined (HAVE_NEON)
+  if (cpu_flags & SPA_CPU_FLAG_NEON) {
+    ops->cpu_flags = SPA_CPU_FLAG_NEON;
+    ops->s16_to_f32 = spa_audioconvert_s16_to_f32_neon;
+    ops->f32_to_s16 = spa_audioconvert_f32_to_s16_neon;
+  }
+#endif
+}
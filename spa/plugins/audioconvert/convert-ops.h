@@ -0,0 +1,191 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_AUDIOCONVERT_CONVERT_OPS_H__
+#define __SPA_AUDIOCONVERT_CONVERT_OPS_H__
+
+#include <math.h>
+
+#include <spa/defs.h>
+
+/* full scale of the integer formats, F32 samples are in [-1.0, 1.0) */
+#define SPA_AUDIOCONVERT_S16_SCALE      32768.0f
+#define SPA_AUDIOCONVERT_S24_SCALE      8388608.0f
+#define SPA_AUDIOCONVERT_S32_SCALE      2147483648.0f
+/* largest float below 2^31, larger values don't fit an int32 */
+#define SPA_AUDIOCONVERT_S32_MAX        2147483520.0f
+
+/**
+ * SpaAudioConvertToF32Func:
+ * @dst: destination F32 samples
+ * @src: source samples
+ * @n_samples: number of samples
+ *
+ * Convert @n_samples from a native endian integer format to F32.
+ */
+typedef void (*SpaAudioConvertToF32Func) (float *dst, const void *src, uint32_t n_samples);
+
+/**
+ * SpaAudioConvertFromF32Func:
+ * @dst: destination samples
+ * @src: source F32 samples
+ * @dither: %NULL or @n_samples of dither noise, in units of the destination LSB
+ * @n_samples: number of samples
+ *
+ * Convert @n_samples from F32 to a native endian integer format, rounding
+ * to the nearest value and clamping. @dither is ignored for S32, which has
+ * more bits than a float can carry.
+ */
+typedef void (*SpaAudioConvertFromF32Func) (void *dst, const float *src, const float *dither,
+                                            uint32_t n_samples);
+
+/**
+ * SpaAudioConvertInterleaveFunc:
+ * @dst: interleaved destination samples
+ * @src: array of @n_channels planes
+ * @n_channels: number of channels
+ * @n_frames: number of frames
+ *
+ * Interleave F32 planes into one buffer.
+ */
+typedef void (*SpaAudioConvertInterleaveFunc) (float *dst, const float *src[],
+                                               uint32_t n_channels, uint32_t n_frames);
+
+/**
+ * SpaAudioConvertDeinterleaveFunc:
+ * @dst: array of @n_channels destination planes
+ * @src: interleaved source samples
+ * @n_channels: number of channels
+ * @n_frames: number of frames
+ *
+ * Split interleaved F32 samples into planes.
+ */
+typedef void (*SpaAudioConvertDeinterleaveFunc) (float *dst[], const float *src,
+                                                 uint32_t n_channels, uint32_t n_frames);
+
+/**
+ * SpaAudioConvertOps:
+ * @cpu_flags: the #SpaCPUFlags the functions were selected for
+ *
+ * The conversion kernels, selected once for the CPU we run on. Every
+ * conversion goes through F32, S24 is packed in 3 bytes and S24_32 is
+ * stored in the low 24 bits of 32.
+ */
+typedef struct {
+  uint32_t                        cpu_flags;
+  SpaAudioConvertToF32Func        s16_to_f32;
+  SpaAudioConvertToF32Func        s24_to_f32;
+  SpaAudioConvertToF32Func        s24_32_to_f32;
+  SpaAudioConvertToF32Func        s32_to_f32;
+  SpaAudioConvertFromF32Func      f32_to_s16;
+  SpaAudioConvertFromF32Func      f32_to_s24;
+  SpaAudioConvertFromF32Func      f32_to_s24_32;
+  SpaAudioConvertFromF32Func      f32_to_s32;
+  SpaAudioConvertInterleaveFunc   interleave_f32;
+  SpaAudioConvertDeinterleaveFunc deinterleave_f32;
+} SpaAudioConvertOps;
+
+void spa_audioconvert_ops_init (SpaAudioConvertOps *ops, uint32_t cpu_flags);
+
+/* plain C versions, also used by the SIMD kernels for the remaining
+ * samples from @start to @end */
+static inline void
+spa_audioconvert_s16_to_f32_range (float *d, const int16_t *s, uint32_t start, uint32_t end)
+{
+  uint32_t i;
+
+  for (i = start; i < end; i++)
+    d[i] = s[i] * (1.0f / SPA_AUDIOCONVERT_S16_SCALE);
+}
+
+static inline void
+spa_audioconvert_s32_to_f32_range (float *d, const int32_t *s, uint32_t start, uint32_t end)
+{
+  uint32_t i;
+
+  for (i = start; i < end; i++)
+    d[i] = s[i] * (1.0f / SPA_AUDIOCONVERT_S32_SCALE);
+}
+
+static inline void
+spa_audioconvert_f32_to_s16_range (int16_t *d, const float *s, const float *dither,
+                                   uint32_t start, uint32_t end)
+{
+  uint32_t i;
+
+  for (i = start; i < end; i++) {
+    float v = s[i] * SPA_AUDIOCONVERT_S16_SCALE + (dither ? dither[i] : 0.0f);
+    d[i] = lrintf (SPA_CLAMP (v, -32768.0f, 32767.0f));
+  }
+}
+
+static inline void
+spa_audioconvert_f32_to_s32_range (int32_t *d, const float *s, uint32_t start, uint32_t end)
+{
+  uint32_t i;
+
+  for (i = start; i < end; i++) {
+    float v = s[i] * SPA_AUDIOCONVERT_S32_SCALE;
+    d[i] = lrintf (SPA_CLAMP (v, -SPA_AUDIOCONVERT_S32_SCALE, SPA_AUDIOCONVERT_S32_MAX));
+  }
+}
+
+void spa_audioconvert_s16_to_f32_c          (float *dst, const void *src, uint32_t n_samples);
+void spa_audioconvert_s24_to_f32_c          (float *dst, const void *src, uint32_t n_samples);
+void spa_audioconvert_s24_32_to_f32_c       (float *dst, const void *src, uint32_t n_samples);
+void spa_audioconvert_s32_to_f32_c          (float *dst, const void *src, uint32_t n_samples);
+void spa_audioconvert_f32_to_s16_c          (void *dst, const float *src, const float *dither,
+                                             uint32_t n_samples);
+void spa_audioconvert_f32_to_s24_c          (void *dst, const float *src, const float *dither,
+                                             uint32_t n_samples);
+void spa_audioconvert_f32_to_s24_32_c       (void *dst, const float *src, const float *dither,
+                                             uint32_t n_samples);
+void spa_audioconvert_f32_to_s32_c          (void *dst, const float *src, const float *dither,
+                                             uint32_t n_samples);
+void spa_audioconvert_interleave_f32_c      (float *dst, const float *src[],
+                                             uint32_t n_channels, uint32_t n_frames);
+void spa_audioconvert_deinterleave_f32_c    (float *dst[], const float *src,
+                                             uint32_t n_channels, uint32_t n_frames);
+#if defined (HAVE_SSE2)
+void spa_audioconvert_s16_to_f32_sse2       (float *dst, const void *src, uint32_t n_samples);
+void spa_audioconvert_s32_to_f32_sse2       (float *dst, const void *src, uint32_t n_samples);
+void spa_audioconvert_f32_to_s16_sse2       (void *dst, const float *src, const float *dither,
+                                             uint32_t n_samples);
+void spa_audioconvert_f32_to_s32_sse2       (void *dst, const float *src, const float *dither,
+                                             uint32_t n_samples);
+void spa_audioconvert_interleave_f32_sse2   (float *dst, const float *src[],
+                                             uint32_t n_channels, uint32_t n_frames);
+void spa_audioconvert_deinterleave_f32_sse2 (float *dst[], const float *src,
+                                             uint32_t n_channels, uint32_t n_frames);
+#endif
+#if defined (HAVE_AVX2)
+void spa_audioconvert_s16_to_f32_avx2       (float *dst, const void *src, uint32_t n_samples);
+void spa_audioconvert_s32_to_f32_avx2       (float *dst, const void *src, uint32_t n_samples);
+void spa_audioconvert_f32_to_s16_avx2       (void *dst, const float *src, const float *dither,
+                                             uint32_t n_samples);
+void spa_audioconvert_f32_to_s32_avx2       (void *dst, const float *src, const float *dither,
+                                             uint32_t n_samples);
+#endif
+#if defined (HAVE_NEON)
+void spa_audioconvert_s16_to_f32_neon       (float *dst, const void *src, uint32_t n_samples);
+void spa_audioconvert_f32_to_s16_neon       (void *dst, const float *src, const float *dither,
+                                             uint32_t n_samples);
+#endif
+
+#endif /* __SPA_AUDIOCONVERT_CONVERT_OPS_H__ */
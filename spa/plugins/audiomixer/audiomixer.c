@@ -27,12 +27,22 @@
 #include <spa/audio/format-utils.h>
 #include <spa/format-builder.h>
 #include <lib/props.h>
+#include <lib/cpu.h>
+#include <lib/mix-ops.h>
 
 #define MAX_BUFFERS     64
 #define MAX_PORTS       128
 
+/* length of the linear gain ramp after a volume or mute change */
+#define RAMP_MSEC       5
+
 typedef struct _SpaAudioMixer SpaAudioMixer;
 
+typedef struct {
+  double volume;
+  bool mute;
+} SpaAudioMixerPortProps;
+
 typedef struct {
   SpaBuffer     *outbuf;
   bool           outstanding;
@@ -41,6 +51,8 @@ typedef struct {
 } MixerBuffer;
 
 typedef struct {
+  uint32_t     id;
+  uint32_t     active_index;
   SpaPortIO   *io;
 
   bool have_format;
@@ -52,11 +64,22 @@ typedef struct {
   SpaList      queue;
   size_t       queued_offset;
   size_t       queued_bytes;
+
+  SpaAudioMixerPortProps props;
+
+  /* gain state, only touched from the processing functions */
+  float        gain;
+  float        target;
+  float        ramp_step;         /* per frame */
+  uint32_t     ramp_left;         /* in frames */
 } SpaAudioMixerPort;
 
 typedef struct {
   uint32_t node;
   uint32_t format;
+  uint32_t props;
+  uint32_t prop_volume;
+  uint32_t prop_mute;
   SpaTypeMediaType media_type;
   SpaTypeMediaSubtype media_subtype;
   SpaTypeFormatAudio format_audio;
@@ -71,6 +94,9 @@ init_type (Type *type, SpaTypeMap *map)
 {
   type->node = spa_type_map_get_id (map, SPA_TYPE__Node);
   type->format = spa_type_map_get_id (map, SPA_TYPE__Format);
+  type->props = spa_type_map_get_id (map, SPA_TYPE__Props);
+  type->prop_volume = spa_type_map_get_id (map, SPA_TYPE_PROPS__volume);
+  type->prop_mute = spa_type_map_get_id (map, SPA_TYPE_PROPS__mute);
   spa_type_media_type_map (map, &type->media_type);
   spa_type_media_subtype_map (map, &type->media_subtype);
   spa_type_format_audio_map (map, &type->format_audio);
@@ -96,10 +122,23 @@ struct _SpaAudioMixer {
   SpaAudioMixerPort in_ports[MAX_PORTS];
   SpaAudioMixerPort out_ports[1];
 
+  /* input ports with io, the processing functions only look at these */
+  SpaAudioMixerPort *active_ports[MAX_PORTS];
+  uint32_t n_active_ports;
+
   bool have_format;
   SpaAudioInfo format;
   uint8_t format_buffer[4096];
 
+  uint8_t props_buffer[512];
+
+  SpaAudioMixerOps ops;
+  SpaAudioMixerMixFunc mix;
+  SpaAudioMixerMixGainFunc mix_gain;
+  uint32_t sample_size;
+  uint32_t frame_size;
+  uint32_t ramp_frames;
+
   bool started;
 };
 
@@ -110,6 +149,16 @@ struct _SpaAudioMixer {
 #define CHECK_OUT_PORT(this,d,p)     ((d) == SPA_DIRECTION_OUTPUT && (p) == 0)
 #define CHECK_PORT(this,d,p)         (CHECK_OUT_PORT(this,d,p) || CHECK_IN_PORT (this,d,p))
 
+#define DEFAULT_VOLUME 1.0
+#define DEFAULT_MUTE false
+
+static void
+reset_port_props (SpaAudioMixerPortProps *props)
+{
+  props->volume = DEFAULT_VOLUME;
+  props->mute = DEFAULT_MUTE;
+}
+
 #define PROP(f,key,type,...)                                                    \
           SPA_POD_PROP (f,key,0,type,1,__VA_ARGS__)
 #define PROP_MM(f,key,type,...)                                                 \
@@ -225,6 +274,31 @@ spa_audiomixer_node_get_port_ids (SpaNode       *node,
   return SPA_RESULT_OK;
 }
 
+static void
+activate_port (SpaAudioMixer *this, SpaAudioMixerPort *port)
+{
+  if (port->active_index != SPA_IDX_INVALID)
+    return;
+
+  port->active_index = this->n_active_ports;
+  this->active_ports[this->n_active_ports++] = port;
+}
+
+static void
+deactivate_port (SpaAudioMixer *this, SpaAudioMixerPort *port)
+{
+  SpaAudioMixerPort *last;
+
+  if (port->active_index == SPA_IDX_INVALID)
+    return;
+
+  /* move the last port into the hole to keep the array dense */
+  last = this->active_ports[--this->n_active_ports];
+  this->active_ports[port->active_index] = last;
+  last->active_index = port->active_index;
+  port->active_index = SPA_IDX_INVALID;
+}
+
 static SpaResult
 spa_audiomixer_node_add_port (SpaNode        *node,
                               SpaDirection    direction,
@@ -240,6 +314,11 @@ spa_audiomixer_node_add_port (SpaNode        *node,
 
   this->port_count++;
   spa_list_init (&this->in_ports[port_id].queue);
+  deactivate_port (this, &this->in_ports[port_id]);
+
+  reset_port_props (&this->in_ports[port_id].props);
+  this->in_ports[port_id].gain = this->in_ports[port_id].target = DEFAULT_VOLUME;
+  this->in_ports[port_id].ramp_left = 0;
 
   this->in_ports[port_id].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS |
                                     SPA_PORT_INFO_FLAG_REMOVABLE |
@@ -267,6 +346,8 @@ spa_audiomixer_node_remove_port (SpaNode        *node,
     this->port_queued--;
 
   this->in_ports[port_id].io = NULL;
+  this->in_ports[port_id].have_format = false;
+  deactivate_port (this, &this->in_ports[port_id]);
   this->port_count--;
 
   return SPA_RESULT_OK;
@@ -305,7 +386,10 @@ next:
     case 0:
       spa_pod_builder_format (&b, &f[0], this->type.format,
           this->type.media_type.audio, this->type.media_subtype.raw,
-          PROP      (&f[1], this->type.format_audio.format,   SPA_POD_TYPE_ID,  this->type.audio_format.S16),
+          PROP_U_EN (&f[1], this->type.format_audio.format,   SPA_POD_TYPE_ID,  4, this->type.audio_format.S16,
+                                                                                this->type.audio_format.S16,
+                                                                                this->type.audio_format.S32,
+                                                                                this->type.audio_format.F32),
           PROP_U_MM (&f[1], this->type.format_audio.rate,     SPA_POD_TYPE_INT, 44100, 1, INT32_MAX),
           PROP_U_MM (&f[1], this->type.format_audio.channels, SPA_POD_TYPE_INT, 2,     1, INT32_MAX));
       break;
@@ -335,6 +419,21 @@ clear_buffers (SpaAudioMixer *this, SpaAudioMixerPort *port)
   return SPA_RESULT_OK;
 }
 
+static bool
+other_port_has_format (SpaAudioMixer *this, SpaAudioMixerPort *port)
+{
+  int i;
+
+  if (port != &this->out_ports[0] && this->out_ports[0].have_format)
+    return true;
+
+  for (i = 0; i < MAX_PORTS; i++) {
+    if (&this->in_ports[i] != port && this->in_ports[i].have_format)
+      return true;
+  }
+  return false;
+}
+
 static SpaResult
 spa_audiomixer_node_port_set_format (SpaNode         *node,
                                      SpaDirection     direction,
@@ -367,6 +466,31 @@ spa_audiomixer_node_port_set_format (SpaNode         *node,
     if (!spa_format_audio_raw_parse (format, &info.info.raw, &this->type.format_audio))
       return SPA_RESULT_INVALID_MEDIA_TYPE;
 
+    if (other_port_has_format (this, port) &&
+        info.info.raw.format != this->format.info.raw.format)
+      return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+    if (info.info.raw.format == this->type.audio_format.S16) {
+      this->mix = this->ops.mix_s16;
+      this->mix_gain = this->ops.mix_s16_gain;
+      this->sample_size = sizeof (int16_t);
+    }
+    else if (info.info.raw.format == this->type.audio_format.S32) {
+      this->mix = this->ops.mix_s32;
+      this->mix_gain = this->ops.mix_s32_gain;
+      this->sample_size = sizeof (int32_t);
+    }
+    else if (info.info.raw.format == this->type.audio_format.F32) {
+      this->mix = this->ops.mix_f32;
+      this->mix_gain = this->ops.mix_f32_gain;
+      this->sample_size = sizeof (float);
+    }
+    else
+      return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+    this->frame_size = this->sample_size * info.info.raw.channels;
+    this->ramp_frames = SPA_MAX (1u, info.info.raw.rate * RAMP_MSEC / 1000);
+
     this->format = info;
     port->have_format = true;
   }
@@ -436,7 +560,28 @@ spa_audiomixer_node_port_get_props (SpaNode       *node,
                                     uint32_t       port_id,
                                     SpaProps     **props)
 {
-  return SPA_RESULT_NOT_IMPLEMENTED;
+  SpaAudioMixer *this;
+  SpaAudioMixerPort *port;
+  SpaPODBuilder b = { NULL,  };
+  SpaPODFrame f[2];
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (props != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaAudioMixer, node);
+
+  spa_return_val_if_fail (CHECK_IN_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  port = &this->in_ports[port_id];
+
+  spa_pod_builder_init (&b, this->props_buffer, sizeof (this->props_buffer));
+  spa_pod_builder_props (&b, &f[0], this->type.props,
+      PROP_MM (&f[1], this->type.prop_volume, SPA_POD_TYPE_DOUBLE, port->props.volume, 0.0, 10.0),
+      PROP    (&f[1], this->type.prop_mute,   SPA_POD_TYPE_BOOL,   port->props.mute));
+
+  *props = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaProps);
+
+  return SPA_RESULT_OK;
 }
 
 static SpaResult
@@ -445,7 +590,27 @@ spa_audiomixer_node_port_set_props (SpaNode        *node,
                                     uint32_t        port_id,
                                     const SpaProps *props)
 {
-  return SPA_RESULT_NOT_IMPLEMENTED;
+  SpaAudioMixer *this;
+  SpaAudioMixerPort *port;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaAudioMixer, node);
+
+  spa_return_val_if_fail (CHECK_IN_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  port = &this->in_ports[port_id];
+
+  /* the new gain is picked up and ramped to in the next mix_output */
+  if (props == NULL) {
+    reset_port_props (&port->props);
+  } else {
+    spa_props_query (props,
+        this->type.prop_volume, SPA_POD_TYPE_DOUBLE, &port->props.volume,
+        this->type.prop_mute,   SPA_POD_TYPE_BOOL,   &port->props.mute,
+        0);
+  }
+  return SPA_RESULT_OK;
 }
 
 static SpaResult
@@ -525,6 +690,13 @@ spa_audiomixer_node_port_set_io (SpaNode      *node,
   port = direction == SPA_DIRECTION_INPUT ? &this->in_ports[port_id] : &this->out_ports[port_id];
   port->io = io;
 
+  if (direction == SPA_DIRECTION_INPUT) {
+    if (io)
+      activate_port (this, port);
+    else
+      deactivate_port (this, port);
+  }
+
   return SPA_RESULT_OK;
 }
 
@@ -573,46 +745,75 @@ spa_audiomixer_node_port_send_command (SpaNode        *node,
 }
 
 static inline void
-add_port_data (SpaAudioMixer *this, void *out, size_t outsize, SpaAudioMixerPort *port, int layer)
+advance_port (SpaAudioMixer *this, SpaAudioMixerPort *port, size_t n_bytes)
 {
-  void *in;
-  size_t insize;
   MixerBuffer *b;
-  SpaData *id;
+  size_t insize;
 
   b = spa_list_first (&port->queue, MixerBuffer, link);
+  insize = b->outbuf->datas[0].chunk->size - port->queued_offset;
 
-  id = b->outbuf->datas;
-  in = SPA_MEMBER (id[0].data, port->queued_offset + id[0].chunk->offset, void);
-  insize = id[0].chunk->size - port->queued_offset;
-  outsize = SPA_MIN (outsize, insize);
-
-  {
-    int i, size = outsize / 2;
-    int16_t *op = out, *ip = in;
-
-    if (layer == 0) {
-      memcpy (op, ip, outsize);
-    }
-    else {
-      for (i = 0; i < size; i++)
-        op[i] = SPA_CLAMP (op[i] + ip[i], INT16_MIN, INT16_MAX);
-    }
-  }
-
-  port->queued_offset += outsize;
-  port->queued_bytes -= outsize;
+  port->queued_offset += n_bytes;
+  port->queued_bytes -= n_bytes;
 
-  if (outsize == insize) {
+  if (n_bytes == insize) {
     spa_log_trace (this->log, "audiomixer %p: return buffer %d on port %p %zd",
-              this, b->outbuf->id, port, outsize);
+              this, b->outbuf->id, port, n_bytes);
     port->io->buffer_id = b->outbuf->id;
     spa_list_remove (&b->link);
     b->outstanding = true;
     port->queued_offset = 0;
   } else {
     spa_log_trace (this->log, "audiomixer %p: keeping buffer %d on port %p %zd %zd",
-        this, b->outbuf->id, port, port->queued_bytes, outsize);
+        this, b->outbuf->id, port, port->queued_bytes, n_bytes);
+  }
+}
+
+static inline void
+update_port_gain (SpaAudioMixer *this, SpaAudioMixerPort *port)
+{
+  float target = port->props.mute ? 0.0f : port->props.volume;
+
+  if (target == port->target)
+    return;
+
+  port->target = target;
+  port->ramp_left = this->ramp_frames;
+  port->ramp_step = (target - port->gain) / this->ramp_frames;
+}
+
+static void
+mix_gain (SpaAudioMixer *this, void *dst, const void *src[], SpaAudioMixerPort **ports,
+          uint32_t n_src, uint32_t n_frames)
+{
+  float gain[MAX_PORTS], step[MAX_PORTS];
+  const void *s[MAX_PORTS];
+  uint32_t i, offset, chunk;
+
+  /* split the block where ramps end so that every chunk has a fixed step
+   * per input, this is usually one or two chunks. All channels of a frame
+   * get the same gain. */
+  for (offset = 0; offset < n_frames; offset += chunk) {
+    chunk = n_frames - offset;
+    for (i = 0; i < n_src; i++) {
+      if (ports[i]->ramp_left > 0)
+        chunk = SPA_MIN (chunk, ports[i]->ramp_left);
+    }
+
+    for (i = 0; i < n_src; i++) {
+      SpaAudioMixerPort *port = ports[i];
+
+      s[i] = SPA_MEMBER (src[i], offset * this->frame_size, void);
+      gain[i] = port->gain;
+      step[i] = port->ramp_left > 0 ? port->ramp_step : 0.0f;
+
+      if (port->ramp_left > 0) {
+        port->ramp_left -= chunk;
+        port->gain = port->ramp_left > 0 ? port->gain + port->ramp_step * chunk : port->target;
+      }
+    }
+    this->mix_gain (SPA_MEMBER (dst, offset * this->frame_size, void), s, gain, step,
+                    this->format.info.raw.channels, n_src, chunk * this->format.info.raw.channels);
   }
 }
 
@@ -620,10 +821,15 @@ static SpaResult
 mix_output (SpaAudioMixer *this, size_t n_bytes)
 {
   MixerBuffer *outbuf;
-  int i, layer;
+  uint32_t i;
   SpaAudioMixerPort *outport;
   SpaPortIO *output;
   SpaData *od;
+  SpaAudioMixerPort *ports[MAX_PORTS];
+  SpaAudioMixerPort *mix_ports[MAX_PORTS];
+  const void *src[MAX_PORTS];
+  uint32_t n_ports, n_src;
+  bool unity = true;
 
   outport = &this->out_ports[0];
   output = outport->io;
@@ -637,26 +843,60 @@ mix_output (SpaAudioMixer *this, size_t n_bytes)
 
   od = outbuf->outbuf->datas;
   n_bytes = SPA_MIN (n_bytes, od[0].maxsize);
-  od[0].chunk->offset = 0;
-  od[0].chunk->size = n_bytes;
-  od[0].chunk->stride = 0;
 
-  spa_log_trace (this->log, "audiomixer %p: dequeue output buffer %d %zd",
-                this, outbuf->outbuf->id, n_bytes);
-  for (layer = 0, i = 0; i < MAX_PORTS; i++) {
-    SpaAudioMixerPort *port = &this->in_ports[i];
+  /* collect the data of all inputs, we only mix what all of them have
+   * in their first buffer so that the output is written exactly once.
+   * Muted inputs are consumed but not read. */
+  for (n_ports = 0, n_src = 0, i = 0; i < this->n_active_ports; i++) {
+    SpaAudioMixerPort *port = this->active_ports[i];
+    MixerBuffer *b;
+    SpaData *id;
 
-    if (port->io == NULL || port->n_buffers == 0)
+    if (port->n_buffers == 0)
       continue;
 
     if (spa_list_is_empty (&port->queue)) {
-      spa_log_warn (this->log, "audiomixer %p: underrun stream %d", this, i);
+      spa_log_warn (this->log, "audiomixer %p: underrun stream %d", this, port->id);
       port->queued_bytes = 0;
       port->queued_offset = 0;
       continue;
     }
-    add_port_data (this, od[0].data, n_bytes, port, layer++);
+    b = spa_list_first (&port->queue, MixerBuffer, link);
+    id = b->outbuf->datas;
+
+    ports[n_ports++] = port;
+    n_bytes = SPA_MIN (n_bytes, id[0].chunk->size - port->queued_offset);
+
+    update_port_gain (this, port);
+    if (port->gain == 0.0f && port->ramp_left == 0)
+      continue;
+    if (port->gain != 1.0f || port->ramp_left > 0)
+      unity = false;
+
+    src[n_src] = SPA_MEMBER (id[0].data, port->queued_offset + id[0].chunk->offset, void);
+    mix_ports[n_src++] = port;
   }
+  n_bytes -= n_bytes % this->frame_size;
+
+  od[0].chunk->offset = 0;
+  od[0].chunk->size = n_bytes;
+  od[0].chunk->stride = 0;
+
+  spa_log_trace (this->log, "audiomixer %p: dequeue output buffer %d %zd, %u inputs",
+                this, outbuf->outbuf->id, n_bytes, n_src);
+
+  if (n_src == 0)
+    memset (od[0].data, 0, n_bytes);
+  else if (!unity)
+    mix_gain (this, od[0].data, src, mix_ports, n_src, n_bytes / this->frame_size);
+  else if (n_src == 1)
+    memcpy (od[0].data, src[0], n_bytes);
+  else
+    this->mix (od[0].data, src, n_src, n_bytes / this->sample_size);
+
+  for (i = 0; i < n_ports; i++)
+    advance_port (this, ports[i], n_bytes);
+
   output->buffer_id = outbuf->outbuf->id;
   output->status = SPA_RESULT_HAVE_BUFFER;
 
@@ -683,11 +923,11 @@ spa_audiomixer_node_process_input (SpaNode *node)
   if (output->status == SPA_RESULT_HAVE_BUFFER)
     return SPA_RESULT_HAVE_BUFFER;
 
-  for (i = 0; i < MAX_PORTS; i++) {
-    SpaAudioMixerPort *port = &this->in_ports[i];
-    SpaPortIO *input;
+  for (i = 0; i < this->n_active_ports; i++) {
+    SpaAudioMixerPort *port = this->active_ports[i];
+    SpaPortIO *input = port->io;
 
-    if ((input = port->io) == NULL || port->n_buffers == 0)
+    if (port->n_buffers == 0)
       continue;
 
     if (port->queued_bytes == 0 &&
@@ -709,7 +949,7 @@ spa_audiomixer_node_process_input (SpaNode *node)
       port->queued_bytes += b->outbuf->datas[0].chunk->size;
 
       spa_log_trace (this->log, "audiomixer %p: queue buffer %d on port %d %zd %zd",
-          this, b->outbuf->id, i, port->queued_bytes, min_queued);
+          this, b->outbuf->id, port->id, port->queued_bytes, min_queued);
     }
     if (port->queued_bytes > 0 && port->queued_bytes < min_queued)
       min_queued = port->queued_bytes;
@@ -729,7 +969,7 @@ spa_audiomixer_node_process_output (SpaNode *node)
   SpaAudioMixer *this;
   SpaAudioMixerPort *port;
   SpaPortIO *output;
-  int i;
+  uint32_t i;
   size_t min_queued = SIZE_MAX;
 
   spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
@@ -749,10 +989,10 @@ spa_audiomixer_node_process_output (SpaNode *node)
     output->buffer_id = SPA_ID_INVALID;
   }
   /* produce more output if possible */
-  for (i = 0; i < MAX_PORTS; i++) {
-    SpaAudioMixerPort *port = &this->in_ports[i];
+  for (i = 0; i < this->n_active_ports; i++) {
+    SpaAudioMixerPort *port = this->active_ports[i];
 
-    if (port->io == NULL || port->n_buffers == 0)
+    if (port->n_buffers == 0)
       continue;
 
     if (port->queued_bytes < min_queued)
@@ -763,11 +1003,11 @@ spa_audiomixer_node_process_output (SpaNode *node)
   }
   else {
     /* take requested output range and apply to input */
-    for (i = 0; i < MAX_PORTS; i++) {
-      SpaAudioMixerPort *port = &this->in_ports[i];
-      SpaPortIO *input;
+    for (i = 0; i < this->n_active_ports; i++) {
+      SpaAudioMixerPort *port = this->active_ports[i];
+      SpaPortIO *input = port->io;
 
-      if ((input = port->io) == NULL || port->n_buffers == 0)
+      if (port->n_buffers == 0)
         continue;
 
       if (port->queued_bytes == 0) {
@@ -778,7 +1018,7 @@ spa_audiomixer_node_process_output (SpaNode *node)
         input->status = SPA_RESULT_OK;
       }
       spa_log_trace (this->log, "audiomixer %p: port %d %d queued %zd, res %d", this,
-          i, output->range.min_size, port->queued_bytes, input->status);
+          port->id, output->range.min_size, port->queued_bytes, input->status);
     }
   }
   return output->status;
@@ -866,8 +1106,16 @@ spa_audiomixer_init (const SpaHandleFactory *factory,
   }
   init_type (&this->type, this->map);
 
+  spa_audiomixer_ops_init (&this->ops, spa_cpu_get_info_flags (info));
+  spa_log_info (this->log, "audiomixer %p: using cpu flags 0x%08x", this, this->ops.cpu_flags);
+
   this->node = audiomixer_node;
 
+  for (i = 0; i < MAX_PORTS; i++) {
+    this->in_ports[i].id = i;
+    this->in_ports[i].active_index = SPA_IDX_INVALID;
+  }
+
   this->out_ports[0].io = NULL;
   this->out_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS |
                                   SPA_PORT_INFO_FLAG_NO_REF;
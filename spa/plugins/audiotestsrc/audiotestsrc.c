@@ -32,6 +32,9 @@
 #include <spa/audio/format-utils.h>
 #include <spa/format-builder.h>
 #include <lib/props.h>
+#include <lib/cpu.h>
+
+#include "fill-ops.h"
 
 #define SAMPLES_TO_TIME(this,s)   ((s) * SPA_NSEC_PER_SEC / (this)->current_format.info.raw.rate)
 #define BYTES_TO_SAMPLES(this,b)  ((b)/(this)->bpf)
@@ -46,8 +49,12 @@ typedef struct {
   uint32_t prop_wave;
   uint32_t prop_freq;
   uint32_t prop_volume;
+  uint32_t prop_burst;
   uint32_t wave_sine;
   uint32_t wave_square;
+  uint32_t wave_noise;
+  uint32_t wave_impulse;
+  uint32_t wave_sweep;
   SpaTypeMeta meta;
   SpaTypeData data;
   SpaTypeMediaType media_type;
@@ -71,8 +78,12 @@ init_type (Type *type, SpaTypeMap *map)
   type->prop_wave = spa_type_map_get_id (map, SPA_TYPE_PROPS__waveType);
   type->prop_freq = spa_type_map_get_id (map, SPA_TYPE_PROPS__frequency);
   type->prop_volume = spa_type_map_get_id (map, SPA_TYPE_PROPS__volume);
+  type->prop_burst = spa_type_map_get_id (map, SPA_TYPE_PROPS__burst);
   type->wave_sine = spa_type_map_get_id (map, SPA_TYPE_PROPS__waveType ":sine");
   type->wave_square = spa_type_map_get_id (map, SPA_TYPE_PROPS__waveType ":square");
+  type->wave_noise = spa_type_map_get_id (map, SPA_TYPE_PROPS__waveType ":noise");
+  type->wave_impulse = spa_type_map_get_id (map, SPA_TYPE_PROPS__waveType ":impulse");
+  type->wave_sweep = spa_type_map_get_id (map, SPA_TYPE_PROPS__waveType ":sweep");
   spa_type_meta_map (map, &type->meta);
   spa_type_data_map (map, &type->data);
   spa_type_media_type_map (map, &type->media_type);
@@ -92,9 +103,11 @@ typedef struct {
   uint32_t wave;
   double freq;
   double volume;
+  uint32_t burst;
 } SpaAudioTestSrcProps;
 
 #define MAX_BUFFERS 16
+#define WAVE_BLOCK  256
 
 typedef struct _ATSBuffer ATSBuffer;
 
@@ -106,8 +119,6 @@ struct _ATSBuffer {
   SpaList link;
 };
 
-typedef SpaResult (*RenderFunc) (SpaAudioTestSrc *this, void *samples, size_t n_samples);
-
 struct _SpaAudioTestSrc {
   SpaHandle handle;
   SpaNode node;
@@ -136,8 +147,15 @@ struct _SpaAudioTestSrc {
   SpaAudioInfo current_format;
   uint8_t format_buffer[1024];
   size_t bpf;
-  RenderFunc render_func;
-  double accumulator;
+
+  SpaAudioTestSrcOps ops;
+  SpaAudioTestSrcFillFunc fill_func;
+  double osc_re, osc_im;
+  double rot_re, rot_im;
+  uint32_t sweep_pos;
+  uint32_t phase;
+  uint32_t seed;
+  float wave[WAVE_BLOCK];
 
   ATSBuffer buffers[MAX_BUFFERS];
   uint32_t  n_buffers;
@@ -156,6 +174,7 @@ struct _SpaAudioTestSrc {
 #define DEFAULT_WAVE wave_sine
 #define DEFAULT_FREQ 440.0
 #define DEFAULT_VOLUME 1.0
+#define DEFAULT_BURST 0
 
 static void
 reset_audiotestsrc_props (SpaAudioTestSrc *this, SpaAudioTestSrcProps *props)
@@ -164,6 +183,7 @@ reset_audiotestsrc_props (SpaAudioTestSrc *this, SpaAudioTestSrcProps *props)
   props->wave = this->type. DEFAULT_WAVE;
   props->freq = DEFAULT_FREQ;
   props->volume = DEFAULT_VOLUME;
+  props->burst = DEFAULT_BURST;
 }
 
 #define PROP(f,key,type,...)                                                    \
@@ -195,13 +215,18 @@ spa_audiotestsrc_node_get_props (SpaNode       *node,
   spa_pod_builder_init (&b, this->props_buffer, sizeof (this->props_buffer));
   spa_pod_builder_props (&b, &f[0], this->type.props,
     PROP    (&f[1], this->type.prop_live,   SPA_POD_TYPE_BOOL,   this->props.live),
-    PROP_EN (&f[1], this->type.prop_wave,   SPA_POD_TYPE_ID,  3, this->props.wave,
+    PROP_EN (&f[1], this->type.prop_wave,   SPA_POD_TYPE_ID,  6, this->props.wave,
                                                                 this->type.wave_sine,
-                                                                this->type.wave_square),
+                                                                this->type.wave_square,
+                                                                this->type.wave_noise,
+                                                                this->type.wave_impulse,
+                                                                this->type.wave_sweep),
     PROP_MM (&f[1], this->type.prop_freq,   SPA_POD_TYPE_DOUBLE, this->props.freq,
                                                             0.0, 50000000.0),
     PROP_MM (&f[1], this->type.prop_volume, SPA_POD_TYPE_DOUBLE, this->props.volume,
-                                                            0.0, 10.0));
+                                                            0.0, 10.0),
+    PROP_MM (&f[1], this->type.prop_burst,  SPA_POD_TYPE_INT,    this->props.burst,
+                                                            0, MAX_BUFFERS));
 
   *props = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaProps);
 
@@ -226,6 +251,7 @@ spa_audiotestsrc_node_set_props (SpaNode         *node,
         this->type.prop_wave,   SPA_POD_TYPE_ID,     &this->props.wave,
         this->type.prop_freq,   SPA_POD_TYPE_DOUBLE, &this->props.freq,
         this->type.prop_volume, SPA_POD_TYPE_DOUBLE, &this->props.volume,
+        this->type.prop_burst,  SPA_POD_TYPE_INT,    &this->props.burst,
         0);
   }
 
@@ -286,8 +312,6 @@ audiotestsrc_make_buffer (SpaAudioTestSrc *this)
   SpaPortIO *io = this->io;
   int n_bytes, n_samples;
 
-  read_timer (this);
-
   if (spa_list_is_empty (&this->empty)) {
     set_timer (this, false);
     return SPA_RESULT_OUT_OF_BUFFERS;
@@ -320,15 +344,15 @@ audiotestsrc_make_buffer (SpaAudioTestSrc *this)
 
     if (offset + n_bytes > b->rb->ringbuffer.size) {
       uint32_t l0 = b->rb->ringbuffer.size - offset;
-      this->render_func (this, SPA_MEMBER (b->outbuf->datas[0].data, offset, void), l0 / this->bpf);
-      this->render_func (this, b->outbuf->datas[0].data, (n_bytes - l0) / this->bpf);
+      audio_test_src_render (this, SPA_MEMBER (b->outbuf->datas[0].data, offset, void), l0 / this->bpf);
+      audio_test_src_render (this, b->outbuf->datas[0].data, (n_bytes - l0) / this->bpf);
     } else {
-      this->render_func (this, SPA_MEMBER (b->outbuf->datas[0].data, offset, void), n_samples);
+      audio_test_src_render (this, SPA_MEMBER (b->outbuf->datas[0].data, offset, void), n_samples);
     }
     spa_ringbuffer_write_update (&b->rb->ringbuffer, index + n_bytes);
   } else {
     n_samples = n_bytes / this->bpf;
-    this->render_func (this, b->outbuf->datas[0].data, n_samples);
+    audio_test_src_render (this, b->outbuf->datas[0].data, n_samples);
     b->outbuf->datas[0].chunk->size = n_bytes;
     b->outbuf->datas[0].chunk->offset = 0;
     b->outbuf->datas[0].chunk->stride = 0;
@@ -354,12 +378,21 @@ static void
 audiotestsrc_on_output (SpaSource *source)
 {
   SpaAudioTestSrc *this = source->data;
-  SpaResult res;
+  uint32_t i, n_buffers = SPA_MAX (this->props.burst, 1);
 
-  res = audiotestsrc_make_buffer (this);
+  read_timer (this);
+
+  /* in burst mode, push buffers back to back for as long as the graph
+   * takes them */
+  for (i = 0; i < n_buffers; i++) {
+    if (i > 0 && this->io->status == SPA_RESULT_HAVE_BUFFER)
+      break;
+
+    if (audiotestsrc_make_buffer (this) != SPA_RESULT_HAVE_BUFFER)
+      break;
 
-  if (res == SPA_RESULT_HAVE_BUFFER)
     send_have_output (this);
+  }
 }
 
 static SpaResult
@@ -581,6 +614,8 @@ spa_audiotestsrc_node_port_set_format (SpaNode         *node,
                           SPA_FORMAT_MEDIA_SUBTYPE (format), };
     int idx;
     int sizes[4] = { 2, 4, 4, 8 };
+    SpaAudioTestSrcFillFunc fill_funcs[4] = { this->ops.fill_s16, this->ops.fill_s32,
+                                              this->ops.fill_f32, this->ops.fill_f64 };
 
     if (info.media_type != this->type.media_type.audio ||
         info.media_subtype != this->type.media_subtype.raw)
@@ -603,7 +638,8 @@ spa_audiotestsrc_node_port_set_format (SpaNode         *node,
     this->bpf = sizes[idx] * info.info.raw.channels;
     this->current_format = info;
     this->have_format = true;
-    this->render_func =  sine_funcs[idx];
+    this->fill_func = fill_funcs[idx];
+    audio_test_src_reset_wave (this);
   }
 
   if (this->have_format) {
@@ -861,8 +897,10 @@ spa_audiotestsrc_node_process_output (SpaNode *node)
     this->io->buffer_id = SPA_ID_INVALID;
   }
 
-  if (!this->callbacks.have_output && (io->status == SPA_RESULT_NEED_BUFFER))
+  if (!this->callbacks.have_output && (io->status == SPA_RESULT_NEED_BUFFER)) {
+    read_timer (this);
     return audiotestsrc_make_buffer (this);
+  }
   else
     return SPA_RESULT_OK;
 }
@@ -1015,6 +1053,9 @@ audiotestsrc_init (const SpaHandleFactory  *factory,
   this->clock = audiotestsrc_clock;
   reset_audiotestsrc_props (this, &this->props);
 
+  spa_audiotestsrc_ops_init (&this->ops, spa_cpu_get_info_flags (info));
+  audio_test_src_reset_wave (this);
+
   spa_list_init (&this->empty);
 
   this->timer_source.func = audiotestsrc_on_output;
@@ -1035,7 +1076,8 @@ audiotestsrc_init (const SpaHandleFactory  *factory,
   if (this->props.live)
     this->info.flags |= SPA_PORT_INFO_FLAG_LIVE;
 
-  spa_log_info (this->log, "audiotestsrc %p: initialized", this);
+  spa_log_info (this->log, "audiotestsrc %p: initialized, using cpu flags 0x%08x", this,
+      this->ops.cpu_flags);
 
   return SPA_RESULT_OK;
 }
@@ -0,0 +1,77 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <emmintrin.h>
+
+#include "fill-ops.h"
+
+/* mono and stereo are vectorized, more channels use the C version */
+
+void
+spa_audiotestsrc_fill_s16_sse2 (void *dst, const float *src, float amp,
+                                uint32_t n_channels, uint32_t n_frames)
+{
+  int16_t *d = dst;
+  uint32_t i = 0, unrolled = n_frames & ~7;
+  const __m128 scale = _mm_set1_ps (amp * 32767.0f);
+  const __m128 min = _mm_set1_ps (INT16_MIN), max = _mm_set1_ps (INT16_MAX);
+
+  if (n_channels <= 2) {
+    for (; i < unrolled; i += 8) {
+      __m128 in0 = _mm_mul_ps (_mm_loadu_ps (&src[i]), scale);
+      __m128 in1 = _mm_mul_ps (_mm_loadu_ps (&src[i + 4]), scale);
+      __m128i out;
+
+      in0 = _mm_min_ps (_mm_max_ps (in0, min), max);
+      in1 = _mm_min_ps (_mm_max_ps (in1, min), max);
+      out = _mm_packs_epi32 (_mm_cvtps_epi32 (in0), _mm_cvtps_epi32 (in1));
+
+      if (n_channels == 1) {
+        _mm_storeu_si128 ((__m128i *) &d[i], out);
+      } else {
+        _mm_storeu_si128 ((__m128i *) &d[2 * i], _mm_unpacklo_epi16 (out, out));
+        _mm_storeu_si128 ((__m128i *) &d[2 * i + 8], _mm_unpackhi_epi16 (out, out));
+      }
+    }
+  }
+  spa_audiotestsrc_fill_s16_range (d, src, amp, n_channels, i, n_frames);
+}
+
+void
+spa_audiotestsrc_fill_f32_sse2 (void *dst, const float *src, float amp,
+                                uint32_t n_channels, uint32_t n_frames)
+{
+  float *d = dst;
+  uint32_t i = 0, unrolled = n_frames & ~3;
+  const __m128 scale = _mm_set1_ps (amp);
+
+  if (n_channels <= 2) {
+    for (; i < unrolled; i += 4) {
+      __m128 in = _mm_mul_ps (_mm_loadu_ps (&src[i]), scale);
+
+      if (n_channels == 1) {
+        _mm_storeu_ps (&d[i], in);
+      } else {
+        _mm_storeu_ps (&d[2 * i], _mm_unpacklo_ps (in, in));
+        _mm_storeu_ps (&d[2 * i + 4], _mm_unpackhi_ps (in, in));
+      }
+    }
+  }
+  spa_audiotestsrc_fill_f32_range (d, src, amp, n_channels, i, n_frames);
+}
@@ -0,0 +1,84 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <lib/cpu.h>
+
+#include "fill-ops.h"
+
+void
+spa_audiotestsrc_fill_s16_c (void *dst, const float *src, float amp,
+                             uint32_t n_channels, uint32_t n_frames)
+{
+  spa_audiotestsrc_fill_s16_range (dst, src, amp, n_channels, 0, n_frames);
+}
+
+void
+spa_audiotestsrc_fill_s32_c (void *dst, const float *src, float amp,
+                             uint32_t n_channels, uint32_t n_frames)
+{
+  int32_t *d = dst;
+  uint32_t i, c;
+
+  /* float does not have enough precision for S32 */
+  for (i = 0; i < n_frames; i++) {
+    double t = src[i] * (double) amp * 2147483647.0;
+    int32_t v = llrint (SPA_CLAMP (t, (double) INT32_MIN, (double) INT32_MAX));
+    for (c = 0; c < n_channels; c++)
+      *d++ = v;
+  }
+}
+
+void
+spa_audiotestsrc_fill_f32_c (void *dst, const float *src, float amp,
+                             uint32_t n_channels, uint32_t n_frames)
+{
+  spa_audiotestsrc_fill_f32_range (dst, src, amp, n_channels, 0, n_frames);
+}
+
+void
+spa_audiotestsrc_fill_f64_c (void *dst, const float *src, float amp,
+                             uint32_t n_channels, uint32_t n_frames)
+{
+  double *d = dst;
+  uint32_t i, c;
+
+  for (i = 0; i < n_frames; i++) {
+    double v = src[i] * (double) amp;
+    for (c = 0; c < n_channels; c++)
+      *d++ = v;
+  }
+}
+
+void
+spa_audiotestsrc_ops_init (SpaAudioTestSrcOps *ops, uint32_t cpu_flags)
+{
+  ops->cpu_flags = 0;
+  ops->fill_s16 = spa_audiotestsrc_fill_s16_c;
+  ops->fill_s32 = spa_audiotestsrc_fill_s32_c;
+  ops->fill_f32 = spa_audiotestsrc_fill_f32_c;
+  ops->fill_f64 = spa_audiotestsrc_fill_f64_c;
+
+#if defined (HAVE_SSE2)
+  if (cpu_flags & SPA_CPU_FLAG_SSE2) {
+    ops->cpu_flags = SPA_CPU_FLAG_SSE2;
+    ops->fill_s16 = spa_audiotestsrc_fill_s16_sse2;
+    ops->fill_f32 = spa_audiotestsrc_fill_f32_sse2;
+  }
+#endif
+}
@@ -0,0 +1,104 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_AUDIOTESTSRC_FILL_OPS_H__
+#define __SPA_AUDIOTESTSRC_FILL_OPS_H__
+
+#include <math.h>
+
+#include <spa/defs.h>
+
+/**
+ * SpaAudioTestSrcFillFunc:
+ * @dst: interleaved destination samples
+ * @src: one channel of samples between -1.0 and 1.0
+ * @amp: the amplitude to scale @src with, 1.0 is full scale
+ * @n_channels: number of channels in @dst
+ * @n_frames: number of frames
+ *
+ * Scale @src, convert it to the sample format and copy it to all
+ * channels of @dst. Integer formats are clipped.
+ */
+typedef void (*SpaAudioTestSrcFillFunc) (void *dst, const float *src, float amp,
+                                         uint32_t n_channels, uint32_t n_frames);
+
+/**
+ * SpaAudioTestSrcOps:
+ * @cpu_flags: the #SpaCPUFlags the functions were selected for
+ *
+ * The fill kernels for each format, selected once for the CPU we run on.
+ */
+typedef struct {
+  uint32_t                cpu_flags;
+  SpaAudioTestSrcFillFunc fill_s16;
+  SpaAudioTestSrcFillFunc fill_s32;
+  SpaAudioTestSrcFillFunc fill_f32;
+  SpaAudioTestSrcFillFunc fill_f64;
+} SpaAudioTestSrcOps;
+
+void spa_audiotestsrc_ops_init (SpaAudioTestSrcOps *ops, uint32_t cpu_flags);
+
+/* plain C versions, also used by the SIMD kernels for the remaining
+ * frames from @start to @end */
+static inline void
+spa_audiotestsrc_fill_s16_range (int16_t *d, const float *s, float amp,
+                                 uint32_t n_channels, uint32_t start, uint32_t end)
+{
+  uint32_t i, c;
+  float scale = amp * 32767.0f;
+
+  d += start * n_channels;
+  for (i = start; i < end; i++) {
+    float t = s[i] * scale;
+    int16_t v = lrintf (SPA_CLAMP (t, (float) INT16_MIN, (float) INT16_MAX));
+    for (c = 0; c < n_channels; c++)
+      *d++ = v;
+  }
+}
+
+static inline void
+spa_audiotestsrc_fill_f32_range (float *d, const float *s, float amp,
+                                 uint32_t n_channels, uint32_t start, uint32_t end)
+{
+  uint32_t i, c;
+
+  d += start * n_channels;
+  for (i = start; i < end; i++) {
+    float v = s[i] * amp;
+    for (c = 0; c < n_channels; c++)
+      *d++ = v;
+  }
+}
+
+void spa_audiotestsrc_fill_s16_c    (void *dst, const float *src, float amp,
+                                     uint32_t n_channels, uint32_t n_frames);
+void spa_audiotestsrc_fill_s32_c    (void *dst, const float *src, float amp,
+                                     uint32_t n_channels, uint32_t n_frames);
+void spa_audiotestsrc_fill_f32_c    (void *dst, const float *src, float amp,
+                                     uint32_t n_channels, uint32_t n_frames);
+void spa_audiotestsrc_fill_f64_c    (void *dst, const float *src, float amp,
+                                     uint32_t n_channels, uint32_t n_frames);
+#if defined (HAVE_SSE2)
+void spa_audiotestsrc_fill_s16_sse2 (void *dst, const float *src, float amp,
+                                     uint32_t n_channels, uint32_t n_frames);
+void spa_audiotestsrc_fill_f32_sse2 (void *dst, const float *src, float amp,
+                                     uint32_t n_channels, uint32_t n_frames);
+#endif
+
+#endif /* __SPA_AUDIOTESTSRC_FILL_OPS_H__ */
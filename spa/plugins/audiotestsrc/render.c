@@ -21,36 +21,195 @@
 
 #define M_PI_M2 ( M_PI + M_PI )
 
-typedef SpaResult (*RenderFunc) (SpaAudioTestSrc *this, void *samples, size_t n_samples);
-
-#define DEFINE_SINE(type,scale)                                                 \
-static void                                                                     \
-audio_test_src_create_sine_##type (SpaAudioTestSrc *this, type * samples, size_t n_samples) \
-{                                                                               \
-  int i, c, channels;                                                           \
-  double step, amp;                                                             \
-                                                                                \
-  channels = this->current_format.info.raw.channels;                            \
-  step = M_PI_M2 * this->props.freq / this->current_format.info.raw.rate;       \
-  amp = this->props.volume * scale;                                             \
-                                                                                \
-  for (i = 0; i < n_samples; i++) {                                             \
-    this->accumulator += step;                                                  \
-    if (this->accumulator >= M_PI_M2)                                           \
-      this->accumulator -= M_PI_M2;                                             \
-    for (c = 0; c < channels; ++c)                                              \
-      *samples++ = (type) (sin (this->accumulator) * amp);                      \
-  }                                                                             \
-}
-
-DEFINE_SINE (int16_t, 32767.0);
-DEFINE_SINE (int32_t, 2147483647.0);
-DEFINE_SINE (float, 1.0);
-DEFINE_SINE (double, 1.0);
-
-static const RenderFunc sine_funcs[] = {
-  (RenderFunc) audio_test_src_create_sine_int16_t,
-  (RenderFunc) audio_test_src_create_sine_int32_t,
-  (RenderFunc) audio_test_src_create_sine_float,
-  (RenderFunc) audio_test_src_create_sine_double
-};
+/* The waves are made one block of one channel at a time in this->wave,
+ * the fill function of the format then scales and copies the block to
+ * all channels.
+ *
+ * Sine and sweep use a phasor that is rotated by the angle of one sample
+ * for each sample, which avoids a call to sin() per frame. The phasor is
+ * normalized again after each block so that rounding errors do not make
+ * the amplitude drift. The sweep also rotates the rotation itself, which
+ * makes the frequency go up linearly. */
+
+typedef void (*WaveFunc) (SpaAudioTestSrc *this, float *out, uint32_t n_frames);
+
+static inline void
+normalize (double *re, double *im)
+{
+  double mag = sqrt (*re * *re + *im * *im);
+
+  if (mag > 0.0) {
+    *re /= mag;
+    *im /= mag;
+  } else {
+    *re = 1.0;
+    *im = 0.0;
+  }
+}
+
+/* the phase increment per sample for square and impulse, a full period
+ * is 2^32 */
+static inline uint32_t
+phase_step (SpaAudioTestSrc *this)
+{
+  double f = this->props.freq / this->current_format.info.raw.rate;
+
+  return (uint32_t) (int64_t) ((f - floor (f)) * 4294967296.0);
+}
+
+static void
+wave_sine (SpaAudioTestSrc *this, float *out, uint32_t n_frames)
+{
+  double step = M_PI_M2 * this->props.freq / this->current_format.info.raw.rate;
+  double c = cos (step), s = sin (step);
+  double c4 = cos (4 * step), s4 = sin (4 * step);
+  double re[4], im[4], t;
+  uint32_t i, k;
+
+  /* four phasors, one sample apart, that each advance four samples at a
+   * time so that they do not wait for each other */
+  re[0] = this->osc_re;
+  im[0] = this->osc_im;
+  for (k = 1; k < 4; k++) {
+    re[k] = re[k - 1] * c - im[k - 1] * s;
+    im[k] = re[k - 1] * s + im[k - 1] * c;
+  }
+  for (i = 0; i + 4 <= n_frames; i += 4) {
+    for (k = 0; k < 4; k++) {
+      out[i + k] = im[k];
+      t = re[k] * c4 - im[k] * s4;
+      im[k] = re[k] * s4 + im[k] * c4;
+      re[k] = t;
+    }
+  }
+  for (; i < n_frames; i++) {
+    out[i] = im[0];
+    t = re[0] * c - im[0] * s;
+    im[0] = re[0] * s + im[0] * c;
+    re[0] = t;
+  }
+  normalize (&re[0], &im[0]);
+  this->osc_re = re[0];
+  this->osc_im = im[0];
+}
+
+static void
+wave_square (SpaAudioTestSrc *this, float *out, uint32_t n_frames)
+{
+  uint32_t i, phase = this->phase, step = phase_step (this);
+
+  for (i = 0; i < n_frames; i++) {
+    out[i] = phase < 0x80000000u ? 1.0f : -1.0f;
+    phase += step;
+  }
+  this->phase = phase;
+}
+
+/* uniform white noise from a xorshift generator */
+static void
+wave_noise (SpaAudioTestSrc *this, float *out, uint32_t n_frames)
+{
+  uint32_t i, x = this->seed;
+
+  for (i = 0; i < n_frames; i++) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    out[i] = (int32_t) x * (1.0f / 2147483648.0f);
+  }
+  this->seed = x;
+}
+
+/* one full scale sample at the start of each period */
+static void
+wave_impulse (SpaAudioTestSrc *this, float *out, uint32_t n_frames)
+{
+  uint32_t i, phase = this->phase, step = phase_step (this);
+
+  for (i = 0; i < n_frames; i++) {
+    uint32_t next = phase + step;
+    out[i] = next < phase ? 1.0f : 0.0f;
+    phase = next;
+  }
+  this->phase = phase;
+}
+
+/* a sine going from 0 Hz to the frequency in one second, then starting
+ * over */
+static void
+wave_sweep (SpaAudioTestSrc *this, float *out, uint32_t n_frames)
+{
+  uint32_t i, rate = this->current_format.info.raw.rate;
+  double step = M_PI_M2 * this->props.freq / rate / rate;
+  double c = cos (step), s = sin (step);
+  double re = this->osc_re, im = this->osc_im;
+  double rre = this->rot_re, rim = this->rot_im, t;
+
+  for (i = 0; i < n_frames; i++) {
+    out[i] = im;
+    t = re * rre - im * rim;
+    im = re * rim + im * rre;
+    re = t;
+    if (++this->sweep_pos >= rate) {
+      this->sweep_pos = 0;
+      rre = 1.0;
+      rim = 0.0;
+    } else {
+      t = rre * c - rim * s;
+      rim = rre * s + rim * c;
+      rre = t;
+    }
+  }
+  normalize (&re, &im);
+  normalize (&rre, &rim);
+  this->osc_re = re;
+  this->osc_im = im;
+  this->rot_re = rre;
+  this->rot_im = rim;
+}
+
+static WaveFunc
+get_wave_func (SpaAudioTestSrc *this)
+{
+  uint32_t wave = this->props.wave;
+
+  if (wave == this->type.wave_square)
+    return wave_square;
+  else if (wave == this->type.wave_noise)
+    return wave_noise;
+  else if (wave == this->type.wave_impulse)
+    return wave_impulse;
+  else if (wave == this->type.wave_sweep)
+    return wave_sweep;
+  else
+    return wave_sine;
+}
+
+static void
+audio_test_src_render (SpaAudioTestSrc *this, void *samples, size_t n_samples)
+{
+  WaveFunc wave = get_wave_func (this);
+  uint32_t channels = this->current_format.info.raw.channels;
+
+  while (n_samples > 0) {
+    uint32_t n_frames = SPA_MIN (n_samples, WAVE_BLOCK);
+
+    wave (this, this->wave, n_frames);
+    this->fill_func (samples, this->wave, this->props.volume, channels, n_frames);
+
+    samples = SPA_MEMBER (samples, n_frames * this->bpf, void);
+    n_samples -= n_frames;
+  }
+}
+
+static void
+audio_test_src_reset_wave (SpaAudioTestSrc *this)
+{
+  this->osc_re = 1.0;
+  this->osc_im = 0.0;
+  this->rot_re = 1.0;
+  this->rot_im = 0.0;
+  this->sweep_pos = 0;
+  this->phase = 0;
+  this->seed = 0x9e3779b9;
+}
@@ -0,0 +1,50 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <immintrin.h>
+
+#include "channelmix-ops.h"
+
+/* like the SSE2 version, a whole output frame fits in one register */
+void
+spa_channelmix_matrix_avx2 (const SpaChannelMixMatrix *mix, float *dst,
+                            const float *src, uint32_t n_frames)
+{
+  uint32_t f, j, n_dst = mix->n_dst, n_src = mix->n_src, extra, unrolled;
+
+  if (n_dst > SPA_CHANNELMIX_MAX_VECTOR) {
+    spa_channelmix_matrix_range (mix, dst, src, 0, n_frames);
+    return;
+  }
+
+  extra = (8 - 1) / n_dst;
+  unrolled = n_frames > extra ? n_frames - extra : 0;
+
+  for (f = 0; f < unrolled; f++) {
+    const float *s = &src[f * n_src];
+    __m256 acc = _mm256_setzero_ps ();
+
+    for (j = 0; j < n_src; j++)
+      acc = _mm256_add_ps (acc, _mm256_mul_ps (_mm256_broadcast_ss (&s[j]),
+                                               _mm256_loadu_ps (mix->columns[j])));
+
+    _mm256_storeu_ps (&dst[f * n_dst], acc);
+  }
+  spa_channelmix_matrix_range (mix, dst, src, unrolled, n_frames);
+}
@@ -0,0 +1,66 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <arm_neon.h>
+
+#include "channelmix-ops.h"
+
+/* like the SSE2 version, for up to 8 output channels in two registers */
+void
+spa_channelmix_matrix_neon (const SpaChannelMixMatrix *mix, float *dst,
+                            const float *src, uint32_t n_frames)
+{
+  uint32_t f, j, n_dst = mix->n_dst, n_src = mix->n_src, width, extra, unrolled;
+
+  if (n_dst > SPA_CHANNELMIX_MAX_VECTOR) {
+    spa_channelmix_matrix_range (mix, dst, src, 0, n_frames);
+    return;
+  }
+
+  width = n_dst > 4 ? 8 : 4;
+  extra = (width - 1) / n_dst;
+  unrolled = n_frames > extra ? n_frames - extra : 0;
+
+  if (n_dst > 4) {
+    for (f = 0; f < unrolled; f++) {
+      const float *s = &src[f * n_src];
+      float32x4_t acc0 = vdupq_n_f32 (0.0f), acc1 = vdupq_n_f32 (0.0f);
+
+      for (j = 0; j < n_src; j++) {
+        float32x4_t in = vdupq_n_f32 (s[j]);
+
+        acc0 = vaddq_f32 (acc0, vmulq_f32 (in, vld1q_f32 (&mix->columns[j][0])));
+        acc1 = vaddq_f32 (acc1, vmulq_f32 (in, vld1q_f32 (&mix->columns[j][4])));
+      }
+      vst1q_f32 (&dst[f * n_dst], acc0);
+      vst1q_f32 (&dst[f * n_dst + 4], acc1);
+    }
+  } else {
+    for (f = 0; f < unrolled; f++) {
+      const float *s = &src[f * n_src];
+      float32x4_t acc = vdupq_n_f32 (0.0f);
+
+      for (j = 0; j < n_src; j++)
+        acc = vaddq_f32 (acc, vmulq_f32 (vdupq_n_f32 (s[j]), vld1q_f32 (mix->columns[j])));
+
+      vst1q_f32 (&dst[f * n_dst], acc);
+    }
+  }
+  spa_channelmix_matrix_range (mix, dst, src, unrolled, n_frames);
+}
@@ -0,0 +1,69 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <emmintrin.h>
+
+#include "channelmix-ops.h"
+
+/* every output frame is the sum of the input samples times the gains of
+ * their column. The vectors are stored whole, the lanes past the frame are
+ * overwritten by the next frame. */
+void
+spa_channelmix_matrix_sse2 (const SpaChannelMixMatrix *mix, float *dst,
+                            const float *src, uint32_t n_frames)
+{
+  uint32_t f, j, n_dst = mix->n_dst, n_src = mix->n_src, width, extra, unrolled;
+
+  if (n_dst > SPA_CHANNELMIX_MAX_VECTOR) {
+    spa_channelmix_matrix_range (mix, dst, src, 0, n_frames);
+    return;
+  }
+
+  width = n_dst > 4 ? 8 : 4;
+  /* the frames that the stores of one frame reach into */
+  extra = (width - 1) / n_dst;
+  unrolled = n_frames > extra ? n_frames - extra : 0;
+
+  if (n_dst > 4) {
+    for (f = 0; f < unrolled; f++) {
+      const float *s = &src[f * n_src];
+      __m128 acc0 = _mm_setzero_ps (), acc1 = _mm_setzero_ps ();
+
+      for (j = 0; j < n_src; j++) {
+        __m128 in = _mm_set1_ps (s[j]);
+
+        acc0 = _mm_add_ps (acc0, _mm_mul_ps (in, _mm_loadu_ps (&mix->columns[j][0])));
+        acc1 = _mm_add_ps (acc1, _mm_mul_ps (in, _mm_loadu_ps (&mix->columns[j][4])));
+      }
+      _mm_storeu_ps (&dst[f * n_dst], acc0);
+      _mm_storeu_ps (&dst[f * n_dst + 4], acc1);
+    }
+  } else {
+    for (f = 0; f < unrolled; f++) {
+      const float *s = &src[f * n_src];
+      __m128 acc = _mm_setzero_ps ();
+
+      for (j = 0; j < n_src; j++)
+        acc = _mm_add_ps (acc, _mm_mul_ps (_mm_set1_ps (s[j]), _mm_loadu_ps (mix->columns[j])));
+
+      _mm_storeu_ps (&dst[f * n_dst], acc);
+    }
+  }
+  spa_channelmix_matrix_range (mix, dst, src, unrolled, n_frames);
+}
@@ -0,0 +1,307 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include <spa/defs.h>
+#include <spa/audio/raw.h>
+#include <lib/cpu.h>
+
+#include "channelmix-ops.h"
+
+#define FL   SPA_AUDIO_CHANNEL_FL
+#define FR   SPA_AUDIO_CHANNEL_FR
+#define FC   SPA_AUDIO_CHANNEL_FC
+#define LFE  SPA_AUDIO_CHANNEL_LFE
+#define RL   SPA_AUDIO_CHANNEL_RL
+#define RR   SPA_AUDIO_CHANNEL_RR
+#define FLC  SPA_AUDIO_CHANNEL_FLC
+#define FRC  SPA_AUDIO_CHANNEL_FRC
+#define RC   SPA_AUDIO_CHANNEL_RC
+#define SL   SPA_AUDIO_CHANNEL_SL
+#define SR   SPA_AUDIO_CHANNEL_SR
+
+/* -3dB */
+#define M3DB  0.7071067811865476f
+
+/**
+ * spa_channelmix_default_mask:
+ * @channels: a number of channels
+ *
+ * Returns: the usual channel mask for @channels or 0 when there is none
+ */
+uint32_t
+spa_channelmix_default_mask (uint32_t channels)
+{
+  switch (channels) {
+    case 1:
+      return FC;
+    case 2:
+      return FL | FR;
+    case 3:
+      return FL | FR | FC;
+    case 4:
+      return FL | FR | RL | RR;
+    case 5:
+      return FL | FR | FC | RL | RR;
+    case 6:
+      return FL | FR | FC | LFE | RL | RR;
+    case 7:
+      return FL | FR | FC | LFE | RL | RR | RC;
+    case 8:
+      return FL | FR | FC | LFE | RL | RR | SL | SR;
+  }
+  return 0;
+}
+
+/* where to put a channel that the output does not have. The first
+ * alternative of which all positions exist in the output is used. */
+typedef struct {
+  uint32_t position;
+  struct {
+    uint32_t target[2];
+    float    gain;
+  } alt[4];
+} FoldRule;
+
+static const FoldRule fold_rules[] = {
+  { FL,  { { { FC,  0 },  M3DB }, } },
+  { FR,  { { { FC,  0 },  M3DB }, } },
+  { FC,  { { { FL,  FR }, M3DB }, } },
+  { RL,  { { { SL,  0 },  1.0f }, { { FL,  0 },  M3DB }, { { FC, 0 }, M3DB }, } },
+  { RR,  { { { SR,  0 },  1.0f }, { { FR,  0 },  M3DB }, { { FC, 0 }, M3DB }, } },
+  { SL,  { { { RL,  0 },  1.0f }, { { FL,  0 },  M3DB }, { { FC, 0 }, M3DB }, } },
+  { SR,  { { { RR,  0 },  1.0f }, { { FR,  0 },  M3DB }, { { FC, 0 }, M3DB }, } },
+  { RC,  { { { RL,  RR }, M3DB }, { { SL,  SR }, M3DB }, { { FL, FR }, 0.5f }, { { FC, 0 }, M3DB } } },
+  { FLC, { { { FL,  0 },  1.0f }, { { FC,  0 },  M3DB }, } },
+  { FRC, { { { FR,  0 },  1.0f }, { { FC,  0 },  M3DB }, } },
+};
+
+static inline uint32_t
+channel_index (uint32_t mask, uint32_t position)
+{
+  return __builtin_popcount (mask & (position - 1));
+}
+
+static void
+fold_channel (SpaChannelMixMatrix *mix, uint32_t dst_mask, uint32_t src_mask, uint32_t position)
+{
+  uint32_t i, j, k, s = channel_index (src_mask, position);
+
+  for (i = 0; i < SPA_N_ELEMENTS (fold_rules); i++) {
+    const FoldRule *r = &fold_rules[i];
+
+    if (r->position != position)
+      continue;
+
+    for (j = 0; j < SPA_N_ELEMENTS (r->alt) && r->alt[j].gain > 0.0f; j++) {
+      uint32_t targets = r->alt[j].target[0] | r->alt[j].target[1];
+
+      if ((dst_mask & targets) != targets)
+        continue;
+
+      for (k = 0; k < 2 && r->alt[j].target[k]; k++)
+        mix->matrix[channel_index (dst_mask, r->alt[j].target[k])][s] += r->alt[j].gain;
+      return;
+    }
+  }
+  /* the LFE and channels without a place are dropped */
+}
+
+/**
+ * spa_channelmix_default_matrix:
+ * @mix: a #SpaChannelMixMatrix with @n_dst and @n_src set
+ * @dst_mask: the channel mask of the output or 0
+ * @src_mask: the channel mask of the input or 0
+ * @normalize: scale the matrix so that the output can't clip
+ *
+ * Make the standard up or downmix matrix between the channel layouts.
+ * Channels that exist on both sides are copied, the others are folded
+ * into their nearest neighbours at -3dB. Without masks, the usual layout
+ * for the number of channels is used, or else the channels are copied
+ * in order.
+ */
+void
+spa_channelmix_default_matrix (SpaChannelMixMatrix *mix,
+                               uint32_t       dst_mask,
+                               uint32_t       src_mask,
+                               bool           normalize)
+{
+  uint32_t i, j, n_dst = mix->n_dst, n_src = mix->n_src;
+  float max = 0.0f;
+
+  memset (mix->matrix, 0, sizeof (mix->matrix));
+
+  if (dst_mask == 0 || __builtin_popcount (dst_mask) != n_dst)
+    dst_mask = spa_channelmix_default_mask (n_dst);
+  if (src_mask == 0 || __builtin_popcount (src_mask) != n_src)
+    src_mask = spa_channelmix_default_mask (n_src);
+
+  if (dst_mask == 0 || src_mask == 0) {
+    for (i = 0; i < SPA_MIN (n_dst, n_src); i++)
+      mix->matrix[i][i] = 1.0f;
+  } else {
+    for (j = 0; j < SPA_AUDIO_N_CHANNEL_POSITIONS; j++) {
+      uint32_t position = 1u << j;
+
+      if ((src_mask & position) == 0)
+        continue;
+
+      if (dst_mask & position)
+        mix->matrix[channel_index (dst_mask, position)][channel_index (src_mask, position)] = 1.0f;
+      else
+        fold_channel (mix, dst_mask, src_mask, position);
+    }
+  }
+
+  if (normalize) {
+    for (i = 0; i < n_dst; i++) {
+      float sum = 0.0f;
+
+      for (j = 0; j < n_src; j++)
+        sum += fabsf (mix->matrix[i][j]);
+      max = SPA_MAX (max, sum);
+    }
+    if (max > 1.0f) {
+      for (i = 0; i < n_dst; i++)
+        for (j = 0; j < n_src; j++)
+          mix->matrix[i][j] /= max;
+    }
+  }
+}
+
+/**
+ * spa_channelmix_prepare:
+ * @mix: a #SpaChannelMixMatrix with the matrix filled in
+ *
+ * Find the cheapest way to apply the matrix of @mix.
+ */
+void
+spa_channelmix_prepare (SpaChannelMixMatrix *mix)
+{
+  uint32_t i, j, n_dst = mix->n_dst, n_src = mix->n_src;
+  bool identity = n_dst == n_src, remap = true;
+
+  for (i = 0; i < n_dst; i++) {
+    mix->map[i] = -1;
+
+    for (j = 0; j < n_src; j++) {
+      float g = mix->matrix[i][j];
+
+      if (g == 0.0f)
+        continue;
+      if (i != j || g != 1.0f)
+        identity = false;
+      if (g != 1.0f || mix->map[i] != -1)
+        remap = false;
+      mix->map[i] = j;
+    }
+    if (mix->map[i] != (int32_t) i)
+      identity = false;
+  }
+
+  if (identity)
+    mix->kind = SPA_CHANNELMIX_IDENTITY;
+  else if (remap)
+    mix->kind = SPA_CHANNELMIX_REMAP;
+  else
+    mix->kind = SPA_CHANNELMIX_MATRIX;
+
+  memset (mix->columns, 0, sizeof (mix->columns));
+  if (n_dst <= SPA_CHANNELMIX_MAX_VECTOR) {
+    for (j = 0; j < n_src; j++)
+      for (i = 0; i < n_dst; i++)
+        mix->columns[j][i] = mix->matrix[i][j];
+  }
+}
+
+void
+spa_channelmix_matrix_c (const SpaChannelMixMatrix *mix, float *dst,
+                         const float *src, uint32_t n_frames)
+{
+  spa_channelmix_matrix_range (mix, dst, src, 0, n_frames);
+}
+
+static void
+channelmix_remap (const SpaChannelMixMatrix *mix, float *dst,
+                  const float *src, uint32_t n_frames)
+{
+  uint32_t f, i, n_dst = mix->n_dst, n_src = mix->n_src;
+
+  for (f = 0; f < n_frames; f++) {
+    for (i = 0; i < n_dst; i++)
+      dst[i] = mix->map[i] < 0 ? 0.0f : src[mix->map[i]];
+    dst += n_dst;
+    src += n_src;
+  }
+}
+
+/**
+ * spa_channelmix_process:
+ * @ops: the #SpaChannelMixOps
+ * @mix: a prepared #SpaChannelMixMatrix
+ * @dst: the output frames
+ * @src: the input frames
+ * @n_frames: number of frames
+ *
+ * Apply @mix with the fastest method for its kind.
+ */
+void
+spa_channelmix_process (const SpaChannelMixOps *ops, const SpaChannelMixMatrix *mix,
+                        float *dst, const float *src, uint32_t n_frames)
+{
+  switch (mix->kind) {
+    case SPA_CHANNELMIX_IDENTITY:
+      memcpy (dst, src, n_frames * mix->n_dst * sizeof (float));
+      break;
+    case SPA_CHANNELMIX_REMAP:
+      channelmix_remap (mix, dst, src, n_frames);
+      break;
+    case SPA_CHANNELMIX_MATRIX:
+      ops->matrix (mix, dst, src, n_frames);
+      break;
+  }
+}
+
+void
+spa_channelmix_ops_init (SpaChannelMixOps *ops, uint32_t cpu_flags)
+{
+  ops->cpu_flags = 0;
+  ops->matrix = spa_channelmix_matrix_c;
+
+#if defined (HAVE_SSE2)
+  if (cpu_flags & SPA_CPU_FLAG_SSE2) {
+    ops->cpu_flags = SPA_CPU_FLAG_SSE2;
+    ops->matrix = spa_channelmix_matrix_sse2;
+  }
+#endif
+#if defined (HAVE_AVX2)
+  if (cpu_flags & SPA_CPU_FLAG_AVX2) {
+    ops->cpu_flags = SPA_CPU_FLAG_AVX2;
+    ops->matrix = spa_channelmix_matrix_avx2;
+  }
+#endif
+#if defined (HAVE_NEON)
+  if (cpu_flags & SPA_CPU_FLAG_NEON) {
+    ops->cpu_flags = SPA_CPU_FLAG_NEON;
+    ops->matrix = spa_channelmix_matrix_neon;
+  }
+#endif
+}
@@ -0,0 +1,137 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_CHANNELMIX_CHANNELMIX_OPS_H__
+#define __SPA_CHANNELMIX_CHANNELMIX_OPS_H__
+
+#include <spa/defs.h>
+
+#define SPA_CHANNELMIX_MAX_CHANNELS   64
+/* the SIMD kernels compute a whole output frame in one register, for up to
+ * this many output channels */
+#define SPA_CHANNELMIX_MAX_VECTOR     8
+
+/**
+ * SpaChannelMixKind:
+ * @SPA_CHANNELMIX_IDENTITY: the output is the input
+ * @SPA_CHANNELMIX_REMAP: each output channel is a copy of one input
+ *     channel or silent
+ * @SPA_CHANNELMIX_MATRIX: each output channel is a weighted sum of the
+ *     input channels
+ */
+typedef enum {
+  SPA_CHANNELMIX_IDENTITY,
+  SPA_CHANNELMIX_REMAP,
+  SPA_CHANNELMIX_MATRIX,
+} SpaChannelMixKind;
+
+/**
+ * SpaChannelMixMatrix:
+ * @kind: the #SpaChannelMixKind of @matrix
+ * @n_dst: number of output channels
+ * @n_src: number of input channels
+ * @matrix: @n_dst rows of @n_src gains
+ * @map: for %SPA_CHANNELMIX_REMAP, the input channel of each output
+ *     channel or -1 for silence
+ * @columns: the gains of each input channel for all output channels,
+ *     padded to %SPA_CHANNELMIX_MAX_VECTOR, for the SIMD kernels
+ *
+ * A prepared channel mixing matrix.
+ */
+typedef struct {
+  SpaChannelMixKind kind;
+  uint32_t          n_dst;
+  uint32_t          n_src;
+  float             matrix[SPA_CHANNELMIX_MAX_CHANNELS][SPA_CHANNELMIX_MAX_CHANNELS];
+  int32_t           map[SPA_CHANNELMIX_MAX_CHANNELS];
+  float             columns[SPA_CHANNELMIX_MAX_CHANNELS][SPA_CHANNELMIX_MAX_VECTOR];
+} SpaChannelMixMatrix;
+
+uint32_t  spa_channelmix_default_mask   (uint32_t channels);
+void      spa_channelmix_default_matrix (SpaChannelMixMatrix *mix,
+                                         uint32_t       dst_mask,
+                                         uint32_t       src_mask,
+                                         bool           normalize);
+void      spa_channelmix_prepare        (SpaChannelMixMatrix *mix);
+
+/**
+ * SpaChannelMixFunc:
+ * @mix: a prepared #SpaChannelMixMatrix of kind %SPA_CHANNELMIX_MATRIX
+ * @dst: @n_frames interleaved frames of @mix->n_dst channels
+ * @src: @n_frames interleaved frames of @mix->n_src channels
+ * @n_frames: number of frames
+ *
+ * Mix the channels of @src into @dst. @dst and @src can't overlap.
+ */
+typedef void (*SpaChannelMixFunc) (const SpaChannelMixMatrix *mix, float *dst,
+                                   const float *src, uint32_t n_frames);
+
+/**
+ * SpaChannelMixOps:
+ * @cpu_flags: the #SpaCPUFlags the functions were selected for
+ *
+ * The matrix kernel, selected once for the CPU we run on.
+ */
+typedef struct {
+  uint32_t          cpu_flags;
+  SpaChannelMixFunc matrix;
+} SpaChannelMixOps;
+
+void spa_channelmix_ops_init (SpaChannelMixOps *ops, uint32_t cpu_flags);
+void spa_channelmix_process  (const SpaChannelMixOps *ops, const SpaChannelMixMatrix *mix,
+                              float *dst, const float *src, uint32_t n_frames);
+
+/* plain C version, also used by the SIMD kernels for the remaining frames
+ * from @start to @end */
+static inline void
+spa_channelmix_matrix_range (const SpaChannelMixMatrix *mix, float *dst, const float *src,
+                             uint32_t start, uint32_t end)
+{
+  uint32_t f, i, j, n_dst = mix->n_dst, n_src = mix->n_src;
+
+  for (f = start; f < end; f++) {
+    const float *s = &src[f * n_src];
+    float *d = &dst[f * n_dst];
+
+    for (i = 0; i < n_dst; i++) {
+      float sum = 0.0f;
+
+      for (j = 0; j < n_src; j++)
+        sum += mix->matrix[i][j] * s[j];
+      d[i] = sum;
+    }
+  }
+}
+
+void spa_channelmix_matrix_c    (const SpaChannelMixMatrix *mix, float *dst,
+                                 const float *src, uint32_t n_frames);
+#if defined (HAVE_SSE2)
+void spa_channelmix_matrix_sse2 (const SpaChannelMixMatrix *mix, float *dst,
+                                 const float *src, uint32_t n_frames);
+#endif
+#if defined (HAVE_AVX2)
+void spa_channelmix_matrix_avx2 (const SpaChannelMixMatrix *mix, float *dst,
+                                 const float *src, uint32_t n_frames);
+#endif
+#if defined (HAVE_NEON)
+void spa_channelmix_matrix_neon (const SpaChannelMixMatrix *mix, float *dst,
+                                 const float *src, uint32_t n_frames);
+#endif
+
+#endif /* __SPA_CHANNELMIX_CHANNELMIX_OPS_H__ */
@@ -0,0 +1,951 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include <spa/log.h>
+#include <spa/type-map.h>
+#include <spa/node.h>
+#include <spa/list.h>
+#include <spa/audio/format-utils.h>
+#include <spa/format-builder.h>
+#include <lib/props.h>
+#include <lib/cpu.h>
+
+#include "channelmix-ops.h"
+
+#define MAX_BUFFERS     16
+#define MAX_CHANNELS    SPA_CHANNELMIX_MAX_CHANNELS
+#define MAX_MATRIX      (MAX_CHANNELS * MAX_CHANNELS)
+
+/* frames in one buffer */
+#define BLOCK_FRAMES    1024
+
+typedef struct _SpaChannelMix SpaChannelMix;
+
+typedef struct {
+  float    matrix[MAX_MATRIX];
+  uint32_t n_matrix;
+  bool     normalize;
+} SpaChannelMixProps;
+
+typedef struct {
+  SpaBuffer     *outbuf;
+  bool           outstanding;
+  SpaMetaHeader *h;
+  SpaList        link;
+} SpaChannelMixBuffer;
+
+typedef struct {
+  bool            have_format;
+  SpaAudioInfo    format;
+  uint32_t        frame_size;
+
+  SpaPortInfo     info;
+  SpaAllocParam  *params[2];
+  uint8_t         params_buffer[1024];
+
+  SpaChannelMixBuffer buffers[MAX_BUFFERS];
+  uint32_t        n_buffers;
+  SpaPortIO      *io;
+
+  SpaList         empty;
+} SpaChannelMixPort;
+
+typedef struct {
+  uint32_t node;
+  uint32_t format;
+  uint32_t props;
+  uint32_t prop_channel_matrix;
+  uint32_t prop_normalize;
+  SpaTypeMeta meta;
+  SpaTypeData data;
+  SpaTypeMediaType media_type;
+  SpaTypeMediaSubtype media_subtype;
+  SpaTypeFormatAudio format_audio;
+  SpaTypeAudioFormat audio_format;
+  SpaTypeEventNode event_node;
+  SpaTypeCommandNode command_node;
+  SpaTypeAllocParamBuffers alloc_param_buffers;
+  SpaTypeAllocParamMetaEnable alloc_param_meta_enable;
+} Type;
+
+static inline void
+init_type (Type *type, SpaTypeMap *map)
+{
+  type->node = spa_type_map_get_id (map, SPA_TYPE__Node);
+  type->format = spa_type_map_get_id (map, SPA_TYPE__Format);
+  type->props = spa_type_map_get_id (map, SPA_TYPE__Props);
+  type->prop_channel_matrix = spa_type_map_get_id (map, SPA_TYPE_PROPS__channelMatrix);
+  type->prop_normalize = spa_type_map_get_id (map, SPA_TYPE_PROPS__normalize);
+  spa_type_meta_map (map, &type->meta);
+  spa_type_data_map (map, &type->data);
+  spa_type_media_type_map (map, &type->media_type);
+  spa_type_media_subtype_map (map, &type->media_subtype);
+  spa_type_format_audio_map (map, &type->format_audio);
+  spa_type_audio_format_map (map, &type->audio_format);
+  spa_type_event_node_map (map, &type->event_node);
+  spa_type_command_node_map (map, &type->command_node);
+  spa_type_alloc_param_buffers_map (map, &type->alloc_param_buffers);
+  spa_type_alloc_param_meta_enable_map (map, &type->alloc_param_meta_enable);
+}
+
+struct _SpaChannelMix {
+  SpaHandle  handle;
+  SpaNode  node;
+
+  Type type;
+  SpaTypeMap *map;
+  SpaLog *log;
+
+  uint8_t props_buffer[MAX_MATRIX * sizeof (float) + 512];
+  SpaChannelMixProps props;
+
+  SpaNodeCallbacks callbacks;
+  void *user_data;
+
+  uint8_t format_buffer[1024];
+
+  SpaChannelMixPort in_ports[1];
+  SpaChannelMixPort out_ports[1];
+
+  SpaChannelMixOps ops;
+  SpaChannelMixMatrix mix;
+  bool have_mix;
+
+  bool started;
+};
+
+#define CHECK_IN_PORT(this,d,p)  ((d) == SPA_DIRECTION_INPUT && (p) == 0)
+#define CHECK_OUT_PORT(this,d,p) ((d) == SPA_DIRECTION_OUTPUT && (p) == 0)
+#define CHECK_PORT(this,d,p)     ((p) == 0)
+#define GET_PORT(this,d,p)       ((d) == SPA_DIRECTION_INPUT ? &(this)->in_ports[p] : &(this)->out_ports[p])
+#define GET_OTHER_PORT(this,d,p) ((d) == SPA_DIRECTION_INPUT ? &(this)->out_ports[p] : &(this)->in_ports[p])
+
+#define DEFAULT_NORMALIZE true
+
+static void
+reset_channelmix_props (SpaChannelMixProps *props)
+{
+  props->n_matrix = 0;
+  props->normalize = DEFAULT_NORMALIZE;
+}
+
+#define PROP(f,key,type,...)                                                    \
+          SPA_POD_PROP (f,key,0,type,1,__VA_ARGS__)
+#define PROP_MM(f,key,type,...)                                                 \
+          SPA_POD_PROP (f,key,SPA_POD_PROP_RANGE_MIN_MAX,type,3,__VA_ARGS__)
+#define PROP_EN(f,key,type,n,...)                                               \
+          SPA_POD_PROP (f,key,SPA_POD_PROP_RANGE_ENUM,type,n,__VA_ARGS__)
+#define PROP_U_MM(f,key,type,...)                                               \
+          SPA_POD_PROP (f,key,SPA_POD_PROP_FLAG_UNSET |                         \
+                              SPA_POD_PROP_RANGE_MIN_MAX,type,3,__VA_ARGS__)
+
+static SpaResult
+spa_channelmix_node_get_props (SpaNode        *node,
+                               SpaProps     **props)
+{
+  SpaChannelMix *this;
+  SpaPODBuilder b = { NULL,  };
+  SpaPODFrame f[2];
+  uint8_t buffer[MAX_MATRIX * sizeof (float) + 64];
+  SpaPOD *channel_matrix;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (props != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaChannelMix, node);
+
+  spa_pod_builder_init (&b, buffer, sizeof (buffer));
+  spa_pod_builder_array (&b, sizeof (float), SPA_POD_TYPE_FLOAT,
+                         this->props.n_matrix, this->props.matrix);
+  channel_matrix = SPA_POD_BUILDER_DEREF (&b, 0, SpaPOD);
+
+  spa_pod_builder_init (&b, this->props_buffer, sizeof (this->props_buffer));
+  spa_pod_builder_props (&b, &f[0], this->type.props,
+      PROP (&f[1], this->type.prop_channel_matrix, SPA_POD_TYPE_POD,  channel_matrix),
+      PROP (&f[1], this->type.prop_normalize,      SPA_POD_TYPE_BOOL, this->props.normalize));
+
+  *props = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaProps);
+
+  return SPA_RESULT_OK;
+}
+
+static void update_mix (SpaChannelMix *this);
+
+static SpaResult
+spa_channelmix_node_set_props (SpaNode        *node,
+                               const SpaProps *props)
+{
+  SpaChannelMix *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaChannelMix, node);
+
+  if (props == NULL) {
+    reset_channelmix_props (&this->props);
+  } else {
+    SpaPODArray *channel_matrix = NULL;
+
+    spa_props_query (props,
+        this->type.prop_channel_matrix, -SPA_POD_TYPE_ARRAY, &channel_matrix,
+        this->type.prop_normalize,      SPA_POD_TYPE_BOOL,   &this->props.normalize,
+        0);
+
+    if (channel_matrix && channel_matrix->body.child.type == SPA_POD_TYPE_FLOAT &&
+        channel_matrix->body.child.size == sizeof (float)) {
+      uint32_t n = (SPA_POD_BODY_SIZE (channel_matrix) - sizeof (SpaPODArrayBody)) / sizeof (float);
+
+      this->props.n_matrix = SPA_MIN (n, MAX_MATRIX);
+      memcpy (this->props.matrix, SPA_MEMBER (&channel_matrix->body, sizeof (SpaPODArrayBody), float),
+              this->props.n_matrix * sizeof (float));
+    }
+  }
+  update_mix (this);
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_channelmix_node_send_command (SpaNode    *node,
+                                  SpaCommand *command)
+{
+  SpaChannelMix *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (command != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaChannelMix, node);
+
+  if (SPA_COMMAND_TYPE (command) == this->type.command_node.Start) {
+    this->started = true;
+  }
+  else if (SPA_COMMAND_TYPE (command) == this->type.command_node.Pause) {
+    this->started = false;
+  }
+  else
+    return SPA_RESULT_NOT_IMPLEMENTED;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_channelmix_node_set_callbacks (SpaNode                *node,
+                                   const SpaNodeCallbacks *callbacks,
+                                   size_t                  callbacks_size,
+                                   void                   *user_data)
+{
+  SpaChannelMix *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaChannelMix, node);
+
+  this->callbacks = *callbacks;
+  this->user_data = user_data;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_channelmix_node_get_n_ports (SpaNode       *node,
+                                 uint32_t      *n_input_ports,
+                                 uint32_t      *max_input_ports,
+                                 uint32_t      *n_output_ports,
+                                 uint32_t      *max_output_ports)
+{
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  if (n_input_ports)
+    *n_input_ports = 1;
+  if (max_input_ports)
+    *max_input_ports = 1;
+  if (n_output_ports)
+    *n_output_ports = 1;
+  if (max_output_ports)
+    *max_output_ports = 1;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_channelmix_node_get_port_ids (SpaNode       *node,
+                                  uint32_t       n_input_ports,
+                                  uint32_t      *input_ids,
+                                  uint32_t       n_output_ports,
+                                  uint32_t      *output_ids)
+{
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  if (n_input_ports > 0 && input_ids)
+    input_ids[0] = 0;
+  if (n_output_ports > 0 && output_ids)
+    output_ids[0] = 0;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_channelmix_node_add_port (SpaNode        *node,
+                              SpaDirection    direction,
+                              uint32_t        port_id)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_channelmix_node_remove_port (SpaNode        *node,
+                                 SpaDirection    direction,
+                                 uint32_t        port_id)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_channelmix_node_port_enum_formats (SpaNode          *node,
+                                       SpaDirection      direction,
+                                       uint32_t          port_id,
+                                       SpaFormat       **format,
+                                       const SpaFormat  *filter,
+                                       uint32_t          index)
+{
+  SpaChannelMix *this;
+  SpaChannelMixPort *other;
+  SpaResult res;
+  SpaFormat *fmt;
+  uint8_t buffer[1024];
+  SpaPODBuilder b = { NULL, };
+  SpaPODFrame f[2];
+  uint32_t count, match;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (format != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaChannelMix, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  other = GET_OTHER_PORT (this, direction, port_id);
+
+  count = match = filter ? 0 : index;
+
+next:
+  spa_pod_builder_init (&b, buffer, sizeof (buffer));
+
+  switch (count++) {
+    case 0:
+      /* we only mix the channels, the rate has to match the other port
+       * once that is configured. Prefer the channels of the other port,
+       * we don't need to mix when they are accepted. */
+      if (other->have_format) {
+        spa_pod_builder_format (&b, &f[0], this->type.format,
+            this->type.media_type.audio, this->type.media_subtype.raw,
+            PROP      (&f[1], this->type.format_audio.format,   SPA_POD_TYPE_ID,  this->type.audio_format.F32),
+            PROP      (&f[1], this->type.format_audio.layout,   SPA_POD_TYPE_INT, SPA_AUDIO_LAYOUT_INTERLEAVED),
+            PROP      (&f[1], this->type.format_audio.rate,     SPA_POD_TYPE_INT, other->format.info.raw.rate),
+            PROP_U_MM (&f[1], this->type.format_audio.channels, SPA_POD_TYPE_INT,
+                                                                other->format.info.raw.channels,
+                                                                1, MAX_CHANNELS));
+      } else {
+        spa_pod_builder_format (&b, &f[0], this->type.format,
+            this->type.media_type.audio, this->type.media_subtype.raw,
+            PROP      (&f[1], this->type.format_audio.format,   SPA_POD_TYPE_ID,  this->type.audio_format.F32),
+            PROP      (&f[1], this->type.format_audio.layout,   SPA_POD_TYPE_INT, SPA_AUDIO_LAYOUT_INTERLEAVED),
+            PROP_U_MM (&f[1], this->type.format_audio.rate,     SPA_POD_TYPE_INT, 44100, 1, INT32_MAX),
+            PROP_U_MM (&f[1], this->type.format_audio.channels, SPA_POD_TYPE_INT, 2, 1, MAX_CHANNELS));
+      }
+      break;
+    default:
+      return SPA_RESULT_ENUM_END;
+  }
+  fmt = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaFormat);
+  spa_pod_builder_init (&b, this->format_buffer, sizeof (this->format_buffer));
+
+  if ((res = spa_format_filter (fmt, filter, &b)) != SPA_RESULT_OK || match++ != index)
+    goto next;
+
+  *format = SPA_POD_BUILDER_DEREF (&b, 0, SpaFormat);
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+clear_buffers (SpaChannelMix *this, SpaChannelMixPort *port)
+{
+  if (port->n_buffers > 0) {
+    spa_log_info (this->log, "channelmix %p: clear buffers", this);
+    port->n_buffers = 0;
+    spa_list_init (&port->empty);
+  }
+  return SPA_RESULT_OK;
+}
+
+/* make the matrix between the configured layouts, the one from the
+ * properties when it has the right size or else the default up or
+ * downmix */
+static void
+update_mix (SpaChannelMix *this)
+{
+  SpaChannelMixPort *in = &this->in_ports[0], *out = &this->out_ports[0];
+  SpaChannelMixMatrix *mix = &this->mix;
+  uint32_t i, j;
+  static const char *kinds[] = { "identity", "remap", "matrix" };
+
+  this->have_mix = false;
+
+  if (!in->have_format || !out->have_format)
+    return;
+
+  mix->n_dst = out->format.info.raw.channels;
+  mix->n_src = in->format.info.raw.channels;
+
+  if (this->props.n_matrix == mix->n_dst * mix->n_src) {
+    for (i = 0; i < mix->n_dst; i++)
+      for (j = 0; j < mix->n_src; j++)
+        mix->matrix[i][j] = this->props.matrix[i * mix->n_src + j];
+  } else {
+    spa_channelmix_default_matrix (mix, out->format.info.raw.channel_mask,
+                                   in->format.info.raw.channel_mask,
+                                   this->props.normalize);
+  }
+  spa_channelmix_prepare (mix);
+  this->have_mix = true;
+
+  spa_log_info (this->log, "channelmix %p: %u -> %u channels, %s", this,
+      mix->n_src, mix->n_dst, kinds[mix->kind]);
+}
+
+static SpaResult
+spa_channelmix_node_port_set_format (SpaNode         *node,
+                                     SpaDirection     direction,
+                                     uint32_t         port_id,
+                                     uint32_t         flags,
+                                     const SpaFormat *format)
+{
+  SpaChannelMix *this;
+  SpaChannelMixPort *port, *other;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaChannelMix, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  port = GET_PORT (this, direction, port_id);
+  other = GET_OTHER_PORT (this, direction, port_id);
+
+  if (format == NULL) {
+    port->have_format = false;
+    clear_buffers (this, port);
+    this->have_mix = false;
+  } else {
+    SpaAudioInfo info = { SPA_FORMAT_MEDIA_TYPE (format),
+                          SPA_FORMAT_MEDIA_SUBTYPE (format), };
+
+    if (info.media_type != this->type.media_type.audio ||
+        info.media_subtype != this->type.media_subtype.raw)
+      return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+    if (!spa_format_audio_raw_parse (format, &info.info.raw, &this->type.format_audio))
+      return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+    if (info.info.raw.format != this->type.audio_format.F32 ||
+        info.info.raw.layout != SPA_AUDIO_LAYOUT_INTERLEAVED)
+      return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+    if (info.info.raw.channels == 0 || info.info.raw.channels > MAX_CHANNELS ||
+        info.info.raw.rate == 0)
+      return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+    if (other->have_format && info.info.raw.rate != other->format.info.raw.rate)
+      return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+    port->frame_size = sizeof (float) * info.info.raw.channels;
+    port->format = info;
+    port->have_format = true;
+
+    update_mix (this);
+  }
+
+  if (port->have_format) {
+    SpaPODBuilder b = { NULL };
+    SpaPODFrame f[2];
+
+    port->info.maxbuffering = -1;
+    port->info.latency = 0;
+
+    port->info.n_params = 2;
+    port->info.params = port->params;
+
+    spa_pod_builder_init (&b, port->params_buffer, sizeof (port->params_buffer));
+    spa_pod_builder_object (&b, &f[0], 0, this->type.alloc_param_buffers.Buffers,
+      PROP      (&f[1], this->type.alloc_param_buffers.size,    SPA_POD_TYPE_INT,
+                                                                BLOCK_FRAMES * port->frame_size),
+      PROP      (&f[1], this->type.alloc_param_buffers.stride,  SPA_POD_TYPE_INT, port->frame_size),
+      PROP_U_MM (&f[1], this->type.alloc_param_buffers.buffers, SPA_POD_TYPE_INT, MAX_BUFFERS, 2, MAX_BUFFERS),
+      PROP      (&f[1], this->type.alloc_param_buffers.align,   SPA_POD_TYPE_INT, 16));
+    port->params[0] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
+
+    spa_pod_builder_object (&b, &f[0], 0, this->type.alloc_param_meta_enable.MetaEnable,
+      PROP      (&f[1], this->type.alloc_param_meta_enable.type, SPA_POD_TYPE_ID, this->type.meta.Header),
+      PROP      (&f[1], this->type.alloc_param_meta_enable.size, SPA_POD_TYPE_INT, sizeof (SpaMetaHeader)));
+    port->params[1] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
+
+    port->info.extra = NULL;
+  }
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_channelmix_node_port_get_format (SpaNode          *node,
+                                     SpaDirection      direction,
+                                     uint32_t          port_id,
+                                     const SpaFormat **format)
+{
+  SpaChannelMix *this;
+  SpaChannelMixPort *port;
+  SpaPODBuilder b = { NULL, };
+  SpaPODFrame f[2];
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (format != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaChannelMix, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  port = GET_PORT (this, direction, port_id);
+
+  if (!port->have_format)
+    return SPA_RESULT_NO_FORMAT;
+
+  spa_pod_builder_init (&b, this->format_buffer, sizeof (this->format_buffer));
+  spa_pod_builder_format (&b, &f[0], this->type.format,
+         this->type.media_type.audio, this->type.media_subtype.raw,
+         PROP (&f[1], this->type.format_audio.format,   SPA_POD_TYPE_ID,  port->format.info.raw.format),
+         PROP (&f[1], this->type.format_audio.layout,   SPA_POD_TYPE_INT, port->format.info.raw.layout),
+         PROP (&f[1], this->type.format_audio.rate,     SPA_POD_TYPE_INT, port->format.info.raw.rate),
+         PROP (&f[1], this->type.format_audio.channels, SPA_POD_TYPE_INT, port->format.info.raw.channels));
+
+  *format = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaFormat);
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_channelmix_node_port_get_info (SpaNode            *node,
+                                   SpaDirection        direction,
+                                   uint32_t            port_id,
+                                   const SpaPortInfo **info)
+{
+  SpaChannelMix *this;
+  SpaChannelMixPort *port;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (info != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaChannelMix, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  port = GET_PORT (this, direction, port_id);
+  *info = &port->info;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_channelmix_node_port_get_props (SpaNode       *node,
+                                    SpaDirection   direction,
+                                    uint32_t       port_id,
+                                    SpaProps     **props)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_channelmix_node_port_set_props (SpaNode        *node,
+                                    SpaDirection    direction,
+                                    uint32_t        port_id,
+                                    const SpaProps *props)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_channelmix_node_port_use_buffers (SpaNode         *node,
+                                      SpaDirection     direction,
+                                      uint32_t         port_id,
+                                      SpaBuffer      **buffers,
+                                      uint32_t         n_buffers)
+{
+  SpaChannelMix *this;
+  SpaChannelMixPort *port;
+  uint32_t i, j;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaChannelMix, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  port = GET_PORT (this, direction, port_id);
+
+  if (!port->have_format)
+    return SPA_RESULT_NO_FORMAT;
+
+  clear_buffers (this, port);
+
+  for (i = 0; i < n_buffers; i++) {
+    SpaChannelMixBuffer *b;
+    SpaData *d = buffers[i]->datas;
+
+    b = &port->buffers[i];
+    b->outbuf = buffers[i];
+    b->outstanding = true;
+    b->h = spa_buffer_find_meta (buffers[i], this->type.meta.Header);
+
+    for (j = 0; j < buffers[i]->n_datas; j++) {
+      if ((d[j].type != this->type.data.MemPtr &&
+           d[j].type != this->type.data.MemFd &&
+           d[j].type != this->type.data.DmaBuf) ||
+          d[j].data == NULL) {
+        spa_log_error (this->log, "channelmix %p: invalid memory on buffer %p", this, buffers[i]);
+        return SPA_RESULT_ERROR;
+      }
+    }
+    spa_list_insert (port->empty.prev, &b->link);
+  }
+  port->n_buffers = n_buffers;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_channelmix_node_port_alloc_buffers (SpaNode         *node,
+                                        SpaDirection     direction,
+                                        uint32_t         port_id,
+                                        SpaAllocParam  **params,
+                                        uint32_t         n_params,
+                                        SpaBuffer      **buffers,
+                                        uint32_t        *n_buffers)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_channelmix_node_port_set_io (SpaNode      *node,
+                                 SpaDirection  direction,
+                                 uint32_t      port_id,
+                                 SpaPortIO    *io)
+{
+  SpaChannelMix *this;
+  SpaChannelMixPort *port;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaChannelMix, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  port = GET_PORT (this, direction, port_id);
+  port->io = io;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_channelmix_node_port_reuse_buffer (SpaNode         *node,
+                                       uint32_t         port_id,
+                                       uint32_t         buffer_id)
+{
+  SpaChannelMix *this;
+  SpaChannelMixBuffer *b;
+  SpaChannelMixPort *port;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaChannelMix, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, SPA_DIRECTION_OUTPUT, port_id), SPA_RESULT_INVALID_PORT);
+
+  port = &this->out_ports[port_id];
+
+  if (port->n_buffers == 0)
+    return SPA_RESULT_NO_BUFFERS;
+
+  if (buffer_id >= port->n_buffers)
+    return SPA_RESULT_INVALID_BUFFER_ID;
+
+  b = &port->buffers[buffer_id];
+  if (!b->outstanding)
+    return SPA_RESULT_OK;
+
+  b->outstanding = false;
+  spa_list_insert (port->empty.prev, &b->link);
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_channelmix_node_port_send_command (SpaNode        *node,
+                                       SpaDirection    direction,
+                                       uint32_t        port_id,
+                                       SpaCommand     *command)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaChannelMixBuffer *
+find_free_buffer (SpaChannelMix *this, SpaChannelMixPort *port)
+{
+  SpaChannelMixBuffer *b;
+
+  if (spa_list_is_empty (&port->empty))
+    return NULL;
+
+  b = spa_list_first (&port->empty, SpaChannelMixBuffer, link);
+  spa_list_remove (&b->link);
+  b->outstanding = true;
+
+  return b;
+}
+
+static inline void
+release_buffer (SpaChannelMix *this, SpaBuffer *buffer)
+{
+  this->callbacks.reuse_buffer (&this->node, 0, buffer->id, this->user_data);
+}
+
+static void
+do_mix (SpaChannelMix *this, SpaBuffer *dbuf, SpaBuffer *sbuf)
+{
+  SpaChannelMixPort *in = &this->in_ports[0], *out = &this->out_ports[0];
+  SpaData *sd = sbuf->datas, *dd = dbuf->datas;
+  const float *src;
+  uint32_t n_frames;
+
+  src = SPA_MEMBER (sd[0].data, sd[0].chunk->offset, float);
+  n_frames = SPA_MIN (sd[0].chunk->size, sd[0].maxsize) / in->frame_size;
+  n_frames = SPA_MIN (n_frames, dd[0].maxsize / out->frame_size);
+
+  if (this->have_mix)
+    spa_channelmix_process (&this->ops, &this->mix, dd[0].data, src, n_frames);
+  else
+    n_frames = 0;
+
+  dd[0].chunk->offset = 0;
+  dd[0].chunk->size = n_frames * out->frame_size;
+  dd[0].chunk->stride = out->frame_size;
+}
+
+static SpaResult
+spa_channelmix_node_process_input (SpaNode *node)
+{
+  SpaChannelMix *this;
+  SpaPortIO *input;
+  SpaPortIO *output;
+  SpaChannelMixPort *in_port, *out_port;
+  SpaChannelMixBuffer *sb, *db;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaChannelMix, node);
+
+  in_port = &this->in_ports[0];
+  out_port = &this->out_ports[0];
+
+  if ((input = in_port->io) == NULL)
+    return SPA_RESULT_ERROR;
+  if ((output = out_port->io) == NULL)
+    return SPA_RESULT_ERROR;
+
+  if (!in_port->have_format || !out_port->have_format) {
+    input->status = SPA_RESULT_NO_FORMAT;
+    return SPA_RESULT_ERROR;
+  }
+  if (input->buffer_id >= in_port->n_buffers) {
+    input->status = SPA_RESULT_INVALID_BUFFER_ID;
+    return SPA_RESULT_ERROR;
+  }
+
+  if (output->buffer_id >= out_port->n_buffers) {
+    db = find_free_buffer (this, out_port);
+  } else {
+    db = &out_port->buffers[output->buffer_id];
+  }
+  if (db == NULL)
+    return SPA_RESULT_OUT_OF_BUFFERS;
+
+  sb = &in_port->buffers[input->buffer_id];
+
+  input->buffer_id = SPA_ID_INVALID;
+  input->status = SPA_RESULT_OK;
+
+  do_mix (this, db->outbuf, sb->outbuf);
+
+  if (sb->h && db->h)
+    *db->h = *sb->h;
+
+  output->buffer_id = db->outbuf->id;
+  output->status = SPA_RESULT_OK;
+
+  release_buffer (this, sb->outbuf);
+
+  return SPA_RESULT_HAVE_BUFFER;
+}
+
+static SpaResult
+spa_channelmix_node_process_output (SpaNode *node)
+{
+  return SPA_RESULT_NEED_BUFFER;
+}
+
+static const SpaNode channelmix_node = {
+  sizeof (SpaNode),
+  NULL,
+  spa_channelmix_node_get_props,
+  spa_channelmix_node_set_props,
+  spa_channelmix_node_send_command,
+  spa_channelmix_node_set_callbacks,
+  spa_channelmix_node_get_n_ports,
+  spa_channelmix_node_get_port_ids,
+  spa_channelmix_node_add_port,
+  spa_channelmix_node_remove_port,
+  spa_channelmix_node_port_enum_formats,
+  spa_channelmix_node_port_set_format,
+  spa_channelmix_node_port_get_format,
+  spa_channelmix_node_port_get_info,
+  spa_channelmix_node_port_get_props,
+  spa_channelmix_node_port_set_props,
+  spa_channelmix_node_port_use_buffers,
+  spa_channelmix_node_port_alloc_buffers,
+  spa_channelmix_node_port_set_io,
+  spa_channelmix_node_port_reuse_buffer,
+  spa_channelmix_node_port_send_command,
+  spa_channelmix_node_process_input,
+  spa_channelmix_node_process_output,
+};
+
+static SpaResult
+spa_channelmix_get_interface (SpaHandle               *handle,
+                              uint32_t                 interface_id,
+                              void                   **interface)
+{
+  SpaChannelMix *this;
+
+  spa_return_val_if_fail (handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (interface != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = (SpaChannelMix *) handle;
+
+  if (interface_id == this->type.node)
+    *interface = &this->node;
+  else
+    return SPA_RESULT_UNKNOWN_INTERFACE;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+channelmix_clear (SpaHandle *handle)
+{
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+channelmix_init (const SpaHandleFactory  *factory,
+                 SpaHandle               *handle,
+                 const SpaDict           *info,
+                 const SpaSupport        *support,
+                 uint32_t                 n_support)
+{
+  SpaChannelMix *this;
+  uint32_t i;
+
+  spa_return_val_if_fail (factory != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  handle->get_interface = spa_channelmix_get_interface;
+  handle->clear = channelmix_clear;
+
+  this = (SpaChannelMix *) handle;
+
+  for (i = 0; i < n_support; i++) {
+    if (strcmp (support[i].type, SPA_TYPE__TypeMap) == 0)
+      this->map = support[i].data;
+    else if (strcmp (support[i].type, SPA_TYPE__Log) == 0)
+      this->log = support[i].data;
+  }
+  if (this->map == NULL) {
+    spa_log_error (this->log, "a type-map is needed");
+    return SPA_RESULT_ERROR;
+  }
+  init_type (&this->type, this->map);
+
+  spa_channelmix_ops_init (&this->ops, spa_cpu_get_info_flags (info));
+  spa_log_info (this->log, "channelmix %p: using cpu flags 0x%08x", this, this->ops.cpu_flags);
+
+  this->node = channelmix_node;
+  reset_channelmix_props (&this->props);
+
+  this->in_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
+  spa_list_init (&this->in_ports[0].empty);
+
+  this->out_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS |
+                                  SPA_PORT_INFO_FLAG_NO_REF;
+  spa_list_init (&this->out_ports[0].empty);
+
+  return SPA_RESULT_OK;
+}
+
+static const SpaInterfaceInfo channelmix_interfaces[] =
+{
+  { SPA_TYPE__Node, },
+};
+
+static SpaResult
+channelmix_enum_interface_info (const SpaHandleFactory  *factory,
+                                const SpaInterfaceInfo **info,
+                                uint32_t                 index)
+{
+  spa_return_val_if_fail (factory != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (info != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  switch (index) {
+    case 0:
+      *info = &channelmix_interfaces[index];
+      break;
+    default:
+      return SPA_RESULT_ENUM_END;
+  }
+  return SPA_RESULT_OK;
+}
+
+const SpaHandleFactory spa_channelmix_factory =
+{ "channelmix",
+  NULL,
+  sizeof (SpaChannelMix),
+  channelmix_init,
+  channelmix_enum_interface_info,
+};
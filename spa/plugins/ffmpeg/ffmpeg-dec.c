@@ -17,6 +17,7 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include <string.h>
 #include <stddef.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -25,47 +26,91 @@
 #include <spa/type-map.h>
 #include <spa/log.h>
 #include <spa/node.h>
-#include <spa/video/format-utils.h>
+#include <spa/list.h>
+#include <spa/format-builder.h>
 #include <lib/props.h>
 
+#include "ffmpeg.h"
+
 typedef struct _SpaFFMpegDec SpaFFMpegDec;
 
 #define IS_VALID_PORT(this,d,id) ((id) == 0)
 #define MAX_BUFFERS    32
+#define MAX_PLANES     3
+
+typedef struct {
+  int32_t threads;
+  bool low_latency;
+} SpaFFMpegDecProps;
 
 typedef struct _FFMpegBuffer FFMpegBuffer;
 
 struct _FFMpegBuffer {
   SpaBuffer *outbuf;
   bool outstanding;
-  FFMpegBuffer *next;
+  SpaMetaHeader *h;
+  SpaList link;
 };
 
 typedef struct {
   bool have_format;
-  SpaVideoInfo current_format;
-  bool have_buffers;
-  FFMpegBuffer buffers[MAX_BUFFERS];
+  SpaRectangle size;
+  SpaFraction framerate;
+  /* raw video on the output port */
+  uint32_t format;
+  enum AVPixelFormat pix_fmt;
+  uint32_t n_planes;
+  uint32_t stride[MAX_PLANES];
+  uint32_t offset[MAX_PLANES];
+  uint32_t frame_size;
+
   SpaPortInfo info;
+  SpaAllocParam *params[2];
+  uint8_t params_buffer[1024];
+
+  FFMpegBuffer buffers[MAX_BUFFERS];
+  uint32_t n_buffers;
   SpaPortIO *io;
+
+  SpaList empty;
 } SpaFFMpegPort;
 
 typedef struct {
   uint32_t node;
+  uint32_t format;
+  uint32_t props;
+  uint32_t prop_threads;
+  uint32_t prop_low_latency;
+  SpaTypeMeta meta;
+  SpaTypeData data;
   SpaTypeMediaType media_type;
   SpaTypeMediaSubtype media_subtype;
+  SpaTypeMediaSubtypeVideo media_subtype_video;
   SpaTypeFormatVideo format_video;
+  SpaTypeVideoFormat video_format;
   SpaTypeCommandNode command_node;
+  SpaTypeAllocParamBuffers alloc_param_buffers;
+  SpaTypeAllocParamMetaEnable alloc_param_meta_enable;
 } Type;
 
 static inline void
 init_type (Type *type, SpaTypeMap *map)
 {
   type->node = spa_type_map_get_id (map, SPA_TYPE__Node);
+  type->format = spa_type_map_get_id (map, SPA_TYPE__Format);
+  type->props = spa_type_map_get_id (map, SPA_TYPE__Props);
+  type->prop_threads = spa_type_map_get_id (map, SPA_TYPE_PROPS__threads);
+  type->prop_low_latency = spa_type_map_get_id (map, SPA_TYPE_PROPS__lowLatency);
+  spa_type_meta_map (map, &type->meta);
+  spa_type_data_map (map, &type->data);
   spa_type_media_type_map (map, &type->media_type);
   spa_type_media_subtype_map (map, &type->media_subtype);
+  spa_type_media_subtype_video_map (map, &type->media_subtype_video);
   spa_type_format_video_map (map, &type->format_video);
+  spa_type_video_format_map (map, &type->video_format);
   spa_type_command_node_map (map, &type->command_node);
+  spa_type_alloc_param_buffers_map (map, &type->alloc_param_buffers);
+  spa_type_alloc_param_meta_enable_map (map, &type->alloc_param_meta_enable);
 }
 
 struct _SpaFFMpegDec {
@@ -76,31 +121,96 @@ struct _SpaFFMpegDec {
   SpaTypeMap *map;
   SpaLog *log;
 
+  uint8_t props_buffer[512];
+  SpaFFMpegDecProps props;
+
   SpaNodeCallbacks callbacks;
   void *user_data;
 
+  uint8_t format_buffer[1024];
+
   SpaFFMpegPort in_ports[1];
   SpaFFMpegPort out_ports[1];
 
+  AVCodec *codec;
+  uint32_t subtype;
+  AVCodecContext *ctx;
+  AVFrame *frame;
+  AVPacket *pkt;
+  uint32_t seq;
+
   bool started;
 };
 
-enum {
-  PROP_ID_LAST,
-};
+#define GET_PORT(this,d,p)       ((d) == SPA_DIRECTION_INPUT ? &(this)->in_ports[p] : &(this)->out_ports[p])
+#define GET_OTHER_PORT(this,d,p) ((d) == SPA_DIRECTION_INPUT ? &(this)->out_ports[p] : &(this)->in_ports[p])
+
+#define DEFAULT_THREADS      0
+#define DEFAULT_LOW_LATENCY  false
+
+static void
+reset_ffmpeg_dec_props (SpaFFMpegDecProps *props)
+{
+  props->threads = DEFAULT_THREADS;
+  props->low_latency = DEFAULT_LOW_LATENCY;
+}
+
+#define PROP(f,key,type,...)                                                    \
+          SPA_POD_PROP (f,key,0,type,1,__VA_ARGS__)
+#define PROP_MM(f,key,type,...)                                                 \
+          SPA_POD_PROP (f,key,SPA_POD_PROP_RANGE_MIN_MAX,type,3,__VA_ARGS__)
+#define PROP_U_MM(f,key,type,...)                                               \
+          SPA_POD_PROP (f,key,SPA_POD_PROP_FLAG_UNSET |                         \
+                              SPA_POD_PROP_RANGE_MIN_MAX,type,3,__VA_ARGS__)
+
+static void close_decoder (SpaFFMpegDec *this);
 
 static SpaResult
 spa_ffmpeg_dec_node_get_props (SpaNode       *node,
                                SpaProps     **props)
 {
-  return SPA_RESULT_NOT_IMPLEMENTED;
+  SpaFFMpegDec *this;
+  SpaPODBuilder b = { NULL,  };
+  SpaPODFrame f[2];
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (props != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaFFMpegDec, node);
+
+  spa_pod_builder_init (&b, this->props_buffer, sizeof (this->props_buffer));
+  spa_pod_builder_props (&b, &f[0], this->type.props,
+      PROP_MM (&f[1], this->type.prop_threads,     SPA_POD_TYPE_INT,  this->props.threads,
+                                                                      0, SPA_FFMPEG_MAX_THREADS),
+      PROP    (&f[1], this->type.prop_low_latency, SPA_POD_TYPE_BOOL, this->props.low_latency));
+  *props = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaProps);
+
+  return SPA_RESULT_OK;
 }
 
 static SpaResult
 spa_ffmpeg_dec_node_set_props (SpaNode         *node,
                                const SpaProps  *props)
 {
-  return SPA_RESULT_NOT_IMPLEMENTED;
+  SpaFFMpegDec *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaFFMpegDec, node);
+
+  if (props == NULL) {
+    reset_ffmpeg_dec_props (&this->props);
+  } else {
+    spa_props_query (props,
+        this->type.prop_threads,     SPA_POD_TYPE_INT,  &this->props.threads,
+        this->type.prop_low_latency, SPA_POD_TYPE_BOOL, &this->props.low_latency,
+        0);
+  }
+  /* the settings are applied when the decoder is opened again for
+   * the next packet */
+  close_decoder (this);
+
+  return SPA_RESULT_OK;
 }
 
 static SpaResult
@@ -109,8 +219,8 @@ spa_ffmpeg_dec_node_send_command (SpaNode    *node,
 {
   SpaFFMpegDec *this;
 
-  if (node == NULL || command == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (command != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   this = SPA_CONTAINER_OF (node, SpaFFMpegDec, node);
 
@@ -134,8 +244,7 @@ spa_ffmpeg_dec_node_set_callbacks (SpaNode                *node,
 {
   SpaFFMpegDec *this;
 
-  if (node == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   this = SPA_CONTAINER_OF (node, SpaFFMpegDec, node);
 
@@ -152,8 +261,7 @@ spa_ffmpeg_dec_node_get_n_ports (SpaNode       *node,
                                  uint32_t      *n_output_ports,
                                  uint32_t      *max_output_ports)
 {
-  if (node == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   if (n_input_ports)
     *n_input_ports = 1;
@@ -174,8 +282,7 @@ spa_ffmpeg_dec_node_get_port_ids (SpaNode       *node,
                                   uint32_t       n_output_ports,
                                   uint32_t      *output_ids)
 {
-  if (node == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   if (n_input_ports > 0 && input_ids != NULL)
     input_ids[0] = 0;
@@ -210,24 +317,111 @@ spa_ffmpeg_dec_node_port_enum_formats (SpaNode         *node,
                                        const SpaFormat *filter,
                                        uint32_t         index)
 {
-  //SpaFFMpegDec *this;
+  SpaFFMpegDec *this;
+  SpaFFMpegPort *other;
+  SpaResult res;
+  SpaFormat *fmt;
+  uint8_t buffer[1024];
+  SpaPODBuilder b = { NULL, };
+  SpaPODFrame f[2];
+  uint32_t count, match;
+  SpaRectangle size = { 320, 240 };
+  SpaFraction framerate = { 25, 1 };
+  uint32_t unset;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (format != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
-  if (node == NULL || format == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  this = SPA_CONTAINER_OF (node, SpaFFMpegDec, node);
 
-  //this = SPA_CONTAINER_OF (node, SpaFFMpegDec, node);
+  spa_return_val_if_fail (IS_VALID_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
 
-  if (!IS_VALID_PORT (this, direction, port_id))
-    return SPA_RESULT_INVALID_PORT;
+  other = GET_OTHER_PORT (this, direction, port_id);
 
-  switch (index) {
+  /* size and framerate are fixed once the other port has a format */
+  if (other->have_format) {
+    size = other->size;
+    framerate = other->framerate;
+    unset = 0;
+  } else {
+    unset = SPA_POD_PROP_FLAG_UNSET | SPA_POD_PROP_RANGE_MIN_MAX;
+  }
+
+  count = match = filter ? 0 : index;
+
+next:
+  spa_pod_builder_init (&b, buffer, sizeof (buffer));
+
+  switch (count++) {
     case 0:
+      /* the software decoders we expose make 4:2:0 planar video, other
+       * formats are left to a videoconvert node */
+      if (direction == SPA_DIRECTION_OUTPUT) {
+        spa_pod_builder_format (&b, &f[0], this->type.format,
+            this->type.media_type.video, this->type.media_subtype.raw,
+            PROP (&f[1], this->type.format_video.format, SPA_POD_TYPE_ID,
+                                                              this->type.video_format.I420),
+            SPA_POD_PROP (&f[1], this->type.format_video.size, unset, SPA_POD_TYPE_RECTANGLE, 3,
+                                                              size.width, size.height,
+                                                              1, 1,
+                                                              INT32_MAX, INT32_MAX),
+            SPA_POD_PROP (&f[1], this->type.format_video.framerate, unset, SPA_POD_TYPE_FRACTION, 3,
+                                                              framerate.num, framerate.denom,
+                                                              0, 1,
+                                                              INT32_MAX, 1));
+      }
+      else if (this->subtype == this->type.media_subtype_video.h264) {
+        spa_pod_builder_format (&b, &f[0], this->type.format,
+            this->type.media_type.video, this->subtype,
+            SPA_POD_PROP (&f[1], this->type.format_video.size, unset, SPA_POD_TYPE_RECTANGLE, 3,
+                                                              size.width, size.height,
+                                                              1, 1,
+                                                              INT32_MAX, INT32_MAX),
+            SPA_POD_PROP (&f[1], this->type.format_video.framerate, unset, SPA_POD_TYPE_FRACTION, 3,
+                                                              framerate.num, framerate.denom,
+                                                              0, 1,
+                                                              INT32_MAX, 1),
+            PROP (&f[1], this->type.format_video.stream_format, SPA_POD_TYPE_INT,
+                                                              SPA_H264_STREAM_FORMAT_BYTESTREAM),
+            PROP (&f[1], this->type.format_video.alignment,     SPA_POD_TYPE_INT,
+                                                              SPA_H264_ALIGNMENT_AU));
+      }
+      else {
+        spa_pod_builder_format (&b, &f[0], this->type.format,
+            this->type.media_type.video, this->subtype,
+            SPA_POD_PROP (&f[1], this->type.format_video.size, unset, SPA_POD_TYPE_RECTANGLE, 3,
+                                                              size.width, size.height,
+                                                              1, 1,
+                                                              INT32_MAX, INT32_MAX),
+            SPA_POD_PROP (&f[1], this->type.format_video.framerate, unset, SPA_POD_TYPE_FRACTION, 3,
+                                                              framerate.num, framerate.denom,
+                                                              0, 1,
+                                                              INT32_MAX, 1));
+      }
       break;
     default:
       return SPA_RESULT_ENUM_END;
   }
-  *format = NULL;
+  fmt = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaFormat);
+
+  spa_pod_builder_init (&b, this->format_buffer, sizeof (this->format_buffer));
+
+  if ((res = spa_format_filter (fmt, filter, &b)) != SPA_RESULT_OK || match++ != index)
+    goto next;
 
+  *format = SPA_POD_BUILDER_DEREF (&b, 0, SpaFormat);
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+clear_buffers (SpaFFMpegDec *this, SpaFFMpegPort *port)
+{
+  if (port->n_buffers > 0) {
+    spa_log_info (this->log, "ffmpeg-dec %p: clear buffers", this);
+    port->n_buffers = 0;
+    spa_list_init (&port->empty);
+  }
   return SPA_RESULT_OK;
 }
 
@@ -239,37 +433,114 @@ spa_ffmpeg_dec_node_port_set_format (SpaNode         *node,
                                      const SpaFormat *format)
 {
   SpaFFMpegDec *this;
-  SpaFFMpegPort *port;
+  SpaFFMpegPort *port, *other;
 
-  if (node == NULL || format == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   this = SPA_CONTAINER_OF (node, SpaFFMpegDec, node);
 
-  if (!IS_VALID_PORT (this, direction, port_id))
-    return SPA_RESULT_INVALID_PORT;
+  spa_return_val_if_fail (IS_VALID_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
 
-  port = direction == SPA_DIRECTION_INPUT ? &this->in_ports[port_id] : &this->out_ports[port_id];
+  port = GET_PORT (this, direction, port_id);
+  other = GET_OTHER_PORT (this, direction, port_id);
 
   if (format == NULL) {
     port->have_format = false;
-    return SPA_RESULT_OK;
+    clear_buffers (this, port);
   } else {
-    SpaVideoInfo info = { SPA_FORMAT_MEDIA_TYPE (format),
-                          SPA_FORMAT_MEDIA_SUBTYPE (format), };
+    uint32_t media_type = SPA_FORMAT_MEDIA_TYPE (format);
+    uint32_t media_subtype = SPA_FORMAT_MEDIA_SUBTYPE (format);
+    SpaRectangle size = { 0, 0 };
+    SpaFraction framerate = { 0, 1 };
+    SpaVideoInfoRaw raw = { 0, };
 
-    if (info.media_type != this->type.media_type.video &&
-        info.media_subtype != this->type.media_subtype.raw)
+    if (media_type != this->type.media_type.video)
       return SPA_RESULT_INVALID_MEDIA_TYPE;
 
-    if (!spa_format_video_raw_parse (format, &info.info.raw, &this->type.format_video))
+    if (direction == SPA_DIRECTION_OUTPUT) {
+      if (media_subtype != this->type.media_subtype.raw)
+        return SPA_RESULT_INVALID_MEDIA_TYPE;
+      if (!spa_format_video_raw_parse (format, &raw, &this->type.format_video))
+        return SPA_RESULT_INVALID_MEDIA_TYPE;
+      if (raw.format != this->type.video_format.I420)
+        return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+      size = raw.size;
+      framerate = raw.framerate;
+
+      if (size.width == 0 || size.height == 0)
+        return SPA_RESULT_INVALID_MEDIA_TYPE;
+    } else {
+      if (media_subtype != this->subtype)
+        return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+      /* the size is also in the stream, it is only needed here to
+       * negotiate the output */
+      spa_format_query (format,
+          this->type.format_video.size,      SPA_POD_TYPE_RECTANGLE, &size,
+          this->type.format_video.framerate, SPA_POD_TYPE_FRACTION,  &framerate,
+          0);
+    }
+
+    /* streams without a size in the format take any output size, the
+     * decoded frames are checked against it */
+    if (other->have_format && size.width != 0 && other->size.width != 0 &&
+        (size.width != other->size.width ||
+         size.height != other->size.height ||
+         framerate.num != other->framerate.num ||
+         framerate.denom != other->framerate.denom))
       return SPA_RESULT_INVALID_MEDIA_TYPE;
 
-    if (!(flags & SPA_PORT_FORMAT_FLAG_TEST_ONLY)) {
-      port->current_format = info;
-      port->have_format = true;
+    if (flags & SPA_PORT_FORMAT_FLAG_TEST_ONLY)
+      return SPA_RESULT_OK;
+
+    port->size = size;
+    port->framerate = framerate;
+
+    if (direction == SPA_DIRECTION_OUTPUT) {
+      port->format = raw.format;
+      port->pix_fmt = AV_PIX_FMT_YUV420P;
+      port->n_planes = spa_ffmpeg_get_n_planes (port->pix_fmt);
+      port->frame_size = spa_ffmpeg_get_layout (port->pix_fmt, size.height,
+                                                spa_ffmpeg_default_stride (size.width),
+                                                port->stride, port->offset);
+    } else {
+      /* room for an uncompressed I420 frame, packets are almost always
+       * a lot smaller than that */
+      port->stride[0] = 0;
+      port->frame_size = SPA_MAX (size.width * size.height * 3 / 2, 1024 * 1024);
     }
+    port->have_format = true;
   }
+  if (direction == SPA_DIRECTION_INPUT)
+    close_decoder (this);
+
+  if (port->have_format) {
+    SpaPODBuilder b = { NULL };
+    SpaPODFrame f[2];
+
+    port->info.maxbuffering = -1;
+    port->info.latency = 0;
+
+    port->info.n_params = 2;
+    port->info.params = port->params;
+
+    spa_pod_builder_init (&b, port->params_buffer, sizeof (port->params_buffer));
+    spa_pod_builder_object (&b, &f[0], 0, this->type.alloc_param_buffers.Buffers,
+      PROP      (&f[1], this->type.alloc_param_buffers.size,    SPA_POD_TYPE_INT, port->frame_size),
+      PROP      (&f[1], this->type.alloc_param_buffers.stride,  SPA_POD_TYPE_INT, port->stride[0]),
+      PROP_U_MM (&f[1], this->type.alloc_param_buffers.buffers, SPA_POD_TYPE_INT, MAX_BUFFERS, 2, MAX_BUFFERS),
+      PROP      (&f[1], this->type.alloc_param_buffers.align,   SPA_POD_TYPE_INT, 32));
+    port->params[0] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
+
+    spa_pod_builder_object (&b, &f[0], 0, this->type.alloc_param_meta_enable.MetaEnable,
+      PROP      (&f[1], this->type.alloc_param_meta_enable.type, SPA_POD_TYPE_ID, this->type.meta.Header),
+      PROP      (&f[1], this->type.alloc_param_meta_enable.size, SPA_POD_TYPE_INT, sizeof (SpaMetaHeader)));
+    port->params[1] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
+
+    port->info.extra = NULL;
+  }
+
   return SPA_RESULT_OK;
 }
 
@@ -281,21 +552,35 @@ spa_ffmpeg_dec_node_port_get_format (SpaNode          *node,
 {
   SpaFFMpegDec *this;
   SpaFFMpegPort *port;
+  SpaPODBuilder b = { NULL, };
+  SpaPODFrame f[2];
 
-  if (node == NULL || format == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (format != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   this = SPA_CONTAINER_OF (node, SpaFFMpegDec, node);
 
-  if (!IS_VALID_PORT (this, direction, port_id))
-    return SPA_RESULT_INVALID_PORT;
+  spa_return_val_if_fail (IS_VALID_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
 
-  port = direction == SPA_DIRECTION_INPUT ? &this->in_ports[port_id] : &this->out_ports[port_id];
+  port = GET_PORT (this, direction, port_id);
 
   if (!port->have_format)
     return SPA_RESULT_NO_FORMAT;
 
-  *format = NULL;
+  spa_pod_builder_init (&b, this->format_buffer, sizeof (this->format_buffer));
+  if (direction == SPA_DIRECTION_OUTPUT) {
+    spa_pod_builder_format (&b, &f[0], this->type.format,
+           this->type.media_type.video, this->type.media_subtype.raw,
+           PROP (&f[1], this->type.format_video.format,    SPA_POD_TYPE_ID,         port->format),
+           PROP (&f[1], this->type.format_video.size,      -SPA_POD_TYPE_RECTANGLE, &port->size),
+           PROP (&f[1], this->type.format_video.framerate, -SPA_POD_TYPE_FRACTION,  &port->framerate));
+  } else {
+    spa_pod_builder_format (&b, &f[0], this->type.format,
+           this->type.media_type.video, this->subtype,
+           PROP (&f[1], this->type.format_video.size,      -SPA_POD_TYPE_RECTANGLE, &port->size),
+           PROP (&f[1], this->type.format_video.framerate, -SPA_POD_TYPE_FRACTION,  &port->framerate));
+  }
+  *format = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaFormat);
 
   return SPA_RESULT_OK;
 }
@@ -309,15 +594,14 @@ spa_ffmpeg_dec_node_port_get_info (SpaNode            *node,
   SpaFFMpegDec *this;
   SpaFFMpegPort *port;
 
-  if (node == NULL || info == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (info != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   this = SPA_CONTAINER_OF (node, SpaFFMpegDec, node);
 
-  if (!IS_VALID_PORT (this, direction, port_id))
-    return SPA_RESULT_INVALID_PORT;
+  spa_return_val_if_fail (IS_VALID_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
 
-  port = direction == SPA_DIRECTION_INPUT ? &this->in_ports[port_id] : &this->out_ports[port_id];
+  port = GET_PORT (this, direction, port_id);
   *info = &port->info;
 
   return SPA_RESULT_OK;
@@ -348,13 +632,55 @@ spa_ffmpeg_dec_node_port_use_buffers (SpaNode         *node,
                                       SpaBuffer      **buffers,
                                       uint32_t         n_buffers)
 {
-  if (node == NULL)
+  SpaFFMpegDec *this;
+  SpaFFMpegPort *port;
+  uint32_t i, j;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaFFMpegDec, node);
+
+  spa_return_val_if_fail (IS_VALID_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  port = GET_PORT (this, direction, port_id);
+
+  if (!port->have_format)
+    return SPA_RESULT_NO_FORMAT;
+
+  if (n_buffers > MAX_BUFFERS)
     return SPA_RESULT_INVALID_ARGUMENTS;
 
-  if (!IS_VALID_PORT (node, direction, port_id))
-    return SPA_RESULT_INVALID_PORT;
+  clear_buffers (this, port);
+
+  for (i = 0; i < n_buffers; i++) {
+    FFMpegBuffer *b;
+    SpaData *d = buffers[i]->datas;
+
+    b = &port->buffers[i];
+    b->outbuf = buffers[i];
+    b->outstanding = true;
+    b->h = spa_buffer_find_meta (buffers[i], this->type.meta.Header);
+
+    for (j = 0; j < buffers[i]->n_datas; j++) {
+      if ((d[j].type != this->type.data.MemPtr &&
+           d[j].type != this->type.data.MemFd &&
+           d[j].type != this->type.data.DmaBuf) ||
+          d[j].data == NULL) {
+        spa_log_error (this->log, "ffmpeg-dec %p: invalid memory on buffer %p", this, buffers[i]);
+        return SPA_RESULT_ERROR;
+      }
+    }
+    if (direction == SPA_DIRECTION_OUTPUT) {
+      if (buffers[i]->n_datas < port->n_planes && d[0].maxsize < port->frame_size) {
+        spa_log_error (this->log, "ffmpeg-dec %p: buffer %p too small", this, buffers[i]);
+        return SPA_RESULT_ERROR;
+      }
+      spa_list_insert (port->empty.prev, &b->link);
+    }
+  }
+  port->n_buffers = n_buffers;
 
-  return SPA_RESULT_NOT_IMPLEMENTED;
+  return SPA_RESULT_OK;
 }
 
 static SpaResult
@@ -378,75 +704,326 @@ spa_ffmpeg_dec_node_port_set_io (SpaNode      *node,
   SpaFFMpegDec *this;
   SpaFFMpegPort *port;
 
-  if (node == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   this = SPA_CONTAINER_OF (node, SpaFFMpegDec, node);
 
-  if (!IS_VALID_PORT (this, direction, port_id))
-    return SPA_RESULT_INVALID_PORT;
+  spa_return_val_if_fail (IS_VALID_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
 
-  port = direction == SPA_DIRECTION_INPUT ? &this->in_ports[port_id] : &this->out_ports[port_id];
+  port = GET_PORT (this, direction, port_id);
   port->io = io;
 
   return SPA_RESULT_OK;
 }
 
 static SpaResult
-spa_ffmpeg_dec_node_process_input (SpaNode *node)
+spa_ffmpeg_dec_node_port_reuse_buffer (SpaNode         *node,
+                                       uint32_t         port_id,
+                                       uint32_t         buffer_id)
 {
-  return SPA_RESULT_INVALID_PORT;
+  SpaFFMpegDec *this;
+  SpaFFMpegPort *port;
+  FFMpegBuffer *b;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaFFMpegDec, node);
+
+  spa_return_val_if_fail (port_id == 0, SPA_RESULT_INVALID_PORT);
+
+  port = &this->out_ports[port_id];
+
+  if (port->n_buffers == 0)
+    return SPA_RESULT_NO_BUFFERS;
+
+  if (buffer_id >= port->n_buffers)
+    return SPA_RESULT_INVALID_BUFFER_ID;
+
+  b = &port->buffers[buffer_id];
+  if (!b->outstanding)
+    return SPA_RESULT_OK;
+
+  b->outstanding = false;
+  spa_list_insert (port->empty.prev, &b->link);
+
+  return SPA_RESULT_OK;
 }
 
 static SpaResult
-spa_ffmpeg_dec_node_process_output (SpaNode *node)
+spa_ffmpeg_dec_node_port_send_command (SpaNode        *node,
+                                       SpaDirection    direction,
+                                       uint32_t        port_id,
+                                       SpaCommand     *command)
 {
-  SpaFFMpegDec *this;
-  SpaFFMpegPort *port;
-  SpaPortIO *output;
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
 
-  if (node == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+static FFMpegBuffer *
+find_free_buffer (SpaFFMpegDec *this, SpaFFMpegPort *port)
+{
+  FFMpegBuffer *b;
 
-  this = SPA_CONTAINER_OF (node, SpaFFMpegDec, node);
+  if (spa_list_is_empty (&port->empty))
+    return NULL;
 
-  port = &this->out_ports[0];
+  b = spa_list_first (&port->empty, FFMpegBuffer, link);
+  spa_list_remove (&b->link);
+  b->outstanding = true;
 
-  if ((output = port->io) == NULL)
-    return SPA_RESULT_ERROR;
+  return b;
+}
 
-  if (!port->have_format) {
-    output->status = SPA_RESULT_NO_FORMAT;
+static inline void
+release_buffer (SpaFFMpegDec *this, SpaBuffer *buffer)
+{
+  this->callbacks.reuse_buffer (&this->node, 0, buffer->id, this->user_data);
+}
+
+static SpaResult
+open_decoder (SpaFFMpegDec *this)
+{
+  AVCodecContext *ctx;
+  int ret;
+
+  if ((ctx = avcodec_alloc_context3 (this->codec)) == NULL)
+    return SPA_RESULT_NO_MEMORY;
+
+  /* timestamps go in and out in nanoseconds */
+  ctx->pkt_timebase.num = 1;
+  ctx->pkt_timebase.den = SPA_NSEC_PER_SEC;
+  ctx->thread_count = this->props.threads;
+  /* frame threads delay the output by one frame per thread */
+  ctx->thread_type = spa_ffmpeg_get_thread_type (this->codec, this->props.low_latency);
+  if (this->props.low_latency)
+    ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+
+  if ((ret = avcodec_open2 (ctx, this->codec, NULL)) < 0) {
+    spa_log_error (this->log, "ffmpeg-dec %p: can't open %s: %d", this, this->codec->name, ret);
+    avcodec_free_context (&ctx);
     return SPA_RESULT_ERROR;
   }
-  output->status = SPA_RESULT_OK;
+  spa_log_info (this->log, "ffmpeg-dec %p: opened %s, %d threads, thread type %d", this,
+      this->codec->name, ctx->thread_count, ctx->active_thread_type);
+
+  this->ctx = ctx;
 
   return SPA_RESULT_OK;
 }
 
+static void
+close_decoder (SpaFFMpegDec *this)
+{
+  if (this->ctx)
+    avcodec_free_context (&this->ctx);
+}
+
+/* the buffer memory is handed to libavcodec as is, it makes its own
+ * padded copy of packets that it needs to keep */
+static int
+send_packet (SpaFFMpegDec *this, FFMpegBuffer *b)
+{
+  AVPacket *pkt = this->pkt;
+  SpaData *d = b->outbuf->datas;
+  int ret;
+
+  if (d[0].chunk->offset + d[0].chunk->size > d[0].maxsize)
+    return AVERROR (EINVAL);
+
+  pkt->data = SPA_MEMBER (d[0].data, d[0].chunk->offset, uint8_t);
+  pkt->size = d[0].chunk->size;
+  pkt->pts = b->h ? b->h->pts : AV_NOPTS_VALUE;
+  if (b->h && !(b->h->flags & SPA_META_HEADER_FLAG_DELTA_UNIT))
+    pkt->flags |= AV_PKT_FLAG_KEY;
+
+  ret = avcodec_send_packet (this->ctx, pkt);
+  /* the packet does not own the data, this only resets the fields */
+  av_packet_unref (pkt);
+
+  return ret;
+}
+
+static void
+copy_plane (uint8_t *dst, uint32_t dst_stride, const uint8_t *src, int src_stride,
+            uint32_t width, uint32_t height)
+{
+  uint32_t y;
+
+  for (y = 0; y < height; y++)
+    memcpy (dst + y * dst_stride, src + y * src_stride, width);
+}
+
+/* the number of lines in plane @i */
+static inline uint32_t
+plane_height (SpaFFMpegPort *port, uint32_t i)
+{
+  return i == 0 ? port->size.height : (port->size.height + 1) / 2;
+}
+
+/* check that all planes of the output layout fit in the memory of @buffer,
+ * with one data block per plane or with the planes in one block */
+static bool
+frame_fits (SpaFFMpegPort *port, SpaBuffer *buffer)
+{
+  SpaData *d = buffer->datas;
+  uint32_t i;
+
+  for (i = 0; i < port->n_planes; i++) {
+    uint64_t size = (uint64_t) port->stride[i] * plane_height (port, i);
+
+    if (buffer->n_datas >= port->n_planes) {
+      if (size > d[i].maxsize)
+        return false;
+    } else if (port->offset[i] + size > d[0].maxsize)
+      return false;
+  }
+  return true;
+}
+
 static SpaResult
-spa_ffmpeg_dec_node_port_reuse_buffer (SpaNode         *node,
-                                       uint32_t         port_id,
-                                       uint32_t         buffer_id)
+receive_frame (SpaFFMpegDec *this, FFMpegBuffer *db)
 {
-  if (node == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  SpaFFMpegPort *port = &this->out_ports[0];
+  AVFrame *frame = this->frame;
+  SpaData *d = db->outbuf->datas;
+  uint32_t i, width, height;
+  int ret;
+
+  if ((ret = avcodec_receive_frame (this->ctx, frame)) == AVERROR (EAGAIN))
+    return SPA_RESULT_NEED_BUFFER;
+  else if (ret < 0) {
+    spa_log_error (this->log, "ffmpeg-dec %p: decoding failed: %d", this, ret);
+    return SPA_RESULT_ERROR;
+  }
+
+  if (frame->width != (int) port->size.width ||
+      frame->height != (int) port->size.height ||
+      spa_ffmpeg_get_video_format (&this->type.video_format, frame->format) != port->format) {
+    spa_log_error (this->log, "ffmpeg-dec %p: decoded %dx%d format %d does not match the output",
+        this, frame->width, frame->height, frame->format);
+    av_frame_unref (frame);
+    return SPA_RESULT_ERROR;
+  }
+  if (!frame_fits (port, db->outbuf)) {
+    spa_log_error (this->log, "ffmpeg-dec %p: output buffer too small", this);
+    av_frame_unref (frame);
+    return SPA_RESULT_ERROR;
+  }
 
-  if (port_id != 0)
-    return SPA_RESULT_INVALID_PORT;
+  for (i = 0; i < port->n_planes; i++) {
+    uint8_t *dst;
+    uint32_t dst_stride;
+
+    width = i == 0 ? port->size.width : (port->size.width + 1) / 2;
+    height = plane_height (port, i);
+
+    if (db->outbuf->n_datas >= port->n_planes) {
+      dst = d[i].data;
+      dst_stride = port->stride[i];
+      d[i].chunk->offset = 0;
+      d[i].chunk->size = dst_stride * height;
+      d[i].chunk->stride = dst_stride;
+    } else {
+      dst = SPA_MEMBER (d[0].data, port->offset[i], uint8_t);
+      dst_stride = port->stride[i];
+    }
+    copy_plane (dst, dst_stride, frame->data[i], frame->linesize[i], width, height);
+  }
+  if (db->outbuf->n_datas < port->n_planes) {
+    d[0].chunk->offset = 0;
+    d[0].chunk->size = port->frame_size;
+    d[0].chunk->stride = port->stride[0];
+  }
 
-  return SPA_RESULT_NOT_IMPLEMENTED;
+  if (db->h) {
+    db->h->flags = 0;
+    if (frame->decode_error_flags || (frame->flags & AV_FRAME_FLAG_CORRUPT))
+      db->h->flags |= SPA_META_HEADER_FLAG_CORRUPTED;
+    db->h->seq = this->seq++;
+    db->h->pts = frame->pts != AV_NOPTS_VALUE ? frame->pts : 0;
+    db->h->dts_offset = 0;
+  }
+  av_frame_unref (frame);
+
+  port->io->buffer_id = db->outbuf->id;
+  port->io->status = SPA_RESULT_OK;
+
+  return SPA_RESULT_HAVE_BUFFER;
 }
 
 static SpaResult
-spa_ffmpeg_dec_node_port_send_command (SpaNode        *node,
-                                       SpaDirection    direction,
-                                       uint32_t        port_id,
-                                       SpaCommand     *command)
+spa_ffmpeg_dec_node_process_input (SpaNode *node)
 {
-  return SPA_RESULT_NOT_IMPLEMENTED;
+  SpaFFMpegDec *this;
+  SpaPortIO *input;
+  SpaPortIO *output;
+  SpaFFMpegPort *in_port, *out_port;
+  FFMpegBuffer *db;
+  SpaResult res;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaFFMpegDec, node);
+
+  in_port = &this->in_ports[0];
+  out_port = &this->out_ports[0];
+
+  if ((input = in_port->io) == NULL)
+    return SPA_RESULT_ERROR;
+  if ((output = out_port->io) == NULL)
+    return SPA_RESULT_ERROR;
+
+  if (!in_port->have_format || !out_port->have_format) {
+    input->status = SPA_RESULT_NO_FORMAT;
+    return SPA_RESULT_ERROR;
+  }
+
+  if (this->ctx == NULL && (res = open_decoder (this)) != SPA_RESULT_OK) {
+    input->status = res;
+    return SPA_RESULT_ERROR;
+  }
+
+  if (input->buffer_id != SPA_ID_INVALID) {
+    FFMpegBuffer *sb;
+    int ret;
+
+    if (input->buffer_id >= in_port->n_buffers) {
+      input->status = SPA_RESULT_INVALID_BUFFER_ID;
+      return SPA_RESULT_ERROR;
+    }
+    sb = &in_port->buffers[input->buffer_id];
+
+    /* when the decoder is full, the input stays until we took a frame */
+    if ((ret = send_packet (this, sb)) != AVERROR (EAGAIN)) {
+      input->buffer_id = SPA_ID_INVALID;
+      input->status = SPA_RESULT_OK;
+
+      if (ret < 0)
+        spa_log_warn (this->log, "ffmpeg-dec %p: dropping packet: %d", this, ret);
+      release_buffer (this, sb->outbuf);
+    }
+  }
+
+  if (output->buffer_id < out_port->n_buffers) {
+    db = &out_port->buffers[output->buffer_id];
+  } else {
+    db = find_free_buffer (this, out_port);
+  }
+  if (db == NULL)
+    return SPA_RESULT_OUT_OF_BUFFERS;
+
+  if ((res = receive_frame (this, db)) != SPA_RESULT_HAVE_BUFFER) {
+    output->buffer_id = SPA_ID_INVALID;
+    db->outstanding = false;
+    spa_list_insert (out_port->empty.prev, &db->link);
+  }
+  return res;
 }
 
+static SpaResult
+spa_ffmpeg_dec_node_process_output (SpaNode *node)
+{
+  return SPA_RESULT_NEED_BUFFER;
+}
 
 static const SpaNode ffmpeg_dec_node = {
   sizeof (SpaNode),
@@ -481,8 +1058,8 @@ spa_ffmpeg_dec_get_interface (SpaHandle         *handle,
 {
   SpaFFMpegDec *this;
 
-  if (handle == NULL || interface == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (interface != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   this = (SpaFFMpegDec *) handle;
 
@@ -494,16 +1071,36 @@ spa_ffmpeg_dec_get_interface (SpaHandle         *handle,
   return SPA_RESULT_OK;
 }
 
+static SpaResult
+spa_ffmpeg_dec_clear (SpaHandle *handle)
+{
+  SpaFFMpegDec *this;
+
+  spa_return_val_if_fail (handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = (SpaFFMpegDec *) handle;
+
+  close_decoder (this);
+  av_packet_free (&this->pkt);
+  av_frame_free (&this->frame);
+
+  return SPA_RESULT_OK;
+}
+
+const size_t spa_ffmpeg_dec_size = sizeof (SpaFFMpegDec);
+
 SpaResult
 spa_ffmpeg_dec_init (SpaHandle         *handle,
                      const SpaDict     *info,
                      const SpaSupport  *support,
-                     uint32_t           n_support)
+                     uint32_t           n_support,
+                     AVCodec           *codec)
 {
   SpaFFMpegDec *this;
   uint32_t i;
 
   handle->get_interface = spa_ffmpeg_dec_get_interface;
+  handle->clear = spa_ffmpeg_dec_clear;
 
   this = (SpaFFMpegDec *) handle;
 
@@ -519,10 +1116,28 @@ spa_ffmpeg_dec_init (SpaHandle         *handle,
   }
   init_type (&this->type, this->map);
 
+  this->codec = codec;
+  this->subtype = spa_ffmpeg_get_media_subtype (&this->type.media_subtype_video, codec->id);
+  if (this->subtype == 0) {
+    spa_log_error (this->log, "ffmpeg-dec %p: unsupported codec %s", this, codec->name);
+    return SPA_RESULT_ERROR;
+  }
+  if ((this->frame = av_frame_alloc ()) == NULL)
+    return SPA_RESULT_NO_MEMORY;
+  if ((this->pkt = av_packet_alloc ()) == NULL) {
+    av_frame_free (&this->frame);
+    return SPA_RESULT_NO_MEMORY;
+  }
+
   this->node = ffmpeg_dec_node;
+  reset_ffmpeg_dec_props (&this->props);
+
+  this->in_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
+  spa_list_init (&this->in_ports[0].empty);
 
-  this->in_ports[0].info.flags = 0;
-  this->out_ports[0].info.flags = 0;
+  this->out_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS |
+                                  SPA_PORT_INFO_FLAG_NO_REF;
+  spa_list_init (&this->out_ports[0].empty);
 
   return SPA_RESULT_OK;
 }
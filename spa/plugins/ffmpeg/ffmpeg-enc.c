@@ -17,6 +17,7 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include <string.h>
 #include <stddef.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -25,52 +26,102 @@
 #include <spa/log.h>
 #include <spa/type-map.h>
 #include <spa/node.h>
-#include <spa/video/format-utils.h>
+#include <spa/list.h>
+#include <spa/format-builder.h>
 #include <lib/props.h>
 
+#include <libavutil/dict.h>
+
+#include "ffmpeg.h"
+
 typedef struct _SpaFFMpegEnc SpaFFMpegEnc;
 
 #define IS_VALID_PORT(this,d,id) ((id) == 0)
 #define MAX_BUFFERS    32
+#define MAX_PLANES     3
+/* the buffer timestamps of this many frames are kept while the frames
+ * are in the encoder */
+#define MAX_DELAY      256
+
+typedef struct {
+  int32_t threads;
+  bool low_latency;
+  int32_t bitrate;
+} SpaFFMpegEncProps;
 
 typedef struct _FFMpegBuffer FFMpegBuffer;
 
 struct _FFMpegBuffer {
-  SpaBuffer buffer;
-  SpaMeta metas[1];
-  SpaMetaHeader header;
-  SpaData datas[1];
-  SpaFFMpegEnc *enc;
-  SpaBuffer *imported;
+  SpaBuffer *outbuf;
   bool outstanding;
-  FFMpegBuffer *next;
+  SpaMetaHeader *h;
+  /* set when libavcodec drops its last reference to an input buffer,
+   * this can happen on one of the encoder threads */
+  bool released;
+  SpaList link;
 };
 
 typedef struct {
   bool have_format;
-  SpaVideoInfo current_format;
-  bool have_buffers;
-  FFMpegBuffer buffers[MAX_BUFFERS];
+  SpaRectangle size;
+  SpaFraction framerate;
+  /* raw video on the input port */
+  uint32_t format;
+  enum AVPixelFormat pix_fmt;
+  uint32_t n_planes;
+  uint32_t stride[MAX_PLANES];
+  uint32_t offset[MAX_PLANES];
+  uint32_t frame_size;
+
   SpaPortInfo info;
+  SpaAllocParam *params[2];
+  uint8_t params_buffer[1024];
+
+  FFMpegBuffer buffers[MAX_BUFFERS];
+  uint32_t n_buffers;
   SpaPortIO *io;
+
+  SpaList empty;
 } SpaFFMpegPort;
 
 typedef struct {
   uint32_t node;
+  uint32_t format;
+  uint32_t props;
+  uint32_t prop_threads;
+  uint32_t prop_low_latency;
+  uint32_t prop_bitrate;
+  SpaTypeMeta meta;
+  SpaTypeData data;
   SpaTypeMediaType media_type;
   SpaTypeMediaSubtype media_subtype;
+  SpaTypeMediaSubtypeVideo media_subtype_video;
   SpaTypeFormatVideo format_video;
+  SpaTypeVideoFormat video_format;
   SpaTypeCommandNode command_node;
+  SpaTypeAllocParamBuffers alloc_param_buffers;
+  SpaTypeAllocParamMetaEnable alloc_param_meta_enable;
 } Type;
 
 static inline void
 init_type (Type *type, SpaTypeMap *map)
 {
   type->node = spa_type_map_get_id (map, SPA_TYPE__Node);
+  type->format = spa_type_map_get_id (map, SPA_TYPE__Format);
+  type->props = spa_type_map_get_id (map, SPA_TYPE__Props);
+  type->prop_threads = spa_type_map_get_id (map, SPA_TYPE_PROPS__threads);
+  type->prop_low_latency = spa_type_map_get_id (map, SPA_TYPE_PROPS__lowLatency);
+  type->prop_bitrate = spa_type_map_get_id (map, SPA_TYPE_PROPS__bitrate);
+  spa_type_meta_map (map, &type->meta);
+  spa_type_data_map (map, &type->data);
   spa_type_media_type_map (map, &type->media_type);
   spa_type_media_subtype_map (map, &type->media_subtype);
+  spa_type_media_subtype_video_map (map, &type->media_subtype_video);
   spa_type_format_video_map (map, &type->format_video);
+  spa_type_video_format_map (map, &type->video_format);
   spa_type_command_node_map (map, &type->command_node);
+  spa_type_alloc_param_buffers_map (map, &type->alloc_param_buffers);
+  spa_type_alloc_param_meta_enable_map (map, &type->alloc_param_meta_enable);
 }
 
 struct _SpaFFMpegEnc {
@@ -81,27 +132,109 @@ struct _SpaFFMpegEnc {
   SpaTypeMap *map;
   SpaLog *log;
 
+  uint8_t props_buffer[512];
+  SpaFFMpegEncProps props;
+
   SpaNodeCallbacks callbacks;
   void *user_data;
 
+  uint8_t format_buffer[1024];
+
   SpaFFMpegPort in_ports[1];
   SpaFFMpegPort out_ports[1];
 
+  AVCodec *codec;
+  uint32_t subtype;
+  AVCodecContext *ctx;
+  AVFrame *frame;
+  AVPacket *pkt;
+
+  /* frames are numbered in the encoder, this maps them back to the
+   * timestamps of the input buffers */
+  int64_t n_frames;
+  int64_t pts[MAX_DELAY];
+  uint32_t seq;
+
   bool started;
 };
 
+#define GET_PORT(this,d,p)       ((d) == SPA_DIRECTION_INPUT ? &(this)->in_ports[p] : &(this)->out_ports[p])
+#define GET_OTHER_PORT(this,d,p) ((d) == SPA_DIRECTION_INPUT ? &(this)->out_ports[p] : &(this)->in_ports[p])
+
+#define DEFAULT_THREADS      0
+#define DEFAULT_LOW_LATENCY  false
+#define DEFAULT_BITRATE      4000000
+
+static void
+reset_ffmpeg_enc_props (SpaFFMpegEncProps *props)
+{
+  props->threads = DEFAULT_THREADS;
+  props->low_latency = DEFAULT_LOW_LATENCY;
+  props->bitrate = DEFAULT_BITRATE;
+}
+
+#define PROP(f,key,type,...)                                                    \
+          SPA_POD_PROP (f,key,0,type,1,__VA_ARGS__)
+#define PROP_MM(f,key,type,...)                                                 \
+          SPA_POD_PROP (f,key,SPA_POD_PROP_RANGE_MIN_MAX,type,3,__VA_ARGS__)
+#define PROP_U_MM(f,key,type,...)                                               \
+          SPA_POD_PROP (f,key,SPA_POD_PROP_FLAG_UNSET |                         \
+                              SPA_POD_PROP_RANGE_MIN_MAX,type,3,__VA_ARGS__)
+#define PROP_U_EN(f,key,type,n,...)                                             \
+          SPA_POD_PROP (f,key,SPA_POD_PROP_FLAG_UNSET |                         \
+                              SPA_POD_PROP_RANGE_ENUM,type,n,__VA_ARGS__)
+
+static void close_encoder (SpaFFMpegEnc *this);
+
 static SpaResult
 spa_ffmpeg_enc_node_get_props (SpaNode       *node,
                                SpaProps     **props)
 {
-  return SPA_RESULT_NOT_IMPLEMENTED;
+  SpaFFMpegEnc *this;
+  SpaPODBuilder b = { NULL,  };
+  SpaPODFrame f[2];
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (props != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaFFMpegEnc, node);
+
+  spa_pod_builder_init (&b, this->props_buffer, sizeof (this->props_buffer));
+  spa_pod_builder_props (&b, &f[0], this->type.props,
+      PROP_MM (&f[1], this->type.prop_threads,     SPA_POD_TYPE_INT,  this->props.threads,
+                                                                      0, SPA_FFMPEG_MAX_THREADS),
+      PROP    (&f[1], this->type.prop_low_latency, SPA_POD_TYPE_BOOL, this->props.low_latency),
+      PROP_MM (&f[1], this->type.prop_bitrate,     SPA_POD_TYPE_INT,  this->props.bitrate,
+                                                                      1, INT32_MAX));
+  *props = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaProps);
+
+  return SPA_RESULT_OK;
 }
 
 static SpaResult
 spa_ffmpeg_enc_node_set_props (SpaNode         *node,
                                const SpaProps  *props)
 {
-  return SPA_RESULT_NOT_IMPLEMENTED;
+  SpaFFMpegEnc *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaFFMpegEnc, node);
+
+  if (props == NULL) {
+    reset_ffmpeg_enc_props (&this->props);
+  } else {
+    spa_props_query (props,
+        this->type.prop_threads,     SPA_POD_TYPE_INT,  &this->props.threads,
+        this->type.prop_low_latency, SPA_POD_TYPE_BOOL, &this->props.low_latency,
+        this->type.prop_bitrate,     SPA_POD_TYPE_INT,  &this->props.bitrate,
+        0);
+  }
+  /* the settings are applied when the encoder is opened again for
+   * the next frame */
+  close_encoder (this);
+
+  return SPA_RESULT_OK;
 }
 
 static SpaResult
@@ -110,8 +243,8 @@ spa_ffmpeg_enc_node_send_command (SpaNode    *node,
 {
   SpaFFMpegEnc *this;
 
-  if (node == NULL || command == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (command != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   this = SPA_CONTAINER_OF (node, SpaFFMpegEnc, node);
 
@@ -135,8 +268,7 @@ spa_ffmpeg_enc_node_set_callbacks (SpaNode                *node,
 {
   SpaFFMpegEnc *this;
 
-  if (node == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   this = SPA_CONTAINER_OF (node, SpaFFMpegEnc, node);
 
@@ -153,8 +285,7 @@ spa_ffmpeg_enc_node_get_n_ports (SpaNode       *node,
                                  uint32_t      *n_output_ports,
                                  uint32_t      *max_output_ports)
 {
-  if (node == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   if (n_input_ports)
     *n_input_ports = 1;
@@ -175,8 +306,7 @@ spa_ffmpeg_enc_node_get_port_ids (SpaNode       *node,
                                   uint32_t       n_output_ports,
                                   uint32_t      *output_ids)
 {
-  if (node == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   if (n_input_ports > 0 && input_ids != NULL)
     input_ids[0] = 0;
@@ -203,6 +333,21 @@ spa_ffmpeg_enc_node_remove_port (SpaNode        *node,
   return SPA_RESULT_NOT_IMPLEMENTED;
 }
 
+/* the raw formats of the encoder, returns the number of formats */
+static uint32_t
+get_raw_formats (SpaFFMpegEnc *this, uint32_t formats[2])
+{
+  SpaTypeVideoFormat *vf = &this->type.video_format;
+  const enum AVPixelFormat *p;
+  uint32_t n = 0;
+
+  for (p = this->codec->pix_fmts; p && *p != AV_PIX_FMT_NONE && n < 2; p++) {
+    if (*p == AV_PIX_FMT_YUV420P || *p == AV_PIX_FMT_NV12)
+      formats[n++] = spa_ffmpeg_get_video_format (vf, *p);
+  }
+  return n;
+}
+
 static SpaResult
 spa_ffmpeg_enc_node_port_enum_formats (SpaNode         *node,
                                        SpaDirection     direction,
@@ -211,30 +356,117 @@ spa_ffmpeg_enc_node_port_enum_formats (SpaNode         *node,
                                        const SpaFormat *filter,
                                        uint32_t         index)
 {
-  //SpaFFMpegEnc *this;
-  //SpaFFMpegPort *port;
+  SpaFFMpegEnc *this;
+  SpaFFMpegPort *other;
+  SpaResult res;
+  SpaFormat *fmt;
+  uint8_t buffer[1024];
+  SpaPODBuilder b = { NULL, };
+  SpaPODFrame f[2];
+  uint32_t count, match, formats[2];
+  SpaRectangle size = { 320, 240 };
+  SpaFraction framerate = { 25, 1 };
+  uint32_t unset;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (format != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
-  if (node == NULL || format == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  this = SPA_CONTAINER_OF (node, SpaFFMpegEnc, node);
 
-  //this = SPA_CONTAINER_OF (node, SpaFFMpegEnc, node);
+  spa_return_val_if_fail (IS_VALID_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
 
-  if (!IS_VALID_PORT (this, direction, port_id))
-    return SPA_RESULT_INVALID_PORT;
+  other = GET_OTHER_PORT (this, direction, port_id);
 
-  //port = direction == SPA_DIRECTION_INPUT ? &this->in_ports[port_id] : &this->out_ports[port_id];
+  /* size and framerate are fixed once the other port has a format */
+  if (other->have_format) {
+    size = other->size;
+    framerate = other->framerate;
+    unset = 0;
+  } else {
+    unset = SPA_POD_PROP_FLAG_UNSET | SPA_POD_PROP_RANGE_MIN_MAX;
+  }
+
+  count = match = filter ? 0 : index;
+
+next:
+  spa_pod_builder_init (&b, buffer, sizeof (buffer));
 
-  switch (index) {
+  switch (count++) {
     case 0:
+      if (direction == SPA_DIRECTION_INPUT) {
+        if (get_raw_formats (this, formats) == 1)
+          formats[1] = formats[0];
+
+        spa_pod_builder_format (&b, &f[0], this->type.format,
+            this->type.media_type.video, this->type.media_subtype.raw,
+            PROP_U_EN (&f[1], this->type.format_video.format, SPA_POD_TYPE_ID, 3,
+                                                              formats[0],
+                                                              formats[0],
+                                                              formats[1]),
+            SPA_POD_PROP (&f[1], this->type.format_video.size, unset, SPA_POD_TYPE_RECTANGLE, 3,
+                                                              size.width, size.height,
+                                                              1, 1,
+                                                              INT32_MAX, INT32_MAX),
+            SPA_POD_PROP (&f[1], this->type.format_video.framerate, unset, SPA_POD_TYPE_FRACTION, 3,
+                                                              framerate.num, framerate.denom,
+                                                              0, 1,
+                                                              INT32_MAX, 1));
+      }
+      else if (this->subtype == this->type.media_subtype_video.h264) {
+        spa_pod_builder_format (&b, &f[0], this->type.format,
+            this->type.media_type.video, this->subtype,
+            SPA_POD_PROP (&f[1], this->type.format_video.size, unset, SPA_POD_TYPE_RECTANGLE, 3,
+                                                              size.width, size.height,
+                                                              1, 1,
+                                                              INT32_MAX, INT32_MAX),
+            SPA_POD_PROP (&f[1], this->type.format_video.framerate, unset, SPA_POD_TYPE_FRACTION, 3,
+                                                              framerate.num, framerate.denom,
+                                                              0, 1,
+                                                              INT32_MAX, 1),
+            PROP (&f[1], this->type.format_video.stream_format, SPA_POD_TYPE_INT,
+                                                              SPA_H264_STREAM_FORMAT_BYTESTREAM),
+            PROP (&f[1], this->type.format_video.alignment,     SPA_POD_TYPE_INT,
+                                                              SPA_H264_ALIGNMENT_AU));
+      }
+      else {
+        spa_pod_builder_format (&b, &f[0], this->type.format,
+            this->type.media_type.video, this->subtype,
+            SPA_POD_PROP (&f[1], this->type.format_video.size, unset, SPA_POD_TYPE_RECTANGLE, 3,
+                                                              size.width, size.height,
+                                                              1, 1,
+                                                              INT32_MAX, INT32_MAX),
+            SPA_POD_PROP (&f[1], this->type.format_video.framerate, unset, SPA_POD_TYPE_FRACTION, 3,
+                                                              framerate.num, framerate.denom,
+                                                              0, 1,
+                                                              INT32_MAX, 1));
+      }
       break;
     default:
       return SPA_RESULT_ENUM_END;
   }
-  *format = NULL;
+  fmt = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaFormat);
+
+  spa_pod_builder_init (&b, this->format_buffer, sizeof (this->format_buffer));
+
+  if ((res = spa_format_filter (fmt, filter, &b)) != SPA_RESULT_OK || match++ != index)
+    goto next;
+
+  *format = SPA_POD_BUILDER_DEREF (&b, 0, SpaFormat);
 
   return SPA_RESULT_OK;
 }
 
+static SpaResult
+clear_buffers (SpaFFMpegEnc *this, SpaFFMpegPort *port)
+{
+  if (port->n_buffers > 0) {
+    spa_log_info (this->log, "ffmpeg-enc %p: clear buffers", this);
+    port->n_buffers = 0;
+    spa_list_init (&port->empty);
+  }
+  return SPA_RESULT_OK;
+}
+
 static SpaResult
 spa_ffmpeg_enc_node_port_set_format (SpaNode         *node,
                                      SpaDirection     direction,
@@ -243,37 +475,118 @@ spa_ffmpeg_enc_node_port_set_format (SpaNode         *node,
                                      const SpaFormat *format)
 {
   SpaFFMpegEnc *this;
-  SpaFFMpegPort *port;
+  SpaFFMpegPort *port, *other;
 
-  if (node == NULL || format == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   this = SPA_CONTAINER_OF (node, SpaFFMpegEnc, node);
 
-  if (!IS_VALID_PORT (this, direction, port_id))
-    return SPA_RESULT_INVALID_PORT;
+  spa_return_val_if_fail (IS_VALID_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
 
-  port = direction == SPA_DIRECTION_INPUT ? &this->in_ports[port_id] : &this->out_ports[port_id];
+  port = GET_PORT (this, direction, port_id);
+  other = GET_OTHER_PORT (this, direction, port_id);
 
   if (format == NULL) {
     port->have_format = false;
-    return SPA_RESULT_OK;
+    clear_buffers (this, port);
   } else {
-    SpaVideoInfo info = { SPA_FORMAT_MEDIA_TYPE (format),
-                          SPA_FORMAT_MEDIA_SUBTYPE (format), };
+    uint32_t media_type = SPA_FORMAT_MEDIA_TYPE (format);
+    uint32_t media_subtype = SPA_FORMAT_MEDIA_SUBTYPE (format);
+    SpaRectangle size = { 0, 0 };
+    SpaFraction framerate = { 0, 1 };
+    SpaVideoInfoRaw raw = { 0, };
+    enum AVPixelFormat pix_fmt = AV_PIX_FMT_NONE;
+
+    if (media_type != this->type.media_type.video)
+      return SPA_RESULT_INVALID_MEDIA_TYPE;
 
-    if (info.media_type != this->type.media_type.video &&
-        info.media_subtype != this->type.media_subtype.raw)
+    if (direction == SPA_DIRECTION_INPUT) {
+      const enum AVPixelFormat *p;
+
+      if (media_subtype != this->type.media_subtype.raw)
+        return SPA_RESULT_INVALID_MEDIA_TYPE;
+      if (!spa_format_video_raw_parse (format, &raw, &this->type.format_video))
+        return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+      pix_fmt = spa_ffmpeg_get_pix_fmt (&this->type.video_format, raw.format);
+      for (p = this->codec->pix_fmts; p && *p != AV_PIX_FMT_NONE; p++) {
+        if (*p == pix_fmt)
+          break;
+      }
+      if (pix_fmt == AV_PIX_FMT_NONE || p == NULL || *p == AV_PIX_FMT_NONE)
+        return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+      size = raw.size;
+      framerate = raw.framerate;
+    } else {
+      if (media_subtype != this->subtype)
+        return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+      spa_format_query (format,
+          this->type.format_video.size,      SPA_POD_TYPE_RECTANGLE, &size,
+          this->type.format_video.framerate, SPA_POD_TYPE_FRACTION,  &framerate,
+          0);
+    }
+
+    if (size.width == 0 || size.height == 0)
       return SPA_RESULT_INVALID_MEDIA_TYPE;
 
-    if (!spa_format_video_raw_parse (format, &info.info.raw, &this->type.format_video))
+    if (other->have_format &&
+        (size.width != other->size.width ||
+         size.height != other->size.height ||
+         framerate.num != other->framerate.num ||
+         framerate.denom != other->framerate.denom))
       return SPA_RESULT_INVALID_MEDIA_TYPE;
 
-    if (!(flags & SPA_PORT_FORMAT_FLAG_TEST_ONLY)) {
-      port->current_format = info;
-      port->have_format = true;
+    if (flags & SPA_PORT_FORMAT_FLAG_TEST_ONLY)
+      return SPA_RESULT_OK;
+
+    port->size = size;
+    port->framerate = framerate;
+
+    if (direction == SPA_DIRECTION_INPUT) {
+      port->format = raw.format;
+      port->pix_fmt = pix_fmt;
+      port->n_planes = spa_ffmpeg_get_n_planes (pix_fmt);
+      port->frame_size = spa_ffmpeg_get_layout (pix_fmt, size.height,
+                                                spa_ffmpeg_default_stride (size.width),
+                                                port->stride, port->offset);
+    } else {
+      /* room for an uncompressed I420 frame, packets are almost always
+       * a lot smaller than that */
+      port->stride[0] = 0;
+      port->frame_size = size.width * size.height * 3 / 2;
     }
+    port->have_format = true;
+  }
+  close_encoder (this);
+
+  if (port->have_format) {
+    SpaPODBuilder b = { NULL };
+    SpaPODFrame f[2];
+
+    port->info.maxbuffering = -1;
+    port->info.latency = 0;
+
+    port->info.n_params = 2;
+    port->info.params = port->params;
+
+    spa_pod_builder_init (&b, port->params_buffer, sizeof (port->params_buffer));
+    spa_pod_builder_object (&b, &f[0], 0, this->type.alloc_param_buffers.Buffers,
+      PROP      (&f[1], this->type.alloc_param_buffers.size,    SPA_POD_TYPE_INT, port->frame_size),
+      PROP      (&f[1], this->type.alloc_param_buffers.stride,  SPA_POD_TYPE_INT, port->stride[0]),
+      PROP_U_MM (&f[1], this->type.alloc_param_buffers.buffers, SPA_POD_TYPE_INT, MAX_BUFFERS, 2, MAX_BUFFERS),
+      PROP      (&f[1], this->type.alloc_param_buffers.align,   SPA_POD_TYPE_INT, 32));
+    port->params[0] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
+
+    spa_pod_builder_object (&b, &f[0], 0, this->type.alloc_param_meta_enable.MetaEnable,
+      PROP      (&f[1], this->type.alloc_param_meta_enable.type, SPA_POD_TYPE_ID, this->type.meta.Header),
+      PROP      (&f[1], this->type.alloc_param_meta_enable.size, SPA_POD_TYPE_INT, sizeof (SpaMetaHeader)));
+    port->params[1] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
+
+    port->info.extra = NULL;
   }
+
   return SPA_RESULT_OK;
 }
 
@@ -285,21 +598,35 @@ spa_ffmpeg_enc_node_port_get_format (SpaNode          *node,
 {
   SpaFFMpegEnc *this;
   SpaFFMpegPort *port;
+  SpaPODBuilder b = { NULL, };
+  SpaPODFrame f[2];
 
-  if (node == NULL || format == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (format != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   this = SPA_CONTAINER_OF (node, SpaFFMpegEnc, node);
 
-  if (!IS_VALID_PORT (this, direction, port_id))
-    return SPA_RESULT_INVALID_PORT;
+  spa_return_val_if_fail (IS_VALID_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
 
-  port = direction == SPA_DIRECTION_INPUT ? &this->in_ports[port_id] : &this->out_ports[port_id];
+  port = GET_PORT (this, direction, port_id);
 
   if (!port->have_format)
     return SPA_RESULT_NO_FORMAT;
 
-  *format = NULL;
+  spa_pod_builder_init (&b, this->format_buffer, sizeof (this->format_buffer));
+  if (direction == SPA_DIRECTION_INPUT) {
+    spa_pod_builder_format (&b, &f[0], this->type.format,
+           this->type.media_type.video, this->type.media_subtype.raw,
+           PROP (&f[1], this->type.format_video.format,    SPA_POD_TYPE_ID,         port->format),
+           PROP (&f[1], this->type.format_video.size,      -SPA_POD_TYPE_RECTANGLE, &port->size),
+           PROP (&f[1], this->type.format_video.framerate, -SPA_POD_TYPE_FRACTION,  &port->framerate));
+  } else {
+    spa_pod_builder_format (&b, &f[0], this->type.format,
+           this->type.media_type.video, this->subtype,
+           PROP (&f[1], this->type.format_video.size,      -SPA_POD_TYPE_RECTANGLE, &port->size),
+           PROP (&f[1], this->type.format_video.framerate, -SPA_POD_TYPE_FRACTION,  &port->framerate));
+  }
+  *format = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaFormat);
 
   return SPA_RESULT_OK;
 }
@@ -313,25 +640,24 @@ spa_ffmpeg_enc_node_port_get_info (SpaNode            *node,
   SpaFFMpegEnc *this;
   SpaFFMpegPort *port;
 
-  if (node == NULL || info == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (info != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   this = SPA_CONTAINER_OF (node, SpaFFMpegEnc, node);
 
-  if (!IS_VALID_PORT (this, direction, port_id))
-    return SPA_RESULT_INVALID_PORT;
+  spa_return_val_if_fail (IS_VALID_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
 
-  port = direction == SPA_DIRECTION_INPUT ? &this->in_ports[port_id] : &this->out_ports[port_id];
+  port = GET_PORT (this, direction, port_id);
   *info = &port->info;
 
   return SPA_RESULT_OK;
 }
 
 static SpaResult
-spa_ffmpeg_enc_node_port_get_props (SpaNode       *node,
-                                    SpaDirection   direction,
-                                    uint32_t       port_id,
-                                    SpaProps     **props)
+spa_ffmpeg_enc_node_port_get_props (SpaNode        *node,
+                                    SpaDirection    direction,
+                                    uint32_t        port_id,
+                                    SpaProps      **props)
 {
   return SPA_RESULT_NOT_IMPLEMENTED;
 }
@@ -352,13 +678,53 @@ spa_ffmpeg_enc_node_port_use_buffers (SpaNode         *node,
                                       SpaBuffer      **buffers,
                                       uint32_t         n_buffers)
 {
-  if (node == NULL)
+  SpaFFMpegEnc *this;
+  SpaFFMpegPort *port;
+  uint32_t i, j;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaFFMpegEnc, node);
+
+  spa_return_val_if_fail (IS_VALID_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  port = GET_PORT (this, direction, port_id);
+
+  if (!port->have_format)
+    return SPA_RESULT_NO_FORMAT;
+
+  if (n_buffers > MAX_BUFFERS)
     return SPA_RESULT_INVALID_ARGUMENTS;
 
-  if (!IS_VALID_PORT (node, direction, port_id))
-    return SPA_RESULT_INVALID_PORT;
+  /* the encoder can still reference the old input buffers */
+  close_encoder (this);
+  clear_buffers (this, port);
+
+  for (i = 0; i < n_buffers; i++) {
+    FFMpegBuffer *b;
+    SpaData *d = buffers[i]->datas;
+
+    b = &port->buffers[i];
+    b->outbuf = buffers[i];
+    b->outstanding = true;
+    b->released = false;
+    b->h = spa_buffer_find_meta (buffers[i], this->type.meta.Header);
+
+    for (j = 0; j < buffers[i]->n_datas; j++) {
+      if ((d[j].type != this->type.data.MemPtr &&
+           d[j].type != this->type.data.MemFd &&
+           d[j].type != this->type.data.DmaBuf) ||
+          d[j].data == NULL) {
+        spa_log_error (this->log, "ffmpeg-enc %p: invalid memory on buffer %p", this, buffers[i]);
+        return SPA_RESULT_ERROR;
+      }
+    }
+    if (direction == SPA_DIRECTION_OUTPUT)
+      spa_list_insert (port->empty.prev, &b->link);
+  }
+  port->n_buffers = n_buffers;
 
-  return SPA_RESULT_NOT_IMPLEMENTED;
+  return SPA_RESULT_OK;
 }
 
 static SpaResult
@@ -382,15 +748,13 @@ spa_ffmpeg_enc_node_port_set_io (SpaNode      *node,
   SpaFFMpegEnc *this;
   SpaFFMpegPort *port;
 
-  if (node == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   this = SPA_CONTAINER_OF (node, SpaFFMpegEnc, node);
 
-  if (!IS_VALID_PORT (this, direction, port_id))
-    return SPA_RESULT_INVALID_PORT;
+  spa_return_val_if_fail (IS_VALID_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
 
-  port = direction == SPA_DIRECTION_INPUT ? &this->in_ports[port_id] : &this->out_ports[port_id];
+  port = GET_PORT (this, direction, port_id);
   port->io = io;
 
   return SPA_RESULT_OK;
@@ -401,13 +765,32 @@ spa_ffmpeg_enc_node_port_reuse_buffer (SpaNode         *node,
                                        uint32_t         port_id,
                                        uint32_t         buffer_id)
 {
-  if (node == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  SpaFFMpegEnc *this;
+  SpaFFMpegPort *port;
+  FFMpegBuffer *b;
 
-  if (port_id != 0)
-    return SPA_RESULT_INVALID_PORT;
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
-  return SPA_RESULT_NOT_IMPLEMENTED;
+  this = SPA_CONTAINER_OF (node, SpaFFMpegEnc, node);
+
+  spa_return_val_if_fail (port_id == 0, SPA_RESULT_INVALID_PORT);
+
+  port = &this->out_ports[port_id];
+
+  if (port->n_buffers == 0)
+    return SPA_RESULT_NO_BUFFERS;
+
+  if (buffer_id >= port->n_buffers)
+    return SPA_RESULT_INVALID_BUFFER_ID;
+
+  b = &port->buffers[buffer_id];
+  if (!b->outstanding)
+    return SPA_RESULT_OK;
+
+  b->outstanding = false;
+  spa_list_insert (port->empty.prev, &b->link);
+
+  return SPA_RESULT_OK;
 }
 
 static SpaResult
@@ -419,36 +802,314 @@ spa_ffmpeg_enc_node_port_send_command (SpaNode        *node,
   return SPA_RESULT_NOT_IMPLEMENTED;
 }
 
+static FFMpegBuffer *
+find_free_buffer (SpaFFMpegEnc *this, SpaFFMpegPort *port)
+{
+  FFMpegBuffer *b;
+
+  if (spa_list_is_empty (&port->empty))
+    return NULL;
+
+  b = spa_list_first (&port->empty, FFMpegBuffer, link);
+  spa_list_remove (&b->link);
+  b->outstanding = true;
+
+  return b;
+}
+
+static inline void
+release_buffer (SpaFFMpegEnc *this, SpaBuffer *buffer)
+{
+  this->callbacks.reuse_buffer (&this->node, 0, buffer->id, this->user_data);
+}
+
+static void
+free_input (void *opaque, uint8_t *data)
+{
+  FFMpegBuffer *b = opaque;
+
+  __atomic_store_n (&b->released, true, __ATOMIC_RELEASE);
+}
+
+/* give the input buffers that the encoder is done with back to the
+ * upstream node, from the thread that runs the graph */
+static void
+recycle_buffers (SpaFFMpegEnc *this)
+{
+  SpaFFMpegPort *port = &this->in_ports[0];
+  uint32_t i;
+
+  for (i = 0; i < port->n_buffers; i++) {
+    FFMpegBuffer *b = &port->buffers[i];
+
+    if (__atomic_load_n (&b->released, __ATOMIC_ACQUIRE)) {
+      b->released = false;
+      release_buffer (this, b->outbuf);
+    }
+  }
+}
+
 static SpaResult
-spa_ffmpeg_enc_node_process_input (SpaNode *node)
+open_encoder (SpaFFMpegEnc *this)
 {
-  return SPA_RESULT_INVALID_PORT;
+  SpaFFMpegPort *in = &this->in_ports[0];
+  AVCodecContext *ctx;
+  AVDictionary *opts = NULL;
+  int ret;
+
+  if ((ctx = avcodec_alloc_context3 (this->codec)) == NULL)
+    return SPA_RESULT_NO_MEMORY;
+
+  ctx->width = in->size.width;
+  ctx->height = in->size.height;
+  ctx->pix_fmt = in->pix_fmt;
+  /* the encoder counts frames, variable framerate streams are encoded
+   * as if they were 30 fps */
+  if (in->framerate.num > 0 && in->framerate.denom > 0) {
+    ctx->time_base.num = in->framerate.denom;
+    ctx->time_base.den = in->framerate.num;
+  } else {
+    ctx->time_base.num = 1;
+    ctx->time_base.den = 30;
+  }
+  ctx->framerate.num = ctx->time_base.den;
+  ctx->framerate.den = ctx->time_base.num;
+  ctx->bit_rate = this->props.bitrate;
+  ctx->thread_count = this->props.threads;
+  ctx->thread_type = spa_ffmpeg_get_thread_type (this->codec, this->props.low_latency);
+
+  if (this->props.low_latency) {
+    /* every frame comes out as soon as it is encoded */
+    ctx->max_b_frames = 0;
+    ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    av_dict_set (&opts, "tune", "zerolatency", 0);
+    av_dict_set (&opts, "lag-in-frames", "0", 0);
+    av_dict_set (&opts, "deadline", "realtime", 0);
+  }
+
+  ret = avcodec_open2 (ctx, this->codec, &opts);
+  av_dict_free (&opts);
+
+  if (ret < 0) {
+    spa_log_error (this->log, "ffmpeg-enc %p: can't open %s: %d", this, this->codec->name, ret);
+    avcodec_free_context (&ctx);
+    return SPA_RESULT_ERROR;
+  }
+  spa_log_info (this->log, "ffmpeg-enc %p: opened %s %dx%d, %d threads, thread type %d", this,
+      this->codec->name, ctx->width, ctx->height, ctx->thread_count, ctx->active_thread_type);
+
+  this->ctx = ctx;
+  this->n_frames = 0;
+
+  return SPA_RESULT_OK;
+}
+
+static void
+close_encoder (SpaFFMpegEnc *this)
+{
+  if (this->ctx == NULL)
+    return;
+
+  /* this drops the references to the input buffers in the encoder */
+  avcodec_free_context (&this->ctx);
+  recycle_buffers (this);
+}
+
+/* point @frame at the planes of @buffer, from one data block per plane or
+ * from consecutive planes in one block */
+static bool
+get_frame (SpaFFMpegPort *port, SpaBuffer *buffer, AVFrame *frame)
+{
+  SpaData *d = buffer->datas;
+  uint32_t i, stride[MAX_PLANES], offset[MAX_PLANES], size;
+
+  if (buffer->n_datas >= port->n_planes) {
+    for (i = 0; i < port->n_planes; i++) {
+      frame->data[i] = SPA_MEMBER (d[i].data, d[i].chunk->offset, uint8_t);
+      frame->linesize[i] = d[i].chunk->stride ? d[i].chunk->stride : port->stride[i];
+    }
+    return true;
+  }
+
+  if (d[0].chunk->stride != 0)
+    size = spa_ffmpeg_get_layout (port->pix_fmt, port->size.height, d[0].chunk->stride, stride, offset);
+  else
+    size = spa_ffmpeg_get_layout (port->pix_fmt, port->size.height, port->stride[0], stride, offset);
+
+  if (d[0].chunk->offset + size > d[0].maxsize)
+    return false;
+
+  for (i = 0; i < port->n_planes; i++) {
+    frame->data[i] = SPA_MEMBER (d[0].data, d[0].chunk->offset + offset[i], uint8_t);
+    frame->linesize[i] = stride[i];
+  }
+  return true;
+}
+
+/* send the frame in @b to the encoder without copying it */
+static int
+send_frame (SpaFFMpegEnc *this, FFMpegBuffer *b)
+{
+  SpaFFMpegPort *port = &this->in_ports[0];
+  AVFrame *frame = this->frame;
+  SpaData *d = b->outbuf->datas;
+  int ret;
+
+  if (!get_frame (port, b->outbuf, frame)) {
+    spa_log_error (this->log, "ffmpeg-enc %p: input buffer too small", this);
+    return AVERROR (EINVAL);
+  }
+
+  /* wrap the buffer memory so that libavcodec takes a reference instead
+   * of making a copy, the buffer is recycled when that goes away */
+  frame->buf[0] = av_buffer_create (d[0].data, d[0].maxsize, free_input, b, AV_BUFFER_FLAG_READONLY);
+  if (frame->buf[0] == NULL) {
+    av_frame_unref (frame);
+    return AVERROR (ENOMEM);
+  }
+  frame->format = port->pix_fmt;
+  frame->width = port->size.width;
+  frame->height = port->size.height;
+  frame->pts = this->n_frames;
+
+  this->pts[this->n_frames % MAX_DELAY] = b->h ? b->h->pts : 0;
+
+  ret = avcodec_send_frame (this->ctx, frame);
+  av_frame_unref (frame);
+
+  if (ret < 0) {
+    /* the encoder did not keep the frame, the buffer stays with the
+     * input port or is released as an error */
+    b->released = false;
+    return ret;
+  }
+  this->n_frames++;
+
+  return 0;
 }
 
 static SpaResult
-spa_ffmpeg_enc_node_process_output (SpaNode *node)
+receive_packet (SpaFFMpegEnc *this, FFMpegBuffer *db)
+{
+  SpaFFMpegPort *port = &this->out_ports[0];
+  AVPacket *pkt = this->pkt;
+  SpaData *d = db->outbuf->datas;
+  uint32_t size;
+  int ret;
+
+  if ((ret = avcodec_receive_packet (this->ctx, pkt)) == AVERROR (EAGAIN))
+    return SPA_RESULT_NEED_BUFFER;
+  else if (ret < 0) {
+    spa_log_error (this->log, "ffmpeg-enc %p: encoding failed: %d", this, ret);
+    return SPA_RESULT_ERROR;
+  }
+
+  size = SPA_MIN ((uint32_t) pkt->size, d[0].maxsize);
+  if (size < (uint32_t) pkt->size)
+    spa_log_warn (this->log, "ffmpeg-enc %p: packet of %d bytes does not fit", this, pkt->size);
+
+  memcpy (d[0].data, pkt->data, size);
+  d[0].chunk->offset = 0;
+  d[0].chunk->size = size;
+  d[0].chunk->stride = 0;
+
+  if (db->h) {
+    AVRational *tb = &this->ctx->time_base;
+
+    db->h->flags = 0;
+    if (!(pkt->flags & AV_PKT_FLAG_KEY))
+      db->h->flags |= SPA_META_HEADER_FLAG_DELTA_UNIT;
+    if (size < (uint32_t) pkt->size)
+      db->h->flags |= SPA_META_HEADER_FLAG_CORRUPTED;
+    db->h->seq = this->seq++;
+    db->h->pts = pkt->pts != AV_NOPTS_VALUE ? this->pts[pkt->pts % MAX_DELAY] : 0;
+    db->h->dts_offset = pkt->dts != AV_NOPTS_VALUE && pkt->pts != AV_NOPTS_VALUE ?
+        (pkt->dts - pkt->pts) * SPA_NSEC_PER_SEC * tb->num / tb->den : 0;
+  }
+  av_packet_unref (pkt);
+
+  port->io->buffer_id = db->outbuf->id;
+  port->io->status = SPA_RESULT_OK;
+
+  return SPA_RESULT_HAVE_BUFFER;
+}
+
+static SpaResult
+spa_ffmpeg_enc_node_process_input (SpaNode *node)
 {
   SpaFFMpegEnc *this;
-  SpaFFMpegPort *port;
+  SpaPortIO *input;
   SpaPortIO *output;
+  SpaFFMpegPort *in_port, *out_port;
+  FFMpegBuffer *db;
+  SpaResult res;
 
-  if (node == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   this = SPA_CONTAINER_OF (node, SpaFFMpegEnc, node);
 
-  if ((output = this->out_ports[0].io) == NULL)
-    return SPA_RESULT_OK;
+  in_port = &this->in_ports[0];
+  out_port = &this->out_ports[0];
 
-  port = &this->out_ports[0];
+  if ((input = in_port->io) == NULL)
+    return SPA_RESULT_ERROR;
+  if ((output = out_port->io) == NULL)
+    return SPA_RESULT_ERROR;
 
-  if (!port->have_format) {
-    output->status = SPA_RESULT_NO_FORMAT;
+  if (!in_port->have_format || !out_port->have_format) {
+    input->status = SPA_RESULT_NO_FORMAT;
     return SPA_RESULT_ERROR;
   }
-  output->status = SPA_RESULT_OK;
 
-  return SPA_RESULT_OK;
+  recycle_buffers (this);
+
+  if (this->ctx == NULL && (res = open_encoder (this)) != SPA_RESULT_OK) {
+    input->status = res;
+    return SPA_RESULT_ERROR;
+  }
+
+  if (input->buffer_id != SPA_ID_INVALID) {
+    FFMpegBuffer *sb;
+    int ret;
+
+    if (input->buffer_id >= in_port->n_buffers) {
+      input->status = SPA_RESULT_INVALID_BUFFER_ID;
+      return SPA_RESULT_ERROR;
+    }
+    sb = &in_port->buffers[input->buffer_id];
+
+    /* when the encoder is full, the input stays until we took a packet */
+    if ((ret = send_frame (this, sb)) != AVERROR (EAGAIN)) {
+      input->buffer_id = SPA_ID_INVALID;
+      input->status = SPA_RESULT_OK;
+
+      if (ret < 0) {
+        spa_log_warn (this->log, "ffmpeg-enc %p: dropping frame: %d", this, ret);
+        release_buffer (this, sb->outbuf);
+      }
+    }
+  }
+
+  if (output->buffer_id < out_port->n_buffers) {
+    db = &out_port->buffers[output->buffer_id];
+  } else {
+    db = find_free_buffer (this, out_port);
+  }
+  if (db == NULL)
+    return SPA_RESULT_OUT_OF_BUFFERS;
+
+  if ((res = receive_packet (this, db)) != SPA_RESULT_HAVE_BUFFER) {
+    output->buffer_id = SPA_ID_INVALID;
+    db->outstanding = false;
+    spa_list_insert (out_port->empty.prev, &db->link);
+  }
+  return res;
+}
+
+static SpaResult
+spa_ffmpeg_enc_node_process_output (SpaNode *node)
+{
+  return SPA_RESULT_NEED_BUFFER;
 }
 
 static const SpaNode ffmpeg_enc_node = {
@@ -484,8 +1145,8 @@ spa_ffmpeg_enc_get_interface (SpaHandle         *handle,
 {
   SpaFFMpegEnc *this;
 
-  if (handle == NULL || interface == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (interface != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   this = (SpaFFMpegEnc *) handle;
 
@@ -497,16 +1158,36 @@ spa_ffmpeg_enc_get_interface (SpaHandle         *handle,
   return SPA_RESULT_OK;
 }
 
+static SpaResult
+spa_ffmpeg_enc_clear (SpaHandle *handle)
+{
+  SpaFFMpegEnc *this;
+
+  spa_return_val_if_fail (handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = (SpaFFMpegEnc *) handle;
+
+  close_encoder (this);
+  av_packet_free (&this->pkt);
+  av_frame_free (&this->frame);
+
+  return SPA_RESULT_OK;
+}
+
+const size_t spa_ffmpeg_enc_size = sizeof (SpaFFMpegEnc);
+
 SpaResult
 spa_ffmpeg_enc_init (SpaHandle         *handle,
                      const SpaDict     *info,
                      const SpaSupport  *support,
-                     uint32_t           n_support)
+                     uint32_t           n_support,
+                     AVCodec           *codec)
 {
   SpaFFMpegEnc *this;
   uint32_t i;
 
   handle->get_interface = spa_ffmpeg_enc_get_interface;
+  handle->clear = spa_ffmpeg_enc_clear;
 
   this = (SpaFFMpegEnc *) handle;
 
@@ -520,11 +1201,30 @@ spa_ffmpeg_enc_init (SpaHandle         *handle,
     spa_log_error (this->log, "a type-map is needed");
     return SPA_RESULT_ERROR;
   }
+  init_type (&this->type, this->map);
+
+  this->codec = codec;
+  this->subtype = spa_ffmpeg_get_media_subtype (&this->type.media_subtype_video, codec->id);
+  if (this->subtype == 0) {
+    spa_log_error (this->log, "ffmpeg-enc %p: unsupported codec %s", this, codec->name);
+    return SPA_RESULT_ERROR;
+  }
+  if ((this->frame = av_frame_alloc ()) == NULL)
+    return SPA_RESULT_NO_MEMORY;
+  if ((this->pkt = av_packet_alloc ()) == NULL) {
+    av_frame_free (&this->frame);
+    return SPA_RESULT_NO_MEMORY;
+  }
 
   this->node = ffmpeg_enc_node;
+  reset_ffmpeg_enc_props (&this->props);
+
+  this->in_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
+  spa_list_init (&this->in_ports[0].empty);
 
-  this->in_ports[0].info.flags = 0;
-  this->out_ports[0].info.flags = 0;
+  this->out_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS |
+                                  SPA_PORT_INFO_FLAG_NO_REF;
+  spa_list_init (&this->out_ports[0].empty);
 
   return SPA_RESULT_OK;
 }
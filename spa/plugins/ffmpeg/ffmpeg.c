@@ -18,6 +18,8 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <spa/plugin.h>
 #include <spa/node.h>
@@ -25,8 +27,21 @@
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 
-SpaResult spa_ffmpeg_dec_init (SpaHandle *handle, const SpaDict *info, const SpaSupport *support, uint32_t n_support);
-SpaResult spa_ffmpeg_enc_init (SpaHandle *handle, const SpaDict *info, const SpaSupport *support, uint32_t n_support);
+#include "ffmpeg.h"
+
+#define ENC_PREFIX "ffenc_"
+#define DEC_PREFIX "ffdec_"
+
+/* a factory for each codec, the name and the codec stay valid for as long
+ * as the plugin is loaded */
+typedef struct {
+  SpaHandleFactory factory;
+  char name[128];
+  AVCodec *codec;
+} FFmpegFactory;
+
+static FFmpegFactory *factories;
+static uint32_t n_factories;
 
 static SpaResult
 ffmpeg_dec_init (const SpaHandleFactory  *factory,
@@ -35,10 +50,14 @@ ffmpeg_dec_init (const SpaHandleFactory  *factory,
                  const SpaSupport        *support,
                  uint32_t                 n_support)
 {
+  FFmpegFactory *f;
+
   if (factory == NULL || handle == NULL)
     return SPA_RESULT_INVALID_ARGUMENTS;
 
-  return spa_ffmpeg_dec_init (handle, info, support, n_support);
+  f = SPA_CONTAINER_OF (factory, FFmpegFactory, factory);
+
+  return spa_ffmpeg_dec_init (handle, info, support, n_support, f->codec);
 }
 
 static SpaResult
@@ -48,10 +67,14 @@ ffmpeg_enc_init (const SpaHandleFactory  *factory,
                  const SpaSupport        *support,
                  uint32_t                 n_support)
 {
+  FFmpegFactory *f;
+
   if (factory == NULL || handle == NULL)
     return SPA_RESULT_INVALID_ARGUMENTS;
 
-  return spa_ffmpeg_enc_init (handle, info, support, n_support);
+  f = SPA_CONTAINER_OF (factory, FFmpegFactory, factory);
+
+  return spa_ffmpeg_enc_init (handle, info, support, n_support, f->codec);
 }
 
 static const SpaInterfaceInfo ffmpeg_interfaces[] =
@@ -76,41 +99,66 @@ ffmpeg_enum_interface_info (const SpaHandleFactory  *factory,
   return SPA_RESULT_OK;
 }
 
-SpaResult
-spa_enum_handle_factory (const SpaHandleFactory **factory,
-                         uint32_t                 index)
+static SpaResult
+make_factories (void)
 {
-  static const AVCodec *c = NULL;
-  static int ci = 0;
-  static SpaHandleFactory f;
-  static char name[128];
+  AVCodec *c;
+  uint32_t n = 0;
 
   av_register_all();
 
-  if (index == 0) {
-    c = av_codec_next (NULL);
-    ci = 0;
-  }
-  while (index > ci && c) {
-    c = av_codec_next (c);
-    ci++;
+  /* only the video codecs we can negotiate are exposed */
+  for (c = av_codec_next (NULL); c; c = av_codec_next (c)) {
+    if (spa_ffmpeg_codec_is_supported (c))
+      n++;
   }
-  if (c == NULL)
-    return SPA_RESULT_ENUM_END;
+  if (n > 0 && (factories = calloc (n, sizeof (FFmpegFactory))) == NULL)
+    return SPA_RESULT_NO_MEMORY;
 
-  if (av_codec_is_encoder (c)) {
-    snprintf (name, 128, "ffenc_%s", c->name);
-    f.init = ffmpeg_enc_init;
-  }
-  else {
-    snprintf (name, 128, "ffdec_%s", c->name);
-    f.init = ffmpeg_dec_init;
+  for (c = av_codec_next (NULL); c && n_factories < n; c = av_codec_next (c)) {
+    FFmpegFactory *f;
+
+    if (!spa_ffmpeg_codec_is_supported (c))
+      continue;
+
+    f = &factories[n_factories++];
+    f->codec = c;
+
+    /* the fields of a factory are const, fill in a new one */
+    if (av_codec_is_encoder (c)) {
+      SpaHandleFactory enc = { f->name, NULL, spa_ffmpeg_enc_size,
+                               ffmpeg_enc_init, ffmpeg_enum_interface_info };
+
+      snprintf (f->name, sizeof (f->name), ENC_PREFIX "%s", c->name);
+      memcpy (&f->factory, &enc, sizeof (enc));
+    }
+    else {
+      SpaHandleFactory dec = { f->name, NULL, spa_ffmpeg_dec_size,
+                               ffmpeg_dec_init, ffmpeg_enum_interface_info };
+
+      snprintf (f->name, sizeof (f->name), DEC_PREFIX "%s", c->name);
+      memcpy (&f->factory, &dec, sizeof (dec));
+    }
   }
-  f.name = name;
-  f.info = NULL;
-  f.enum_interface_info = ffmpeg_enum_interface_info;
+  return SPA_RESULT_OK;
+}
+
+SpaResult
+spa_enum_handle_factory (const SpaHandleFactory **factory,
+                         uint32_t                 index)
+{
+  SpaResult res;
+
+  if (factory == NULL)
+    return SPA_RESULT_INVALID_ARGUMENTS;
+
+  if (factories == NULL && (res = make_factories ()) < 0)
+    return res;
+
+  if (index >= n_factories)
+    return SPA_RESULT_ENUM_END;
 
-  *factory = &f;
+  *factory = &factories[index].factory;
 
   return SPA_RESULT_OK;
 }
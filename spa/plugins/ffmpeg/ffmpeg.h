@@ -0,0 +1,155 @@
+/* Spa FFMpeg
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_FFMPEG_H__
+#define __SPA_FFMPEG_H__
+
+#include <spa/plugin.h>
+#include <spa/format-utils.h>
+#include <spa/video/format-utils.h>
+
+#include <libavcodec/avcodec.h>
+
+/* a threads property of 0 lets libavcodec pick one thread per CPU */
+#define SPA_FFMPEG_MAX_THREADS   16
+
+extern const size_t spa_ffmpeg_dec_size;
+extern const size_t spa_ffmpeg_enc_size;
+
+SpaResult spa_ffmpeg_dec_init (SpaHandle *handle, const SpaDict *info,
+                               const SpaSupport *support, uint32_t n_support,
+                               AVCodec *codec);
+SpaResult spa_ffmpeg_enc_init (SpaHandle *handle, const SpaDict *info,
+                               const SpaSupport *support, uint32_t n_support,
+                               AVCodec *codec);
+
+/* the media subtype of the encoded video of @id or 0 when we can't
+ * describe it */
+static inline uint32_t
+spa_ffmpeg_get_media_subtype (SpaTypeMediaSubtypeVideo *type, enum AVCodecID id)
+{
+  switch (id) {
+    case AV_CODEC_ID_H264:
+      return type->h264;
+    case AV_CODEC_ID_VP8:
+      return type->vp8;
+    case AV_CODEC_ID_VP9:
+      return type->vp9;
+    default:
+      return 0;
+  }
+}
+
+static inline enum AVPixelFormat
+spa_ffmpeg_get_pix_fmt (SpaTypeVideoFormat *type, uint32_t format)
+{
+  if (format == type->I420)
+    return AV_PIX_FMT_YUV420P;
+  if (format == type->NV12)
+    return AV_PIX_FMT_NV12;
+  return AV_PIX_FMT_NONE;
+}
+
+static inline uint32_t
+spa_ffmpeg_get_video_format (SpaTypeVideoFormat *type, enum AVPixelFormat pix_fmt)
+{
+  switch (pix_fmt) {
+    case AV_PIX_FMT_YUV420P:
+    case AV_PIX_FMT_YUVJ420P:
+      return type->I420;
+    case AV_PIX_FMT_NV12:
+      return type->NV12;
+    default:
+      return 0;
+  }
+}
+
+static inline uint32_t
+spa_ffmpeg_get_n_planes (enum AVPixelFormat pix_fmt)
+{
+  return pix_fmt == AV_PIX_FMT_NV12 ? 2 : 3;
+}
+
+static inline uint32_t
+spa_ffmpeg_default_stride (uint32_t width)
+{
+  return SPA_ROUND_UP_N (width, 32);
+}
+
+/* fill in the strides and offsets of the planes of an I420 or NV12
+ * frame in one memory block where the first plane has @stride0,
+ * returns the size of the frame */
+static inline uint32_t
+spa_ffmpeg_get_layout (enum AVPixelFormat pix_fmt, uint32_t height, uint32_t stride0,
+                       uint32_t stride[], uint32_t offset[])
+{
+  uint32_t chroma_height = (height + 1) / 2;
+
+  stride[0] = stride0;
+  offset[0] = 0;
+  offset[1] = stride0 * height;
+
+  if (pix_fmt == AV_PIX_FMT_NV12) {
+    stride[1] = stride0;
+    return offset[1] + stride[1] * chroma_height;
+  }
+  stride[1] = stride[2] = stride0 / 2;
+  offset[2] = offset[1] + stride[1] * chroma_height;
+
+  return offset[2] + stride[2] * chroma_height;
+}
+
+/* check if we can make a node for @codec, encoders need to accept
+ * one of our raw formats */
+static inline bool
+spa_ffmpeg_codec_is_supported (AVCodec *codec)
+{
+  const enum AVPixelFormat *p;
+
+  if (codec->type != AVMEDIA_TYPE_VIDEO)
+    return false;
+  if (codec->id != AV_CODEC_ID_H264 &&
+      codec->id != AV_CODEC_ID_VP8 &&
+      codec->id != AV_CODEC_ID_VP9)
+    return false;
+  if (!av_codec_is_encoder (codec))
+    return true;
+  for (p = codec->pix_fmts; p && *p != AV_PIX_FMT_NONE; p++) {
+    if (*p == AV_PIX_FMT_YUV420P || *p == AV_PIX_FMT_NV12)
+      return true;
+  }
+  return false;
+}
+
+/* the thread_type flags for a codec, slice threads add no delay so only
+ * those are used when low latency is requested */
+static inline int
+spa_ffmpeg_get_thread_type (AVCodec *codec, bool low_latency)
+{
+  int type = 0;
+
+  if (codec->capabilities & AV_CODEC_CAP_SLICE_THREADS)
+    type |= FF_THREAD_SLICE;
+  if (!low_latency && (codec->capabilities & AV_CODEC_CAP_FRAME_THREADS))
+    type |= FF_THREAD_FRAME;
+
+  return type;
+}
+
+#endif /* __SPA_FFMPEG_H__ */
@@ -0,0 +1,609 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include <spa/node.h>
+#include <lib/props.h>
+
+#include "null-utils.h"
+
+#define CHECK_PORT(this,d,p)  ((d) == SPA_DIRECTION_INPUT && (p) == 0)
+
+typedef struct _SpaNullState SpaNullSink;
+
+static SpaResult
+spa_null_sink_node_get_props (SpaNode       *node,
+                              SpaProps     **props)
+{
+  SpaNullSink *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (props != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaNullSink, node);
+
+  return spa_null_get_props (this, props);
+}
+
+static SpaResult
+spa_null_sink_node_set_props (SpaNode         *node,
+                              const SpaProps  *props)
+{
+  SpaNullSink *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaNullSink, node);
+
+  return spa_null_set_props (this, props);
+}
+
+/* the buffers of the last period have been played, give them back */
+static void
+release_buffers (SpaNullSink *this)
+{
+  while (!spa_list_is_empty (&this->ready)) {
+    SpaNullBuffer *b = spa_list_first (&this->ready, SpaNullBuffer, link);
+
+    spa_list_remove (&b->link);
+    b->outstanding = true;
+
+    spa_log_trace (this->log, "null-sink %p: reuse buffer %u", this, b->outbuf->id);
+
+    this->io->buffer_id = b->outbuf->id;
+    if (this->callbacks.reuse_buffer)
+      this->callbacks.reuse_buffer (&this->node, 0, b->outbuf->id, this->user_data);
+  }
+}
+
+static void
+null_sink_on_timer (SpaSource *source)
+{
+  SpaNullSink *this = source->data;
+  SpaPortIO *io = this->io;
+  uint32_t n_frames;
+
+  spa_null_read_timer (this);
+
+  if (!this->started || io == NULL)
+    return;
+
+  release_buffers (this);
+
+  /* the graph did not give us anything since the last request */
+  if (this->cycle_start >= 0) {
+    this->stats.xruns++;
+    spa_log_trace (this->log, "null-sink %p: xrun %u", this, this->stats.xruns);
+  }
+
+  if (this->media_type == this->type.media_type.audio)
+    n_frames = this->props.period_size;
+  else
+    n_frames = 1;
+
+  io->status = SPA_RESULT_NEED_BUFFER;
+  io->range.offset = this->frame_count * this->frame_size;
+  io->range.min_size = n_frames * this->frame_size;
+  io->range.max_size = n_frames * this->frame_size;
+
+  this->frame_count += n_frames;
+  this->elapsed_time = FRAMES_TO_TIME (this, this->frame_count);
+
+  /* when not live, the next cycle starts as soon as this one has
+   * completed, see process_input */
+  if (this->props.live)
+    spa_null_set_timer (this, true);
+
+  spa_null_cycle_begin (this);
+  this->callbacks.need_input (&this->node, this->user_data);
+}
+
+static SpaResult
+spa_null_sink_node_send_command (SpaNode    *node,
+                                 SpaCommand *command)
+{
+  SpaNullSink *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (command != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaNullSink, node);
+
+  if (SPA_COMMAND_TYPE (command) == this->type.command_node.Start) {
+    if (this->callbacks.need_input == NULL)
+      return SPA_RESULT_ERROR;
+
+    return spa_null_start (this);
+  }
+  else if (SPA_COMMAND_TYPE (command) == this->type.command_node.Pause) {
+    return spa_null_pause (this);
+  }
+  else
+    return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_null_sink_node_set_callbacks (SpaNode                *node,
+                                  const SpaNodeCallbacks *callbacks,
+                                  size_t                  callbacks_size,
+                                  void                   *user_data)
+{
+  SpaNullSink *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaNullSink, node);
+
+  if (this->data_loop == NULL && callbacks->need_input) {
+    spa_log_error (this->log, "a data_loop is needed for async operation");
+    return SPA_RESULT_ERROR;
+  }
+
+  this->callbacks = *callbacks;
+  this->user_data = user_data;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_null_sink_node_get_n_ports (SpaNode       *node,
+                                uint32_t      *n_input_ports,
+                                uint32_t      *max_input_ports,
+                                uint32_t      *n_output_ports,
+                                uint32_t      *max_output_ports)
+{
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  if (n_input_ports)
+    *n_input_ports = 1;
+  if (n_output_ports)
+    *n_output_ports = 0;
+  if (max_input_ports)
+    *max_input_ports = 1;
+  if (max_output_ports)
+    *max_output_ports = 0;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_null_sink_node_get_port_ids (SpaNode       *node,
+                                 uint32_t       n_input_ports,
+                                 uint32_t      *input_ids,
+                                 uint32_t       n_output_ports,
+                                 uint32_t      *output_ids)
+{
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  if (n_input_ports > 0 && input_ids != NULL)
+    input_ids[0] = 0;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_null_sink_node_add_port (SpaNode        *node,
+                             SpaDirection    direction,
+                             uint32_t        port_id)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_null_sink_node_remove_port (SpaNode        *node,
+                                SpaDirection    direction,
+                                uint32_t        port_id)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_null_sink_node_port_enum_formats (SpaNode          *node,
+                                      SpaDirection      direction,
+                                      uint32_t          port_id,
+                                      SpaFormat       **format,
+                                      const SpaFormat  *filter,
+                                      uint32_t          index)
+{
+  SpaNullSink *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (format != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaNullSink, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  return spa_null_enum_format (this, format, filter, index);
+}
+
+static SpaResult
+spa_null_sink_node_port_set_format (SpaNode         *node,
+                                    SpaDirection     direction,
+                                    uint32_t         port_id,
+                                    uint32_t         flags,
+                                    const SpaFormat *format)
+{
+  SpaNullSink *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaNullSink, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  return spa_null_set_format (this, format);
+}
+
+static SpaResult
+spa_null_sink_node_port_get_format (SpaNode          *node,
+                                    SpaDirection      direction,
+                                    uint32_t          port_id,
+                                    const SpaFormat **format)
+{
+  SpaNullSink *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (format != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaNullSink, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  return spa_null_get_format (this, format);
+}
+
+static SpaResult
+spa_null_sink_node_port_get_info (SpaNode            *node,
+                                  SpaDirection        direction,
+                                  uint32_t            port_id,
+                                  const SpaPortInfo **info)
+{
+  SpaNullSink *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (info != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaNullSink, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  *info = &this->info;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_null_sink_node_port_get_props (SpaNode       *node,
+                                   SpaDirection   direction,
+                                   uint32_t       port_id,
+                                   SpaProps     **props)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_null_sink_node_port_set_props (SpaNode        *node,
+                                   SpaDirection    direction,
+                                   uint32_t        port_id,
+                                   const SpaProps *props)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_null_sink_node_port_use_buffers (SpaNode         *node,
+                                     SpaDirection     direction,
+                                     uint32_t         port_id,
+                                     SpaBuffer      **buffers,
+                                     uint32_t         n_buffers)
+{
+  SpaNullSink *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaNullSink, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  return spa_null_use_buffers (this, buffers, n_buffers);
+}
+
+static SpaResult
+spa_null_sink_node_port_alloc_buffers (SpaNode         *node,
+                                       SpaDirection     direction,
+                                       uint32_t         port_id,
+                                       SpaAllocParam  **params,
+                                       uint32_t         n_params,
+                                       SpaBuffer      **buffers,
+                                       uint32_t        *n_buffers)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_null_sink_node_port_set_io (SpaNode       *node,
+                                SpaDirection   direction,
+                                uint32_t       port_id,
+                                SpaPortIO     *io)
+{
+  SpaNullSink *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaNullSink, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  this->io = io;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_null_sink_node_port_reuse_buffer (SpaNode         *node,
+                                      uint32_t         port_id,
+                                      uint32_t         buffer_id)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_null_sink_node_port_send_command (SpaNode        *node,
+                                      SpaDirection    direction,
+                                      uint32_t        port_id,
+                                      SpaCommand     *command)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+/* the bytes in @b, everything in it is consumed */
+static size_t
+consume_buffer (SpaNullSink *this, SpaNullBuffer *b)
+{
+  SpaData *d = b->outbuf->datas;
+
+  if (b->rb) {
+    SpaRingbuffer *ringbuffer = &b->rb->ringbuffer;
+    uint32_t index;
+    int32_t filled;
+
+    filled = spa_ringbuffer_get_read_index (ringbuffer, &index);
+    if (filled <= 0)
+      return 0;
+    spa_ringbuffer_read_update (ringbuffer, index + filled);
+    return filled;
+  } else {
+    size_t offs = SPA_MIN (d[0].chunk->offset, d[0].maxsize);
+    return SPA_MIN (d[0].chunk->size, d[0].maxsize - offs);
+  }
+}
+
+static SpaResult
+spa_null_sink_node_process_input (SpaNode *node)
+{
+  SpaNullSink *this;
+  SpaPortIO *input;
+  SpaNullBuffer *b;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaNullSink, node);
+  input = this->io;
+  spa_return_val_if_fail (input != NULL, SPA_RESULT_WRONG_STATE);
+
+  if (input->status != SPA_RESULT_HAVE_BUFFER ||
+      input->buffer_id == SPA_ID_INVALID)
+    return SPA_RESULT_OK;
+
+  if (input->buffer_id >= this->n_buffers) {
+    input->status = SPA_RESULT_INVALID_BUFFER_ID;
+    return SPA_RESULT_INVALID_BUFFER_ID;
+  }
+
+  b = &this->buffers[input->buffer_id];
+  if (!b->outstanding) {
+    spa_log_warn (this->log, "null-sink %p: buffer %u in use", this, input->buffer_id);
+    input->status = SPA_RESULT_INVALID_BUFFER_ID;
+    return SPA_RESULT_INVALID_BUFFER_ID;
+  }
+
+  spa_log_trace (this->log, "null-sink %p: consume buffer %u", this, input->buffer_id);
+
+  this->stats.bytes += consume_buffer (this, b);
+  spa_null_cycle_end (this);
+
+  spa_list_insert (this->ready.prev, &b->link);
+  b->outstanding = false;
+  input->buffer_id = SPA_ID_INVALID;
+  input->status = SPA_RESULT_OK;
+
+  if (this->started && !this->props.live)
+    spa_null_set_timer (this, true);
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_null_sink_node_process_output (SpaNode *node)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static const SpaNode nullsink_node = {
+  sizeof (SpaNode),
+  NULL,
+  spa_null_sink_node_get_props,
+  spa_null_sink_node_set_props,
+  spa_null_sink_node_send_command,
+  spa_null_sink_node_set_callbacks,
+  spa_null_sink_node_get_n_ports,
+  spa_null_sink_node_get_port_ids,
+  spa_null_sink_node_add_port,
+  spa_null_sink_node_remove_port,
+  spa_null_sink_node_port_enum_formats,
+  spa_null_sink_node_port_set_format,
+  spa_null_sink_node_port_get_format,
+  spa_null_sink_node_port_get_info,
+  spa_null_sink_node_port_get_props,
+  spa_null_sink_node_port_set_props,
+  spa_null_sink_node_port_use_buffers,
+  spa_null_sink_node_port_alloc_buffers,
+  spa_null_sink_node_port_set_io,
+  spa_null_sink_node_port_reuse_buffer,
+  spa_null_sink_node_port_send_command,
+  spa_null_sink_node_process_input,
+  spa_null_sink_node_process_output,
+};
+
+static SpaResult
+spa_null_sink_clock_get_props (SpaClock  *clock,
+                               SpaProps **props)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_null_sink_clock_set_props (SpaClock       *clock,
+                               const SpaProps *props)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_null_sink_clock_get_time (SpaClock         *clock,
+                              int32_t          *rate,
+                              int64_t          *ticks,
+                              int64_t          *monotonic_time)
+{
+  SpaNullSink *this;
+
+  spa_return_val_if_fail (clock != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (clock, SpaNullSink, clock);
+
+  return spa_null_get_time (this, rate, ticks, monotonic_time);
+}
+
+static const SpaClock nullsink_clock = {
+  sizeof (SpaClock),
+  NULL,
+  SPA_CLOCK_STATE_STOPPED,
+  spa_null_sink_clock_get_props,
+  spa_null_sink_clock_set_props,
+  spa_null_sink_clock_get_time,
+};
+
+static SpaResult
+spa_null_sink_get_interface (SpaHandle         *handle,
+                             uint32_t           interface_id,
+                             void             **interface)
+{
+  SpaNullSink *this;
+
+  spa_return_val_if_fail (handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (interface != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = (SpaNullSink *) handle;
+
+  if (interface_id == this->type.node)
+    *interface = &this->node;
+  else if (interface_id == this->type.clock)
+    *interface = &this->clock;
+  else
+    return SPA_RESULT_UNKNOWN_INTERFACE;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+null_sink_clear (SpaHandle *handle)
+{
+  spa_return_val_if_fail (handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  spa_null_clear ((SpaNullSink *) handle);
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+null_sink_init (const SpaHandleFactory  *factory,
+                SpaHandle               *handle,
+                const SpaDict           *info,
+                const SpaSupport        *support,
+                uint32_t                 n_support)
+{
+  SpaNullSink *this;
+  SpaResult res;
+
+  spa_return_val_if_fail (factory != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  handle->get_interface = spa_null_sink_get_interface;
+  handle->clear = null_sink_clear;
+
+  this = (SpaNullSink *) handle;
+  this->node = nullsink_node;
+  this->clock = nullsink_clock;
+  this->direction = SPA_DIRECTION_INPUT;
+  this->name = "null-sink";
+  this->timer_source.func = null_sink_on_timer;
+
+  if ((res = spa_null_init (this, support, n_support)) != SPA_RESULT_OK)
+    return res;
+
+  spa_log_info (this->log, "null-sink %p: initialized", this);
+
+  return SPA_RESULT_OK;
+}
+
+static const SpaInterfaceInfo null_sink_interfaces[] =
+{
+  { SPA_TYPE__Node, },
+  { SPA_TYPE__Clock, },
+};
+
+static SpaResult
+null_sink_enum_interface_info (const SpaHandleFactory  *factory,
+                               const SpaInterfaceInfo **info,
+                               uint32_t                 index)
+{
+  spa_return_val_if_fail (factory != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (info != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  switch (index) {
+    case 0:
+    case 1:
+      *info = &null_sink_interfaces[index];
+      break;
+    default:
+      return SPA_RESULT_ENUM_END;
+  }
+  return SPA_RESULT_OK;
+}
+
+const SpaHandleFactory spa_null_sink_factory =
+{ "null-sink",
+  NULL,
+  sizeof (SpaNullSink),
+  null_sink_init,
+  null_sink_enum_interface_info,
+};
@@ -0,0 +1,642 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include <spa/node.h>
+#include <lib/props.h>
+
+#include "null-utils.h"
+
+#define CHECK_PORT(this,d,p)  ((d) == SPA_DIRECTION_OUTPUT && (p) == 0)
+
+typedef struct _SpaNullState SpaNullSource;
+
+static SpaResult
+spa_null_source_node_get_props (SpaNode       *node,
+                              SpaProps     **props)
+{
+  SpaNullSource *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (props != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaNullSource, node);
+
+  return spa_null_get_props (this, props);
+}
+
+static SpaResult
+spa_null_source_node_set_props (SpaNode         *node,
+                              const SpaProps  *props)
+{
+  SpaNullSource *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaNullSource, node);
+
+  return spa_null_set_props (this, props);
+}
+
+static inline SpaResult
+send_have_output (SpaNullSource *this)
+{
+  if (this->callbacks.have_output) {
+    spa_null_cycle_begin (this);
+    this->callbacks.have_output (&this->node, this->user_data);
+    spa_null_cycle_end (this);
+  }
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+null_source_make_buffer (SpaNullSource *this)
+{
+  SpaNullBuffer *b;
+  SpaPortIO *io = this->io;
+  size_t n_bytes;
+  uint32_t n_frames;
+
+  spa_null_read_timer (this);
+
+  if (spa_list_is_empty (&this->free)) {
+    this->stats.xruns++;
+    spa_null_set_timer (this, false);
+    return SPA_RESULT_OUT_OF_BUFFERS;
+  }
+  b = spa_list_first (&this->free, SpaNullBuffer, link);
+  spa_list_remove (&b->link);
+  b->outstanding = true;
+
+  n_bytes = b->outbuf->datas[0].maxsize;
+  if (this->media_type == this->type.media_type.audio) {
+    n_bytes = SPA_MIN (n_bytes, this->props.period_size * this->frame_size);
+    if (io->range.min_size != 0) {
+      n_bytes = SPA_MIN (n_bytes, io->range.min_size);
+      if (io->range.max_size < n_bytes)
+        n_bytes = io->range.max_size;
+    }
+  } else {
+    n_bytes = SPA_MIN (n_bytes, this->frame_size);
+  }
+
+  spa_log_trace (this->log, "null-source %p: dequeue buffer %d %d %zd", this, b->outbuf->id,
+      b->outbuf->datas[0].maxsize, n_bytes);
+
+  if (b->rb) {
+    int32_t filled, avail;
+    uint32_t index, offset;
+
+    filled = spa_ringbuffer_get_write_index (&b->rb->ringbuffer, &index);
+    avail = b->rb->ringbuffer.size - filled;
+    n_bytes = SPA_MIN (avail, n_bytes);
+
+    offset = index & b->rb->ringbuffer.mask;
+
+    if (offset + n_bytes > b->rb->ringbuffer.size) {
+      uint32_t l0 = b->rb->ringbuffer.size - offset;
+      memset (SPA_MEMBER (b->outbuf->datas[0].data, offset, void), 0, l0);
+      memset (b->outbuf->datas[0].data, 0, n_bytes - l0);
+    } else {
+      memset (SPA_MEMBER (b->outbuf->datas[0].data, offset, void), 0, n_bytes);
+    }
+    spa_ringbuffer_write_update (&b->rb->ringbuffer, index + n_bytes);
+  } else {
+    memset (b->outbuf->datas[0].data, 0, n_bytes);
+    b->outbuf->datas[0].chunk->size = n_bytes;
+    b->outbuf->datas[0].chunk->offset = 0;
+    b->outbuf->datas[0].chunk->stride = this->stride;
+  }
+
+  if (this->media_type == this->type.media_type.audio)
+    n_frames = n_bytes / this->frame_size;
+  else
+    n_frames = 1;
+
+  if (b->h) {
+    b->h->seq = this->frame_count;
+    b->h->pts = this->start_time + this->elapsed_time;
+    b->h->dts_offset = 0;
+  }
+
+  this->stats.bytes += n_bytes;
+  this->frame_count += n_frames;
+  this->elapsed_time = FRAMES_TO_TIME (this, this->frame_count);
+  spa_null_set_timer (this, true);
+
+  io->buffer_id = b->outbuf->id;
+  io->status = SPA_RESULT_HAVE_BUFFER;
+
+  return SPA_RESULT_HAVE_BUFFER;
+}
+
+static void
+null_source_on_timer (SpaSource *source)
+{
+  SpaNullSource *this = source->data;
+
+  if (!this->started || this->io == NULL) {
+    spa_null_read_timer (this);
+    return;
+  }
+
+  if (null_source_make_buffer (this) == SPA_RESULT_HAVE_BUFFER)
+    send_have_output (this);
+}
+
+static SpaResult
+spa_null_source_node_send_command (SpaNode    *node,
+                                 SpaCommand *command)
+{
+  SpaNullSource *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (command != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaNullSource, node);
+
+  if (SPA_COMMAND_TYPE (command) == this->type.command_node.Start) {
+    return spa_null_start (this);
+  }
+  else if (SPA_COMMAND_TYPE (command) == this->type.command_node.Pause) {
+    return spa_null_pause (this);
+  }
+  else
+    return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_null_source_node_set_callbacks (SpaNode                *node,
+                                  const SpaNodeCallbacks *callbacks,
+                                  size_t                  callbacks_size,
+                                  void                   *user_data)
+{
+  SpaNullSource *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaNullSource, node);
+
+  if (this->data_loop == NULL && callbacks->have_output) {
+    spa_log_error (this->log, "a data_loop is needed for async operation");
+    return SPA_RESULT_ERROR;
+  }
+
+  this->callbacks = *callbacks;
+  this->user_data = user_data;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_null_source_node_get_n_ports (SpaNode       *node,
+                                uint32_t      *n_input_ports,
+                                uint32_t      *max_input_ports,
+                                uint32_t      *n_output_ports,
+                                uint32_t      *max_output_ports)
+{
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  if (n_input_ports)
+    *n_input_ports = 0;
+  if (n_output_ports)
+    *n_output_ports = 1;
+  if (max_input_ports)
+    *max_input_ports = 0;
+  if (max_output_ports)
+    *max_output_ports = 1;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_null_source_node_get_port_ids (SpaNode       *node,
+                                 uint32_t       n_input_ports,
+                                 uint32_t      *input_ids,
+                                 uint32_t       n_output_ports,
+                                 uint32_t      *output_ids)
+{
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  if (n_output_ports > 0 && output_ids != NULL)
+    output_ids[0] = 0;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_null_source_node_add_port (SpaNode        *node,
+                             SpaDirection    direction,
+                             uint32_t        port_id)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_null_source_node_remove_port (SpaNode        *node,
+                                SpaDirection    direction,
+                                uint32_t        port_id)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_null_source_node_port_enum_formats (SpaNode          *node,
+                                      SpaDirection      direction,
+                                      uint32_t          port_id,
+                                      SpaFormat       **format,
+                                      const SpaFormat  *filter,
+                                      uint32_t          index)
+{
+  SpaNullSource *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (format != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaNullSource, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  return spa_null_enum_format (this, format, filter, index);
+}
+
+static SpaResult
+spa_null_source_node_port_set_format (SpaNode         *node,
+                                    SpaDirection     direction,
+                                    uint32_t         port_id,
+                                    uint32_t         flags,
+                                    const SpaFormat *format)
+{
+  SpaNullSource *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaNullSource, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  return spa_null_set_format (this, format);
+}
+
+static SpaResult
+spa_null_source_node_port_get_format (SpaNode          *node,
+                                    SpaDirection      direction,
+                                    uint32_t          port_id,
+                                    const SpaFormat **format)
+{
+  SpaNullSource *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (format != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaNullSource, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  return spa_null_get_format (this, format);
+}
+
+static SpaResult
+spa_null_source_node_port_get_info (SpaNode            *node,
+                                  SpaDirection        direction,
+                                  uint32_t            port_id,
+                                  const SpaPortInfo **info)
+{
+  SpaNullSource *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (info != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaNullSource, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  *info = &this->info;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_null_source_node_port_get_props (SpaNode       *node,
+                                   SpaDirection   direction,
+                                   uint32_t       port_id,
+                                   SpaProps     **props)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_null_source_node_port_set_props (SpaNode        *node,
+                                   SpaDirection    direction,
+                                   uint32_t        port_id,
+                                   const SpaProps *props)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_null_source_node_port_use_buffers (SpaNode         *node,
+                                     SpaDirection     direction,
+                                     uint32_t         port_id,
+                                     SpaBuffer      **buffers,
+                                     uint32_t         n_buffers)
+{
+  SpaNullSource *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaNullSource, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  return spa_null_use_buffers (this, buffers, n_buffers);
+}
+
+static SpaResult
+spa_null_source_node_port_alloc_buffers (SpaNode         *node,
+                                       SpaDirection     direction,
+                                       uint32_t         port_id,
+                                       SpaAllocParam  **params,
+                                       uint32_t         n_params,
+                                       SpaBuffer      **buffers,
+                                       uint32_t        *n_buffers)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_null_source_node_port_set_io (SpaNode       *node,
+                                SpaDirection   direction,
+                                uint32_t       port_id,
+                                SpaPortIO     *io)
+{
+  SpaNullSource *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaNullSource, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  this->io = io;
+
+  return SPA_RESULT_OK;
+}
+
+static inline void
+reuse_buffer (SpaNullSource *this, uint32_t id)
+{
+  SpaNullBuffer *b = &this->buffers[id];
+  spa_return_if_fail (b->outstanding);
+
+  spa_log_trace (this->log, "null-source %p: reuse buffer %d", this, id);
+
+  b->outstanding = false;
+  spa_list_insert (this->free.prev, &b->link);
+
+  if (this->started && !this->props.live)
+    spa_null_set_timer (this, true);
+}
+
+static SpaResult
+spa_null_source_node_port_reuse_buffer (SpaNode         *node,
+                                        uint32_t         port_id,
+                                        uint32_t         buffer_id)
+{
+  SpaNullSource *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaNullSource, node);
+
+  spa_return_val_if_fail (port_id == 0, SPA_RESULT_INVALID_PORT);
+  spa_return_val_if_fail (this->n_buffers > 0, SPA_RESULT_NO_BUFFERS);
+  spa_return_val_if_fail (buffer_id < this->n_buffers, SPA_RESULT_INVALID_BUFFER_ID);
+
+  reuse_buffer (this, buffer_id);
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_null_source_node_port_send_command (SpaNode        *node,
+                                        SpaDirection    direction,
+                                        uint32_t        port_id,
+                                        SpaCommand     *command)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_null_source_node_process_input (SpaNode *node)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_null_source_node_process_output (SpaNode *node)
+{
+  SpaNullSource *this;
+  SpaPortIO *io;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaNullSource, node);
+  io = this->io;
+  spa_return_val_if_fail (io != NULL, SPA_RESULT_WRONG_STATE);
+
+  if (io->status == SPA_RESULT_HAVE_BUFFER)
+    return SPA_RESULT_HAVE_BUFFER;
+
+  if (io->buffer_id != SPA_ID_INVALID) {
+    reuse_buffer (this, io->buffer_id);
+    io->buffer_id = SPA_ID_INVALID;
+  }
+
+  /* pulled by the graph, the cycle is the time between two pulls */
+  if (!this->callbacks.have_output && (io->status == SPA_RESULT_NEED_BUFFER)) {
+    spa_null_cycle_end (this);
+    spa_null_cycle_begin (this);
+    return null_source_make_buffer (this);
+  }
+  else
+    return SPA_RESULT_OK;
+}
+
+static const SpaNode nullsource_node = {
+  sizeof (SpaNode),
+  NULL,
+  spa_null_source_node_get_props,
+  spa_null_source_node_set_props,
+  spa_null_source_node_send_command,
+  spa_null_source_node_set_callbacks,
+  spa_null_source_node_get_n_ports,
+  spa_null_source_node_get_port_ids,
+  spa_null_source_node_add_port,
+  spa_null_source_node_remove_port,
+  spa_null_source_node_port_enum_formats,
+  spa_null_source_node_port_set_format,
+  spa_null_source_node_port_get_format,
+  spa_null_source_node_port_get_info,
+  spa_null_source_node_port_get_props,
+  spa_null_source_node_port_set_props,
+  spa_null_source_node_port_use_buffers,
+  spa_null_source_node_port_alloc_buffers,
+  spa_null_source_node_port_set_io,
+  spa_null_source_node_port_reuse_buffer,
+  spa_null_source_node_port_send_command,
+  spa_null_source_node_process_input,
+  spa_null_source_node_process_output,
+};
+
+static SpaResult
+spa_null_source_clock_get_props (SpaClock  *clock,
+                               SpaProps **props)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_null_source_clock_set_props (SpaClock       *clock,
+                               const SpaProps *props)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_null_source_clock_get_time (SpaClock         *clock,
+                              int32_t          *rate,
+                              int64_t          *ticks,
+                              int64_t          *monotonic_time)
+{
+  SpaNullSource *this;
+
+  spa_return_val_if_fail (clock != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (clock, SpaNullSource, clock);
+
+  return spa_null_get_time (this, rate, ticks, monotonic_time);
+}
+
+static const SpaClock nullsource_clock = {
+  sizeof (SpaClock),
+  NULL,
+  SPA_CLOCK_STATE_STOPPED,
+  spa_null_source_clock_get_props,
+  spa_null_source_clock_set_props,
+  spa_null_source_clock_get_time,
+};
+
+static SpaResult
+spa_null_source_get_interface (SpaHandle         *handle,
+                             uint32_t           interface_id,
+                             void             **interface)
+{
+  SpaNullSource *this;
+
+  spa_return_val_if_fail (handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (interface != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = (SpaNullSource *) handle;
+
+  if (interface_id == this->type.node)
+    *interface = &this->node;
+  else if (interface_id == this->type.clock)
+    *interface = &this->clock;
+  else
+    return SPA_RESULT_UNKNOWN_INTERFACE;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+null_source_clear (SpaHandle *handle)
+{
+  spa_return_val_if_fail (handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  spa_null_clear ((SpaNullSource *) handle);
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+null_source_init (const SpaHandleFactory  *factory,
+                SpaHandle               *handle,
+                const SpaDict           *info,
+                const SpaSupport        *support,
+                uint32_t                 n_support)
+{
+  SpaNullSource *this;
+  SpaResult res;
+
+  spa_return_val_if_fail (factory != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  handle->get_interface = spa_null_source_get_interface;
+  handle->clear = null_source_clear;
+
+  this = (SpaNullSource *) handle;
+  this->node = nullsource_node;
+  this->clock = nullsource_clock;
+  this->direction = SPA_DIRECTION_OUTPUT;
+  this->name = "null-source";
+  this->timer_source.func = null_source_on_timer;
+
+  if ((res = spa_null_init (this, support, n_support)) != SPA_RESULT_OK)
+    return res;
+
+  spa_log_info (this->log, "null-source %p: initialized", this);
+
+  return SPA_RESULT_OK;
+}
+
+static const SpaInterfaceInfo null_source_interfaces[] =
+{
+  { SPA_TYPE__Node, },
+  { SPA_TYPE__Clock, },
+};
+
+static SpaResult
+null_source_enum_interface_info (const SpaHandleFactory  *factory,
+                               const SpaInterfaceInfo **info,
+                               uint32_t                 index)
+{
+  spa_return_val_if_fail (factory != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (info != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  switch (index) {
+    case 0:
+    case 1:
+      *info = &null_source_interfaces[index];
+      break;
+    default:
+      return SPA_RESULT_ENUM_END;
+  }
+  return SPA_RESULT_OK;
+}
+
+const SpaHandleFactory spa_null_source_factory =
+{ "null-source",
+  NULL,
+  sizeof (SpaNullSource),
+  null_source_init,
+  null_source_enum_interface_info,
+};
@@ -0,0 +1,555 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <lib/props.h>
+
+#include "null-utils.h"
+
+#define DEFAULT_LIVE          true
+#define DEFAULT_PERIOD_SIZE   1024
+
+static inline int64_t
+get_monotonic_time (void)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return SPA_TIMESPEC_TO_TIME (&now);
+}
+
+SpaResult
+spa_null_init (SpaNullState     *state,
+               const SpaSupport *support,
+               uint32_t          n_support)
+{
+  uint32_t i;
+
+  for (i = 0; i < n_support; i++) {
+    if (strcmp (support[i].type, SPA_TYPE__TypeMap) == 0)
+      state->map = support[i].data;
+    else if (strcmp (support[i].type, SPA_TYPE__Log) == 0)
+      state->log = support[i].data;
+    else if (strcmp (support[i].type, SPA_TYPE_LOOP__DataLoop) == 0)
+      state->data_loop = support[i].data;
+  }
+  if (state->map == NULL) {
+    spa_log_error (state->log, "a type-map is needed");
+    return SPA_RESULT_ERROR;
+  }
+  init_type (&state->type, state->map);
+
+  spa_null_reset_props (state);
+
+  spa_list_init (&state->free);
+  spa_list_init (&state->ready);
+  state->cycle_start = -1;
+
+  state->timer_source.data = state;
+  state->timer_source.fd = timerfd_create (CLOCK_MONOTONIC, TFD_CLOEXEC);
+  state->timer_source.mask = SPA_IO_IN;
+  state->timer_source.rmask = 0;
+  state->timerspec.it_value.tv_sec = 0;
+  state->timerspec.it_value.tv_nsec = 0;
+  state->timerspec.it_interval.tv_sec = 0;
+  state->timerspec.it_interval.tv_nsec = 0;
+
+  if (state->data_loop)
+    spa_loop_add_source (state->data_loop, &state->timer_source);
+
+  state->info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS |
+                      SPA_PORT_INFO_FLAG_NO_REF;
+  if (state->props.live)
+    state->info.flags |= SPA_PORT_INFO_FLAG_LIVE;
+
+  return SPA_RESULT_OK;
+}
+
+void
+spa_null_clear (SpaNullState *state)
+{
+  if (state->data_loop)
+    spa_loop_remove_source (state->data_loop, &state->timer_source);
+  close (state->timer_source.fd);
+}
+
+void
+spa_null_reset_props (SpaNullState *state)
+{
+  state->props.live = DEFAULT_LIVE;
+  state->props.period_size = DEFAULT_PERIOD_SIZE;
+}
+
+SpaResult
+spa_null_get_props (SpaNullState  *state,
+                    SpaProps     **props)
+{
+  SpaPODBuilder b = { NULL,  };
+  SpaPODFrame f[2];
+  SpaNullStats *stats = &state->stats;
+  int64_t avg_cycle = stats->cycles > 0 ? stats->total_cycle / stats->cycles : 0;
+
+  spa_pod_builder_init (&b, state->props_buffer, sizeof (state->props_buffer));
+  spa_pod_builder_props (&b, &f[0], state->type.props,
+    PROP    (&f[1], state->type.prop_live,           SPA_POD_TYPE_BOOL, state->props.live),
+    PROP_MM (&f[1], state->type.prop_period_size,    SPA_POD_TYPE_INT,  state->props.period_size,
+                                                                        1, INT32_MAX),
+    PROP_R  (&f[1], state->type.prop_bytes,          SPA_POD_TYPE_LONG, stats->bytes),
+    PROP_R  (&f[1], state->type.prop_cycles,         SPA_POD_TYPE_LONG, stats->cycles),
+    PROP_R  (&f[1], state->type.prop_xruns,          SPA_POD_TYPE_INT,  stats->xruns),
+    PROP_R  (&f[1], state->type.prop_min_cycle_time, SPA_POD_TYPE_LONG, stats->min_cycle),
+    PROP_R  (&f[1], state->type.prop_max_cycle_time, SPA_POD_TYPE_LONG, stats->max_cycle),
+    PROP_R  (&f[1], state->type.prop_avg_cycle_time, SPA_POD_TYPE_LONG, avg_cycle));
+
+  *props = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaProps);
+
+  return SPA_RESULT_OK;
+}
+
+SpaResult
+spa_null_set_props (SpaNullState   *state,
+                    const SpaProps *props)
+{
+  if (props == NULL) {
+    spa_null_reset_props (state);
+  } else {
+    spa_props_query (props,
+        state->type.prop_live,        SPA_POD_TYPE_BOOL, &state->props.live,
+        state->type.prop_period_size, SPA_POD_TYPE_INT,  &state->props.period_size,
+        0);
+    if (state->props.period_size == 0)
+      state->props.period_size = DEFAULT_PERIOD_SIZE;
+  }
+
+  if (state->props.live)
+    state->info.flags |= SPA_PORT_INFO_FLAG_LIVE;
+  else
+    state->info.flags &= ~SPA_PORT_INFO_FLAG_LIVE;
+
+  return SPA_RESULT_OK;
+}
+
+SpaResult
+spa_null_enum_format (SpaNullState     *state,
+                      SpaFormat       **format,
+                      const SpaFormat  *filter,
+                      uint32_t          index)
+{
+  SpaResult res;
+  SpaFormat *fmt;
+  uint8_t buffer[256];
+  SpaPODBuilder b = { NULL, };
+  SpaPODFrame f[2];
+  uint32_t count, match;
+
+  count = match = filter ? 0 : index;
+
+next:
+  spa_pod_builder_init (&b, buffer, sizeof (buffer));
+
+  switch (count++) {
+    case 0:
+      spa_pod_builder_format (&b, &f[0], state->type.format,
+          state->type.media_type.audio, state->type.media_subtype.raw,
+          PROP_U_EN (&f[1], state->type.format_audio.format,   SPA_POD_TYPE_ID,  5, state->type.audio_format.S16,
+                                                                                 state->type.audio_format.S16,
+                                                                                 state->type.audio_format.S32,
+                                                                                 state->type.audio_format.F32,
+                                                                                 state->type.audio_format.F64),
+          PROP_U_MM (&f[1], state->type.format_audio.rate,     SPA_POD_TYPE_INT, 44100, 1, INT32_MAX),
+          PROP_U_MM (&f[1], state->type.format_audio.channels, SPA_POD_TYPE_INT, 2,     1, INT32_MAX));
+      break;
+    case 1:
+      spa_pod_builder_format (&b, &f[0], state->type.format,
+         state->type.media_type.video, state->type.media_subtype.raw,
+         PROP_U_EN (&f[1], state->type.format_video.format,    SPA_POD_TYPE_ID,  3,
+                                                              state->type.video_format.RGB,
+                                                              state->type.video_format.RGB,
+                                                              state->type.video_format.UYVY),
+         PROP_U_MM (&f[1], state->type.format_video.size,      SPA_POD_TYPE_RECTANGLE,
+                                                              320, 240,
+                                                              1, 1,
+                                                              INT32_MAX, INT32_MAX),
+         PROP_U_MM (&f[1], state->type.format_video.framerate, SPA_POD_TYPE_FRACTION,
+                                                              25, 1,
+                                                              1, 1,
+                                                              INT32_MAX, 1));
+      break;
+    default:
+      return SPA_RESULT_ENUM_END;
+  }
+  fmt = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaFormat);
+
+  spa_pod_builder_init (&b, state->format_buffer, sizeof (state->format_buffer));
+
+  if ((res = spa_format_filter (fmt, filter, &b)) != SPA_RESULT_OK || match++ != index)
+    goto next;
+
+  *format = SPA_POD_BUILDER_DEREF (&b, 0, SpaFormat);
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+parse_audio (SpaNullState *state, const SpaFormat *format)
+{
+  SpaAudioInfoRaw info = { 0, };
+  size_t bps;
+
+  if (!spa_format_audio_raw_parse (format, &info, &state->type.format_audio))
+    return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+  if (info.format == state->type.audio_format.S16)
+    bps = 2;
+  else if (info.format == state->type.audio_format.S32 ||
+           info.format == state->type.audio_format.F32)
+    bps = 4;
+  else if (info.format == state->type.audio_format.F64)
+    bps = 8;
+  else
+    return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+  if (info.rate == 0 || info.channels == 0)
+    return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+  state->audio_info = info;
+  state->frame_size = bps * info.channels;
+  state->stride = state->frame_size;
+  state->frame_rate.num = info.rate;
+  state->frame_rate.denom = 1;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+parse_video (SpaNullState *state, const SpaFormat *format)
+{
+  SpaVideoInfoRaw info = { 0, };
+  size_t bpp;
+
+  if (!spa_format_video_raw_parse (format, &info, &state->type.format_video))
+    return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+  if (info.format == state->type.video_format.RGB)
+    bpp = 3;
+  else if (info.format == state->type.video_format.UYVY)
+    bpp = 2;
+  else
+    return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+  /* we need a fixed framerate to pace the frames */
+  if (info.framerate.num == 0 || info.framerate.denom == 0)
+    return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+  state->video_info = info;
+  state->stride = SPA_ROUND_UP_N (bpp * info.size.width, 4);
+  state->frame_size = state->stride * info.size.height;
+  state->frame_rate = info.framerate;
+
+  return SPA_RESULT_OK;
+}
+
+SpaResult
+spa_null_set_format (SpaNullState    *state,
+                     const SpaFormat *format)
+{
+  SpaPODBuilder b = { NULL };
+  SpaPODFrame f[2];
+  uint32_t media_type, media_subtype;
+  SpaResult res;
+  size_t size;
+
+  if (format == NULL) {
+    state->have_format = false;
+    spa_null_clear_buffers (state);
+    return SPA_RESULT_OK;
+  }
+
+  media_type = SPA_FORMAT_MEDIA_TYPE (format);
+  media_subtype = SPA_FORMAT_MEDIA_SUBTYPE (format);
+
+  if (media_subtype != state->type.media_subtype.raw)
+    return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+  if (media_type == state->type.media_type.audio)
+    res = parse_audio (state, format);
+  else if (media_type == state->type.media_type.video)
+    res = parse_video (state, format);
+  else
+    res = SPA_RESULT_INVALID_MEDIA_TYPE;
+
+  if (res != SPA_RESULT_OK)
+    return res;
+
+  state->media_type = media_type;
+  state->have_format = true;
+
+  if (media_type == state->type.media_type.audio) {
+    size = state->props.period_size * state->frame_size;
+    state->info.latency = FRAMES_TO_TIME (state, state->props.period_size);
+  } else {
+    size = state->frame_size;
+    state->info.latency = FRAMES_TO_TIME (state, 1);
+  }
+  state->info.maxbuffering = -1;
+  state->info.n_params = 2;
+  state->info.params = state->params;
+
+  spa_pod_builder_init (&b, state->params_buffer, sizeof (state->params_buffer));
+  spa_pod_builder_object (&b, &f[0], 0, state->type.alloc_param_buffers.Buffers,
+    PROP      (&f[1], state->type.alloc_param_buffers.size,    SPA_POD_TYPE_INT, size),
+    PROP      (&f[1], state->type.alloc_param_buffers.stride,  SPA_POD_TYPE_INT, state->stride),
+    PROP_U_MM (&f[1], state->type.alloc_param_buffers.buffers, SPA_POD_TYPE_INT, MAX_BUFFERS, 2, MAX_BUFFERS),
+    PROP      (&f[1], state->type.alloc_param_buffers.align,   SPA_POD_TYPE_INT, 16));
+  state->params[0] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
+
+  spa_pod_builder_object (&b, &f[0], 0, state->type.alloc_param_meta_enable.MetaEnable,
+    PROP      (&f[1], state->type.alloc_param_meta_enable.type, SPA_POD_TYPE_ID, state->type.meta.Header),
+    PROP      (&f[1], state->type.alloc_param_meta_enable.size, SPA_POD_TYPE_INT, sizeof (SpaMetaHeader)));
+  state->params[1] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
+
+  state->info.extra = NULL;
+
+  return SPA_RESULT_OK;
+}
+
+SpaResult
+spa_null_get_format (SpaNullState     *state,
+                     const SpaFormat **format)
+{
+  SpaPODBuilder b = { NULL, };
+  SpaPODFrame f[2];
+
+  if (!state->have_format)
+    return SPA_RESULT_NO_FORMAT;
+
+  spa_pod_builder_init (&b, state->format_buffer, sizeof (state->format_buffer));
+
+  if (state->media_type == state->type.media_type.audio) {
+    spa_pod_builder_format (&b, &f[0], state->type.format,
+       state->type.media_type.audio, state->type.media_subtype.raw,
+       PROP (&f[1], state->type.format_audio.format,   SPA_POD_TYPE_ID,  state->audio_info.format),
+       PROP (&f[1], state->type.format_audio.rate,     SPA_POD_TYPE_INT, state->audio_info.rate),
+       PROP (&f[1], state->type.format_audio.channels, SPA_POD_TYPE_INT, state->audio_info.channels));
+  } else {
+    spa_pod_builder_format (&b, &f[0], state->type.format,
+       state->type.media_type.video, state->type.media_subtype.raw,
+       PROP (&f[1], state->type.format_video.format,     SPA_POD_TYPE_ID,        state->video_info.format),
+       PROP (&f[1], state->type.format_video.size,      -SPA_POD_TYPE_RECTANGLE, &state->video_info.size),
+       PROP (&f[1], state->type.format_video.framerate, -SPA_POD_TYPE_FRACTION,  &state->video_info.framerate));
+  }
+  *format = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaFormat);
+
+  return SPA_RESULT_OK;
+}
+
+SpaResult
+spa_null_use_buffers (SpaNullState  *state,
+                      SpaBuffer    **buffers,
+                      uint32_t       n_buffers)
+{
+  uint32_t i;
+
+  if (!state->have_format)
+    return SPA_RESULT_NO_FORMAT;
+
+  if (n_buffers > MAX_BUFFERS)
+    return SPA_RESULT_ERROR;
+
+  spa_null_clear_buffers (state);
+
+  for (i = 0; i < n_buffers; i++) {
+    SpaNullBuffer *b = &state->buffers[i];
+    SpaData *d = buffers[i]->datas;
+
+    b->outbuf = buffers[i];
+    b->h = spa_buffer_find_meta (buffers[i], state->type.meta.Header);
+    b->rb = spa_buffer_find_meta (buffers[i], state->type.meta.Ringbuffer);
+
+    if ((d[0].type == state->type.data.MemPtr ||
+         d[0].type == state->type.data.MemFd ||
+         d[0].type == state->type.data.DmaBuf) &&
+        d[0].data == NULL) {
+      spa_log_error (state->log, "%s %p: invalid memory on buffer %p", state->name, state, buffers[i]);
+    }
+
+    /* the buffers of an input port are with the graph until they are
+     * pushed to us */
+    if (state->direction == SPA_DIRECTION_INPUT) {
+      b->outstanding = true;
+    } else {
+      b->outstanding = false;
+      spa_list_insert (state->free.prev, &b->link);
+    }
+  }
+  state->n_buffers = n_buffers;
+
+  return SPA_RESULT_OK;
+}
+
+void
+spa_null_clear_buffers (SpaNullState *state)
+{
+  if (state->n_buffers > 0) {
+    spa_log_info (state->log, "%s %p: clear buffers", state->name, state);
+    state->n_buffers = 0;
+    spa_list_init (&state->free);
+    spa_list_init (&state->ready);
+    state->started = false;
+    spa_null_set_timer (state, false);
+  }
+}
+
+SpaResult
+spa_null_start (SpaNullState *state)
+{
+  if (!state->have_format)
+    return SPA_RESULT_NO_FORMAT;
+
+  if (state->n_buffers == 0)
+    return SPA_RESULT_NO_BUFFERS;
+
+  if (state->started)
+    return SPA_RESULT_OK;
+
+  if (state->props.live)
+    state->start_time = get_monotonic_time ();
+  else
+    state->start_time = 0;
+  state->frame_count = 0;
+  state->elapsed_time = 0;
+
+  state->cycle_start = -1;
+  memset (&state->stats, 0, sizeof (SpaNullStats));
+
+  state->started = true;
+  spa_null_set_timer (state, true);
+
+  return SPA_RESULT_OK;
+}
+
+SpaResult
+spa_null_pause (SpaNullState *state)
+{
+  if (!state->have_format)
+    return SPA_RESULT_NO_FORMAT;
+
+  if (state->n_buffers == 0)
+    return SPA_RESULT_NO_BUFFERS;
+
+  if (!state->started)
+    return SPA_RESULT_OK;
+
+  state->started = false;
+  spa_null_set_timer (state, false);
+
+  return SPA_RESULT_OK;
+}
+
+/* a sink always runs from the timer, a source only when it pushes
+ * buffers or runs in real time */
+static inline bool
+use_timer (SpaNullState *state)
+{
+  return state->direction == SPA_DIRECTION_INPUT ||
+         state->callbacks.have_output ||
+         state->props.live;
+}
+
+void
+spa_null_set_timer (SpaNullState *state, bool enabled)
+{
+  if (!use_timer (state))
+    return;
+
+  if (enabled) {
+    if (state->props.live) {
+      uint64_t next_time = state->start_time + state->elapsed_time;
+      state->timerspec.it_value.tv_sec = next_time / SPA_NSEC_PER_SEC;
+      state->timerspec.it_value.tv_nsec = next_time % SPA_NSEC_PER_SEC;
+    } else {
+      state->timerspec.it_value.tv_sec = 0;
+      state->timerspec.it_value.tv_nsec = 1;
+    }
+  } else {
+    state->timerspec.it_value.tv_sec = 0;
+    state->timerspec.it_value.tv_nsec = 0;
+  }
+  timerfd_settime (state->timer_source.fd, TFD_TIMER_ABSTIME, &state->timerspec, NULL);
+}
+
+void
+spa_null_read_timer (SpaNullState *state)
+{
+  uint64_t expirations;
+
+  if (!use_timer (state))
+    return;
+
+  if (read (state->timer_source.fd, &expirations, sizeof (uint64_t)) < sizeof (uint64_t))
+    perror ("read timerfd");
+}
+
+void
+spa_null_cycle_begin (SpaNullState *state)
+{
+  state->cycle_start = get_monotonic_time ();
+}
+
+void
+spa_null_cycle_end (SpaNullState *state)
+{
+  SpaNullStats *stats = &state->stats;
+  int64_t elapsed;
+
+  if (state->cycle_start < 0)
+    return;
+
+  elapsed = get_monotonic_time () - state->cycle_start;
+  state->cycle_start = -1;
+
+  if (stats->cycles == 0 || elapsed < stats->min_cycle)
+    stats->min_cycle = elapsed;
+  if (elapsed > stats->max_cycle)
+    stats->max_cycle = elapsed;
+  stats->total_cycle += elapsed;
+  stats->cycles++;
+}
+
+SpaResult
+spa_null_get_time (SpaNullState *state,
+                   int32_t      *rate,
+                   int64_t      *ticks,
+                   int64_t      *monotonic_time)
+{
+  int64_t now = get_monotonic_time ();
+
+  if (rate)
+    *rate = SPA_NSEC_PER_SEC;
+  if (ticks)
+    *ticks = now;
+  if (monotonic_time)
+    *monotonic_time = now;
+
+  return SPA_RESULT_OK;
+}
@@ -0,0 +1,252 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_NULL_UTILS_H__
+#define __SPA_NULL_UTILS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <sys/timerfd.h>
+
+#include <spa/type-map.h>
+#include <spa/clock.h>
+#include <spa/log.h>
+#include <spa/list.h>
+#include <spa/node.h>
+#include <spa/loop.h>
+#include <spa/ringbuffer.h>
+#include <spa/audio/format-utils.h>
+#include <spa/video/format-utils.h>
+#include <spa/format-builder.h>
+
+typedef struct _SpaNullState SpaNullState;
+typedef struct _SpaNullBuffer SpaNullBuffer;
+
+/**
+ * SpaNullProps:
+ * @live: run at the pace of the format or as fast as possible
+ * @period_size: audio frames to consume or produce in one cycle. Video
+ *    always uses one frame per cycle.
+ */
+typedef struct {
+  bool     live;
+  uint32_t period_size;
+} SpaNullProps;
+
+/**
+ * SpaNullStats:
+ * @bytes: bytes consumed or produced since the start
+ * @cycles: number of completed cycles
+ * @xruns: cycles in which the graph did not provide a buffer
+ * @min_cycle: shortest cycle, in nanoseconds
+ * @max_cycle: longest cycle, in nanoseconds
+ * @total_cycle: the duration of all cycles, in nanoseconds
+ *
+ * A cycle of a sink is the time between asking for a buffer and receiving
+ * it. A cycle of a source is the time it takes to push a buffer through
+ * the graph or, when the graph pulls, the time between two pulls.
+ */
+typedef struct {
+  int64_t  bytes;
+  int64_t  cycles;
+  uint32_t xruns;
+  int64_t  min_cycle;
+  int64_t  max_cycle;
+  int64_t  total_cycle;
+} SpaNullStats;
+
+#define MAX_BUFFERS 32
+
+struct _SpaNullBuffer {
+  SpaBuffer *outbuf;
+  SpaMetaHeader *h;
+  SpaMetaRingbuffer *rb;
+  bool outstanding;
+  SpaList link;
+};
+
+typedef struct {
+  uint32_t node;
+  uint32_t clock;
+  uint32_t format;
+  uint32_t props;
+  uint32_t prop_live;
+  uint32_t prop_period_size;
+  uint32_t prop_bytes;
+  uint32_t prop_cycles;
+  uint32_t prop_xruns;
+  uint32_t prop_min_cycle_time;
+  uint32_t prop_max_cycle_time;
+  uint32_t prop_avg_cycle_time;
+  SpaTypeMeta meta;
+  SpaTypeData data;
+  SpaTypeMediaType media_type;
+  SpaTypeMediaSubtype media_subtype;
+  SpaTypeFormatAudio format_audio;
+  SpaTypeAudioFormat audio_format;
+  SpaTypeFormatVideo format_video;
+  SpaTypeVideoFormat video_format;
+  SpaTypeEventNode event_node;
+  SpaTypeCommandNode command_node;
+  SpaTypeAllocParamBuffers alloc_param_buffers;
+  SpaTypeAllocParamMetaEnable alloc_param_meta_enable;
+} Type;
+
+static inline void
+init_type (Type *type, SpaTypeMap *map)
+{
+  type->node = spa_type_map_get_id (map, SPA_TYPE__Node);
+  type->clock = spa_type_map_get_id (map, SPA_TYPE__Clock);
+  type->format = spa_type_map_get_id (map, SPA_TYPE__Format);
+  type->props = spa_type_map_get_id (map, SPA_TYPE__Props);
+  type->prop_live = spa_type_map_get_id (map, SPA_TYPE_PROPS__live);
+  type->prop_period_size = spa_type_map_get_id (map, SPA_TYPE_PROPS__periodSize);
+  type->prop_bytes = spa_type_map_get_id (map, SPA_TYPE_PROPS__bytes);
+  type->prop_cycles = spa_type_map_get_id (map, SPA_TYPE_PROPS__cycles);
+  type->prop_xruns = spa_type_map_get_id (map, SPA_TYPE_PROPS__xruns);
+  type->prop_min_cycle_time = spa_type_map_get_id (map, SPA_TYPE_PROPS__minCycleTime);
+  type->prop_max_cycle_time = spa_type_map_get_id (map, SPA_TYPE_PROPS__maxCycleTime);
+  type->prop_avg_cycle_time = spa_type_map_get_id (map, SPA_TYPE_PROPS__avgCycleTime);
+  spa_type_meta_map (map, &type->meta);
+  spa_type_data_map (map, &type->data);
+  spa_type_media_type_map (map, &type->media_type);
+  spa_type_media_subtype_map (map, &type->media_subtype);
+  spa_type_format_audio_map (map, &type->format_audio);
+  spa_type_audio_format_map (map, &type->audio_format);
+  spa_type_format_video_map (map, &type->format_video);
+  spa_type_video_format_map (map, &type->video_format);
+  spa_type_event_node_map (map, &type->event_node);
+  spa_type_command_node_map (map, &type->command_node);
+  spa_type_alloc_param_buffers_map (map, &type->alloc_param_buffers);
+  spa_type_alloc_param_meta_enable_map (map, &type->alloc_param_meta_enable);
+}
+
+struct _SpaNullState {
+  SpaHandle handle;
+  SpaNode node;
+  SpaClock clock;
+
+  Type type;
+  SpaTypeMap *map;
+  SpaLog *log;
+  SpaLoop *data_loop;
+
+  SpaDirection direction;
+  const char *name;
+
+  SpaNodeCallbacks callbacks;
+  void *user_data;
+
+  uint8_t props_buffer[1024];
+  SpaNullProps props;
+
+  SpaSource timer_source;
+  struct itimerspec timerspec;
+
+  SpaPortInfo info;
+  SpaAllocParam *params[2];
+  uint8_t params_buffer[1024];
+  SpaPortIO *io;
+
+  bool have_format;
+  uint32_t media_type;
+  SpaAudioInfoRaw audio_info;
+  SpaVideoInfoRaw video_info;
+  uint8_t format_buffer[1024];
+  size_t frame_size;
+  int stride;
+  SpaFraction frame_rate;
+
+  SpaNullBuffer buffers[MAX_BUFFERS];
+  uint32_t n_buffers;
+  SpaList free;
+  SpaList ready;
+
+  bool started;
+  uint64_t start_time;
+  uint64_t elapsed_time;
+  uint64_t frame_count;
+
+  int64_t cycle_start;
+  SpaNullStats stats;
+};
+
+#define FRAMES_TO_TIME(s,f)     ((f) * (s)->frame_rate.denom * SPA_NSEC_PER_SEC / (s)->frame_rate.num)
+
+#define PROP(f,key,type,...)                                                    \
+          SPA_POD_PROP (f,key,0,type,1,__VA_ARGS__)
+#define PROP_R(f,key,type,...)                                                  \
+          SPA_POD_PROP (f,key,SPA_POD_PROP_FLAG_READONLY,type,1,__VA_ARGS__)
+#define PROP_MM(f,key,type,...)                                                 \
+          SPA_POD_PROP (f,key,SPA_POD_PROP_RANGE_MIN_MAX,type,3,__VA_ARGS__)
+#define PROP_U_MM(f,key,type,...)                                               \
+          SPA_POD_PROP (f,key,SPA_POD_PROP_FLAG_UNSET |                         \
+                              SPA_POD_PROP_RANGE_MIN_MAX,type,3,__VA_ARGS__)
+#define PROP_EN(f,key,type,n,...)                                               \
+          SPA_POD_PROP (f,key,SPA_POD_PROP_RANGE_ENUM,type,n,__VA_ARGS__)
+#define PROP_U_EN(f,key,type,n,...)                                             \
+          SPA_POD_PROP (f,key,SPA_POD_PROP_FLAG_UNSET |                         \
+                              SPA_POD_PROP_RANGE_ENUM,type,n,__VA_ARGS__)
+
+SpaResult spa_null_init (SpaNullState     *state,
+                         const SpaSupport *support,
+                         uint32_t          n_support);
+void      spa_null_clear (SpaNullState *state);
+
+void      spa_null_reset_props (SpaNullState *state);
+SpaResult spa_null_get_props (SpaNullState  *state,
+                              SpaProps     **props);
+SpaResult spa_null_set_props (SpaNullState   *state,
+                              const SpaProps *props);
+
+SpaResult spa_null_enum_format (SpaNullState     *state,
+                                SpaFormat       **format,
+                                const SpaFormat  *filter,
+                                uint32_t          index);
+SpaResult spa_null_set_format (SpaNullState    *state,
+                               const SpaFormat *format);
+SpaResult spa_null_get_format (SpaNullState     *state,
+                               const SpaFormat **format);
+SpaResult spa_null_use_buffers (SpaNullState  *state,
+                                SpaBuffer    **buffers,
+                                uint32_t       n_buffers);
+void      spa_null_clear_buffers (SpaNullState *state);
+
+SpaResult spa_null_start (SpaNullState *state);
+SpaResult spa_null_pause (SpaNullState *state);
+
+void      spa_null_set_timer (SpaNullState *state, bool enabled);
+void      spa_null_read_timer (SpaNullState *state);
+
+void      spa_null_cycle_begin (SpaNullState *state);
+void      spa_null_cycle_end (SpaNullState *state);
+
+SpaResult spa_null_get_time (SpaNullState *state,
+                             int32_t      *rate,
+                             int64_t      *ticks,
+                             int64_t      *monotonic_time);
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* __SPA_NULL_UTILS_H__ */
@@ -0,0 +1,66 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <immintrin.h>
+
+#include "resample-ops.h"
+
+static inline float
+dot_avx2 (const float *s, const float *t, uint32_t n_taps)
+{
+  __m256 sum0 = _mm256_setzero_ps (), sum1 = _mm256_setzero_ps ();
+  __m128 sum;
+  uint32_t i;
+
+  for (i = 0; i < n_taps; i += 16) {
+    sum0 = _mm256_add_ps (sum0, _mm256_mul_ps (_mm256_loadu_ps (&s[i]),     _mm256_load_ps (&t[i])));
+    sum1 = _mm256_add_ps (sum1, _mm256_mul_ps (_mm256_loadu_ps (&s[i + 8]), _mm256_load_ps (&t[i + 8])));
+  }
+  sum0 = _mm256_add_ps (sum0, sum1);
+  sum = _mm_add_ps (_mm256_castps256_ps128 (sum0), _mm256_extractf128_ps (sum0, 1));
+  sum = _mm_add_ps (sum, _mm_movehl_ps (sum, sum));
+  sum = _mm_add_ss (sum, _mm_shuffle_ps (sum, sum, 0x55));
+
+  return _mm_cvtss_f32 (sum);
+}
+
+uint32_t
+spa_resample_process_avx2 (const SpaResampleFilter *filter,
+                           float *dst, uint32_t dst_stride,
+                           const float *src, uint32_t n_src,
+                           uint32_t *index, uint32_t *phase,
+                           uint32_t n_dst)
+{
+  uint32_t o, idx = *index, ph = *phase, n_taps = filter->n_taps;
+
+  for (o = 0; o < n_dst && idx + n_taps <= n_src; o++) {
+    float x, v;
+    const float *t = spa_resample_phase_taps (filter, ph, &x);
+
+    v = dot_avx2 (&src[idx], t, n_taps);
+    if (x != 0.0f)
+      v += (dot_avx2 (&src[idx], t + n_taps, n_taps) - v) * x;
+    dst[o * dst_stride] = v;
+    spa_resample_advance (filter, &idx, &ph);
+  }
+  *index = idx;
+  *phase = ph;
+
+  return o;
+}
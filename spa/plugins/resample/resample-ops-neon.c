@@ -0,0 +1,68 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <arm_neon.h>
+
+#include "resample-ops.h"
+
+static inline float
+dot_neon (const float *s, const float *t, uint32_t n_taps)
+{
+  float32x4_t sum0 = vdupq_n_f32 (0.0f), sum1 = vdupq_n_f32 (0.0f);
+  float32x4_t sum2 = vdupq_n_f32 (0.0f), sum3 = vdupq_n_f32 (0.0f);
+  float32x2_t sum;
+  uint32_t i;
+
+  for (i = 0; i < n_taps; i += 16) {
+    sum0 = vmlaq_f32 (sum0, vld1q_f32 (&s[i]),      vld1q_f32 (&t[i]));
+    sum1 = vmlaq_f32 (sum1, vld1q_f32 (&s[i + 4]),  vld1q_f32 (&t[i + 4]));
+    sum2 = vmlaq_f32 (sum2, vld1q_f32 (&s[i + 8]),  vld1q_f32 (&t[i + 8]));
+    sum3 = vmlaq_f32 (sum3, vld1q_f32 (&s[i + 12]), vld1q_f32 (&t[i + 12]));
+  }
+  sum0 = vaddq_f32 (vaddq_f32 (sum0, sum1), vaddq_f32 (sum2, sum3));
+  sum = vadd_f32 (vget_low_f32 (sum0), vget_high_f32 (sum0));
+  sum = vpadd_f32 (sum, sum);
+
+  return vget_lane_f32 (sum, 0);
+}
+
+uint32_t
+spa_resample_process_neon (const SpaResampleFilter *filter,
+                           float *dst, uint32_t dst_stride,
+                           const float *src, uint32_t n_src,
+                           uint32_t *index, uint32_t *phase,
+                           uint32_t n_dst)
+{
+  uint32_t o, idx = *index, ph = *phase, n_taps = filter->n_taps;
+
+  for (o = 0; o < n_dst && idx + n_taps <= n_src; o++) {
+    float x, v;
+    const float *t = spa_resample_phase_taps (filter, ph, &x);
+
+    v = dot_neon (&src[idx], t, n_taps);
+    if (x != 0.0f)
+      v += (dot_neon (&src[idx], t + n_taps, n_taps) - v) * x;
+    dst[o * dst_stride] = v;
+    spa_resample_advance (filter, &idx, &ph);
+  }
+  *index = idx;
+  *phase = ph;
+
+  return o;
+}
@@ -0,0 +1,67 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <emmintrin.h>
+
+#include "resample-ops.h"
+
+static inline float
+dot_sse2 (const float *s, const float *t, uint32_t n_taps)
+{
+  __m128 sum0 = _mm_setzero_ps (), sum1 = _mm_setzero_ps ();
+  __m128 sum2 = _mm_setzero_ps (), sum3 = _mm_setzero_ps ();
+  uint32_t i;
+
+  for (i = 0; i < n_taps; i += 16) {
+    sum0 = _mm_add_ps (sum0, _mm_mul_ps (_mm_loadu_ps (&s[i]),      _mm_load_ps (&t[i])));
+    sum1 = _mm_add_ps (sum1, _mm_mul_ps (_mm_loadu_ps (&s[i + 4]),  _mm_load_ps (&t[i + 4])));
+    sum2 = _mm_add_ps (sum2, _mm_mul_ps (_mm_loadu_ps (&s[i + 8]),  _mm_load_ps (&t[i + 8])));
+    sum3 = _mm_add_ps (sum3, _mm_mul_ps (_mm_loadu_ps (&s[i + 12]), _mm_load_ps (&t[i + 12])));
+  }
+  sum0 = _mm_add_ps (_mm_add_ps (sum0, sum1), _mm_add_ps (sum2, sum3));
+  sum0 = _mm_add_ps (sum0, _mm_movehl_ps (sum0, sum0));
+  sum0 = _mm_add_ss (sum0, _mm_shuffle_ps (sum0, sum0, 0x55));
+
+  return _mm_cvtss_f32 (sum0);
+}
+
+uint32_t
+spa_resample_process_sse2 (const SpaResampleFilter *filter,
+                           float *dst, uint32_t dst_stride,
+                           const float *src, uint32_t n_src,
+                           uint32_t *index, uint32_t *phase,
+                           uint32_t n_dst)
+{
+  uint32_t o, idx = *index, ph = *phase, n_taps = filter->n_taps;
+
+  for (o = 0; o < n_dst && idx + n_taps <= n_src; o++) {
+    float x, v;
+    const float *t = spa_resample_phase_taps (filter, ph, &x);
+
+    v = dot_sse2 (&src[idx], t, n_taps);
+    if (x != 0.0f)
+      v += (dot_sse2 (&src[idx], t + n_taps, n_taps) - v) * x;
+    dst[o * dst_stride] = v;
+    spa_resample_advance (filter, &idx, &ph);
+  }
+  *index = idx;
+  *phase = ph;
+
+  return o;
+}
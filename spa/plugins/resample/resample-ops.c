@@ -0,0 +1,202 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <math.h>
+
+#include <lib/cpu.h>
+
+#include "resample-ops.h"
+
+static uint32_t
+gcd (uint32_t a, uint32_t b)
+{
+  while (b != 0) {
+    uint32_t t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+/* 4 term Blackman-Harris window for x in [-1, 1] */
+static double
+window (double x)
+{
+  if (x <= -1.0 || x >= 1.0)
+    return 0.0;
+  return 0.35875 + 0.48829 * cos (M_PI * x) + 0.14128 * cos (2.0 * M_PI * x) +
+         0.01168 * cos (3.0 * M_PI * x);
+}
+
+static double
+sinc (double x)
+{
+  if (fabs (x) < 1e-9)
+    return 1.0;
+  return sin (M_PI * x) / (M_PI * x);
+}
+
+/**
+ * spa_resample_filter_init:
+ * @filter: a #SpaResampleFilter
+ * @in_rate: the input rate
+ * @out_rate: the output rate
+ * @n_taps: taps of the filter when not downsampling
+ * @cutoff: cutoff frequency relative to the nyquist frequency of the lower rate
+ * @adaptive: make a filter of which the rate can be adjusted
+ *
+ * Compute the polyphase filter taps for converting @in_rate to @out_rate.
+ * When downsampling, the cutoff is lowered to the output nyquist
+ * frequency and the filter is made longer to keep the same transition
+ * band.
+ *
+ * Returns: #SPA_RESULT_OK on success
+ */
+SpaResult
+spa_resample_filter_init (SpaResampleFilter *filter,
+                          uint32_t           in_rate,
+                          uint32_t           out_rate,
+                          uint32_t           n_taps,
+                          double             cutoff,
+                          bool               adaptive)
+{
+  uint32_t g, p, k;
+  double center;
+
+  if (in_rate == 0 || out_rate == 0 || n_taps == 0)
+    return SPA_RESULT_INVALID_ARGUMENTS;
+
+  g = gcd (in_rate, out_rate);
+  filter->in_rate = in_rate / g;
+  filter->out_rate = out_rate / g;
+  filter->n_phases = SPA_MIN (filter->out_rate, SPA_RESAMPLE_MAX_PHASES);
+
+  if (adaptive) {
+    uint32_t scale = SPA_MAX (SPA_RESAMPLE_ADAPTIVE_DENOM / filter->out_rate, 1);
+
+    filter->in_rate *= scale;
+    filter->out_rate *= scale;
+    filter->n_phases = SPA_RESAMPLE_MAX_PHASES;
+  }
+  filter->nominal_rate = filter->in_rate;
+  filter->step = filter->in_rate / filter->out_rate;
+  filter->frac = filter->in_rate % filter->out_rate;
+
+  if (in_rate > out_rate) {
+    cutoff = cutoff * out_rate / in_rate;
+    n_taps = ceil ((double) n_taps * in_rate / out_rate);
+  }
+  n_taps = SPA_MIN (n_taps, SPA_RESAMPLE_MAX_TAPS);
+  filter->n_taps = SPA_ROUND_UP_N (n_taps, SPA_RESAMPLE_TAPS_ALIGN);
+
+  if (posix_memalign ((void **) &filter->taps, 32,
+                      (filter->n_phases + 1) * filter->n_taps * sizeof (float)) != 0)
+    return SPA_RESULT_NO_MEMORY;
+
+  for (p = 0; p <= filter->n_phases; p++) {
+    float *taps = &filter->taps[p * filter->n_taps];
+    double sum = 0.0;
+
+    /* the output sample lies between input n_taps / 2 - 1 and n_taps / 2 */
+    center = filter->n_taps / 2 - 1 + (double) p / filter->n_phases;
+
+    for (k = 0; k < filter->n_taps; k++) {
+      double t = k - center;
+      double v = cutoff * sinc (cutoff * t) * window (t / (filter->n_taps / 2));
+
+      taps[k] = v;
+      sum += v;
+    }
+    /* unity gain at DC for every phase */
+    for (k = 0; k < filter->n_taps; k++)
+      taps[k] /= sum;
+  }
+  return SPA_RESULT_OK;
+}
+
+void
+spa_resample_filter_clear (SpaResampleFilter *filter)
+{
+  free (filter->taps);
+  filter->taps = NULL;
+}
+
+static inline float
+dot_c (const float *s, const float *t, uint32_t n_taps)
+{
+  float sum = 0.0f;
+  uint32_t i;
+
+  for (i = 0; i < n_taps; i++)
+    sum += s[i] * t[i];
+
+  return sum;
+}
+
+uint32_t
+spa_resample_process_c (const SpaResampleFilter *filter,
+                        float *dst, uint32_t dst_stride,
+                        const float *src, uint32_t n_src,
+                        uint32_t *index, uint32_t *phase,
+                        uint32_t n_dst)
+{
+  uint32_t o, idx = *index, ph = *phase, n_taps = filter->n_taps;
+
+  for (o = 0; o < n_dst && idx + n_taps <= n_src; o++) {
+    float x, v;
+    const float *t = spa_resample_phase_taps (filter, ph, &x);
+
+    v = dot_c (&src[idx], t, n_taps);
+    if (x != 0.0f)
+      v += (dot_c (&src[idx], t + n_taps, n_taps) - v) * x;
+    dst[o * dst_stride] = v;
+    spa_resample_advance (filter, &idx, &ph);
+  }
+  *index = idx;
+  *phase = ph;
+
+  return o;
+}
+
+void
+spa_resample_ops_init (SpaResampleOps *ops, uint32_t cpu_flags)
+{
+  ops->cpu_flags = 0;
+  ops->process = spa_resample_process_c;
+
+#if defined (HAVE_SSE2)
+  if (cpu_flags & SPA_CPU_FLAG_SSE2) {
+    ops->cpu_flags = SPA_CPU_FLAG_SSE2;
+    ops->process = spa_resample_process_sse2;
+  }
+#endif
+#if defined (HAVE_AVX2)
+  if (cpu_flags & SPA_CPU_FLAG_AVX2) {
+    ops->cpu_flags = SPA_CPU_FLAG_AVX2;
+    ops->process = spa_resample_process_avx2;
+  }
+#endif
+#if defined (HAVE_NEON)
+  if (cpu_flags & SPA_CPU_FLAG_NEON) {
+    ops->cpu_flags = SPA_CPU_FLAG_NEON;
+    ops->process = spa_resample_process_neon;
+  }
+#endif
+}
@@ -0,0 +1,186 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_RESAMPLE_RESAMPLE_OPS_H__
+#define __SPA_RESAMPLE_RESAMPLE_OPS_H__
+
+#include <spa/defs.h>
+
+/* the number of taps is a multiple of this, the kernels don't need a tail */
+#define SPA_RESAMPLE_TAPS_ALIGN   16
+/* with more phases than this the output is interpolated linearly between
+ * the two nearest phases */
+#define SPA_RESAMPLE_MAX_PHASES   1024
+#define SPA_RESAMPLE_MAX_TAPS     1024
+/* phase resolution of an adaptive filter, the rate can be adjusted in
+ * steps of about 1 / this */
+#define SPA_RESAMPLE_ADAPTIVE_DENOM   (1 << 24)
+
+/**
+ * SpaResampleFilter:
+ * @in_rate: input rate, divided by the gcd with @out_rate
+ * @out_rate: output rate, divided by the gcd with @in_rate
+ * @nominal_rate: @in_rate without rate adjustment
+ * @step: whole input samples to advance for each output sample
+ * @frac: remainder of the advance, in units of 1/@out_rate
+ * @n_taps: taps of each phase, a multiple of %SPA_RESAMPLE_TAPS_ALIGN
+ * @n_phases: number of phases, @out_rate when it is small enough
+ * @taps: @n_phases + 1 rows of @n_taps coefficients, 32 byte aligned. The
+ *        last row is phase 0 shifted by one input sample, for interpolating
+ *        past the last phase
+ *
+ * A windowed-sinc lowpass filter split into polyphase components. Output
+ * sample n is computed from the input samples starting at an integer
+ * index with the taps of the phase given by the fractional part of
+ * n * @in_rate / @out_rate.
+ *
+ * An adaptive filter always uses %SPA_RESAMPLE_MAX_PHASES phases and a
+ * fine grained @out_rate so that @in_rate can be adjusted at runtime with
+ * spa_resample_filter_adjust(), also when the rates are the same. When
+ * @n_phases is less than @out_rate, the output is interpolated linearly
+ * between the results of the two nearest phases. With 1024 phases this
+ * stays within 2e-6 of the exact phase, relative to full scale, where
+ * rounding down to the nearest phase is off by up to 3e-3.
+ */
+typedef struct {
+  uint32_t  in_rate;
+  uint32_t  out_rate;
+  uint32_t  nominal_rate;
+  uint32_t  step;
+  uint32_t  frac;
+  uint32_t  n_taps;
+  uint32_t  n_phases;
+  float    *taps;
+} SpaResampleFilter;
+
+SpaResult spa_resample_filter_init  (SpaResampleFilter *filter,
+                                     uint32_t           in_rate,
+                                     uint32_t           out_rate,
+                                     uint32_t           n_taps,
+                                     double             cutoff,
+                                     bool               adaptive);
+void      spa_resample_filter_clear (SpaResampleFilter *filter);
+
+/**
+ * spa_resample_filter_adjust:
+ * @filter: an adaptive #SpaResampleFilter
+ * @rate: the factor to apply to the input rate
+ *
+ * Consume the input @rate times faster than the nominal rate, so that
+ * fewer output samples are made for each input sample when @rate > 1.
+ * The phase of a running resampler stays valid.
+ */
+static inline void
+spa_resample_filter_adjust (SpaResampleFilter *filter, double rate)
+{
+  filter->in_rate = filter->nominal_rate * rate + 0.5;
+  filter->step = filter->in_rate / filter->out_rate;
+  filter->frac = filter->in_rate % filter->out_rate;
+}
+
+/**
+ * SpaResampleFunc:
+ * @filter: a #SpaResampleFilter
+ * @dst: destination samples
+ * @dst_stride: distance between destination samples, in samples
+ * @src: source samples of one channel
+ * @n_src: number of samples in @src
+ * @index: position in @src of the next output sample, updated
+ * @phase: phase of the next output sample in units of 1/@out_rate, updated
+ * @n_dst: maximum number of samples to write
+ *
+ * Resample one channel until @n_dst samples are written or the filter
+ * would read past @n_src.
+ *
+ * Returns: the number of samples written to @dst
+ */
+typedef uint32_t (*SpaResampleFunc) (const SpaResampleFilter *filter,
+                                     float *dst, uint32_t dst_stride,
+                                     const float *src, uint32_t n_src,
+                                     uint32_t *index, uint32_t *phase,
+                                     uint32_t n_dst);
+
+/**
+ * SpaResampleOps:
+ * @cpu_flags: the #SpaCPUFlags the functions were selected for
+ *
+ * The resampling kernels, selected once for the CPU we run on.
+ */
+typedef struct {
+  uint32_t        cpu_flags;
+  SpaResampleFunc process;
+} SpaResampleOps;
+
+void spa_resample_ops_init (SpaResampleOps *ops, uint32_t cpu_flags);
+
+/* the taps of the phase at or below @phase, @frac is set to the weight of
+ * the next phase */
+static inline const float *
+spa_resample_phase_taps (const SpaResampleFilter *filter, uint32_t phase, float *frac)
+{
+  uint64_t pos;
+
+  if (filter->n_phases == filter->out_rate) {
+    *frac = 0.0f;
+    return &filter->taps[phase * filter->n_taps];
+  }
+  pos = (uint64_t) phase * filter->n_phases;
+  *frac = (float) (pos % filter->out_rate) / filter->out_rate;
+  return &filter->taps[(pos / filter->out_rate) * filter->n_taps];
+}
+
+static inline void
+spa_resample_advance (const SpaResampleFilter *filter, uint32_t *index, uint32_t *phase)
+{
+  *index += filter->step;
+  *phase += filter->frac;
+  if (*phase >= filter->out_rate) {
+    *phase -= filter->out_rate;
+    *index += 1;
+  }
+}
+
+uint32_t spa_resample_process_c    (const SpaResampleFilter *filter,
+                                    float *dst, uint32_t dst_stride,
+                                    const float *src, uint32_t n_src,
+                                    uint32_t *index, uint32_t *phase,
+                                    uint32_t n_dst);
+#if defined (HAVE_SSE2)
+uint32_t spa_resample_process_sse2 (const SpaResampleFilter *filter,
+                                    float *dst, uint32_t dst_stride,
+                                    const float *src, uint32_t n_src,
+                                    uint32_t *index, uint32_t *phase,
+                                    uint32_t n_dst);
+#endif
+#if defined (HAVE_AVX2)
+uint32_t spa_resample_process_avx2 (const SpaResampleFilter *filter,
+                                    float *dst, uint32_t dst_stride,
+                                    const float *src, uint32_t n_src,
+                                    uint32_t *index, uint32_t *phase,
+                                    uint32_t n_dst);
+#endif
+#if defined (HAVE_NEON)
+uint32_t spa_resample_process_neon (const SpaResampleFilter *filter,
+                                    float *dst, uint32_t dst_stride,
+                                    const float *src, uint32_t n_src,
+                                    uint32_t *index, uint32_t *phase,
+                                    uint32_t n_dst);
+#endif
+
+#endif /* __SPA_RESAMPLE_RESAMPLE_OPS_H__ */
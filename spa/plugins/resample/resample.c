@@ -0,0 +1,1167 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include <spa/log.h>
+#include <spa/type-map.h>
+#include <spa/node.h>
+#include <spa/list.h>
+#include <spa/audio/format-utils.h>
+#include <spa/format-builder.h>
+#include <lib/props.h>
+#include <lib/cpu.h>
+
+#include "resample-ops.h"
+
+#define MAX_BUFFERS     16
+#define MAX_CHANNELS    64
+
+/* input frames added to the history in one go */
+#define BLOCK_FRAMES    1024
+/* output buffer size, enough for 1024 input frames upsampled 8 times */
+#define MAX_OUT_FRAMES  8192
+
+typedef struct _SpaResample SpaResample;
+
+typedef struct {
+  uint32_t quality;
+  bool     adaptive;
+  double   rate_correction;
+} SpaResampleProps;
+
+typedef struct {
+  SpaBuffer     *outbuf;
+  bool           outstanding;
+  SpaMetaHeader *h;
+  SpaList        link;
+} SpaResampleBuffer;
+
+typedef struct {
+  bool            have_format;
+  SpaAudioInfo    format;
+  uint32_t        frame_size;
+
+  SpaPortInfo     info;
+  SpaAllocParam  *params[2];
+  uint8_t         params_buffer[1024];
+
+  SpaResampleBuffer buffers[MAX_BUFFERS];
+  uint32_t        n_buffers;
+  SpaPortIO      *io;
+
+  SpaList         empty;
+} SpaResamplePort;
+
+typedef struct {
+  uint32_t node;
+  uint32_t format;
+  uint32_t props;
+  uint32_t prop_quality;
+  uint32_t prop_adaptive;
+  uint32_t prop_rate_correction;
+  uint32_t quality_fast;
+  uint32_t quality_low;
+  uint32_t quality_medium;
+  uint32_t quality_high;
+  SpaTypeMeta meta;
+  SpaTypeData data;
+  SpaTypeMediaType media_type;
+  SpaTypeMediaSubtype media_subtype;
+  SpaTypeFormatAudio format_audio;
+  SpaTypeAudioFormat audio_format;
+  SpaTypeEventNode event_node;
+  SpaTypeCommandNode command_node;
+  SpaTypeAllocParamBuffers alloc_param_buffers;
+  SpaTypeAllocParamMetaEnable alloc_param_meta_enable;
+} Type;
+
+static inline void
+init_type (Type *type, SpaTypeMap *map)
+{
+  type->node = spa_type_map_get_id (map, SPA_TYPE__Node);
+  type->format = spa_type_map_get_id (map, SPA_TYPE__Format);
+  type->props = spa_type_map_get_id (map, SPA_TYPE__Props);
+  type->prop_quality = spa_type_map_get_id (map, SPA_TYPE_PROPS__quality);
+  type->quality_fast = spa_type_map_get_id (map, SPA_TYPE_PROPS__quality ":fast");
+  type->quality_low = spa_type_map_get_id (map, SPA_TYPE_PROPS__quality ":low");
+  type->quality_medium = spa_type_map_get_id (map, SPA_TYPE_PROPS__quality ":medium");
+  type->quality_high = spa_type_map_get_id (map, SPA_TYPE_PROPS__quality ":high");
+  type->prop_adaptive = spa_type_map_get_id (map, SPA_TYPE_PROPS__adaptive);
+  type->prop_rate_correction = spa_type_map_get_id (map, SPA_TYPE_PROPS__rateCorrection);
+  spa_type_meta_map (map, &type->meta);
+  spa_type_data_map (map, &type->data);
+  spa_type_media_type_map (map, &type->media_type);
+  spa_type_media_subtype_map (map, &type->media_subtype);
+  spa_type_format_audio_map (map, &type->format_audio);
+  spa_type_audio_format_map (map, &type->audio_format);
+  spa_type_event_node_map (map, &type->event_node);
+  spa_type_command_node_map (map, &type->command_node);
+  spa_type_alloc_param_buffers_map (map, &type->alloc_param_buffers);
+  spa_type_alloc_param_meta_enable_map (map, &type->alloc_param_meta_enable);
+}
+
+/* the filter of a quality preset, longer filters have a steeper
+ * transition band and a higher cutoff but cost more cpu */
+typedef struct {
+  uint32_t n_taps;
+  double   cutoff;
+} QualityPreset;
+
+static const QualityPreset quality_presets[] = {
+  {  16, 0.80 },        /* fast */
+  {  32, 0.88 },        /* low */
+  {  64, 0.93 },        /* medium */
+  { 128, 0.96 },        /* high */
+};
+
+typedef struct _Filter Filter;
+
+struct _SpaResample {
+  SpaHandle  handle;
+  SpaNode  node;
+
+  Type type;
+  SpaTypeMap *map;
+  SpaLog *log;
+
+  uint8_t props_buffer[512];
+  SpaResampleProps props;
+
+  SpaNodeCallbacks callbacks;
+  void *user_data;
+
+  uint8_t format_buffer[1024];
+
+  SpaResamplePort in_ports[1];
+  SpaResamplePort out_ports[1];
+
+  SpaResampleOps ops;
+  Filter *filter;
+  bool passthrough;
+  /* the shared filter with our rate correction applied */
+  SpaResampleFilter current;
+  double rate_correction;
+
+  /* per channel input history, @n_history valid samples in each */
+  float *history[MAX_CHANNELS];
+  float *history_data;
+  uint32_t history_size;
+  uint32_t n_history;
+  uint32_t index;
+  uint32_t phase;
+
+  bool started;
+};
+
+#define CHECK_IN_PORT(this,d,p)  ((d) == SPA_DIRECTION_INPUT && (p) == 0)
+#define CHECK_OUT_PORT(this,d,p) ((d) == SPA_DIRECTION_OUTPUT && (p) == 0)
+#define CHECK_PORT(this,d,p)     ((p) == 0)
+#define GET_PORT(this,d,p)       ((d) == SPA_DIRECTION_INPUT ? &(this)->in_ports[p] : &(this)->out_ports[p])
+#define GET_OTHER_PORT(this,d,p) ((d) == SPA_DIRECTION_INPUT ? &(this)->out_ports[p] : &(this)->in_ports[p])
+
+#define DEFAULT_QUALITY quality_medium
+#define DEFAULT_ADAPTIVE false
+#define DEFAULT_RATE_CORRECTION 1.0
+/* how far an adaptive resampler can deviate from the nominal rate */
+#define MAX_RATE_CORRECTION 0.05
+
+static void
+reset_resample_props (SpaResample *this, SpaResampleProps *props)
+{
+  props->quality = this->type. DEFAULT_QUALITY;
+  props->adaptive = DEFAULT_ADAPTIVE;
+  props->rate_correction = DEFAULT_RATE_CORRECTION;
+}
+
+static uint32_t
+quality_index (SpaResample *this)
+{
+  uint32_t q = this->props.quality;
+
+  if (q == this->type.quality_fast)
+    return 0;
+  else if (q == this->type.quality_low)
+    return 1;
+  else if (q == this->type.quality_high)
+    return 3;
+  return 2;
+}
+
+/* filters only depend on the rates and the quality, share them between
+ * all the resamplers in the process */
+struct _Filter {
+  SpaList           link;
+  uint32_t          refcount;
+  uint32_t          in_rate;
+  uint32_t          out_rate;
+  uint32_t          quality;
+  bool              adaptive;
+  SpaResampleFilter filter;
+};
+
+static pthread_mutex_t filters_lock = PTHREAD_MUTEX_INITIALIZER;
+static SpaList filters = { &filters, &filters };
+
+static Filter *
+filter_ref (uint32_t in_rate, uint32_t out_rate, uint32_t quality, bool adaptive)
+{
+  Filter *f;
+
+  pthread_mutex_lock (&filters_lock);
+  spa_list_for_each (f, &filters, link) {
+    if (f->in_rate == in_rate && f->out_rate == out_rate &&
+        f->quality == quality && f->adaptive == adaptive) {
+      f->refcount++;
+      goto done;
+    }
+  }
+  if ((f = calloc (1, sizeof (Filter))) == NULL)
+    goto done;
+
+  if (spa_resample_filter_init (&f->filter, in_rate, out_rate,
+                                quality_presets[quality].n_taps,
+                                quality_presets[quality].cutoff,
+                                adaptive) != SPA_RESULT_OK) {
+    free (f);
+    f = NULL;
+    goto done;
+  }
+  f->refcount = 1;
+  f->in_rate = in_rate;
+  f->out_rate = out_rate;
+  f->quality = quality;
+  f->adaptive = adaptive;
+  spa_list_insert (filters.prev, &f->link);
+
+done:
+  pthread_mutex_unlock (&filters_lock);
+  return f;
+}
+
+static void
+filter_unref (Filter *f)
+{
+  pthread_mutex_lock (&filters_lock);
+  if (--f->refcount == 0) {
+    spa_list_remove (&f->link);
+    spa_resample_filter_clear (&f->filter);
+    free (f);
+  }
+  pthread_mutex_unlock (&filters_lock);
+}
+
+#define PROP(f,key,type,...)                                                    \
+          SPA_POD_PROP (f,key,0,type,1,__VA_ARGS__)
+#define PROP_MM(f,key,type,...)                                                 \
+          SPA_POD_PROP (f,key,SPA_POD_PROP_RANGE_MIN_MAX,type,3,__VA_ARGS__)
+#define PROP_EN(f,key,type,n,...)                                               \
+          SPA_POD_PROP (f,key,SPA_POD_PROP_RANGE_ENUM,type,n,__VA_ARGS__)
+#define PROP_U_MM(f,key,type,...)                                               \
+          SPA_POD_PROP (f,key,SPA_POD_PROP_FLAG_UNSET |                         \
+                              SPA_POD_PROP_RANGE_MIN_MAX,type,3,__VA_ARGS__)
+
+static SpaResult
+spa_resample_node_get_props (SpaNode        *node,
+                             SpaProps     **props)
+{
+  SpaResample *this;
+  SpaPODBuilder b = { NULL,  };
+  SpaPODFrame f[2];
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (props != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaResample, node);
+
+  spa_pod_builder_init (&b, this->props_buffer, sizeof (this->props_buffer));
+  spa_pod_builder_props (&b, &f[0], this->type.props,
+      PROP_EN (&f[1], this->type.prop_quality, SPA_POD_TYPE_ID, 5, this->props.quality,
+                                                                 this->type.quality_fast,
+                                                                 this->type.quality_low,
+                                                                 this->type.quality_medium,
+                                                                 this->type.quality_high),
+      PROP    (&f[1], this->type.prop_adaptive,        SPA_POD_TYPE_BOOL,   this->props.adaptive),
+      PROP_MM (&f[1], this->type.prop_rate_correction, SPA_POD_TYPE_DOUBLE, this->props.rate_correction,
+                                                                1.0 - MAX_RATE_CORRECTION,
+                                                                1.0 + MAX_RATE_CORRECTION));
+
+  *props = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaProps);
+
+  return SPA_RESULT_OK;
+}
+
+static void update_resample (SpaResample *this);
+
+static SpaResult
+spa_resample_node_set_props (SpaNode        *node,
+                             const SpaProps *props)
+{
+  SpaResample *this;
+  SpaResampleProps old;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaResample, node);
+
+  old = this->props;
+  if (props == NULL) {
+    reset_resample_props (this, &this->props);
+  } else {
+    spa_props_query (props,
+        this->type.prop_quality,         SPA_POD_TYPE_ID,     &this->props.quality,
+        this->type.prop_adaptive,        SPA_POD_TYPE_BOOL,   &this->props.adaptive,
+        this->type.prop_rate_correction, SPA_POD_TYPE_DOUBLE, &this->props.rate_correction,
+        0);
+  }
+  this->props.rate_correction = SPA_CLAMP (this->props.rate_correction,
+                                           1.0 - MAX_RATE_CORRECTION,
+                                           1.0 + MAX_RATE_CORRECTION);
+
+  /* the rate correction is picked up while processing, only a new filter
+   * needs a restart */
+  if (old.quality != this->props.quality || old.adaptive != this->props.adaptive)
+    update_resample (this);
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_resample_node_send_command (SpaNode    *node,
+                                SpaCommand *command)
+{
+  SpaResample *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (command != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaResample, node);
+
+  if (SPA_COMMAND_TYPE (command) == this->type.command_node.Start) {
+    this->started = true;
+  }
+  else if (SPA_COMMAND_TYPE (command) == this->type.command_node.Pause) {
+    this->started = false;
+  }
+  else
+    return SPA_RESULT_NOT_IMPLEMENTED;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_resample_node_set_callbacks (SpaNode                *node,
+                                 const SpaNodeCallbacks *callbacks,
+                                 size_t                  callbacks_size,
+                                 void                   *user_data)
+{
+  SpaResample *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaResample, node);
+
+  this->callbacks = *callbacks;
+  this->user_data = user_data;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_resample_node_get_n_ports (SpaNode       *node,
+                               uint32_t      *n_input_ports,
+                               uint32_t      *max_input_ports,
+                               uint32_t      *n_output_ports,
+                               uint32_t      *max_output_ports)
+{
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  if (n_input_ports)
+    *n_input_ports = 1;
+  if (max_input_ports)
+    *max_input_ports = 1;
+  if (n_output_ports)
+    *n_output_ports = 1;
+  if (max_output_ports)
+    *max_output_ports = 1;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_resample_node_get_port_ids (SpaNode       *node,
+                                uint32_t       n_input_ports,
+                                uint32_t      *input_ids,
+                                uint32_t       n_output_ports,
+                                uint32_t      *output_ids)
+{
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  if (n_input_ports > 0 && input_ids)
+    input_ids[0] = 0;
+  if (n_output_ports > 0 && output_ids)
+    output_ids[0] = 0;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_resample_node_add_port (SpaNode        *node,
+                            SpaDirection    direction,
+                            uint32_t        port_id)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_resample_node_remove_port (SpaNode        *node,
+                               SpaDirection    direction,
+                               uint32_t        port_id)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_resample_node_port_enum_formats (SpaNode          *node,
+                                     SpaDirection      direction,
+                                     uint32_t          port_id,
+                                     SpaFormat       **format,
+                                     const SpaFormat  *filter,
+                                     uint32_t          index)
+{
+  SpaResample *this;
+  SpaResamplePort *other;
+  SpaResult res;
+  SpaFormat *fmt;
+  uint8_t buffer[1024];
+  SpaPODBuilder b = { NULL, };
+  SpaPODFrame f[2];
+  uint32_t count, match;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (format != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaResample, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  other = GET_OTHER_PORT (this, direction, port_id);
+
+  count = match = filter ? 0 : index;
+
+next:
+  spa_pod_builder_init (&b, buffer, sizeof (buffer));
+
+  switch (count++) {
+    case 0:
+      /* we only convert the rate, the channels have to match the other
+       * port once that is configured. Prefer the rate of the other port,
+       * we don't resample when it is accepted. */
+      if (other->have_format) {
+        spa_pod_builder_format (&b, &f[0], this->type.format,
+            this->type.media_type.audio, this->type.media_subtype.raw,
+            PROP      (&f[1], this->type.format_audio.format,   SPA_POD_TYPE_ID,  this->type.audio_format.F32),
+            PROP      (&f[1], this->type.format_audio.layout,   SPA_POD_TYPE_INT, SPA_AUDIO_LAYOUT_INTERLEAVED),
+            PROP_U_MM (&f[1], this->type.format_audio.rate,     SPA_POD_TYPE_INT, other->format.info.raw.rate,
+                                                                1, INT32_MAX),
+            PROP      (&f[1], this->type.format_audio.channels, SPA_POD_TYPE_INT,
+                                                                other->format.info.raw.channels));
+      } else {
+        spa_pod_builder_format (&b, &f[0], this->type.format,
+            this->type.media_type.audio, this->type.media_subtype.raw,
+            PROP      (&f[1], this->type.format_audio.format,   SPA_POD_TYPE_ID,  this->type.audio_format.F32),
+            PROP      (&f[1], this->type.format_audio.layout,   SPA_POD_TYPE_INT, SPA_AUDIO_LAYOUT_INTERLEAVED),
+            PROP_U_MM (&f[1], this->type.format_audio.rate,     SPA_POD_TYPE_INT, 44100, 1, INT32_MAX),
+            PROP_U_MM (&f[1], this->type.format_audio.channels, SPA_POD_TYPE_INT, 2, 1, MAX_CHANNELS));
+      }
+      break;
+    default:
+      return SPA_RESULT_ENUM_END;
+  }
+  fmt = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaFormat);
+  spa_pod_builder_init (&b, this->format_buffer, sizeof (this->format_buffer));
+
+  if ((res = spa_format_filter (fmt, filter, &b)) != SPA_RESULT_OK || match++ != index)
+    goto next;
+
+  *format = SPA_POD_BUILDER_DEREF (&b, 0, SpaFormat);
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+clear_buffers (SpaResample *this, SpaResamplePort *port)
+{
+  if (port->n_buffers > 0) {
+    spa_log_info (this->log, "resample %p: clear buffers", this);
+    port->n_buffers = 0;
+    spa_list_init (&port->empty);
+  }
+  return SPA_RESULT_OK;
+}
+
+static void
+clear_filter (SpaResample *this)
+{
+  if (this->filter) {
+    filter_unref (this->filter);
+    this->filter = NULL;
+  }
+  free (this->history_data);
+  this->history_data = NULL;
+}
+
+/* get the filter for the configured rates and start with an empty
+ * history */
+static void
+update_resample (SpaResample *this)
+{
+  SpaResamplePort *in = &this->in_ports[0], *out = &this->out_ports[0];
+  uint32_t i, channels, in_rate, out_rate, quality, n_taps;
+
+  clear_filter (this);
+
+  if (!in->have_format || !out->have_format)
+    return;
+
+  channels = in->format.info.raw.channels;
+  in_rate = in->format.info.raw.rate;
+  out_rate = out->format.info.raw.rate;
+  quality = quality_index (this);
+
+  /* an adaptive resampler follows the rate correction, even when the
+   * nominal rates are the same */
+  this->passthrough = in_rate == out_rate && !this->props.adaptive;
+  if (this->passthrough) {
+    spa_log_info (this->log, "resample %p: passthrough", this);
+    return;
+  }
+
+  if ((this->filter = filter_ref (in_rate, out_rate, quality, this->props.adaptive)) == NULL) {
+    spa_log_error (this->log, "resample %p: can't make filter", this);
+    return;
+  }
+  this->current = this->filter->filter;
+  this->rate_correction = 1.0;
+  n_taps = this->current.n_taps;
+
+  this->history_size = n_taps + BLOCK_FRAMES;
+  this->history_data = calloc (channels * this->history_size, sizeof (float));
+  if (this->history_data == NULL) {
+    clear_filter (this);
+    return;
+  }
+  for (i = 0; i < channels; i++)
+    this->history[i] = &this->history_data[i * this->history_size];
+
+  /* start with silence so that the first output sample lines up with the
+   * first input sample */
+  this->n_history = n_taps / 2 - 1;
+  this->index = 0;
+  this->phase = 0;
+
+  spa_log_info (this->log, "resample %p: %u -> %u, %u taps, %u phases%s", this,
+      in_rate, out_rate, n_taps, this->current.n_phases,
+      this->props.adaptive ? ", adaptive" : "");
+}
+
+static SpaResult
+spa_resample_node_port_set_format (SpaNode         *node,
+                                   SpaDirection     direction,
+                                   uint32_t         port_id,
+                                   uint32_t         flags,
+                                   const SpaFormat *format)
+{
+  SpaResample *this;
+  SpaResamplePort *port, *other;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaResample, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  port = GET_PORT (this, direction, port_id);
+  other = GET_OTHER_PORT (this, direction, port_id);
+
+  if (format == NULL) {
+    port->have_format = false;
+    clear_buffers (this, port);
+    clear_filter (this);
+  } else {
+    SpaAudioInfo info = { SPA_FORMAT_MEDIA_TYPE (format),
+                          SPA_FORMAT_MEDIA_SUBTYPE (format), };
+
+    if (info.media_type != this->type.media_type.audio ||
+        info.media_subtype != this->type.media_subtype.raw)
+      return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+    if (!spa_format_audio_raw_parse (format, &info.info.raw, &this->type.format_audio))
+      return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+    if (info.info.raw.format != this->type.audio_format.F32 ||
+        info.info.raw.layout != SPA_AUDIO_LAYOUT_INTERLEAVED)
+      return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+    if (info.info.raw.channels == 0 || info.info.raw.channels > MAX_CHANNELS ||
+        info.info.raw.rate == 0)
+      return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+    if (other->have_format && info.info.raw.channels != other->format.info.raw.channels)
+      return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+    port->frame_size = sizeof (float) * info.info.raw.channels;
+    port->format = info;
+    port->have_format = true;
+
+    update_resample (this);
+  }
+
+  if (port->have_format) {
+    SpaPODBuilder b = { NULL };
+    SpaPODFrame f[2];
+
+    port->info.maxbuffering = -1;
+    port->info.latency = 0;
+
+    port->info.n_params = 2;
+    port->info.params = port->params;
+
+    spa_pod_builder_init (&b, port->params_buffer, sizeof (port->params_buffer));
+    spa_pod_builder_object (&b, &f[0], 0, this->type.alloc_param_buffers.Buffers,
+      PROP      (&f[1], this->type.alloc_param_buffers.size,    SPA_POD_TYPE_INT,
+                                                                (direction == SPA_DIRECTION_INPUT ?
+                                                                 BLOCK_FRAMES : MAX_OUT_FRAMES) * port->frame_size),
+      PROP      (&f[1], this->type.alloc_param_buffers.stride,  SPA_POD_TYPE_INT, port->frame_size),
+      PROP_U_MM (&f[1], this->type.alloc_param_buffers.buffers, SPA_POD_TYPE_INT, MAX_BUFFERS, 2, MAX_BUFFERS),
+      PROP      (&f[1], this->type.alloc_param_buffers.align,   SPA_POD_TYPE_INT, 16));
+    port->params[0] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
+
+    spa_pod_builder_object (&b, &f[0], 0, this->type.alloc_param_meta_enable.MetaEnable,
+      PROP      (&f[1], this->type.alloc_param_meta_enable.type, SPA_POD_TYPE_ID, this->type.meta.Header),
+      PROP      (&f[1], this->type.alloc_param_meta_enable.size, SPA_POD_TYPE_INT, sizeof (SpaMetaHeader)));
+    port->params[1] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
+
+    port->info.extra = NULL;
+  }
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_resample_node_port_get_format (SpaNode          *node,
+                                   SpaDirection      direction,
+                                   uint32_t          port_id,
+                                   const SpaFormat **format)
+{
+  SpaResample *this;
+  SpaResamplePort *port;
+  SpaPODBuilder b = { NULL, };
+  SpaPODFrame f[2];
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (format != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaResample, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  port = GET_PORT (this, direction, port_id);
+
+  if (!port->have_format)
+    return SPA_RESULT_NO_FORMAT;
+
+  spa_pod_builder_init (&b, this->format_buffer, sizeof (this->format_buffer));
+  spa_pod_builder_format (&b, &f[0], this->type.format,
+         this->type.media_type.audio, this->type.media_subtype.raw,
+         PROP (&f[1], this->type.format_audio.format,   SPA_POD_TYPE_ID,  port->format.info.raw.format),
+         PROP (&f[1], this->type.format_audio.layout,   SPA_POD_TYPE_INT, port->format.info.raw.layout),
+         PROP (&f[1], this->type.format_audio.rate,     SPA_POD_TYPE_INT, port->format.info.raw.rate),
+         PROP (&f[1], this->type.format_audio.channels, SPA_POD_TYPE_INT, port->format.info.raw.channels));
+
+  *format = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaFormat);
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_resample_node_port_get_info (SpaNode            *node,
+                                 SpaDirection        direction,
+                                 uint32_t            port_id,
+                                 const SpaPortInfo **info)
+{
+  SpaResample *this;
+  SpaResamplePort *port;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (info != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaResample, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  port = GET_PORT (this, direction, port_id);
+  *info = &port->info;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_resample_node_port_get_props (SpaNode       *node,
+                                  SpaDirection   direction,
+                                  uint32_t       port_id,
+                                  SpaProps     **props)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_resample_node_port_set_props (SpaNode        *node,
+                                  SpaDirection    direction,
+                                  uint32_t        port_id,
+                                  const SpaProps *props)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_resample_node_port_use_buffers (SpaNode         *node,
+                                    SpaDirection     direction,
+                                    uint32_t         port_id,
+                                    SpaBuffer      **buffers,
+                                    uint32_t         n_buffers)
+{
+  SpaResample *this;
+  SpaResamplePort *port;
+  uint32_t i, j;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaResample, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  port = GET_PORT (this, direction, port_id);
+
+  if (!port->have_format)
+    return SPA_RESULT_NO_FORMAT;
+
+  clear_buffers (this, port);
+
+  for (i = 0; i < n_buffers; i++) {
+    SpaResampleBuffer *b;
+    SpaData *d = buffers[i]->datas;
+
+    b = &port->buffers[i];
+    b->outbuf = buffers[i];
+    b->outstanding = true;
+    b->h = spa_buffer_find_meta (buffers[i], this->type.meta.Header);
+
+    for (j = 0; j < buffers[i]->n_datas; j++) {
+      if ((d[j].type != this->type.data.MemPtr &&
+           d[j].type != this->type.data.MemFd &&
+           d[j].type != this->type.data.DmaBuf) ||
+          d[j].data == NULL) {
+        spa_log_error (this->log, "resample %p: invalid memory on buffer %p", this, buffers[i]);
+        return SPA_RESULT_ERROR;
+      }
+    }
+    spa_list_insert (port->empty.prev, &b->link);
+  }
+  port->n_buffers = n_buffers;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_resample_node_port_alloc_buffers (SpaNode         *node,
+                                      SpaDirection     direction,
+                                      uint32_t         port_id,
+                                      SpaAllocParam  **params,
+                                      uint32_t         n_params,
+                                      SpaBuffer      **buffers,
+                                      uint32_t        *n_buffers)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_resample_node_port_set_io (SpaNode      *node,
+                               SpaDirection  direction,
+                               uint32_t      port_id,
+                               SpaPortIO    *io)
+{
+  SpaResample *this;
+  SpaResamplePort *port;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaResample, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  port = GET_PORT (this, direction, port_id);
+  port->io = io;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_resample_node_port_reuse_buffer (SpaNode         *node,
+                                     uint32_t         port_id,
+                                     uint32_t         buffer_id)
+{
+  SpaResample *this;
+  SpaResampleBuffer *b;
+  SpaResamplePort *port;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaResample, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, SPA_DIRECTION_OUTPUT, port_id), SPA_RESULT_INVALID_PORT);
+
+  port = &this->out_ports[port_id];
+
+  if (port->n_buffers == 0)
+    return SPA_RESULT_NO_BUFFERS;
+
+  if (buffer_id >= port->n_buffers)
+    return SPA_RESULT_INVALID_BUFFER_ID;
+
+  b = &port->buffers[buffer_id];
+  if (!b->outstanding)
+    return SPA_RESULT_OK;
+
+  b->outstanding = false;
+  spa_list_insert (port->empty.prev, &b->link);
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_resample_node_port_send_command (SpaNode        *node,
+                                     SpaDirection    direction,
+                                     uint32_t        port_id,
+                                     SpaCommand     *command)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResampleBuffer *
+find_free_buffer (SpaResample *this, SpaResamplePort *port)
+{
+  SpaResampleBuffer *b;
+
+  if (spa_list_is_empty (&port->empty))
+    return NULL;
+
+  b = spa_list_first (&port->empty, SpaResampleBuffer, link);
+  spa_list_remove (&b->link);
+  b->outstanding = true;
+
+  return b;
+}
+
+static inline void
+release_buffer (SpaResample *this, SpaBuffer *buffer)
+{
+  this->callbacks.reuse_buffer (&this->node, 0, buffer->id, this->user_data);
+}
+
+/* resample @n_frames interleaved frames from @src into @dst, which has room
+ * for @max_frames, and return the number of frames written */
+static uint32_t
+resample (SpaResample *this, float *dst, uint32_t max_frames, const float *src, uint32_t n_frames)
+{
+  const SpaResampleFilter *filter = &this->current;
+  uint32_t channels = this->in_ports[0].format.info.raw.channels;
+  uint32_t i, c, k, n, n_out = 0, index = 0, phase = 0, produced = 0;
+
+  if (this->props.adaptive && this->rate_correction != this->props.rate_correction) {
+    this->rate_correction = this->props.rate_correction;
+    spa_resample_filter_adjust (&this->current, this->rate_correction);
+  }
+
+  for (k = 0; k < n_frames; k += n) {
+    if ((n = SPA_MIN (n_frames - k, this->history_size - this->n_history)) == 0)
+      break;
+
+    /* split the new frames into the channel histories */
+    for (c = 0; c < channels; c++) {
+      float *h = &this->history[c][this->n_history];
+      const float *s = &src[k * channels + c];
+
+      for (i = 0; i < n; i++)
+        h[i] = s[i * channels];
+    }
+    this->n_history += n;
+
+    /* all channels are at the same position */
+    for (c = 0; c < channels; c++) {
+      index = this->index;
+      phase = this->phase;
+      produced = this->ops.process (filter, &dst[n_out * channels + c], channels,
+                                    this->history[c], this->n_history,
+                                    &index, &phase, max_frames - n_out);
+    }
+    this->index = SPA_MIN (index, this->n_history);
+    this->phase = phase;
+    n_out += produced;
+
+    /* drop the samples we don't need anymore */
+    if (this->index > 0) {
+      this->n_history -= this->index;
+      for (c = 0; c < channels; c++)
+        memmove (this->history[c], &this->history[c][this->index], this->n_history * sizeof (float));
+      this->index = 0;
+    }
+  }
+  if (k < n_frames)
+    spa_log_warn (this->log, "resample %p: output full, dropped %u frames", this, n_frames - k);
+
+  return n_out;
+}
+
+static void
+do_resample (SpaResample *this, SpaBuffer *dbuf, SpaBuffer *sbuf)
+{
+  SpaResamplePort *in = &this->in_ports[0], *out = &this->out_ports[0];
+  SpaData *sd = sbuf->datas, *dd = dbuf->datas;
+  const float *src;
+  uint32_t n_frames, max_frames;
+
+  src = SPA_MEMBER (sd[0].data, sd[0].chunk->offset, float);
+  n_frames = SPA_MIN (sd[0].chunk->size, sd[0].maxsize) / in->frame_size;
+  max_frames = dd[0].maxsize / out->frame_size;
+
+  if (this->passthrough) {
+    n_frames = SPA_MIN (n_frames, max_frames);
+    memcpy (dd[0].data, src, n_frames * out->frame_size);
+  } else if (this->filter)
+    n_frames = resample (this, dd[0].data, max_frames, src, n_frames);
+  else
+    n_frames = 0;
+
+  dd[0].chunk->offset = 0;
+  dd[0].chunk->size = n_frames * out->frame_size;
+  dd[0].chunk->stride = out->frame_size;
+}
+
+static SpaResult
+spa_resample_node_process_input (SpaNode *node)
+{
+  SpaResample *this;
+  SpaPortIO *input;
+  SpaPortIO *output;
+  SpaResamplePort *in_port, *out_port;
+  SpaResampleBuffer *sb, *db;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaResample, node);
+
+  in_port = &this->in_ports[0];
+  out_port = &this->out_ports[0];
+
+  if ((input = in_port->io) == NULL)
+    return SPA_RESULT_ERROR;
+  if ((output = out_port->io) == NULL)
+    return SPA_RESULT_ERROR;
+
+  if (!in_port->have_format || !out_port->have_format) {
+    input->status = SPA_RESULT_NO_FORMAT;
+    return SPA_RESULT_ERROR;
+  }
+  if (input->buffer_id >= in_port->n_buffers) {
+    input->status = SPA_RESULT_INVALID_BUFFER_ID;
+    return SPA_RESULT_ERROR;
+  }
+
+  if (output->buffer_id >= out_port->n_buffers) {
+    db = find_free_buffer (this, out_port);
+  } else {
+    db = &out_port->buffers[output->buffer_id];
+  }
+  if (db == NULL)
+    return SPA_RESULT_OUT_OF_BUFFERS;
+
+  sb = &in_port->buffers[input->buffer_id];
+
+  input->buffer_id = SPA_ID_INVALID;
+  input->status = SPA_RESULT_OK;
+
+  do_resample (this, db->outbuf, sb->outbuf);
+
+  if (sb->h && db->h)
+    *db->h = *sb->h;
+
+  output->buffer_id = db->outbuf->id;
+  output->status = SPA_RESULT_OK;
+
+  release_buffer (this, sb->outbuf);
+
+  return SPA_RESULT_HAVE_BUFFER;
+}
+
+static SpaResult
+spa_resample_node_process_output (SpaNode *node)
+{
+  return SPA_RESULT_NEED_BUFFER;
+}
+
+static const SpaNode resample_node = {
+  sizeof (SpaNode),
+  NULL,
+  spa_resample_node_get_props,
+  spa_resample_node_set_props,
+  spa_resample_node_send_command,
+  spa_resample_node_set_callbacks,
+  spa_resample_node_get_n_ports,
+  spa_resample_node_get_port_ids,
+  spa_resample_node_add_port,
+  spa_resample_node_remove_port,
+  spa_resample_node_port_enum_formats,
+  spa_resample_node_port_set_format,
+  spa_resample_node_port_get_format,
+  spa_resample_node_port_get_info,
+  spa_resample_node_port_get_props,
+  spa_resample_node_port_set_props,
+  spa_resample_node_port_use_buffers,
+  spa_resample_node_port_alloc_buffers,
+  spa_resample_node_port_set_io,
+  spa_resample_node_port_reuse_buffer,
+  spa_resample_node_port_send_command,
+  spa_resample_node_process_input,
+  spa_resample_node_process_output,
+};
+
+static SpaResult
+spa_resample_get_interface (SpaHandle               *handle,
+                            uint32_t                 interface_id,
+                            void                   **interface)
+{
+  SpaResample *this;
+
+  spa_return_val_if_fail (handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (interface != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = (SpaResample *) handle;
+
+  if (interface_id == this->type.node)
+    *interface = &this->node;
+  else
+    return SPA_RESULT_UNKNOWN_INTERFACE;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+resample_clear (SpaHandle *handle)
+{
+  SpaResample *this;
+
+  spa_return_val_if_fail (handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = (SpaResample *) handle;
+
+  clear_filter (this);
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+resample_init (const SpaHandleFactory  *factory,
+               SpaHandle               *handle,
+               const SpaDict           *info,
+               const SpaSupport        *support,
+               uint32_t                 n_support)
+{
+  SpaResample *this;
+  uint32_t i;
+
+  spa_return_val_if_fail (factory != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  handle->get_interface = spa_resample_get_interface;
+  handle->clear = resample_clear;
+
+  this = (SpaResample *) handle;
+
+  for (i = 0; i < n_support; i++) {
+    if (strcmp (support[i].type, SPA_TYPE__TypeMap) == 0)
+      this->map = support[i].data;
+    else if (strcmp (support[i].type, SPA_TYPE__Log) == 0)
+      this->log = support[i].data;
+  }
+  if (this->map == NULL) {
+    spa_log_error (this->log, "a type-map is needed");
+    return SPA_RESULT_ERROR;
+  }
+  init_type (&this->type, this->map);
+
+  spa_resample_ops_init (&this->ops, spa_cpu_get_info_flags (info));
+  spa_log_info (this->log, "resample %p: using cpu flags 0x%08x", this, this->ops.cpu_flags);
+
+  this->node = resample_node;
+  reset_resample_props (this, &this->props);
+
+  this->in_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
+  spa_list_init (&this->in_ports[0].empty);
+
+  this->out_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS |
+                                  SPA_PORT_INFO_FLAG_NO_REF;
+  spa_list_init (&this->out_ports[0].empty);
+
+  return SPA_RESULT_OK;
+}
+
+static const SpaInterfaceInfo resample_interfaces[] =
+{
+  { SPA_TYPE__Node, },
+};
+
+static SpaResult
+resample_enum_interface_info (const SpaHandleFactory  *factory,
+                              const SpaInterfaceInfo **info,
+                              uint32_t                 index)
+{
+  spa_return_val_if_fail (factory != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (info != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  switch (index) {
+    case 0:
+      *info = &resample_interfaces[index];
+      break;
+    default:
+      return SPA_RESULT_ENUM_END;
+  }
+  return SPA_RESULT_OK;
+}
+
+const SpaHandleFactory spa_resample_factory =
+{ "resample",
+  NULL,
+  sizeof (SpaResample),
+  resample_init,
+  resample_enum_interface_info,
+};
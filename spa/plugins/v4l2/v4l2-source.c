@@ -43,12 +43,16 @@ typedef struct {
   char device[64];
   char device_name[128];
   int  device_fd;
+  bool drop_oldest;
 } SpaV4l2SourceProps;
 
+#define DEFAULT_DROP_OLDEST false
+
 static void
 reset_v4l2_source_props (SpaV4l2SourceProps *props)
 {
   strncpy (props->device, default_device, 64);
+  props->drop_oldest = DEFAULT_DROP_OLDEST;
 }
 
 #define MAX_BUFFERS     64
@@ -58,11 +62,38 @@ typedef struct _V4l2Buffer V4l2Buffer;
 struct _V4l2Buffer {
   SpaBuffer *outbuf;
   SpaMetaHeader *h;
+  SpaMetaVideoCrop *crop;
   bool outstanding;
   bool allocated;
   struct v4l2_buffer v4l2_buffer;
+  struct v4l2_plane planes[VIDEO_MAX_PLANES];
 };
 
+typedef struct {
+  struct v4l2_frmsizeenum frmsize;
+  uint32_t first_frmival;
+  uint32_t n_frmivals;
+} V4l2FrameSize;
+
+typedef struct {
+  struct v4l2_fmtdesc fmtdesc;
+  uint32_t first_frmsize;
+  uint32_t n_frmsizes;
+} V4l2Format;
+
+/* everything the format, frame size and frame interval enumeration of the
+ * device returns, probed once so that negotiation does not need ioctls */
+typedef struct {
+  bool valid;
+  struct v4l2_capability cap;
+  V4l2Format *formats;
+  uint32_t n_formats;
+  V4l2FrameSize *frmsizes;
+  uint32_t n_frmsizes;
+  struct v4l2_frmivalenum *frmivals;
+  uint32_t n_frmivals;
+} V4l2Caps;
+
 typedef struct {
   uint32_t node;
   uint32_t clock;
@@ -71,6 +102,8 @@ typedef struct {
   uint32_t prop_device;
   uint32_t prop_device_name;
   uint32_t prop_device_fd;
+  uint32_t prop_drop_oldest;
+  uint32_t prop_dropped_frames;
   SpaTypeMediaType media_type;
   SpaTypeMediaSubtype media_subtype;
   SpaTypeMediaSubtypeVideo media_subtype_video;
@@ -94,6 +127,8 @@ init_type (Type *type, SpaTypeMap *map)
   type->prop_device = spa_type_map_get_id (map, SPA_TYPE_PROPS__device);
   type->prop_device_name = spa_type_map_get_id (map, SPA_TYPE_PROPS__deviceName);
   type->prop_device_fd = spa_type_map_get_id (map, SPA_TYPE_PROPS__deviceFd);
+  type->prop_drop_oldest = spa_type_map_get_id (map, SPA_TYPE_PROPS__dropOldest);
+  type->prop_dropped_frames = spa_type_map_get_id (map, SPA_TYPE_PROPS__droppedFrames);
   spa_type_media_type_map (map, &type->media_type);
   spa_type_media_subtype_map (map, &type->media_subtype);
   spa_type_media_subtype_video_map (map, &type->media_subtype_video);
@@ -128,9 +163,13 @@ typedef struct {
   int fd;
   bool opened;
   struct v4l2_capability cap;
+  V4l2Caps caps;
   struct v4l2_format fmt;
   enum v4l2_buf_type type;
   enum v4l2_memory memtype;
+  uint32_t n_planes;
+  /* the part of the frame the driver composes the image into */
+  SpaMetaVideoCrop crop;
 
   V4l2Buffer   buffers[MAX_BUFFERS];
   uint32_t     n_buffers;
@@ -139,12 +178,17 @@ typedef struct {
   SpaSource source;
 
   SpaPortInfo info;
-  SpaAllocParam *params[2];
+  SpaAllocParam *params[3];
   uint8_t params_buffer[1024];
   SpaPortIO *io;
 
   int64_t last_ticks;
   int64_t last_monotonic;
+
+  /* frames that were already replaced by a newer one in the driver queue */
+  uint32_t dropped_stale;
+  /* frames that downstream did not take before the next one was ready */
+  uint32_t dropped_late;
 } SpaV4l2State;
 
 struct _SpaV4l2Source {
@@ -203,7 +247,10 @@ spa_v4l2_source_node_get_props (SpaNode       *node,
   spa_pod_builder_props (&b, &f[0], this->type.props,
       PROP   (&f[1], this->type.prop_device,      -SPA_POD_TYPE_STRING, this->props.device, sizeof (this->props.device)),
       PROP_R (&f[1], this->type.prop_device_name, -SPA_POD_TYPE_STRING, this->props.device_name, sizeof (this->props.device_name)),
-      PROP_R (&f[1], this->type.prop_device_fd,    SPA_POD_TYPE_INT,    this->props.device_fd));
+      PROP_R (&f[1], this->type.prop_device_fd,    SPA_POD_TYPE_INT,    this->props.device_fd),
+      PROP   (&f[1], this->type.prop_drop_oldest,  SPA_POD_TYPE_BOOL,   this->props.drop_oldest),
+      PROP_R (&f[1], this->type.prop_dropped_frames, SPA_POD_TYPE_INT,
+                                                   this->state[0].dropped_stale + this->state[0].dropped_late));
   *props = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaProps);
 
   return SPA_RESULT_OK;
@@ -224,7 +271,8 @@ spa_v4l2_source_node_set_props (SpaNode         *node,
     return SPA_RESULT_OK;
   } else {
     spa_props_query (props,
-        this->type.prop_device, -SPA_POD_TYPE_STRING, this->props.device, sizeof (this->props.device),
+        this->type.prop_device,      -SPA_POD_TYPE_STRING, this->props.device, sizeof (this->props.device),
+        this->type.prop_drop_oldest,  SPA_POD_TYPE_BOOL,   &this->props.drop_oldest,
         0);
   }
   return SPA_RESULT_OK;
@@ -916,6 +964,14 @@ spa_v4l2_source_get_interface (SpaHandle               *handle,
 static SpaResult
 v4l2_source_clear (SpaHandle *handle)
 {
+  SpaV4l2Source *this;
+
+  spa_return_val_if_fail (handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = (SpaV4l2Source *) handle;
+
+  spa_v4l2_clear_caps (this);
+
   return SPA_RESULT_OK;
 }
 
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sched.h>
@@ -9,7 +10,10 @@
 
 #define CLEAR(x) memset(&(x), 0, sizeof(x))
 
+#define IS_MPLANE(state) ((state)->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE)
+
 static void v4l2_on_fd_events (SpaSource *source);
+static void spa_v4l2_probe_caps (SpaV4l2Source *this);
 
 static int
 xioctl (int fd, int request, void *arg)
@@ -29,6 +33,7 @@ spa_v4l2_open (SpaV4l2Source *this)
   SpaV4l2State *state = &this->state[0];
   struct stat st;
   SpaV4l2SourceProps *props = &this->props;
+  uint32_t caps;
 
   if (state->opened)
     return 0;
@@ -64,10 +69,22 @@ spa_v4l2_open (SpaV4l2Source *this)
     return -1;
   }
 
-  if ((state->cap.capabilities & V4L2_CAP_VIDEO_CAPTURE) == 0) {
+  caps = state->cap.capabilities;
+  if (caps & V4L2_CAP_DEVICE_CAPS)
+    caps = state->cap.device_caps;
+
+  if (caps & V4L2_CAP_VIDEO_CAPTURE)
+    state->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  else if (caps & V4L2_CAP_VIDEO_CAPTURE_MPLANE)
+    state->type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+  else {
     spa_log_error (state->log, "v4l2: %s is no video capture device", props->device);
     return -1;
   }
+  state->n_planes = 1;
+
+  if (!state->caps.valid || memcmp (&state->caps.cap, &state->cap, sizeof (state->cap)) != 0)
+    spa_v4l2_probe_caps (this);
 
   state->source.func = v4l2_on_fd_events;
   state->source.data = this;
@@ -103,7 +120,7 @@ spa_v4l2_clear_buffers (SpaV4l2Source *this)
 {
   SpaV4l2State *state = &this->state[0];
   struct v4l2_requestbuffers reqbuf;
-  int i;
+  int i, j;
 
   if (state->n_buffers == 0)
     return SPA_RESULT_OK;
@@ -117,16 +134,20 @@ spa_v4l2_clear_buffers (SpaV4l2Source *this)
       spa_v4l2_buffer_recycle (this, i);
     }
     if (b->allocated) {
-      if (b->outbuf->datas[0].data)
-        munmap (b->outbuf->datas[0].data, b->outbuf->datas[0].maxsize);
-      if (b->outbuf->datas[0].fd != -1)
-        close (b->outbuf->datas[0].fd);
-      b->outbuf->datas[0].type = SPA_ID_INVALID;
+      for (j = 0; j < state->n_planes; j++) {
+        SpaData *d = &b->outbuf->datas[j];
+
+        if (d->data)
+          munmap (d->data, d->maxsize);
+        if (d->fd != -1)
+          close (d->fd);
+        d->type = SPA_ID_INVALID;
+      }
     }
   }
 
   CLEAR(reqbuf);
-  reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  reqbuf.type = state->type;
   reqbuf.memory = state->memtype;
   reqbuf.count = 0;
 
@@ -514,6 +535,188 @@ filter_framerate (struct v4l2_frmivalenum *frmival,
   return true;
 }
 
+static void
+spa_v4l2_clear_caps (SpaV4l2Source *this)
+{
+  V4l2Caps *caps = &this->state[0].caps;
+
+  free (caps->formats);
+  free (caps->frmsizes);
+  free (caps->frmivals);
+  CLEAR (*caps);
+}
+
+static void *
+caps_add (void **array, uint32_t *n_items, size_t item_size)
+{
+  void *p;
+
+  if ((p = realloc (*array, (*n_items + 1) * item_size)) == NULL)
+    return NULL;
+
+  *array = p;
+  return SPA_MEMBER (p, (*n_items)++ * item_size, void);
+}
+
+static void
+spa_v4l2_probe_caps (SpaV4l2Source *this)
+{
+  SpaV4l2State *state = &this->state[0];
+  V4l2Caps *caps = &state->caps;
+  struct v4l2_fmtdesc fmtdesc;
+  struct v4l2_frmsizeenum frmsize;
+  struct v4l2_frmivalenum frmival;
+  V4l2Format *f;
+  V4l2FrameSize *s;
+  struct v4l2_frmivalenum *i;
+
+  spa_v4l2_clear_caps (this);
+
+  CLEAR (fmtdesc);
+  fmtdesc.type = state->type;
+
+  while (xioctl (state->fd, VIDIOC_ENUM_FMT, &fmtdesc) == 0) {
+    if ((f = caps_add ((void **) &caps->formats, &caps->n_formats, sizeof (V4l2Format))) == NULL)
+      goto no_mem;
+    f->fmtdesc = fmtdesc;
+    f->first_frmsize = caps->n_frmsizes;
+    f->n_frmsizes = 0;
+
+    CLEAR (frmsize);
+    frmsize.pixel_format = fmtdesc.pixelformat;
+
+    while (xioctl (state->fd, VIDIOC_ENUM_FRAMESIZES, &frmsize) == 0) {
+      if ((s = caps_add ((void **) &caps->frmsizes, &caps->n_frmsizes, sizeof (V4l2FrameSize))) == NULL)
+        goto no_mem;
+      s->frmsize = frmsize;
+      s->first_frmival = caps->n_frmivals;
+      s->n_frmivals = 0;
+      caps->formats[caps->n_formats - 1].n_frmsizes++;
+
+      /* the intervals of non discrete sizes are taken at the minimum size,
+       * like spa_v4l2_enum_format does */
+      CLEAR (frmival);
+      frmival.pixel_format = frmsize.pixel_format;
+      if (frmsize.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
+        frmival.width = frmsize.discrete.width;
+        frmival.height = frmsize.discrete.height;
+      } else {
+        frmival.width = frmsize.stepwise.min_width;
+        frmival.height = frmsize.stepwise.min_height;
+      }
+
+      while (xioctl (state->fd, VIDIOC_ENUM_FRAMEINTERVALS, &frmival) == 0) {
+        if ((i = caps_add ((void **) &caps->frmivals, &caps->n_frmivals,
+                           sizeof (struct v4l2_frmivalenum))) == NULL)
+          goto no_mem;
+        *i = frmival;
+        caps->frmsizes[caps->n_frmsizes - 1].n_frmivals++;
+
+        if (frmival.type != V4L2_FRMIVAL_TYPE_DISCRETE)
+          break;
+        frmival.index++;
+      }
+
+      if (frmsize.type != V4L2_FRMSIZE_TYPE_DISCRETE)
+        break;
+      frmsize.index++;
+    }
+    fmtdesc.index++;
+  }
+  caps->cap = state->cap;
+  caps->valid = true;
+
+  spa_log_info (state->log, "v4l2 %p: probed %u formats, %u frame sizes, %u frame intervals",
+      this, caps->n_formats, caps->n_frmsizes, caps->n_frmivals);
+  return;
+
+no_mem:
+  spa_log_error (state->log, "v4l2 %p: no memory to probe formats", this);
+  spa_v4l2_clear_caps (this);
+}
+
+/* the cached versions of the enumeration ioctls, they fail with EINVAL at
+ * the end of the enumeration like the real ones */
+static int
+caps_enum_fmt (SpaV4l2State *state, struct v4l2_fmtdesc *fmtdesc)
+{
+  V4l2Caps *caps = &state->caps;
+
+  if (!caps->valid)
+    return xioctl (state->fd, VIDIOC_ENUM_FMT, fmtdesc);
+
+  if (fmtdesc->index >= caps->n_formats) {
+    errno = EINVAL;
+    return -1;
+  }
+  *fmtdesc = caps->formats[fmtdesc->index].fmtdesc;
+  return 0;
+}
+
+static V4l2Format *
+caps_find_format (V4l2Caps *caps, uint32_t fourcc)
+{
+  uint32_t i;
+
+  for (i = 0; i < caps->n_formats; i++) {
+    if (caps->formats[i].fmtdesc.pixelformat == fourcc)
+      return &caps->formats[i];
+  }
+  return NULL;
+}
+
+static int
+caps_enum_framesizes (SpaV4l2State *state, struct v4l2_frmsizeenum *frmsize)
+{
+  V4l2Caps *caps = &state->caps;
+  V4l2Format *f;
+
+  if (!caps->valid)
+    return xioctl (state->fd, VIDIOC_ENUM_FRAMESIZES, frmsize);
+
+  if ((f = caps_find_format (caps, frmsize->pixel_format)) == NULL ||
+      frmsize->index >= f->n_frmsizes) {
+    errno = EINVAL;
+    return -1;
+  }
+  *frmsize = caps->frmsizes[f->first_frmsize + frmsize->index].frmsize;
+  return 0;
+}
+
+static int
+caps_enum_frameintervals (SpaV4l2State *state, struct v4l2_frmivalenum *frmival)
+{
+  V4l2Caps *caps = &state->caps;
+  V4l2Format *f;
+  uint32_t i;
+
+  if (caps->valid && (f = caps_find_format (caps, frmival->pixel_format))) {
+    for (i = 0; i < f->n_frmsizes; i++) {
+      V4l2FrameSize *s = &caps->frmsizes[f->first_frmsize + i];
+      uint32_t width, height;
+
+      if (s->frmsize.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
+        width = s->frmsize.discrete.width;
+        height = s->frmsize.discrete.height;
+      } else {
+        width = s->frmsize.stepwise.min_width;
+        height = s->frmsize.stepwise.min_height;
+      }
+      if (width != frmival->width || height != frmival->height)
+        continue;
+
+      if (frmival->index >= s->n_frmivals) {
+        errno = EINVAL;
+        return -1;
+      }
+      *frmival = caps->frmivals[s->first_frmival + frmival->index];
+      return 0;
+    }
+  }
+  /* a size we did not probe, ask the device */
+  return xioctl (state->fd, VIDIOC_ENUM_FRAMEINTERVALS, frmival);
+}
+
 #define FOURCC_ARGS(f) (f)&0x7f,((f)>>8)&0x7f,((f)>>16)&0x7f,((f)>>24)&0x7f
 
 static SpaResult
@@ -538,7 +741,7 @@ spa_v4l2_enum_format (SpaV4l2Source   *this,
   if (index == 0) {
     CLEAR (state->fmtdesc);
     state->fmtdesc.index = 0;
-    state->fmtdesc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    state->fmtdesc.type = state->type;
     state->next_fmtdesc = true;
     CLEAR (state->frmsize);
     state->next_frmsize = true;
@@ -567,7 +770,7 @@ next_fmtdesc:
 
       state->fmtdesc.pixelformat = info->fourcc;
     } else {
-      if ((res = xioctl (state->fd, VIDIOC_ENUM_FMT, &state->fmtdesc)) < 0) {
+      if ((res = caps_enum_fmt (state, &state->fmtdesc)) < 0) {
         if (errno != EINVAL)
           perror ("VIDIOC_ENUM_FMT");
         return SPA_RESULT_ENUM_END;
@@ -606,7 +809,7 @@ next_frmsize:
       }
     }
 do_frmsize:
-    if ((res = xioctl (state->fd, VIDIOC_ENUM_FRAMESIZES, &state->frmsize)) < 0) {
+    if ((res = caps_enum_framesizes (state, &state->frmsize)) < 0) {
       if (errno == EINVAL)
         goto next_fmtdesc;
 
@@ -703,7 +906,7 @@ have_size:
   state->frmival.index = 0;
 
   while (true) {
-    if ((res = xioctl (state->fd, VIDIOC_ENUM_FRAMEINTERVALS, &state->frmival)) < 0) {
+    if ((res = caps_enum_frameintervals (state, &state->frmival)) < 0) {
       if (errno == EINVAL) {
         state->frmsize.index++;
         state->next_frmsize = true;
@@ -803,6 +1006,104 @@ have_framerate:
   return SPA_RESULT_OK;
 }
 
+/* formats that keep each plane in its own memory block */
+static bool
+is_multiplanar_fourcc (uint32_t fourcc)
+{
+  switch (fourcc) {
+    case V4L2_PIX_FMT_YUV420M:
+    case V4L2_PIX_FMT_YVU420M:
+    case V4L2_PIX_FMT_NV12M:
+    case V4L2_PIX_FMT_NV12MT:
+    case V4L2_PIX_FMT_NV12MT_16X16:
+    case V4L2_PIX_FMT_NV21M:
+    case V4L2_PIX_FMT_NV16M:
+    case V4L2_PIX_FMT_NV61M:
+      return true;
+    default:
+      return false;
+  }
+}
+
+static bool
+has_fourcc (SpaV4l2State *state, uint32_t fourcc)
+{
+  struct v4l2_fmtdesc fmtdesc;
+
+  CLEAR (fmtdesc);
+  fmtdesc.type = state->type;
+
+  while (caps_enum_fmt (state, &fmtdesc) == 0) {
+    if (fmtdesc.pixelformat == fourcc)
+      return true;
+    fmtdesc.index++;
+  }
+  return false;
+}
+
+/* on a multiplanar device, prefer the variant of @info that gives us one
+ * memory block per plane so that the planes can be exported separately */
+static const FormatInfo *
+find_multiplanar_format_info (SpaV4l2Source *this, const FormatInfo *info)
+{
+  SpaV4l2State *state = &this->state[0];
+  const FormatInfo *mp = info;
+  uint32_t media_type, media_subtype, format;
+
+  media_type = *SPA_MEMBER (&this->type, info->media_type_offset, uint32_t);
+  media_subtype = *SPA_MEMBER (&this->type, info->media_subtype_offset, uint32_t);
+  format = *SPA_MEMBER (&this->type, info->format_offset, uint32_t);
+
+  while ((mp = find_format_info_by_media_type (&this->type, media_type, media_subtype,
+                                               format, mp - format_info + 1))) {
+    if (is_multiplanar_fourcc (mp->fourcc) && has_fourcc (state, mp->fourcc))
+      return mp;
+  }
+  return info;
+}
+
+static uint32_t
+get_plane_stride (SpaV4l2State *state, uint32_t plane)
+{
+  if (IS_MPLANE (state))
+    return state->fmt.fmt.pix_mp.plane_fmt[plane].bytesperline;
+  return state->fmt.fmt.pix.bytesperline;
+}
+
+/* find the region of the buffer the driver writes the image into. Drivers
+ * that pad the frame (to a macroblock size, for example) compose into a
+ * smaller rectangle, without selection support the whole frame is valid */
+static void
+spa_v4l2_get_crop (SpaV4l2Source *this, uint32_t width, uint32_t height)
+{
+  SpaV4l2State *state = &this->state[0];
+  struct v4l2_selection sel;
+
+  state->crop.x = 0;
+  state->crop.y = 0;
+  state->crop.width = width;
+  state->crop.height = height;
+
+  CLEAR (sel);
+  /* the selection api uses the single planar type for both kinds of devices */
+  sel.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  sel.target = V4L2_SEL_TGT_COMPOSE;
+  if (xioctl (state->fd, VIDIOC_G_SELECTION, &sel) < 0)
+    return;
+
+  if (sel.r.left < 0 || sel.r.top < 0 || sel.r.width == 0 || sel.r.height == 0 ||
+      sel.r.left + sel.r.width > width || sel.r.top + sel.r.height > height)
+    return;
+
+  state->crop.x = sel.r.left;
+  state->crop.y = sel.r.top;
+  state->crop.width = sel.r.width;
+  state->crop.height = sel.r.height;
+
+  spa_log_info (state->log, "v4l2: image at %d,%d %dx%d", state->crop.x, state->crop.y,
+      state->crop.width, state->crop.height);
+}
+
 static int
 spa_v4l2_set_format (SpaV4l2Source *this, SpaVideoInfo *format, bool try_only)
 {
@@ -816,11 +1117,17 @@ spa_v4l2_set_format (SpaV4l2Source *this, SpaVideoInfo *format, bool try_only)
   SpaFraction *framerate = NULL;
   SpaPODBuilder b = { NULL };
   SpaPODFrame f[2];
+  uint32_t i, size_image, stride;
 
+  if (spa_v4l2_open (this) < 0)
+    return -1;
+
+  /* the multiplanar format starts with the same width, height, pixelformat
+   * and field members as the single planar one, we use those from fmt.pix */
   CLEAR (fmt);
   CLEAR (streamparm);
-  fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-  streamparm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  fmt.type = state->type;
+  streamparm.type = state->type;
 
   if (format->media_subtype == this->type.media_subtype.raw) {
     video_format = format->info.raw.format;
@@ -853,6 +1160,8 @@ spa_v4l2_set_format (SpaV4l2Source *this, SpaVideoInfo *format, bool try_only)
     return -1;
   }
 
+  if (IS_MPLANE (state))
+    info = find_multiplanar_format_info (this, info);
 
   fmt.fmt.pix.pixelformat = info->fourcc;
   fmt.fmt.pix.field = V4L2_FIELD_ANY;
@@ -868,9 +1177,6 @@ spa_v4l2_set_format (SpaV4l2Source *this, SpaVideoInfo *format, bool try_only)
 
   reqfmt = fmt;
 
-  if (spa_v4l2_open (this) < 0)
-    return -1;
-
   cmd = try_only ? VIDIOC_TRY_FMT : VIDIOC_S_FMT;
   if (xioctl (state->fd, cmd, &fmt) < 0) {
     perror ("VIDIOC_S_FMT");
@@ -900,6 +1206,22 @@ spa_v4l2_set_format (SpaV4l2Source *this, SpaVideoInfo *format, bool try_only)
   framerate->denom = streamparm.parm.capture.timeperframe.numerator;
 
   state->fmt = fmt;
+  if (IS_MPLANE (state)) {
+    state->n_planes = fmt.fmt.pix_mp.num_planes;
+    size_image = 0;
+    for (i = 0; i < state->n_planes; i++)
+      size_image = SPA_MAX (size_image, fmt.fmt.pix_mp.plane_fmt[i].sizeimage);
+  } else {
+    state->n_planes = 1;
+    size_image = fmt.fmt.pix.sizeimage;
+  }
+  stride = get_plane_stride (state, 0);
+
+  spa_log_info (state->log, "v4l2: %u planes, size %u, stride %u", state->n_planes,
+      size_image, stride);
+
+  spa_v4l2_get_crop (this, size->width, size->height);
+
   state->info.flags = (state->export_buf ? SPA_PORT_INFO_FLAG_CAN_ALLOC_BUFFERS : 0) |
                       SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS |
                       SPA_PORT_INFO_FLAG_LIVE;
@@ -907,15 +1229,16 @@ spa_v4l2_set_format (SpaV4l2Source *this, SpaVideoInfo *format, bool try_only)
   state->info.latency = (streamparm.parm.capture.timeperframe.numerator * SPA_NSEC_PER_SEC) /
                          streamparm.parm.capture.timeperframe.denominator;
 
-  state->info.n_params = 2;
+  state->info.n_params = 3;
   state->info.params = state->params;
 
   spa_pod_builder_init (&b, state->params_buffer, sizeof (state->params_buffer));
   spa_pod_builder_object (&b, &f[0], 0, this->type.alloc_param_buffers.Buffers,
-        PROP      (&f[1], this->type.alloc_param_buffers.size,    SPA_POD_TYPE_INT, fmt.fmt.pix.sizeimage),
-        PROP      (&f[1], this->type.alloc_param_buffers.stride,  SPA_POD_TYPE_INT, fmt.fmt.pix.bytesperline),
+        PROP      (&f[1], this->type.alloc_param_buffers.size,    SPA_POD_TYPE_INT, size_image),
+        PROP      (&f[1], this->type.alloc_param_buffers.stride,  SPA_POD_TYPE_INT, stride),
         PROP_U_MM (&f[1], this->type.alloc_param_buffers.buffers, SPA_POD_TYPE_INT, MAX_BUFFERS, 2, MAX_BUFFERS),
-        PROP      (&f[1], this->type.alloc_param_buffers.align,   SPA_POD_TYPE_INT, 16));
+        PROP      (&f[1], this->type.alloc_param_buffers.align,   SPA_POD_TYPE_INT, 16),
+        PROP      (&f[1], this->type.alloc_param_buffers.datas,   SPA_POD_TYPE_INT, state->n_planes));
   state->params[0] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
 
   spa_pod_builder_object (&b, &f[0], 0, this->type.alloc_param_meta_enable.MetaEnable,
@@ -923,26 +1246,30 @@ spa_v4l2_set_format (SpaV4l2Source *this, SpaVideoInfo *format, bool try_only)
         PROP      (&f[1], this->type.alloc_param_meta_enable.size, SPA_POD_TYPE_INT, sizeof (SpaMetaHeader)));
   state->params[1] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
 
+  spa_pod_builder_object (&b, &f[0], 0, this->type.alloc_param_meta_enable.MetaEnable,
+        PROP      (&f[1], this->type.alloc_param_meta_enable.type, SPA_POD_TYPE_ID, this->type.meta.VideoCrop),
+        PROP      (&f[1], this->type.alloc_param_meta_enable.size, SPA_POD_TYPE_INT, sizeof (SpaMetaVideoCrop)));
+  state->params[2] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
+
   state->info.extra = NULL;
 
   return 0;
 }
 
 static SpaResult
-mmap_read (SpaV4l2Source *this)
+dequeue_buffer (SpaV4l2Source *this, struct v4l2_buffer *buf, struct v4l2_plane *planes)
 {
   SpaV4l2State *state = &this->state[0];
-  struct v4l2_buffer buf;
-  V4l2Buffer *b;
-  SpaData *d;
-  int64_t pts;
-  SpaPortIO *io = state->io;
 
-  CLEAR(buf);
-  buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-  buf.memory = state->memtype;
+  CLEAR(*buf);
+  buf->type = state->type;
+  buf->memory = state->memtype;
+  if (IS_MPLANE (state)) {
+    buf->m.planes = planes;
+    buf->length = state->n_planes;
+  }
 
-  if (xioctl (state->fd, VIDIOC_DQBUF, &buf) < 0) {
+  if (xioctl (state->fd, VIDIOC_DQBUF, buf) < 0) {
     switch (errno) {
       case EAGAIN:
         return SPA_RESULT_ERROR;
@@ -952,6 +1279,61 @@ mmap_read (SpaV4l2Source *this)
         return SPA_RESULT_ERROR;
     }
   }
+  return SPA_RESULT_OK;
+}
+
+/* give a dequeued frame straight back to the driver */
+static void
+drop_buffer (SpaV4l2Source *this, uint32_t index)
+{
+  SpaV4l2State *state = &this->state[0];
+
+  state->buffers[index].outstanding = true;
+  spa_v4l2_buffer_recycle (this, index);
+}
+
+static SpaResult
+mmap_read (SpaV4l2Source *this)
+{
+  SpaV4l2State *state = &this->state[0];
+  struct v4l2_buffer buf;
+  struct v4l2_plane planes[VIDEO_MAX_PLANES];
+  V4l2Buffer *b;
+  SpaData *d;
+  int64_t pts;
+  SpaPortIO *io = state->io;
+  uint32_t i;
+
+  if (dequeue_buffer (this, &buf, planes) < 0)
+    return SPA_RESULT_ERROR;
+
+  if (this->props.drop_oldest) {
+    struct v4l2_buffer next;
+    struct v4l2_plane next_planes[VIDEO_MAX_PLANES];
+    uint32_t dropped = 0;
+
+    /* take everything the driver has ready and only keep the newest
+     * frame so that a slow consumer does not add latency */
+    while (dequeue_buffer (this, &next, next_planes) == SPA_RESULT_OK) {
+      drop_buffer (this, buf.index);
+      state->dropped_stale++;
+      dropped++;
+      buf = next;
+      if (IS_MPLANE (state)) {
+        memcpy (planes, next_planes, sizeof (planes));
+        buf.m.planes = planes;
+      }
+    }
+    /* the previous frame was not taken yet, replace it */
+    if (io->status == SPA_RESULT_HAVE_BUFFER && io->buffer_id < state->n_buffers) {
+      spa_v4l2_buffer_recycle (this, io->buffer_id);
+      state->dropped_late++;
+      dropped++;
+    }
+    if (dropped > 0)
+      spa_log_debug (state->log, "v4l2 %p: dropped %u frames, %u stale, %u late in total", this,
+          dropped, state->dropped_stale, state->dropped_late);
+  }
 
   state->last_ticks = (int64_t)buf.timestamp.tv_sec * SPA_USEC_PER_SEC + (uint64_t)buf.timestamp.tv_usec;
   pts = state->last_ticks * 1000;
@@ -969,11 +1351,21 @@ mmap_read (SpaV4l2Source *this)
     b->h->seq = buf.sequence;
     b->h->pts = pts;
   }
+  if (b->crop)
+    *b->crop = state->crop;
 
   d = b->outbuf->datas;
-  d[0].chunk->offset = 0;
-  d[0].chunk->size = buf.bytesused;
-  d[0].chunk->stride = state->fmt.fmt.pix.bytesperline;
+  if (IS_MPLANE (state)) {
+    for (i = 0; i < state->n_planes; i++) {
+      d[i].chunk->offset = planes[i].data_offset;
+      d[i].chunk->size = planes[i].bytesused - planes[i].data_offset;
+      d[i].chunk->stride = get_plane_stride (state, i);
+    }
+  } else {
+    d[0].chunk->offset = 0;
+    d[0].chunk->size = buf.bytesused;
+    d[0].chunk->stride = get_plane_stride (state, 0);
+  }
 
   b->outstanding = true;
   io->buffer_id = b->outbuf->id;
@@ -1024,7 +1416,7 @@ spa_v4l2_use_buffers (SpaV4l2Source *this, SpaBuffer **buffers, uint32_t n_buffe
   }
 
   CLEAR(reqbuf);
-  reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  reqbuf.type = state->type;
   reqbuf.memory = state->memtype;
   reqbuf.count = n_buffers;
 
@@ -1040,28 +1432,44 @@ spa_v4l2_use_buffers (SpaV4l2Source *this, SpaBuffer **buffers, uint32_t n_buffe
 
   for (i = 0; i < reqbuf.count; i++) {
     V4l2Buffer *b;
+    uint32_t j;
 
     b = &state->buffers[i];
     b->outbuf = buffers[i];
     b->outstanding = true;
     b->allocated = false;
     b->h = spa_buffer_find_meta (b->outbuf, this->type.meta.Header);
+    b->crop = spa_buffer_find_meta (b->outbuf, this->type.meta.VideoCrop);
 
     spa_log_info (state->log, "v4l2: import buffer %p", buffers[i]);
 
-    if (buffers[i]->n_datas < 1) {
+    if (buffers[i]->n_datas < state->n_planes) {
       spa_log_error (state->log, "v4l2: invalid memory on buffer %p", buffers[i]);
       return SPA_RESULT_ERROR;
     }
     d = buffers[i]->datas;
 
     CLEAR (b->v4l2_buffer);
-    b->v4l2_buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    b->v4l2_buffer.type = state->type;
     b->v4l2_buffer.memory = state->memtype;
     b->v4l2_buffer.index = i;
 
-    if (d[0].type == this->type.data.MemPtr ||
-        d[0].type == this->type.data.MemFd) {
+    if (IS_MPLANE (state)) {
+      CLEAR (b->planes);
+      b->v4l2_buffer.m.planes = b->planes;
+      b->v4l2_buffer.length = state->n_planes;
+
+      for (j = 0; j < state->n_planes; j++) {
+        if (state->memtype == V4L2_MEMORY_USERPTR) {
+          b->planes[j].m.userptr = (unsigned long) d[j].data;
+          b->planes[j].length = d[j].maxsize;
+        } else {
+          b->planes[j].m.fd = d[j].fd;
+        }
+      }
+    }
+    else if (d[0].type == this->type.data.MemPtr ||
+             d[0].type == this->type.data.MemFd) {
       b->v4l2_buffer.m.userptr = (unsigned long) d[0].data;
       b->v4l2_buffer.length = d[0].maxsize;
     }
@@ -1089,7 +1497,7 @@ mmap_init (SpaV4l2Source   *this,
   state->memtype = V4L2_MEMORY_MMAP;
 
   CLEAR(reqbuf);
-  reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  reqbuf.type = state->type;
   reqbuf.memory = state->memtype;
   reqbuf.count = *n_buffers;
 
@@ -1111,8 +1519,9 @@ mmap_init (SpaV4l2Source   *this,
   for (i = 0; i < reqbuf.count; i++) {
     V4l2Buffer *b;
     SpaData *d;
+    uint32_t j;
 
-    if (buffers[i]->n_datas < 1) {
+    if (buffers[i]->n_datas < state->n_planes) {
       spa_log_error (state->log, "v4l2: invalid buffer data");
       return SPA_RESULT_ERROR;
     }
@@ -1122,11 +1531,17 @@ mmap_init (SpaV4l2Source   *this,
     b->outstanding = true;
     b->allocated = true;
     b->h = spa_buffer_find_meta (b->outbuf, this->type.meta.Header);
+    b->crop = spa_buffer_find_meta (b->outbuf, this->type.meta.VideoCrop);
 
     CLEAR (b->v4l2_buffer);
-    b->v4l2_buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    b->v4l2_buffer.type = state->type;
     b->v4l2_buffer.memory = state->memtype;
     b->v4l2_buffer.index = i;
+    if (IS_MPLANE (state)) {
+      CLEAR (b->planes);
+      b->v4l2_buffer.m.planes = b->planes;
+      b->v4l2_buffer.length = state->n_planes;
+    }
 
     if (xioctl (state->fd, VIDIOC_QUERYBUF, &b->v4l2_buffer) < 0) {
       perror ("VIDIOC_QUERYBUF");
@@ -1134,38 +1549,53 @@ mmap_init (SpaV4l2Source   *this,
     }
 
     d = buffers[i]->datas;
-    d[0].mapoffset = 0;
-    d[0].maxsize = b->v4l2_buffer.length;
-    d[0].chunk->offset = 0;
-    d[0].chunk->size = b->v4l2_buffer.length;
-    d[0].chunk->stride = state->fmt.fmt.pix.bytesperline;
-
-    if (state->export_buf) {
-      struct v4l2_exportbuffer expbuf;
-
-      CLEAR (expbuf);
-      expbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-      expbuf.index = i;
-      expbuf.flags = O_CLOEXEC | O_RDONLY;
-      if (xioctl (state->fd, VIDIOC_EXPBUF, &expbuf) < 0) {
-        perror("VIDIOC_EXPBUF");
-        continue;
+
+    for (j = 0; j < state->n_planes; j++) {
+      uint32_t length, offset;
+
+      if (IS_MPLANE (state)) {
+        length = b->planes[j].length;
+        offset = b->planes[j].m.mem_offset;
+      } else {
+        length = b->v4l2_buffer.length;
+        offset = b->v4l2_buffer.m.offset;
       }
-      d[0].type = this->type.data.DmaBuf;
-      d[0].fd = expbuf.fd;
-      d[0].data = NULL;
-    } else {
-      d[0].type = this->type.data.MemPtr;
-      d[0].fd = -1;
-      d[0].data = mmap (NULL,
-                        b->v4l2_buffer.length,
-                        PROT_READ,
-                        MAP_SHARED,
-                        state->fd,
-                        b->v4l2_buffer.m.offset);
-      if (d[0].data == MAP_FAILED) {
-        perror ("mmap");
-        continue;
+
+      d[j].mapoffset = 0;
+      d[j].maxsize = length;
+      d[j].chunk->offset = 0;
+      d[j].chunk->size = length;
+      d[j].chunk->stride = get_plane_stride (state, j);
+
+      if (state->export_buf) {
+        struct v4l2_exportbuffer expbuf;
+
+        CLEAR (expbuf);
+        expbuf.type = state->type;
+        expbuf.index = i;
+        expbuf.plane = j;
+        expbuf.flags = O_CLOEXEC | O_RDONLY;
+        if (xioctl (state->fd, VIDIOC_EXPBUF, &expbuf) < 0) {
+          perror("VIDIOC_EXPBUF");
+          continue;
+        }
+        d[j].type = this->type.data.DmaBuf;
+        d[j].fd = expbuf.fd;
+        d[j].data = NULL;
+      } else {
+        d[j].type = this->type.data.MemPtr;
+        d[j].fd = -1;
+        d[j].data = mmap (NULL,
+                          length,
+                          PROT_READ,
+                          MAP_SHARED,
+                          state->fd,
+                          offset);
+        if (d[j].data == MAP_FAILED) {
+          perror ("mmap");
+          d[j].data = NULL;
+          continue;
+        }
       }
     }
     spa_v4l2_buffer_recycle (this, i);
@@ -1222,7 +1652,7 @@ spa_v4l2_stream_on (SpaV4l2Source *this)
   if (state->started)
     return SPA_RESULT_OK;
 
-  type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  type = state->type;
   if (xioctl (state->fd, VIDIOC_STREAMON, &type) < 0) {
     spa_log_error (this->log, "VIDIOC_STREAMON: %s", strerror (errno));
     return SPA_RESULT_ERROR;
@@ -1244,7 +1674,7 @@ spa_v4l2_stream_off (SpaV4l2Source *this)
 
   spa_v4l2_port_set_enabled (this, false);
 
-  type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  type = state->type;
   if (xioctl (state->fd, VIDIOC_STREAMOFF, &type) < 0) {
     spa_log_error (this->log, "VIDIOC_STREAMOFF: %s", strerror (errno));
     return SPA_RESULT_ERROR;
@@ -0,0 +1,157 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <emmintrin.h>
+
+#include "convert-ops.h"
+
+/* split 8 packed pixels into 16 bit R/Y, G/U and B/V vectors */
+static inline void
+split_pixels (const uint8_t *s, __m128i *c0, __m128i *c1, __m128i *c2)
+{
+  const __m128i mask = _mm_set1_epi32 (0xff);
+  __m128i x0 = _mm_loadu_si128 ((const __m128i *) s);
+  __m128i x1 = _mm_loadu_si128 ((const __m128i *) (s + 16));
+
+  *c0 = _mm_packs_epi32 (_mm_and_si128 (x0, mask), _mm_and_si128 (x1, mask));
+  *c1 = _mm_packs_epi32 (_mm_and_si128 (_mm_srli_epi32 (x0, 8), mask),
+                         _mm_and_si128 (_mm_srli_epi32 (x1, 8), mask));
+  *c2 = _mm_packs_epi32 (_mm_and_si128 (_mm_srli_epi32 (x0, 16), mask),
+                         _mm_and_si128 (_mm_srli_epi32 (x1, 16), mask));
+}
+
+/* the reverse of split_pixels, values are clipped to 0-255 */
+static inline void
+merge_pixels (uint8_t *d, __m128i c0, __m128i c1, __m128i c2)
+{
+  const __m128i ff = _mm_set1_epi8 ((char) 0xff);
+  __m128i c01, c2x;
+
+  c0 = _mm_packus_epi16 (c0, c0);
+  c1 = _mm_packus_epi16 (c1, c1);
+  c2 = _mm_packus_epi16 (c2, c2);
+
+  c01 = _mm_unpacklo_epi8 (c0, c1);
+  c2x = _mm_unpacklo_epi8 (c2, ff);
+
+  _mm_storeu_si128 ((__m128i *) d, _mm_unpacklo_epi16 (c01, c2x));
+  _mm_storeu_si128 ((__m128i *) (d + 16), _mm_unpackhi_epi16 (c01, c2x));
+}
+
+void
+spa_videoconvert_rgb_to_yuv_sse2 (uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+  uint32_t i = 0, unrolled = width & ~7;
+  const __m128i y_off = _mm_set1_epi16 (128 + (16 << 8));
+  const __m128i uv_off = _mm_set1_epi16 ((short) (128 + 32768));
+
+  /* all intermediate values fit in unsigned 16 bits */
+  for (; i < unrolled; i += 8) {
+    __m128i r, g, b, y, u, v;
+
+    split_pixels (&src[4 * i], &r, &g, &b);
+
+    y = _mm_add_epi16 (_mm_add_epi16 (_mm_mullo_epi16 (r, _mm_set1_epi16 (66)),
+                                      _mm_mullo_epi16 (g, _mm_set1_epi16 (129))),
+                       _mm_add_epi16 (_mm_mullo_epi16 (b, _mm_set1_epi16 (25)), y_off));
+    u = _mm_sub_epi16 (_mm_add_epi16 (_mm_mullo_epi16 (b, _mm_set1_epi16 (112)), uv_off),
+                       _mm_add_epi16 (_mm_mullo_epi16 (r, _mm_set1_epi16 (38)),
+                                      _mm_mullo_epi16 (g, _mm_set1_epi16 (74))));
+    v = _mm_sub_epi16 (_mm_add_epi16 (_mm_mullo_epi16 (r, _mm_set1_epi16 (112)), uv_off),
+                       _mm_add_epi16 (_mm_mullo_epi16 (g, _mm_set1_epi16 (94)),
+                                      _mm_mullo_epi16 (b, _mm_set1_epi16 (18))));
+
+    merge_pixels (&dst[4 * i], _mm_srli_epi16 (y, 8), _mm_srli_epi16 (u, 8), _mm_srli_epi16 (v, 8));
+  }
+  spa_videoconvert_rgb_to_yuv_range (dst, src, i, width);
+}
+
+static inline __m128i
+madd_round (__m128i a, __m128i coef)
+{
+  return _mm_srai_epi32 (_mm_add_epi32 (_mm_madd_epi16 (a, coef), _mm_set1_epi32 (128)), 8);
+}
+
+void
+spa_videoconvert_yuv_to_rgb_sse2 (uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+  uint32_t i = 0, unrolled = width & ~7;
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i cr = _mm_set_epi16 (409, 298, 409, 298, 409, 298, 409, 298);
+  const __m128i cb = _mm_set_epi16 (516, 298, 516, 298, 516, 298, 516, 298);
+  const __m128i cg0 = _mm_set_epi16 (-100, 298, -100, 298, -100, 298, -100, 298);
+  const __m128i cg1 = _mm_set_epi16 (0, -208, 0, -208, 0, -208, 0, -208);
+
+  /* 298 * Y does not fit in 16 bits, multiply-add pairs to 32 bits */
+  for (; i < unrolled; i += 8) {
+    __m128i c, u, v, ce, cu, vz, r, g, b;
+
+    split_pixels (&src[4 * i], &c, &u, &v);
+    c = _mm_sub_epi16 (c, _mm_set1_epi16 (16));
+    u = _mm_sub_epi16 (u, _mm_set1_epi16 (128));
+    v = _mm_sub_epi16 (v, _mm_set1_epi16 (128));
+
+    ce = _mm_unpacklo_epi16 (c, v);
+    cu = _mm_unpacklo_epi16 (c, u);
+    vz = _mm_unpacklo_epi16 (v, zero);
+    r = madd_round (ce, cr);
+    b = madd_round (cu, cb);
+    g = _mm_srai_epi32 (_mm_add_epi32 (_mm_add_epi32 (_mm_madd_epi16 (cu, cg0),
+                                                      _mm_madd_epi16 (vz, cg1)),
+                                       _mm_set1_epi32 (128)), 8);
+
+    ce = _mm_unpackhi_epi16 (c, v);
+    cu = _mm_unpackhi_epi16 (c, u);
+    vz = _mm_unpackhi_epi16 (v, zero);
+    r = _mm_packs_epi32 (r, madd_round (ce, cr));
+    b = _mm_packs_epi32 (b, madd_round (cu, cb));
+    g = _mm_packs_epi32 (g, _mm_srai_epi32 (_mm_add_epi32 (_mm_add_epi32 (_mm_madd_epi16 (cu, cg0),
+                                                                          _mm_madd_epi16 (vz, cg1)),
+                                                           _mm_set1_epi32 (128)), 8));
+
+    merge_pixels (&dst[4 * i], r, g, b);
+  }
+  spa_videoconvert_yuv_to_rgb_range (dst, src, i, width);
+}
+
+void
+spa_videoconvert_blend_v_sse2 (uint8_t *dst, const uint8_t *s0, const uint8_t *s1,
+                               uint32_t weight, uint32_t n_bytes)
+{
+  uint32_t i = 0, unrolled = n_bytes & ~15;
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i w0 = _mm_set1_epi16 (256 - weight);
+  const __m128i w1 = _mm_set1_epi16 (weight);
+  const __m128i round = _mm_set1_epi16 (128);
+
+  for (; i < unrolled; i += 16) {
+    __m128i a = _mm_loadu_si128 ((const __m128i *) &s0[i]);
+    __m128i b = _mm_loadu_si128 ((const __m128i *) &s1[i]);
+    __m128i lo, hi;
+
+    lo = _mm_add_epi16 (_mm_add_epi16 (_mm_mullo_epi16 (_mm_unpacklo_epi8 (a, zero), w0),
+                                       _mm_mullo_epi16 (_mm_unpacklo_epi8 (b, zero), w1)), round);
+    hi = _mm_add_epi16 (_mm_add_epi16 (_mm_mullo_epi16 (_mm_unpackhi_epi8 (a, zero), w0),
+                                       _mm_mullo_epi16 (_mm_unpackhi_epi8 (b, zero), w1)), round);
+
+    _mm_storeu_si128 ((__m128i *) &dst[i],
+                      _mm_packus_epi16 (_mm_srli_epi16 (lo, 8), _mm_srli_epi16 (hi, 8)));
+  }
+  spa_videoconvert_blend_v_range (dst, s0, s1, weight, i, n_bytes);
+}
@@ -0,0 +1,290 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include <lib/cpu.h>
+
+#include "convert-ops.h"
+
+void
+spa_videoconvert_unpack_rgb (uint8_t *dst, const uint8_t *src[3], uint32_t width)
+{
+  const uint8_t *s = src[0];
+  uint32_t i;
+
+  for (i = 0; i < width; i++) {
+    dst[0] = s[0];
+    dst[1] = s[1];
+    dst[2] = s[2];
+    dst[3] = 0xff;
+    dst += 4;
+    s += 3;
+  }
+}
+
+/* 4:2:2 chroma is repeated for both pixels of a pair */
+static inline void
+unpack_422 (uint8_t *dst, const uint8_t *s, uint32_t width, int y0, int y1, int u, int v)
+{
+  uint32_t i;
+
+  for (i = 0; i + 1 < width; i += 2) {
+    dst[0] = s[y0];
+    dst[1] = s[u];
+    dst[2] = s[v];
+    dst[3] = 0xff;
+    dst[4] = s[y1];
+    dst[5] = s[u];
+    dst[6] = s[v];
+    dst[7] = 0xff;
+    dst += 8;
+    s += 4;
+  }
+  if (i < width) {
+    dst[0] = s[y0];
+    dst[1] = s[u];
+    dst[2] = s[v];
+    dst[3] = 0xff;
+  }
+}
+
+void
+spa_videoconvert_unpack_uyvy (uint8_t *dst, const uint8_t *src[3], uint32_t width)
+{
+  unpack_422 (dst, src[0], width, 1, 3, 0, 2);
+}
+
+void
+spa_videoconvert_unpack_yuy2 (uint8_t *dst, const uint8_t *src[3], uint32_t width)
+{
+  unpack_422 (dst, src[0], width, 0, 2, 1, 3);
+}
+
+void
+spa_videoconvert_unpack_i420 (uint8_t *dst, const uint8_t *src[3], uint32_t width)
+{
+  const uint8_t *y = src[0], *u = src[1], *v = src[2];
+  uint32_t i;
+
+  for (i = 0; i < width; i++) {
+    dst[0] = y[i];
+    dst[1] = u[i >> 1];
+    dst[2] = v[i >> 1];
+    dst[3] = 0xff;
+    dst += 4;
+  }
+}
+
+void
+spa_videoconvert_unpack_nv12 (uint8_t *dst, const uint8_t *src[3], uint32_t width)
+{
+  const uint8_t *y = src[0], *uv = src[1];
+  uint32_t i;
+
+  for (i = 0; i < width; i++) {
+    dst[0] = y[i];
+    dst[1] = uv[(i & ~1)];
+    dst[2] = uv[(i & ~1) + 1];
+    dst[3] = 0xff;
+    dst += 4;
+  }
+}
+
+void
+spa_videoconvert_pack_rgb (uint8_t *dst[3], const uint8_t *src, uint32_t width, bool chroma)
+{
+  uint8_t *d = dst[0];
+  uint32_t i;
+
+  for (i = 0; i < width; i++) {
+    d[0] = src[0];
+    d[1] = src[1];
+    d[2] = src[2];
+    d += 3;
+    src += 4;
+  }
+}
+
+/* 4:2:2 chroma is the average of the pixel pair */
+static inline void
+pack_422 (uint8_t *d, const uint8_t *s, uint32_t width, int y0, int y1, int u, int v)
+{
+  uint32_t i;
+
+  for (i = 0; i + 1 < width; i += 2) {
+    d[y0] = s[0];
+    d[y1] = s[4];
+    d[u] = (s[1] + s[5] + 1) >> 1;
+    d[v] = (s[2] + s[6] + 1) >> 1;
+    d += 4;
+    s += 8;
+  }
+  if (i < width) {
+    d[y0] = s[0];
+    d[y1] = s[0];
+    d[u] = s[1];
+    d[v] = s[2];
+  }
+}
+
+void
+spa_videoconvert_pack_uyvy (uint8_t *dst[3], const uint8_t *src, uint32_t width, bool chroma)
+{
+  pack_422 (dst[0], src, width, 1, 3, 0, 2);
+}
+
+void
+spa_videoconvert_pack_yuy2 (uint8_t *dst[3], const uint8_t *src, uint32_t width, bool chroma)
+{
+  pack_422 (dst[0], src, width, 0, 2, 1, 3);
+}
+
+static inline void
+pack_luma (uint8_t *d, const uint8_t *s, uint32_t width)
+{
+  uint32_t i;
+
+  for (i = 0; i < width; i++)
+    d[i] = s[4 * i];
+}
+
+void
+spa_videoconvert_pack_i420 (uint8_t *dst[3], const uint8_t *src, uint32_t width, bool chroma)
+{
+  uint8_t *u = dst[1], *v = dst[2];
+  uint32_t i;
+
+  pack_luma (dst[0], src, width);
+
+  if (!chroma)
+    return;
+
+  for (i = 0; i + 1 < width; i += 2) {
+    *u++ = (src[1] + src[5] + 1) >> 1;
+    *v++ = (src[2] + src[6] + 1) >> 1;
+    src += 8;
+  }
+  if (i < width) {
+    *u = src[1];
+    *v = src[2];
+  }
+}
+
+void
+spa_videoconvert_pack_nv12 (uint8_t *dst[3], const uint8_t *src, uint32_t width, bool chroma)
+{
+  uint8_t *uv = dst[1];
+  uint32_t i;
+
+  pack_luma (dst[0], src, width);
+
+  if (!chroma)
+    return;
+
+  for (i = 0; i + 1 < width; i += 2) {
+    *uv++ = (src[1] + src[5] + 1) >> 1;
+    *uv++ = (src[2] + src[6] + 1) >> 1;
+    src += 8;
+  }
+  if (i < width) {
+    *uv++ = src[1];
+    *uv++ = src[2];
+  }
+}
+
+void
+spa_videoconvert_scale_h_bilinear (uint8_t *dst, const uint8_t *src,
+                                   const uint32_t *xmap, const uint16_t *xweight,
+                                   uint32_t dst_width)
+{
+  uint32_t i, c;
+
+  for (i = 0; i < dst_width; i++) {
+    const uint8_t *s = &src[4 * xmap[i]];
+    uint32_t w1 = xweight[i], w0 = 256 - w1;
+
+    for (c = 0; c < 4; c++)
+      dst[c] = (s[c] * w0 + s[c + 4] * w1 + 128) >> 8;
+    dst += 4;
+  }
+}
+
+void
+spa_videoconvert_scale_h_area (uint8_t *dst, const uint8_t *src,
+                               const uint32_t *xmap, const uint32_t *xmult,
+                               uint32_t dst_width)
+{
+  uint32_t i, j;
+
+  for (i = 0; i < dst_width; i++) {
+    uint32_t j0 = xmap[i], j1 = xmap[i + 1], mult = xmult[i];
+    uint32_t half = (j1 - j0) / 2;
+    uint32_t s0 = half, s1 = half, s2 = half, s3 = half;
+
+    for (j = j0; j < j1; j++) {
+      s0 += src[4 * j + 0];
+      s1 += src[4 * j + 1];
+      s2 += src[4 * j + 2];
+      s3 += src[4 * j + 3];
+    }
+    dst[0] = (s0 * mult) >> 24;
+    dst[1] = (s1 * mult) >> 24;
+    dst[2] = (s2 * mult) >> 24;
+    dst[3] = (s3 * mult) >> 24;
+    dst += 4;
+  }
+}
+
+void
+spa_videoconvert_rgb_to_yuv_c (uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+  spa_videoconvert_rgb_to_yuv_range (dst, src, 0, width);
+}
+
+void
+spa_videoconvert_yuv_to_rgb_c (uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+  spa_videoconvert_yuv_to_rgb_range (dst, src, 0, width);
+}
+
+void
+spa_videoconvert_blend_v_c (uint8_t *dst, const uint8_t *s0, const uint8_t *s1,
+                            uint32_t weight, uint32_t n_bytes)
+{
+  spa_videoconvert_blend_v_range (dst, s0, s1, weight, 0, n_bytes);
+}
+
+void
+spa_videoconvert_ops_init (SpaVideoConvertOps *ops, uint32_t cpu_flags)
+{
+  ops->cpu_flags = 0;
+  ops->rgb_to_yuv = spa_videoconvert_rgb_to_yuv_c;
+  ops->yuv_to_rgb = spa_videoconvert_yuv_to_rgb_c;
+  ops->blend_v = spa_videoconvert_blend_v_c;
+
+#if defined (HAVE_SSE2)
+  if (cpu_flags & SPA_CPU_FLAG_SSE2) {
+    ops->cpu_flags = SPA_CPU_FLAG_SSE2;
+    ops->rgb_to_yuv = spa_videoconvert_rgb_to_yuv_sse2;
+    ops->yuv_to_rgb = spa_videoconvert_yuv_to_rgb_sse2;
+    ops->blend_v = spa_videoconvert_blend_v_sse2;
+  }
+#endif
+}
@@ -0,0 +1,198 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_VIDEOCONVERT_CONVERT_OPS_H__
+#define __SPA_VIDEOCONVERT_CONVERT_OPS_H__
+
+#include <stdbool.h>
+
+#include <spa/defs.h>
+
+/*
+ * All conversions go through lines of 4 bytes per pixel without
+ * subsampling, either R,G,B,x or Y,U,V,x. The unpack functions make such
+ * a line from a line of the input format, the pack functions write one
+ * into the output format. Scaling and the color matrix only work on the
+ * unpacked lines.
+ */
+#define SPA_VIDEOCONVERT_PIXEL_SIZE 4
+
+/**
+ * SpaVideoConvertUnpackFunc:
+ * @dst: @width unpacked pixels
+ * @src: the planes of one input line, chroma planes of 4:2:0 formats
+ *       point to the chroma line for this line
+ * @width: number of pixels
+ */
+typedef void (*SpaVideoConvertUnpackFunc) (uint8_t *dst, const uint8_t *src[3], uint32_t width);
+
+/**
+ * SpaVideoConvertPackFunc:
+ * @dst: the planes of one output line
+ * @src: @width unpacked pixels
+ * @width: number of pixels
+ * @chroma: write the chroma planes, %false for the odd lines of 4:2:0
+ *          formats
+ */
+typedef void (*SpaVideoConvertPackFunc) (uint8_t *dst[3], const uint8_t *src, uint32_t width, bool chroma);
+
+/**
+ * SpaVideoConvertMatrixFunc:
+ * @dst: destination pixels
+ * @src: source pixels, can be the same as @dst
+ * @width: number of pixels
+ *
+ * Convert between RGB and BT.601 limited range YUV.
+ */
+typedef void (*SpaVideoConvertMatrixFunc) (uint8_t *dst, const uint8_t *src, uint32_t width);
+
+/**
+ * SpaVideoConvertBlendFunc:
+ * @dst: destination bytes
+ * @s0: first line
+ * @s1: second line
+ * @weight: weight of @s1 between 0 and 256
+ * @n_bytes: number of bytes
+ *
+ * Interpolate between two lines for vertical bilinear scaling.
+ */
+typedef void (*SpaVideoConvertBlendFunc) (uint8_t *dst, const uint8_t *s0, const uint8_t *s1,
+                                          uint32_t weight, uint32_t n_bytes);
+
+/**
+ * SpaVideoConvertOps:
+ * @cpu_flags: the #SpaCPUFlags the functions were selected for
+ *
+ * The per-line kernels that have SIMD versions, selected once for the
+ * CPU we run on.
+ */
+typedef struct {
+  uint32_t                  cpu_flags;
+  SpaVideoConvertMatrixFunc rgb_to_yuv;
+  SpaVideoConvertMatrixFunc yuv_to_rgb;
+  SpaVideoConvertBlendFunc  blend_v;
+} SpaVideoConvertOps;
+
+void spa_videoconvert_ops_init (SpaVideoConvertOps *ops, uint32_t cpu_flags);
+
+/* plain C versions, also used by the SIMD kernels for the remaining
+ * pixels from @start to @end */
+static inline uint8_t
+spa_videoconvert_clip (int32_t v)
+{
+  return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+static inline void
+spa_videoconvert_rgb_to_yuv_range (uint8_t *d, const uint8_t *s, uint32_t start, uint32_t end)
+{
+  uint32_t i;
+
+  for (i = start * 4; i < end * 4; i += 4) {
+    int32_t r = s[i + 0], g = s[i + 1], b = s[i + 2];
+
+    d[i + 0] = (( 66 * r + 129 * g +  25 * b + 128) >> 8) + 16;
+    d[i + 1] = ((-38 * r -  74 * g + 112 * b + 128 + 32768) >> 8);
+    d[i + 2] = ((112 * r -  94 * g -  18 * b + 128 + 32768) >> 8);
+    d[i + 3] = 0xff;
+  }
+}
+
+static inline void
+spa_videoconvert_yuv_to_rgb_range (uint8_t *d, const uint8_t *s, uint32_t start, uint32_t end)
+{
+  uint32_t i;
+
+  for (i = start * 4; i < end * 4; i += 4) {
+    int32_t c = s[i + 0] - 16, u = s[i + 1] - 128, v = s[i + 2] - 128;
+
+    d[i + 0] = spa_videoconvert_clip ((298 * c           + 409 * v + 128) >> 8);
+    d[i + 1] = spa_videoconvert_clip ((298 * c - 100 * u - 208 * v + 128) >> 8);
+    d[i + 2] = spa_videoconvert_clip ((298 * c + 516 * u           + 128) >> 8);
+    d[i + 3] = 0xff;
+  }
+}
+
+static inline void
+spa_videoconvert_blend_v_range (uint8_t *d, const uint8_t *s0, const uint8_t *s1,
+                                uint32_t weight, uint32_t start, uint32_t end)
+{
+  uint32_t i, w0 = 256 - weight;
+
+  for (i = start; i < end; i++)
+    d[i] = (s0[i] * w0 + s1[i] * weight + 128) >> 8;
+}
+
+void spa_videoconvert_unpack_rgb  (uint8_t *dst, const uint8_t *src[3], uint32_t width);
+void spa_videoconvert_unpack_uyvy (uint8_t *dst, const uint8_t *src[3], uint32_t width);
+void spa_videoconvert_unpack_yuy2 (uint8_t *dst, const uint8_t *src[3], uint32_t width);
+void spa_videoconvert_unpack_i420 (uint8_t *dst, const uint8_t *src[3], uint32_t width);
+void spa_videoconvert_unpack_nv12 (uint8_t *dst, const uint8_t *src[3], uint32_t width);
+
+void spa_videoconvert_pack_rgb    (uint8_t *dst[3], const uint8_t *src, uint32_t width, bool chroma);
+void spa_videoconvert_pack_uyvy   (uint8_t *dst[3], const uint8_t *src, uint32_t width, bool chroma);
+void spa_videoconvert_pack_yuy2   (uint8_t *dst[3], const uint8_t *src, uint32_t width, bool chroma);
+void spa_videoconvert_pack_i420   (uint8_t *dst[3], const uint8_t *src, uint32_t width, bool chroma);
+void spa_videoconvert_pack_nv12   (uint8_t *dst[3], const uint8_t *src, uint32_t width, bool chroma);
+
+/* ((x + n / 2) * SPA_VIDEOCONVERT_RECIPROCAL (n)) >> 24 is the rounded
+ * x / n for the sums of n 8 bit values that area scaling averages. It fits
+ * in 32 bits and is exact up to n = 256, larger n can be off by one. */
+#define SPA_VIDEOCONVERT_RECIPROCAL(n) ((((uint32_t) 1 << 24) + (n) - 1) / (n))
+
+/**
+ * spa_videoconvert_scale_h_bilinear:
+ * @dst: @dst_width unpacked pixels
+ * @src: unpacked source pixels
+ * @xmap: for each destination pixel, the left source pixel
+ * @xweight: for each destination pixel, the weight of the right source
+ *           pixel between 0 and 256
+ * @dst_width: number of destination pixels
+ */
+void spa_videoconvert_scale_h_bilinear (uint8_t *dst, const uint8_t *src,
+                                        const uint32_t *xmap, const uint16_t *xweight,
+                                        uint32_t dst_width);
+/**
+ * spa_videoconvert_scale_h_area:
+ * @dst: @dst_width unpacked pixels
+ * @src: unpacked source pixels
+ * @xmap: the first source pixel of each destination pixel, @dst_width + 1
+ *        entries
+ * @xmult: SPA_VIDEOCONVERT_RECIPROCAL() of the number of source pixels of
+ *         each destination pixel
+ * @dst_width: number of destination pixels
+ *
+ * Average all source pixels that fall in a destination pixel.
+ */
+void spa_videoconvert_scale_h_area     (uint8_t *dst, const uint8_t *src,
+                                        const uint32_t *xmap, const uint32_t *xmult,
+                                        uint32_t dst_width);
+
+void spa_videoconvert_rgb_to_yuv_c     (uint8_t *dst, const uint8_t *src, uint32_t width);
+void spa_videoconvert_yuv_to_rgb_c     (uint8_t *dst, const uint8_t *src, uint32_t width);
+void spa_videoconvert_blend_v_c        (uint8_t *dst, const uint8_t *s0, const uint8_t *s1,
+                                        uint32_t weight, uint32_t n_bytes);
+#if defined (HAVE_SSE2)
+void spa_videoconvert_rgb_to_yuv_sse2  (uint8_t *dst, const uint8_t *src, uint32_t width);
+void spa_videoconvert_yuv_to_rgb_sse2  (uint8_t *dst, const uint8_t *src, uint32_t width);
+void spa_videoconvert_blend_v_sse2     (uint8_t *dst, const uint8_t *s0, const uint8_t *s1,
+                                        uint32_t weight, uint32_t n_bytes);
+#endif
+
+#endif /* __SPA_VIDEOCONVERT_CONVERT_OPS_H__ */
@@ -0,0 +1,1436 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <spa/log.h>
+#include <spa/type-map.h>
+#include <spa/node.h>
+#include <spa/list.h>
+#include <spa/video/format-utils.h>
+#include <spa/format-builder.h>
+#include <lib/props.h>
+#include <lib/cpu.h>
+
+#include "convert-ops.h"
+#include "workers.h"
+
+#define MAX_BUFFERS     16
+#define MAX_PLANES      3
+#define MAX_SLICES      (SPA_VIDEOCONVERT_MAX_THREADS + 1)
+
+/* smaller frames are converted on the calling thread only */
+#define SLICE_MIN_PIXELS  (640 * 480)
+/* threads used when the threads property is 0 */
+#define DEFAULT_THREADS   4
+
+typedef struct _SpaVideoConvert SpaVideoConvert;
+
+typedef struct {
+  int32_t threads;
+} SpaVideoConvertProps;
+
+typedef struct {
+  SpaBuffer     *outbuf;
+  bool           outstanding;
+  SpaMetaHeader *h;
+  SpaList        link;
+} SpaVideoConvertBuffer;
+
+typedef struct {
+  uint32_t                  n_planes;
+  bool                      yuv;
+  /* vertical chroma subsampling shift of planes 1 and 2 */
+  uint32_t                  chroma_shift;
+  SpaVideoConvertUnpackFunc unpack;
+  SpaVideoConvertPackFunc   pack;
+} SpaVideoConvertFormatInfo;
+
+typedef struct {
+  uint8_t  *data[MAX_PLANES];
+  uint32_t  stride[MAX_PLANES];
+} SpaVideoConvertFrame;
+
+typedef struct {
+  bool            have_format;
+  SpaVideoInfo    format;
+  SpaVideoConvertFormatInfo fi;
+  uint32_t        stride[MAX_PLANES];
+  uint32_t        offset[MAX_PLANES];
+  uint32_t        size;
+
+  SpaPortInfo     info;
+  SpaAllocParam  *params[2];
+  uint8_t         params_buffer[1024];
+
+  SpaVideoConvertBuffer buffers[MAX_BUFFERS];
+  uint32_t        n_buffers;
+  SpaPortIO      *io;
+
+  SpaList         empty;
+} SpaVideoConvertPort;
+
+typedef enum {
+  SCALE_NONE,
+  SCALE_BILINEAR,
+  SCALE_AREA,
+} ScaleMode;
+
+/* the scratch lines of one slice */
+typedef struct {
+  uint8_t  *src;
+  uint8_t  *lines[2];
+  int32_t   line_y[2];
+  uint8_t  *out;
+  uint32_t *accum;
+} SpaVideoConvertSlice;
+
+typedef struct {
+  uint32_t node;
+  uint32_t format;
+  uint32_t props;
+  uint32_t prop_threads;
+  SpaTypeMeta meta;
+  SpaTypeData data;
+  SpaTypeMediaType media_type;
+  SpaTypeMediaSubtype media_subtype;
+  SpaTypeFormatVideo format_video;
+  SpaTypeVideoFormat video_format;
+  SpaTypeEventNode event_node;
+  SpaTypeCommandNode command_node;
+  SpaTypeAllocParamBuffers alloc_param_buffers;
+  SpaTypeAllocParamMetaEnable alloc_param_meta_enable;
+} Type;
+
+static inline void
+init_type (Type *type, SpaTypeMap *map)
+{
+  type->node = spa_type_map_get_id (map, SPA_TYPE__Node);
+  type->format = spa_type_map_get_id (map, SPA_TYPE__Format);
+  type->props = spa_type_map_get_id (map, SPA_TYPE__Props);
+  type->prop_threads = spa_type_map_get_id (map, SPA_TYPE_PROPS__threads);
+  spa_type_meta_map (map, &type->meta);
+  spa_type_data_map (map, &type->data);
+  spa_type_media_type_map (map, &type->media_type);
+  spa_type_media_subtype_map (map, &type->media_subtype);
+  spa_type_format_video_map (map, &type->format_video);
+  spa_type_video_format_map (map, &type->video_format);
+  spa_type_event_node_map (map, &type->event_node);
+  spa_type_command_node_map (map, &type->command_node);
+  spa_type_alloc_param_buffers_map (map, &type->alloc_param_buffers);
+  spa_type_alloc_param_meta_enable_map (map, &type->alloc_param_meta_enable);
+}
+
+struct _SpaVideoConvert {
+  SpaHandle  handle;
+  SpaNode  node;
+
+  Type type;
+  SpaTypeMap *map;
+  SpaLog *log;
+
+  uint8_t props_buffer[512];
+  SpaVideoConvertProps props;
+
+  SpaNodeCallbacks callbacks;
+  void *user_data;
+
+  uint8_t format_buffer[1024];
+
+  SpaVideoConvertPort in_ports[1];
+  SpaVideoConvertPort out_ports[1];
+
+  SpaVideoConvertOps ops;
+  SpaVideoConvertMatrixFunc matrix;
+  bool passthrough;
+  ScaleMode scale_h;
+  ScaleMode scale_v;
+  uint32_t *xmap;
+  uint16_t *xweight;
+  uint32_t *xmult;
+
+  bool configured;
+
+  SpaVideoConvertWorkers workers;
+  bool have_workers;
+  /* the number of threads asked for, workers.n_threads can be less */
+  uint32_t n_threads;
+  uint32_t n_slices;
+  SpaVideoConvertSlice slices[MAX_SLICES];
+  void *scratch;
+
+  /* the frames being converted */
+  SpaVideoConvertFrame src;
+  SpaVideoConvertFrame dst;
+
+  bool started;
+};
+
+#define CHECK_IN_PORT(this,d,p)  ((d) == SPA_DIRECTION_INPUT && (p) == 0)
+#define CHECK_OUT_PORT(this,d,p) ((d) == SPA_DIRECTION_OUTPUT && (p) == 0)
+#define CHECK_PORT(this,d,p)     ((p) == 0)
+#define GET_PORT(this,d,p)       ((d) == SPA_DIRECTION_INPUT ? &(this)->in_ports[p] : &(this)->out_ports[p])
+#define GET_OTHER_PORT(this,d,p) ((d) == SPA_DIRECTION_INPUT ? &(this)->out_ports[p] : &(this)->in_ports[p])
+
+#define DEFAULT_THREADS_PROP 0
+
+static void
+reset_videoconvert_props (SpaVideoConvertProps *props)
+{
+  props->threads = DEFAULT_THREADS_PROP;
+}
+
+#define PROP(f,key,type,...)                                                    \
+          SPA_POD_PROP (f,key,0,type,1,__VA_ARGS__)
+#define PROP_MM(f,key,type,...)                                                 \
+          SPA_POD_PROP (f,key,SPA_POD_PROP_RANGE_MIN_MAX,type,3,__VA_ARGS__)
+#define PROP_U_MM(f,key,type,...)                                               \
+          SPA_POD_PROP (f,key,SPA_POD_PROP_FLAG_UNSET |                         \
+                              SPA_POD_PROP_RANGE_MIN_MAX,type,3,__VA_ARGS__)
+#define PROP_U_EN(f,key,type,n,...)                                             \
+          SPA_POD_PROP (f,key,SPA_POD_PROP_FLAG_UNSET |                         \
+                              SPA_POD_PROP_RANGE_ENUM,type,n,__VA_ARGS__)
+
+static SpaResult
+spa_videoconvert_node_get_props (SpaNode        *node,
+                                 SpaProps     **props)
+{
+  SpaVideoConvert *this;
+  SpaPODBuilder b = { NULL,  };
+  SpaPODFrame f[2];
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (props != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaVideoConvert, node);
+
+  spa_pod_builder_init (&b, this->props_buffer, sizeof (this->props_buffer));
+  spa_pod_builder_props (&b, &f[0], this->type.props,
+      PROP_MM (&f[1], this->type.prop_threads, SPA_POD_TYPE_INT, this->props.threads,
+                                                                 0, SPA_VIDEOCONVERT_MAX_THREADS + 1));
+
+  *props = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaProps);
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult update_convert (SpaVideoConvert *this);
+
+static SpaResult
+spa_videoconvert_node_set_props (SpaNode        *node,
+                                 const SpaProps *props)
+{
+  SpaVideoConvert *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaVideoConvert, node);
+
+  if (props == NULL) {
+    reset_videoconvert_props (&this->props);
+  } else {
+    spa_props_query (props,
+        this->type.prop_threads, SPA_POD_TYPE_INT, &this->props.threads,
+        0);
+  }
+  return update_convert (this);
+}
+
+static SpaResult
+spa_videoconvert_node_send_command (SpaNode    *node,
+                                    SpaCommand *command)
+{
+  SpaVideoConvert *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (command != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaVideoConvert, node);
+
+  if (SPA_COMMAND_TYPE (command) == this->type.command_node.Start) {
+    this->started = true;
+  }
+  else if (SPA_COMMAND_TYPE (command) == this->type.command_node.Pause) {
+    this->started = false;
+  }
+  else
+    return SPA_RESULT_NOT_IMPLEMENTED;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_videoconvert_node_set_callbacks (SpaNode                *node,
+                                     const SpaNodeCallbacks *callbacks,
+                                     size_t                  callbacks_size,
+                                     void                   *user_data)
+{
+  SpaVideoConvert *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaVideoConvert, node);
+
+  this->callbacks = *callbacks;
+  this->user_data = user_data;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_videoconvert_node_get_n_ports (SpaNode       *node,
+                                   uint32_t      *n_input_ports,
+                                   uint32_t      *max_input_ports,
+                                   uint32_t      *n_output_ports,
+                                   uint32_t      *max_output_ports)
+{
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  if (n_input_ports)
+    *n_input_ports = 1;
+  if (max_input_ports)
+    *max_input_ports = 1;
+  if (n_output_ports)
+    *n_output_ports = 1;
+  if (max_output_ports)
+    *max_output_ports = 1;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_videoconvert_node_get_port_ids (SpaNode       *node,
+                                    uint32_t       n_input_ports,
+                                    uint32_t      *input_ids,
+                                    uint32_t       n_output_ports,
+                                    uint32_t      *output_ids)
+{
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  if (n_input_ports > 0 && input_ids)
+    input_ids[0] = 0;
+  if (n_output_ports > 0 && output_ids)
+    output_ids[0] = 0;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_videoconvert_node_add_port (SpaNode        *node,
+                                SpaDirection    direction,
+                                uint32_t        port_id)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_videoconvert_node_remove_port (SpaNode        *node,
+                                   SpaDirection    direction,
+                                   uint32_t        port_id)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_videoconvert_node_port_enum_formats (SpaNode          *node,
+                                         SpaDirection      direction,
+                                         uint32_t          port_id,
+                                         SpaFormat       **format,
+                                         const SpaFormat  *filter,
+                                         uint32_t          index)
+{
+  SpaVideoConvert *this;
+  SpaVideoConvertPort *other;
+  SpaTypeVideoFormat *vf;
+  SpaResult res;
+  SpaFormat *fmt;
+  uint8_t buffer[1024];
+  SpaPODBuilder b = { NULL, };
+  SpaPODFrame f[2];
+  uint32_t count, match;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (format != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaVideoConvert, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  other = GET_OTHER_PORT (this, direction, port_id);
+  vf = &this->type.video_format;
+
+  count = match = filter ? 0 : index;
+
+next:
+  spa_pod_builder_init (&b, buffer, sizeof (buffer));
+
+  switch (count++) {
+    case 0:
+      /* we convert the format and the size, the framerate has to match
+       * the other port once that is configured */
+      if (other->have_format) {
+        SpaVideoInfoRaw *raw = &other->format.info.raw;
+
+        spa_pod_builder_format (&b, &f[0], this->type.format,
+            this->type.media_type.video, this->type.media_subtype.raw,
+            PROP_U_EN (&f[1], this->type.format_video.format,    SPA_POD_TYPE_ID,  6,
+                                                                 raw->format,
+                                                                 vf->RGB,
+                                                                 vf->UYVY,
+                                                                 vf->YUY2,
+                                                                 vf->I420,
+                                                                 vf->NV12),
+            PROP_U_MM (&f[1], this->type.format_video.size,      SPA_POD_TYPE_RECTANGLE,
+                                                                 raw->size.width, raw->size.height,
+                                                                 1, 1,
+                                                                 INT32_MAX, INT32_MAX),
+            PROP      (&f[1], this->type.format_video.framerate, SPA_POD_TYPE_FRACTION,
+                                                                 raw->framerate.num, raw->framerate.denom));
+      } else {
+        spa_pod_builder_format (&b, &f[0], this->type.format,
+            this->type.media_type.video, this->type.media_subtype.raw,
+            PROP_U_EN (&f[1], this->type.format_video.format,    SPA_POD_TYPE_ID,  6,
+                                                                 vf->I420,
+                                                                 vf->RGB,
+                                                                 vf->UYVY,
+                                                                 vf->YUY2,
+                                                                 vf->I420,
+                                                                 vf->NV12),
+            PROP_U_MM (&f[1], this->type.format_video.size,      SPA_POD_TYPE_RECTANGLE,
+                                                                 320, 240,
+                                                                 1, 1,
+                                                                 INT32_MAX, INT32_MAX),
+            PROP_U_MM (&f[1], this->type.format_video.framerate, SPA_POD_TYPE_FRACTION,
+                                                                 25, 1,
+                                                                 0, 1,
+                                                                 INT32_MAX, 1));
+      }
+      break;
+    default:
+      return SPA_RESULT_ENUM_END;
+  }
+  fmt = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaFormat);
+  spa_pod_builder_init (&b, this->format_buffer, sizeof (this->format_buffer));
+
+  if ((res = spa_format_filter (fmt, filter, &b)) != SPA_RESULT_OK || match++ != index)
+    goto next;
+
+  *format = SPA_POD_BUILDER_DEREF (&b, 0, SpaFormat);
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+clear_buffers (SpaVideoConvert *this, SpaVideoConvertPort *port)
+{
+  if (port->n_buffers > 0) {
+    spa_log_info (this->log, "videoconvert %p: clear buffers", this);
+    port->n_buffers = 0;
+    spa_list_init (&port->empty);
+  }
+  return SPA_RESULT_OK;
+}
+
+static bool
+get_format_info (SpaVideoConvert *this, uint32_t format, SpaVideoConvertFormatInfo *fi)
+{
+  SpaTypeVideoFormat *vf = &this->type.video_format;
+
+  fi->n_planes = 1;
+  fi->yuv = true;
+  fi->chroma_shift = 0;
+
+  if (format == vf->RGB) {
+    fi->yuv = false;
+    fi->unpack = spa_videoconvert_unpack_rgb;
+    fi->pack = spa_videoconvert_pack_rgb;
+  } else if (format == vf->UYVY) {
+    fi->unpack = spa_videoconvert_unpack_uyvy;
+    fi->pack = spa_videoconvert_pack_uyvy;
+  } else if (format == vf->YUY2) {
+    fi->unpack = spa_videoconvert_unpack_yuy2;
+    fi->pack = spa_videoconvert_pack_yuy2;
+  } else if (format == vf->I420) {
+    fi->n_planes = 3;
+    fi->chroma_shift = 1;
+    fi->unpack = spa_videoconvert_unpack_i420;
+    fi->pack = spa_videoconvert_pack_i420;
+  } else if (format == vf->NV12) {
+    fi->n_planes = 2;
+    fi->chroma_shift = 1;
+    fi->unpack = spa_videoconvert_unpack_nv12;
+    fi->pack = spa_videoconvert_pack_nv12;
+  } else
+    return false;
+
+  return true;
+}
+
+/* fill in the plane strides and offsets of a frame of @port in one
+ * memory block where the first plane has @stride0, returns the size */
+static uint32_t
+get_layout (SpaVideoConvertPort *port, uint32_t stride0, uint32_t stride[], uint32_t offset[])
+{
+  SpaVideoConvertFormatInfo *fi = &port->fi;
+  uint32_t height = port->format.info.raw.size.height;
+  uint32_t chroma_height = (height + (1 << fi->chroma_shift) - 1) >> fi->chroma_shift;
+  uint32_t i, size;
+
+  stride[0] = stride0;
+  offset[0] = 0;
+  size = stride0 * height;
+
+  for (i = 1; i < fi->n_planes; i++) {
+    /* I420 has half width U and V planes, NV12 one UV plane */
+    stride[i] = fi->n_planes == 3 ? stride0 / 2 : stride0;
+    offset[i] = size;
+    size += stride[i] * chroma_height;
+  }
+  return size;
+}
+
+static uint32_t
+default_stride (SpaVideoConvertPort *port)
+{
+  uint32_t width = port->format.info.raw.size.width;
+
+  if (port->fi.n_planes > 1)
+    return SPA_ROUND_UP_N (width, 8);
+  else if (port->fi.yuv)
+    return SPA_ROUND_UP_N (width * 2, 4);
+  else
+    return SPA_ROUND_UP_N (width * 3, 4);
+}
+
+static void
+free_scratch (SpaVideoConvert *this)
+{
+  free (this->scratch);
+  this->scratch = NULL;
+  free (this->xmap);
+  this->xmap = NULL;
+  free (this->xweight);
+  this->xweight = NULL;
+  free (this->xmult);
+  this->xmult = NULL;
+}
+
+static ScaleMode
+get_scale_mode (uint32_t src_size, uint32_t dst_size)
+{
+  if (src_size == dst_size)
+    return SCALE_NONE;
+  /* bilinear skips source pixels when downscaling more than 2 times */
+  if (dst_size * 2 > src_size)
+    return SCALE_BILINEAR;
+  return SCALE_AREA;
+}
+
+static uint32_t
+get_n_threads (SpaVideoConvert *this)
+{
+  long n;
+
+  if (this->props.threads > 0)
+    return SPA_MIN (this->props.threads, MAX_SLICES);
+
+  n = sysconf (_SC_NPROCESSORS_ONLN);
+  return SPA_CLAMP (n, 1, DEFAULT_THREADS);
+}
+
+static void
+update_workers (SpaVideoConvert *this, uint32_t n_slices)
+{
+  uint32_t n_threads = n_slices - 1;
+  SpaResult res;
+
+  if (this->have_workers && this->n_threads != n_threads) {
+    spa_videoconvert_workers_clear (&this->workers);
+    this->have_workers = false;
+  }
+  if (n_threads == 0)
+    return;
+
+  if (!this->have_workers) {
+    res = spa_videoconvert_workers_init (&this->workers, n_threads);
+    this->n_threads = n_threads;
+    this->have_workers = true;
+  } else if (this->workers.n_threads < n_threads) {
+    /* keep the threads we have and retry the ones that failed to start */
+    res = spa_videoconvert_workers_add (&this->workers, n_threads);
+  } else {
+    return;
+  }
+  if (res < 0)
+    spa_log_warn (this->log, "videoconvert %p: could only start %u of %u threads", this,
+        this->workers.n_threads, n_threads);
+}
+
+/* pick the kernels and set up the scaling for the configured formats,
+ * the converter stays unconfigured when this fails */
+static SpaResult
+update_convert (SpaVideoConvert *this)
+{
+  SpaVideoConvertPort *in = &this->in_ports[0], *out = &this->out_ports[0];
+  SpaRectangle *in_size, *out_size;
+  uint32_t i, n_slices, line_size, slice_size;
+  uint8_t *p;
+
+  this->configured = false;
+  free_scratch (this);
+
+  if (!in->have_format || !out->have_format)
+    return SPA_RESULT_OK;
+
+  in_size = &in->format.info.raw.size;
+  out_size = &out->format.info.raw.size;
+
+  this->passthrough = in->format.info.raw.format == out->format.info.raw.format &&
+                      in_size->width == out_size->width &&
+                      in_size->height == out_size->height;
+
+  if (in->fi.yuv == out->fi.yuv)
+    this->matrix = NULL;
+  else if (in->fi.yuv)
+    this->matrix = this->ops.yuv_to_rgb;
+  else
+    this->matrix = this->ops.rgb_to_yuv;
+
+  this->scale_h = get_scale_mode (in_size->width, out_size->width);
+  this->scale_v = get_scale_mode (in_size->height, out_size->height);
+
+  if (this->passthrough) {
+    update_workers (this, 1);
+    this->n_slices = 1;
+    goto done;
+  }
+
+  /* xmap holds the first source pixel of each output pixel, for area
+   * scaling it has one more entry for the end of the last pixel */
+  this->xmap = malloc ((out_size->width + 1) * sizeof (uint32_t));
+  this->xweight = malloc (out_size->width * sizeof (uint16_t));
+  this->xmult = malloc (out_size->width * sizeof (uint32_t));
+  if (this->xmap == NULL || this->xweight == NULL || this->xmult == NULL)
+    goto no_memory;
+
+  for (i = 0; i <= out_size->width; i++) {
+    if (this->scale_h == SCALE_BILINEAR && i < out_size->width) {
+      /* sample at the pixel centers, in 1/256th of a pixel */
+      int64_t pos = ((int64_t) (2 * i + 1) * in_size->width * 256) / (2 * out_size->width) - 128;
+
+      pos = SPA_CLAMP (pos, 0, (int64_t) (in_size->width - 1) * 256);
+      this->xmap[i] = pos >> 8;
+      this->xweight[i] = pos & 0xff;
+    } else {
+      this->xmap[i] = (uint64_t) i * in_size->width / out_size->width;
+    }
+  }
+  if (this->scale_h == SCALE_AREA) {
+    for (i = 0; i < out_size->width; i++)
+      this->xmult[i] = SPA_VIDEOCONVERT_RECIPROCAL (this->xmap[i + 1] - this->xmap[i]);
+  }
+
+  n_slices = out_size->width * out_size->height >= SLICE_MIN_PIXELS ? get_n_threads (this) : 1;
+  n_slices = SPA_MIN (n_slices, SPA_MAX (out_size->height / 16, 1));
+  update_workers (this, n_slices);
+  this->n_slices = this->have_workers ? this->workers.n_threads + 1 : 1;
+
+  /* the unpacked source line has room for one more pixel so that
+   * bilinear scaling can always read the pixel on the right */
+  line_size = SPA_ROUND_UP_N ((SPA_MAX (in_size->width, out_size->width) + 1) * 4, 64);
+  slice_size = 4 * line_size + out_size->width * 4 * sizeof (uint32_t);
+
+  p = this->scratch = malloc (this->n_slices * slice_size);
+  if (p == NULL)
+    goto no_memory;
+  for (i = 0; i < this->n_slices; i++) {
+    SpaVideoConvertSlice *s = &this->slices[i];
+
+    s->src = p;
+    s->lines[0] = p + line_size;
+    s->lines[1] = p + 2 * line_size;
+    s->out = p + 3 * line_size;
+    s->accum = (uint32_t *) (p + 4 * line_size);
+    p += slice_size;
+  }
+
+done:
+  spa_log_info (this->log, "videoconvert %p: %ux%u -> %ux%u %s%s, %u slices", this,
+      in_size->width, in_size->height, out_size->width, out_size->height,
+      this->passthrough ? "passthrough" : "convert",
+      this->matrix ? ", color matrix" : "",
+      this->n_slices);
+  this->configured = true;
+
+  return SPA_RESULT_OK;
+
+no_memory:
+  spa_log_error (this->log, "videoconvert %p: can't allocate scaling tables for %ux%u", this,
+      out_size->width, out_size->height);
+  free_scratch (this);
+  return SPA_RESULT_NO_MEMORY;
+}
+
+static SpaResult
+spa_videoconvert_node_port_set_format (SpaNode         *node,
+                                       SpaDirection     direction,
+                                       uint32_t         port_id,
+                                       uint32_t         flags,
+                                       const SpaFormat *format)
+{
+  SpaVideoConvert *this;
+  SpaVideoConvertPort *port, *other;
+  SpaResult res;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaVideoConvert, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  port = GET_PORT (this, direction, port_id);
+  other = GET_OTHER_PORT (this, direction, port_id);
+
+  if (format == NULL) {
+    port->have_format = false;
+    clear_buffers (this, port);
+  } else {
+    SpaVideoInfo info = { SPA_FORMAT_MEDIA_TYPE (format),
+                          SPA_FORMAT_MEDIA_SUBTYPE (format), };
+    SpaVideoConvertFormatInfo fi;
+
+    if (info.media_type != this->type.media_type.video ||
+        info.media_subtype != this->type.media_subtype.raw)
+      return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+    if (!spa_format_video_raw_parse (format, &info.info.raw, &this->type.format_video))
+      return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+    if (info.info.raw.size.width == 0 || info.info.raw.size.height == 0)
+      return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+    if (other->have_format &&
+        (info.info.raw.framerate.num != other->format.info.raw.framerate.num ||
+         info.info.raw.framerate.denom != other->format.info.raw.framerate.denom))
+      return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+    if (!get_format_info (this, info.info.raw.format, &fi))
+      return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+    port->fi = fi;
+    port->format = info;
+    port->size = get_layout (port, default_stride (port), port->stride, port->offset);
+    port->have_format = true;
+
+    if ((res = update_convert (this)) < 0) {
+      port->have_format = false;
+      return res;
+    }
+  }
+
+  if (port->have_format) {
+    SpaPODBuilder b = { NULL };
+    SpaPODFrame f[2];
+
+    port->info.maxbuffering = -1;
+    port->info.latency = 0;
+
+    port->info.n_params = 2;
+    port->info.params = port->params;
+
+    spa_pod_builder_init (&b, port->params_buffer, sizeof (port->params_buffer));
+    spa_pod_builder_object (&b, &f[0], 0, this->type.alloc_param_buffers.Buffers,
+      PROP      (&f[1], this->type.alloc_param_buffers.size,    SPA_POD_TYPE_INT, port->size),
+      PROP      (&f[1], this->type.alloc_param_buffers.stride,  SPA_POD_TYPE_INT, port->stride[0]),
+      PROP_U_MM (&f[1], this->type.alloc_param_buffers.buffers, SPA_POD_TYPE_INT, MAX_BUFFERS, 2, MAX_BUFFERS),
+      PROP      (&f[1], this->type.alloc_param_buffers.align,   SPA_POD_TYPE_INT, 16));
+    port->params[0] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
+
+    spa_pod_builder_object (&b, &f[0], 0, this->type.alloc_param_meta_enable.MetaEnable,
+      PROP      (&f[1], this->type.alloc_param_meta_enable.type, SPA_POD_TYPE_ID, this->type.meta.Header),
+      PROP      (&f[1], this->type.alloc_param_meta_enable.size, SPA_POD_TYPE_INT, sizeof (SpaMetaHeader)));
+    port->params[1] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
+
+    port->info.extra = NULL;
+  }
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_videoconvert_node_port_get_format (SpaNode          *node,
+                                       SpaDirection      direction,
+                                       uint32_t          port_id,
+                                       const SpaFormat **format)
+{
+  SpaVideoConvert *this;
+  SpaVideoConvertPort *port;
+  SpaPODBuilder b = { NULL, };
+  SpaPODFrame f[2];
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (format != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaVideoConvert, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  port = GET_PORT (this, direction, port_id);
+
+  if (!port->have_format)
+    return SPA_RESULT_NO_FORMAT;
+
+  spa_pod_builder_init (&b, this->format_buffer, sizeof (this->format_buffer));
+  spa_pod_builder_format (&b, &f[0], this->type.format,
+         this->type.media_type.video, this->type.media_subtype.raw,
+         PROP (&f[1], this->type.format_video.format,    SPA_POD_TYPE_ID,         port->format.info.raw.format),
+         PROP (&f[1], this->type.format_video.size,      -SPA_POD_TYPE_RECTANGLE, &port->format.info.raw.size),
+         PROP (&f[1], this->type.format_video.framerate, -SPA_POD_TYPE_FRACTION,  &port->format.info.raw.framerate));
+
+  *format = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaFormat);
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_videoconvert_node_port_get_info (SpaNode            *node,
+                                     SpaDirection        direction,
+                                     uint32_t            port_id,
+                                     const SpaPortInfo **info)
+{
+  SpaVideoConvert *this;
+  SpaVideoConvertPort *port;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (info != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaVideoConvert, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  port = GET_PORT (this, direction, port_id);
+  *info = &port->info;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_videoconvert_node_port_get_props (SpaNode       *node,
+                                      SpaDirection   direction,
+                                      uint32_t       port_id,
+                                      SpaProps     **props)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_videoconvert_node_port_set_props (SpaNode        *node,
+                                      SpaDirection    direction,
+                                      uint32_t        port_id,
+                                      const SpaProps *props)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_videoconvert_node_port_use_buffers (SpaNode         *node,
+                                        SpaDirection     direction,
+                                        uint32_t         port_id,
+                                        SpaBuffer      **buffers,
+                                        uint32_t         n_buffers)
+{
+  SpaVideoConvert *this;
+  SpaVideoConvertPort *port;
+  uint32_t i, j;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaVideoConvert, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  port = GET_PORT (this, direction, port_id);
+
+  if (!port->have_format)
+    return SPA_RESULT_NO_FORMAT;
+
+  clear_buffers (this, port);
+
+  for (i = 0; i < n_buffers; i++) {
+    SpaVideoConvertBuffer *b;
+    SpaData *d = buffers[i]->datas;
+
+    b = &port->buffers[i];
+    b->outbuf = buffers[i];
+    b->outstanding = true;
+    b->h = spa_buffer_find_meta (buffers[i], this->type.meta.Header);
+
+    for (j = 0; j < buffers[i]->n_datas; j++) {
+      if ((d[j].type != this->type.data.MemPtr &&
+           d[j].type != this->type.data.MemFd &&
+           d[j].type != this->type.data.DmaBuf) ||
+          d[j].data == NULL) {
+        spa_log_error (this->log, "videoconvert %p: invalid memory on buffer %p", this, buffers[i]);
+        return SPA_RESULT_ERROR;
+      }
+    }
+    if (direction == SPA_DIRECTION_OUTPUT &&
+        buffers[i]->n_datas < port->fi.n_planes && d[0].maxsize < port->size) {
+      spa_log_error (this->log, "videoconvert %p: buffer %p too small", this, buffers[i]);
+      return SPA_RESULT_ERROR;
+    }
+    spa_list_insert (port->empty.prev, &b->link);
+  }
+  port->n_buffers = n_buffers;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_videoconvert_node_port_alloc_buffers (SpaNode         *node,
+                                          SpaDirection     direction,
+                                          uint32_t         port_id,
+                                          SpaAllocParam  **params,
+                                          uint32_t         n_params,
+                                          SpaBuffer      **buffers,
+                                          uint32_t        *n_buffers)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaResult
+spa_videoconvert_node_port_set_io (SpaNode      *node,
+                                   SpaDirection  direction,
+                                   uint32_t      port_id,
+                                   SpaPortIO    *io)
+{
+  SpaVideoConvert *this;
+  SpaVideoConvertPort *port;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaVideoConvert, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  port = GET_PORT (this, direction, port_id);
+  port->io = io;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_videoconvert_node_port_reuse_buffer (SpaNode         *node,
+                                         uint32_t         port_id,
+                                         uint32_t         buffer_id)
+{
+  SpaVideoConvert *this;
+  SpaVideoConvertBuffer *b;
+  SpaVideoConvertPort *port;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaVideoConvert, node);
+
+  spa_return_val_if_fail (CHECK_PORT (this, SPA_DIRECTION_OUTPUT, port_id), SPA_RESULT_INVALID_PORT);
+
+  port = &this->out_ports[port_id];
+
+  if (port->n_buffers == 0)
+    return SPA_RESULT_NO_BUFFERS;
+
+  if (buffer_id >= port->n_buffers)
+    return SPA_RESULT_INVALID_BUFFER_ID;
+
+  b = &port->buffers[buffer_id];
+  if (!b->outstanding)
+    return SPA_RESULT_OK;
+
+  b->outstanding = false;
+  spa_list_insert (port->empty.prev, &b->link);
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_videoconvert_node_port_send_command (SpaNode        *node,
+                                         SpaDirection    direction,
+                                         uint32_t        port_id,
+                                         SpaCommand     *command)
+{
+  return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static SpaVideoConvertBuffer *
+find_free_buffer (SpaVideoConvert *this, SpaVideoConvertPort *port)
+{
+  SpaVideoConvertBuffer *b;
+
+  if (spa_list_is_empty (&port->empty))
+    return NULL;
+
+  b = spa_list_first (&port->empty, SpaVideoConvertBuffer, link);
+  spa_list_remove (&b->link);
+  b->outstanding = true;
+
+  return b;
+}
+
+static inline void
+release_buffer (SpaVideoConvert *this, SpaBuffer *buffer)
+{
+  this->callbacks.reuse_buffer (&this->node, 0, buffer->id, this->user_data);
+}
+
+/* unpack input line @y and scale it horizontally to the output width. The
+ * last two lines are kept because bilinear scaling uses most lines twice. */
+static const uint8_t *
+get_line (SpaVideoConvert *this, SpaVideoConvertSlice *s, int32_t y)
+{
+  SpaVideoConvertPort *in = &this->in_ports[0];
+  SpaVideoConvertFrame *src = &this->src;
+  uint32_t in_width = in->format.info.raw.size.width;
+  uint32_t out_width = this->out_ports[0].format.info.raw.size.width;
+  const uint8_t *planes[MAX_PLANES];
+  uint8_t *line;
+  uint32_t i, cy;
+
+  if (s->line_y[0] == y)
+    return s->lines[0];
+  if (s->line_y[1] == y)
+    return s->lines[1];
+
+  i = s->line_y[0] < s->line_y[1] ? 0 : 1;
+  line = this->scale_h == SCALE_NONE ? s->lines[i] : s->src;
+
+  planes[0] = src->data[0] + y * src->stride[0];
+  cy = y >> in->fi.chroma_shift;
+  for (i = 1; i < in->fi.n_planes; i++)
+    planes[i] = src->data[i] + cy * src->stride[i];
+
+  in->fi.unpack (line, planes, in_width);
+
+  i = s->line_y[0] < s->line_y[1] ? 0 : 1;
+  if (this->scale_h == SCALE_BILINEAR) {
+    memcpy (&line[in_width * 4], &line[(in_width - 1) * 4], 4);
+    spa_videoconvert_scale_h_bilinear (s->lines[i], line, this->xmap, this->xweight, out_width);
+  } else if (this->scale_h == SCALE_AREA) {
+    spa_videoconvert_scale_h_area (s->lines[i], line, this->xmap, this->xmult, out_width);
+  }
+  s->line_y[i] = y;
+
+  return s->lines[i];
+}
+
+static const uint8_t *
+get_area_line (SpaVideoConvert *this, SpaVideoConvertSlice *s, uint32_t y)
+{
+  uint32_t in_height = this->in_ports[0].format.info.raw.size.height;
+  uint32_t out_height = this->out_ports[0].format.info.raw.size.height;
+  uint32_t n_bytes = this->out_ports[0].format.info.raw.size.width * 4;
+  uint32_t y0 = (uint64_t) y * in_height / out_height;
+  uint32_t y1 = (uint64_t) (y + 1) * in_height / out_height;
+  uint32_t i, sy, n = y1 - y0;
+  uint32_t mult = SPA_VIDEOCONVERT_RECIPROCAL (n);
+  uint32_t *accum = s->accum;
+  uint8_t *out = s->out;
+
+  memset (accum, 0, n_bytes * sizeof (uint32_t));
+  for (sy = y0; sy < y1; sy++) {
+    const uint8_t *l = get_line (this, s, sy);
+    for (i = 0; i < n_bytes; i++)
+      accum[i] += l[i];
+  }
+  for (i = 0; i < n_bytes; i++)
+    out[i] = ((accum[i] + n / 2) * mult) >> 24;
+
+  return s->out;
+}
+
+static void
+convert_slice (void *data, uint32_t slice, uint32_t n_slices)
+{
+  SpaVideoConvert *this = data;
+  SpaVideoConvertSlice *s = &this->slices[slice];
+  SpaVideoConvertPort *out = &this->out_ports[0];
+  SpaVideoConvertFrame *dst = &this->dst;
+  uint32_t in_height = this->in_ports[0].format.info.raw.size.height;
+  uint32_t out_width = out->format.info.raw.size.width;
+  uint32_t out_height = out->format.info.raw.size.height;
+  uint32_t y, y0, y1, lines, i;
+
+  /* slices start on an even line for the 4:2:0 chroma */
+  lines = SPA_ROUND_UP_N ((out_height + n_slices - 1) / n_slices, 2);
+  y0 = SPA_MIN (slice * lines, out_height);
+  y1 = SPA_MIN (y0 + lines, out_height);
+
+  s->line_y[0] = s->line_y[1] = -1;
+
+  for (y = y0; y < y1; y++) {
+    const uint8_t *line;
+    uint8_t *planes[MAX_PLANES];
+    uint32_t cy;
+
+    if (this->scale_v == SCALE_NONE) {
+      line = get_line (this, s, y);
+    } else if (this->scale_v == SCALE_BILINEAR) {
+      int64_t pos = ((int64_t) (2 * y + 1) * in_height * 256) / (2 * out_height) - 128;
+      uint32_t sy, weight;
+
+      pos = SPA_CLAMP (pos, 0, (int64_t) (in_height - 1) * 256);
+      sy = pos >> 8;
+      weight = pos & 0xff;
+
+      if (weight == 0) {
+        line = get_line (this, s, sy);
+      } else {
+        const uint8_t *l0 = get_line (this, s, sy);
+        const uint8_t *l1 = get_line (this, s, sy + 1);
+
+        this->ops.blend_v (s->out, l0, l1, weight, out_width * 4);
+        line = s->out;
+      }
+    } else {
+      line = get_area_line (this, s, y);
+    }
+
+    if (this->matrix) {
+      this->matrix (s->out, line, out_width);
+      line = s->out;
+    }
+
+    planes[0] = dst->data[0] + y * dst->stride[0];
+    cy = y >> out->fi.chroma_shift;
+    for (i = 1; i < out->fi.n_planes; i++)
+      planes[i] = dst->data[i] + cy * dst->stride[i];
+
+    out->fi.pack (planes, line, out_width, (y & ((1 << out->fi.chroma_shift) - 1)) == 0);
+  }
+}
+
+/* the number of lines in plane @i */
+static inline uint32_t
+plane_height (SpaVideoConvertPort *port, uint32_t i)
+{
+  uint32_t height = port->format.info.raw.size.height;
+
+  return i == 0 ? height : (height + (1 << port->fi.chroma_shift) - 1) >> port->fi.chroma_shift;
+}
+
+/* get the planes of @buffer, from one data block per plane or from
+ * consecutive planes in one block. Fails when the planes don't fit in the
+ * memory of the buffer. */
+static bool
+get_frame (SpaVideoConvertPort *port, SpaBuffer *buffer, bool input, SpaVideoConvertFrame *frame)
+{
+  SpaData *d = buffer->datas;
+  uint32_t i, stride[MAX_PLANES], offset[MAX_PLANES], size;
+
+  if (port->fi.n_planes > 1 && buffer->n_datas >= port->fi.n_planes) {
+    for (i = 0; i < port->fi.n_planes; i++) {
+      uint32_t offs = input ? d[i].chunk->offset : 0;
+
+      stride[i] = input && d[i].chunk->stride ? d[i].chunk->stride : port->stride[i];
+      if ((uint64_t) offs + (uint64_t) stride[i] * plane_height (port, i) > d[i].maxsize)
+        return false;
+
+      frame->data[i] = SPA_MEMBER (d[i].data, offs, uint8_t);
+      frame->stride[i] = stride[i];
+    }
+    if (!input) {
+      for (i = 0; i < port->fi.n_planes; i++) {
+        d[i].chunk->offset = 0;
+        d[i].chunk->size = stride[i] * plane_height (port, i);
+        d[i].chunk->stride = stride[i];
+      }
+    }
+    return true;
+  }
+
+  if (input && d[0].chunk->stride != 0)
+    size = get_layout (port, d[0].chunk->stride, stride, offset);
+  else
+    size = get_layout (port, port->stride[0], stride, offset);
+
+  if (input) {
+    if ((uint64_t) d[0].chunk->offset + size > d[0].maxsize)
+      return false;
+  } else {
+    if (size > d[0].maxsize)
+      return false;
+    d[0].chunk->offset = 0;
+    d[0].chunk->size = size;
+    d[0].chunk->stride = stride[0];
+  }
+
+  for (i = 0; i < port->fi.n_planes; i++) {
+    frame->data[i] = SPA_MEMBER (d[0].data, (input ? d[0].chunk->offset : 0) + offset[i], uint8_t);
+    frame->stride[i] = stride[i];
+  }
+  return true;
+}
+
+static void
+copy_frame (SpaVideoConvert *this)
+{
+  SpaVideoConvertPort *out = &this->out_ports[0];
+  uint32_t i, y;
+
+  for (i = 0; i < out->fi.n_planes; i++) {
+    uint32_t h = plane_height (out, i);
+    uint32_t n = SPA_MIN (this->src.stride[i], this->dst.stride[i]);
+
+    for (y = 0; y < h; y++)
+      memcpy (this->dst.data[i] + y * this->dst.stride[i],
+              this->src.data[i] + y * this->src.stride[i], n);
+  }
+}
+
+static SpaResult
+do_convert (SpaVideoConvert *this, SpaBuffer *dbuf, SpaBuffer *sbuf)
+{
+  if (!get_frame (&this->in_ports[0], sbuf, true, &this->src)) {
+    spa_log_error (this->log, "videoconvert %p: input buffer too small", this);
+    return SPA_RESULT_ERROR;
+  }
+  if (!get_frame (&this->out_ports[0], dbuf, false, &this->dst)) {
+    spa_log_error (this->log, "videoconvert %p: output buffer too small", this);
+    return SPA_RESULT_ERROR;
+  }
+
+  if (this->passthrough)
+    copy_frame (this);
+  else if (this->n_slices > 1)
+    spa_videoconvert_workers_run (&this->workers, convert_slice, this, this->n_slices);
+  else
+    convert_slice (this, 0, 1);
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+spa_videoconvert_node_process_input (SpaNode *node)
+{
+  SpaVideoConvert *this;
+  SpaPortIO *input;
+  SpaPortIO *output;
+  SpaVideoConvertPort *in_port, *out_port;
+  SpaVideoConvertBuffer *sb, *db;
+  SpaResult res;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaVideoConvert, node);
+
+  in_port = &this->in_ports[0];
+  out_port = &this->out_ports[0];
+
+  if ((input = in_port->io) == NULL)
+    return SPA_RESULT_ERROR;
+  if ((output = out_port->io) == NULL)
+    return SPA_RESULT_ERROR;
+
+  if (!in_port->have_format || !out_port->have_format || !this->configured) {
+    input->status = SPA_RESULT_NO_FORMAT;
+    return SPA_RESULT_ERROR;
+  }
+  if (input->buffer_id >= in_port->n_buffers) {
+    input->status = SPA_RESULT_INVALID_BUFFER_ID;
+    return SPA_RESULT_ERROR;
+  }
+
+  if (output->buffer_id >= out_port->n_buffers) {
+    db = find_free_buffer (this, out_port);
+  } else {
+    db = &out_port->buffers[output->buffer_id];
+  }
+  if (db == NULL)
+    return SPA_RESULT_OUT_OF_BUFFERS;
+
+  sb = &in_port->buffers[input->buffer_id];
+
+  input->buffer_id = SPA_ID_INVALID;
+  input->status = SPA_RESULT_OK;
+
+  res = do_convert (this, db->outbuf, sb->outbuf);
+
+  release_buffer (this, sb->outbuf);
+
+  if (res != SPA_RESULT_OK) {
+    spa_list_insert (out_port->empty.prev, &db->link);
+    db->outstanding = false;
+    return res;
+  }
+
+  if (sb->h && db->h)
+    *db->h = *sb->h;
+
+  output->buffer_id = db->outbuf->id;
+  output->status = SPA_RESULT_OK;
+
+  return SPA_RESULT_HAVE_BUFFER;
+}
+
+static SpaResult
+spa_videoconvert_node_process_output (SpaNode *node)
+{
+  return SPA_RESULT_NEED_BUFFER;
+}
+
+static const SpaNode videoconvert_node = {
+  sizeof (SpaNode),
+  NULL,
+  spa_videoconvert_node_get_props,
+  spa_videoconvert_node_set_props,
+  spa_videoconvert_node_send_command,
+  spa_videoconvert_node_set_callbacks,
+  spa_videoconvert_node_get_n_ports,
+  spa_videoconvert_node_get_port_ids,
+  spa_videoconvert_node_add_port,
+  spa_videoconvert_node_remove_port,
+  spa_videoconvert_node_port_enum_formats,
+  spa_videoconvert_node_port_set_format,
+  spa_videoconvert_node_port_get_format,
+  spa_videoconvert_node_port_get_info,
+  spa_videoconvert_node_port_get_props,
+  spa_videoconvert_node_port_set_props,
+  spa_videoconvert_node_port_use_buffers,
+  spa_videoconvert_node_port_alloc_buffers,
+  spa_videoconvert_node_port_set_io,
+  spa_videoconvert_node_port_reuse_buffer,
+  spa_videoconvert_node_port_send_command,
+  spa_videoconvert_node_process_input,
+  spa_videoconvert_node_process_output,
+};
+
+static SpaResult
+spa_videoconvert_get_interface (SpaHandle               *handle,
+                                uint32_t                 interface_id,
+                                void                   **interface)
+{
+  SpaVideoConvert *this;
+
+  spa_return_val_if_fail (handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (interface != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = (SpaVideoConvert *) handle;
+
+  if (interface_id == this->type.node)
+    *interface = &this->node;
+  else
+    return SPA_RESULT_UNKNOWN_INTERFACE;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+videoconvert_clear (SpaHandle *handle)
+{
+  SpaVideoConvert *this;
+
+  spa_return_val_if_fail (handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = (SpaVideoConvert *) handle;
+
+  update_workers (this, 1);
+  free_scratch (this);
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+videoconvert_init (const SpaHandleFactory  *factory,
+                   SpaHandle               *handle,
+                   const SpaDict           *info,
+                   const SpaSupport        *support,
+                   uint32_t                 n_support)
+{
+  SpaVideoConvert *this;
+  uint32_t i;
+
+  spa_return_val_if_fail (factory != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  handle->get_interface = spa_videoconvert_get_interface;
+  handle->clear = videoconvert_clear;
+
+  this = (SpaVideoConvert *) handle;
+
+  for (i = 0; i < n_support; i++) {
+    if (strcmp (support[i].type, SPA_TYPE__TypeMap) == 0)
+      this->map = support[i].data;
+    else if (strcmp (support[i].type, SPA_TYPE__Log) == 0)
+      this->log = support[i].data;
+  }
+  if (this->map == NULL) {
+    spa_log_error (this->log, "a type-map is needed");
+    return SPA_RESULT_ERROR;
+  }
+  init_type (&this->type, this->map);
+
+  spa_videoconvert_ops_init (&this->ops, spa_cpu_get_info_flags (info));
+  spa_log_info (this->log, "videoconvert %p: using cpu flags 0x%08x", this, this->ops.cpu_flags);
+
+  this->node = videoconvert_node;
+  reset_videoconvert_props (&this->props);
+  this->n_slices = 1;
+
+  this->in_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
+  spa_list_init (&this->in_ports[0].empty);
+
+  this->out_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS |
+                                  SPA_PORT_INFO_FLAG_NO_REF;
+  spa_list_init (&this->out_ports[0].empty);
+
+  return SPA_RESULT_OK;
+}
+
+static const SpaInterfaceInfo videoconvert_interfaces[] =
+{
+  { SPA_TYPE__Node, },
+};
+
+static SpaResult
+videoconvert_enum_interface_info (const SpaHandleFactory  *factory,
+                                  const SpaInterfaceInfo **info,
+                                  uint32_t                 index)
+{
+  spa_return_val_if_fail (factory != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (info != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  switch (index) {
+    case 0:
+      *info = &videoconvert_interfaces[index];
+      break;
+    default:
+      return SPA_RESULT_ENUM_END;
+  }
+  return SPA_RESULT_OK;
+}
+
+const SpaHandleFactory spa_videoconvert_factory =
+{ "videoconvert",
+  NULL,
+  sizeof (SpaVideoConvert),
+  videoconvert_init,
+  videoconvert_enum_interface_info,
+};
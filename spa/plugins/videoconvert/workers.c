@@ -0,0 +1,122 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "workers.h"
+
+/* called with the lock held, returns with the lock held */
+static void
+process_slices (SpaVideoConvertWorkers *workers)
+{
+  while (workers->next_slice < workers->n_slices) {
+    uint32_t slice = workers->next_slice++;
+
+    pthread_mutex_unlock (&workers->lock);
+    workers->func (workers->data, slice, workers->n_slices);
+    pthread_mutex_lock (&workers->lock);
+
+    if (--workers->pending == 0)
+      pthread_cond_signal (&workers->done);
+  }
+}
+
+static void *
+worker_thread (void *data)
+{
+  SpaVideoConvertWorkers *workers = data;
+
+  pthread_mutex_lock (&workers->lock);
+  while (true) {
+    while (workers->running && workers->next_slice >= workers->n_slices)
+      pthread_cond_wait (&workers->wakeup, &workers->lock);
+    if (!workers->running)
+      break;
+    process_slices (workers);
+  }
+  pthread_mutex_unlock (&workers->lock);
+
+  return NULL;
+}
+
+SpaResult
+spa_videoconvert_workers_init (SpaVideoConvertWorkers *workers, uint32_t n_threads)
+{
+  pthread_mutex_init (&workers->lock, NULL);
+  pthread_cond_init (&workers->wakeup, NULL);
+  pthread_cond_init (&workers->done, NULL);
+  workers->running = true;
+  workers->n_slices = workers->next_slice = workers->pending = 0;
+  workers->n_threads = 0;
+
+  return spa_videoconvert_workers_add (workers, n_threads);
+}
+
+/* start threads until @n_threads are running, the ones that are running
+ * already are kept */
+SpaResult
+spa_videoconvert_workers_add (SpaVideoConvertWorkers *workers, uint32_t n_threads)
+{
+  n_threads = SPA_MIN (n_threads, SPA_VIDEOCONVERT_MAX_THREADS);
+  while (workers->n_threads < n_threads) {
+    if (pthread_create (&workers->threads[workers->n_threads], NULL, worker_thread, workers) != 0)
+      return SPA_RESULT_ERROR;
+    workers->n_threads++;
+  }
+  return SPA_RESULT_OK;
+}
+
+void
+spa_videoconvert_workers_clear (SpaVideoConvertWorkers *workers)
+{
+  uint32_t i;
+
+  pthread_mutex_lock (&workers->lock);
+  workers->running = false;
+  pthread_cond_broadcast (&workers->wakeup);
+  pthread_mutex_unlock (&workers->lock);
+
+  for (i = 0; i < workers->n_threads; i++)
+    pthread_join (workers->threads[i], NULL);
+  workers->n_threads = 0;
+
+  pthread_cond_destroy (&workers->done);
+  pthread_cond_destroy (&workers->wakeup);
+  pthread_mutex_destroy (&workers->lock);
+}
+
+/* process @n_slices slices with the workers and the calling thread,
+ * returns when all slices are done */
+void
+spa_videoconvert_workers_run (SpaVideoConvertWorkers *workers,
+                              SpaVideoConvertSliceFunc func,
+                              void *data,
+                              uint32_t n_slices)
+{
+  pthread_mutex_lock (&workers->lock);
+  workers->func = func;
+  workers->data = data;
+  workers->n_slices = n_slices;
+  workers->next_slice = 0;
+  workers->pending = n_slices;
+  pthread_cond_broadcast (&workers->wakeup);
+
+  process_slices (workers);
+  while (workers->pending > 0)
+    pthread_cond_wait (&workers->done, &workers->lock);
+  pthread_mutex_unlock (&workers->lock);
+}
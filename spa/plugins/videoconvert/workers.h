@@ -0,0 +1,67 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_VIDEOCONVERT_WORKERS_H__
+#define __SPA_VIDEOCONVERT_WORKERS_H__
+
+#include <pthread.h>
+
+#include <spa/defs.h>
+
+#define SPA_VIDEOCONVERT_MAX_THREADS  8
+
+/**
+ * SpaVideoConvertSliceFunc:
+ * @data: user data
+ * @slice: the slice to process
+ * @n_slices: the total number of slices
+ */
+typedef void (*SpaVideoConvertSliceFunc) (void *data, uint32_t slice, uint32_t n_slices);
+
+/**
+ * SpaVideoConvertWorkers:
+ *
+ * A small pool of threads that process the slices of one frame together
+ * with the calling thread. The threads sleep between frames.
+ */
+typedef struct {
+  pthread_t threads[SPA_VIDEOCONVERT_MAX_THREADS];
+  uint32_t n_threads;
+
+  pthread_mutex_t lock;
+  pthread_cond_t wakeup;
+  pthread_cond_t done;
+  bool running;
+
+  SpaVideoConvertSliceFunc func;
+  void *data;
+  uint32_t n_slices;
+  uint32_t next_slice;
+  uint32_t pending;
+} SpaVideoConvertWorkers;
+
+SpaResult spa_videoconvert_workers_init  (SpaVideoConvertWorkers *workers, uint32_t n_threads);
+SpaResult spa_videoconvert_workers_add   (SpaVideoConvertWorkers *workers, uint32_t n_threads);
+void      spa_videoconvert_workers_clear (SpaVideoConvertWorkers *workers);
+void      spa_videoconvert_workers_run   (SpaVideoConvertWorkers *workers,
+                                          SpaVideoConvertSliceFunc func,
+                                          void *data,
+                                          uint32_t n_slices);
+
+#endif /* __SPA_VIDEOCONVERT_WORKERS_H__ */
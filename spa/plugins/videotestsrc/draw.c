@@ -184,116 +184,153 @@ next_line (DrawingData *dd)
   dd->line += dd->stride;
 }
 
+/* The SMPTE pattern only has 3 different lines: the bars, the reversed
+ * bars below them and the bottom line with the pluge, which ends in the
+ * snow. Render them once into the template, the snow part of the bottom
+ * line is filled for each frame. Returns the first pixel of the snow. */
+static int
+render_smpte_template (DrawingData *dd)
+{
+  int w = dd->width;
+  int j, x = 0;
+
+  for (j = 0; j < 7; j++) {
+    int x1 = j * w / 7;
+    int x2 = (j + 1) * w / 7;
+    draw_pixels (dd, x1, j, x2 - x1);
+  }
+  next_line (dd);
+
+  for (j = 0; j < 7; j++) {
+    int x1 = j * w / 7;
+    int x2 = (j + 1) * w / 7;
+    Color c = (j & 1) ? BLACK : BLUE - j;
+
+    draw_pixels (dd, x1, c, x2 - x1);
+  }
+  next_line (dd);
+
+  /* negative I */
+  draw_pixels (dd, x, NEG_I, w / 6);
+  x += w / 6;
+
+  /* white */
+  draw_pixels (dd, x, WHITE, w / 6);
+  x += w / 6;
+
+  /* positive Q */
+  draw_pixels (dd, x, POS_Q, w / 6);
+  x += w / 6;
+
+  /* pluge */
+  draw_pixels (dd, x, DARK_BLACK, w / 12);
+  x += w / 12;
+  draw_pixels (dd, x, BLACK, w / 12);
+  x += w / 12;
+  draw_pixels (dd, x, LIGHT_BLACK, w / 12);
+  x += w / 12;
+
+  /* the snow starts on a macropixel boundary */
+  if ((x & 1) && dd->draw_pixel == draw_pixel_uyvy) {
+    draw_pixels (dd, x, LIGHT_BLACK, 1);
+    x++;
+  }
+  return SPA_MIN (x, w);
+}
+
+static SpaResult
+render_template (SpaVideoTestSrc *this)
+{
+  DrawingData dd;
+  SpaResult res;
+  size_t size;
+
+  this->template_valid = false;
+
+  size = 3 * this->stride;
+  if (this->template_size < size) {
+    uint8_t *t = realloc (this->template, size);
+    if (t == NULL)
+      return SPA_RESULT_NO_MEMORY;
+    this->template = t;
+    this->template_size = size;
+  }
+  memset (this->template, 0, size);
+
+  res = drawing_data_init (&dd, this, (char *) this->template);
+  if (res != SPA_RESULT_OK)
+    return res;
+
+  this->snow_x = render_smpte_template (&dd);
+  this->template_valid = true;
+
+  return SPA_RESULT_OK;
+}
+
 static void
-draw_smpte_snow (DrawingData *dd)
+draw_smpte_snow (SpaVideoTestSrc *this, uint8_t *data)
 {
+  const uint8_t *bars = this->template;
+  const uint8_t *reversed = bars + this->stride;
+  const uint8_t *bottom = reversed + this->stride;
+  SpaRectangle *size = &this->current_format.info.raw.size;
+  size_t snow_offset = this->snow_x * this->bpp;
   int h, w;
   int y1, y2;
-  int i, j;
+  int i;
 
-  w = dd->width;
-  h = dd->height;
+  w = size->width;
+  h = size->height;
   y1 = 2 * h / 3;
   y2 = 3 * h / 4;
 
   for (i = 0; i < y1; i++) {
-    for (j = 0; j < 7; j++) {
-      int x1 = j * w / 7;
-      int x2 = (j + 1) * w / 7;
-      draw_pixels (dd, x1, j, x2 - x1);
-    }
-    next_line (dd);
+    memcpy (data, bars, this->stride);
+    data += this->stride;
   }
 
   for (i = y1; i < y2; i++) {
-    for (j = 0; j < 7; j++) {
-      int x1 = j * w / 7;
-      int x2 = (j + 1) * w / 7;
-      Color c = (j & 1) ? BLACK : BLUE - j;
-
-      draw_pixels (dd, x1, c, x2 - x1);
-    }
-    next_line (dd);
+    memcpy (data, reversed, this->stride);
+    data += this->stride;
   }
 
   for (i = y2; i < h; i++) {
-    int x = 0;
-
-    /* negative I */
-    draw_pixels (dd, x, NEG_I, w / 6);
-    x += w / 6;
-
-    /* white */
-    draw_pixels (dd, x, WHITE, w / 6);
-    x += w / 6;
-
-    /* positive Q */
-    draw_pixels (dd, x, POS_Q, w / 6);
-    x += w / 6;
-
-    /* pluge */
-    draw_pixels (dd, x, DARK_BLACK, w / 12);
-    x += w / 12;
-    draw_pixels (dd, x, BLACK, w / 12);
-    x += w / 12;
-    draw_pixels (dd, x, LIGHT_BLACK, w / 12);
-    x += w / 12;
-
+    memcpy (data, bottom, snow_offset);
     /* war of the ants (a.k.a. snow) */
-    for (j = x; j < w; j++) {
-      Pixel p;
-      unsigned char r = rand ();
-
-      p.R = r;
-      p.G = r;
-      p.B = r;
-      update_yuv (&p);
-      dd->draw_pixel (dd, j, &p);
-    }
-
-    next_line (dd);
+    this->noise_func (data + snow_offset, w - this->snow_x, this->seed);
+    data += this->stride;
   }
 }
 
 static void
-draw_snow (DrawingData *dd)
+draw_snow (SpaVideoTestSrc *this, uint8_t *data)
 {
-  int x, y;
-
-  for (y = 0; y < dd->height; y++) {
-    for (x = 0; x < dd->width; x++) {
-      Pixel p;
-      unsigned char r = rand ();
+  SpaRectangle *size = &this->current_format.info.raw.size;
+  int y;
 
-      p.R = r;
-      p.G = r;
-      p.B = r;
-      update_yuv (&p);
-      dd->draw_pixel (dd, x, &p);
-    }
-
-    next_line (dd);
+  for (y = 0; y < size->height; y++) {
+    this->noise_func (data, size->width, this->seed);
+    data += this->stride;
   }
 }
 
 static SpaResult
 draw (SpaVideoTestSrc *this, char *data)
 {
-  DrawingData dd;
   SpaResult res;
   uint32_t pattern;
 
   init_colors ();
 
-  res = drawing_data_init (&dd, this, data);
-  if (res != SPA_RESULT_OK)
-    return res;
-
   pattern = this->props.pattern;
-  if (pattern == this->type.pattern_smpte_snow)
-    draw_smpte_snow (&dd);
+  if (pattern == this->type.pattern_smpte_snow) {
+    if (!this->template_valid &&
+        (res = render_template (this)) != SPA_RESULT_OK)
+      return res;
+    draw_smpte_snow (this, (uint8_t *) data);
+  }
   else if (pattern == this->type.pattern_snow)
-    draw_snow (&dd);
+    draw_snow (this, (uint8_t *) data);
   else
     return SPA_RESULT_NOT_IMPLEMENTED;
 
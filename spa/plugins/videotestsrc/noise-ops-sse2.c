@@ -0,0 +1,42 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <emmintrin.h>
+
+#include "noise-ops.h"
+
+void
+spa_videotestsrc_noise_uyvy_sse2 (uint8_t *dst, uint32_t n_pixels, uint32_t seed[4])
+{
+  uint32_t i = 0, unrolled = n_pixels & ~7;
+  const __m128i ymask = _mm_set1_epi32 (0xff00ff00);
+  const __m128i chroma = _mm_set1_epi32 (0x00800080);
+  __m128i x = _mm_loadu_si128 ((__m128i *) seed);
+
+  for (; i < unrolled; i += 8) {
+    x = _mm_xor_si128 (x, _mm_slli_epi32 (x, 13));
+    x = _mm_xor_si128 (x, _mm_srli_epi32 (x, 17));
+    x = _mm_xor_si128 (x, _mm_slli_epi32 (x, 5));
+    _mm_storeu_si128 ((__m128i *) &dst[2 * i],
+                      _mm_or_si128 (_mm_and_si128 (x, ymask), chroma));
+  }
+  _mm_storeu_si128 ((__m128i *) seed, x);
+
+  spa_videotestsrc_noise_uyvy_range (dst, seed, i, n_pixels);
+}
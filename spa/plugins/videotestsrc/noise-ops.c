@@ -0,0 +1,60 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <lib/cpu.h>
+
+#include "noise-ops.h"
+
+void
+spa_videotestsrc_noise_rgb_c (uint8_t *dst, uint32_t n_pixels, uint32_t seed[4])
+{
+  uint32_t i, j;
+
+  for (i = 0; i < n_pixels; i += 16) {
+    uint8_t *r = (uint8_t *) seed;
+    uint32_t n = SPA_MIN (16, n_pixels - i);
+
+    spa_videotestsrc_noise_step (seed);
+    for (j = 0; j < n; j++) {
+      dst[0] = dst[1] = dst[2] = r[j];
+      dst += 3;
+    }
+  }
+}
+
+void
+spa_videotestsrc_noise_uyvy_c (uint8_t *dst, uint32_t n_pixels, uint32_t seed[4])
+{
+  spa_videotestsrc_noise_uyvy_range (dst, seed, 0, n_pixels);
+}
+
+void
+spa_videotestsrc_ops_init (SpaVideoTestSrcOps *ops, uint32_t cpu_flags)
+{
+  ops->cpu_flags = 0;
+  ops->noise_rgb = spa_videotestsrc_noise_rgb_c;
+  ops->noise_uyvy = spa_videotestsrc_noise_uyvy_c;
+
+#if defined (HAVE_SSE2)
+  if (cpu_flags & SPA_CPU_FLAG_SSE2) {
+    ops->cpu_flags = SPA_CPU_FLAG_SSE2;
+    ops->noise_uyvy = spa_videotestsrc_noise_uyvy_sse2;
+  }
+#endif
+}
@@ -0,0 +1,96 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_VIDEOTESTSRC_NOISE_OPS_H__
+#define __SPA_VIDEOTESTSRC_NOISE_OPS_H__
+
+#include <string.h>
+
+#include <spa/defs.h>
+
+/**
+ * SpaVideoTestSrcNoiseFunc:
+ * @dst: destination pixels
+ * @n_pixels: number of pixels to write
+ * @seed: 4 xorshift32 states, none of them may be 0
+ *
+ * Write @n_pixels random gray pixels to @dst and advance @seed. All
+ * versions of a function produce the same pixels for the same @seed.
+ */
+typedef void (*SpaVideoTestSrcNoiseFunc) (uint8_t *dst, uint32_t n_pixels, uint32_t seed[4]);
+
+/**
+ * SpaVideoTestSrcOps:
+ * @cpu_flags: the #SpaCPUFlags the functions were selected for
+ *
+ * The noise kernels for each format, selected once for the CPU we run on.
+ */
+typedef struct {
+  uint32_t                 cpu_flags;
+  SpaVideoTestSrcNoiseFunc noise_rgb;
+  SpaVideoTestSrcNoiseFunc noise_uyvy;
+} SpaVideoTestSrcOps;
+
+void spa_videotestsrc_ops_init (SpaVideoTestSrcOps *ops, uint32_t cpu_flags);
+
+/* 4 independent xorshift32 generators, 16 random bytes per step. The
+ * SIMD versions run the same generators in the lanes of a register. */
+static inline void
+spa_videotestsrc_noise_step (uint32_t seed[4])
+{
+  int i;
+
+  for (i = 0; i < 4; i++) {
+    uint32_t x = seed[i];
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    seed[i] = x;
+  }
+}
+
+/* gray UYVY has neutral chroma, the random bytes go in the Y positions */
+static inline void
+spa_videotestsrc_noise_uyvy_range (uint8_t *dst, uint32_t seed[4],
+                                   uint32_t start, uint32_t end)
+{
+  uint32_t i, j;
+  uint8_t tmp[16];
+
+  start *= 2;
+  end *= 2;
+  for (i = start; i < end; i += 16) {
+    spa_videotestsrc_noise_step (seed);
+    for (j = 0; j < 4; j++) {
+      tmp[4 * j + 0] = 0x80;
+      tmp[4 * j + 1] = seed[j] >> 8;
+      tmp[4 * j + 2] = 0x80;
+      tmp[4 * j + 3] = seed[j] >> 24;
+    }
+    memcpy (dst + i, tmp, SPA_MIN (16, end - i));
+  }
+}
+
+void spa_videotestsrc_noise_rgb_c     (uint8_t *dst, uint32_t n_pixels, uint32_t seed[4]);
+void spa_videotestsrc_noise_uyvy_c    (uint8_t *dst, uint32_t n_pixels, uint32_t seed[4]);
+#if defined (HAVE_SSE2)
+void spa_videotestsrc_noise_uyvy_sse2 (uint8_t *dst, uint32_t n_pixels, uint32_t seed[4]);
+#endif
+
+#endif /* __SPA_VIDEOTESTSRC_NOISE_OPS_H__ */
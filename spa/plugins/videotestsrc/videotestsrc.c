@@ -19,9 +19,11 @@
  */
 
 #include <stddef.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdio.h>
+#include <inttypes.h>
 #include <sys/timerfd.h>
 
 #include <spa/type-map.h>
@@ -33,6 +35,9 @@
 #include <spa/video/format-utils.h>
 #include <spa/format-builder.h>
 #include <lib/props.h>
+#include <lib/cpu.h>
+
+#include "noise-ops.h"
 
 #define FRAMES_TO_TIME(this,f)    ((this->current_format.info.raw.framerate.denom * (f) * SPA_NSEC_PER_SEC) / \
                                    (this->current_format.info.raw.framerate.num))
@@ -44,6 +49,10 @@ typedef struct {
   uint32_t props;
   uint32_t prop_live;
   uint32_t prop_pattern;
+  uint32_t prop_crop_x;
+  uint32_t prop_crop_y;
+  uint32_t prop_crop_width;
+  uint32_t prop_crop_height;
   uint32_t pattern_smpte_snow;
   uint32_t pattern_snow;
   SpaTypeMeta meta;
@@ -67,6 +76,10 @@ init_type (Type *type, SpaTypeMap *map)
   type->props = spa_type_map_get_id (map, SPA_TYPE__Props);
   type->prop_live = spa_type_map_get_id (map, SPA_TYPE_PROPS__live);
   type->prop_pattern = spa_type_map_get_id (map, SPA_TYPE_PROPS__patternType);
+  type->prop_crop_x = spa_type_map_get_id (map, SPA_TYPE_PROPS__cropX);
+  type->prop_crop_y = spa_type_map_get_id (map, SPA_TYPE_PROPS__cropY);
+  type->prop_crop_width = spa_type_map_get_id (map, SPA_TYPE_PROPS__cropWidth);
+  type->prop_crop_height = spa_type_map_get_id (map, SPA_TYPE_PROPS__cropHeight);
   type->pattern_smpte_snow = spa_type_map_get_id (map, SPA_TYPE_PROPS__patternType ":smpte-snow");
   type->pattern_snow = spa_type_map_get_id (map, SPA_TYPE_PROPS__patternType ":snow");
   spa_type_meta_map (map, &type->meta);
@@ -86,6 +99,7 @@ typedef struct _SpaVideoTestSrc SpaVideoTestSrc;
 typedef struct {
   bool live;
   uint32_t pattern;
+  SpaMetaVideoCrop crop;
 } SpaVideoTestSrcProps;
 
 #define MAX_BUFFERS 16
@@ -97,6 +111,7 @@ struct _VTSBuffer {
   SpaBuffer *outbuf;
   bool outstanding;
   SpaMetaHeader *h;
+  SpaMetaVideoCrop *crop;
   SpaList link;
 };
 
@@ -120,7 +135,7 @@ struct _SpaVideoTestSrc {
   struct itimerspec timerspec;
 
   SpaPortInfo info;
-  SpaAllocParam *params[2];
+  SpaAllocParam *params[3];
   uint8_t params_buffer[1024];
   SpaPortIO *io;
 
@@ -130,6 +145,14 @@ struct _SpaVideoTestSrc {
   size_t bpp;
   int stride;
 
+  SpaVideoTestSrcOps ops;
+  SpaVideoTestSrcNoiseFunc noise_func;
+  uint32_t seed[4];
+  uint8_t *template;
+  size_t template_size;
+  bool template_valid;
+  int snow_x;
+
   VTSBuffer buffers[MAX_BUFFERS];
   uint32_t  n_buffers;
 
@@ -138,6 +161,8 @@ struct _SpaVideoTestSrc {
   uint64_t elapsed_time;
 
   uint64_t frame_count;
+  /* all consumers skip frames within this interval after the previous */
+  int64_t qos_interval;
   SpaList empty;
 };
 
@@ -152,6 +177,10 @@ reset_videotestsrc_props (SpaVideoTestSrc *this, SpaVideoTestSrcProps *props)
 {
   props->live = DEFAULT_LIVE;
   props->pattern = this->type. DEFAULT_PATTERN;
+  props->crop.x = 0;
+  props->crop.y = 0;
+  props->crop.width = 0;
+  props->crop.height = 0;
 }
 
 #define PROP(f,key,type,...)                                                    \
@@ -186,7 +215,11 @@ spa_videotestsrc_node_get_props (SpaNode       *node,
     PROP_EN (&f[1], this->type.prop_pattern,   SPA_POD_TYPE_ID,  3,
                                                         this->props.pattern,
                                                         this->type.pattern_smpte_snow,
-                                                        this->type.pattern_snow));
+                                                        this->type.pattern_snow),
+    PROP    (&f[1], this->type.prop_crop_x,      SPA_POD_TYPE_INT, this->props.crop.x),
+    PROP    (&f[1], this->type.prop_crop_y,      SPA_POD_TYPE_INT, this->props.crop.y),
+    PROP    (&f[1], this->type.prop_crop_width,  SPA_POD_TYPE_INT, this->props.crop.width),
+    PROP    (&f[1], this->type.prop_crop_height, SPA_POD_TYPE_INT, this->props.crop.height));
 
   *props = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaProps);
 
@@ -209,8 +242,13 @@ spa_videotestsrc_node_set_props (SpaNode         *node,
     spa_props_query (props,
         this->type.prop_live,     SPA_POD_TYPE_BOOL,   &this->props.live,
         this->type.prop_pattern,  SPA_POD_TYPE_ID,     &this->props.pattern,
+        this->type.prop_crop_x,       SPA_POD_TYPE_INT, &this->props.crop.x,
+        this->type.prop_crop_y,       SPA_POD_TYPE_INT, &this->props.crop.y,
+        this->type.prop_crop_width,   SPA_POD_TYPE_INT, &this->props.crop.width,
+        this->type.prop_crop_height,  SPA_POD_TYPE_INT, &this->props.crop.height,
         0);
   }
+  this->template_valid = false;
 
   if (this->props.live)
     this->info.flags |= SPA_PORT_INFO_FLAG_LIVE;
@@ -228,6 +266,28 @@ fill_buffer (SpaVideoTestSrc *this, VTSBuffer *b)
   return draw (this, b->outbuf->datas[0].data);
 }
 
+/* the crop region of the props clipped to the frame, an empty region
+ * selects the complete frame */
+static void
+fill_crop (SpaVideoTestSrc *this, SpaMetaVideoCrop *crop)
+{
+  SpaRectangle *size = &this->current_format.info.raw.size;
+  int32_t x, y;
+
+  x = SPA_CLAMP (this->props.crop.x, 0, (int32_t) size->width);
+  y = SPA_CLAMP (this->props.crop.y, 0, (int32_t) size->height);
+
+  crop->x = x;
+  crop->y = y;
+  if (this->props.crop.width > 0 && this->props.crop.height > 0) {
+    crop->width = SPA_MIN (this->props.crop.width, (int32_t) size->width - x);
+    crop->height = SPA_MIN (this->props.crop.height, (int32_t) size->height - y);
+  } else {
+    crop->width = size->width - x;
+    crop->height = size->height - y;
+  }
+}
+
 static void
 set_timer (SpaVideoTestSrc *this, bool enabled)
 {
@@ -293,8 +353,13 @@ videotestsrc_make_buffer (SpaVideoTestSrc *this)
     b->h->pts = this->start_time + this->elapsed_time;
     b->h->dts_offset = 0;
   }
+  if (b->crop)
+    fill_crop (this, b->crop);
 
-  this->frame_count++;
+  /* skip the frames nobody wants, without going above the rate asked */
+  do {
+    this->frame_count++;
+  } while ((int64_t) (FRAMES_TO_TIME (this, this->frame_count) - this->elapsed_time) < this->qos_interval);
   this->elapsed_time = FRAMES_TO_TIME (this, this->frame_count);
   set_timer (this, true);
 
@@ -547,15 +612,18 @@ spa_videotestsrc_node_port_set_format (SpaNode         *node,
 
     if (info.info.raw.format == this->type.video_format.RGB) {
       this->bpp = 3;
+      this->noise_func = this->ops.noise_rgb;
     }
     else if (info.info.raw.format == this->type.video_format.UYVY) {
       this->bpp = 2;
+      this->noise_func = this->ops.noise_uyvy;
     }
     else
       return SPA_RESULT_NOT_IMPLEMENTED;
 
     this->current_format = info;
     this->have_format = true;
+    this->template_valid = false;
   }
 
   if (this->have_format) {
@@ -566,7 +634,7 @@ spa_videotestsrc_node_port_set_format (SpaNode         *node,
     this->info.latency = 0;
     this->info.maxbuffering = -1;
 
-    this->info.n_params = 2;
+    this->info.n_params = 3;
     this->info.params = this->params;
     this->stride = SPA_ROUND_UP_N (this->bpp * raw_info->size.width, 4);
 
@@ -583,6 +651,11 @@ spa_videotestsrc_node_port_set_format (SpaNode         *node,
       PROP      (&f[1], this->type.alloc_param_meta_enable.size, SPA_POD_TYPE_INT, sizeof (SpaMetaHeader)));
     this->params[1] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
 
+    spa_pod_builder_object (&b, &f[0], 0, this->type.alloc_param_meta_enable.MetaEnable,
+      PROP      (&f[1], this->type.alloc_param_meta_enable.type, SPA_POD_TYPE_ID, this->type.meta.VideoCrop),
+      PROP      (&f[1], this->type.alloc_param_meta_enable.size, SPA_POD_TYPE_INT, sizeof (SpaMetaVideoCrop)));
+    this->params[2] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
+
     this->info.extra = NULL;
   }
 
@@ -687,6 +760,7 @@ spa_videotestsrc_node_port_use_buffers (SpaNode         *node,
     b->outbuf = buffers[i];
     b->outstanding = false;
     b->h = spa_buffer_find_meta (buffers[i], this->type.meta.Header);
+    b->crop = spa_buffer_find_meta (buffers[i], this->type.meta.VideoCrop);
 
     if ((d[0].type == this->type.data.MemPtr ||
          d[0].type == this->type.data.MemFd ||
@@ -784,7 +858,25 @@ spa_videotestsrc_node_port_send_command (SpaNode        *node,
                                          uint32_t        port_id,
                                          SpaCommand     *command)
 {
-  return SPA_RESULT_NOT_IMPLEMENTED;
+  SpaVideoTestSrc *this;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (command != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaVideoTestSrc, node);
+
+  spa_return_val_if_fail (CHECK_PORT_NUM (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  if (SPA_COMMAND_TYPE (command) == this->type.command_node.QoS) {
+    SpaCommandNodeQoS *qos = (SpaCommandNodeQoS *) command;
+
+    this->qos_interval = SPA_MAX (qos->body.interval.value, 0);
+    spa_log_info (this->log, "videotestsrc %p: QoS interval %"PRIi64, this, this->qos_interval);
+  }
+  else
+    return SPA_RESULT_NOT_IMPLEMENTED;
+
+  return SPA_RESULT_OK;
 }
 
 static SpaResult
@@ -928,6 +1020,10 @@ videotestsrc_clear (SpaHandle *handle)
     spa_loop_remove_source (this->data_loop, &this->timer_source);
   close (this->timer_source.fd);
 
+  free (this->template);
+  this->template = NULL;
+  this->template_size = 0;
+
   return SPA_RESULT_OK;
 }
 
@@ -967,6 +1063,12 @@ videotestsrc_init (const SpaHandleFactory  *factory,
   this->clock = videotestsrc_clock;
   reset_videotestsrc_props (this, &this->props);
 
+  spa_videotestsrc_ops_init (&this->ops, spa_cpu_get_info_flags (info));
+  this->seed[0] = 0x9e3779b9;
+  this->seed[1] = 0x7f4a7c15;
+  this->seed[2] = 0x85ebca6b;
+  this->seed[3] = 0xc2b2ae35;
+
   spa_list_init (&this->empty);
 
   this->timer_source.func = videotestsrc_on_output;
@@ -987,7 +1089,8 @@ videotestsrc_init (const SpaHandleFactory  *factory,
   if (this->props.live)
     this->info.flags |= SPA_PORT_INFO_FLAG_LIVE;
 
-  spa_log_info (this->log, "videotestsrc %p: initialized", this);
+  spa_log_info (this->log, "videotestsrc %p: initialized, using cpu flags 0x%08x", this,
+      this->ops.cpu_flags);
 
   return SPA_RESULT_OK;
 }
@@ -0,0 +1,71 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <immintrin.h>
+
+#include "volume-ops.h"
+
+void
+spa_volume_apply_s16_avx2 (void *dst, const void *src, const float *gains,
+                           uint32_t n_gains, uint32_t n_samples)
+{
+  int16_t *d = dst;
+  const int16_t *s = src;
+  uint32_t i, j, unrolled = n_samples & ~15;
+  const __m256 min = _mm256_set1_ps (INT16_MIN), max = _mm256_set1_ps (INT16_MAX);
+
+  for (i = 0, j = 0; i < unrolled; i += 16) {
+    __m256 in0 = _mm256_cvtepi32_ps (_mm256_cvtepi16_epi32 (_mm_loadu_si128 ((const __m128i *) &s[i])));
+    __m256 in1 = _mm256_cvtepi32_ps (_mm256_cvtepi16_epi32 (_mm_loadu_si128 ((const __m128i *) &s[i + 8])));
+    __m256i r;
+
+    in0 = _mm256_mul_ps (in0, _mm256_loadu_ps (&gains[j]));
+    in1 = _mm256_mul_ps (in1, _mm256_loadu_ps (&gains[j + 8]));
+    in0 = _mm256_min_ps (_mm256_max_ps (in0, min), max);
+    in1 = _mm256_min_ps (_mm256_max_ps (in1, min), max);
+    /* packs works per 128 bit lane, put the quadwords back in order */
+    r = _mm256_packs_epi32 (_mm256_cvtps_epi32 (in0), _mm256_cvtps_epi32 (in1));
+    _mm256_storeu_si256 ((__m256i *) &d[i], _mm256_permute4x64_epi64 (r, 0xd8));
+
+    if ((j += 16) == n_gains)
+      j = 0;
+  }
+  spa_volume_apply_s16_range (d, s, gains, n_gains, i, n_samples);
+}
+
+void
+spa_volume_apply_f32_avx2 (void *dst, const void *src, const float *gains,
+                           uint32_t n_gains, uint32_t n_samples)
+{
+  float *d = dst;
+  const float *s = src;
+  uint32_t i, j, unrolled = n_samples & ~15;
+
+  for (i = 0, j = 0; i < unrolled; i += 16) {
+    __m256 in0 = _mm256_loadu_ps (&s[i]);
+    __m256 in1 = _mm256_loadu_ps (&s[i + 8]);
+
+    _mm256_storeu_ps (&d[i], _mm256_mul_ps (in0, _mm256_loadu_ps (&gains[j])));
+    _mm256_storeu_ps (&d[i + 8], _mm256_mul_ps (in1, _mm256_loadu_ps (&gains[j + 8])));
+
+    if ((j += 16) == n_gains)
+      j = 0;
+  }
+  spa_volume_apply_f32_range (d, s, gains, n_gains, i, n_samples);
+}
@@ -0,0 +1,43 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <arm_neon.h>
+
+#include "volume-ops.h"
+
+void
+spa_volume_apply_f32_neon (void *dst, const void *src, const float *gains,
+                           uint32_t n_gains, uint32_t n_samples)
+{
+  float *d = dst;
+  const float *s = src;
+  uint32_t i, j, unrolled = n_samples & ~7;
+
+  for (i = 0, j = 0; i < unrolled; i += 8) {
+    float32x4_t in0 = vld1q_f32 (&s[i]);
+    float32x4_t in1 = vld1q_f32 (&s[i + 4]);
+
+    vst1q_f32 (&d[i], vmulq_f32 (in0, vld1q_f32 (&gains[j])));
+    vst1q_f32 (&d[i + 4], vmulq_f32 (in1, vld1q_f32 (&gains[j + 4])));
+
+    if ((j += 8) == n_gains)
+      j = 0;
+  }
+  spa_volume_apply_f32_range (d, s, gains, n_gains, i, n_samples);
+}
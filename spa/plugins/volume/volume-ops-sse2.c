@@ -0,0 +1,69 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <emmintrin.h>
+
+#include "volume-ops.h"
+
+void
+spa_volume_apply_s16_sse2 (void *dst, const void *src, const float *gains,
+                           uint32_t n_gains, uint32_t n_samples)
+{
+  int16_t *d = dst;
+  const int16_t *s = src;
+  uint32_t i, j, unrolled = n_samples & ~7;
+  const __m128 min = _mm_set1_ps (INT16_MIN), max = _mm_set1_ps (INT16_MAX);
+
+  for (i = 0, j = 0; i < unrolled; i += 8) {
+    __m128i in = _mm_loadu_si128 ((const __m128i *) &s[i]);
+    __m128 in0 = _mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpacklo_epi16 (in, in), 16));
+    __m128 in1 = _mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpackhi_epi16 (in, in), 16));
+
+    in0 = _mm_mul_ps (in0, _mm_loadu_ps (&gains[j]));
+    in1 = _mm_mul_ps (in1, _mm_loadu_ps (&gains[j + 4]));
+    in0 = _mm_min_ps (_mm_max_ps (in0, min), max);
+    in1 = _mm_min_ps (_mm_max_ps (in1, min), max);
+    _mm_storeu_si128 ((__m128i *) &d[i], _mm_packs_epi32 (_mm_cvtps_epi32 (in0), _mm_cvtps_epi32 (in1)));
+
+    if ((j += 8) == n_gains)
+      j = 0;
+  }
+  spa_volume_apply_s16_range (d, s, gains, n_gains, i, n_samples);
+}
+
+void
+spa_volume_apply_f32_sse2 (void *dst, const void *src, const float *gains,
+                           uint32_t n_gains, uint32_t n_samples)
+{
+  float *d = dst;
+  const float *s = src;
+  uint32_t i, j, unrolled = n_samples & ~7;
+
+  for (i = 0, j = 0; i < unrolled; i += 8) {
+    __m128 in0 = _mm_loadu_ps (&s[i]);
+    __m128 in1 = _mm_loadu_ps (&s[i + 4]);
+
+    _mm_storeu_ps (&d[i], _mm_mul_ps (in0, _mm_loadu_ps (&gains[j])));
+    _mm_storeu_ps (&d[i + 4], _mm_mul_ps (in1, _mm_loadu_ps (&gains[j + 4])));
+
+    if ((j += 8) == n_gains)
+      j = 0;
+  }
+  spa_volume_apply_f32_range (d, s, gains, n_gains, i, n_samples);
+}
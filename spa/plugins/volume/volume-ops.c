@@ -0,0 +1,134 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <lib/cpu.h>
+
+#include "volume-ops.h"
+
+void
+spa_volume_apply_s16_c (void *dst, const void *src, const float *gains,
+                        uint32_t n_gains, uint32_t n_samples)
+{
+  spa_volume_apply_s16_range (dst, src, gains, n_gains, 0, n_samples);
+}
+
+void
+spa_volume_apply_s32_c (void *dst, const void *src, const float *gains,
+                        uint32_t n_gains, uint32_t n_samples)
+{
+  int32_t *d = dst;
+  const int32_t *s = src;
+  uint32_t i;
+
+  /* float does not have enough precision for S32 */
+  for (i = 0; i < n_samples; i++) {
+    double t = s[i] * (double) gains[i % n_gains];
+    d[i] = llrint (SPA_CLAMP (t, (double) INT32_MIN, (double) INT32_MAX));
+  }
+}
+
+void
+spa_volume_apply_f32_c (void *dst, const void *src, const float *gains,
+                        uint32_t n_gains, uint32_t n_samples)
+{
+  spa_volume_apply_f32_range (dst, src, gains, n_gains, 0, n_samples);
+}
+
+void
+spa_volume_ramp_s16_c (void *dst, const void *src, float *gains, const float *steps,
+                       uint32_t n_channels, uint32_t n_frames)
+{
+  int16_t *d = dst;
+  const int16_t *s = src;
+  uint32_t i, c;
+
+  for (i = 0; i < n_frames; i++) {
+    for (c = 0; c < n_channels; c++) {
+      float t = *s++ * gains[c];
+      *d++ = lrintf (SPA_CLAMP (t, (float) INT16_MIN, (float) INT16_MAX));
+      gains[c] += steps[c];
+    }
+  }
+}
+
+void
+spa_volume_ramp_s32_c (void *dst, const void *src, float *gains, const float *steps,
+                       uint32_t n_channels, uint32_t n_frames)
+{
+  int32_t *d = dst;
+  const int32_t *s = src;
+  uint32_t i, c;
+
+  for (i = 0; i < n_frames; i++) {
+    for (c = 0; c < n_channels; c++) {
+      double t = *s++ * (double) gains[c];
+      *d++ = llrint (SPA_CLAMP (t, (double) INT32_MIN, (double) INT32_MAX));
+      gains[c] += steps[c];
+    }
+  }
+}
+
+void
+spa_volume_ramp_f32_c (void *dst, const void *src, float *gains, const float *steps,
+                       uint32_t n_channels, uint32_t n_frames)
+{
+  float *d = dst;
+  const float *s = src;
+  uint32_t i, c;
+
+  for (i = 0; i < n_frames; i++) {
+    for (c = 0; c < n_channels; c++) {
+      *d++ = *s++ * gains[c];
+      gains[c] += steps[c];
+    }
+  }
+}
+
+void
+spa_volume_ops_init (SpaVolumeOps *ops, uint32_t cpu_flags)
+{
+  ops->cpu_flags = 0;
+  ops->apply_s16 = spa_volume_apply_s16_c;
+  ops->apply_s32 = spa_volume_apply_s32_c;
+  ops->apply_f32 = spa_volume_apply_f32_c;
+  ops->ramp_s16 = spa_volume_ramp_s16_c;
+  ops->ramp_s32 = spa_volume_ramp_s32_c;
+  ops->ramp_f32 = spa_volume_ramp_f32_c;
+
+#if defined (HAVE_SSE2)
+  if (cpu_flags & SPA_CPU_FLAG_SSE2) {
+    ops->cpu_flags = SPA_CPU_FLAG_SSE2;
+    ops->apply_s16 = spa_volume_apply_s16_sse2;
+    ops->apply_f32 = spa_volume_apply_f32_sse2;
+  }
+#endif
+#if defined (HAVE_AVX2)
+  if (cpu_flags & SPA_CPU_FLAG_AVX2) {
+    ops->cpu_flags = SPA_CPU_FLAG_AVX2;
+    ops->apply_s16 = spa_volume_apply_s16_avx2;
+    ops->apply_f32 = spa_volume_apply_f32_avx2;
+  }
+#endif
+#if defined (HAVE_NEON)
+  if (cpu_flags & SPA_CPU_FLAG_NEON) {
+    ops->cpu_flags = SPA_CPU_FLAG_NEON;
+    ops->apply_f32 = spa_volume_apply_f32_neon;
+  }
+#endif
+}
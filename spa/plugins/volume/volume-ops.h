@@ -0,0 +1,129 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_VOLUME_OPS_H__
+#define __SPA_VOLUME_OPS_H__
+
+#include <math.h>
+
+#include <spa/defs.h>
+
+/* the number of gains passed to a #SpaVolumeApplyFunc must be a multiple
+ * of this so that the SIMD versions never have to wrap inside a vector */
+#define SPA_VOLUME_GAIN_ALIGN   16
+
+/**
+ * SpaVolumeApplyFunc:
+ * @dst: destination samples, can be the same as @src
+ * @src: source samples
+ * @gains: repeating gain pattern
+ * @n_gains: number of gains in @gains, a multiple of #SPA_VOLUME_GAIN_ALIGN
+ * @n_samples: number of samples
+ *
+ * Store src[i] * gains[i % n_gains] in dst[i], saturating integer formats.
+ */
+typedef void (*SpaVolumeApplyFunc) (void *dst, const void *src, const float *gains,
+                                    uint32_t n_gains, uint32_t n_samples);
+
+/**
+ * SpaVolumeRampFunc:
+ * @dst: destination samples, can be the same as @src
+ * @src: interleaved source samples
+ * @gains: current gain per channel, updated
+ * @steps: gain increment per channel and frame
+ * @n_channels: number of channels
+ * @n_frames: number of frames
+ *
+ * Apply a linear gain ramp to each channel.
+ */
+typedef void (*SpaVolumeRampFunc) (void *dst, const void *src, float *gains, const float *steps,
+                                   uint32_t n_channels, uint32_t n_frames);
+
+/**
+ * SpaVolumeOps:
+ * @cpu_flags: the #SpaCPUFlags the functions were selected for
+ *
+ * The volume kernels for each format, selected once for the CPU we run on.
+ */
+typedef struct {
+  uint32_t           cpu_flags;
+  SpaVolumeApplyFunc apply_s16;
+  SpaVolumeApplyFunc apply_s32;
+  SpaVolumeApplyFunc apply_f32;
+  SpaVolumeRampFunc  ramp_s16;
+  SpaVolumeRampFunc  ramp_s32;
+  SpaVolumeRampFunc  ramp_f32;
+} SpaVolumeOps;
+
+void spa_volume_ops_init (SpaVolumeOps *ops, uint32_t cpu_flags);
+
+/* plain C versions, also used by the SIMD kernels for the remaining
+ * samples from @start to @end */
+static inline void
+spa_volume_apply_s16_range (int16_t *d, const int16_t *s, const float *gains, uint32_t n_gains,
+                            uint32_t start, uint32_t end)
+{
+  uint32_t i;
+
+  for (i = start; i < end; i++) {
+    float t = s[i] * gains[i % n_gains];
+    d[i] = lrintf (SPA_CLAMP (t, (float) INT16_MIN, (float) INT16_MAX));
+  }
+}
+
+static inline void
+spa_volume_apply_f32_range (float *d, const float *s, const float *gains, uint32_t n_gains,
+                            uint32_t start, uint32_t end)
+{
+  uint32_t i;
+
+  for (i = start; i < end; i++)
+    d[i] = s[i] * gains[i % n_gains];
+}
+
+void spa_volume_apply_s16_c    (void *dst, const void *src, const float *gains,
+                                uint32_t n_gains, uint32_t n_samples);
+void spa_volume_apply_s32_c    (void *dst, const void *src, const float *gains,
+                                uint32_t n_gains, uint32_t n_samples);
+void spa_volume_apply_f32_c    (void *dst, const void *src, const float *gains,
+                                uint32_t n_gains, uint32_t n_samples);
+void spa_volume_ramp_s16_c     (void *dst, const void *src, float *gains, const float *steps,
+                                uint32_t n_channels, uint32_t n_frames);
+void spa_volume_ramp_s32_c     (void *dst, const void *src, float *gains, const float *steps,
+                                uint32_t n_channels, uint32_t n_frames);
+void spa_volume_ramp_f32_c     (void *dst, const void *src, float *gains, const float *steps,
+                                uint32_t n_channels, uint32_t n_frames);
+#if defined (HAVE_SSE2)
+void spa_volume_apply_s16_sse2 (void *dst, const void *src, const float *gains,
+                                uint32_t n_gains, uint32_t n_samples);
+void spa_volume_apply_f32_sse2 (void *dst, const void *src, const float *gains,
+                                uint32_t n_gains, uint32_t n_samples);
+#endif
+#if defined (HAVE_AVX2)
+void spa_volume_apply_s16_avx2 (void *dst, const void *src, const float *gains,
+                                uint32_t n_gains, uint32_t n_samples);
+void spa_volume_apply_f32_avx2 (void *dst, const void *src, const float *gains,
+                                uint32_t n_gains, uint32_t n_samples);
+#endif
+#if defined (HAVE_NEON)
+void spa_volume_apply_f32_neon (void *dst, const void *src, const float *gains,
+                                uint32_t n_gains, uint32_t n_samples);
+#endif
+
+#endif /* __SPA_VOLUME_OPS_H__ */
@@ -27,14 +27,23 @@
 #include <spa/audio/format-utils.h>
 #include <spa/format-builder.h>
 #include <lib/props.h>
+#include <lib/cpu.h>
+
+#include "volume-ops.h"
 
 #define MAX_BUFFERS     16
+#define MAX_CHANNELS    64
+
+/* length of the linear gain ramp after a volume or mute change */
+#define RAMP_MSEC       5
 
 typedef struct _SpaVolume SpaVolume;
 
 typedef struct {
   double volume;
   bool mute;
+  float channel_volume[MAX_CHANNELS];
+  uint32_t n_channel_volumes;
 } SpaVolumeProps;
 
 typedef struct {
@@ -66,6 +75,7 @@ typedef struct {
   uint32_t props;
   uint32_t prop_volume;
   uint32_t prop_mute;
+  uint32_t prop_channel_volume;
   SpaTypeMeta meta;
   SpaTypeData data;
   SpaTypeMediaType media_type;
@@ -86,6 +96,7 @@ init_type (Type *type, SpaTypeMap *map)
   type->props = spa_type_map_get_id (map, SPA_TYPE__Props);
   type->prop_volume = spa_type_map_get_id (map, SPA_TYPE_PROPS__volume);
   type->prop_mute = spa_type_map_get_id (map, SPA_TYPE_PROPS__mute);
+  type->prop_channel_volume = spa_type_map_get_id (map, SPA_TYPE_PROPS__channelVolume);
   spa_type_meta_map (map, &type->meta);
   spa_type_data_map (map, &type->data);
   spa_type_media_type_map (map, &type->media_type);
@@ -106,8 +117,9 @@ struct _SpaVolume {
   SpaTypeMap *map;
   SpaLog *log;
 
-  uint8_t props_buffer[512];
+  uint8_t props_buffer[1024];
   SpaVolumeProps props;
+  bool props_changed;
 
   SpaNodeCallbacks callbacks;
   void *user_data;
@@ -118,6 +130,23 @@ struct _SpaVolume {
   SpaVolumePort in_ports[1];
   SpaVolumePort out_ports[1];
 
+  SpaVolumeOps ops;
+  SpaVolumeApplyFunc apply;
+  SpaVolumeRampFunc ramp;
+  uint32_t sample_size;
+  uint32_t channels;
+  uint32_t ramp_frames;
+
+  /* gain state, only touched from the processing functions */
+  float gain[MAX_CHANNELS];
+  float target[MAX_CHANNELS];
+  float step[MAX_CHANNELS];
+  uint32_t ramp_left;
+  float gain_line[MAX_CHANNELS * SPA_VOLUME_GAIN_ALIGN];
+  uint32_t n_gain_line;
+  bool unity;
+  bool silent;
+
   bool started;
 };
 
@@ -133,6 +162,7 @@ reset_volume_props (SpaVolumeProps *props)
 {
   props->volume = DEFAULT_VOLUME;
   props->mute = DEFAULT_MUTE;
+  props->n_channel_volumes = 0;
 }
 
 #define PROP(f,key,type,...)                                                    \
@@ -154,16 +184,24 @@ spa_volume_node_get_props (SpaNode        *node,
   SpaVolume *this;
   SpaPODBuilder b = { NULL,  };
   SpaPODFrame f[2];
+  uint8_t buffer[MAX_CHANNELS * sizeof (float) + 64];
+  SpaPOD *channel_volume;
 
   spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
   spa_return_val_if_fail (props != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   this = SPA_CONTAINER_OF (node, SpaVolume, node);
 
+  spa_pod_builder_init (&b, buffer, sizeof (buffer));
+  spa_pod_builder_array (&b, sizeof (float), SPA_POD_TYPE_FLOAT,
+                         this->props.n_channel_volumes, this->props.channel_volume);
+  channel_volume = SPA_POD_BUILDER_DEREF (&b, 0, SpaPOD);
+
   spa_pod_builder_init (&b, this->props_buffer, sizeof (this->props_buffer));
   spa_pod_builder_props (&b, &f[0], this->type.props,
-      PROP_MM (&f[1], this->type.prop_volume, SPA_POD_TYPE_DOUBLE, this->props.volume, 0.0, 10.0),
-      PROP    (&f[1], this->type.prop_mute,   SPA_POD_TYPE_BOOL,   this->props.mute));
+      PROP_MM (&f[1], this->type.prop_volume,         SPA_POD_TYPE_DOUBLE, this->props.volume, 0.0, 10.0),
+      PROP    (&f[1], this->type.prop_mute,           SPA_POD_TYPE_BOOL,   this->props.mute),
+      PROP    (&f[1], this->type.prop_channel_volume, SPA_POD_TYPE_POD,    channel_volume));
 
   *props = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaProps);
 
@@ -183,11 +221,26 @@ spa_volume_node_set_props (SpaNode        *node,
   if (props == NULL) {
     reset_volume_props (&this->props);
   } else {
+    SpaPODArray *channel_volume = NULL;
+
     spa_props_query (props,
-        this->type.prop_volume, SPA_POD_TYPE_DOUBLE, &this->props.volume,
-        this->type.prop_mute,   SPA_POD_TYPE_BOOL,   &this->props.mute,
+        this->type.prop_volume,         SPA_POD_TYPE_DOUBLE, &this->props.volume,
+        this->type.prop_mute,           SPA_POD_TYPE_BOOL,   &this->props.mute,
+        this->type.prop_channel_volume, -SPA_POD_TYPE_ARRAY, &channel_volume,
         0);
+
+    if (channel_volume && channel_volume->body.child.type == SPA_POD_TYPE_FLOAT &&
+        channel_volume->body.child.size == sizeof (float)) {
+      uint32_t n = (SPA_POD_BODY_SIZE (channel_volume) - sizeof (SpaPODArrayBody)) / sizeof (float);
+
+      this->props.n_channel_volumes = SPA_MIN (n, MAX_CHANNELS);
+      memcpy (this->props.channel_volume, SPA_MEMBER (&channel_volume->body, sizeof (SpaPODArrayBody), float),
+              this->props.n_channel_volumes * sizeof (float));
+    }
   }
+  /* picked up and ramped to in the next process_input */
+  this->props_changed = true;
+
   return SPA_RESULT_OK;
 }
 
@@ -319,10 +372,11 @@ next:
     case 0:
       spa_pod_builder_format (&b, &f[0], this->type.format,
           this->type.media_type.audio, this->type.media_subtype.raw,
-          PROP_U_EN    (&f[1], this->type.format_audio.format,   SPA_POD_TYPE_ID, 3,
+          PROP_U_EN    (&f[1], this->type.format_audio.format,   SPA_POD_TYPE_ID, 4,
                                                                 this->type.audio_format.S16,
                                                                 this->type.audio_format.S16,
-                                                                this->type.audio_format.S32),
+                                                                this->type.audio_format.S32,
+                                                                this->type.audio_format.F32),
           PROP_U_MM    (&f[1], this->type.format_audio.rate,     SPA_POD_TYPE_INT, 44100, 1, INT32_MAX),
           PROP_U_MM    (&f[1], this->type.format_audio.channels, SPA_POD_TYPE_INT, 2, 1, INT32_MAX));
 
@@ -384,6 +438,31 @@ spa_volume_node_port_set_format (SpaNode         *node,
     if (!spa_format_audio_raw_parse (format, &info.info.raw, &this->type.format_audio))
       return SPA_RESULT_INVALID_MEDIA_TYPE;
 
+    if (info.info.raw.channels == 0 || info.info.raw.channels > MAX_CHANNELS)
+      return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+    if (info.info.raw.format == this->type.audio_format.S16) {
+      this->apply = this->ops.apply_s16;
+      this->ramp = this->ops.ramp_s16;
+      this->sample_size = sizeof (int16_t);
+    }
+    else if (info.info.raw.format == this->type.audio_format.S32) {
+      this->apply = this->ops.apply_s32;
+      this->ramp = this->ops.ramp_s32;
+      this->sample_size = sizeof (int32_t);
+    }
+    else if (info.info.raw.format == this->type.audio_format.F32) {
+      this->apply = this->ops.apply_f32;
+      this->ramp = this->ops.ramp_f32;
+      this->sample_size = sizeof (float);
+    }
+    else
+      return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+    this->channels = info.info.raw.channels;
+    this->ramp_frames = SPA_MAX (1u, info.info.raw.rate * RAMP_MSEC / 1000);
+    this->props_changed = true;
+
     this->current_format = info;
     port->have_format = true;
   }
@@ -631,45 +710,96 @@ release_buffer (SpaVolume *this, SpaBuffer *buffer)
 }
 
 static void
-do_volume (SpaVolume *this, SpaBuffer *dbuf, SpaBuffer *sbuf)
+update_gains (SpaVolume *this)
 {
-  uint32_t si, di, i, n_samples, n_bytes, soff, doff ;
-  SpaData *sd, *dd;
-  uint16_t *src, *dst;
-  double volume;
+  SpaVolumeProps *p = &this->props;
+  uint32_t c, i;
+  bool changed = false;
 
-  volume = this->props.volume;
+  this->props_changed = false;
 
-  si = di = 0;
-  soff = doff = 0;
-
-  while (true) {
-    if (si == sbuf->n_datas || di == dbuf->n_datas)
-      break;
+  for (c = 0; c < this->channels; c++) {
+    float target = p->mute ? 0.0f : p->volume * (c < p->n_channel_volumes ? p->channel_volume[c] : 1.0f);
 
-    sd = &sbuf->datas[si];
-    dd = &dbuf->datas[di];
+    if (target != this->target[c]) {
+      this->target[c] = target;
+      changed = true;
+    }
+  }
+  if (!changed)
+    return;
+
+  this->ramp_left = this->ramp_frames;
+  for (c = 0; c < this->channels; c++)
+    this->step[c] = (this->target[c] - this->gain[c]) / this->ramp_frames;
+
+  /* the steady state gains, repeated so that the SIMD kernels can load them
+   * as vectors without caring about the channel layout */
+  this->unity = this->silent = true;
+  this->n_gain_line = this->channels * SPA_VOLUME_GAIN_ALIGN;
+  for (i = 0; i < this->n_gain_line; i++) {
+    float g = this->target[i % this->channels];
+
+    this->gain_line[i] = g;
+    if (g != 1.0f)
+      this->unity = false;
+    if (g != 0.0f)
+      this->silent = false;
+  }
+}
 
-    src = (uint16_t*) ((uint8_t*)sd->data + sd->chunk->offset + soff);
-    dst = (uint16_t*) ((uint8_t*)dd->data + dd->chunk->offset + doff);
+static void
+do_volume (SpaVolume *this, SpaBuffer *dbuf, SpaBuffer *sbuf)
+{
+  uint32_t i, n_bytes, n_frames, n_ramp, frame_size;
+  SpaData *sd, *dd;
+  uint8_t *src, *dst;
+
+  if (this->props_changed)
+    update_gains (this);
+
+  frame_size = this->sample_size * this->channels;
+
+  for (i = 0; i < sbuf->n_datas && i < dbuf->n_datas; i++) {
+    sd = &sbuf->datas[i];
+    dd = &dbuf->datas[i];
+
+    src = SPA_MEMBER (sd->data, sd->chunk->offset, uint8_t);
+    if (sd->data == dd->data) {
+      dst = src;
+      n_bytes = sd->chunk->size;
+    } else {
+      dst = dd->data;
+      n_bytes = SPA_MIN (sd->chunk->size, dd->maxsize);
+      dd->chunk->offset = 0;
+      dd->chunk->size = n_bytes;
+      dd->chunk->stride = sd->chunk->stride;
+    }
+    n_frames = n_bytes / frame_size;
 
-    n_bytes = SPA_MIN (sd->chunk->size - soff, dd->chunk->size - doff);
-    n_samples = n_bytes / sizeof (uint16_t);
+    if (this->ramp_left > 0) {
+      n_ramp = SPA_MIN (n_frames, this->ramp_left);
 
-    for (i = 0; i < n_samples; i++)
-      *src++ = *dst++ * volume;
+      this->ramp (dst, src, this->gain, this->step, this->channels, n_ramp);
 
-    soff += n_bytes;
-    doff += n_bytes;
+      if ((this->ramp_left -= n_ramp) == 0)
+        memcpy (this->gain, this->target, this->channels * sizeof (float));
 
-    if (soff >= sd->chunk->size) {
-      si++;
-      soff = 0;
+      src += n_ramp * frame_size;
+      dst += n_ramp * frame_size;
+      n_frames -= n_ramp;
     }
-    if (doff >= dd->chunk->size) {
-      di++;
-      doff = 0;
+    if (n_frames == 0)
+      continue;
+
+    if (this->unity) {
+      if (dst != src)
+        memcpy (dst, src, n_frames * frame_size);
     }
+    else if (this->silent)
+      memset (dst, 0, n_frames * frame_size);
+    else
+      this->apply (dst, src, this->gain_line, this->n_gain_line, n_frames * this->channels);
   }
 }
 
@@ -716,7 +846,7 @@ spa_volume_node_process_input (SpaNode *node)
   input->buffer_id = SPA_ID_INVALID;
   input->status = SPA_RESULT_OK;
 
-  do_volume (this, sbuf, dbuf);
+  do_volume (this, dbuf, sbuf);
 
   output->buffer_id = dbuf->id;
   output->status = SPA_RESULT_OK;
@@ -815,9 +945,16 @@ volume_init (const SpaHandleFactory  *factory,
   }
   init_type (&this->type, this->map);
 
+  spa_volume_ops_init (&this->ops, spa_cpu_get_info_flags (info));
+  spa_log_info (this->log, "volume %p: using cpu flags 0x%08x", this, this->ops.cpu_flags);
+
   this->node = volume_node;
   reset_volume_props (&this->props);
 
+  for (i = 0; i < MAX_CHANNELS; i++)
+    this->gain[i] = this->target[i] = DEFAULT_VOLUME;
+  this->unity = true;
+
   this->in_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS |
                                  SPA_PORT_INFO_FLAG_IN_PLACE;
   spa_list_init (&this->in_ports[0].empty);
@@ -21,19 +21,23 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <pthread.h>
 
-#include <linux/videodev2.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <X11/extensions/Xvlib.h>
 
 #include <spa/type-map.h>
 #include <spa/log.h>
+#include <spa/loop.h>
 #include <spa/node.h>
 #include <spa/video/format-utils.h>
+#include <spa/format-builder.h>
 #include <lib/props.h>
 
 typedef struct _SpaXvSink SpaXvSink;
 
-static const char default_device[] = "/dev/video0";
-
 typedef struct {
   char device[64];
   char device_name[128];
@@ -43,56 +47,127 @@ typedef struct {
 static void
 reset_xv_sink_props (SpaXvSinkProps *props)
 {
-  strncpy (props->device, default_device, 64);
+  /* an empty device uses $DISPLAY */
+  props->device[0] = '\0';
 }
 
-#define MAX_BUFFERS     256
+#define MAX_BUFFERS     32
+#define MAX_FORMATS     8
 
 typedef struct _XvBuffer XvBuffer;
 
 struct _XvBuffer {
-  SpaBuffer buffer;
-  SpaMeta meta[1];
-  SpaMetaHeader header;
-  SpaData data[1];
-  XvBuffer *next;
-  uint32_t index;
-  SpaXvSink *sink;
+  SpaBuffer *outbuf;
+  SpaMetaVideoCrop *crop;
   bool outstanding;
+  /* the buffer memory is the shared memory of the image */
+  bool shared;
+  XvImage *image;
+  XShmSegmentInfo shminfo;
 };
 
+/**
+ * SpaXvSinkStats:
+ * @frames: number of frames shown
+ * @dropped: frames that arrived while the server was still busy with the
+ *           previous one
+ * @min_frame_time: shortest frame time, in nanoseconds
+ * @max_frame_time: longest frame time, in nanoseconds
+ * @total_frame_time: the frame times of all frames, in nanoseconds
+ *
+ * The frame time is the time between handing an image to the server and
+ * the server telling us it is done with it.
+ */
+typedef struct {
+  int64_t  frames;
+  uint32_t dropped;
+  int64_t  min_frame_time;
+  int64_t  max_frame_time;
+  int64_t  total_frame_time;
+} SpaXvSinkStats;
+
 typedef struct {
   bool opened;
-  int fd;
+  /* the display is private to this node, the main thread and the data
+   * loop both use it and take the lock around every Xlib call */
+  pthread_mutex_t lock;
+  Display *display;
+  XvPortID port;
+  int completion_type;
+  int formats[MAX_FORMATS];
+  uint32_t n_formats;
+  SpaRectangle max_size;
+
+  Window window;
+  GC gc;
+  uint32_t window_width;
+  uint32_t window_height;
+
+  int fourcc;
+  uint32_t image_size;
+  int n_planes;
+  int pitches[3];
+  int offsets[3];
+
+  SpaLoop *data_loop;
+  SpaSource source;
+  bool source_enabled;
+
   XvBuffer buffers[MAX_BUFFERS];
-  XvBuffer *ready;
-  uint32_t ready_count;
+  uint32_t n_buffers;
+  /* the buffer the server is reading from */
+  XvBuffer *pending;
+  int64_t put_time;
+
+  SpaXvSinkStats stats;
 } SpaXvState;
 
 typedef struct {
   uint32_t node;
+  uint32_t format;
   uint32_t props;
   uint32_t prop_device;
   uint32_t prop_device_name;
   uint32_t prop_device_fd;
+  uint32_t prop_cycles;
+  uint32_t prop_dropped_frames;
+  uint32_t prop_min_cycle_time;
+  uint32_t prop_max_cycle_time;
+  uint32_t prop_avg_cycle_time;
+  SpaTypeMeta meta;
+  SpaTypeData data;
   SpaTypeMediaType media_type;
   SpaTypeMediaSubtype media_subtype;
   SpaTypeFormatVideo format_video;
+  SpaTypeVideoFormat video_format;
   SpaTypeCommandNode command_node;
+  SpaTypeAllocParamBuffers alloc_param_buffers;
+  SpaTypeAllocParamMetaEnable alloc_param_meta_enable;
 } Type;
 
 static inline void
 init_type (Type *type, SpaTypeMap *map)
 {
   type->node = spa_type_map_get_id (map, SPA_TYPE__Node);
+  type->format = spa_type_map_get_id (map, SPA_TYPE__Format);
   type->props = spa_type_map_get_id (map, SPA_TYPE__Props);
   type->prop_device = spa_type_map_get_id (map, SPA_TYPE_PROPS__device);
   type->prop_device_name = spa_type_map_get_id (map, SPA_TYPE_PROPS__deviceName);
   type->prop_device_fd = spa_type_map_get_id (map, SPA_TYPE_PROPS__deviceFd);
+  type->prop_cycles = spa_type_map_get_id (map, SPA_TYPE_PROPS__cycles);
+  type->prop_dropped_frames = spa_type_map_get_id (map, SPA_TYPE_PROPS__droppedFrames);
+  type->prop_min_cycle_time = spa_type_map_get_id (map, SPA_TYPE_PROPS__minCycleTime);
+  type->prop_max_cycle_time = spa_type_map_get_id (map, SPA_TYPE_PROPS__maxCycleTime);
+  type->prop_avg_cycle_time = spa_type_map_get_id (map, SPA_TYPE_PROPS__avgCycleTime);
+  spa_type_meta_map (map, &type->meta);
+  spa_type_data_map (map, &type->data);
   spa_type_media_type_map (map, &type->media_type);
   spa_type_media_subtype_map (map, &type->media_subtype);
   spa_type_format_video_map (map, &type->format_video);
+  spa_type_video_format_map (map, &type->video_format);
   spa_type_command_node_map (map, &type->command_node);
+  spa_type_alloc_param_buffers_map (map, &type->alloc_param_buffers);
+  spa_type_alloc_param_meta_enable_map (map, &type->alloc_param_meta_enable);
 }
 
 struct _SpaXvSink {
@@ -114,12 +189,16 @@ struct _SpaXvSink {
   SpaVideoInfo current_format;
 
   SpaPortInfo info;
+  SpaAllocParam *params[3];
+  uint8_t params_buffer[1024];
   SpaXvState state;
 
   SpaPortIO *io;
 };
 
-#define CHECK_PORT(this,d,p)  ((d) == SPA_DIRECTION_OUTPUT && (p) == 0)
+#define CHECK_PORT(this,d,p)  ((d) == SPA_DIRECTION_INPUT && (p) == 0)
+
+static void xv_on_fd_events (SpaSource *source);
 
 #include "xv-utils.c"
 
@@ -127,25 +206,37 @@ struct _SpaXvSink {
           SPA_POD_PROP (f,key,0,type,1,__VA_ARGS__)
 #define PROP_R(f,key,type,...)                                                  \
           SPA_POD_PROP (f,key,SPA_POD_PROP_FLAG_READONLY,type,1,__VA_ARGS__)
+#define PROP_U_MM(f,key,type,...)                                               \
+          SPA_POD_PROP (f,key,SPA_POD_PROP_FLAG_UNSET |                         \
+                              SPA_POD_PROP_RANGE_MIN_MAX,type,3,__VA_ARGS__)
 
 static SpaResult
 spa_xv_sink_node_get_props (SpaNode       *node,
                             SpaProps     **props)
 {
   SpaXvSink *this;
+  SpaXvSinkStats *stats;
   SpaPODBuilder b = { NULL,  };
   SpaPODFrame f[2];
+  int64_t avg_frame_time;
 
-  if (node == NULL || props == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (props != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   this = SPA_CONTAINER_OF (node, SpaXvSink, node);
+  stats = &this->state.stats;
+  avg_frame_time = stats->frames > 0 ? stats->total_frame_time / stats->frames : 0;
 
   spa_pod_builder_init (&b, this->props_buffer, sizeof (this->props_buffer));
   spa_pod_builder_props (&b, &f[0], this->type.props,
-      PROP   (&f[1], this->type.prop_device,      -SPA_POD_TYPE_STRING, this->props.device, sizeof (this->props.device)),
-      PROP_R (&f[1], this->type.prop_device_name, -SPA_POD_TYPE_STRING, this->props.device_name, sizeof (this->props.device_name)),
-      PROP_R (&f[1], this->type.prop_device_fd,    SPA_POD_TYPE_INT,    this->props.device_fd));
+      PROP   (&f[1], this->type.prop_device,         -SPA_POD_TYPE_STRING, this->props.device, sizeof (this->props.device)),
+      PROP_R (&f[1], this->type.prop_device_name,    -SPA_POD_TYPE_STRING, this->props.device_name, sizeof (this->props.device_name)),
+      PROP_R (&f[1], this->type.prop_device_fd,       SPA_POD_TYPE_INT,    this->props.device_fd),
+      PROP_R (&f[1], this->type.prop_cycles,          SPA_POD_TYPE_LONG,   stats->frames),
+      PROP_R (&f[1], this->type.prop_dropped_frames,  SPA_POD_TYPE_INT,    stats->dropped),
+      PROP_R (&f[1], this->type.prop_min_cycle_time,  SPA_POD_TYPE_LONG,   stats->min_frame_time),
+      PROP_R (&f[1], this->type.prop_max_cycle_time,  SPA_POD_TYPE_LONG,   stats->max_frame_time),
+      PROP_R (&f[1], this->type.prop_avg_cycle_time,  SPA_POD_TYPE_LONG,   avg_frame_time));
   *props = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaProps);
 
   return SPA_RESULT_OK;
@@ -157,8 +248,7 @@ spa_xv_sink_node_set_props (SpaNode         *node,
 {
   SpaXvSink *this;
 
-  if (node == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   this = SPA_CONTAINER_OF (node, SpaXvSink, node);
 
@@ -178,13 +268,19 @@ spa_xv_sink_node_send_command (SpaNode    *node,
 {
   SpaXvSink *this;
 
-  if (node == NULL || command == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (command != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   this = SPA_CONTAINER_OF (node, SpaXvSink, node);
 
   if (SPA_COMMAND_TYPE (command) == this->type.command_node.Start) {
-    spa_xv_start (this);
+    if (!this->have_format)
+      return SPA_RESULT_NO_FORMAT;
+    if (this->state.n_buffers == 0)
+      return SPA_RESULT_NO_BUFFERS;
+
+    if (spa_xv_start (this) < 0)
+      return SPA_RESULT_ERROR;
   }
   else if (SPA_COMMAND_TYPE (command) == this->type.command_node.Pause) {
     spa_xv_stop (this);
@@ -203,8 +299,7 @@ spa_xv_sink_node_set_callbacks (SpaNode                *node,
 {
   SpaXvSink *this;
 
-  if (node == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   this = SPA_CONTAINER_OF (node, SpaXvSink, node);
 
@@ -221,17 +316,16 @@ spa_xv_sink_node_get_n_ports (SpaNode       *node,
                               uint32_t      *n_output_ports,
                               uint32_t      *max_output_ports)
 {
-  if (node == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   if (n_input_ports)
-    *n_input_ports = 0;
+    *n_input_ports = 1;
   if (n_output_ports)
-    *n_output_ports = 1;
+    *n_output_ports = 0;
   if (max_input_ports)
-    *max_input_ports = 0;
+    *max_input_ports = 1;
   if (max_output_ports)
-    *max_output_ports = 1;
+    *max_output_ports = 0;
 
   return SPA_RESULT_OK;
 }
@@ -243,11 +337,10 @@ spa_xv_sink_node_get_port_ids (SpaNode       *node,
                                uint32_t       n_output_ports,
                                uint32_t      *output_ids)
 {
-  if (node == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
-  if (n_output_ports > 0 && output_ids != NULL)
-    output_ids[0] = 0;
+  if (n_input_ports > 0 && input_ids != NULL)
+    input_ids[0] = 0;
 
   return SPA_RESULT_OK;
 }
@@ -277,27 +370,77 @@ spa_xv_sink_node_port_enum_formats (SpaNode         *node,
                                     const SpaFormat *filter,
                                     uint32_t         index)
 {
-  //SpaXvSink *this;
+  SpaXvSink *this;
+  SpaXvState *state;
+  SpaResult res;
+  SpaFormat *fmt;
+  uint8_t buffer[256];
+  SpaPODBuilder b = { NULL, };
+  SpaPODFrame f[2];
+  uint32_t count, match;
 
-  if (node == NULL || format == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (format != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
-  //this = SPA_CONTAINER_OF (node, SpaXvSink, node);
+  this = SPA_CONTAINER_OF (node, SpaXvSink, node);
+  state = &this->state;
 
-  if (!CHECK_PORT (this, direction, port_id))
-    return SPA_RESULT_INVALID_PORT;
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
 
-  switch (index) {
-    case 0:
-      break;
-    default:
-      return SPA_RESULT_ENUM_END;
-  }
-  *format = NULL;
+  /* the formats depend on the adaptor of the display */
+  if (spa_xv_open (this) < 0)
+    return SPA_RESULT_ERROR;
+
+  count = match = filter ? 0 : index;
+
+next:
+  if (count >= state->n_formats)
+    return SPA_RESULT_ENUM_END;
+
+  spa_pod_builder_init (&b, buffer, sizeof (buffer));
+  spa_pod_builder_format (&b, &f[0], this->type.format,
+     this->type.media_type.video, this->type.media_subtype.raw,
+     PROP      (&f[1], this->type.format_video.format,    SPA_POD_TYPE_ID,
+                                                         fourcc_to_video_format (this, state->formats[count])),
+     PROP_U_MM (&f[1], this->type.format_video.size,      SPA_POD_TYPE_RECTANGLE,
+                                                         SPA_MIN (320, state->max_size.width),
+                                                         SPA_MIN (240, state->max_size.height),
+                                                         1, 1,
+                                                         state->max_size.width, state->max_size.height),
+     PROP_U_MM (&f[1], this->type.format_video.framerate, SPA_POD_TYPE_FRACTION,
+                                                         25, 1,
+                                                         0, 1,
+                                                         INT32_MAX, 1));
+  fmt = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaFormat);
+  count++;
+
+  spa_pod_builder_init (&b, this->format_buffer, sizeof (this->format_buffer));
+
+  if ((res = spa_format_filter (fmt, filter, &b)) != SPA_RESULT_OK || match++ != index)
+    goto next;
+
+  *format = SPA_POD_BUILDER_DEREF (&b, 0, SpaFormat);
 
   return SPA_RESULT_OK;
 }
 
+static void
+clear_buffers (SpaXvSink *this)
+{
+  SpaXvState *state = &this->state;
+  uint32_t i;
+
+  if (state->n_buffers == 0)
+    return;
+
+  spa_log_info (this->log, "xv-sink %p: clear buffers", this);
+  spa_xv_stop (this);
+
+  for (i = 0; i < state->n_buffers; i++)
+    spa_xv_free_image (this, &state->buffers[i]);
+  state->n_buffers = 0;
+}
+
 static SpaResult
 spa_xv_sink_node_port_set_format (SpaNode         *node,
                                   SpaDirection     direction,
@@ -306,30 +449,34 @@ spa_xv_sink_node_port_set_format (SpaNode         *node,
                                   const SpaFormat *format)
 {
   SpaXvSink *this;
+  SpaXvState *state;
 
-  if (node == NULL || format == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   this = SPA_CONTAINER_OF (node, SpaXvSink, node);
+  state = &this->state;
 
-  if (!CHECK_PORT (this, direction, port_id))
-    return SPA_RESULT_INVALID_PORT;
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
 
   if (format == NULL) {
+    clear_buffers (this);
+    spa_xv_destroy_window (this);
     this->have_format = false;
     return SPA_RESULT_OK;
   } else {
     SpaVideoInfo info = { SPA_FORMAT_MEDIA_TYPE (format),
                           SPA_FORMAT_MEDIA_SUBTYPE (format), };
 
-
-    if (info.media_type != this->type.media_type.video &&
+    if (info.media_type != this->type.media_type.video ||
         info.media_subtype != this->type.media_subtype.raw)
       return SPA_RESULT_INVALID_MEDIA_TYPE;
 
     if (!spa_format_video_raw_parse (format, &info.info.raw, &this->type.format_video))
       return SPA_RESULT_INVALID_MEDIA_TYPE;
 
+    if (!(flags & SPA_PORT_FORMAT_FLAG_TEST_ONLY))
+      clear_buffers (this);
+
     if (spa_xv_set_format (this, &info, flags & SPA_PORT_FORMAT_FLAG_TEST_ONLY) < 0)
       return SPA_RESULT_INVALID_MEDIA_TYPE;
 
@@ -339,6 +486,40 @@ spa_xv_sink_node_port_set_format (SpaNode         *node,
     }
   }
 
+  if (this->have_format) {
+    SpaPODBuilder b = { NULL };
+    SpaPODFrame f[2];
+
+    /* we can give out buffers in the shared memory of the images, the
+     * producer then draws straight into the memory the server reads */
+    this->info.flags = SPA_PORT_INFO_FLAG_CAN_ALLOC_BUFFERS |
+                       SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
+    this->info.maxbuffering = -1;
+    this->info.latency = 0;
+    this->info.n_params = 3;
+    this->info.params = this->params;
+
+    spa_pod_builder_init (&b, this->params_buffer, sizeof (this->params_buffer));
+    spa_pod_builder_object (&b, &f[0], 0, this->type.alloc_param_buffers.Buffers,
+      PROP      (&f[1], this->type.alloc_param_buffers.size,    SPA_POD_TYPE_INT, state->image_size),
+      PROP      (&f[1], this->type.alloc_param_buffers.stride,  SPA_POD_TYPE_INT, state->pitches[0]),
+      PROP_U_MM (&f[1], this->type.alloc_param_buffers.buffers, SPA_POD_TYPE_INT, 4, 2, MAX_BUFFERS),
+      PROP      (&f[1], this->type.alloc_param_buffers.align,   SPA_POD_TYPE_INT, 16));
+    this->params[0] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
+
+    spa_pod_builder_object (&b, &f[0], 0, this->type.alloc_param_meta_enable.MetaEnable,
+      PROP      (&f[1], this->type.alloc_param_meta_enable.type, SPA_POD_TYPE_ID, this->type.meta.Header),
+      PROP      (&f[1], this->type.alloc_param_meta_enable.size, SPA_POD_TYPE_INT, sizeof (SpaMetaHeader)));
+    this->params[1] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
+
+    spa_pod_builder_object (&b, &f[0], 0, this->type.alloc_param_meta_enable.MetaEnable,
+      PROP      (&f[1], this->type.alloc_param_meta_enable.type, SPA_POD_TYPE_ID, this->type.meta.VideoCrop),
+      PROP      (&f[1], this->type.alloc_param_meta_enable.size, SPA_POD_TYPE_INT, sizeof (SpaMetaVideoCrop)));
+    this->params[2] = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaAllocParam);
+
+    this->info.extra = NULL;
+  }
+
   return SPA_RESULT_OK;
 }
 
@@ -349,19 +530,26 @@ spa_xv_sink_node_port_get_format (SpaNode          *node,
                                   const SpaFormat **format)
 {
   SpaXvSink *this;
+  SpaPODBuilder b = { NULL, };
+  SpaPODFrame f[2];
 
-  if (node == NULL || format == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (format != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   this = SPA_CONTAINER_OF (node, SpaXvSink, node);
 
-  if (!CHECK_PORT (this, direction, port_id))
-    return SPA_RESULT_INVALID_PORT;
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
 
   if (!this->have_format)
     return SPA_RESULT_NO_FORMAT;
 
-  *format = NULL;
+  spa_pod_builder_init (&b, this->format_buffer, sizeof (this->format_buffer));
+  spa_pod_builder_format (&b, &f[0], this->type.format,
+     this->type.media_type.video, this->type.media_subtype.raw,
+     PROP (&f[1], this->type.format_video.format,     SPA_POD_TYPE_ID,        this->current_format.info.raw.format),
+     PROP (&f[1], this->type.format_video.size,      -SPA_POD_TYPE_RECTANGLE, &this->current_format.info.raw.size),
+     PROP (&f[1], this->type.format_video.framerate, -SPA_POD_TYPE_FRACTION,  &this->current_format.info.raw.framerate));
+  *format = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaFormat);
 
   return SPA_RESULT_OK;
 }
@@ -374,13 +562,12 @@ spa_xv_sink_node_port_get_info (SpaNode            *node,
 {
   SpaXvSink *this;
 
-  if (node == NULL || info == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (info != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   this = SPA_CONTAINER_OF (node, SpaXvSink, node);
 
-  if (!CHECK_PORT (this, direction, port_id))
-    return SPA_RESULT_INVALID_PORT;
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
 
   *info = &this->info;
 
@@ -405,6 +592,8 @@ spa_xv_sink_node_port_set_props (SpaNode         *node,
   return SPA_RESULT_NOT_IMPLEMENTED;
 }
 
+/* images for buffers in foreign memory, each frame is copied once into
+ * the shared memory of the image */
 static SpaResult
 spa_xv_sink_node_port_use_buffers (SpaNode         *node,
                                    SpaDirection     direction,
@@ -412,7 +601,53 @@ spa_xv_sink_node_port_use_buffers (SpaNode         *node,
                                    SpaBuffer      **buffers,
                                    uint32_t         n_buffers)
 {
-  return SPA_RESULT_NOT_IMPLEMENTED;
+  SpaXvSink *this;
+  SpaXvState *state;
+  uint32_t i;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaXvSink, node);
+  state = &this->state;
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  if (!this->have_format)
+    return SPA_RESULT_NO_FORMAT;
+
+  if (n_buffers > MAX_BUFFERS)
+    return SPA_RESULT_ERROR;
+
+  clear_buffers (this);
+
+  for (i = 0; i < n_buffers; i++) {
+    XvBuffer *b = &state->buffers[i];
+    SpaData *d = buffers[i]->datas;
+
+    if ((d[0].type != this->type.data.MemPtr &&
+         d[0].type != this->type.data.MemFd &&
+         d[0].type != this->type.data.DmaBuf) ||
+        d[0].data == NULL) {
+      spa_log_error (this->log, "xv-sink %p: invalid memory on buffer %p", this, buffers[i]);
+      goto error;
+    }
+
+    b->outbuf = buffers[i];
+    b->crop = spa_buffer_find_meta (buffers[i], this->type.meta.VideoCrop);
+    b->outstanding = true;
+    b->shared = false;
+
+    if (spa_xv_alloc_image (this, b) < 0)
+      goto error;
+
+    state->n_buffers++;
+  }
+
+  return SPA_RESULT_OK;
+
+error:
+  clear_buffers (this);
+  return SPA_RESULT_ERROR;
 }
 
 static SpaResult
@@ -424,7 +659,61 @@ spa_xv_sink_node_port_alloc_buffers (SpaNode         *node,
                                      SpaBuffer      **buffers,
                                      uint32_t        *n_buffers)
 {
-  return SPA_RESULT_NOT_IMPLEMENTED;
+  SpaXvSink *this;
+  SpaXvState *state;
+  uint32_t i;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (buffers != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (n_buffers != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaXvSink, node);
+  state = &this->state;
+
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
+
+  if (!this->have_format)
+    return SPA_RESULT_NO_FORMAT;
+
+  clear_buffers (this);
+
+  *n_buffers = SPA_MIN (*n_buffers, MAX_BUFFERS);
+
+  for (i = 0; i < *n_buffers; i++) {
+    XvBuffer *b = &state->buffers[i];
+    SpaData *d = buffers[i]->datas;
+
+    if (buffers[i]->n_datas < 1) {
+      spa_log_error (this->log, "xv-sink %p: invalid buffer data", this);
+      goto error;
+    }
+
+    b->outbuf = buffers[i];
+    b->crop = spa_buffer_find_meta (buffers[i], this->type.meta.VideoCrop);
+    b->outstanding = true;
+    b->shared = true;
+
+    if (spa_xv_alloc_image (this, b) < 0)
+      goto error;
+
+    d[0].type = this->type.data.MemPtr;
+    d[0].flags = 0;
+    d[0].fd = -1;
+    d[0].mapoffset = 0;
+    d[0].maxsize = b->image->data_size;
+    d[0].data = b->image->data;
+    d[0].chunk->offset = 0;
+    d[0].chunk->size = b->image->data_size;
+    d[0].chunk->stride = state->pitches[0];
+
+    state->n_buffers++;
+  }
+
+  return SPA_RESULT_OK;
+
+error:
+  clear_buffers (this);
+  return SPA_RESULT_ERROR;
 }
 
 static SpaResult
@@ -435,13 +724,11 @@ spa_xv_sink_node_port_set_io (SpaNode      *node,
 {
   SpaXvSink *this;
 
-  if (node == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   this = SPA_CONTAINER_OF (node, SpaXvSink, node);
 
-  if (!CHECK_PORT (this, direction, port_id))
-    return SPA_RESULT_INVALID_PORT;
+  spa_return_val_if_fail (CHECK_PORT (this, direction, port_id), SPA_RESULT_INVALID_PORT);
 
   this->io = io;
 
@@ -468,7 +755,51 @@ spa_xv_sink_node_port_send_command (SpaNode        *node,
 static SpaResult
 spa_xv_sink_node_process_input (SpaNode          *node)
 {
-  return SPA_RESULT_NOT_IMPLEMENTED;
+  SpaXvSink *this;
+  SpaXvState *state;
+  SpaPortIO *input;
+  XvBuffer *b;
+
+  spa_return_val_if_fail (node != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = SPA_CONTAINER_OF (node, SpaXvSink, node);
+  state = &this->state;
+  input = this->io;
+  spa_return_val_if_fail (input != NULL, SPA_RESULT_WRONG_STATE);
+
+  if (input->status != SPA_RESULT_HAVE_BUFFER ||
+      input->buffer_id == SPA_ID_INVALID)
+    return SPA_RESULT_OK;
+
+  if (input->buffer_id >= state->n_buffers) {
+    input->status = SPA_RESULT_INVALID_BUFFER_ID;
+    return SPA_RESULT_INVALID_BUFFER_ID;
+  }
+
+  b = &state->buffers[input->buffer_id];
+  if (!b->outstanding) {
+    spa_log_warn (this->log, "xv-sink %p: buffer %u in use", this, input->buffer_id);
+    input->status = SPA_RESULT_INVALID_BUFFER_ID;
+    return SPA_RESULT_INVALID_BUFFER_ID;
+  }
+  b->outstanding = false;
+  input->buffer_id = SPA_ID_INVALID;
+  input->status = SPA_RESULT_OK;
+
+  /* the server has not shown the previous frame yet, we don't queue up
+   * frames in the server and drop this one */
+  if (state->pending || state->window == 0) {
+    state->stats.dropped++;
+    spa_log_trace (this->log, "xv-sink %p: drop buffer %u, %u dropped", this,
+        b->outbuf->id, state->stats.dropped);
+    spa_xv_release_buffer (this, b);
+    return SPA_RESULT_OK;
+  }
+
+  spa_log_trace (this->log, "xv-sink %p: show buffer %u", this, b->outbuf->id);
+  spa_xv_show (this, b);
+
+  return SPA_RESULT_OK;
 }
 
 static SpaResult
@@ -510,8 +841,8 @@ spa_xv_sink_get_interface (SpaHandle               *handle,
 {
   SpaXvSink *this;
 
-  if (handle == NULL || interface == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (interface != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   this = (SpaXvSink *) handle;
 
@@ -526,6 +857,16 @@ spa_xv_sink_get_interface (SpaHandle               *handle,
 static SpaResult
 xv_sink_clear (SpaHandle *handle)
 {
+  SpaXvSink *this;
+
+  spa_return_val_if_fail (handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+  this = (SpaXvSink *) handle;
+
+  clear_buffers (this);
+  spa_xv_close (this);
+  pthread_mutex_destroy (&this->state.lock);
+
   return SPA_RESULT_OK;
 }
 
@@ -539,8 +880,8 @@ xv_sink_init (const SpaHandleFactory  *factory,
   SpaXvSink *this;
   uint32_t i;
 
-  if (factory == NULL || handle == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (factory != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   handle->get_interface = spa_xv_sink_get_interface;
   handle->clear = xv_sink_clear;
@@ -552,13 +893,21 @@ xv_sink_init (const SpaHandleFactory  *factory,
       this->map = support[i].data;
     else if (strcmp (support[i].type, SPA_TYPE__Log) == 0)
       this->log = support[i].data;
+    else if (strcmp (support[i].type, SPA_TYPE_LOOP__DataLoop) == 0)
+      this->state.data_loop = support[i].data;
   }
   if (this->map == NULL) {
     spa_log_error (this->log, "a type-map is needed");
     return SPA_RESULT_ERROR;
   }
+  if (this->state.data_loop == NULL) {
+    spa_log_error (this->log, "a data_loop is needed");
+    return SPA_RESULT_ERROR;
+  }
   init_type (&this->type, this->map);
 
+  pthread_mutex_init (&this->state.lock, NULL);
+
   this->node = xvsink_node;
   reset_xv_sink_props (&this->props);
 
@@ -577,8 +926,8 @@ xv_sink_enum_interface_info (const SpaHandleFactory  *factory,
                              const SpaInterfaceInfo **info,
                              uint32_t                 index)
 {
-  if (factory == NULL || info == NULL)
-    return SPA_RESULT_INVALID_ARGUMENTS;
+  spa_return_val_if_fail (factory != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+  spa_return_val_if_fail (info != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
   switch (index) {
     case 0:
@@ -1,34 +1,246 @@
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
-#include <sched.h>
 #include <errno.h>
-#include <sys/ioctl.h>
-#include <sys/mman.h>
-#include <poll.h>
+#include <time.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 
 #define CLEAR(x) memset(&(x), 0, sizeof(x))
 
+static const struct {
+  int fourcc;
+  off_t format_offset;
+} format_map[] = {
+  { 0x30323449, offsetof (SpaTypeVideoFormat, I420) },   /* I420 */
+  { 0x32315659, offsetof (SpaTypeVideoFormat, YV12) },   /* YV12 */
+  { 0x32595559, offsetof (SpaTypeVideoFormat, YUY2) },   /* YUY2 */
+  { 0x59565955, offsetof (SpaTypeVideoFormat, UYVY) },   /* UYVY */
+};
+
+static uint32_t
+fourcc_to_video_format (SpaXvSink *this, int fourcc)
+{
+  uint32_t i;
+
+  for (i = 0; i < SPA_N_ELEMENTS (format_map); i++) {
+    if (format_map[i].fourcc == fourcc)
+      return *SPA_MEMBER (&this->type.video_format, format_map[i].format_offset, uint32_t);
+  }
+  return 0;
+}
+
+static int
+video_format_to_fourcc (SpaXvSink *this, uint32_t format)
+{
+  uint32_t i;
+
+  for (i = 0; i < this->state.n_formats; i++) {
+    if (fourcc_to_video_format (this, this->state.formats[i]) == format)
+      return this->state.formats[i];
+  }
+  return 0;
+}
+
+static int64_t
+get_time_ns (void)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return SPA_TIMESPEC_TO_TIME (&now);
+}
+
+/* find the first port of an image adaptor that we can grab and that
+ * accepts at least one of our formats */
+static int
+spa_xv_find_port (SpaXvSink *this)
+{
+  SpaXvState *state = &this->state;
+  XvAdaptorInfo *adaptors;
+  unsigned int n_adaptors, i;
+  XvPortID p;
+
+  if (XvQueryAdaptors (state->display, DefaultRootWindow (state->display),
+                       &n_adaptors, &adaptors) != Success) {
+    spa_log_error (this->log, "xv-sink %p: can't query adaptors", this);
+    return -1;
+  }
+
+  for (i = 0; i < n_adaptors && state->port == 0; i++) {
+    if ((adaptors[i].type & (XvInputMask | XvImageMask)) != (XvInputMask | XvImageMask))
+      continue;
+
+    for (p = adaptors[i].base_id; p < adaptors[i].base_id + adaptors[i].num_ports; p++) {
+      XvImageFormatValues *formats;
+      int n_formats, j;
+
+      if (XvGrabPort (state->display, p, CurrentTime) != Success)
+        continue;
+
+      state->n_formats = 0;
+      formats = XvListImageFormats (state->display, p, &n_formats);
+      for (j = 0; j < n_formats && state->n_formats < MAX_FORMATS; j++) {
+        if (fourcc_to_video_format (this, formats[j].id) != 0)
+          state->formats[state->n_formats++] = formats[j].id;
+      }
+      if (formats)
+        XFree (formats);
+
+      if (state->n_formats == 0) {
+        XvUngrabPort (state->display, p, CurrentTime);
+        continue;
+      }
+      state->port = p;
+      strncpy (this->props.device_name, adaptors[i].name, sizeof (this->props.device_name) - 1);
+      break;
+    }
+  }
+  XvFreeAdaptorInfo (adaptors);
+
+  if (state->port == 0) {
+    spa_log_error (this->log, "xv-sink %p: no usable Xv port", this);
+    return -1;
+  }
+  return 0;
+}
+
+/* the largest image the port can show */
+static void
+spa_xv_query_max_size (SpaXvSink *this)
+{
+  SpaXvState *state = &this->state;
+  XvEncodingInfo *encodings;
+  unsigned int n_encodings, i;
+
+  state->max_size.width = state->max_size.height = 0;
+
+  if (XvQueryEncodings (state->display, state->port, &n_encodings, &encodings) != Success)
+    return;
+
+  for (i = 0; i < n_encodings; i++) {
+    if (strcmp (encodings[i].name, "XV_IMAGE") == 0) {
+      state->max_size.width = encodings[i].width;
+      state->max_size.height = encodings[i].height;
+      break;
+    }
+  }
+  XvFreeEncodingInfo (encodings);
+}
+
 static int
 spa_xv_open (SpaXvSink *this)
 {
   SpaXvState *state = &this->state;
+  const char *name = this->props.device[0] ? this->props.device : NULL;
+  unsigned int version, revision, request_base, event_base, error_base;
 
   if (state->opened)
     return 0;
 
+  /* we don't call XInitThreads, it has to be the first Xlib call of the
+   * process and a plugin can't make sure of that. The display is our own,
+   * the data loop shows the images and reads the events while the main
+   * thread makes the window and the images, all of them take state->lock */
+  pthread_mutex_lock (&state->lock);
+  if ((state->display = XOpenDisplay (name)) == NULL) {
+    pthread_mutex_unlock (&state->lock);
+    spa_log_error (this->log, "xv-sink %p: can't open display %s", this, XDisplayName (name));
+    return -1;
+  }
+
+  if (XvQueryExtension (state->display, &version, &revision, &request_base,
+                        &event_base, &error_base) != Success) {
+    spa_log_error (this->log, "xv-sink %p: no Xv extension", this);
+    goto error;
+  }
+  /* the completion events of XvShmPutImage tell us when the server is done
+   * with a buffer */
+  if (!XShmQueryExtension (state->display)) {
+    spa_log_error (this->log, "xv-sink %p: no MIT-SHM extension", this);
+    goto error;
+  }
+  state->completion_type = XShmGetEventBase (state->display) + ShmCompletion;
+
+  if (spa_xv_find_port (this) < 0)
+    goto error;
+
+  spa_xv_query_max_size (this);
+  if (state->max_size.width == 0 || state->max_size.height == 0) {
+    state->max_size.width = 2048;
+    state->max_size.height = 2048;
+  }
+
+  this->props.device_fd = ConnectionNumber (state->display);
+
+  state->source.func = xv_on_fd_events;
+  state->source.data = this;
+  state->source.fd = this->props.device_fd;
+  state->source.mask = SPA_IO_IN | SPA_IO_ERR;
+  state->source.rmask = 0;
+
+  spa_log_info (this->log, "xv-sink %p: using port %lu of %s, %u formats, max %dx%d", this,
+      state->port, this->props.device_name, state->n_formats,
+      state->max_size.width, state->max_size.height);
+
   state->opened = true;
+  pthread_mutex_unlock (&state->lock);
 
   return 0;
+
+error:
+  XCloseDisplay (state->display);
+  state->display = NULL;
+  pthread_mutex_unlock (&state->lock);
+  return -1;
+}
+
+static void
+spa_xv_destroy_window (SpaXvSink *this)
+{
+  SpaXvState *state = &this->state;
+
+  if (state->window == 0)
+    return;
+
+  pthread_mutex_lock (&state->lock);
+  XFreeGC (state->display, state->gc);
+  XDestroyWindow (state->display, state->window);
+  state->window = 0;
+  pthread_mutex_unlock (&state->lock);
 }
 
 static int
-spa_xv_set_format (SpaXvSink *this, SpaVideoInfo *info, bool try_only)
+spa_xv_create_window (SpaXvSink *this, uint32_t width, uint32_t height)
 {
-  if (spa_xv_open (this) < 0)
-    return -1;
+  SpaXvState *state = &this->state;
+  Display *dpy = state->display;
+  int res = 0;
 
-  return 0;
+  pthread_mutex_lock (&state->lock);
+  if (state->window) {
+    XResizeWindow (dpy, state->window, width, height);
+  } else {
+    state->window = XCreateSimpleWindow (dpy, DefaultRootWindow (dpy), 0, 0, width, height, 0,
+                                         BlackPixel (dpy, DefaultScreen (dpy)),
+                                         BlackPixel (dpy, DefaultScreen (dpy)));
+    if (state->window == 0) {
+      res = -1;
+      goto done;
+    }
+
+    XSelectInput (dpy, state->window, StructureNotifyMask);
+    XStoreName (dpy, state->window, "Pinos Xv");
+    state->gc = XCreateGC (dpy, state->window, 0, NULL);
+    XMapRaised (dpy, state->window);
+  }
+  state->window_width = width;
+  state->window_height = height;
+  XSync (dpy, False);
+
+done:
+  pthread_mutex_unlock (&state->lock);
+  return res;
 }
 
 static int
@@ -39,24 +251,338 @@ spa_xv_close (SpaXvSink *this)
   if (!state->opened)
     return 0;
 
+  spa_xv_destroy_window (this);
+  pthread_mutex_lock (&state->lock);
+  XvUngrabPort (state->display, state->port, CurrentTime);
+  XCloseDisplay (state->display);
+  state->display = NULL;
+  pthread_mutex_unlock (&state->lock);
+  state->port = 0;
+  state->n_formats = 0;
   state->opened = false;
 
   return 0;
 }
 
+/* get the layout of an image in @format, the server decides on the
+ * pitches and offsets of the planes */
+static int
+spa_xv_set_format (SpaXvSink *this, SpaVideoInfo *info, bool try_only)
+{
+  SpaXvState *state = &this->state;
+  SpaVideoInfoRaw *raw = &info->info.raw;
+  XvImage *image;
+  int fourcc, i;
+
+  if (spa_xv_open (this) < 0)
+    return -1;
+
+  if ((fourcc = video_format_to_fourcc (this, raw->format)) == 0)
+    return -1;
+
+  if (raw->size.width == 0 || raw->size.height == 0 ||
+      raw->size.width > state->max_size.width || raw->size.height > state->max_size.height)
+    return -1;
+
+  if (try_only)
+    return 0;
+
+  pthread_mutex_lock (&state->lock);
+  image = XvCreateImage (state->display, state->port, fourcc, NULL, raw->size.width, raw->size.height);
+  pthread_mutex_unlock (&state->lock);
+  if (image == NULL)
+    return -1;
+
+  state->fourcc = fourcc;
+  state->image_size = image->data_size;
+  state->n_planes = SPA_MIN (image->num_planes, 3);
+  for (i = 0; i < state->n_planes; i++) {
+    state->pitches[i] = image->pitches[i];
+    state->offsets[i] = image->offsets[i];
+  }
+  XFree (image);
+
+  /* the stats are per stream */
+  memset (&state->stats, 0, sizeof (state->stats));
+
+  spa_log_info (this->log, "xv-sink %p: %08x %ux%u, %d planes, size %u", this, fourcc,
+      raw->size.width, raw->size.height, state->n_planes, state->image_size);
+
+  return spa_xv_create_window (this, raw->size.width, raw->size.height);
+}
+
+static void
+spa_xv_free_image (SpaXvSink *this, XvBuffer *b)
+{
+  SpaXvState *state = &this->state;
+
+  if (b->image == NULL)
+    return;
+
+  pthread_mutex_lock (&state->lock);
+  XShmDetach (state->display, &b->shminfo);
+  XSync (state->display, False);
+  pthread_mutex_unlock (&state->lock);
+  shmdt (b->shminfo.shmaddr);
+  XFree (b->image);
+  b->image = NULL;
+}
+
+/* make a shared memory image for @b. When @data is NULL the image
+ * memory is used for the buffer and producers write straight into the
+ * segment the server reads from */
+static int
+spa_xv_alloc_image (SpaXvSink *this, XvBuffer *b)
+{
+  SpaXvState *state = &this->state;
+  const SpaVideoInfoRaw *raw = &this->current_format.info.raw;
+
+  CLEAR (b->shminfo);
+  pthread_mutex_lock (&state->lock);
+  b->image = XvShmCreateImage (state->display, state->port, state->fourcc, NULL,
+                               raw->size.width, raw->size.height, &b->shminfo);
+  if (b->image == NULL)
+    goto error;
+
+  b->shminfo.shmid = shmget (IPC_PRIVATE, b->image->data_size, IPC_CREAT | 0600);
+  if (b->shminfo.shmid < 0) {
+    spa_log_error (this->log, "xv-sink %p: shmget: %s", this, strerror (errno));
+    goto error;
+  }
+  b->shminfo.shmaddr = b->image->data = shmat (b->shminfo.shmid, NULL, 0);
+  if (b->shminfo.shmaddr == (void *) -1) {
+    spa_log_error (this->log, "xv-sink %p: shmat: %s", this, strerror (errno));
+    shmctl (b->shminfo.shmid, IPC_RMID, NULL);
+    goto error;
+  }
+  b->shminfo.readOnly = False;
+
+  if (!XShmAttach (state->display, &b->shminfo)) {
+    shmdt (b->shminfo.shmaddr);
+    shmctl (b->shminfo.shmid, IPC_RMID, NULL);
+    goto error;
+  }
+  XSync (state->display, False);
+  pthread_mutex_unlock (&state->lock);
+  /* the segment goes away when both we and the server detached */
+  shmctl (b->shminfo.shmid, IPC_RMID, NULL);
+
+  return 0;
+
+error:
+  pthread_mutex_unlock (&state->lock);
+  if (b->image)
+    XFree (b->image);
+  b->image = NULL;
+  return -1;
+}
+
+/* the size in bytes of a line and the number of lines of @plane */
+static void
+plane_size (SpaXvSink *this, int plane, uint32_t *width, uint32_t *height)
+{
+  const SpaVideoInfoRaw *raw = &this->current_format.info.raw;
+
+  if (this->state.n_planes == 1) {
+    *width = raw->size.width * 2;
+    *height = raw->size.height;
+  } else {
+    *width = plane == 0 ? raw->size.width : (raw->size.width + 1) / 2;
+    *height = plane == 0 ? raw->size.height : (raw->size.height + 1) / 2;
+  }
+}
+
+/* copy the planes of @b into its image, used when the buffer memory is not
+ * our own shared memory. A buffer with a data block per plane uses the
+ * offset and stride of each block, the planes in a single block are laid
+ * out like the image we announced in the buffer params. */
+static int
+spa_xv_copy_image (SpaXvSink *this, XvBuffer *b)
+{
+  SpaXvState *state = &this->state;
+  SpaBuffer *buf = b->outbuf;
+  SpaData *d = buf->datas;
+  bool per_plane = state->n_planes > 1 && buf->n_datas >= state->n_planes;
+  int i;
+
+  if (!per_plane && state->n_planes > 1 &&
+      d[0].chunk->stride != 0 && d[0].chunk->stride != state->pitches[0]) {
+    spa_log_warn (this->log, "xv-sink %p: stride %d of buffer %u does not match %d", this,
+        d[0].chunk->stride, buf->id, state->pitches[0]);
+    return -1;
+  }
+
+  for (i = 0; i < state->n_planes; i++) {
+    SpaData *sd = per_plane ? &d[i] : &d[0];
+    uint8_t *dst = (uint8_t *) b->image->data + state->offsets[i];
+    uint32_t width, height, stride, offset, y;
+    uint8_t *src;
+
+    plane_size (this, i, &width, &height);
+
+    if (per_plane || state->n_planes == 1) {
+      offset = sd->chunk->offset;
+      stride = sd->chunk->stride ? sd->chunk->stride : state->pitches[i];
+    } else {
+      offset = sd->chunk->offset + state->offsets[i];
+      stride = state->pitches[i];
+    }
+    width = SPA_MIN (width, SPA_MIN (stride, (uint32_t) state->pitches[i]));
+
+    if (sd->data == NULL ||
+        (uint64_t) offset + (uint64_t) stride * (height - 1) + width > sd->maxsize) {
+      spa_log_warn (this->log, "xv-sink %p: plane %d of buffer %u too small", this, i, buf->id);
+      return -1;
+    }
+    src = SPA_MEMBER (sd->data, offset, uint8_t);
+
+    for (y = 0; y < height; y++)
+      memcpy (dst + y * state->pitches[i], src + y * stride, width);
+  }
+  return 0;
+}
+
+static void
+spa_xv_release_buffer (SpaXvSink *this, XvBuffer *b)
+{
+  b->outstanding = true;
+  spa_log_trace (this->log, "xv-sink %p: reuse buffer %u", this, b->outbuf->id);
+  if (this->callbacks.reuse_buffer)
+    this->callbacks.reuse_buffer (&this->node, 0, b->outbuf->id, this->user_data);
+}
+
+/* the server read the image of the pending buffer, returns the buffer
+ * to give back to the producer */
+static XvBuffer *
+spa_xv_complete (SpaXvSink *this)
+{
+  SpaXvState *state = &this->state;
+  SpaXvSinkStats *stats = &state->stats;
+  XvBuffer *b = state->pending;
+  int64_t frame_time;
+
+  if (b == NULL)
+    return NULL;
+
+  state->pending = NULL;
+
+  frame_time = get_time_ns () - state->put_time;
+  stats->frames++;
+  stats->total_frame_time += frame_time;
+  if (stats->frames == 1 || frame_time < stats->min_frame_time)
+    stats->min_frame_time = frame_time;
+  if (frame_time > stats->max_frame_time)
+    stats->max_frame_time = frame_time;
+
+  return b;
+}
+
+static void
+xv_on_fd_events (SpaSource *source)
+{
+  SpaXvSink *this = source->data;
+  SpaXvState *state = &this->state;
+  XvBuffer *done = NULL;
+
+  if (source->rmask & SPA_IO_ERR) {
+    spa_log_error (this->log, "xv-sink %p: error on X connection", this);
+    return;
+  }
+
+  pthread_mutex_lock (&state->lock);
+  while (XPending (state->display)) {
+    XEvent event;
+
+    XNextEvent (state->display, &event);
+
+    if (event.type == state->completion_type) {
+      XShmCompletionEvent *ev = (XShmCompletionEvent *) &event;
+
+      if (state->pending && state->pending->shminfo.shmseg == ev->shmseg)
+        done = spa_xv_complete (this);
+    }
+    else if (event.type == ConfigureNotify) {
+      state->window_width = event.xconfigure.width;
+      state->window_height = event.xconfigure.height;
+    }
+  }
+  pthread_mutex_unlock (&state->lock);
+
+  if (done)
+    spa_xv_release_buffer (this, done);
+}
+
+static int
+spa_xv_show (SpaXvSink *this, XvBuffer *b)
+{
+  SpaXvState *state = &this->state;
+  const SpaVideoInfoRaw *raw = &this->current_format.info.raw;
+  int x = 0, y = 0, width = raw->size.width, height = raw->size.height;
+
+  if (!b->shared && spa_xv_copy_image (this, b) < 0) {
+    state->stats.dropped++;
+    spa_xv_release_buffer (this, b);
+    return -1;
+  }
+
+  if (b->crop && b->crop->width > 0 && b->crop->height > 0 &&
+      b->crop->x >= 0 && b->crop->y >= 0 &&
+      b->crop->x + b->crop->width <= width && b->crop->y + b->crop->height <= height) {
+    x = b->crop->x;
+    y = b->crop->y;
+    width = b->crop->width;
+    height = b->crop->height;
+  }
+
+  pthread_mutex_lock (&state->lock);
+  state->put_time = get_time_ns ();
+  state->pending = b;
+  XvShmPutImage (state->display, state->port, state->window, state->gc, b->image,
+                 x, y, width, height,
+                 0, 0, state->window_width, state->window_height, True);
+  XFlush (state->display);
+  pthread_mutex_unlock (&state->lock);
+
+  return 0;
+}
+
 static int
 spa_xv_start (SpaXvSink *this)
 {
+  SpaXvState *state = &this->state;
+
   if (spa_xv_open (this) < 0)
     return -1;
 
+  if (!state->source_enabled) {
+    spa_loop_add_source (state->data_loop, &state->source);
+    state->source_enabled = true;
+  }
   return 0;
 }
 
 static int
 spa_xv_stop (SpaXvSink *this)
 {
-  spa_xv_close (this);
+  SpaXvState *state = &this->state;
+  XvBuffer *pending;
+
+  if (state->source_enabled) {
+    spa_loop_remove_source (state->data_loop, &state->source);
+    state->source_enabled = false;
+  }
+  /* the server is done with the image once the connection is synced */
+  if (state->display == NULL)
+    return 0;
+
+  pthread_mutex_lock (&state->lock);
+  if ((pending = state->pending)) {
+    XSync (state->display, False);
+    state->pending = NULL;
+  }
+  pthread_mutex_unlock (&state->lock);
 
+  if (pending)
+    spa_xv_release_buffer (this, pending);
   return 0;
 }
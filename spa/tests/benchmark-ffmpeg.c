@@ -0,0 +1,467 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <dlfcn.h>
+#include <time.h>
+
+#include <spa/node.h>
+#include <spa/log.h>
+#include <spa/type-map.h>
+#include <spa/video/format-utils.h>
+#include <spa/format-utils.h>
+#include <spa/format-builder.h>
+#include <lib/mapper.h>
+#include <lib/debug.h>
+#include <lib/props.h>
+
+typedef struct {
+  uint32_t node;
+  uint32_t props;
+  uint32_t format;
+  uint32_t props_threads;
+  uint32_t props_low_latency;
+  SpaTypeMeta meta;
+  SpaTypeData data;
+  SpaTypeMediaType media_type;
+  SpaTypeMediaSubtype media_subtype;
+  SpaTypeMediaSubtypeVideo media_subtype_video;
+  SpaTypeFormatVideo format_video;
+  SpaTypeVideoFormat video_format;
+} Type;
+
+static inline void
+init_type (Type *type, SpaTypeMap *map)
+{
+  type->node = spa_type_map_get_id (map, SPA_TYPE__Node);
+  type->props = spa_type_map_get_id (map, SPA_TYPE__Props);
+  type->format = spa_type_map_get_id (map, SPA_TYPE__Format);
+  type->props_threads = spa_type_map_get_id (map, SPA_TYPE_PROPS__threads);
+  type->props_low_latency = spa_type_map_get_id (map, SPA_TYPE_PROPS__lowLatency);
+  spa_type_meta_map (map, &type->meta);
+  spa_type_data_map (map, &type->data);
+  spa_type_media_type_map (map, &type->media_type);
+  spa_type_media_subtype_map (map, &type->media_subtype);
+  spa_type_media_subtype_video_map (map, &type->media_subtype_video);
+  spa_type_format_video_map (map, &type->format_video);
+  spa_type_video_format_map (map, &type->video_format);
+}
+
+#define BENCH_FRAMES    120
+#define BENCH_WIDTH     1280
+#define BENCH_HEIGHT    720
+#define BENCH_FPS       30
+#define BENCH_STRIDE    SPA_ROUND_UP_N (BENCH_WIDTH, 32)
+#define BENCH_SIZE      (BENCH_STRIDE * BENCH_HEIGHT * 3 / 2)
+#define N_BUFFERS       4
+
+typedef struct {
+  SpaBuffer buffer;
+  SpaMeta metas[1];
+  SpaMetaHeader header;
+  SpaData datas[1];
+  SpaChunk chunks[1];
+} Buffer;
+
+typedef struct {
+  uint8_t *data;
+  uint32_t size;
+  uint32_t flags;
+  int64_t pts;
+} Packet;
+
+typedef struct {
+  SpaTypeMap *map;
+  SpaLog *log;
+  Type type;
+
+  SpaSupport support[2];
+  uint32_t   n_support;
+
+  SpaPortIO  io[2];
+  SpaBuffer *in_buffers[N_BUFFERS];
+  Buffer     in_buffer[N_BUFFERS];
+  SpaBuffer *out_buffers[N_BUFFERS];
+  Buffer     out_buffer[N_BUFFERS];
+
+  /* the stream of the last encoder run, decoded next */
+  Packet     packets[BENCH_FRAMES];
+  uint32_t   n_packets;
+} AppData;
+
+typedef struct {
+  const char *name;
+  const char *encoder;
+  const char *decoder;
+  uint32_t subtype;
+} BenchCase;
+
+static void
+init_buffer (AppData *data, SpaBuffer **bufs, Buffer *ba, uint32_t n_buffers, size_t size)
+{
+  uint32_t i;
+
+  for (i = 0; i < n_buffers; i++) {
+    Buffer *b = &ba[i];
+    bufs[i] = &b->buffer;
+
+    b->buffer.id = i;
+    b->buffer.n_metas = 1;
+    b->buffer.metas = b->metas;
+    b->buffer.n_datas = 1;
+    b->buffer.datas = b->datas;
+
+    b->header.flags = 0;
+    b->header.seq = 0;
+    b->header.pts = 0;
+    b->header.dts_offset = 0;
+    b->metas[0].type = data->type.meta.Header;
+    b->metas[0].data = &b->header;
+    b->metas[0].size = sizeof (b->header);
+
+    b->datas[0].type = data->type.data.MemPtr;
+    b->datas[0].flags = 0;
+    b->datas[0].fd = -1;
+    b->datas[0].mapoffset = 0;
+    b->datas[0].maxsize = size;
+    b->datas[0].data = malloc (size);
+    b->datas[0].chunk = &b->chunks[0];
+    b->datas[0].chunk->offset = 0;
+    b->datas[0].chunk->size = size;
+    b->datas[0].chunk->stride = 0;
+  }
+}
+
+/* a gradient with a moving block, something an encoder has to work on
+ * without being noise */
+static void
+fill_frame (uint8_t *p, uint32_t frame)
+{
+  uint8_t *y = p, *u = p + BENCH_STRIDE * BENCH_HEIGHT;
+  uint8_t *v = u + BENCH_STRIDE / 2 * BENCH_HEIGHT / 2;
+  uint32_t i, j, bx = (frame * 16) % BENCH_WIDTH;
+
+  for (i = 0; i < BENCH_HEIGHT; i++) {
+    for (j = 0; j < BENCH_WIDTH; j++)
+      y[i * BENCH_STRIDE + j] = j >= bx && j < bx + 128 && i >= 256 && i < 384 ? 235 : (i + j + frame) & 0xff;
+  }
+  for (i = 0; i < BENCH_HEIGHT / 2; i++) {
+    for (j = 0; j < BENCH_WIDTH / 2; j++) {
+      u[i * BENCH_STRIDE / 2 + j] = (j + frame) & 0xff;
+      v[i * BENCH_STRIDE / 2 + j] = (i + frame) & 0xff;
+    }
+  }
+}
+
+static SpaResult
+make_node (AppData *data, SpaNode **node, const char *lib, const char *name)
+{
+  SpaHandle *handle;
+  SpaResult res;
+  void *hnd;
+  SpaEnumHandleFactoryFunc enum_func;
+  uint32_t i;
+
+  if ((hnd = dlopen (lib, RTLD_NOW)) == NULL) {
+    printf ("can't load %s: %s\n", lib, dlerror());
+    return SPA_RESULT_ERROR;
+  }
+  if ((enum_func = dlsym (hnd, "spa_enum_handle_factory")) == NULL) {
+    printf ("can't find enum function\n");
+    return SPA_RESULT_ERROR;
+  }
+
+  for (i = 0; ;i++) {
+    const SpaHandleFactory *factory;
+    void *iface;
+
+    if ((res = enum_func (&factory, i)) < 0) {
+      if (res != SPA_RESULT_ENUM_END)
+        printf ("can't enumerate factories: %d\n", res);
+      break;
+    }
+    if (strcmp (factory->name, name))
+      continue;
+
+    handle = calloc (1, factory->size);
+    if ((res = spa_handle_factory_init (factory, handle, NULL, data->support, data->n_support)) < 0) {
+      printf ("can't make factory instance: %d\n", res);
+      return res;
+    }
+    if ((res = spa_handle_get_interface (handle, data->type.node, &iface)) < 0) {
+      printf ("can't get interface %d\n", res);
+      return res;
+    }
+    *node = iface;
+    return SPA_RESULT_OK;
+  }
+  return SPA_RESULT_ERROR;
+}
+
+static void
+on_reuse_buffer (SpaNode *node, uint32_t port_id, uint32_t buffer_id, void *user_data)
+{
+}
+
+static const SpaNodeCallbacks ffmpeg_callbacks = {
+  .reuse_buffer = on_reuse_buffer,
+};
+
+static SpaResult
+set_formats (AppData *data, SpaNode *node, SpaDirection raw_direction, uint32_t subtype)
+{
+  SpaPODBuilder b = { NULL, };
+  SpaPODFrame f[2];
+  uint8_t buffer[256];
+  SpaResult res;
+
+  spa_pod_builder_init (&b, buffer, sizeof (buffer));
+  spa_pod_builder_format (&b, &f[0], data->type.format,
+      data->type.media_type.video, data->type.media_subtype.raw,
+      SPA_POD_PROP (&f[1], data->type.format_video.format, 0,
+                           SPA_POD_TYPE_ID, 1,
+                           data->type.video_format.I420),
+      SPA_POD_PROP (&f[1], data->type.format_video.size, 0,
+                           SPA_POD_TYPE_RECTANGLE, 1,
+                           BENCH_WIDTH, BENCH_HEIGHT),
+      SPA_POD_PROP (&f[1], data->type.format_video.framerate, 0,
+                           SPA_POD_TYPE_FRACTION, 1,
+                           BENCH_FPS, 1));
+
+  if ((res = spa_node_port_set_format (node, raw_direction, 0, 0,
+                                       SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaFormat))) < 0)
+    return res;
+
+  spa_pod_builder_init (&b, buffer, sizeof (buffer));
+  spa_pod_builder_format (&b, &f[0], data->type.format,
+      data->type.media_type.video, subtype,
+      SPA_POD_PROP (&f[1], data->type.format_video.size, 0,
+                           SPA_POD_TYPE_RECTANGLE, 1,
+                           BENCH_WIDTH, BENCH_HEIGHT),
+      SPA_POD_PROP (&f[1], data->type.format_video.framerate, 0,
+                           SPA_POD_TYPE_FRACTION, 1,
+                           BENCH_FPS, 1));
+
+  return spa_node_port_set_format (node, raw_direction == SPA_DIRECTION_INPUT ?
+                                   SPA_DIRECTION_OUTPUT : SPA_DIRECTION_INPUT, 0, 0,
+                                   SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaFormat));
+}
+
+static SpaResult
+setup_node (AppData *data, SpaNode **node, const char *name, int32_t threads, bool low_latency)
+{
+  SpaResult res;
+  SpaProps *props;
+  SpaPODBuilder b = { NULL, };
+  SpaPODFrame f[2];
+  uint8_t buffer[256];
+
+  if ((res = make_node (data, node, "build/spa/plugins/ffmpeg/libspa-ffmpeg.so", name)) < 0) {
+    printf ("can't create %s: %d\n", name, res);
+    return res;
+  }
+  spa_node_set_callbacks (*node, &ffmpeg_callbacks, sizeof (ffmpeg_callbacks), data);
+
+  spa_pod_builder_init (&b, buffer, sizeof (buffer));
+  spa_pod_builder_props (&b, &f[0], data->type.props,
+      SPA_POD_PROP (&f[1], data->type.props_threads, 0, SPA_POD_TYPE_INT, 1, threads),
+      SPA_POD_PROP (&f[1], data->type.props_low_latency, 0, SPA_POD_TYPE_BOOL, 1, low_latency));
+  props = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaProps);
+
+  if ((res = spa_node_set_props (*node, props)) < 0)
+    return res;
+
+  spa_node_port_set_io (*node, SPA_DIRECTION_INPUT, 0, &data->io[0]);
+  spa_node_port_set_io (*node, SPA_DIRECTION_OUTPUT, 0, &data->io[1]);
+
+  return SPA_RESULT_OK;
+}
+
+/* feed BENCH_FRAMES buffers to @node and time how long it takes for each
+ * of them to come out on the other side */
+static SpaResult
+run_node (AppData *data, SpaNode *node, const char *what, bool store)
+{
+  SpaResult res;
+  struct timespec now;
+  int64_t start, t_in[BENCH_FRAMES];
+  int64_t elapsed, lat, lat_sum = 0, lat_max = 0;
+  uint32_t i, n_out = 0, first = 0;
+
+  data->io[1].status = SPA_RESULT_OK;
+  data->io[1].buffer_id = SPA_ID_INVALID;
+
+  if (store) {
+    for (i = 0; i < data->n_packets; i++)
+      free (data->packets[i].data);
+    data->n_packets = 0;
+  }
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  start = SPA_TIMESPEC_TO_TIME (&now);
+
+  for (i = 0; i < BENCH_FRAMES; i++) {
+    Buffer *b = &data->in_buffer[i % N_BUFFERS];
+
+    if (!store) {
+      /* decoding, send the stored stream */
+      if (i >= data->n_packets)
+        break;
+      memcpy (b->datas[0].data, data->packets[i].data, data->packets[i].size);
+      b->datas[0].chunk->size = data->packets[i].size;
+      b->header.flags = data->packets[i].flags;
+    }
+    b->header.seq = i;
+    b->header.pts = (int64_t) i * SPA_NSEC_PER_SEC / BENCH_FPS;
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    t_in[i] = SPA_TIMESPEC_TO_TIME (&now);
+
+    data->io[0].status = SPA_RESULT_HAVE_BUFFER;
+    data->io[0].buffer_id = b->buffer.id;
+
+    /* the node keeps the input when it has output to get rid of first */
+    while (data->io[0].buffer_id != SPA_ID_INVALID) {
+      Buffer *ob;
+      uint32_t idx;
+
+      res = spa_node_process_input (node);
+      if (res == SPA_RESULT_NEED_BUFFER)
+        continue;
+      if (res != SPA_RESULT_HAVE_BUFFER) {
+        printf ("got process_input error from %s %d\n", what, res);
+        return res;
+      }
+
+      clock_gettime (CLOCK_MONOTONIC, &now);
+      ob = &data->out_buffer[data->io[1].buffer_id];
+      idx = (ob->header.pts * BENCH_FPS + SPA_NSEC_PER_SEC / 2) / SPA_NSEC_PER_SEC;
+      if (idx < BENCH_FRAMES) {
+        lat = SPA_TIMESPEC_TO_TIME (&now) - t_in[idx];
+        lat_sum += lat;
+        lat_max = SPA_MAX (lat_max, lat);
+      }
+      if (n_out++ == 0)
+        first = i;
+
+      if (store && data->n_packets < BENCH_FRAMES) {
+        Packet *p = &data->packets[data->n_packets++];
+        p->size = ob->datas[0].chunk->size;
+        p->data = malloc (p->size);
+        memcpy (p->data, ob->datas[0].data, p->size);
+        p->flags = ob->header.flags;
+        p->pts = ob->header.pts;
+      }
+      spa_node_port_reuse_buffer (node, 0, data->io[1].buffer_id);
+      data->io[1].buffer_id = SPA_ID_INVALID;
+    }
+  }
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  elapsed = SPA_TIMESPEC_TO_TIME (&now) - start;
+
+  printf ("  %-6s %7.1f fps, first output after %3u frames, latency avg %6.2f ms max %6.2f ms\n",
+      what, (double) i * SPA_NSEC_PER_SEC / elapsed, first,
+      n_out ? (double) lat_sum / n_out / SPA_NSEC_PER_MSEC : 0.0,
+      (double) lat_max / SPA_NSEC_PER_MSEC);
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+benchmark_ffmpeg (AppData *data, const BenchCase *c, int32_t threads, bool low_latency)
+{
+  SpaResult res;
+  SpaNode *enc, *dec;
+  uint32_t i;
+
+  for (i = 0; i < N_BUFFERS; i++) {
+    fill_frame (data->in_buffers[i]->datas[0].data, i);
+    data->in_buffer[i].datas[0].chunk->size = BENCH_SIZE;
+    data->in_buffer[i].header.flags = 0;
+  }
+
+  printf ("%s threads %s%s\n", c->name, threads ? "1" : "auto", low_latency ? " low latency" : "");
+
+  if ((res = setup_node (data, &enc, c->encoder, threads, low_latency)) < 0 ||
+      (res = set_formats (data, enc, SPA_DIRECTION_INPUT, c->subtype)) < 0)
+    return res;
+
+  if ((res = spa_node_port_use_buffers (enc, SPA_DIRECTION_INPUT, 0, data->in_buffers, N_BUFFERS)) < 0 ||
+      (res = spa_node_port_use_buffers (enc, SPA_DIRECTION_OUTPUT, 0, data->out_buffers, N_BUFFERS)) < 0)
+    return res;
+
+  if ((res = run_node (data, enc, "encode", true)) < 0)
+    return res;
+
+  if ((res = setup_node (data, &dec, c->decoder, threads, low_latency)) < 0 ||
+      (res = set_formats (data, dec, SPA_DIRECTION_OUTPUT, c->subtype)) < 0)
+    return res;
+
+  if ((res = spa_node_port_use_buffers (dec, SPA_DIRECTION_INPUT, 0, data->in_buffers, N_BUFFERS)) < 0 ||
+      (res = spa_node_port_use_buffers (dec, SPA_DIRECTION_OUTPUT, 0, data->out_buffers, N_BUFFERS)) < 0)
+    return res;
+
+  return run_node (data, dec, "decode", false);
+}
+
+int
+main (int argc, char *argv[])
+{
+  AppData data = { NULL };
+  SpaResult res;
+  const char *str;
+  uint32_t i;
+
+  data.map = spa_type_map_get_default();
+  data.log = spa_log_get_default();
+
+  if ((str = getenv ("PINOS_DEBUG")))
+    data.log->level = atoi (str);
+
+  data.support[0].type = SPA_TYPE__TypeMap;
+  data.support[0].data = data.map;
+  data.support[1].type = SPA_TYPE__Log;
+  data.support[1].data = data.log;
+  data.n_support = 2;
+
+  init_type (&data.type, data.map);
+
+  {
+    const BenchCase cases[] = {
+      { "720p H.264", "ffenc_libx264", "ffdec_h264", data.type.media_subtype_video.h264 },
+      { "720p VP8",   "ffenc_libvpx",  "ffdec_vp8",  data.type.media_subtype_video.vp8 },
+    };
+
+    init_buffer (&data, data.in_buffers, data.in_buffer, N_BUFFERS, BENCH_SIZE);
+    init_buffer (&data, data.out_buffers, data.out_buffer, N_BUFFERS, BENCH_SIZE);
+
+    /* one thread, all threads, then all threads without frame delay */
+    for (i = 0; i < SPA_N_ELEMENTS (cases); i++) {
+      if ((res = benchmark_ffmpeg (&data, &cases[i], 1, false)) < 0 ||
+          (res = benchmark_ffmpeg (&data, &cases[i], 0, false)) < 0 ||
+          (res = benchmark_ffmpeg (&data, &cases[i], 0, true)) < 0) {
+        printf ("benchmark failed: %d\n", res);
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,341 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <dlfcn.h>
+#include <math.h>
+#include <time.h>
+
+#include <spa/node.h>
+#include <spa/log.h>
+#include <spa/type-map.h>
+#include <spa/audio/format-utils.h>
+#include <spa/format-utils.h>
+#include <spa/format-builder.h>
+#include <lib/mapper.h>
+#include <lib/debug.h>
+#include <lib/props.h>
+#include <lib/cpu.h>
+
+typedef struct {
+  uint32_t node;
+  uint32_t props;
+  uint32_t format;
+  uint32_t props_quality;
+  uint32_t quality[4];
+  SpaTypeMeta meta;
+  SpaTypeData data;
+  SpaTypeMediaType media_type;
+  SpaTypeMediaSubtype media_subtype;
+  SpaTypeFormatAudio format_audio;
+  SpaTypeAudioFormat audio_format;
+} Type;
+
+static const char *quality_names[] = { "fast", "low", "medium", "high" };
+static const char *quality_types[] = {
+  SPA_TYPE_PROPS__quality ":fast",
+  SPA_TYPE_PROPS__quality ":low",
+  SPA_TYPE_PROPS__quality ":medium",
+  SPA_TYPE_PROPS__quality ":high",
+};
+
+static inline void
+init_type (Type *type, SpaTypeMap *map)
+{
+  uint32_t i;
+
+  type->node = spa_type_map_get_id (map, SPA_TYPE__Node);
+  type->props = spa_type_map_get_id (map, SPA_TYPE__Props);
+  type->format = spa_type_map_get_id (map, SPA_TYPE__Format);
+  type->props_quality = spa_type_map_get_id (map, SPA_TYPE_PROPS__quality);
+  for (i = 0; i < SPA_N_ELEMENTS (quality_types); i++)
+    type->quality[i] = spa_type_map_get_id (map, quality_types[i]);
+  spa_type_meta_map (map, &type->meta);
+  spa_type_data_map (map, &type->data);
+  spa_type_media_type_map (map, &type->media_type);
+  spa_type_media_subtype_map (map, &type->media_subtype);
+  spa_type_format_audio_map (map, &type->format_audio);
+  spa_type_audio_format_map (map, &type->audio_format);
+}
+
+typedef struct {
+  SpaBuffer buffer;
+  SpaMeta metas[1];
+  SpaMetaHeader header;
+  SpaData datas[1];
+  SpaChunk chunks[1];
+} Buffer;
+
+typedef struct {
+  SpaTypeMap *map;
+  SpaLog *log;
+  Type type;
+
+  SpaSupport support[2];
+  uint32_t   n_support;
+
+  SpaPortIO  io[2];
+  SpaBuffer *buffers[2];
+  Buffer     buffer[2];
+} AppData;
+
+#define BENCH_CHANNELS  2
+#define BENCH_FRAMES    1024
+#define BENCH_CYCLES    2000
+/* room for BENCH_FRAMES upsampled 8 times */
+#define BENCH_OUT_FRAMES (BENCH_FRAMES * 8 + 16)
+
+static void
+init_buffer (AppData *data, SpaBuffer *buf, Buffer *b, uint32_t id, size_t size)
+{
+  b->buffer.id = id;
+  b->buffer.n_metas = 1;
+  b->buffer.metas = b->metas;
+  b->buffer.n_datas = 1;
+  b->buffer.datas = b->datas;
+
+  b->header.flags = 0;
+  b->header.seq = 0;
+  b->header.pts = 0;
+  b->header.dts_offset = 0;
+  b->metas[0].type = data->type.meta.Header;
+  b->metas[0].data = &b->header;
+  b->metas[0].size = sizeof (b->header);
+
+  b->datas[0].type = data->type.data.MemPtr;
+  b->datas[0].flags = 0;
+  b->datas[0].fd = -1;
+  b->datas[0].mapoffset = 0;
+  b->datas[0].maxsize = size;
+  b->datas[0].data = malloc (size);
+  b->datas[0].chunk = &b->chunks[0];
+  b->datas[0].chunk->offset = 0;
+  b->datas[0].chunk->size = size;
+  b->datas[0].chunk->stride = 0;
+}
+
+static SpaResult
+make_node (AppData *data, SpaNode **node, const char *lib, const char *name, const SpaDict *info)
+{
+  SpaHandle *handle;
+  SpaResult res;
+  void *hnd;
+  SpaEnumHandleFactoryFunc enum_func;
+  uint32_t i;
+
+  if ((hnd = dlopen (lib, RTLD_NOW)) == NULL) {
+    printf ("can't load %s: %s\n", lib, dlerror());
+    return SPA_RESULT_ERROR;
+  }
+  if ((enum_func = dlsym (hnd, "spa_enum_handle_factory")) == NULL) {
+    printf ("can't find enum function\n");
+    return SPA_RESULT_ERROR;
+  }
+
+  for (i = 0; ;i++) {
+    const SpaHandleFactory *factory;
+    void *iface;
+
+    if ((res = enum_func (&factory, i)) < 0) {
+      if (res != SPA_RESULT_ENUM_END)
+        printf ("can't enumerate factories: %d\n", res);
+      break;
+    }
+    if (strcmp (factory->name, name))
+      continue;
+
+    handle = calloc (1, factory->size);
+    if ((res = spa_handle_factory_init (factory, handle, info, data->support, data->n_support)) < 0) {
+      printf ("can't make factory instance: %d\n", res);
+      return res;
+    }
+    if ((res = spa_handle_get_interface (handle, data->type.node, &iface)) < 0) {
+      printf ("can't get interface %d\n", res);
+      return res;
+    }
+    *node = iface;
+    return SPA_RESULT_OK;
+  }
+  return SPA_RESULT_ERROR;
+}
+
+static void
+on_reuse_buffer (SpaNode *node, uint32_t port_id, uint32_t buffer_id, void *user_data)
+{
+}
+
+static const SpaNodeCallbacks resample_callbacks = {
+  .reuse_buffer = on_reuse_buffer,
+};
+
+static SpaResult
+set_format (AppData *data, SpaNode *node, SpaDirection direction, uint32_t rate)
+{
+  SpaPODBuilder b = { NULL, };
+  SpaPODFrame f[2];
+  uint8_t buffer[256];
+
+  spa_pod_builder_init (&b, buffer, sizeof (buffer));
+  spa_pod_builder_format (&b, &f[0], data->type.format,
+      data->type.media_type.audio, data->type.media_subtype.raw,
+      SPA_POD_PROP (&f[1], data->type.format_audio.format, 0,
+                           SPA_POD_TYPE_ID,  1,
+                           data->type.audio_format.F32),
+      SPA_POD_PROP (&f[1], data->type.format_audio.layout, 0,
+                           SPA_POD_TYPE_INT, 1,
+                           SPA_AUDIO_LAYOUT_INTERLEAVED),
+      SPA_POD_PROP (&f[1], data->type.format_audio.rate, 0,
+                           SPA_POD_TYPE_INT, 1,
+                           rate),
+      SPA_POD_PROP (&f[1], data->type.format_audio.channels, 0,
+                           SPA_POD_TYPE_INT, 1,
+                           BENCH_CHANNELS));
+
+  return spa_node_port_set_format (node, direction, 0, 0,
+                                   SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaFormat));
+}
+
+static SpaResult
+benchmark_resample (AppData *data, uint32_t in_rate, uint32_t out_rate,
+                    uint32_t quality, const char *cpu_mask)
+{
+  SpaResult res;
+  SpaNode *node;
+  SpaProps *props;
+  SpaPODBuilder b = { NULL, };
+  SpaPODFrame f[2];
+  uint8_t buffer[256];
+  SpaDictItem items[1];
+  SpaDict info;
+  struct timespec t1, t2;
+  int64_t elapsed;
+  uint64_t n_out = 0;
+  uint32_t i;
+
+  items[0].key = SPA_CPU_INFO_MASK;
+  items[0].value = cpu_mask;
+  info.n_items = cpu_mask ? 1 : 0;
+  info.items = items;
+
+  if ((res = make_node (data, &node,
+                        "build/spa/plugins/resample/libspa-resample.so",
+                        "resample", &info)) < 0) {
+    printf ("can't create resample: %d\n", res);
+    return res;
+  }
+  spa_node_set_callbacks (node, &resample_callbacks, sizeof (resample_callbacks), data);
+
+  spa_pod_builder_init (&b, buffer, sizeof (buffer));
+  spa_pod_builder_props (&b, &f[0], data->type.props,
+      SPA_POD_PROP (&f[1], data->type.props_quality, 0, SPA_POD_TYPE_ID, 1,
+                           data->type.quality[quality]));
+  props = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaProps);
+
+  if ((res = spa_node_set_props (node, props)) < 0)
+    return res;
+
+  spa_node_port_set_io (node, SPA_DIRECTION_INPUT, 0, &data->io[0]);
+  spa_node_port_set_io (node, SPA_DIRECTION_OUTPUT, 0, &data->io[1]);
+
+  if ((res = set_format (data, node, SPA_DIRECTION_INPUT, in_rate)) < 0 ||
+      (res = set_format (data, node, SPA_DIRECTION_OUTPUT, out_rate)) < 0)
+    return res;
+
+  if ((res = spa_node_port_use_buffers (node, SPA_DIRECTION_INPUT, 0, &data->buffers[0], 1)) < 0 ||
+      (res = spa_node_port_use_buffers (node, SPA_DIRECTION_OUTPUT, 0, &data->buffers[1], 1)) < 0)
+    return res;
+
+  clock_gettime (CLOCK_MONOTONIC, &t1);
+  for (i = 0; i < BENCH_CYCLES; i++) {
+    data->io[0].status = SPA_RESULT_HAVE_BUFFER;
+    data->io[0].buffer_id = 0;
+    data->io[1].status = SPA_RESULT_OK;
+    data->io[1].buffer_id = SPA_ID_INVALID;
+
+    if ((res = spa_node_process_input (node)) != SPA_RESULT_HAVE_BUFFER) {
+      printf ("got process_input error from resample %d\n", res);
+      return res;
+    }
+    n_out += data->buffers[1]->datas[0].chunk->size / (BENCH_CHANNELS * sizeof (float));
+    spa_node_port_reuse_buffer (node, 0, data->io[1].buffer_id);
+  }
+  clock_gettime (CLOCK_MONOTONIC, &t2);
+
+  elapsed = SPA_TIMESPEC_TO_TIME (&t2) - SPA_TIMESPEC_TO_TIME (&t1);
+  printf ("%6u -> %6u %-6s cpu mask %-4s: %8"PRIi64" ns/cycle, %7.1fx realtime, %.4f out/in\n",
+      in_rate, out_rate, quality_names[quality], cpu_mask ? cpu_mask : "auto",
+      elapsed / BENCH_CYCLES,
+      ((double) BENCH_CYCLES * BENCH_FRAMES * SPA_NSEC_PER_SEC / in_rate) / elapsed,
+      (double) n_out / ((double) BENCH_CYCLES * BENCH_FRAMES));
+
+  return SPA_RESULT_OK;
+}
+
+int
+main (int argc, char *argv[])
+{
+  AppData data = { NULL };
+  SpaResult res;
+  const char *str;
+  static const uint32_t rates[][2] = {
+    { 44100, 48000 },
+    { 48000, 44100 },
+    { 48000, 96000 },
+    { 96000, 48000 },
+  };
+  float *samples;
+  uint32_t i, j;
+
+  data.map = spa_type_map_get_default();
+  data.log = spa_log_get_default();
+
+  if ((str = getenv ("PINOS_DEBUG")))
+    data.log->level = atoi (str);
+
+  data.support[0].type = SPA_TYPE__TypeMap;
+  data.support[0].data = data.map;
+  data.support[1].type = SPA_TYPE__Log;
+  data.support[1].data = data.log;
+  data.n_support = 2;
+
+  init_type (&data.type, data.map);
+
+  init_buffer (&data, data.buffers[0] = &data.buffer[0].buffer, &data.buffer[0], 0,
+               BENCH_FRAMES * BENCH_CHANNELS * sizeof (float));
+  init_buffer (&data, data.buffers[1] = &data.buffer[1].buffer, &data.buffer[1], 0,
+               BENCH_OUT_FRAMES * BENCH_CHANNELS * sizeof (float));
+
+  samples = data.buffers[0]->datas[0].data;
+  for (i = 0; i < BENCH_FRAMES * BENCH_CHANNELS; i++)
+    samples[i] = (float) rand () / RAND_MAX - 0.5f;
+
+  /* plain C kernels first, then the ones selected for this CPU */
+  for (i = 0; i < SPA_N_ELEMENTS (rates); i++) {
+    for (j = 0; j < SPA_N_ELEMENTS (quality_names); j++) {
+      if ((res = benchmark_resample (&data, rates[i][0], rates[i][1], j, "0")) < 0 ||
+          (res = benchmark_resample (&data, rates[i][0], rates[i][1], j, NULL)) < 0) {
+        printf ("benchmark failed: %d\n", res);
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,406 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <lib/cpu.h>
+
+#include <plugins/audioconvert/convert-ops.h>
+
+/* lengths from 0 to MAX_SAMPLES cover every tail of the kernels */
+#define MAX_SAMPLES     67
+/* start this many samples into the buffers to test unaligned memory */
+#define MAX_OFFSET      4
+#define MAX_CHANNELS    8
+/* guard samples after the end that the kernels must not touch */
+#define GUARD           8
+#define N_DITHER        65536
+
+static uint32_t failures;
+static uint32_t seed = 1;
+
+#define CHECK(expr, ...)                        \
+  do {                                          \
+    if (!(expr)) {                              \
+      if (failures++ < 20) {                    \
+        printf ("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf (__VA_ARGS__);                   \
+        printf ("\n");                          \
+      }                                         \
+    }                                           \
+  } while (0)
+
+static uint32_t
+next_random (void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+/* uniform in [-@range, @range] */
+static float
+random_float (float range)
+{
+  return ((next_random () & 0xffff) / 32767.5f - 1.0f) * range;
+}
+
+/* triangular noise of +-1 LSB, like the dither of the node */
+static void
+make_dither (float *dither, uint32_t n_samples)
+{
+  uint32_t i;
+
+  for (i = 0; i < n_samples; i++) {
+    float r1 = next_random () * (1.0f / (1 << 24));
+    float r2 = next_random () * (1.0f / (1 << 24));
+
+    dither[i] = r1 - r2;
+  }
+}
+
+/* samples with the extremes of each format mixed in */
+static void
+make_f32 (float *s, uint32_t n_samples)
+{
+  static const float special[] = { 0.0f, 1.0f, -1.0f, 0.99999994f, -0.99999994f,
+                                   1.5f, -1.5f, 0.5f / 32768.0f, -0.5f / 32768.0f };
+  uint32_t i;
+
+  for (i = 0; i < n_samples; i++) {
+    if (i % 5 == 0)
+      s[i] = special[(i / 5) % SPA_N_ELEMENTS (special)];
+    else
+      s[i] = random_float (1.2f);
+  }
+}
+
+static void
+make_int (void *s, uint32_t size, uint32_t n_samples)
+{
+  uint32_t i;
+
+  for (i = 0; i < n_samples; i++) {
+    int32_t v = next_random () << 8 | (next_random () & 0xff);
+
+    if (i % 7 == 0)
+      v = i % 2 ? INT32_MIN : INT32_MAX;
+    if (size == 2)
+      ((int16_t *) s)[i] = v >> 16;
+    else
+      ((int32_t *) s)[i] = v;
+  }
+}
+
+static void
+test_to_f32 (const char *name, SpaAudioConvertToF32Func func, SpaAudioConvertToF32Func ref,
+             uint32_t size)
+{
+  static uint8_t src[(MAX_SAMPLES + MAX_OFFSET) * 4];
+  static float d1[MAX_SAMPLES + MAX_OFFSET + GUARD], d2[MAX_SAMPLES + MAX_OFFSET + GUARD];
+  uint32_t n, o, i;
+
+  for (o = 0; o < MAX_OFFSET; o++) {
+    for (n = 0; n <= MAX_SAMPLES; n++) {
+      make_int (src, size, n + o);
+      for (i = 0; i < SPA_N_ELEMENTS (d1); i++)
+        d1[i] = d2[i] = -42.0f;
+
+      func (&d1[o], &src[o * size], n);
+      ref (&d2[o], &src[o * size], n);
+
+      for (i = 0; i < SPA_N_ELEMENTS (d1); i++)
+        CHECK (d1[i] == d2[i], "%s: %u samples at %u: %u is %g, not %g",
+            name, n, o, i, d1[i], d2[i]);
+    }
+  }
+}
+
+static void
+test_from_f32 (const char *name, SpaAudioConvertFromF32Func func, SpaAudioConvertFromF32Func ref,
+               uint32_t size, bool use_dither)
+{
+  static float src[MAX_SAMPLES + MAX_OFFSET], dither[MAX_SAMPLES + MAX_OFFSET];
+  static uint8_t d1[(MAX_SAMPLES + MAX_OFFSET + GUARD) * 4], d2[(MAX_SAMPLES + MAX_OFFSET + GUARD) * 4];
+  uint32_t n, o, i;
+
+  for (o = 0; o < MAX_OFFSET; o++) {
+    for (n = 0; n <= MAX_SAMPLES; n++) {
+      make_f32 (src, n + o);
+      make_dither (dither, n + o);
+      memset (d1, 0x5a, sizeof (d1));
+      memset (d2, 0x5a, sizeof (d2));
+
+      func (&d1[o * size], &src[o], use_dither ? &dither[o] : NULL, n);
+      ref (&d2[o * size], &src[o], use_dither ? &dither[o] : NULL, n);
+
+      for (i = 0; i < sizeof (d1); i++)
+        CHECK (d1[i] == d2[i], "%s%s: %u samples at %u: byte %u is %02x, not %02x",
+            name, use_dither ? " dither" : "", n, o, i, d1[i], d2[i]);
+    }
+  }
+}
+
+static void
+test_interleave (const char *name, SpaAudioConvertInterleaveFunc func,
+                 SpaAudioConvertInterleaveFunc ref)
+{
+  static float planes[MAX_CHANNELS][MAX_SAMPLES + MAX_OFFSET];
+  static float d1[MAX_CHANNELS * (MAX_SAMPLES + MAX_OFFSET) + GUARD];
+  static float d2[MAX_CHANNELS * (MAX_SAMPLES + MAX_OFFSET) + GUARD];
+  const float *src[MAX_CHANNELS];
+  uint32_t c, n, o, i;
+
+  for (c = 1; c <= MAX_CHANNELS; c++) {
+    for (o = 0; o < MAX_OFFSET; o++) {
+      for (n = 0; n <= MAX_SAMPLES; n++) {
+        for (i = 0; i < c; i++) {
+          make_f32 (planes[i], n + o);
+          src[i] = &planes[i][o];
+        }
+        for (i = 0; i < SPA_N_ELEMENTS (d1); i++)
+          d1[i] = d2[i] = -42.0f;
+
+        func (&d1[o], src, c, n);
+        ref (&d2[o], src, c, n);
+
+        for (i = 0; i < SPA_N_ELEMENTS (d1); i++)
+          CHECK (d1[i] == d2[i], "%s: %u channels, %u frames at %u: %u is %g, not %g",
+              name, c, n, o, i, d1[i], d2[i]);
+      }
+    }
+  }
+}
+
+static void
+test_deinterleave (const char *name, SpaAudioConvertDeinterleaveFunc func,
+                   SpaAudioConvertDeinterleaveFunc ref)
+{
+  static float src[MAX_CHANNELS * (MAX_SAMPLES + MAX_OFFSET)];
+  static float p1[MAX_CHANNELS][MAX_SAMPLES + MAX_OFFSET + GUARD];
+  static float p2[MAX_CHANNELS][MAX_SAMPLES + MAX_OFFSET + GUARD];
+  float *d1[MAX_CHANNELS], *d2[MAX_CHANNELS];
+  uint32_t c, n, o, i, j;
+
+  for (c = 1; c <= MAX_CHANNELS; c++) {
+    for (o = 0; o < MAX_OFFSET; o++) {
+      for (n = 0; n <= MAX_SAMPLES; n++) {
+        make_f32 (src, c * (n + o));
+        for (i = 0; i < MAX_CHANNELS; i++) {
+          for (j = 0; j < SPA_N_ELEMENTS (p1[i]); j++)
+            p1[i][j] = p2[i][j] = -42.0f;
+          d1[i] = &p1[i][o];
+          d2[i] = &p2[i][o];
+        }
+
+        func (d1, &src[c * o], c, n);
+        ref (d2, &src[c * o], c, n);
+
+        for (i = 0; i < MAX_CHANNELS; i++)
+          for (j = 0; j < SPA_N_ELEMENTS (p1[i]); j++)
+            CHECK (p1[i][j] == p2[i][j], "%s: %u channels, %u frames at %u: %u.%u is %g, not %g",
+                name, c, n, o, i, j, p1[i][j], p2[i][j]);
+      }
+    }
+  }
+}
+
+/* every SIMD kernel gives the same result as the C version */
+static void
+test_kernels (const char *name, const SpaAudioConvertOps *ops)
+{
+  printf ("checking %s kernels\n", name);
+
+  test_to_f32 ("s16_to_f32", ops->s16_to_f32, spa_audioconvert_s16_to_f32_c, 2);
+  test_to_f32 ("s32_to_f32", ops->s32_to_f32, spa_audioconvert_s32_to_f32_c, 4);
+  test_from_f32 ("f32_to_s16", ops->f32_to_s16, spa_audioconvert_f32_to_s16_c, 2, false);
+  test_from_f32 ("f32_to_s16", ops->f32_to_s16, spa_audioconvert_f32_to_s16_c, 2, true);
+  test_from_f32 ("f32_to_s32", ops->f32_to_s32, spa_audioconvert_f32_to_s32_c, 4, false);
+  test_interleave ("interleave_f32", ops->interleave_f32, spa_audioconvert_interleave_f32_c);
+  test_deinterleave ("deinterleave_f32", ops->deinterleave_f32, spa_audioconvert_deinterleave_f32_c);
+}
+
+static int32_t
+s24_get (const uint8_t *p)
+{
+  int32_t v;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  v = p[0] | (p[1] << 8) | (p[2] << 16);
+#else
+  v = p[2] | (p[1] << 8) | (p[0] << 16);
+#endif
+  return (v ^ 0x800000) - 0x800000;
+}
+
+static void
+s24_set (uint8_t *p, int32_t v)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  p[0] = v; p[1] = v >> 8; p[2] = v >> 16;
+#else
+  p[2] = v; p[1] = v >> 8; p[0] = v >> 16;
+#endif
+}
+
+/* integer to F32 and back gives the same value */
+static void
+test_roundtrip (const SpaAudioConvertOps *ops)
+{
+  static int16_t s16[65536], r16[65536];
+  static float f[65536];
+  static uint8_t s24[65536 * 3], r24[65536 * 3];
+  static int32_t s32[65536], r32[65536];
+  uint32_t i;
+
+  printf ("checking round trips\n");
+
+  for (i = 0; i < 65536; i++)
+    s16[i] = i - 32768;
+  ops->s16_to_f32 (f, s16, 65536);
+  ops->f32_to_s16 (r16, f, NULL, 65536);
+  for (i = 0; i < 65536; i++)
+    CHECK (r16[i] == s16[i], "s16 %d comes back as %d", s16[i], r16[i]);
+
+  /* 256 steps over the whole S24 range and the extremes */
+  for (i = 0; i < 65536; i++)
+    s24_set (&s24[i * 3], i == 65535 ? 0x7fffff : (int32_t) (i * 256 + (i & 0xff)) - 0x800000);
+  ops->s24_to_f32 (f, s24, 65536);
+  ops->f32_to_s24 (r24, f, NULL, 65536);
+  for (i = 0; i < 65536; i++)
+    CHECK (s24_get (&r24[i * 3]) == s24_get (&s24[i * 3]), "s24 %d comes back as %d",
+        s24_get (&s24[i * 3]), s24_get (&r24[i * 3]));
+
+  /* the top byte of S24_32 is ignored */
+  for (i = 0; i < 65536; i++)
+    s32[i] = (i == 65535 ? 0x7fffff : (int32_t) (i * 256 + (i & 0xff)) - 0x800000) ^
+             (next_random () << 24);
+  ops->s24_32_to_f32 (f, s32, 65536);
+  ops->f32_to_s24_32 (r32, f, NULL, 65536);
+  for (i = 0; i < 65536; i++)
+    CHECK (r32[i] == ((int32_t) ((uint32_t) s32[i] << 8) >> 8), "s24_32 %08x comes back as %08x",
+        s32[i], r32[i]);
+
+  /* a float has 24 bits, S32 comes back to within half its precision */
+  make_int (s32, 4, 65536);
+  ops->s32_to_f32 (f, s32, 65536);
+  ops->f32_to_s32 (r32, f, NULL, 65536);
+  for (i = 0; i < 65536; i++)
+    CHECK (llabs ((int64_t) r32[i] - s32[i]) <= 128, "s32 %d comes back as %d", s32[i], r32[i]);
+
+  /* F32 to S16 and back is within half an LSB, out of range values clamp */
+  make_f32 (f, 65536);
+  ops->f32_to_s16 (r16, f, NULL, 65536);
+  for (i = 0; i < 65536; i++) {
+    float expect = SPA_CLAMP (f[i], -1.0f, 32767.0f / 32768.0f);
+
+    CHECK (fabsf (r16[i] / 32768.0f - expect) <= 0.5f / 32768.0f, "f32 %g is s16 %d", f[i], r16[i]);
+  }
+}
+
+/* dither adds at most 1 LSB of noise and does not move the average */
+static void
+test_dither (const char *name, SpaAudioConvertFromF32Func func, uint32_t size, float scale)
+{
+  static const float levels[] = { 0.0f, 0.25f, 0.5f, -0.75f, 100.3f, -1000.5f };
+  static float src[N_DITHER], dither[N_DITHER];
+  static uint8_t dst[N_DITHER * 4];
+  uint32_t l, i;
+
+  for (l = 0; l < SPA_N_ELEMENTS (levels); l++) {
+    double sum = 0.0;
+    float min = 1e9, max = -1e9;
+
+    for (i = 0; i < N_DITHER; i++)
+      src[i] = levels[l] / scale;
+    make_dither (dither, N_DITHER);
+    func (dst, src, dither, N_DITHER);
+
+    for (i = 0; i < N_DITHER; i++) {
+      float v;
+
+      if (size == 2)
+        v = ((int16_t *) dst)[i];
+      else if (size == 3)
+        v = s24_get (&dst[i * 3]);
+      else
+        v = ((int32_t *) dst)[i];
+
+      sum += v;
+      min = SPA_MIN (min, v);
+      max = SPA_MAX (max, v);
+    }
+    CHECK (min >= levels[l] - 1.5f && max <= levels[l] + 1.5f,
+        "%s: level %g dithered to [%g, %g]", name, levels[l], min, max);
+    CHECK (fabs (sum / N_DITHER - levels[l]) < 0.02,
+        "%s: level %g averages %g", name, levels[l], sum / N_DITHER);
+  }
+}
+
+static void
+test_ops (const char *name, const SpaAudioConvertOps *ops)
+{
+  test_roundtrip (ops);
+
+  printf ("checking dither\n");
+  test_dither ("f32_to_s16", ops->f32_to_s16, 2, SPA_AUDIOCONVERT_S16_SCALE);
+  test_dither ("f32_to_s24", ops->f32_to_s24, 3, SPA_AUDIOCONVERT_S24_SCALE);
+  test_dither ("f32_to_s24_32", ops->f32_to_s24_32, 4, SPA_AUDIOCONVERT_S24_SCALE);
+}
+
+int
+main (int argc, char *argv[])
+{
+  static const struct {
+    const char *name;
+    uint32_t flag;
+  } simd[] = {
+    { "sse2", SPA_CPU_FLAG_SSE2 },
+    { "avx2", SPA_CPU_FLAG_AVX2 },
+    { "neon", SPA_CPU_FLAG_NEON },
+  };
+  SpaAudioConvertOps ops;
+  uint32_t i, cpu_flags = spa_cpu_get_flags ();
+
+  spa_audioconvert_ops_init (&ops, 0);
+  printf ("checking c\n");
+  test_ops ("c", &ops);
+
+  for (i = 0; i < SPA_N_ELEMENTS (simd); i++) {
+    if (!(cpu_flags & simd[i].flag))
+      continue;
+    /* not built for this machine */
+    spa_audioconvert_ops_init (&ops, simd[i].flag);
+    if (ops.cpu_flags != simd[i].flag)
+      continue;
+
+    test_kernels (simd[i].name, &ops);
+    printf ("checking %s\n", simd[i].name);
+    test_ops (simd[i].name, &ops);
+  }
+
+  if (failures) {
+    printf ("%u failures\n", failures);
+    return 1;
+  }
+  printf ("all passed\n");
+  return 0;
+}
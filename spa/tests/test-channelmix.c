@@ -0,0 +1,248 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <spa/defs.h>
+#include <spa/audio/raw.h>
+#include <lib/cpu.h>
+
+#include <plugins/channelmix/channelmix-ops.h>
+
+/* up to and past SPA_CHANNELMIX_MAX_VECTOR, where the kernels fall back
+ * to C */
+#define MAX_CHANNELS    10
+#define MAX_FRAMES      37
+#define GUARD           16
+
+#define FL   SPA_AUDIO_CHANNEL_FL
+#define FR   SPA_AUDIO_CHANNEL_FR
+#define FC   SPA_AUDIO_CHANNEL_FC
+#define LFE  SPA_AUDIO_CHANNEL_LFE
+#define RL   SPA_AUDIO_CHANNEL_RL
+#define RR   SPA_AUDIO_CHANNEL_RR
+#define SL   SPA_AUDIO_CHANNEL_SL
+#define SR   SPA_AUDIO_CHANNEL_SR
+
+#define M3DB  0.7071067811865476f
+
+static uint32_t failures;
+static uint32_t seed = 1;
+
+#define CHECK(expr, ...)                        \
+  do {                                          \
+    if (!(expr)) {                              \
+      if (failures++ < 20) {                    \
+        printf ("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf (__VA_ARGS__);                   \
+        printf ("\n");                          \
+      }                                         \
+    }                                           \
+  } while (0)
+
+static float
+random_float (void)
+{
+  seed = seed * 1103515245 + 12345;
+  return ((seed >> 8) & 0xffff) / 32767.5f - 1.0f;
+}
+
+/* every SIMD kernel gives the same frames as the C version for all
+ * channel counts and lengths and does not write past the last frame */
+static void
+test_kernel (const char *name, SpaChannelMixFunc func)
+{
+  static SpaChannelMixMatrix mix;
+  static float src[MAX_FRAMES * MAX_CHANNELS];
+  static float d1[MAX_FRAMES * MAX_CHANNELS + GUARD], d2[MAX_FRAMES * MAX_CHANNELS + GUARD];
+  uint32_t n_dst, n_src, n, i, j;
+
+  for (n_dst = 1; n_dst <= MAX_CHANNELS; n_dst++) {
+    for (n_src = 1; n_src <= MAX_CHANNELS; n_src++) {
+      mix.n_dst = n_dst;
+      mix.n_src = n_src;
+      for (i = 0; i < n_dst; i++)
+        for (j = 0; j < n_src; j++)
+          mix.matrix[i][j] = random_float ();
+      spa_channelmix_prepare (&mix);
+
+      for (n = 0; n <= MAX_FRAMES; n++) {
+        for (i = 0; i < n * n_src; i++)
+          src[i] = random_float ();
+        for (i = 0; i < SPA_N_ELEMENTS (d1); i++)
+          d1[i] = d2[i] = -42.0f;
+
+        func (&mix, d1, src, n);
+        spa_channelmix_matrix_c (&mix, d2, src, n);
+
+        for (i = 0; i < SPA_N_ELEMENTS (d1); i++)
+          CHECK (fabsf (d1[i] - d2[i]) <= 1e-5f, "%s: %u -> %u channels, %u frames: %u is %g, not %g",
+              name, n_src, n_dst, n, i, d1[i], d2[i]);
+      }
+    }
+  }
+}
+
+typedef struct {
+  const char *name;
+  uint32_t src_mask;
+  uint32_t dst_mask;
+  bool normalize;
+  SpaChannelMixKind kind;
+  /* gains of the output channel, from the input channel, the others are 0 */
+  struct {
+    uint32_t dst;
+    uint32_t src;
+    float gain;
+  } gains[12];
+} Layout;
+
+#define N1 (1.0f / (1.0f + 2.0f * M3DB))
+
+static const Layout layouts[] = {
+  { "mono -> stereo", FC, FL | FR, false, SPA_CHANNELMIX_MATRIX,
+    { { FL, FC, M3DB }, { FR, FC, M3DB }, } },
+  { "stereo -> mono", FL | FR, FC, false, SPA_CHANNELMIX_MATRIX,
+    { { FC, FL, M3DB }, { FC, FR, M3DB }, } },
+  { "stereo -> mono normalized", FL | FR, FC, true, SPA_CHANNELMIX_MATRIX,
+    { { FC, FL, 0.5f }, { FC, FR, 0.5f }, } },
+  { "quad -> stereo", FL | FR | RL | RR, FL | FR, false, SPA_CHANNELMIX_MATRIX,
+    { { FL, FL, 1.0f }, { FL, RL, M3DB }, { FR, FR, 1.0f }, { FR, RR, M3DB }, } },
+  { "5.1 -> stereo", FL | FR | FC | LFE | RL | RR, FL | FR, false, SPA_CHANNELMIX_MATRIX,
+    { { FL, FL, 1.0f }, { FL, FC, M3DB }, { FL, RL, M3DB },
+      { FR, FR, 1.0f }, { FR, FC, M3DB }, { FR, RR, M3DB }, } },
+  { "5.1 -> stereo normalized", FL | FR | FC | LFE | RL | RR, FL | FR, true, SPA_CHANNELMIX_MATRIX,
+    { { FL, FL, N1 }, { FL, FC, M3DB * N1 }, { FL, RL, M3DB * N1 },
+      { FR, FR, N1 }, { FR, FC, M3DB * N1 }, { FR, RR, M3DB * N1 }, } },
+  { "7.1 -> 5.1", FL | FR | FC | LFE | RL | RR | SL | SR, FL | FR | FC | LFE | RL | RR, false,
+    SPA_CHANNELMIX_MATRIX,
+    { { FL, FL, 1.0f }, { FR, FR, 1.0f }, { FC, FC, 1.0f }, { LFE, LFE, 1.0f },
+      { RL, RL, 1.0f }, { RL, SL, 1.0f }, { RR, RR, 1.0f }, { RR, SR, 1.0f }, } },
+  { "stereo -> 5.1", FL | FR, FL | FR | FC | LFE | RL | RR, false, SPA_CHANNELMIX_REMAP,
+    { { FL, FL, 1.0f }, { FR, FR, 1.0f }, } },
+  { "5.1 -> 5.1", FL | FR | FC | LFE | RL | RR, FL | FR | FC | LFE | RL | RR, false,
+    SPA_CHANNELMIX_IDENTITY,
+    { { FL, FL, 1.0f }, { FR, FR, 1.0f }, { FC, FC, 1.0f }, { LFE, LFE, 1.0f },
+      { RL, RL, 1.0f }, { RR, RR, 1.0f }, } },
+};
+
+static uint32_t
+channel_index (uint32_t mask, uint32_t position)
+{
+  return __builtin_popcount (mask & (position - 1));
+}
+
+/* the default matrices of the standard layouts and the way they are
+ * applied */
+static void
+test_layouts (const SpaChannelMixOps *ops)
+{
+  static SpaChannelMixMatrix mix;
+  static float src[MAX_FRAMES * MAX_CHANNELS], dst[MAX_FRAMES * MAX_CHANNELS];
+  uint32_t l, i, j, k, f;
+
+  for (l = 0; l < SPA_N_ELEMENTS (layouts); l++) {
+    const Layout *t = &layouts[l];
+    float expect[MAX_CHANNELS][MAX_CHANNELS];
+
+    memset (expect, 0, sizeof (expect));
+    for (k = 0; k < SPA_N_ELEMENTS (t->gains) && t->gains[k].dst; k++)
+      expect[channel_index (t->dst_mask, t->gains[k].dst)][channel_index (t->src_mask, t->gains[k].src)] =
+          t->gains[k].gain;
+
+    mix.n_dst = __builtin_popcount (t->dst_mask);
+    mix.n_src = __builtin_popcount (t->src_mask);
+    spa_channelmix_default_matrix (&mix, t->dst_mask, t->src_mask, t->normalize);
+    spa_channelmix_prepare (&mix);
+
+    for (i = 0; i < mix.n_dst; i++)
+      for (j = 0; j < mix.n_src; j++)
+        CHECK (fabsf (mix.matrix[i][j] - expect[i][j]) < 1e-6f, "%s: gain %u from %u is %g, not %g",
+            t->name, i, j, mix.matrix[i][j], expect[i][j]);
+    CHECK (mix.kind == t->kind, "%s: kind %d, not %d", t->name, mix.kind, t->kind);
+
+    for (i = 0; i < MAX_FRAMES * mix.n_src; i++)
+      src[i] = random_float ();
+    spa_channelmix_process (ops, &mix, dst, src, MAX_FRAMES);
+
+    for (f = 0; f < MAX_FRAMES; f++) {
+      for (i = 0; i < mix.n_dst; i++) {
+        float sum = 0.0f;
+
+        for (j = 0; j < mix.n_src; j++)
+          sum += expect[i][j] * src[f * mix.n_src + j];
+        CHECK (fabsf (dst[f * mix.n_dst + i] - sum) < 1e-5f, "%s: frame %u channel %u is %g, not %g",
+            t->name, f, i, dst[f * mix.n_dst + i], sum);
+      }
+    }
+  }
+
+  /* without a usual layout the channels are copied in order */
+  mix.n_dst = 9;
+  mix.n_src = 10;
+  spa_channelmix_default_matrix (&mix, 0, 0, true);
+  spa_channelmix_prepare (&mix);
+  for (i = 0; i < mix.n_dst; i++)
+    for (j = 0; j < mix.n_src; j++)
+      CHECK (mix.matrix[i][j] == (i == j ? 1.0f : 0.0f), "10 -> 9: gain %u from %u is %g",
+          i, j, mix.matrix[i][j]);
+  CHECK (mix.kind == SPA_CHANNELMIX_REMAP, "10 -> 9: kind %d", mix.kind);
+}
+
+int
+main (int argc, char *argv[])
+{
+  static const struct {
+    const char *name;
+    uint32_t flag;
+  } simd[] = {
+    { "sse2", SPA_CPU_FLAG_SSE2 },
+    { "avx2", SPA_CPU_FLAG_AVX2 },
+    { "neon", SPA_CPU_FLAG_NEON },
+  };
+  SpaChannelMixOps ops;
+  uint32_t i, cpu_flags = spa_cpu_get_flags ();
+
+  printf ("checking c\n");
+  spa_channelmix_ops_init (&ops, 0);
+  test_layouts (&ops);
+
+  for (i = 0; i < SPA_N_ELEMENTS (simd); i++) {
+    if (!(cpu_flags & simd[i].flag))
+      continue;
+    /* not built for this machine */
+    spa_channelmix_ops_init (&ops, simd[i].flag);
+    if (ops.cpu_flags != simd[i].flag)
+      continue;
+
+    printf ("checking %s\n", simd[i].name);
+    test_kernel (simd[i].name, ops.matrix);
+    test_layouts (&ops);
+  }
+
+  if (failures) {
+    printf ("%u failures\n", failures);
+    return 1;
+  }
+  printf ("all passed\n");
+  return 0;
+}
@@ -25,6 +25,9 @@
 #include <errno.h>
 #include <pthread.h>
 #include <poll.h>
+#include <time.h>
+#include <inttypes.h>
+#include <math.h>
 
 #include <spa/node.h>
 #include <spa/log.h>
@@ -36,6 +39,8 @@
 #include <lib/mapper.h>
 #include <lib/debug.h>
 #include <lib/props.h>
+#include <lib/cpu.h>
+#include <lib/mix-ops.h>
 
 typedef struct {
   uint32_t node;
@@ -46,6 +51,12 @@ typedef struct {
   uint32_t props_volume;
   uint32_t props_min_latency;
   uint32_t props_live;
+  uint32_t props_bytes;
+  uint32_t props_cycles;
+  uint32_t props_xruns;
+  uint32_t props_min_cycle_time;
+  uint32_t props_max_cycle_time;
+  uint32_t props_avg_cycle_time;
   SpaTypeMeta meta;
   SpaTypeData data;
   SpaTypeMediaType media_type;
@@ -67,6 +78,12 @@ init_type (Type *type, SpaTypeMap *map)
   type->props_volume = spa_type_map_get_id (map, SPA_TYPE_PROPS__volume);
   type->props_min_latency = spa_type_map_get_id (map, SPA_TYPE_PROPS__minLatency);
   type->props_live = spa_type_map_get_id (map, SPA_TYPE_PROPS__live);
+  type->props_bytes = spa_type_map_get_id (map, SPA_TYPE_PROPS__bytes);
+  type->props_cycles = spa_type_map_get_id (map, SPA_TYPE_PROPS__cycles);
+  type->props_xruns = spa_type_map_get_id (map, SPA_TYPE_PROPS__xruns);
+  type->props_min_cycle_time = spa_type_map_get_id (map, SPA_TYPE_PROPS__minCycleTime);
+  type->props_max_cycle_time = spa_type_map_get_id (map, SPA_TYPE_PROPS__maxCycleTime);
+  type->props_avg_cycle_time = spa_type_map_get_id (map, SPA_TYPE_PROPS__avgCycleTime);
   spa_type_meta_map (map, &type->meta);
   spa_type_data_map (map, &type->data);
   spa_type_media_type_map (map, &type->media_type);
@@ -95,6 +112,7 @@ typedef struct {
   uint32_t   n_support;
 
   SpaNode *sink;
+  bool null_sink;
   SpaPortIO mix_sink_io[1];
 
   SpaNode *mix;
@@ -114,6 +132,7 @@ typedef struct {
 
   bool running;
   pthread_t thread;
+  unsigned int duration;
 
   SpaSource sources[16];
   unsigned int n_sources;
@@ -165,9 +184,8 @@ init_buffer (AppData *data, SpaBuffer **bufs, Buffer *ba, int n_buffers, size_t
 }
 
 static SpaResult
-make_node (AppData *data, SpaNode **node, const char *lib, const char *name)
+make_handle (AppData *data, SpaHandle **handle, const char *lib, const char *name, const SpaDict *info)
 {
-  SpaHandle *handle;
   SpaResult res;
   void *hnd;
   SpaEnumHandleFactoryFunc enum_func;
@@ -185,7 +203,6 @@ make_node (AppData *data, SpaNode **node, const char *lib, const char *name)
 
   for (i = 0; ;i++) {
     const SpaHandleFactory *factory;
-    void *iface;
 
     if ((res = enum_func (&factory, state++)) < 0) {
       if (res != SPA_RESULT_ENUM_END)
@@ -195,21 +212,35 @@ make_node (AppData *data, SpaNode **node, const char *lib, const char *name)
     if (strcmp (factory->name, name))
       continue;
 
-    handle = calloc (1, factory->size);
-    if ((res = spa_handle_factory_init (factory, handle, NULL, data->support, data->n_support)) < 0) {
+    *handle = calloc (1, factory->size);
+    if ((res = spa_handle_factory_init (factory, *handle, info, data->support, data->n_support)) < 0) {
       printf ("can't make factory instance: %d\n", res);
+      free (*handle);
       return res;
     }
-    if ((res = spa_handle_get_interface (handle, data->type.node, &iface)) < 0) {
-      printf ("can't get interface %d\n", res);
-      return res;
-    }
-    *node = iface;
     return SPA_RESULT_OK;
   }
   return SPA_RESULT_ERROR;
 }
 
+static SpaResult
+make_node (AppData *data, SpaNode **node, const char *lib, const char *name, const SpaDict *info)
+{
+  SpaHandle *handle;
+  SpaResult res;
+  void *iface;
+
+  if ((res = make_handle (data, &handle, lib, name, info)) < 0)
+    return res;
+
+  if ((res = spa_handle_get_interface (handle, data->type.node, &iface)) < 0) {
+    printf ("can't get interface %d\n", res);
+    return res;
+  }
+  *node = iface;
+  return SPA_RESULT_OK;
+}
+
 static void
 on_sink_event (SpaNode *node, SpaEvent *event, void *user_data)
 {
@@ -311,33 +342,49 @@ make_nodes (AppData *data, const char *device)
   SpaPODFrame f[2];
   uint8_t buffer[128];
 
-  if ((res = make_node (data, &data->sink,
-                        "build/spa/plugins/alsa/libspa-alsa.so",
-                        "alsa-sink")) < 0) {
-    printf ("can't create alsa-sink: %d\n", res);
-    return res;
-  }
-  spa_node_set_callbacks (data->sink, &sink_callbacks, sizeof (sink_callbacks), data);
+  if (data->null_sink) {
+    if ((res = make_node (data, &data->sink,
+                          "build/spa/plugins/null/libspa-null.so",
+                          "null-sink", NULL)) < 0) {
+      printf ("can't create null-sink: %d\n", res);
+      return res;
+    }
+    spa_node_set_callbacks (data->sink, &sink_callbacks, sizeof (sink_callbacks), data);
 
-  spa_pod_builder_init (&b, buffer, sizeof (buffer));
-  spa_pod_builder_props (&b, &f[0], data->type.props,
-      SPA_POD_PROP (&f[1], data->type.props_device, 0, SPA_POD_TYPE_STRING, 1, device ? device : "hw:0"),
-      SPA_POD_PROP (&f[1], data->type.props_min_latency, 0, SPA_POD_TYPE_INT, 1, MIN_LATENCY));
-  props = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaProps);
+    /* consume as fast as the graph can produce */
+    spa_pod_builder_init (&b, buffer, sizeof (buffer));
+    spa_pod_builder_props (&b, &f[0], data->type.props,
+        SPA_POD_PROP (&f[1], data->type.props_live, 0, SPA_POD_TYPE_BOOL, 1, false));
+    props = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaProps);
+  } else {
+    if ((res = make_node (data, &data->sink,
+                          "build/spa/plugins/alsa/libspa-alsa.so",
+                          "alsa-sink", NULL)) < 0) {
+      printf ("can't create alsa-sink: %d\n", res);
+      return res;
+    }
+    spa_node_set_callbacks (data->sink, &sink_callbacks, sizeof (sink_callbacks), data);
+
+    spa_pod_builder_init (&b, buffer, sizeof (buffer));
+    spa_pod_builder_props (&b, &f[0], data->type.props,
+        SPA_POD_PROP (&f[1], data->type.props_device, 0, SPA_POD_TYPE_STRING, 1, device ? device : "hw:0"),
+        SPA_POD_PROP (&f[1], data->type.props_min_latency, 0, SPA_POD_TYPE_INT, 1, MIN_LATENCY));
+    props = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaProps);
+  }
 
   if ((res = spa_node_set_props (data->sink, props)) < 0)
     printf ("got set_props error %d\n", res);
 
   if ((res = make_node (data, &data->mix,
                         "build/spa/plugins/audiomixer/libspa-audiomixer.so",
-                        "audiomixer")) < 0) {
+                        "audiomixer", NULL)) < 0) {
     printf ("can't create audiomixer: %d\n", res);
     return res;
   }
 
   if ((res = make_node (data, &data->source1,
                         "build/spa/plugins/audiotestsrc/libspa-audiotestsrc.so",
-                        "audiotestsrc")) < 0) {
+                        "audiotestsrc", NULL)) < 0) {
     printf ("can't create audiotestsrc: %d\n", res);
     return res;
   }
@@ -354,7 +401,7 @@ make_nodes (AppData *data, const char *device)
 
   if ((res = make_node (data, &data->source2,
                         "build/spa/plugins/audiotestsrc/libspa-audiotestsrc.so",
-                        "audiotestsrc")) < 0) {
+                        "audiotestsrc", NULL)) < 0) {
     printf ("can't create audiotestsrc: %d\n", res);
     return res;
   }
@@ -514,6 +561,29 @@ loop (void *user_data)
   return NULL;
 }
 
+static void
+print_sink_stats (AppData *data)
+{
+  SpaProps *props;
+  int64_t bytes = 0, cycles = 0, min_cycle = 0, max_cycle = 0, avg_cycle = 0;
+  int32_t xruns = 0;
+
+  if (spa_node_get_props (data->sink, &props) < 0)
+    return;
+
+  spa_props_query (props,
+      data->type.props_bytes,          SPA_POD_TYPE_LONG, &bytes,
+      data->type.props_cycles,         SPA_POD_TYPE_LONG, &cycles,
+      data->type.props_xruns,          SPA_POD_TYPE_INT,  &xruns,
+      data->type.props_min_cycle_time, SPA_POD_TYPE_LONG, &min_cycle,
+      data->type.props_max_cycle_time, SPA_POD_TYPE_LONG, &max_cycle,
+      data->type.props_avg_cycle_time, SPA_POD_TYPE_LONG, &avg_cycle,
+      0);
+
+  printf ("consumed %"PRIi64" bytes in %"PRIi64" cycles, %d xruns\n", bytes, cycles, xruns);
+  printf ("cycle time min %"PRIi64" max %"PRIi64" avg %"PRIi64" ns\n", min_cycle, max_cycle, avg_cycle);
+}
+
 static void
 run_async_sink (AppData *data)
 {
@@ -538,8 +608,8 @@ run_async_sink (AppData *data)
     data->running = false;
   }
 
-  printf ("sleeping for 1000 seconds\n");
-  sleep (1000);
+  printf ("sleeping for %u seconds\n", data->duration);
+  sleep (data->duration);
 
   if (data->running) {
     data->running = false;
@@ -557,6 +627,269 @@ run_async_sink (AppData *data)
     if ((res = spa_node_send_command (data->source2, &cmd)) < 0)
       printf ("got source2 error %d\n", res);
   }
+
+  if (data->null_sink)
+    print_sink_stats (data);
+}
+
+#define BENCH_PORTS     64
+#define BENCH_CHANNELS  2
+#define BENCH_RATE      48000
+#define BENCH_FRAMES    1024
+#define BENCH_CYCLES    20000
+
+#define CHECK_SOURCES   5
+#define CHECK_SAMPLES   67
+#define CHECK_GUARD     8
+
+/* compare the kernels selected for @flag against the C versions for a
+ * few sources, channel counts and lengths that leave a tail, with and
+ * without a gain ramp. S32 has no SIMD kernels, it accumulates in 64 bits
+ * and SSE2/AVX2 have no 64 bit min/max to clamp with, NEON has no
+ * s16_gain kernel; those are the C versions and compare trivially */
+static uint32_t
+check_kernels (const char *name, uint32_t flag)
+{
+  static int16_t s16[CHECK_SOURCES][CHECK_SAMPLES], d16[2][CHECK_SAMPLES + CHECK_GUARD];
+  static int32_t s32[CHECK_SOURCES][CHECK_SAMPLES], d32[2][CHECK_SAMPLES + CHECK_GUARD];
+  static float f32[CHECK_SOURCES][CHECK_SAMPLES], df[2][CHECK_SAMPLES + CHECK_GUARD];
+  const void *src16[CHECK_SOURCES], *src32[CHECK_SOURCES], *srcf[CHECK_SOURCES];
+  float gain[CHECK_SOURCES], step[CHECK_SOURCES];
+  SpaAudioMixerOps ops;
+  uint32_t failures = 0, n_src, n_channels, n, i, j, seed = 1;
+
+  spa_audiomixer_ops_init (&ops, flag);
+  if (ops.cpu_flags != flag)
+    return 0;
+
+  for (j = 0; j < CHECK_SOURCES; j++) {
+    for (i = 0; i < CHECK_SAMPLES; i++) {
+      seed = seed * 1103515245 + 12345;
+      /* large enough for the integer sums to clip */
+      s16[j][i] = (int16_t) (seed >> 16);
+      s32[j][i] = (int32_t) seed;
+      f32[j][i] = (int16_t) (seed >> 16) / 32768.0f;
+    }
+    src16[j] = s16[j];
+    src32[j] = s32[j];
+    srcf[j] = f32[j];
+    gain[j] = 0.2f + 0.3f * j;
+    step[j] = (j & 1 ? -1.0f : 1.0f) / 512.0f;
+  }
+
+#define COMPARE(d,fmt,abs_tol,rel_tol)                                          \
+  for (i = 0; i < SPA_N_ELEMENTS (d[0]); i++) {                                 \
+    if (fabs ((double) d[0][i] - d[1][i]) > (abs_tol) + (rel_tol) * fabs (d[1][i])) { \
+      if (failures++ < 20)                                                      \
+        printf ("%s: " fmt ": %u sources, %u channels, %u samples: %u is %g, not %g\n", \
+            name, n_src, n_channels, n, i, (double) d[0][i], (double) d[1][i]); \
+    }                                                                           \
+  }
+#define RUN(d,src,func,c_func,...)                                              \
+  memset (d, 0x55, sizeof (d));                                                 \
+  func (d[0], src, __VA_ARGS__);                                                \
+  c_func (d[1], src, __VA_ARGS__);
+
+  for (n_src = 1; n_src <= CHECK_SOURCES; n_src++) {
+    for (n_channels = 1; n_channels <= 3; n_channels++) {
+      for (n = 0; n <= CHECK_SAMPLES - n_channels; n += n_channels) {
+        RUN (d16, src16, ops.mix_s16, spa_audiomixer_mix_s16_c, n_src, n);
+        COMPARE (d16, "mix_s16", 0, 0);
+        RUN (d32, src32, ops.mix_s32, spa_audiomixer_mix_s32_c, n_src, n);
+        COMPARE (d32, "mix_s32", 0, 0);
+        RUN (df, srcf, ops.mix_f32, spa_audiomixer_mix_f32_c, n_src, n);
+        COMPARE (df, "mix_f32", 1e-6, 1e-6);
+        /* the SIMD versions may round the gain ramp differently */
+        RUN (d16, src16, ops.mix_s16_gain, spa_audiomixer_mix_s16_gain_c, gain, step, n_channels, n_src, n);
+        COMPARE (d16, "mix_s16_gain", 1, 0);
+        RUN (d32, src32, ops.mix_s32_gain, spa_audiomixer_mix_s32_gain_c, gain, step, n_channels, n_src, n);
+        COMPARE (d32, "mix_s32_gain", 0, 0);
+        RUN (df, srcf, ops.mix_f32_gain, spa_audiomixer_mix_f32_gain_c, gain, step, n_channels, n_src, n);
+        COMPARE (df, "mix_f32_gain", 1e-5, 1e-5);
+      }
+    }
+  }
+#undef RUN
+#undef COMPARE
+
+  printf ("%s kernels: %s\n", name, failures ? "FAILED" : "ok");
+  return failures;
+}
+
+typedef struct {
+  SpaPortIO  io[BENCH_PORTS + 1];
+  SpaBuffer *buffers[BENCH_PORTS + 1];
+  Buffer     buffer[BENCH_PORTS + 1];
+} BenchData;
+
+static SpaResult
+benchmark_mixer (AppData *data, BenchData *bd, uint32_t n_ports, uint32_t sample_format,
+                 double volume, const char *cpu_mask)
+{
+  SpaResult res;
+  SpaHandle *handle;
+  void *iface;
+  SpaNode *mix;
+  SpaFormat *format, *filter;
+  SpaProps *props;
+  SpaPODBuilder b = { 0 };
+  SpaPODFrame f[2];
+  uint8_t buffer[256];
+  SpaDictItem items[1];
+  SpaDict info;
+  bool is_float = sample_format == data->type.audio_format.F32;
+  size_t size = BENCH_FRAMES * BENCH_CHANNELS * (is_float ? sizeof (float) : sizeof (int16_t));
+  struct timespec t1, t2;
+  int64_t elapsed;
+  uint32_t i, j;
+
+  items[0].key = SPA_CPU_INFO_MASK;
+  items[0].value = cpu_mask;
+  info.n_items = cpu_mask ? 1 : 0;
+  info.items = items;
+
+  init_buffer (data, bd->buffers, bd->buffer, n_ports + 1, size);
+
+  if ((res = make_handle (data, &handle,
+                          "build/spa/plugins/audiomixer/libspa-audiomixer.so",
+                          "audiomixer", &info)) < 0) {
+    printf ("can't create audiomixer: %d\n", res);
+    goto done_buffers;
+  }
+  if ((res = spa_handle_get_interface (handle, data->type.node, &iface)) < 0)
+    goto done;
+  mix = iface;
+
+  spa_pod_builder_init (&b, buffer, sizeof (buffer));
+  spa_pod_builder_format (&b, &f[0], data->type.format,
+      data->type.media_type.audio, data->type.media_subtype.raw,
+      SPA_POD_PROP (&f[1], data->type.format_audio.format, 0,
+                           SPA_POD_TYPE_ID,  1,
+                           sample_format),
+      SPA_POD_PROP (&f[1], data->type.format_audio.rate, 0,
+                           SPA_POD_TYPE_INT, 1,
+                           BENCH_RATE),
+      SPA_POD_PROP (&f[1], data->type.format_audio.channels, 0,
+                           SPA_POD_TYPE_INT, 1,
+                           BENCH_CHANNELS));
+  filter = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaFormat);
+
+  if ((res = spa_node_port_enum_formats (mix, SPA_DIRECTION_OUTPUT, 0, &format, filter, 0)) < 0)
+    goto done;
+
+  spa_node_port_set_io (mix, SPA_DIRECTION_OUTPUT, 0, &bd->io[0]);
+  if ((res = spa_node_port_set_format (mix, SPA_DIRECTION_OUTPUT, 0, 0, format)) < 0)
+    goto done;
+  if ((res = spa_node_port_use_buffers (mix, SPA_DIRECTION_OUTPUT, 0, &bd->buffers[0], 1)) < 0)
+    goto done;
+
+  for (i = 0; i < n_ports; i++) {
+    void *p = bd->buffers[i + 1]->datas[0].data;
+
+    if (is_float) {
+      for (j = 0; j < size / sizeof (float); j++)
+        ((float *) p)[j] = (float) rand () / RAND_MAX - 0.5f;
+    } else {
+      for (j = 0; j < size / sizeof (int16_t); j++)
+        ((int16_t *) p)[j] = (rand () & 0xffff) - 0x8000;
+    }
+
+    /* every input port has a single buffer, with id 0 on that port */
+    bd->buffers[i + 1]->id = 0;
+
+    if ((res = spa_node_add_port (mix, SPA_DIRECTION_INPUT, i)) < 0)
+      goto done;
+    spa_node_port_set_io (mix, SPA_DIRECTION_INPUT, i, &bd->io[i + 1]);
+    if ((res = spa_node_port_set_format (mix, SPA_DIRECTION_INPUT, i, 0, format)) < 0)
+      goto done;
+    if ((res = spa_node_port_use_buffers (mix, SPA_DIRECTION_INPUT, i, &bd->buffers[i + 1], 1)) < 0)
+      goto done;
+  }
+
+  spa_pod_builder_init (&b, buffer, sizeof (buffer));
+  spa_pod_builder_props (&b, &f[0], data->type.props,
+      SPA_POD_PROP (&f[1], data->type.props_volume, 0, SPA_POD_TYPE_DOUBLE, 1, volume));
+  props = SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaProps);
+
+  for (i = 0; i < n_ports; i++) {
+    if ((res = spa_node_port_set_props (mix, SPA_DIRECTION_INPUT, i, props)) < 0)
+      goto done;
+  }
+
+  clock_gettime (CLOCK_MONOTONIC, &t1);
+  for (i = 0; i < BENCH_CYCLES; i++) {
+    for (j = 1; j <= n_ports; j++) {
+      bd->io[j].status = SPA_RESULT_HAVE_BUFFER;
+      bd->io[j].buffer_id = 0;
+    }
+    bd->io[0].status = SPA_RESULT_OK;
+
+    if ((res = spa_node_process_input (mix)) != SPA_RESULT_HAVE_BUFFER) {
+      printf ("got process_input error from mixer %d\n", res);
+      goto done;
+    }
+    spa_node_port_reuse_buffer (mix, 0, bd->io[0].buffer_id);
+  }
+  clock_gettime (CLOCK_MONOTONIC, &t2);
+
+  elapsed = SPA_TIMESPEC_TO_TIME (&t2) - SPA_TIMESPEC_TO_TIME (&t1);
+  printf ("%s volume %.1f cpu mask %-6s: %u ports, %d frames: %8"PRIi64" ns/cycle, %7.1fx realtime\n",
+      is_float ? "F32" : "S16", volume, cpu_mask ? cpu_mask : "auto", n_ports, BENCH_FRAMES, elapsed / BENCH_CYCLES,
+      ((double) BENCH_CYCLES * BENCH_FRAMES * SPA_NSEC_PER_SEC / BENCH_RATE) / elapsed);
+  res = SPA_RESULT_OK;
+
+done:
+  spa_handle_clear (handle);
+  free (handle);
+done_buffers:
+  for (i = 0; i <= n_ports; i++)
+    free (bd->buffer[i].datas[0].data);
+  return res;
+}
+
+static int
+run_benchmark (AppData *data, uint32_t n_ports)
+{
+  static const struct {
+    const char *name;
+    uint32_t flag;
+  } simd[] = {
+    { "sse2", SPA_CPU_FLAG_SSE2 },
+    { "avx2", SPA_CPU_FLAG_AVX2 },
+    { "neon", SPA_CPU_FLAG_NEON },
+  };
+  BenchData *bd;
+  SpaResult res;
+  uint32_t formats[] = { data->type.audio_format.S16, data->type.audio_format.F32 };
+  double volumes[] = { 1.0, 0.5 };
+  uint32_t i, j, failures = 0, cpu_flags = spa_cpu_get_flags ();
+
+  /* a fast kernel is only worth timing when it mixes like the C one */
+  for (i = 0; i < SPA_N_ELEMENTS (simd); i++) {
+    if (cpu_flags & simd[i].flag)
+      failures += check_kernels (simd[i].name, simd[i].flag);
+  }
+  if (failures) {
+    printf ("%u kernel mismatches\n", failures);
+    return -1;
+  }
+
+  bd = calloc (1, sizeof (BenchData));
+  n_ports = SPA_CLAMP (n_ports, 1, BENCH_PORTS);
+
+  /* plain C kernels first, then the ones selected for this CPU */
+  for (i = 0; i < SPA_N_ELEMENTS (formats); i++) {
+    for (j = 0; j < SPA_N_ELEMENTS (volumes); j++) {
+      if ((res = benchmark_mixer (data, bd, n_ports, formats[i], volumes[j], "0")) < 0 ||
+          (res = benchmark_mixer (data, bd, n_ports, formats[i], volumes[j], NULL)) < 0) {
+        printf ("benchmark failed: %d\n", res);
+        free (bd);
+        return -1;
+      }
+    }
+  }
+  free (bd);
+  return 0;
 }
 
 int
@@ -589,6 +922,16 @@ main (int argc, char *argv[])
 
   init_type (&data.type, data.map);
 
+  if (argc > 1 && !strcmp (argv[1], "--benchmark"))
+    return run_benchmark (&data, argc > 2 ? atoi (argv[2]) : BENCH_PORTS);
+
+  /* "null" runs the graph into the null sink for a number of seconds */
+  data.duration = 1000;
+  if (argc > 1 && !strcmp (argv[1], "null")) {
+    data.null_sink = true;
+    data.duration = argc > 2 ? atoi (argv[2]) : 10;
+  }
+
   if ((res = make_nodes (&data, argc > 1 ? argv[1] : NULL)) < 0) {
     printf ("can't make nodes: %d\n", res);
     return -1;
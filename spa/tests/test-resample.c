@@ -0,0 +1,251 @@
+/* Spa
+ * Copyright (C) 2016 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <lib/cpu.h>
+
+#include <plugins/resample/resample-ops.h>
+
+#define N_SRC           4099
+#define MAX_DST         (N_SRC * 3)
+#define MAX_OFFSET      4
+
+static uint32_t failures;
+static uint32_t seed = 1;
+
+#define CHECK(expr, ...)                        \
+  do {                                          \
+    if (!(expr)) {                              \
+      if (failures++ < 20) {                    \
+        printf ("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf (__VA_ARGS__);                   \
+        printf ("\n");                          \
+      }                                         \
+    }                                           \
+  } while (0)
+
+typedef struct {
+  uint32_t in_rate;
+  uint32_t out_rate;
+  uint32_t n_taps;
+  double   cutoff;
+  bool     adaptive;
+  /* rate correction applied to an adaptive filter */
+  double   rate;
+} Config;
+
+static const Config configs[] = {
+  { 44100, 48000,  64, 0.93, false, 1.0 },
+  { 48000, 44100,  64, 0.93, false, 1.0 },
+  { 48000, 96000,  16, 0.80, false, 1.0 },
+  { 96000, 44100, 128, 0.96, false, 1.0 },
+  { 48000, 48000,  32, 0.88, true,  1.0 },
+  { 48000, 48000,  32, 0.88, true,  1.0005 },
+  { 44100, 48000,  64, 0.93, true,  0.9993 },
+};
+
+static uint32_t
+next_random (void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+static void
+make_filter (const Config *c, SpaResampleFilter *filter)
+{
+  spa_resample_filter_init (filter, c->in_rate, c->out_rate, c->n_taps, c->cutoff, c->adaptive);
+  if (c->adaptive)
+    spa_resample_filter_adjust (filter, c->rate);
+}
+
+/* the number of outputs from position 0 whose taps fit in @n_src, output
+ * n starts at input n * in_rate / out_rate */
+static uint32_t
+expected_output (const SpaResampleFilter *filter, uint32_t n_src)
+{
+  uint64_t end;
+
+  if (n_src < filter->n_taps)
+    return 0;
+  end = (uint64_t) (n_src - filter->n_taps + 1) * filter->out_rate;
+  return (end + filter->in_rate - 1) / filter->in_rate;
+}
+
+/* every SIMD kernel gives the same samples as the C version, for any
+ * length, destination stride and start */
+static void
+test_kernel (const char *name, SpaResampleFunc func)
+{
+  static float src[N_SRC + MAX_OFFSET], d1[MAX_DST * 2 + 8], d2[MAX_DST * 2 + 8];
+  uint32_t c, i, n, stride, o;
+
+  for (i = 0; i < SPA_N_ELEMENTS (src); i++)
+    src[i] = ((next_random () & 0xffff) / 32767.5f - 1.0f);
+
+  for (c = 0; c < SPA_N_ELEMENTS (configs); c++) {
+    SpaResampleFilter filter;
+
+    make_filter (&configs[c], &filter);
+
+    for (o = 0; o < MAX_OFFSET; o++) {
+      for (stride = 1; stride <= 2; stride++) {
+        for (n = filter.n_taps - 1; n < filter.n_taps + 40; n += 3) {
+          uint32_t idx1 = 0, ph1 = 0, idx2 = 0, ph2 = 0, r1, r2;
+
+          for (i = 0; i < SPA_N_ELEMENTS (d1); i++)
+            d1[i] = d2[i] = -42.0f;
+
+          r1 = func (&filter, &d1[o], stride, &src[o], n, &idx1, &ph1, MAX_DST);
+          r2 = spa_resample_process_c (&filter, &d2[o], stride, &src[o], n, &idx2, &ph2, MAX_DST);
+
+          CHECK (r1 == r2 && idx1 == idx2 && ph1 == ph2,
+              "%s: %u -> %u: %u samples: %u %u %u, not %u %u %u", name,
+              configs[c].in_rate, configs[c].out_rate, n, r1, idx1, ph1, r2, idx2, ph2);
+          for (i = 0; i < SPA_N_ELEMENTS (d1); i++)
+            CHECK (fabsf (d1[i] - d2[i]) <= 1e-5f, "%s: %u -> %u: %u samples, stride %u: %u is %g, not %g",
+                name, configs[c].in_rate, configs[c].out_rate, n, stride, i, d1[i], d2[i]);
+        }
+      }
+    }
+    spa_resample_filter_clear (&filter);
+  }
+}
+
+/* the number of output samples, the final position and the samples don't
+ * depend on how the output is split up */
+static void
+test_length (const char *name, SpaResampleFunc func)
+{
+  static float src[N_SRC], d1[MAX_DST], d2[MAX_DST];
+  uint32_t c, i;
+
+  for (i = 0; i < N_SRC; i++)
+    src[i] = ((next_random () & 0xffff) / 32767.5f - 1.0f);
+
+  for (c = 0; c < SPA_N_ELEMENTS (configs); c++) {
+    SpaResampleFilter filter;
+    uint32_t idx1 = 0, ph1 = 0, idx2 = 0, ph2 = 0, n1, n2 = 0, expect;
+    uint64_t pos;
+
+    make_filter (&configs[c], &filter);
+    expect = expected_output (&filter, N_SRC);
+    pos = (uint64_t) expect * filter.in_rate;
+
+    n1 = func (&filter, d1, 1, src, N_SRC, &idx1, &ph1, MAX_DST);
+    CHECK (n1 == expect, "%s: %u -> %u: %u samples, not %u", name,
+        configs[c].in_rate, configs[c].out_rate, n1, expect);
+    CHECK (idx1 == pos / filter.out_rate && ph1 == pos % filter.out_rate,
+        "%s: %u -> %u: ends at %u %u, not %u %u", name, configs[c].in_rate, configs[c].out_rate,
+        idx1, ph1, (uint32_t) (pos / filter.out_rate), (uint32_t) (pos % filter.out_rate));
+
+    /* odd sized pieces */
+    while (n2 < MAX_DST) {
+      uint32_t r = func (&filter, &d2[n2], 1, src, N_SRC, &idx2, &ph2, 1 + (n2 % 13));
+
+      if (r == 0)
+        break;
+      n2 += r;
+    }
+    CHECK (n2 == n1 && idx2 == idx1 && ph2 == ph1, "%s: %u -> %u: in pieces %u %u %u, not %u %u %u",
+        name, configs[c].in_rate, configs[c].out_rate, n2, idx2, ph2, n1, idx1, ph1);
+    for (i = 0; i < n1; i++)
+      CHECK (d1[i] == d2[i], "%s: %u -> %u: in pieces %u is %g, not %g", name,
+          configs[c].in_rate, configs[c].out_rate, i, d2[i], d1[i]);
+
+    spa_resample_filter_clear (&filter);
+  }
+}
+
+/* a sine in the passband comes out at the position of each output
+ * sample, which lies @n_taps / 2 - 1 after the index. Rounding an adaptive
+ * filter down to one of 1024 phases is off by more than 1e-4 here */
+static void
+test_phase (const char *name, SpaResampleFunc func)
+{
+  static float src[N_SRC], dst[MAX_DST];
+  uint32_t c, i;
+
+  for (c = 0; c < SPA_N_ELEMENTS (configs); c++) {
+    SpaResampleFilter filter;
+    uint32_t idx = 0, ph = 0, n;
+    /* 1 kHz, well inside the passband of every config */
+    double w = 2.0 * M_PI * 1000.0 / configs[c].in_rate, max_err = 0.0;
+
+    make_filter (&configs[c], &filter);
+
+    for (i = 0; i < N_SRC; i++)
+      src[i] = sin (w * i);
+
+    n = func (&filter, dst, 1, src, N_SRC, &idx, &ph, MAX_DST);
+    for (i = 0; i < n; i++) {
+      double pos = (double) i * filter.in_rate / filter.out_rate + filter.n_taps / 2 - 1;
+
+      max_err = SPA_MAX (max_err, fabs (dst[i] - sin (w * pos)));
+    }
+    CHECK (max_err < 1e-5, "%s: %u -> %u%s: sine is off by %g", name,
+        configs[c].in_rate, configs[c].out_rate, configs[c].adaptive ? " adaptive" : "", max_err);
+
+    spa_resample_filter_clear (&filter);
+  }
+}
+
+int
+main (int argc, char *argv[])
+{
+  static const struct {
+    const char *name;
+    uint32_t flag;
+  } simd[] = {
+    { "sse2", SPA_CPU_FLAG_SSE2 },
+    { "avx2", SPA_CPU_FLAG_AVX2 },
+    { "neon", SPA_CPU_FLAG_NEON },
+  };
+  SpaResampleOps ops;
+  uint32_t i, cpu_flags = spa_cpu_get_flags ();
+
+  printf ("checking c\n");
+  test_length ("c", spa_resample_process_c);
+  test_phase ("c", spa_resample_process_c);
+
+  for (i = 0; i < SPA_N_ELEMENTS (simd); i++) {
+    if (!(cpu_flags & simd[i].flag))
+      continue;
+    /* not built for this machine */
+    spa_resample_ops_init (&ops, simd[i].flag);
+    if (ops.cpu_flags != simd[i].flag)
+      continue;
+
+    printf ("checking %s\n", simd[i].name);
+    test_kernel (simd[i].name, ops.process);
+    test_length (simd[i].name, ops.process);
+    test_phase (simd[i].name, ops.process);
+  }
+
+  if (failures) {
+    printf ("%u failures\n", failures);
+    return 1;
+  }
+  printf ("all passed\n");
+  return 0;
+}
@@ -0,0 +1,381 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Pulls frames from the videotestsrc with a crop region set and checks
+ * that the region ends up in the VideoCrop metadata. The buffers only get
+ * the metadata the port enables in its params, like the link does. */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <dlfcn.h>
+
+#include <spa/node.h>
+#include <spa/log.h>
+#include <spa/loop.h>
+#include <spa/type-map.h>
+#include <spa/video/format-utils.h>
+#include <spa/format-utils.h>
+#include <spa/format-builder.h>
+#include <lib/mapper.h>
+#include <lib/debug.h>
+#include <lib/props.h>
+
+typedef struct {
+  uint32_t node;
+  uint32_t props;
+  uint32_t format;
+  uint32_t prop_live;
+  uint32_t prop_crop_x;
+  uint32_t prop_crop_y;
+  uint32_t prop_crop_width;
+  uint32_t prop_crop_height;
+  SpaTypeMeta meta;
+  SpaTypeData data;
+  SpaTypeMediaType media_type;
+  SpaTypeMediaSubtype media_subtype;
+  SpaTypeFormatVideo format_video;
+  SpaTypeVideoFormat video_format;
+  SpaTypeCommandNode command_node;
+  SpaTypeAllocParamMetaEnable alloc_param_meta_enable;
+} Type;
+
+static inline void
+init_type (Type *type, SpaTypeMap *map)
+{
+  type->node = spa_type_map_get_id (map, SPA_TYPE__Node);
+  type->props = spa_type_map_get_id (map, SPA_TYPE__Props);
+  type->format = spa_type_map_get_id (map, SPA_TYPE__Format);
+  type->prop_live = spa_type_map_get_id (map, SPA_TYPE_PROPS__live);
+  type->prop_crop_x = spa_type_map_get_id (map, SPA_TYPE_PROPS__cropX);
+  type->prop_crop_y = spa_type_map_get_id (map, SPA_TYPE_PROPS__cropY);
+  type->prop_crop_width = spa_type_map_get_id (map, SPA_TYPE_PROPS__cropWidth);
+  type->prop_crop_height = spa_type_map_get_id (map, SPA_TYPE_PROPS__cropHeight);
+  spa_type_meta_map (map, &type->meta);
+  spa_type_data_map (map, &type->data);
+  spa_type_media_type_map (map, &type->media_type);
+  spa_type_media_subtype_map (map, &type->media_subtype);
+  spa_type_format_video_map (map, &type->format_video);
+  spa_type_video_format_map (map, &type->video_format);
+  spa_type_command_node_map (map, &type->command_node);
+  spa_type_alloc_param_meta_enable_map (map, &type->alloc_param_meta_enable);
+}
+
+#define TEST_FRAMES     8
+#define TEST_WIDTH      320
+#define TEST_HEIGHT     240
+#define TEST_SIZE       (TEST_WIDTH * TEST_HEIGHT * 2)
+#define N_BUFFERS       2
+#define MAX_METAS       4
+
+typedef struct {
+  SpaBuffer buffer;
+  SpaMeta metas[MAX_METAS];
+  uint8_t meta_data[MAX_METAS][64];
+  SpaData datas[1];
+  SpaChunk chunks[1];
+  uint8_t *mem;
+} Buffer;
+
+typedef struct {
+  SpaTypeMap *map;
+  SpaLog *log;
+  Type type;
+
+  SpaSupport support[2];
+  uint32_t   n_support;
+
+  SpaNode   *source;
+  SpaPortIO  io;
+
+  SpaBuffer *buffers[N_BUFFERS];
+  Buffer     buffer[N_BUFFERS];
+} AppData;
+
+static SpaResult
+make_node (AppData *data, SpaNode **node, const char *lib, const char *name)
+{
+  SpaHandle *handle;
+  SpaResult res;
+  void *hnd;
+  SpaEnumHandleFactoryFunc enum_func;
+  uint32_t i;
+
+  if ((hnd = dlopen (lib, RTLD_NOW)) == NULL) {
+    printf ("can't load %s: %s\n", lib, dlerror());
+    return SPA_RESULT_ERROR;
+  }
+  if ((enum_func = dlsym (hnd, "spa_enum_handle_factory")) == NULL) {
+    printf ("can't find enum function\n");
+    return SPA_RESULT_ERROR;
+  }
+
+  for (i = 0; ;i++) {
+    const SpaHandleFactory *factory;
+    void *iface;
+
+    if ((res = enum_func (&factory, i)) < 0) {
+      if (res != SPA_RESULT_ENUM_END)
+        printf ("can't enumerate factories: %d\n", res);
+      break;
+    }
+    if (strcmp (factory->name, name))
+      continue;
+
+    handle = calloc (1, factory->size);
+    if ((res = spa_handle_factory_init (factory, handle, NULL, data->support, data->n_support)) < 0) {
+      printf ("can't make factory instance: %d\n", res);
+      return res;
+    }
+    if ((res = spa_handle_get_interface (handle, data->type.node, &iface)) < 0) {
+      printf ("can't get interface %d\n", res);
+      return res;
+    }
+    *node = iface;
+    return SPA_RESULT_OK;
+  }
+  return SPA_RESULT_ERROR;
+}
+
+static SpaResult
+set_props (AppData *data, int32_t x, int32_t y, int32_t width, int32_t height)
+{
+  SpaPODBuilder b = { NULL, };
+  SpaPODFrame f[2];
+  uint8_t buffer[256];
+
+  spa_pod_builder_init (&b, buffer, sizeof (buffer));
+  spa_pod_builder_props (&b, &f[0], data->type.props,
+      SPA_POD_PROP (&f[1], data->type.prop_live, 0, SPA_POD_TYPE_BOOL, 1, false),
+      SPA_POD_PROP (&f[1], data->type.prop_crop_x, 0, SPA_POD_TYPE_INT, 1, x),
+      SPA_POD_PROP (&f[1], data->type.prop_crop_y, 0, SPA_POD_TYPE_INT, 1, y),
+      SPA_POD_PROP (&f[1], data->type.prop_crop_width, 0, SPA_POD_TYPE_INT, 1, width),
+      SPA_POD_PROP (&f[1], data->type.prop_crop_height, 0, SPA_POD_TYPE_INT, 1, height));
+
+  return spa_node_set_props (data->source, SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaProps));
+}
+
+static SpaResult
+set_format (AppData *data)
+{
+  SpaPODBuilder b = { NULL, };
+  SpaPODFrame f[2];
+  uint8_t buffer[256];
+
+  spa_pod_builder_init (&b, buffer, sizeof (buffer));
+  spa_pod_builder_format (&b, &f[0], data->type.format,
+      data->type.media_type.video, data->type.media_subtype.raw,
+      SPA_POD_PROP (&f[1], data->type.format_video.format, 0,
+                           SPA_POD_TYPE_ID, 1,
+                           data->type.video_format.UYVY),
+      SPA_POD_PROP (&f[1], data->type.format_video.size, 0,
+                           SPA_POD_TYPE_RECTANGLE, 1,
+                           TEST_WIDTH, TEST_HEIGHT),
+      SPA_POD_PROP (&f[1], data->type.format_video.framerate, 0,
+                           SPA_POD_TYPE_FRACTION, 1,
+                           30, 1));
+
+  return spa_node_port_set_format (data->source, SPA_DIRECTION_OUTPUT, 0, 0,
+                                   SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaFormat));
+}
+
+/* add the metadata that the port enables, with the size it asks for */
+static SpaResult
+init_buffers (AppData *data)
+{
+  const SpaPortInfo *info;
+  SpaResult res;
+  uint32_t i, j;
+
+  if ((res = spa_node_port_get_info (data->source, SPA_DIRECTION_OUTPUT, 0, &info)) < 0)
+    return res;
+
+  for (i = 0; i < N_BUFFERS; i++) {
+    Buffer *b = &data->buffer[i];
+    uint32_t n_metas = 0;
+
+    data->buffers[i] = &b->buffer;
+
+    for (j = 0; j < info->n_params; j++) {
+      SpaAllocParam *ap = info->params[j];
+      uint32_t type, size;
+
+      if (ap->body.body.type != data->type.alloc_param_meta_enable.MetaEnable)
+        continue;
+      if (spa_alloc_param_query (ap,
+            data->type.alloc_param_meta_enable.type, SPA_POD_TYPE_ID, &type,
+            data->type.alloc_param_meta_enable.size, SPA_POD_TYPE_INT, &size,
+            0) != 2)
+        continue;
+      if (n_metas == MAX_METAS || size > sizeof (b->meta_data[0]))
+        return SPA_RESULT_ERROR;
+
+      memset (b->meta_data[n_metas], 0, size);
+      b->metas[n_metas].type = type;
+      b->metas[n_metas].data = b->meta_data[n_metas];
+      b->metas[n_metas].size = size;
+      n_metas++;
+    }
+
+    b->buffer.id = i;
+    b->buffer.n_metas = n_metas;
+    b->buffer.metas = b->metas;
+    b->buffer.n_datas = 1;
+    b->buffer.datas = b->datas;
+
+    b->mem = malloc (TEST_SIZE);
+    b->datas[0].type = data->type.data.MemPtr;
+    b->datas[0].flags = 0;
+    b->datas[0].fd = -1;
+    b->datas[0].mapoffset = 0;
+    b->datas[0].maxsize = TEST_SIZE;
+    b->datas[0].data = b->mem;
+    b->datas[0].chunk = &b->chunks[0];
+    b->datas[0].chunk->offset = 0;
+    b->datas[0].chunk->size = 0;
+    b->datas[0].chunk->stride = 0;
+  }
+  return SPA_RESULT_OK;
+}
+
+static void
+free_buffers (AppData *data)
+{
+  uint32_t i;
+
+  for (i = 0; i < N_BUFFERS; i++)
+    free (data->buffer[i].mem);
+}
+
+static SpaResult
+run_crop (AppData *data,
+          int32_t x, int32_t y, int32_t width, int32_t height,
+          const SpaMetaVideoCrop *expected)
+{
+  SpaResult res;
+  uint32_t i;
+
+  if ((res = set_props (data, x, y, width, height)) < 0) {
+    printf ("can't set props: %d\n", res);
+    return res;
+  }
+  if ((res = set_format (data)) < 0) {
+    printf ("can't set format: %d\n", res);
+    return res;
+  }
+  if ((res = init_buffers (data)) < 0) {
+    printf ("can't init buffers: %d\n", res);
+    return res;
+  }
+  if ((res = spa_node_port_use_buffers (data->source, SPA_DIRECTION_OUTPUT, 0,
+                                        data->buffers, N_BUFFERS)) < 0) {
+    printf ("can't use buffers: %d\n", res);
+    goto done;
+  }
+  {
+    SpaCommand cmd = SPA_COMMAND_INIT (data->type.command_node.Start);
+    if ((res = spa_node_send_command (data->source, &cmd)) < 0) {
+      printf ("can't start: %d\n", res);
+      goto done;
+    }
+  }
+
+  data->io.status = SPA_RESULT_NEED_BUFFER;
+  data->io.buffer_id = SPA_ID_INVALID;
+
+  for (i = 0; i < TEST_FRAMES; i++) {
+    SpaMetaVideoCrop *crop;
+
+    if ((res = spa_node_process_output (data->source)) != SPA_RESULT_HAVE_BUFFER) {
+      printf ("process_output error: %d\n", res);
+      res = SPA_RESULT_ERROR;
+      goto done;
+    }
+    crop = spa_buffer_find_meta (data->buffers[data->io.buffer_id], data->type.meta.VideoCrop);
+    if (crop == NULL) {
+      printf ("buffer %u has no crop metadata\n", data->io.buffer_id);
+      res = SPA_RESULT_ERROR;
+      goto done;
+    }
+    if (crop->x != expected->x || crop->y != expected->y ||
+        crop->width != expected->width || crop->height != expected->height) {
+      printf ("frame %u: crop %d,%d %dx%d, expected %d,%d %dx%d\n", i,
+          crop->x, crop->y, crop->width, crop->height,
+          expected->x, expected->y, expected->width, expected->height);
+      res = SPA_RESULT_ERROR;
+      goto done;
+    }
+    /* give the buffer back with the next pull */
+    data->io.status = SPA_RESULT_NEED_BUFFER;
+  }
+  printf ("  crop %d,%d %dx%d -> %d,%d %dx%d ok\n", x, y, width, height,
+      expected->x, expected->y, expected->width, expected->height);
+  res = SPA_RESULT_OK;
+
+done:
+  {
+    SpaCommand cmd = SPA_COMMAND_INIT (data->type.command_node.Pause);
+    spa_node_send_command (data->source, &cmd);
+  }
+  spa_node_port_use_buffers (data->source, SPA_DIRECTION_OUTPUT, 0, NULL, 0);
+  free_buffers (data);
+
+  return res;
+}
+
+int
+main (int argc, char *argv[])
+{
+  AppData data = { NULL };
+  SpaResult res;
+  const char *str;
+  static const SpaMetaVideoCrop inside = { 16, 8, 160, 120 };
+  static const SpaMetaVideoCrop clipped = { 240, 200, 80, 40 };
+  static const SpaMetaVideoCrop full = { 0, 0, TEST_WIDTH, TEST_HEIGHT };
+
+  data.map = spa_type_map_get_default();
+  data.log = spa_log_get_default();
+
+  if ((str = getenv ("PINOS_DEBUG")))
+    data.log->level = atoi (str);
+
+  data.support[0].type = SPA_TYPE__TypeMap;
+  data.support[0].data = data.map;
+  data.support[1].type = SPA_TYPE__Log;
+  data.support[1].data = data.log;
+  data.n_support = 2;
+
+  init_type (&data.type, data.map);
+
+  if ((res = make_node (&data, &data.source, "build/spa/plugins/videotestsrc/libspa-videotestsrc.so", "videotestsrc")) < 0) {
+    printf ("can't create videotestsrc: %d\n", res);
+    return -1;
+  }
+  spa_node_port_set_io (data.source, SPA_DIRECTION_OUTPUT, 0, &data.io);
+
+  printf ("%dx%d, %d frames\n", TEST_WIDTH, TEST_HEIGHT, TEST_FRAMES);
+
+  if ((res = run_crop (&data, 16, 8, 160, 120, &inside)) < 0 ||
+      (res = run_crop (&data, 240, 200, 160, 120, &clipped)) < 0 ||
+      (res = run_crop (&data, 0, 0, 0, 0, &full)) < 0) {
+    printf ("test failed: %d\n", res);
+    return -1;
+  }
+  return 0;
+}
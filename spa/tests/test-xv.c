@@ -0,0 +1,438 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Shows frames with the xv-sink, first in buffers allocated by the sink,
+ * then in our own memory. Needs an X server with Xv, run it with
+ * xvfb-run to test without a display. */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <dlfcn.h>
+#include <poll.h>
+#include <inttypes.h>
+
+#include <spa/node.h>
+#include <spa/log.h>
+#include <spa/loop.h>
+#include <spa/type-map.h>
+#include <spa/video/format-utils.h>
+#include <spa/format-utils.h>
+#include <spa/format-builder.h>
+#include <lib/mapper.h>
+#include <lib/debug.h>
+#include <lib/props.h>
+
+typedef struct {
+  uint32_t node;
+  uint32_t props;
+  uint32_t format;
+  uint32_t prop_cycles;
+  uint32_t prop_dropped_frames;
+  uint32_t prop_min_cycle_time;
+  uint32_t prop_max_cycle_time;
+  uint32_t prop_avg_cycle_time;
+  SpaTypeMeta meta;
+  SpaTypeData data;
+  SpaTypeMediaType media_type;
+  SpaTypeMediaSubtype media_subtype;
+  SpaTypeFormatVideo format_video;
+  SpaTypeVideoFormat video_format;
+  SpaTypeCommandNode command_node;
+} Type;
+
+static inline void
+init_type (Type *type, SpaTypeMap *map)
+{
+  type->node = spa_type_map_get_id (map, SPA_TYPE__Node);
+  type->props = spa_type_map_get_id (map, SPA_TYPE__Props);
+  type->format = spa_type_map_get_id (map, SPA_TYPE__Format);
+  type->prop_cycles = spa_type_map_get_id (map, SPA_TYPE_PROPS__cycles);
+  type->prop_dropped_frames = spa_type_map_get_id (map, SPA_TYPE_PROPS__droppedFrames);
+  type->prop_min_cycle_time = spa_type_map_get_id (map, SPA_TYPE_PROPS__minCycleTime);
+  type->prop_max_cycle_time = spa_type_map_get_id (map, SPA_TYPE_PROPS__maxCycleTime);
+  type->prop_avg_cycle_time = spa_type_map_get_id (map, SPA_TYPE_PROPS__avgCycleTime);
+  spa_type_meta_map (map, &type->meta);
+  spa_type_data_map (map, &type->data);
+  spa_type_media_type_map (map, &type->media_type);
+  spa_type_media_subtype_map (map, &type->media_subtype);
+  spa_type_format_video_map (map, &type->format_video);
+  spa_type_video_format_map (map, &type->video_format);
+  spa_type_command_node_map (map, &type->command_node);
+}
+
+#define TEST_FRAMES     300
+#define TEST_WIDTH      640
+#define TEST_HEIGHT     480
+#define TEST_SIZE       (TEST_WIDTH * TEST_HEIGHT * 2)
+#define N_BUFFERS       4
+
+typedef struct {
+  SpaBuffer buffer;
+  SpaMeta metas[2];
+  SpaMetaHeader header;
+  SpaMetaVideoCrop crop;
+  SpaData datas[1];
+  SpaChunk chunks[1];
+} Buffer;
+
+typedef struct {
+  SpaTypeMap *map;
+  SpaLog *log;
+  SpaLoop data_loop;
+  Type type;
+
+  SpaSupport support[3];
+  uint32_t   n_support;
+
+  SpaNode   *sink;
+  SpaPortIO  io;
+
+  SpaSource  source;
+  bool       have_source;
+
+  SpaBuffer *buffers[N_BUFFERS];
+  Buffer     buffer[N_BUFFERS];
+  bool       free[N_BUFFERS];
+} AppData;
+
+static SpaResult
+make_node (AppData *data, SpaNode **node, const char *lib, const char *name)
+{
+  SpaHandle *handle;
+  SpaResult res;
+  void *hnd;
+  SpaEnumHandleFactoryFunc enum_func;
+  uint32_t i;
+
+  if ((hnd = dlopen (lib, RTLD_NOW)) == NULL) {
+    printf ("can't load %s: %s\n", lib, dlerror());
+    return SPA_RESULT_ERROR;
+  }
+  if ((enum_func = dlsym (hnd, "spa_enum_handle_factory")) == NULL) {
+    printf ("can't find enum function\n");
+    return SPA_RESULT_ERROR;
+  }
+
+  for (i = 0; ;i++) {
+    const SpaHandleFactory *factory;
+    void *iface;
+
+    if ((res = enum_func (&factory, i)) < 0) {
+      if (res != SPA_RESULT_ENUM_END)
+        printf ("can't enumerate factories: %d\n", res);
+      break;
+    }
+    if (strcmp (factory->name, name))
+      continue;
+
+    handle = calloc (1, factory->size);
+    if ((res = spa_handle_factory_init (factory, handle, NULL, data->support, data->n_support)) < 0) {
+      printf ("can't make factory instance: %d\n", res);
+      return res;
+    }
+    if ((res = spa_handle_get_interface (handle, data->type.node, &iface)) < 0) {
+      printf ("can't get interface %d\n", res);
+      return res;
+    }
+    *node = iface;
+    return SPA_RESULT_OK;
+  }
+  return SPA_RESULT_ERROR;
+}
+
+static void
+on_reuse_buffer (SpaNode *node, uint32_t port_id, uint32_t buffer_id, void *user_data)
+{
+  AppData *data = user_data;
+
+  data->free[buffer_id] = true;
+}
+
+static const SpaNodeCallbacks sink_callbacks = {
+  .reuse_buffer = on_reuse_buffer,
+};
+
+static SpaResult
+do_add_source (SpaLoop   *loop,
+               SpaSource *source)
+{
+  AppData *data = SPA_CONTAINER_OF (loop, AppData, data_loop);
+
+  data->source = *source;
+  data->have_source = true;
+
+  return SPA_RESULT_OK;
+}
+
+static SpaResult
+do_update_source (SpaSource  *source)
+{
+  return SPA_RESULT_OK;
+}
+
+static void
+do_remove_source (SpaSource  *source)
+{
+}
+
+static SpaResult
+do_invoke (SpaLoop       *loop,
+           SpaInvokeFunc  func,
+           uint32_t       seq,
+           size_t         size,
+           void          *data,
+           void          *user_data)
+{
+  return func (loop, false, seq, size, data, user_data);
+}
+
+/* dispatch the events of the X connection, wait at most @timeout ms */
+static void
+iterate (AppData *data, int timeout)
+{
+  struct pollfd pfd;
+
+  if (!data->have_source)
+    return;
+
+  pfd.fd = data->source.fd;
+  pfd.events = POLLIN;
+
+  if (poll (&pfd, 1, timeout) <= 0)
+    return;
+
+  data->source.rmask = 0;
+  if (pfd.revents & POLLIN)
+    data->source.rmask |= SPA_IO_IN;
+  if (pfd.revents & (POLLERR | POLLHUP))
+    data->source.rmask |= SPA_IO_ERR;
+  data->source.func (&data->source);
+}
+
+static void
+init_buffers (AppData *data, bool alloc)
+{
+  uint32_t i;
+
+  for (i = 0; i < N_BUFFERS; i++) {
+    Buffer *b = &data->buffer[i];
+    data->buffers[i] = &b->buffer;
+    data->free[i] = true;
+
+    b->buffer.id = i;
+    b->buffer.n_metas = 2;
+    b->buffer.metas = b->metas;
+    b->buffer.n_datas = 1;
+    b->buffer.datas = b->datas;
+
+    memset (&b->header, 0, sizeof (b->header));
+    b->metas[0].type = data->type.meta.Header;
+    b->metas[0].data = &b->header;
+    b->metas[0].size = sizeof (b->header);
+
+    memset (&b->crop, 0, sizeof (b->crop));
+    b->metas[1].type = data->type.meta.VideoCrop;
+    b->metas[1].data = &b->crop;
+    b->metas[1].size = sizeof (b->crop);
+
+    b->datas[0].type = data->type.data.MemPtr;
+    b->datas[0].flags = 0;
+    b->datas[0].fd = -1;
+    b->datas[0].mapoffset = 0;
+    b->datas[0].maxsize = TEST_SIZE;
+    b->datas[0].data = alloc ? NULL : malloc (TEST_SIZE);
+    b->datas[0].chunk = &b->chunks[0];
+    b->datas[0].chunk->offset = 0;
+    b->datas[0].chunk->size = TEST_SIZE;
+    b->datas[0].chunk->stride = 0;
+  }
+}
+
+static SpaResult
+set_format (AppData *data)
+{
+  SpaResult res;
+  SpaFormat *format;
+  SpaVideoInfoRaw info;
+  SpaPODBuilder b = { NULL, };
+  SpaPODFrame f[2];
+  uint8_t buffer[256];
+
+  /* take the first format the adaptor has */
+  if ((res = spa_node_port_enum_formats (data->sink, SPA_DIRECTION_INPUT, 0, &format, NULL, 0)) < 0)
+    return res;
+  if (!spa_format_video_raw_parse (format, &info, &data->type.format_video))
+    return SPA_RESULT_INVALID_MEDIA_TYPE;
+
+  spa_pod_builder_init (&b, buffer, sizeof (buffer));
+  spa_pod_builder_format (&b, &f[0], data->type.format,
+      data->type.media_type.video, data->type.media_subtype.raw,
+      SPA_POD_PROP (&f[1], data->type.format_video.format, 0,
+                           SPA_POD_TYPE_ID, 1,
+                           info.format),
+      SPA_POD_PROP (&f[1], data->type.format_video.size, 0,
+                           SPA_POD_TYPE_RECTANGLE, 1,
+                           TEST_WIDTH, TEST_HEIGHT),
+      SPA_POD_PROP (&f[1], data->type.format_video.framerate, 0,
+                           SPA_POD_TYPE_FRACTION, 1,
+                           30, 1));
+
+  return spa_node_port_set_format (data->sink, SPA_DIRECTION_INPUT, 0, 0,
+                                   SPA_POD_BUILDER_DEREF (&b, f[0].ref, SpaFormat));
+}
+
+static void
+print_stats (AppData *data, const char *what)
+{
+  SpaProps *props;
+  int64_t frames = 0, min = 0, max = 0, avg = 0;
+  int32_t dropped = 0;
+
+  if (spa_node_get_props (data->sink, &props) < 0)
+    return;
+
+  spa_props_query (props,
+      data->type.prop_cycles, SPA_POD_TYPE_LONG, &frames,
+      data->type.prop_dropped_frames, SPA_POD_TYPE_INT, &dropped,
+      data->type.prop_min_cycle_time, SPA_POD_TYPE_LONG, &min,
+      data->type.prop_max_cycle_time, SPA_POD_TYPE_LONG, &max,
+      data->type.prop_avg_cycle_time, SPA_POD_TYPE_LONG, &avg,
+      0);
+
+  printf ("  %-6s %5"PRIi64" frames, %4d dropped, frame time min %6.2f ms avg %6.2f ms max %6.2f ms\n",
+      what, frames, dropped,
+      (double) min / SPA_NSEC_PER_MSEC,
+      (double) avg / SPA_NSEC_PER_MSEC,
+      (double) max / SPA_NSEC_PER_MSEC);
+}
+
+static SpaResult
+run_sink (AppData *data, bool alloc, const char *what)
+{
+  SpaResult res;
+  uint32_t i, j, n_buffers = N_BUFFERS;
+
+  init_buffers (data, alloc);
+
+  if ((res = set_format (data)) < 0) {
+    printf ("can't set format: %d\n", res);
+    return res;
+  }
+
+  if (alloc)
+    res = spa_node_port_alloc_buffers (data->sink, SPA_DIRECTION_INPUT, 0, NULL, 0,
+                                       data->buffers, &n_buffers);
+  else
+    res = spa_node_port_use_buffers (data->sink, SPA_DIRECTION_INPUT, 0,
+                                     data->buffers, n_buffers);
+  if (res < 0) {
+    printf ("can't get buffers: %d\n", res);
+    return res;
+  }
+
+  {
+    SpaCommand cmd = SPA_COMMAND_INIT (data->type.command_node.Start);
+    if ((res = spa_node_send_command (data->sink, &cmd)) < 0) {
+      printf ("can't start: %d\n", res);
+      return res;
+    }
+  }
+
+  for (i = 0; i < TEST_FRAMES; i++) {
+    SpaData *d;
+
+    /* wait for the server to give back a buffer */
+    for (j = 0; j < n_buffers && !data->free[j]; j++);
+    while (j == n_buffers) {
+      iterate (data, 100);
+      for (j = 0; j < n_buffers && !data->free[j]; j++);
+    }
+    data->free[j] = false;
+
+    d = data->buffers[j]->datas;
+    memset (d[0].data, (i * 4) & 0xff, d[0].maxsize);
+
+    data->io.status = SPA_RESULT_HAVE_BUFFER;
+    data->io.buffer_id = j;
+    if ((res = spa_node_process_input (data->sink)) < 0) {
+      printf ("process_input error: %d\n", res);
+      return res;
+    }
+    iterate (data, 0);
+  }
+
+  {
+    SpaCommand cmd = SPA_COMMAND_INIT (data->type.command_node.Pause);
+    spa_node_send_command (data->sink, &cmd);
+  }
+  print_stats (data, what);
+
+  if (!alloc) {
+    for (i = 0; i < N_BUFFERS; i++)
+      free (data->buffer[i].datas[0].data);
+  }
+  return SPA_RESULT_OK;
+}
+
+int
+main (int argc, char *argv[])
+{
+  AppData data = { NULL };
+  SpaResult res;
+  const char *str;
+
+  data.map = spa_type_map_get_default();
+  data.log = spa_log_get_default();
+
+  if ((str = getenv ("PINOS_DEBUG")))
+    data.log->level = atoi (str);
+
+  data.data_loop.size = sizeof (SpaLoop);
+  data.data_loop.add_source = do_add_source;
+  data.data_loop.update_source = do_update_source;
+  data.data_loop.remove_source = do_remove_source;
+  data.data_loop.invoke = do_invoke;
+
+  data.support[0].type = SPA_TYPE__TypeMap;
+  data.support[0].data = data.map;
+  data.support[1].type = SPA_TYPE__Log;
+  data.support[1].data = data.log;
+  data.support[2].type = SPA_TYPE_LOOP__DataLoop;
+  data.support[2].data = &data.data_loop;
+  data.n_support = 3;
+
+  init_type (&data.type, data.map);
+
+  if ((res = make_node (&data, &data.sink, "build/spa/plugins/xv/libspa-xv.so", "xv-sink")) < 0) {
+    printf ("can't create xv-sink: %d\n", res);
+    return -1;
+  }
+  spa_node_set_callbacks (data.sink, &sink_callbacks, sizeof (sink_callbacks), &data);
+  spa_node_port_set_io (data.sink, SPA_DIRECTION_INPUT, 0, &data.io);
+
+  printf ("%dx%d, %d frames\n", TEST_WIDTH, TEST_HEIGHT, TEST_FRAMES);
+
+  if ((res = run_sink (&data, true, "shared")) < 0 ||
+      (res = run_sink (&data, false, "copy")) < 0) {
+    printf ("test failed: %d\n", res);
+    return -1;
+  }
+  return 0;
+}